@@ -6,6 +6,7 @@
 #include "mstsequence.h"
 #include "mstcondeg.h"
 #include "mstmagic.h"
+#include <mutex>
 using namespace MST;
 
 class EnergyTable;
@@ -28,6 +29,43 @@ class termData;
  *         present in too many of the matches, because we actually try to keep as large of a TERM as possible.
  */
 
+/* A content-addressed store of TERM matches: for each searched TERM, keyed by
+ * its exact geometry and the options it was searched with, the addresses and
+ * RMSDs of its matches. Designs on the same template (with different variable
+ * positions, alphabets, or specificity contexts) search many of the same TERMs,
+ * and with a store only the first search of each TERM needs to be done; the
+ * statistics that depend on the alphabet are still computed from the matches
+ * each time. Lookups and insertions can happen from different threads. */
+class termMatchStore {
+  public:
+    termMatchStore() {}
+
+    /* The key of the given TERM searched with the given options. Returns an
+     * empty string if the search can not be stored (i.e., the options have
+     * gap, chain, or sequence constraints). */
+    static string key(const Structure& term, const fasstSearchOptions& opts, bool autoSplitChains = true);
+
+    bool find(const string& key, fasstSolutionSet& sols) const; // returns false if not present
+    void insert(const string& key, const fasstSolutionSet& sols);
+    int size() const;
+    void clear();
+
+    /* The store is only meaningful for the database it was built with, so the
+     * number of targets in that database is written along with it and checked
+     * upon reading. Reading adds to any entries already in the store. */
+    void write(const string& file, int numTargets) const;
+    void read(const string& file, int numTargets);
+
+  private:
+    struct entry {
+      vector<int> segLengths;
+      vector<fasstSolutionAddress> addresses;
+      vector<mstreal> rmsds;
+    };
+    map<string, entry> entries;
+    mutable mutex lock;
+};
+
 class dTERMen {
   public:
     dTERMen();
@@ -37,6 +75,25 @@ class dTERMen {
     void setEnergyFunction(const string& ver); // sets the energy function version and alters any necessary parameters
     void setRecordFlag(bool record = true) { recordData = record; }
 
+    /* The number of threads with which buildEnergyTable computes energies
+     * (default is 1). Every self and pair TERM then becomes a separate task,
+     * with tasks handed out to workers as they free up. Each worker searches
+     * with its own FASST object over the shared database, and results are
+     * combined into the table in the same order as with a single thread, so the
+     * table does not depend on the number of threads. */
+    void setNumThreads(int n);
+    int getNumThreads() const { return numThreads; }
+
+    /* With a match store (see termMatchStore), every TERM search first looks
+     * for the TERM in the store and only searches if it is not there, adding the
+     * matches it finds. readMatchStore() turns the store on and loads entries
+     * from a file written by writeMatchStore() with the same database. */
+    void setMatchStoreFlag(bool use = true) { useStore = use; }
+    bool getMatchStoreFlag() const { return useStore; }
+    void readMatchStore(const string& file);
+    void writeMatchStore(const string& file);
+    termMatchStore& getMatchStore() { return store; }
+
     /* Builds an energy table for design. Parameters:
      * - a list of mutable positions as vector<Residue*>. All residues must belong
      *   to a single Structure objects.
@@ -96,15 +153,65 @@ class dTERMen {
     struct zeroDimPotType { // NOTE: in the future, these should become classes with overloaded "access" operators for lookup
       vector<mstreal> aaEnergies;
     };
+    /* Finds the bin a value falls into (as findBin() does) in constant time.
+     * The range of the bins is split into uniform cells no wider than the
+     * narrowest bin (but no more than maxCells of them), each cell knowing the
+     * bin its start falls into, so the bin of a value is that of its cell or
+     * (if a bin edge falls within the cell) one of its neighbors. */
+    class binLookup {
+      public:
+        binLookup() { lo = hi = invWidth = 0; }
+        void compile(const vector<mstreal>& binEdges);
+        // returns the bin index, or -1 if x is outside of the range of bins
+        int bin(mstreal x) const {
+          if (!((x >= lo) && (x <= hi))) return -1;
+          int c = MstUtils::min((int) ((x - lo)*invWidth), (int) cellBin.size() - 1);
+          int k = cellBin[c], nb = edges.size() - 1;
+          while ((k < nb - 1) && (x >= edges[k+1])) k++;
+          while ((k > 0) && (x < edges[k])) k--;
+          return k;
+        }
+        static const int maxCells = 4096;
+
+      private:
+        vector<mstreal> edges;
+        mstreal lo, hi, invWidth;
+        vector<int> cellBin;
+    };
+    /* Potentials keep energies as built (aaEnergies), and, once compiled (which
+     * building and reading potentials does), also in one contiguous array, with
+     * energies of all amino acids in each bin together, for lookup. */
     struct oneDimPotType {
       vector<mstreal> binEdges;
       vector<vector<mstreal> > aaEnergies;
+
+      void compile();
+      // energies of all amino acids for the value x, or NULL if x is out of range
+      const mstreal* energies(mstreal x) const { int k = bins.bin(x); return (k < 0) ? NULL : &(flat[k*naa]); }
+      binLookup bins;
+      vector<mstreal> flat;
+      int naa = 0;
     };
     struct twoDimPotType {
       vector<mstreal> xBinEdges;
       vector<mstreal> yBinEdges;
       vector<vector<vector<mstreal> > > aaEnergies;
+
+      void compile();
+      const mstreal* energies(mstreal x, mstreal y) const {
+        int kx = xBins.bin(x); if (kx < 0) return NULL;
+        int ky = yBins.bin(y); if (ky < 0) return NULL;
+        return &(flat[(kx*nyb + ky)*naa]);
+      }
+      binLookup xBins, yBins;
+      vector<mstreal> flat;
+      int nyb = 0, naa = 0;
     };
+    /* Builds background potentials from the residues of the database. Residue
+     * data are gathered from targets with as many threads as set by
+     * setNumThreads() (so set the number of threads before reading a config-
+     * uration file, for this to apply on start-up), and the three histograms
+     * are binned concurrently. */
     void buildBackgroundPotentials();
     zeroDimPotType buildZeroDimPotential(const vector<int>& AA, vector<vector<mstreal> >& backPot);
     oneDimPotType buildOneDimPotential(const oneDimHist& H, const vector<int>& AA, mstreal pc, vector<vector<mstreal> >& backPot, bool updateBackPot = false);
@@ -142,8 +249,18 @@ class dTERMen {
     oneDimHist binData(const vector<mstreal>& X, int binSpecType, const vector<mstreal>& binSpec, const vector<mstreal>& M = vector<mstreal>(), bool isAngle = false);
     twoDimHist binData(const vector<mstreal>& X, const vector<mstreal>& Y, const vector<mstreal>& xBinSpec, const vector<mstreal>& yBinSpec, const vector<mstreal>& M = vector<mstreal>(), bool isAngle = false);
 
-    void readBackgroundPotentials(const string& file);  // TODO
-    void writeBackgroundPotentials(const string& file); // TODO
+    /* Background potentials depend only on the database and on the amino-acid
+     * alphabet, and take a pass over every residue of the database to build, so
+     * they can be written once and read back in later runs. If the configuration
+     * file names a background potential file ("backpot = <file>"), potentials
+     * are read from it when it is valid, and otherwise built and written to it.
+     * A file is valid if it was written in the current format, for a database
+     * with the same content (judged by a checksum of the residue data the
+     * potentials are built from) and with the same alphabet; otherwise,
+     * readBackgroundPotentials() leaves potentials as they are and returns
+     * false. */
+    bool readBackgroundPotentials(const string& file);
+    void writeBackgroundPotentials(const string& file);
     void writeRecordedData(const string& file); // writes all recorded TERM data to a file
 
     mstreal backEner(const string& aa) { return lookupZeroDimPotential(bkPot, aaToIndex(aa)); }
@@ -165,6 +282,10 @@ class dTERMen {
 
     mstreal pairEnergy(Residue* Ri, Residue* Rj, const string& aai = "", const string& aaj = "");
     vector<vector<mstreal>> pairEnergies(Residue* Ri, Residue* Rj, bool verbose = false);
+    /* Same as above, but for a list of residue pairs at once. TERM searches for
+     * all pairs are done as a single batch (see FASST::searchBatch), which saves
+     * a pass over the database for every pair. */
+    vector<vector<vector<mstreal>>> pairEnergies(const vector<pair<Residue*, Residue*>>& pairs, bool verbose = false);
     vector<vector<mstreal>> pairEnergiesNew(Residue* Ri, Residue* Rj, bool verbose = false);
     vector<vector<mstreal>> pairEnergiesNew2(Residue* Ri, Residue* Rj, bool verbose = false);
 
@@ -175,22 +296,65 @@ class dTERMen {
     mstreal bbPhiPsiEner(mstreal phi, mstreal psi, int aai) { return lookupTwoDimPotential(ppPot, phi, psi, aai); }
     mstreal envEner(mstreal env, int aai) { return lookupOneDimPotential(envPot, env, aai); }
     void printSelfComponent(const CartesianPoint& ener, const string& prefix);
+    /* Sets ener[aai] to backEner(aai) + bbOmegaEner(omg, aai) + bbPhiPsiEner(phi,
+     * psi, aai) + envEner(env, aai) for all amino acids, finding the bin of each
+     * potential only once. */
+    void backgroundEnergies(mstreal phi, mstreal psi, mstreal omg, mstreal env, mstreal* ener);
+
+    /* Gathers the amino acid and the phi, psi, omega, env and multiplicity
+     * ("mult") properties of every database residue in the global alphabet,
+     * and the checksum identifying these data and the alphabet (bkPotKey). */
+    void collectBackgroundData(vector<int>& aa, map<string, vector<mstreal> >& propVals);
+    void buildBackgroundPotentials(const vector<int>& aa, map<string, vector<mstreal> >& propVals);
+
+    /* Defines the pair TERM for residues Ri and Rj (stored in pT) and returns
+     * the FASST options to search for it with. */
+    fasstSearchOptions pairSearchOptions(Residue* Ri, Residue* Rj, termData& pT);
+
+    /* Computes pair energies from the already searched pair TERM. */
+    vector<vector<mstreal>> pairEnergiesFromMatches(termData& pT, FASST* fasst = NULL);
+
+    /* The FASST object to search with or look matches up in: fasst, if given, is
+     * a searcher borrowing the database of F (see setNumThreads). */
+    FASST& searcher(FASST* fasst) { return (fasst == NULL) ? F : *fasst; }
+
+    /* Searches for the TERM with the given options using fasst, going through
+     * the match store if it is on. The second form does a batch of TERMs, with
+     * only those not in the store searched (as one batch). */
+    fasstSolutionSet searchTERM(FASST& fasst, const Structure& term, const fasstSearchOptions& opts, bool autoSplitChains = true);
+    vector<fasstSolutionSet> searchTERMs(FASST& fasst, const vector<Structure>& terms, const vector<fasstSearchOptions>& opts);
+
+    /* Self energies of R given its freedom and contacts (the latter are only
+     * needed for the self correction), searching with fasst. Searched TERMs are
+     * appended to recorded (if recording is on). Does not touch ConFind or any
+     * state of the object other than fasst, so can run concurrently for different
+     * residues with different searchers. */
+    vector<mstreal> selfEnergies(Residue* R, mstreal freedom, const vector<pair<Residue*, Residue*>>& conts, FASST& fasst, vector<termData>& recorded, bool verbose = false);
+
+    /* Same for the pair energies of Ri and Rj. */
+    vector<vector<mstreal>> pairEnergies(Residue* Ri, Residue* Rj, FASST& fasst, vector<termData>& recorded);
+
+    /* Computes self energies of all variable positions and pair energies of all
+     * given contacts with numThreads workers, each running one TERM at a time. */
+    void termEnergiesParallel(const vector<Residue*>& variable, const vector<pair<Residue*, Residue*>>& conts, ConFind& C, vector<vector<mstreal>>& selfE, vector<vector<vector<mstreal>>>& pairE);
+    // whether self energies involve a self correction (and hence contacts)
+    bool needSelfCorrection() const { return (selfCorrMaxCliqueSize < 0) || (selfCorrMaxCliqueSize >= 2); }
 
     /* Given a list of FASST solutions, computes the residual statistical energy
      * for all amino acids at the position with index cInd, after accounting for
      * all "trivial" background statistical contributions at this position
      * accross all of the matches. */
-    CartesianPoint singleBodyStatEnergy(fasstSolutionSet& matches, int cInd, int pc);
+    CartesianPoint singleBodyStatEnergy(fasstSolutionSet& matches, int cInd, int pc, FASST* fasst = NULL);
 
     /* For a given match, compute the expectation of any given amino acid at the
      * specified position based on "trivial" background statistical contributions. */
-    CartesianPoint backExpectation(const fasstSolution& m, int cInd);
+    CartesianPoint backExpectation(const fasstSolution& m, int cInd, FASST* fasst = NULL);
 
     /* Counts observations at the given positions across all matches. */
-    CartesianPoint singleBodyObservations(fasstSolutionSet& matches, int cInd);
+    CartesianPoint singleBodyObservations(fasstSolutionSet& matches, int cInd, FASST* fasst = NULL);
 
     /* Same as above, but for amino-acid observations at two sites. */
-    CartesianPoint twoBodyObservations(fasstSolutionSet& matches, int cIndI, int cIndJ);
+    CartesianPoint twoBodyObservations(fasstSolutionSet& matches, int cIndI, int cIndJ, FASST* fasst = NULL);
 
     /* Computes the number of times each amino acid is expected to be found at
      * the given position, across all matches. NOTE: skips any matches that have
@@ -198,7 +362,7 @@ class dTERMen {
      * observed counts, such matches would have no "vote", so it would be unfair
      * to given them a vote in computing the expectation. The optional pointer
      * can be specified to collect the expectation in each match. */
-    CartesianPoint singleBodyExpectations(fasstSolutionSet& matches, int cInd, vector<CartesianPoint>* breakDown = NULL);
+    CartesianPoint singleBodyExpectations(fasstSolutionSet& matches, int cInd, vector<CartesianPoint>* breakDown = NULL, FASST* fasst = NULL);
 
     /* Computes the number of times each amino acid is expected to be found at
      * the given position in each match. Identifies an underlying amino-acid bias
@@ -207,7 +371,7 @@ class dTERMen {
      * to the expectations. In practice, the agreement should be essentially
      * perfect, limited only by the number of iterations of the underlying itera-
      * tive procedure. */
-    vector<CartesianPoint> singleBodyExpectationsMatchedMarginals(fasstSolutionSet& matches, int cInd);
+    vector<CartesianPoint> singleBodyExpectationsMatchedMarginals(fasstSolutionSet& matches, int cInd, FASST* fasst = NULL);
 
     mstreal enerToProb(vector<mstreal>& ener);
     mstreal enerToProb(const vector<mstreal>& _ener) { vector<mstreal> ener = _ener; return enerToProb(ener); }
@@ -239,12 +403,15 @@ class dTERMen {
     RotamerLibrary RL;
     string fasstdbPath, backPotFile, rotLibFile, efunVer;
     zeroDimPotType bkPot;
+    uint64_t bkPotKey; bool bkPotKeySet; // identifies the data background potentials are built from
     oneDimPotType omPot, envPot;
     twoDimPotType ppPot;
     mstreal kT, cdCut, intCut, selfResidualPC, selfCorrPC, homCut;
     int pmSelf, pmPair;
     int selfResidualMinN, selfResidualMaxN, selfCorrMinN, selfCorrMaxN, selfCorrMaxCliqueSize, pairMinN, pairMaxN;
-    bool recordData;
+    bool recordData, useStore;
+    int numThreads;
+    termMatchStore store;
     vector<termData> data;
     Sequence targetOrigSeq;
     vector<int> variableResidues;
@@ -339,7 +506,7 @@ class termData {
 
 class EnergyTable {
   public:
-    EnergyTable() {}
+    EnergyTable() { compiled = false; }
     EnergyTable(const string& tabFile);
 
     /* restrictSiteAlphabet() constructs a new energy table, copying only the residue types that are
@@ -378,9 +545,33 @@ class EnergyTable {
     void setSelfEnergy(int s, int aa, mstreal ener);
     void setPairEnergy(int si, int sj, int aai, int aaj, mstreal ener);
 
+    /* Freezes the table into a compiled form, in which the interactions of each
+     * site are a contiguous list of neighbors, each with a contiguous block of
+     * pair energies (see below). Scoring of solutions and mutations then runs
+     * over these lists, without any map lookups. Any change to sites, alphabets
+     * or pair energies drops the compiled form (it can be compiled again); mc()
+     * compiles the table if it is not compiled already. */
+    void compile();
+    bool isCompiled() const { return compiled; }
+
     // -- some simple evaluation routines
     mstreal scoreSolution(const vector<int>& seq);
     mstreal scoreSequence(const Sequence& seq);
+
+    /* Scores many sequences at once: sequences are mapped to the table's
+     * alphabets in bulk and scored in blocks, site by site across each block
+     * (so that the inner loops run over contiguous arrays), with blocks split
+     * between numThreads threads. Sequences of the wrong length or with amino
+     * acids not in the alphabet of their sites get a score of NaN, unless strict
+     * is true, in which case that is an error. Compiles the table, if it is not
+     * compiled already. */
+    vector<mstreal> scoreSequences(const vector<Sequence>& seqs, int numThreads = 1, bool strict = false);
+
+    /* Streams sequences from seqFile (one per line, as in SeqTools::readSequences),
+     * scoring them in chunks of chunkSize with scoreSequences() and writing each
+     * score and the sequence (as given) on a line of out, in the input order.
+     * Returns the number of sequences scored. */
+    long scoreSequences(const string& seqFile, ostream& out, int numThreads = 1, bool strict = false, int chunkSize = 100000);
     mstreal scoreMutation(const vector<int>& seq, int mutSite, int mutAA);
     mstreal scoreMutation(const vector<int>& seq, const vector<int>& mutSites, const vector<int>& mutAAs);
     mstreal meanEnergy() const;
@@ -423,6 +614,38 @@ class EnergyTable {
      * mutate based on the variance of interaction strengths at the pair. */
     vector<int> mc(int Nc, int Ni, mstreal kTi, mstreal kTf = -1, int annealType = 1, void* rec = NULL, void (*add)(void*, const vector<int>&, mstreal) = NULL, int Ne = -1, void* extra = NULL, mstreal (*additionalScore)(void*, const vector<int>&, EnergyTable&, int mutSite, int mutAA) = NULL);
 
+    /* Multi-chain counterpart of mc(), with the same parameters plus:
+     * numThreads -- number of threads to run chains on.
+     * exchange   -- if 0 (the default), the Nc chains are independent annealing
+     *               cycles, just like in mc(). Otherwise, the chains are
+     *               replicas at fixed temperatures, spaced geometrically from
+     *               kTi to kTf (annealType is then ignored), and every exchange
+     *               iterations neighboring replicas attempt to swap their
+     *               solutions by the Metropolis criterion.
+     * Each chain draws from its own random stream, seeded from the global
+     * engine (see MstUtils::seedRandEngine) when the call starts, so results
+     * depend on the seed but not on the number of threads. Returns the lowest-
+     * energy solution of any chain. The add callback is called with the same
+     * samples as in mc(), under a lock (so rec need not be thread safe), but
+     * samples of different chains are interleaved. additionalScore must be
+     * safe to call from several threads at once. */
+    vector<int> mcParallel(int Nc, int Ni, mstreal kTi, mstreal kTf = -1, int annealType = 1, int numThreads = 1, int exchange = 0, void* rec = NULL, void (*add)(void*, const vector<int>&, mstreal) = NULL, int Ne = -1, void* extra = NULL, mstreal (*additionalScore)(void*, const vector<int>&, EnergyTable&, int mutSite, int mutAA) = NULL);
+
+    /* Deterministic optimization: dead-end elimination (Goldstein singles),
+     * along with bounds against a local optimum, prunes amino acids that can not
+     * be part of the K best solutions, and an A* search over the remaining ones
+     * enumerates the K lowest-energy solutions, which are returned in increasing
+     * order of energy (fewer if the table has fewer solutions). For K > 1,
+     * pruning keeps everything within a margin of the best energy, and the
+     * margin is widened until K solutions are found within it. maxTime (in
+     * seconds) and maxNodes (the number of A* nodes kept) bound the search, if
+     * positive; if either runs out, the best solutions found by then are
+     * returned (if none was, the better of the local optimum and a greedy
+     * completion of the most promising partial one), and need not be optimal.
+     * If optimal is given, it is set to whether the returned solutions are
+     * provably the K best. NOTE: ignores any additional score terms, unlike mc(). */
+    vector<vector<int>> optimalSolutions(int K = 1, mstreal maxTime = -1, long maxNodes = -1, bool* optimal = NULL);
+
     Sequence solutionToSequence(const vector<int>& sol);
     vector<int> sequenceToSolution(const Sequence& seq, bool strict = false);
     string getResidueString(int si, int ri); // TODO
@@ -458,6 +681,71 @@ class EnergyTable {
      * amino acid aai interacting with site k occupied with amino acid aaj,
      * assuming that i < pairMaps[i][k]. */
     vector<vector<vector<vector<mstreal > > > > pairE;
+
+    /* The compiled form, in a CSR-like layout: the neighbors of site i are
+     * nbrSite[nbrStart[i]] through nbrSite[nbrStart[i+1] - 1]. For the k-th of
+     * these neighbors, site j, the interaction of amino acid aai at site i with
+     * amino acid aaj at site j is nbrE[nbrOffset[k] + aai*nbrAlphaSize[k] + aaj],
+     * nbrAlphaSize[k] being the alphabet size of site j. Every interaction is
+     * stored in both directions, so that the block of any site's neighbor is
+     * laid out by the amino acid at that site. */
+    bool compiled;
+    vector<int> nbrStart, nbrSite, nbrOffset, nbrAlphaSize;
+    vector<mstreal> nbrE;
+
+    /* Site-major scoring kernel of scoreSequences(): aa[si*n + b] is the amino
+     * acid (index in the alphabet of site si) of the b-th of n solutions, whose
+     * energies go into ener. Uses the compiled form. */
+    void scoreBlock(const int* aa, int n, mstreal* ener) const;
+
+    /* The state of one chain of mcParallel(): its current solution and energy,
+     * the best solution it has seen, and its own random stream. */
+    struct mcChain {
+      vector<int> seq, bestSeq;
+      mstreal ener, bestEner;
+      mt19937 rng;
+    };
+    typedef mstreal (*mcScoreFunc)(void*, const vector<int>&, EnergyTable&, int, int);
+    typedef void (*mcRecordFunc)(void*, const vector<int>&, mstreal);
+
+    /* Makes n moves of the chain, with the temperature going from kTi to kTf
+     * according to annealType (see mc()). Samples are only passed to add (under
+     * recLock) and the best solution only updated if record is true. */
+    void mcSteps(mcChain& ch, int n, mstreal kTi, mstreal kTf, int annealType, bool record, mutex& recLock, void* rec, mcRecordFunc add, void* extra, mcScoreFunc additionalScore);
+
+    /* Dead-end elimination within the given margin of the best energy: alive[i]
+     * lists the amino acids (indices) still allowed at site i, and is pruned in
+     * place. Uses the compiled form. */
+    void deadEndElimination(vector<vector<int>>& alive, mstreal margin);
+
+    /* Lower bounds on the energy of partial solutions that only use the alive
+     * amino acids (see deadEndElimination()). Sites are ordered most constrained
+     * first, and assign holds the amino acid at every assigned site (or -1). */
+    struct searchBound {
+      searchBound(EnergyTable& _E, const vector<vector<int>>& _alive);
+      // interaction energy of amino acid s at (unassigned) site j with the assigned sites
+      mstreal assignedEner(int j, int s) const;
+      // lower bound on the energy of the unassigned sites from position d of the order on
+      mstreal lowerBound(int d = 0) const;
+
+      EnergyTable& E;
+      const vector<vector<int>>& alive;
+      vector<int> order, pos, assign;
+      vector<vector<mstreal>> minAhead;
+    };
+
+    /* Removes from alive any amino acid with which no solution can have energy
+     * at most maxEner, by the bounds of searchBound, alternating with
+     * dead-end elimination (within margin) until neither prunes anything. */
+    void boundElimination(vector<vector<int>>& alive, mstreal maxEner, mstreal margin);
+
+    /* Steepest descent from sol over single mutations to alive amino acids. */
+    vector<int> localOptimum(const vector<vector<int>>& alive, vector<int> sol);
+
+    /* A* enumeration (see optimalSolutions()) over the alive amino acids, of
+     * solutions with energy at most maxEner, until K are found. Returns false if
+     * the budget ran out first (the deadline or maxNodes). */
+    bool aStar(const vector<vector<int>>& alive, int K, mstreal maxEner, chrono::steady_clock::time_point deadline, bool timed, long maxNodes, vector<vector<int>>& sols, vector<mstreal>& eners);
 };
 
 #endif
@@ -4,6 +4,7 @@
 #include "msttypes.h"
 #include "mstrotlib.h"
 #include <set>
+#include <unordered_map>
 
 using namespace std;
 using namespace MST;
@@ -11,64 +12,68 @@ using namespace MST;
 template<typename key, typename T>
 using fastmap = map<key, T>;
 
+/* Contacts are kept as flat per-contact arrays (source and destination, as
+ * indices into the list of distinct residues involved, and degree), with a
+ * hash from residue pairs to the contacts between them, so that lists of many
+ * contacts are compact and pairs are looked up in constant time. Info strings
+ * and alphabets take space only once some contact has them. */
 class contactList {
 public:
-  void addContact(Residue* _resi, Residue* _resj, mstreal _degree, string _info = "", bool directional = false, set<string> _resi_aa = {}, set<string> _resj_aa = {}) {
-    resi.push_back(_resi);
-    resj.push_back(_resj);
-    degrees.push_back(_degree);
-    infos.push_back(_info);
-    resi_aa.push_back(_resi_aa);
-    resj_aa.push_back(_resj_aa);
-    
-    inContact[_resi][_resj].insert(resi.size() - 1);
-    if (!directional) inContact[_resj][_resi].insert(resi.size() - 1);
-    if ((!directional) && (_resi->getResidueIndex() > _resj->getResidueIndex())) {
-      orderedContacts.insert(pair<Residue*, Residue*>(_resj, _resi));
-    } else {
-      orderedContacts.insert(pair<Residue*, Residue*>(_resi, _resj));
-    }
-  }
-  
-  int size() { return resi.size(); }
-  Residue* residueA(int i) { return resi[i]; }
-  Residue* residueB(int i) { return resj[i]; }
-  Residue* srcResidue(int i) { return resi[i]; }
-  Residue* dstResidue(int i) { return resj[i]; }
-  vector<Residue*> srcResidues() { return resi; }
-  vector<Residue*> destResidues() { return resj; }
+  void addContact(Residue* _resi, Residue* _resj, mstreal _degree, string _info = "", bool directional = false, set<string> _resi_aa = {}, set<string> _resj_aa = {});
+  void reserve(int n);
+
+  int size() { return degrees.size(); }
+  Residue* residueA(int i) { return residues[ci[i]]; }
+  Residue* residueB(int i) { return residues[cj[i]]; }
+  Residue* srcResidue(int i) { return residues[ci[i]]; }
+  Residue* dstResidue(int i) { return residues[cj[i]]; }
+  vector<Residue*> srcResidues();
+  vector<Residue*> destResidues();
   mstreal degree(int i) { return degrees[i]; }
   mstreal degree(Residue* _resi, Residue* _resj); //if multiple are defined for this residue, only gets one
-  string info(int i) { return infos[i]; }
+  string info(int i) { return (i < infos.size()) ? infos[i] : ""; }
   void sortByDegree(); // sorts the contact list by contact degree, highest to lowest
   vector<pair<Residue*, Residue*>> getOrderedContacts();
   bool areInContact(Residue* A, Residue* B);
   
   set<int> getContacts(Residue* _resi, Residue* _resj);
-  set<string> const alphabetA(int i) { return resi_aa[i]; }
-  set<string> const alphabetB(int i) { return resj_aa[i]; }
-  
+  set<string> const alphabetA(int i) { return (i < resi_aa.size()) ? resi_aa[i] : set<string>(); }
+  set<string> const alphabetB(int i) { return (i < resj_aa.size()) ? resj_aa[i] : set<string>(); }
+
+  /* Distinct residues involved in contacts, in the order first seen; contact
+   * i is between residue(srcIndex(i)) and residue(dstIndex(i)). */
+  int numResidues() { return residues.size(); }
+  Residue* residue(int k) { return residues[k]; }
+  int srcIndex(int i) { return ci[i]; }
+  int dstIndex(int i) { return cj[i]; }
+
+  /* Contact degrees as rows of a residue-pair table, in the form taken by
+   * FASST::addResiduePairProperties: for each of numRes residues (by their
+   * index in the structure), the number of partners (-1 if none), followed
+   * by the partners (ascending) and values of all rows. Each contact gives an
+   * entry from residue A to B if forward is true, and from B to A if reverse
+   * is true. If a pair gets more than one value, the last contact wins. */
+  void pairTable(int numRes, vector<int>& rowLen, vector<int>& partners, vector<mstreal>& vals, bool forward = true, bool reverse = true);
+
 private:
-  struct contComp {
-    bool operator() (const pair<Residue*, Residue*>& lhs, const pair<Residue*, Residue*>& rhs) const {
-      int lhsI = lhs.first->getResidueIndex();
-      int rhsI = rhs.first->getResidueIndex();
-      if (lhsI == rhsI) {
-        lhsI = lhs.second->getResidueIndex();
-        rhsI = rhs.second->getResidueIndex();
-      }
-      return lhsI < rhsI;
-    }
-  };
-  
-  vector<Residue*> resi;
-  vector<Residue*> resj;
+  int residueKey(Residue* res);
+  static uint64_t pairKey(int a, int b) { return (((uint64_t) (uint32_t) a) << 32) | (uint32_t) b; }
+  void link(int a, int b, int c);
+
+  vector<Residue*> residues;
+  unordered_map<Residue*, int> resIdx;
+  vector<int> ci, cj;          // contacts, as indices into residues
   vector<mstreal> degrees;
-  vector<string> infos;
-  fastmap<Residue*, fastmap<Residue*, set<int>>> inContact;
-  set<pair<Residue*, Residue*>, contComp> orderedContacts;
-  vector<set<string>> resi_aa;
+  vector<bool> directed;
+  vector<string> infos;        // empty until a contact has info
+  vector<set<string>> resi_aa; // same for alphabets
   vector<set<string>> resj_aa;
+
+  // contacts between each (ordered) pair of residues, as linked lists of
+  // entries, with the pair's first entry found by hash
+  struct adjEntry { int contact, next; };
+  unordered_map<uint64_t, int> pairHead;
+  vector<adjEntry> adj;
 };
 
 class ConFind {
@@ -83,6 +88,13 @@ class ConFind {
     void cache(const vector<Residue*>& residues);
     void cache(Residue* res);
 
+    /* The number of threads with which to cache multiple residues at once
+     * (default is 1). Rotamers are built at each residue independently, and
+     * the results are merged in the order residues were given, so the outcome
+     * does not depend on the number of threads. */
+    void setNumThreads(int n);
+    int getNumThreads() const { return numThreads; }
+
     // find those residues that are close enough to affect the passed residue(s)
     vector<Residue*> getNeighbors(Residue* residue);
     vector<Residue*> getNeighbors(vector<Residue*>& residues);
@@ -91,6 +103,7 @@ class ConFind {
     /* this function encodes whether a given atom counts as "side-chain" for the
      * purposes of finding sidechain-to-sidechain contacts. */
     bool countsAsSidechain(Atom& a);
+    bool countsAsSidechain(const string& atomName, const string& resName);
   
     /*
      Contact degree is the potential for the sidechain of two residues to interact. The A_aa and B_aa
@@ -102,6 +115,11 @@ class ConFind {
      */
 
     mstreal contactDegree(Residue* resA, Residue* resB, bool cacheA = true, bool cacheB = true, bool checkNeighbors = true, set<string> aaAllowedA = {}, set<string> aaAllowedB = {});
+    /* Contacts of the given residue(s) with all of their neighbors. Contact
+     * degrees of all pairs are computed together: rotamers of every residue
+     * involved go into one grid, which is swept once per residue of interest
+     * (in parallel, per setNumThreads), giving the same values as computing
+     * contactDegree one pair at a time. */
     contactList getContacts(Residue* res, mstreal cdcut = 0.0, contactList* list = NULL);
     contactList getContacts(Structure& S, mstreal cdcut = 0.0, contactList* list = NULL);
     contactList getContacts(const vector<Residue*>& residues, mstreal cdcut = 0.0, contactList* list = NULL);
@@ -175,6 +193,54 @@ class ConFind {
      * does not check whether all the relevant contacting residues have been
      * visited, so must be called only at the right times (that's why protected) */
     mstreal computeFreedom(Residue* res);
+    /* Everything that caching a residue produces. Computing it only reads
+     * from the object (the structure, its proximity grids and the rotamer
+     * library), so different residues can be computed concurrently; storing it
+     * then goes into the object's maps and the rotamer store (see below). */
+    struct residueCache {
+      vector<rotamerID*> survivingRotamers;
+      vector<int> rotAA;       // amino-acid index of each surviving rotamer
+      vector<mstreal> rotProb; // and its probability
+      vector<mstcoor> coor;    // side-chain atoms of surviving rotamers (3 coordinates each), sorted by grid cell
+      vector<int> atomRot;     // (local) index of the surviving rotamer each atom belongs to
+      vector<int> cellStart;   // atoms in grid cell c are [cellStart[c], cellStart[c+1])
+      mstreal lo[3], hi[3];    // bounding box of the atoms
+      int dims[3];             // grid dimensions
+      set<int> permanentContacts;
+      fastmap<Residue*, vector<mstreal> > interference; // by amino-acid index
+      mstreal fractionPruned;
+      int numLibraryRotamers;
+      string log; // rotamer log output (if a log file is open)
+    };
+    void computeCache(Residue* res, residueCache& rc);
+    void storeCache(Residue* res, residueCache& rc);
+    unsigned int aaMask(const set<string>& aas); // bit i is set if the i-th amino acid of aaNames is in aas
+    string aaList(int ai);                       // the ai-th amino acid of aaNames
+    /* sums up the contact-degree contributions of the given sorted, unique
+     * clashing rotamer pairs between A and B (encoded as in contactDegree),
+     * adding to the collision probabilities at A and/or B if asked to. The
+     * result is not normalized. */
+    mstreal clashingPairsWeight(Residue* resA, Residue* resB, const vector<long>& clashing, bool updateA, bool updateB);
+    /* A single grid (cells the size of the contact distance) over the
+     * side-chain atoms of surviving rotamers at a set of cached residues, so
+     * that rotamer pairs in contact between one residue and all of its partners
+     * are found in one sweep over its atoms. Within each cell, atoms of the same
+     * residue are contiguous (a run), so that residues that are not partners
+     * (including the residue itself) are skipped without looking at atoms. */
+    struct sweepGrid {
+      mstreal lo[3];
+      int dims[3];
+      vector<mstcoor> coor; // 3 coordinates per atom, sorted by cell and residue
+      vector<int> rot;      // rotamer of each atom
+      vector<int> runRes;   // cached index of the residue of each run
+      vector<int> runStart; // atoms of run r are [runStart[r], runStart[r+1])
+      vector<int> cellRun;  // runs in cell c are [cellRun[c], cellRun[c+1])
+    };
+    void buildSweepGrid(const vector<int>& residues, sweepGrid& G);
+    /* for cached residue ci and each of its partners (cached indices), finds
+     * the sorted, unique clashing rotamer pairs. slotOf is scratch space with an
+     * entry per cached residue, all -1 (and left that way). */
+    void sweepClashing(int ci, const vector<int>& partners, const sweepGrid& G, vector<int>& slotOf, vector<vector<long> >& clashing);
     void collProbUpdateOn(Residue* res) { updateCollProb[res] = true; }
     void collProbUpdateOff(Residue* res) { updateCollProb[res] = false; }
 
@@ -183,7 +249,7 @@ class ConFind {
     bool isRotLibLocal;
     bool strict; //if true, will only consider the amino acid present in the structure in calculations
     AtomPointerVector backbone, ca;
-    ProximitySearch *bbNN, *caNN;
+    CellList *bbNN, *caNN;
     fastmap<Residue*, set<int> > permanentContacts;
     fastmap<Residue*, mstreal> fractionPruned;
     fastmap<Residue*, mstreal> freedom;
@@ -191,15 +257,35 @@ class ConFind {
     fastmap<Residue*, vector<rotamerID*> > survivingRotamers;
     fastmap<Residue*, fastmap<Residue*, mstreal> > degrees; // used for caching previously computed general (non-amino acid restricted) contact degrees
     fastmap<Residue*, fastmap<rotamerID*, mstreal> > collProb;
-    fastmap<Residue*, fastmap<string, DecoratedProximitySearch<rotamerID*>* > > rotamerHeavySC;
-    fastmap<Residue*, fastmap<Residue*, fastmap<string, mstreal> > > interference; // interference[resA][resB][aa] will store how much the backbone of
-                                                                 // resB can potentially interfere amino acid aa at resA
+    fastmap<Residue*, fastmap<Residue*, vector<mstreal> > > interference; // interference[resA][resB][ai] will store how much the backbone of
+                                                                 // resB can potentially interfere the ai-th amino acid (of aaNames) at resA
+
+    /* Surviving rotamers of all cached residues, in flat arrays. The
+     * side-chain atoms of rotamers at cached residue i (cached[i]; i is
+     * cachedIndex[res]) are scCoor/scRot entries [firstAtom, firstAtom +
+     * numAtoms), sorted by cell of a grid over them (with cells the size of
+     * the contact distance), and its rotamers are entries [firstRot, firstRot +
+     * numRots) of the per-rotamer arrays, in the order of survivingRotamers[res]. */
+    struct cachedResidue {
+      int firstAtom, numAtoms, firstRot, numRots;
+      int firstCell, dims[3]; // the residue's grid cells start at cellStart[firstCell] (offsets relative to firstAtom)
+      mstreal lo[3], hi[3];   // bounding box of the atoms
+    };
+    fastmap<Residue*, int> cachedIndex;
+    vector<cachedResidue> cached;
+    vector<mstcoor> scCoor;                 // 3 coordinates per atom
+    vector<int> scRot;                      // rotamer of each atom
+    vector<int> cellStart;
+    vector<int> rotAA;                      // amino-acid index of each rotamer
+    vector<mstreal> rotProb, rotAAProp;     // probability of each rotamer and propensity of its amino acid
+    fastmap<string, int> aaIndex;           // index of each amino acid in aaNames
     set<string> aaNames;     // amino acids whose rotamers will be considered (all except GLY and PRO)
     mstreal dcut;                  // CA-CA distance cutoff beyond which we do not consider pairwise interactions
     mstreal clashDist, contDist;   // inter-atomic distances for counting main-chain clashes and inter-rotamer contacts, respectively
     fastmap<string, double> aaProp; // amino-acid propensities (in percent)
     bool doNotCountCB;          // if true, CB is not counted as a side-chain atom for counting clashes (except for ALA)
     fstream rotOut;
+    int numThreads;
     /* an internal flag that sets the state of the object with respect to
      * uplading the collision probability mass table. In general, should be
      * false, unless set internally as part of a relevant function (and then
@@ -0,0 +1,96 @@
+#ifndef _MSTDOCK_H
+#define _MSTDOCK_H
+
+#include "msttypes.h"
+#include "msttransforms.h"
+#include <functional>
+#include <climits>
+
+namespace MST {
+
+/* Samples random rigid-body docks of a ligand against a fixed receptor. The
+ * receptor is binned into cell lists once, and the ligand is kept as a rigid block
+ * of coordinates centered at the origin. Each trial picks a random relative
+ * orientation, starts with the two centers coincident, and pulls the ligand
+ * away from the receptor in random half-normal steps, until a step has few
+ * enough clashes and enough contacts (accepted), or the ligand is farther than
+ * a cutoff past the receptor along the pull direction or makes a disallowed
+ * contact (failed). Trials are evaluated in batches spread over threads; each
+ * trial draws its random numbers from its own seed, taken from the MstUtils
+ * random engine up front, so the accepted poses do not depend on the number
+ * of threads. */
+class RigidBodyDocker {
+  public:
+    /* By default, all CA atoms of each partner count towards contacts. */
+    RigidBodyDocker(const AtomPointerVector& receptor, const AtomPointerVector& ligand);
+
+    /* indices (into the receptor and ligand atom vectors given upon construction)
+     * of atoms that count toward contacts */
+    void setReceptorContactAtoms(const vector<int>& idx);
+    void setLigandContactAtoms(const vector<int>& idx);
+
+    /* contacts between these receptor and ligand atoms cause a trial to fail */
+    void setDisallowedContacts(const vector<int>& receptorIdx, const vector<int>& ligandIdx);
+
+    /* By default, the receptor orientation relative to the pull direction is
+     * random. If a pull direction is specified (in the receptor frame), the
+     * ligand is always pulled along it, starting from a random lateral offset
+     * of up to half of the combined lateral extents of the contact atoms; upon
+     * specifying ligand contact atoms, trials in which these face away from the
+     * receptor or cannot laterally meet the receptor contact atoms are skipped,
+     * and the ligand starts out separated by 3/4 of the smaller contact extent
+     * along the pull direction. */
+    void setPullDirection(const CartesianPoint& u);
+
+    void setClashDistance(mstreal d) { clashDist = d; gridsSet = false; }
+    void setContactDistance(mstreal d) { contDist = d; gridsSet = false; }
+    void setClashesAllowed(int n) { clashesAllowed = n; }
+    void setContactsRequired(int n) { contactsRequired = n; }
+    void setPullSigma(mstreal s) { pullSigma = s; }        // standard deviation of each pull step
+    void setMaxSeparation(mstreal d) { maxSeparation = d; } // gap along the pull direction at which a trial fails
+    void setNumThreads(int n) { numThreads = n; }
+    void setBatchSize(int n) { batchSize = n; }
+
+    /* Runs trials until n poses are accepted (or maxTrials trials are run, if
+     * positive), calling onAccept for each accepted pose, in trial order. The
+     * Transform maps the ligand coordinates given upon construction onto the
+     * docked pose in the receptor frame. Returns the number of failed trials. */
+    long sample(int n, const function<void(const Transform&)>& onAccept, long maxTrials = 0);
+    vector<Transform> sample(int n, long* numFailed = NULL);
+
+    /* clash and contact counts of the ligand placed by T (for checking poses) */
+    int numClashes(const Transform& T);
+    int numContacts(const Transform& T);
+
+  protected:
+    enum trialOutcome { trialFailed = 0, trialAccepted, trialSkipped };
+
+    /* runs one trial, given scratch space for placed ligand coordinates and
+     * clashing atoms; places an accepted pose in T */
+    trialOutcome trial(unsigned seed, vector<mstreal>& placed, vector<int>& recent, Transform& T) const;
+    int countClashes(const vector<mstreal>& placed, vector<int>& recent, int maxCount) const;
+    int countContacts(const vector<mstreal>& placed, const vector<int>& idx, const CellList& grid, int maxCount) const;
+    // number of grid points within d of the i-th placed point, counting no further than maxCount + 1
+    static int countWithin(const CellList& grid, const vector<mstreal>& placed, int i, mstreal d, int maxCount);
+    void setGrids();
+    static vector<mstreal> coordinateSubset(const vector<mstreal>& xyz, const vector<int>& idx);
+    // extent of the given points (all, if idx is NULL) of a coordinate block projected onto the axis
+    static void projectedExtent(const vector<mstreal>& xyz, const vector<int>* idx, const CartesianPoint& axis, mstreal& lo, mstreal& hi);
+
+  private:
+    vector<mstreal> recXYZ, ligXYZ; // receptor coordinates, and ligand coordinates centered at the origin
+    CartesianPoint recCenter, ligCenter;
+    vector<int> recContIdx, ligContIdx, recBadIdx, ligBadIdx;
+    CellList clashGrid, contactGrid, disallowedGrid;
+    bool gridsSet;
+
+    bool fixedPull, ligContactsGiven;
+    Transform pullFrame; // rotation that takes the pull direction onto the X-axis (if fixed)
+
+    mstreal clashDist, contDist, pullSigma, maxSeparation;
+    int clashesAllowed, contactsRequired, numThreads, batchSize;
+};
+
+}
+
+#endif
@@ -65,4 +65,44 @@ private:
   vector<resInfo> data;
 };
 
+/**
+ Assigns secondary structure in-process from backbone coordinates, without STRIDE. Backbone hydrogen bonds are
+ found with the electrostatic energy of DSSP, from which turns, helices, and beta bridges and ladders are built as
+ DSSP does (Kabsch W, Sander C. Biopolymers 22:2577-2637 (1983)). Labels are those of the STRIDE key above (DSSP
+ bends are reported as coil), so they can stand in for those of strideInterface.
+ */
+class secondaryStructureAssigner {
+public:
+  /**
+   @param S The structure to classify; residues missing any of N, CA, C or O are coil and form no hydrogen bonds
+   @return The single letter classifications of the residues of S, in order
+   */
+  static vector<string> assign(const Structure& S);
+
+  /**
+   @param structs Structures to classify
+   @param numThreads Number of threads among which to divide the structures
+   @return The classifications of each structure, in order
+   */
+  static vector<vector<string> > assign(const vector<Structure*>& structs, int numThreads = 1);
+
+  static constexpr mstreal maxHBondEnergy = -0.5; // kcal/mol, below which a hydrogen bond is counted
+
+private:
+  struct backbone {
+    Point3 N, CA, C, O, H;
+    bool complete = false, hasH = false;
+    int segment = -1; // residues in the same segment are covalently connected
+    // the two lowest-energy hydrogen bonds of the N-H (to acceptors) and of the C=O (from donors)
+    int acceptor[2] = {-1, -1}, donor[2] = {-1, -1};
+    mstreal acceptorEnergy[2] = {0, 0}, donorEnergy[2] = {0, 0};
+  };
+  static mstreal hBondEnergy(const backbone& donor, const backbone& acceptor);
+  static void addHBond(vector<backbone>& bb, int d, int a, mstreal E);
+  // whether the N-H of d is hydrogen bonded to the C=O of a
+  static bool hBonded(const vector<backbone>& bb, int d, int a);
+  // whether residues i through j exist and are covalently connected
+  static bool connected(const vector<backbone>& bb, int i, int j);
+};
+
 #endif /* mstexternal_h */
@@ -5,8 +5,11 @@
 #include "msttransforms.h"
 #include "mstsequence.h"
 #include <list>
+#include <unordered_map>
+#include <memory>
 #include <chrono>
 #include <limits.h>
+#include <stdint.h>
 
 using namespace MST;
 
@@ -54,6 +57,9 @@ class fasstSolution {
         friend bool operator==(const resAddress& ai, const resAddress& aj) {
           return (ai.targIdx == aj.targIdx) && (ai.resIdx == aj.resIdx);
         }
+        struct hasher {
+          size_t operator()(const resAddress& a) const { return (((size_t) a.targIdx) << 16) | a.resIdx; }
+        };
 
       private:
         unsigned short targIdx, resIdx;
@@ -62,16 +68,20 @@ class fasstSolution {
 
     fasstSolution() { rmsd = 0.0; context = NULL; }
     fasstSolution(const vector<int>& _alignment, mstreal _rmsd, int _target, const Transform& _tr, const vector<int>& _segLengths, vector<int> segOrder = vector<int>());
+    /* Segment lengths are the same for all solutions of a query, so solutions
+     * can share them (copying a solution then does not copy them). */
+    fasstSolution(const vector<int>& _alignment, mstreal _rmsd, int _target, const Transform& _tr, const shared_ptr<const vector<int> >& _segLengths);
     fasstSolution(const fasstSolution& _sol);
     fasstSolution(const fasstSolutionAddress& addr, const vector<int> segLen);
+    fasstSolution(const fasstSolutionAddress& addr, const shared_ptr<const vector<int> >& segLen);
     ~fasstSolution() { if (context != NULL) delete context; }
 
     mstreal getRMSD() const { return rmsd; }
     int getTargetIndex() const { return targetIndex; }
     vector<int> getAlignment() const { return alignment; }
-    vector<int> getSegLengths() const { return segLengths; }
-    int segLength(int i) const { return segLengths[i]; }
-    resAddress segCentralResidue(int i) const { return resAddress(targetIndex, alignment[i] + segLengths[i]/2); }
+    vector<int> getSegLengths() const { return (segLengths == NULL) ? vector<int>() : *segLengths; }
+    int segLength(int i) const { return (*segLengths)[i]; }
+    resAddress segCentralResidue(int i) const { return resAddress(targetIndex, alignment[i] + (*segLengths)[i]/2); }
     int numSegments() const { return alignment.size(); }
     int operator[](int i) const { return alignment[i]; }
     Transform getTransform() const { return tr; }
@@ -81,6 +91,7 @@ class fasstSolution {
     void setSeqContext(const vector<Sequence>& _segSeq, const vector<Sequence>& _nSeq, const vector<Sequence>& _cSeq);
     void setStructContext(const vector<AtomPointerVector>& _segStr, const vector<AtomPointerVector>& _nStr, const vector<AtomPointerVector>& _cStr);
     void setRMSD(mstreal r) { rmsd = r; }
+    void setTargetIndex(int ti) { targetIndex = ti; }
     void setTransform(const Transform& _tr) { tr = _tr; }
     fasstSolutionAddress getAddress() const { return fasstSolutionAddress(targetIndex, alignment); }
 
@@ -127,7 +138,8 @@ class fasstSolution {
     const vector<Sequence>& cTermContext() const { return context->cSeq; }
 
   private:
-    vector<int> alignment, segLengths;
+    vector<int> alignment;
+    shared_ptr<const vector<int> > segLengths;
     mstreal rmsd;
     int targetIndex;
     Transform tr; // how the target needs to be transformed for this match to optimally fit onto the query
@@ -198,8 +210,8 @@ class fasstSolutionSet {
     int size() const { return solsSet.size(); }
     void init(int numSegs) { clear(); solsByCenRes.resize(numSegs); algnRedBar.resize(numSegs); algnRedBarSource.resize(numSegs); }
     void clear() { solsSet.clear(); solsByCenRes.clear(); updated = true; }
-    mstreal worstRMSD() { return (solsSet.rbegin())->getRMSD(); }
-    mstreal bestRMSD() { return (solsSet.begin())->getRMSD(); }
+    mstreal worstRMSD() const { return (solsSet.rbegin())->getRMSD(); }
+    mstreal bestRMSD() const { return (solsSet.begin())->getRMSD(); }
     vector<fasstSolution*> orderByDiscovery();
     vector<fasstSolutionAddress> extractAddresses() const;
 
@@ -233,10 +245,10 @@ class fasstSolutionSet {
     // to its elements (i.e., it does not copy them upon resizing like vector).
     set<fasstSolution> solsSet;
     vector<fasstSolution*> solsVec;
-    // solsByCenRes[i] is a map that of solutions keyed by the central residue
+    // solsByCenRes[i] is a hash map of solutions keyed by the central residue
     // of the i-th segment. This is only used during search (for redundancy re-
     // moval) and is deleted before return. Not copied upon assignment.
-    vector<map<fasstSolution::resAddress, set<fasstSolution*>>> solsByCenRes;
+    vector<unordered_map<fasstSolution::resAddress, set<fasstSolution*>, fasstSolution::resAddress::hasher>> solsByCenRes;
 
     // these two member variables are for storing information about existing
     // matches that have redundant segments to potential solutions from the
@@ -247,6 +259,45 @@ class fasstSolutionSet {
     bool updated;
 };
 
+/* Solutions of a search without redundancy filtering, kept as compact records
+ * in flat buffers until the search ends: the alignment of every solution (in
+ * the original segment order) lives in one pooled array, solutions carry no
+ * transform or segment lengths, and they are kept in a max-heap ordered as in
+ * fasstSolution::operator<, so the worst solution is always at hand (e.g., to
+ * evict it once there are more than the maximal number of matches). Once the
+ * heap is filled, inserting and evicting allocates nothing. */
+class fasstSolutionHeap {
+  public:
+    fasstSolutionHeap() { numSegs = 0; }
+    void init(int _numSegs) { clear(); numSegs = _numSegs; }
+    void clear() { heap.clear(); alignments.clear(); freeSlots.clear(); }
+    int size() const { return heap.size(); }
+    bool empty() const { return heap.empty(); }
+    void push(const int* alignment, mstreal rmsd, int targetIndex);
+    void popWorst();
+    mstreal worstRMSD() const { return heap.front().rmsd; }
+
+    // calls f(alignment, rmsd, targetIndex) for every solution, in no particular order
+    template <class F>
+    void forEach(F f) const {
+      for (const record& r : heap) f(&(alignments[r.slot * numSegs]), r.rmsd, r.targetIndex);
+    }
+
+  private:
+    struct record {
+      mstreal rmsd;
+      int targetIndex;
+      int slot;          // the alignment is at alignments[slot * numSegs]
+    };
+    // whether record a comes before b in the order of fasstSolution::operator<
+    bool before(const record& a, const record& b) const;
+
+    int numSegs;
+    vector<record> heap;
+    vector<int> alignments;
+    vector<int> freeSlots;
+};
+
 /* A general virtual class for representing per-segment sequence constraints. */
 class fasstSeqConst {
   public:
@@ -255,6 +306,14 @@ class fasstSeqConst {
      * at with position i meets all sequence constraints, and false otherwise. */
     virtual void evalConstraint(int segIdx, const Sequence& target, vector<bool>& alignments) = 0;
     virtual bool isSegmentConstrained(int segIdx) = 0;
+    virtual fasstSeqConst* clone() const = 0; // a new copy of the constraints (caller takes ownership)
+    /* If the constraints on segment segIdx are positional (i.e., each of some
+     * positions within the segment must be one of a set of amino acids), puts
+     * them in positions and allowed and returns true, which lets FASST look
+     * admissible alignments up in the sequence index of the database (see
+     * fasstSequenceIndex), rather than evaluate constraints on every target.
+     * By default, constraints are taken to not be positional. */
+    virtual bool positionalConstraints(int segIdx, vector<int>& positions, vector<set<res_t> >& allowed) { return false; }
     virtual ~fasstSeqConst() {}
 };
 
@@ -265,6 +324,11 @@ class fasstSeqConstSimple : public fasstSeqConst {
     fasstSeqConstSimple(int numSegs) { positions.resize(numSegs); aminoAcids.resize(numSegs); }
     void evalConstraint(int segIdx, const Sequence& target, vector<bool>& alignments);
     bool isSegmentConstrained(int segIdx) { return !positions[segIdx].empty(); }
+    fasstSeqConst* clone() const { return new fasstSeqConstSimple(*this); }
+    bool positionalConstraints(int segIdx, vector<int>& pos, vector<set<res_t> >& allowed) {
+      pos = positions[segIdx]; allowed = aminoAcids[segIdx];
+      return true;
+    }
     bool hasConstraints() const {
       for (int i = 0; i < positions.size(); i++) { if (!positions[i].empty()) return true; }
       return false;
@@ -298,7 +362,12 @@ class fasstSearchOptions {
       redundancyCut = 1.0;
       seqConst = NULL;
       verb = false;
+      maxSearchTime = -1;
+      maxSearchNodes = -1;
+      orderTargets = false;
     }
+    fasstSearchOptions(const fasstSearchOptions& other) { seqConst = NULL; *this = other; }
+    fasstSearchOptions& operator=(const fasstSearchOptions& other);
     ~fasstSearchOptions() { if (seqConst != NULL) delete(seqConst); }
 
     /* -- getters -- */
@@ -312,6 +381,8 @@ class fasstSearchOptions {
     mstreal getRedundancyCut() const { return redundancyCut; }
     string getRedundancyProperty() const { return redundancyProp; }
     fasstSeqConst* getSequenceConstraints() const { return seqConst; }
+    mstreal getMaxSearchTime() const { return maxSearchTime; }
+    long getMaxSearchNodes() const { return maxSearchNodes; }
 
     /* -- setters -- */
     void setMinNumMatches(int _min);
@@ -332,6 +403,26 @@ class fasstSearchOptions {
     void setRedundancyProperty(const string& _redProp) { redundancyProp = _redProp; }
     template<class T>
     void setSequenceConstraints(const T& c) { if (seqConst != NULL) delete(seqConst); seqConst = new T(c); }
+    /* Budgets for a search: once the search has run for this many seconds, or
+     * has visited this many recursion nodes (see fasstSearchStats), it stops and
+     * returns the solutions found so far, flagged as partial (see
+     * FASST::isSearchPartial). Budgets are checked every few hundred nodes and
+     * before each target, so they can be overrun by a little. In a parallel
+     * search, the node budget is shared by all workers. */
+    void setMaxSearchTime(mstreal seconds) { maxSearchTime = seconds; }
+    void setMaxSearchNodes(long n) { maxSearchNodes = n; }
+    /* With a segment index (see FASST::buildSegmentIndex), every target gets a
+     * lower bound on the residual of any match in it: the sum, over query
+     * segments, of the descriptor bound of its best window. Targets whose bound
+     * is above the current cutoff are skipped in any case. With ordering on,
+     * targets are also visited from the lowest bound up, so that (with a
+     * maximal number of matches) the cutoff tightens early, and the search
+     * ends as soon as the next target's bound is above the cutoff. This does
+     * not change the matches found under a maximal number of matches (except
+     * among ties), but changes which ones are found first (e.g., under a
+     * sufficient number of matches). Segments of lengths not in the index
+     * contribute nothing to the bounds. */
+    void setTargetOrdering(bool order = true) { orderTargets = order; }
 
     /* -- unsetters (resetters) -- */
     void unsetMinNumMatches() { minNumMatches = -1; }
@@ -342,6 +433,8 @@ class fasstSearchOptions {
     void unsetRedundancyCut() { redundancyCut = 1; }
     void unsetRedundancyProperty() { redundancyProp = ""; }
     void unsetSequenceConstraints() { if (seqConst != NULL) delete(seqConst); seqConst = NULL; }
+    void unsetMaxSearchTime() { maxSearchTime = -1; }
+    void unsetMaxSearchNodes() { maxSearchNodes = -1; }
 
     /* -- queriers -- */
     bool isMinNumMatchesSet() const { return (minNumMatches > 0); }
@@ -357,12 +450,20 @@ class fasstSearchOptions {
     bool isRedundancyPropertySet() const { return !redundancyProp.empty(); }
     bool sequenceConstraintsSet() const { return seqConst != NULL; }
     bool isVerbose() const { return verb; }
+    bool isMaxSearchTimeSet() const { return maxSearchTime > 0; }
+    bool isMaxSearchNodesSet() const { return maxSearchNodes > 0; }
+    bool isTargetOrderingSet() const { return orderTargets; }
 
     /* -- validators -- */
     bool validateGapConstraints(int numQuerySegs) const;
     bool validateSearchRequest(int numQuerySegs) const; // make sure all user specified requirements are consistent
     bool areNumMatchConstraintsConsistent() const;
 
+    /* binary (de)serialization, e.g., for sending options to another process;
+     * sequence constraints cannot be written */
+    void write(ostream& _os) const;
+    void read(istream& _is);
+
   private:
     mstreal rmsdCutRequested;
     int contextLength;                       // how long of a local window to consider when comparing segment alingments between solutions
@@ -374,14 +475,284 @@ class fasstSearchOptions {
     bool gapConstSet, diffChainRestSet, verb;
     int maxNumMatches, minNumMatches, suffNumMatches;
     fasstSeqConst* seqConst;
+    mstreal maxSearchTime;                   // in seconds
+    long maxSearchNodes;
+    bool orderTargets;                       // visit targets in the order of their residual bounds
+};
+
+/* Counters and per-phase wall times of FASST searches. Phases are segment
+ * scoring (aligning each query segment onto every target window, including
+ * descriptor pre-filtering and building the proximity grids), placement (the
+ * recursive search over combinations of alignments), redundancy filtering
+ * (inserting solutions into a set filtered for redundancy), and merging (of the
+ * solutions of parallel search workers). Times are summed over threads, so
+ * they can add up to more than the elapsed time of a parallel search. */
+class fasstSearchStats {
+  public:
+    fasstSearchStats() { reset(); }
+    void reset();
+    fasstSearchStats& operator+=(const fasstSearchStats& other);
+    friend ostream& operator<<(ostream &_os, const fasstSearchStats& stats);
+
+    double scoringTime, placementTime, redundancyTime, mergeTime; // in seconds
+    long targetsSearched;    // targets for which segments were scored
+    long targetsSkipped;     // targets not searched since their residual bound was above the cutoff
+    long windowsScored;      // segment alignments scored, over all segments and targets
+    long windowsKept;        // of these, ones under the residual cutoff, kept as options for the search
+    long nodesVisited;       // alignments chosen at any level of the recursion
+    long boundPruned;        // of these, ones rejected since their residual bound was above the cutoff
+    long gapPruned;          // options removed by gap and different-chain constraints
+    long proximityPruned;    // options removed by centroid-to-centroid distance tolerances
+    long solutionsFound;     // full alignments under the cutoff
+    long redundantRejected;  // of these, ones rejected by redundancy filtering
+    bool partial;            // the search was stopped before it was done (see fasstSearchOptions::setMaxSearchTime)
+};
+
+/* A read-only FASST database in a layout that is mmap-ed, rather than read, so
+ * that nothing is allocated per target atom and several processes on the same
+ * host share one copy of the data through the page cache. The file consists of
+ * a fixed header, followed by (8-byte aligned) flat arrays: a target table, a
+ * table of chain lengths, float coordinates of the searchable backbone atoms
+ * of all targets (xyz-interleaved, atomsPerResidue() atoms per residue, in the
+ * centered frame FASST searches in), residue codes of all targets, a name blob,
+ * and one column of values per real-valued residue property. String, pair and
+ * relational properties, which are irregular and comparatively small, are kept
+ * in a trailing section in the stream format of FASST::writeDatabase. All data
+ * are in native byte order. Files are produced by FASST::writeMappedDatabase. */
+class fasstMappedDB {
+  public:
+    fasstMappedDB(const string& dbFile);
+    ~fasstMappedDB();
+
+    // does the given file start like a mapped database?
+    static bool isMappedDatabase(const string& dbFile);
+
+    int numTargets() const { return hdr->numTargets; }
+    int atomsPerResidue() const { return hdr->atomsPerRes; }
+    int residueSize(int ti) const { return targ[ti].numRes; }
+    int chainSize(int ti) const { return targ[ti].numChains; }
+    int chainLength(int ti, int ci) const { return chainLens[targ[ti].chainOff + ci]; }
+    string targetName(int ti) const { return string(names + targ[ti].nameOff); }
+    void targetTranslation(int ti, mstreal& x, mstreal& y, mstreal& z) const { x = targ[ti].trans[0]; y = targ[ti].trans[1]; z = targ[ti].trans[2]; }
+    void targetExtent(int ti, mstreal& xlo, mstreal& ylo, mstreal& zlo, mstreal& xhi, mstreal& yhi, mstreal& zhi) const;
+    const float* coordinates(int ti) const { return coords + targ[ti].resOff * hdr->atomsPerRes * 3; }
+    const res_t* sequence(int ti) const { return seqs + targ[ti].resOff; }
+
+    // real-valued per-residue properties; propertyValues() returns NULL if the
+    // property is not defined for the target
+    int numProperties() const { return hdr->numProps; }
+    string propertyName(int k) const { return string(names + props[k].nameOff); }
+    int propertyIndex(const string& propType) const;
+    const double* propertyValues(int k, int ti) const;
+
+    // where the section of irregular properties starts in the file
+    long extraSectionOffset() const { return hdr->extraOff; }
+    string getFile() const { return file; }
+
+    /* On-disk records. Offsets in the header and in property entries are in
+     * bytes from the start of the file. In target entries, resOff and chainOff
+     * index into the per-residue and chain-length arrays, respectively, and
+     * nameOff is in bytes into the name blob. */
+    struct header {
+      char magic[8];
+      int32_t version, atomsPerRes;
+      int64_t numTargets, numChains, numResidues, numProps;
+      int64_t targOff, chainOff, coordOff, seqOff, nameOff, propOff, extraOff, fileSize;
+    };
+    struct targetEntry {
+      int64_t resOff, chainOff, nameOff;
+      int32_t numRes, numChains;
+      double trans[3], lo[3], hi[3];
+    };
+    struct propertyEntry {
+      int64_t nameOff, presentOff, valuesOff;
+    };
+    static const char* magicString() { return "MSTFMAP"; }
+    static const int currentVersion = 1;
+
+  private:
+    string file;
+    void* base;
+    size_t len;
+    const header* hdr;
+    const targetEntry* targ;
+    const int32_t* chainLens;
+    const float* coords;
+    const res_t* seqs;
+    const char* names;
+    const propertyEntry* props;
+    map<string, int> propIdx;
+};
+
+/* An index of rotation-invariant descriptors of target windows, for a set of
+ * segment lengths. The descriptor of a window (of a given number of residues,
+ * with the searchable backbone atoms of each) is the triple of singular values
+ * of its centered coordinate matrix, in descending order. By Mirsky's
+ * inequality, the optimal superposition residual of two equal-size point sets
+ * is no smaller than the sum of squared differences of their descriptors, so
+ * windows whose descriptors are far from that of a query segment cannot be
+ * part of a match within the residual cutoff and need not be scored at all.
+ * Descriptors are kept per target, so targets without them (e.g., added after
+ * the index was built) are simply not filtered. Descriptors are stored as
+ * floats; residualBound() allows for the corresponding round-off. */
+class fasstSegmentIndex {
+  public:
+    fasstSegmentIndex() {}
+
+    bool empty() const { return desc.empty(); }
+    void clear() { desc.clear(); }
+    vector<int> getLengths() const;
+
+    /* Descriptors of the windows of L residues in target ti, 3 per window (so
+     * the window starting at residue ri is at offset 3*ri), or NULL if target
+     * ti is not indexed for this length. */
+    const float* descriptors(int L, int ti) const;
+    void setDescriptors(int L, int ti, const vector<float>& d);
+
+    /* I/O of the descriptors of targets [firstTarget, firstTarget + numTargets)
+     * to/from their own file. On reading, the descriptors of the i-th target in
+     * the file go to target firstTarget + i; numRes (the number of searchable
+     * residues of targets from firstTarget on) must agree with the file. */
+    void write(const string& file, int firstTarget, int numTargets, const vector<int>& numRes, int atomsPerRes) const;
+    void read(const string& file, int firstTarget, const vector<int>& numRes, int atomsPerRes);
+
+    // descriptor of the n points in the packed span coords
+    template <class T>
+    static void descriptor(const T* coords, int n, mstreal d[3]);
+    // descriptors of numWindows windows of n points each, starting every step points
+    template <class T>
+    static void windowDescriptors(const T* coords, int numWindows, int n, int step, vector<float>& d);
+
+    // lower bound on the residual of superimposing point sets with descriptors a and b
+    static mstreal residualBound(const mstreal* a, const float* b);
+
+  private:
+    map<int, vector<vector<float> > > desc; // desc[L][ti] are descriptors of windows of length L in target ti
+};
+
+/* Inverted index of target sequences: for every residue code, the global
+ * offsets of all residues with that code, in increasing order. Target ti owns
+ * global offsets [residueOffset(ti), residueOffset(ti + 1)). Positional
+ * sequence constraints on a segment are satisfied by intersecting the lists of
+ * the constrained positions, so constrained searches only visit targets (and
+ * alignments) that can meet them. */
+class fasstSequenceIndex {
+  public:
+    fasstSequenceIndex() { targStart.assign(1, 0); }
+
+    void build(const vector<Sequence>& seqs);
+    int numTargets() const { return targStart.size() - 1; }
+    int residueOffset(int ti) const { return targStart[ti]; }
+    int targetOf(int off) const { return upper_bound(targStart.begin(), targStart.end(), off) - targStart.begin() - 1; }
+    const vector<int>& postings(res_t aa) const;
+
+    /* Global offsets (in increasing order) of the first residues of all
+     * windows of L residues, within a single target, in which the residue at
+     * positions[k] (counting from the start of the window) is one of
+     * allowed[k], for every k. The list of the most selective position drives
+     * the intersection; the others are checked against the indexed sequence. */
+    void admissibleStarts(const vector<int>& positions, const vector<set<res_t> >& allowed, int L, vector<int>& starts) const;
+
+  private:
+    vector<int> targStart;          // first global offset of each target (and one past the last)
+    vector<res_t> codes;            // residue codes of all targets, by global offset
+    map<res_t, vector<int> > lists; // posting list of each residue code
+};
+
+/* Columnar store of real-valued residue and residue-pair properties. Targets
+ * are registered in order, and target ti owns the global residue offsets
+ * [residueOffset(ti), residueOffset(ti) + residueSize(ti)). Each residue
+ * property is one contiguous column over those offsets (targets for which it
+ * is not set take up room, but hold no values), so once the integer ID of a
+ * property is known, reading a value is a single indexed load. Values may also
+ * live outside of the store (e.g., in a memory-mapped database), in which case
+ * the store just points to them, and these take precedence over in-memory ones.
+ * Pair properties are kept in CSR form: every residue has a range of partner
+ * residues (in the same target) with the corresponding values. Residue and
+ * pair properties have separate ID spaces, and IDs never change once given. */
+class fasstPropertyStore {
+  public:
+    fasstPropertyStore() { resOff.push_back(0); }
+
+    void addTarget(int numRes) { resOff.push_back(resOff.back() + numRes); }
+    int numTargets() const { return resOff.size() - 1; }
+    int64_t residueOffset(int ti) const { return resOff[ti]; }
+    int residueSize(int ti) const { return resOff[ti + 1] - resOff[ti]; }
+
+    // residue properties; propertyID() returns -1 if the property is not known,
+    // while addProperty() returns the ID of the property, adding it if needed
+    int numProperties() const { return cols.size(); }
+    const string& propertyName(int id) const { return cols[id].name; }
+    int propertyID(const string& name) const;
+    int addProperty(const string& name);
+    void setValues(int id, int ti, const vector<mstreal>& vals);
+    void setExternalValues(int id, int ti, const mstreal* vals);
+    bool isPopulated(int id) const; // set for at least one target?
+
+    // residueSize(ti) values of property id in target ti, or NULL if not set
+    const mstreal* values(int id, int ti) const {
+      const column& c = cols[id];
+      if (ti >= c.own.size()) return NULL;
+      if (c.ext[ti] != NULL) return c.ext[ti];
+      return c.own[ti] ? c.vals.data() + resOff[ti] : NULL;
+    }
+
+    // pair properties, with the same conventions
+    int numPairProperties() const { return pairCols.size(); }
+    const string& pairPropertyName(int id) const { return pairCols[id].name; }
+    int pairPropertyID(const string& name) const;
+    int addPairProperty(const string& name);
+    void setPairValues(int id, int ti, const map<int, map<int, mstreal> >& vals);
+    /* The same, with rows given in CSR form: rowLen[ri] is the number of
+     * partners of residue ri (or -1 if the residue has no entry at all), the
+     * partners of consecutive rows being listed consecutively in partners
+     * (and their values in vals). */
+    void setPairValues(int id, int ti, const vector<int>& rowLen, const vector<int>& partners, const vector<mstreal>& vals);
+    bool hasPairValues(int id, int ti) const { const pairColumn& c = pairCols[id]; return (ti < c.present.size()) && c.present[ti]; }
+    map<int, map<int, mstreal> > getPairValues(int id, int ti) const;
+
+    /* Number of partners of residue ri of target ti for pair property id, or -1
+     * if the residue has no entry. Upon return, partners and vals point to the
+     * partner residue indices and corresponding values, respectively. */
+    int pairs(int id, int ti, int ri, const int*& partners, const mstreal*& vals) const {
+      const pairColumn& c = pairCols[id];
+      if ((ti >= c.present.size()) || !c.present[ti] || (ri < 0) || (ri >= residueSize(ti))) return -1;
+      int64_t g = resOff[ti] + ri;
+      partners = c.partners.data() + c.rowBeg[g];
+      vals = c.vals.data() + c.rowBeg[g];
+      return c.rowLen[g];
+    }
+
+  private:
+    struct column {
+      string name;
+      vector<mstreal> vals;       // in-memory values, by global residue offset
+      vector<bool> own;           // own[ti] is true if vals holds values for target ti
+      vector<const mstreal*> ext; // or, ext[ti] points to values of target ti held elsewhere
+    };
+    struct pairColumn {
+      string name;
+      vector<bool> present;    // present[ti] is true if the property is set for target ti
+      vector<int64_t> rowBeg;  // by global residue offset, the first entry in partners/vals
+      vector<int> rowLen;      // and the number of entries (-1 if none)
+      vector<int> partners;    // partner residue indices (within the same target)
+      vector<mstreal> vals;
+    };
+    void extendColumn(column& c, int ti);
+
+    vector<int64_t> resOff;
+    vector<column> cols;
+    vector<pairColumn> pairCols;
+    map<string, int> colIdx, pairColIdx;
 };
 
 /* FASST -- Fast Algorithm for Searching STructure */
 class FASST {
+  friend class fasstShardServer;
   public:
     enum matchType { REGION = 1, FULL, WITHGAPS };
     enum searchType { CA = 1, FULLBB };
-    enum targetFileType { PDB = 1, BINDATABASE, STRUCTURE };
+    enum targetFileType { PDB = 1, BINDATABASE, STRUCTURE, MAPPEDDATABASE };
     typedef fasstSolution::resAddress resAddress;
 
     class targetInfo {
@@ -409,12 +780,12 @@ class FASST {
          * their index into this array (the world index), although internally costs
          * will also be stored (plus mappings between the two orders), so that the
          * best available option will always be known. If second argument given as
-         * true, will start with all options being available. Otherwise, none will
-         * be marked as available. */
+         * true, will start with all options being available (except for those
+         * costing more than maxCost). Otherwise, none will be marked as available. */
         optList(const vector<mstreal>& _costs, bool add = false) { setOptions(_costs, add); }
         optList() { bestCostRank = -1; numIn = 0; }
 
-        void setOptions(const vector<mstreal>& _costs, bool add = false);
+        void setOptions(const vector<mstreal>& _costs, bool add = false, mstreal maxCost = INFINITY);
         void addOption(int k);
         // after this, the only remaining allowed options will be those that were
         // allowed before AND are in the specified list
@@ -434,26 +805,42 @@ class FASST {
         void copyIn(const optList& opt);
         void removeOptions(int b, int e);
         void removeOption(int k);
-        mstreal bestCost() { return (numIn == 0) ? 0.0 : costs[bestCostRank]; }
-        int bestChoice() { return rankToIdx[bestCostRank]; }
+        mstreal bestCost() { return (numIn == 0) ? 0.0 : costs[bestRank()]; }
+        int bestChoice() { return rankToIdx[bestRank()]; }
         int totNumOptions() { return costs.size(); }
         int numOptions() { return numIn; }
         int size() { return numIn; }
         bool empty() { return (numIn == 0); }
+        bool isIn(int k) const { return (inBits[k >> 6] >> (k & 63)) & 1; }
         bool consistencyCheck();
 
       private:
+        /* Removes options with indices in [b, e] (which must be within range)
+         * a word at a time. */
+        void clearRange(int b, int e);
+        // keeps only the options set in the given bit set (as in inBits)
+        void intersectBits(const vector<uint64_t>& bits);
+        /* Options are only ever removed in bulk, so the best rank is advanced
+         * lazily, past the ranks of options removed since, when it is needed. */
+        int bestRank() {
+          while (!isIn(rankToIdx[bestCostRank])) bestCostRank++;
+          return bestCostRank;
+        }
+
         // costs, sorted in ascending order
         vector<mstreal> costs;
 
-        // is each option (by world index) currently available?
-        vector<bool> isIn;
+        // which options (by world index) are currently available, as a bit set
+        // with 64 options per word
+        vector<uint64_t> inBits, okBits;
 
         // back-and-forth mappings between rank by cost (ascending order) and the
         // flat index known to the word
         vector<int> idxToRank, rankToIdx;
 
-        // of the available options, the lowest-cost rank
+        // no available option has a rank below this one (if there are any
+        // available options, it is the best rank or one of a removed option
+        // ahead of it)
         int bestCostRank;
 
         // number of currently available options
@@ -464,17 +851,25 @@ class FASST {
     FASST();
     void setQuery(const string& pdbFile, bool autoSplitChains = true);
     void setQuery(const Structure& Q, bool autoSplitChains = true);
-    Structure getQuery() const { return queryStruct; }
-    int getNumQuerySegments() const { return queryStruct.chainSize(); }
+    /* Searches for the residues of a view without copying them; the parent
+     * structure must outlive the searches (and keep its residues). */
+    void setQuery(const StructureView& Q, bool autoSplitChains = true);
+    Structure getQuery() const { return (queryView.getParent() != NULL) ? queryView.toStructure() : queryStruct; }
+    int getNumQuerySegments() const { return query.size(); }
     AtomPointerVector getQuerySearchedAtoms() const;
     void addTarget(const Structure& T, short memSave = 0);
     void addTarget(const string& pdbFile, short memSave = 0);
-    void addTargets(const vector<string>& pdbFiles, short memSave = 0);
+    void addTargets(const vector<string>& pdbFiles, short memSave = 0); // files are read in parallel (see setNumThreads())
     void stripSidechains(Structure& S);
 
     void addResidueStringProperties(int ti, const string& propType, const vector<string>& propVals);
     void addResidueProperties(int ti, const string& propType, const vector<mstreal>& propVals);
     void addResiduePairProperties(int ti, const string& propType, const map<int, map<int, mstreal> >& propVals);
+    /* The same, with the values given as rows, one per residue of the target:
+     * the number of partners of each residue (-1 if none), and the partner
+     * indices and values of all rows, one row after the other (e.g., as made
+     * by contactList::pairTable). */
+    void addResiduePairProperties(int ti, const string& propType, const vector<int>& rowLen, const vector<int>& partners, const vector<mstreal>& propVals);
     // void addResidueRelationships(int ti, const string& propType, const map<int, map<int, map<int, set<int> > >& resRels);
     void addResidueRelationship(int ti, const string& propType, int ri, int tj, int rj);
     map<int, vector<resAddress>> getResidueRelationships(int ti, const string& propType);
@@ -491,6 +886,19 @@ class FASST {
     mstreal isResiduePairPropertyPopulated(const string& propType);
     map<int, mstreal> getResiduePairProperties(int ti, const string& propType, int ri);
     mstreal isResidueRelationshipPopulated(const string& propType);
+
+    /* Integer handles of residue and residue-pair properties, which save the
+     * name lookups when reading properties of many residues. Return -1 if the
+     * property is not defined in the database. Handles stay valid as targets
+     * and properties are added. */
+    int getResiduePropertyID(const string& propType) const { return db->props.propertyID(propType); }
+    int getResiduePairPropertyID(const string& propType) const { return db->props.pairPropertyID(propType); }
+    bool hasResidueProperty(int ti, int propID, int ri) const;
+    mstreal getResidueProperty(int ti, int propID, int ri) const;
+    /* Returns the number of partners of residue ri in target ti under the given
+     * pair property (or -1 if the residue has no entry), pointing partners and
+     * vals at the partner residue indices and the corresponding values. */
+    int getResiduePairProperties(int ti, int propID, int ri, const int*& partners, const mstreal*& vals) const;
     void dropResidueRelationship(const string& propType) { resRelProperties.erase(propType); }
 
     // access to search options
@@ -529,12 +937,94 @@ class FASST {
     int numTargets() const { return targetStructs.size(); }
     Structure getTargetCopy(int i) const { return *(targetStructs[i]); }
     Structure* getTarget(int i) { return targetStructs[i]; }
-    int getTargetResidueSize(int i) const { return (targetStructs[i] == NULL) ? atomToResIdx(targets[i].size()) : targetStructs[i]->residueSize(); }
+    int getTargetResidueSize(int i) const { return (targetStructs[i] == NULL) ? atomToResIdx(searchableAtomSize(i)) : targetStructs[i]->residueSize(); }
     string getTargetName(int ti) const { return (targetStructs[ti] == NULL) ? "not-saved" : targetStructs[ti]->getName(); }
     Sequence getTargetSequence(int i) { return targSeqs[i]; }
+    /* Packed x, y, z coordinates of the searchable (backbone) atoms of a target,
+     * as the database holds them (no copy is made), atomsPerResidue() atoms per
+     * residue. Targets from a mapped database are held in single precision, so
+     * for those getTargetCoordinates() returns NULL and the coordinates come
+     * from getMappedTargetCoordinates() (and the other way around for targets
+     * held in memory, which are in mstcoor precision). The pointers stay valid
+     * until the database changes. */
+    int getTargetSearchableAtomSize(int ti) const { return db->searchableAtomSize(ti); }
+    const mstcoor* getTargetCoordinates(int ti) const { return db->targetCoords[ti].empty() ? NULL : db->targetCoords[ti].data(); }
+    const float* getMappedTargetCoordinates(int ti) const { return db->mappedCoordinates(ti); }
+    int atomsPerResidue() const { return atomsPerRes; }
     void setSearchType(searchType _searchType);
+    searchType getSearchType() const { return type; }
     void setGridSpacing(mstreal _spacing) { gridSpacing = _spacing; updateGrids = true; }
+
+    /* With more than one thread, search() distributes targets among worker
+     * threads, each with its own search state, and merges their solutions at
+     * the end, honoring the same match-number and redundancy options as the
+     * serial search. The RMSD cutoff implied by the max number of matches is
+     * shared among workers as it tightens, so pruning stays comparable to the
+     * serial path. The default is 1 (serial search). */
+    void setNumThreads(int n);
+    int getNumThreads() const { return numThreads; }
     fasstSolutionSet search();
+
+    /* Counters and timings of the last search (or the sum over the queries of
+     * the last searchBatch). Gathering them costs a few clock reads per target
+     * and a counter increment per recursion node. */
+    const fasstSearchStats& getSearchStats() const { return stats; }
+
+    /* True if the last search was stopped early, because it ran out of its time
+     * or node budget (see fasstSearchOptions::setMaxSearchTime) or because the
+     * solution callback asked it to stop, so that its solutions are the best
+     * ones found until then rather than the best ones overall. For searchBatch,
+     * true if any query was stopped early, each query having its own budget. */
+    bool isSearchPartial() const { return stats.partial; }
+
+    /* If set, the callback is called with each solution as it is accepted
+     * during search() (e.g., to start working on good matches before the search
+     * is done); returning false stops the search, leaving it partial. Note that
+     * solutions accepted early may later be displaced (by better ones, when the
+     * number of matches is limited, or by redundancy filtering). In a parallel
+     * search, the callback is called from the worker threads, one at a time. It
+     * is not used by searchBatch. */
+    void setSolutionCallback(const function<bool(const fasstSolution&)>& cb) { solutionCallback = cb; }
+    void unsetSolutionCallback() { solutionCallback = nullptr; }
+
+    /* Seeds subsequent calls to search() with solutions of an earlier, similar
+     * query (e.g., the previous point along a trajectory). Before searching, the
+     * seeds are re-scored against the current query (see matchRMSDs). If the
+     * number of matches is limited, the RMSD of the N-th best of them bounds
+     * that of the N-th best match, giving the search a tight initial cutoff
+     * rather than it having to discover one (N being the max number of
+     * matches, or the min number when the RMSD cutoff is looser than that). Seeds that do not
+     * fit the current query or database are ignored. Redundancy filtering can
+     * make a seeded cutoff too tight, so a seeded search that ends up with
+     * fewer than N matches is repeated without the seed. Seeds are kept until
+     * cleared, and are not used by searchBatch. */
+    void setWarmStart(const fasstSolutionSet& sols);
+    void setWarmStart(const vector<fasstSolutionAddress>& addresses) { warmStart = addresses; }
+    void clearWarmStart() { warmStart.clear(); }
+
+    /* Creates a new object that searches over this object's database, with the
+     * same search type and grid spacing, but its own query, options and search
+     * state (caller takes ownership). Different searchers can be used from
+     * different threads concurrently, as long as the database does not change. */
+    FASST* newSearcher();
+
+    /* Merges solutions found separately (e.g., by the workers of a parallel
+     * search, or on different shards of a database) into one set. Solutions are
+     * inserted best first, so that redundancy filtering keeps the best member of
+     * each redundant group, and then the limits in opts on the number of matches
+     * are applied to the combined set. Redundancy by property is only applied if
+     * the relationship map is given. */
+    static fasstSolutionSet mergeSolutions(vector<const fasstSolution*>& pool, int numSegs, const fasstSearchOptions& opts, simpleMap<resAddress, tightvector<resAddress>>* relMap = NULL);
+
+    /* Searches for several queries at once, returning one solution set per
+     * query (in the same order). Targets are visited in the outer loop, so each
+     * target is brought into cache once and scored against the whole batch.
+     * If queryOpts is given, it must have one entry per query; otherwise this
+     * object's options apply to every query. As with setQuery(), gap and same-
+     * chain constraints are reset for each query. With more than one thread,
+     * queries are divided among threads. The query and solutions stored in
+     * this object are not affected. */
+    vector<fasstSolutionSet> searchBatch(const vector<Structure>& queries, const vector<fasstSearchOptions>& queryOpts = vector<fasstSearchOptions>(), bool autoSplitChains = true);
     int numMatches() { return solutions.size(); }
 
     fasstSolutionSet getMatches() { return solutions; }
@@ -549,10 +1039,64 @@ class FASST {
      * atoms) can be tollerated.*/
     void readDatabase(const string& dbFile, short memSave = 0);
 
+    /* Targets whose full structure was not retained (e.g., read with memSave = 2)
+     * have to be re-read from their source to produce matches. Re-read targets
+     * can be kept in a least-recently-used cache of full structures, bounded by
+     * the given number of bytes (estimated from atom, residue, and chain counts),
+     * so that a backbone-only database can still give detailed matches from the
+     * same targets without going back to disk each time. 0 (the default) turns
+     * the cache off. */
+    void setTargetCacheBudget(size_t bytes);
+    size_t getTargetCacheBudget() const { return cacheBudget; }
+    size_t getTargetCacheSize() const { return cacheBytes; } // bytes currently held
+
+    /* In arena mode, the structures of targets added from then on (by reading
+     * databases or PDB files, or by copying) are all allocated from a single
+     * arena held by this object (see MstArena). This makes building and tearing
+     * down large databases considerably cheaper. Off by default. */
+    void setArenaMode(bool on);
+    bool getArenaMode() const { return arena != NULL; }
+
+    /* Writes the database in the memory-mapped format (see fasstMappedDB). As
+     * with memSave = 2, only the searchable backbone is kept, so every residue
+     * of every target must be searchable. readDatabase() recognizes the format
+     * and maps such a file instead of reading it. Targets coming from a mapped
+     * file are searched in place and hold no Structure; match structures built
+     * from them consist of the searchable backbone atoms only, and detailed
+     * matches are not available. The mapping stays open while this object
+     * lives. */
+    void writeMappedDatabase(const string& dbFile);
+    void mapDatabase(const string& dbFile);
+
+    /* Builds the segment descriptor index (see fasstSegmentIndex) of all current
+     * targets, for segments of the given lengths (in residues). If the index
+     * covers the lengths of the query segments, windows that provably exceed
+     * the residual cutoff are discarded before being scored. The index is kept
+     * alongside the database in the file segmentIndexFile(dbFile), which
+     * readDatabase() loads automatically if it exists (i.e., the index must
+     * be written after the database). */
+    void buildSegmentIndex(const vector<int>& lengths);
+    void writeSegmentIndex(const string& dbFile);
+    void readSegmentIndex(const string& dbFile, int firstTarget = 0);
+    static string segmentIndexFile(const string& dbFile) { return dbFile + ".sidx"; }
+    const fasstSegmentIndex& getSegmentIndex() const { return segIndex; }
+
+    /* The inverted index of target sequences (see fasstSequenceIndex), built
+     * (or brought up to date with added targets) upon first use, e.g. by the
+     * first search with positional sequence constraints. */
+    const fasstSequenceIndex& getSequenceIndex();
+
     // get various match properties
     void getMatchStructure(const fasstSolution& sol, Structure& match, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
     Structure getMatchStructure(const fasstSolution& sol, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
     void getMatchStructures(fasstSolutionSet& sols, vector<Structure>& matches, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
+    /* Streaming version of getMatchStructures(): each match is built in turn into
+     * the same Structure buffer and handed to the visitor along with its index in
+     * sols, so that memory does not grow with the number of matches (the buffer is
+     * only valid for the duration of the call). Matches are visited grouped by
+     * target, and targets that need to be re-read are visited in the order they
+     * are laid out on disk, with each file opened only once. */
+    void visitMatchStructures(fasstSolutionSet& sols, const function<void(int, const Structure&)>& visitor, bool detailed = false, matchType type = matchType::REGION, bool algn = true);
     vector<Sequence> getMatchSequences(fasstSolutionSet& sols, matchType type = matchType::REGION);
     Sequence getMatchSequence(const fasstSolution& sol, matchType type = matchType::REGION);
     vector<vector<mstreal> > getResidueProperties(fasstSolutionSet& sols, const string& propType, matchType type = matchType::REGION);
@@ -572,7 +1116,7 @@ class FASST {
      * property in the FASST database. */
     fasstSolutionSet removeRedundancy(const fasstSolutionSet& matches);
 
-    simpleMap<resAddress, tightvector<resAddress>>& getRedundancyPropertyMap() { return resRelProperties[opts.getRedundancyProperty()]; }
+    simpleMap<resAddress, tightvector<resAddress>>& getRedundancyPropertyMap() { return db->resRelProperties[opts.getRedundancyProperty()]; }
 
   protected:
     void processQuery();
@@ -581,7 +1125,9 @@ class FASST {
     int rmsdPriority() const { return rPrior; }
     mstreal getCurrentRMSDCutoff() const { return rmsdCut; }
     void prepForSearch(int ti);
+    vector<mstreal> warmStartRMSDs();                 // RMSDs of the warm-start seeds that fit the current query, re-scored against it, in increasing order
     bool parseChain(const Chain& S, AtomPointerVector* searchable = NULL, Sequence* seq = NULL);
+    bool parseResidues(const vector<Residue*>& residues, AtomPointerVector* searchable = NULL, Sequence* seq = NULL);
     mstreal currentAlignmentResidual(bool compute, bool setTransform = false);   // computes the accumulated residual up to and including segment recLevel
     mstreal boundOnRemainder(bool compute);           // computes the lower bound expected from segments recLevel+1 and on
     Transform currentTransform();                     // tansform for the alignment corresponding to the current residual
@@ -592,12 +1138,86 @@ class FASST {
     mstreal segCentToPrevSegCentTol(int i);
     void rebuildProximityGrids();
     void addTargetStructure(Structure* targetStruct, short memSave = 0);
+    // the cached full structure of the target (NULL if not cached), marking it as most recently used
+    shared_ptr<Structure> cachedTarget(int idx);
+    // caches a copy of the full structure of the target if it fits the budget, evicting the least recently used
+    // targets as needed; returns the copy (NULL if not cached)
+    shared_ptr<Structure> cacheTarget(int idx, const Structure& S);
+    static size_t structureBytes(const Structure& S);
     void addSequenceContext(fasstSolution& sol); // decorate the solution with sequence context
+    void expandExtent(mstreal _xlo, mstreal _ylo, mstreal _zlo, mstreal _xhi, mstreal _yhi, mstreal _zhi); // grow the bounding box to include a newly added target
     void fillTargetChainInfo(int ti);
 
+    // number of searchable atoms in the given target
+    int searchableAtomSize(int ti) const { return (targetMap[ti] == NULL) ? targetCoords[ti].size()/3 : resToAtomIdx(targetMap[ti]->residueSize(targetMapIdx[ti])); }
+    // coordinates of a target from a mapped database, or NULL for a target held in memory
+    const float* mappedCoordinates(int ti) const { return (targetMap[ti] == NULL) ? NULL : targetMap[ti]->coordinates(targetMapIdx[ti]); }
+    Structure mappedTargetStructure(int ti);        // build a backbone-only Structure for a mapped target (in its original frame)
+
+    // score every alignment of query segment i onto the target with the given
+    // (packed) coordinates, also adding window centroids to the segment's grid
+    template <class T>
+    void scoreSegmentAlignments(int i, const T* coords, int Na, const vector<bool>& okAlignments);
+
+    /* The search proceeds by first initializing the solution set and cutoffs,
+     * then searching target by target. searchTarget() returns false if no more
+     * targets need to be searched (e.g., the sufficient number of matches was
+     * found). */
+    void initSearch();
+    /* Computes residual bounds of targets from the segment index (into
+     * targetBounds), and, if target ordering is on, the order of targets by
+     * bound (into targetOrder). Either is left empty if not applicable. Also
+     * looks up alignments admissible under positional sequence constraints
+     * (see filterBySequence). */
+    void boundTargets();
+    /* For every query segment with positional sequence constraints, finds the
+     * admissible alignments in the sequence index (into seqStarts, with
+     * seqIndexed marking such segments); targets lacking an admissible
+     * alignment of any of these segments are then skipped. */
+    void filterBySequence();
+    bool searchTarget(int ti);
+    /* Moves solutions found into the solution heap (if used) into the solution
+     * set, computing their transforms. Ends every search. */
+    void collectSolutions();
+    Transform alignmentTransform(int ti, const int* origAlignment);
+    int numFoundSolutions() const { return useHeap ? found.size() : solutions.size(); }
+    mstreal worstFoundRMSD() const { return useHeap ? found.worstRMSD() : solutions.worstRMSD(); }
+    void removeWorstFound() { if (useHeap) found.popWorst(); else solutions.erase(--solutions.end()); }
+
+    /* State shared by the workers of a parallel search. */
+    class sharedSearchState {
+      public:
+        sharedSearchState(mstreal cut) : nextTarget(0), numFound(0), rmsdCut(cut), numNodes(0), stop(false) {}
+        void tightenRMSDCutoff(mstreal cut);
+        atomic<int> nextTarget;  // the next target to be claimed by some worker
+        atomic<int> numFound;    // the total number of solutions accepted by all workers
+        atomic<mstreal> rmsdCut; // an RMSD cutoff known to be safe for all workers
+        atomic<long> numNodes;   // recursion nodes visited by all workers (as last reported by each)
+        atomic<bool> stop;       // set when the search is to stop early
+    };
+
+    // true (marking the search as partial) if the search should stop early
+    bool outOfBudget();
+
+    /* Makes this object search over the target database of the given object,
+     * rather than over its own (which should be empty). The owner must outlive
+     * this object and its database must not change while this one is in use. */
+    void borrowDatabase(FASST* owner);
+
+    fasstSolutionSet parallelSearch();
+    fasstSolutionSet parallelSearch(sharedSearchState& state); // with workers sharing the given state
+
   private:
     fasstSearchOptions opts;
 
+    // the object that owns the target database being searched (normally this
+    // object, but workers of a parallel search borrow the database of their
+    // parent). Fields below related to targets are only meaningful for the owner.
+    FASST* db;
+    int numThreads;
+    MstArena* arena;           // target structures come from here, if not NULL
+    sharedSearchState* shared; // set only while searching as a worker
+
     /* targetStructs[i] and targets[i] store the original i-th target structure
      * and just the part of it that will be searched over, respectively. NOTE:
      * Atoms* in targets[i] point to Atoms of targetStructs[i]. So there is only
@@ -605,38 +1225,45 @@ class FASST {
      * targets[i] to targetStructs[i], even if when building tagrets[i] some of
      * the residues in targetStructs[i] had to be ignored for whatever reason
      * (e.g., missing backbone). NOTE: it is also possible for any targetStructs[i]
-     * entry to be NULL. This means that the full structure was not retained, that
-     * atoms in targets[i] are "disembodied" copies that have been stripped of
-     * any extra information except coordinates, and therefore is a one-to-one
-     * correspondence between residues in the original full structure and atom
-     * indices in targets[i] (i.e., nothing was skipped upon processing). This
-     * is done for memory reasons. */
+     * entry to be NULL. This means that the full structure was not retained,
+     * targets[i] is empty, and there is a one-to-one correspondence between
+     * residues in the original full structure and the searchable atoms (i.e.,
+     * nothing was skipped upon processing). This is done for memory reasons.
+     * Either way, the search itself only reads targetCoords[i], which packs the
+     * coordinates of the searchable atoms as consecutive x, y, z triples (for
+     * targets from a mapped database, the mapped coordinates are read instead
+     * and targetCoords[i] is empty). */
     vector<Structure*> targetStructs;
     vector<AtomPointerVector> targets;
+    vector<vector<mstcoor> > targetCoords;
 
     vector<Sequence> targSeqs;               // target sequences (of just the parts that will be searched over)
     vector<targetInfo> targetSource;         // from where and how each target was read (e.g., in case need to re-read it)
+    list<pair<int, shared_ptr<Structure> > > cacheOrder; // re-read full target structures, most recently used first
+    map<int, list<pair<int, shared_ptr<Structure> > >::iterator> cacheIndex; // and where each target is in it
+    size_t cacheBudget, cacheBytes;
+    mutex cacheLock;
+    vector<fasstMappedDB*> mappedDBs;        // mapped database files (owned)
+    vector<fasstMappedDB*> targetMap;        // the mapped database each target comes from (NULL if held in memory)
+    vector<int> targetMapIdx;                // and the index of the target within it
+    fasstSegmentIndex segIndex;              // segment descriptors of target windows, if an index was built or read
+    fasstSequenceIndex seqIndex;             // inverted index of target sequences (see getSequenceIndex)
+    mutex seqIndexLock;
     vector<tightvector<int>> targetChainLen; // chain lengths in each target, listed in the order chains appear in the corresponding Structure
     vector<int> targChainBeg, targChainEnd;  // targChainBeg[i] and targChainEnd[i] contain the chain start and end indices for the chain
                                              // that contains the residue with index i (in the overal concatenated sequence). Residue indices
                                              // are based on just the portion of the structure to be searched over.
 
-    /* Object for holding real-valued residue properties. Specifically,
-     * resProperties["env"][ti][ri] is the value of the "env" property for
-     * residue ri in target with index ti. */
-    map<string, map<int, vector<mstreal> > > resProperties;
+    /* Real-valued residue and residue-pair properties of all targets (in the
+     * latter case, the values of a residue pair property, e.g. "cont" for the
+     * contact degree, can be directional; i.e., pairs are not mirrored). */
+    fasstPropertyStore props;
 
     /* Object for holding string residue properties. Specifically,
      * resProperties["stride"][ti][ri] is the string value of the "stride" property for
      * residue ri in target with index ti. */
     map<string, map<int, vector<string> > > resStringProperties;
 
-    /* Object for holding real-valued residue-pair properties. Specifically,
-     * resPairProperties["cont"][ti][ri][rj] is the value of the "cont" property
-     * (e.g., contact degree) between residues ri and rj in target with index ti.
-     * NOTE: this property can be directional (i.e., pairs are not mirrored). */
-    map<string, map<int, map<int, map<int, mstreal> > > > resPairProperties;
-
     /* Object for holding residue-pair relational graphs. Specifically,
      * resRelProperties["sim"][(ti, ri)] is the list of all residues in the data-
      * base that are related by the property "sim" to the residue with the address
@@ -648,11 +1275,17 @@ class FASST {
     int currentTarget;                       // the index of the target currently being searched for
 
     Structure queryStruct;
+    StructureView queryView;      // the query, if set as a view (queryStruct is then empty)
     vector<AtomPointerVector> queryOrig;     // just the part of the query that will be sought, split by segment
     vector<AtomPointerVector> query;         // same as above, but with segments re-orderd for optimal searching
     vector<int> qSegOrd;                     // qSegOrd[i] is the index (in the original queryOrig) of the i-th segment in query
     mstreal xlo, ylo, zlo, xhi, yhi, zhi;    // bounding box of the search database
 
+    // descriptors of every query segment (3 per segment), when the database has a segment index
+    vector<mstreal> qSegDesc;
+    vector<mstreal> targetBounds;            // lower bounds on match residuals, by target (see boundTargets)
+    vector<int> targetOrder;                 // order in which to visit targets (if not in database order)
+
     // segmentResiduals[i][j] is the residual of the alignment of segment i, in which
     // its starting residue aligns with the residue index j in the target
     vector<vector<mstreal> > segmentResiduals;
@@ -710,10 +1343,13 @@ class FASST {
     int rPrior;                  // the priority level of the current RMSD (-1 if not currently at a temporary RMSD)
 
     // Atom subsets needed at different recursion levels. So queryMasks[i] stores
-    // all atoms of the first i+1 segments of the query combined. The same for
-    // targetMasks, although (of course), the content of the latter will change
-    // depending on the alignment
-    vector<AtomPointerVector> queryMasks, targetMasks;
+    // all atoms of the first i+1 segments of the query combined. Because each
+    // mask extends the previous one, all of them are prefixes of the last one,
+    // whose coordinates are packed into queryMaskCoor. targetMaskCoor holds the
+    // coordinates of the corresponding target atoms for the current alignment
+    // (so its content changes as segments get placed).
+    vector<AtomPointerVector> queryMasks;
+    vector<mstreal> queryMaskCoor, targetMaskCoor;
 
     // every time a new target is added, this flag will be set so we will know
     // to update proximity grids required for the search
@@ -722,6 +1358,23 @@ class FASST {
     // grid spacing for ProximitySearch object
     mstreal gridSpacing;
 
+    // per-search quantities set up by initSearch()
+    vector<int> segLen;      // number of residues in each (re-ordered) query segment
+    shared_ptr<const vector<int> > solSegLen; // number of residues in each query segment, in the original order, shared by solutions
+    bool useHeap;            // whether solutions are kept in found while searching (without redundancy filtering)
+    fasstSolutionHeap found;
+    vector<int> origAlignment; // buffer for putting the current alignment in the original segment order
+    vector<mstreal> ccTol;   // current center-to-center tolerances for segments
+    bool doRedBar;           // whether redundancy "barrier" cutoffs apply to partial matches
+    fasstSearchStats stats;  // of the current (or last) search
+    chrono::steady_clock::time_point searchDeadline; // if a time budget is set
+    long nodesReported;      // of stats.nodesVisited, ones already added to the shared node count
+    function<bool(const fasstSolution&)> solutionCallback;
+    vector<bool> seqIndexed; // which (re-ordered) query segments have admissible alignments in seqStarts
+    shared_ptr<const vector<vector<int> > > seqStarts; // global offsets of their admissible alignments (see fasstSequenceIndex)
+    vector<fasstSolutionAddress> warmStart; // seeds for the next searches (see setWarmStart)
+    mstreal warmCut;         // initial RMSD cutoff derived from the seeds for the current search (-1 if none)
+
     RMSDCalculator RC;
 };
 
@@ -3,6 +3,9 @@
 
 #include "msttypes.h"
 #include "mstfasst.h"
+#include <memory>
+#include <mutex>
+#include <random>
 
 // TODO:
 // 1. write a test function for the cache.
@@ -15,114 +18,263 @@
 // 4. test the impact of doing #3 above
 // 5. re-introduce minN capability back inot cFASST
 
-class cFASST : public FASST {
+/* The cache behind cFASST: previously performed searches and their solutions.
+ * A store can be shared by any number of cFASST objects (e.g., one per worker
+ * thread) searching the same database, so that all of them benefit from every
+ * search any of them has done. Lookups read an immutable snapshot of the store
+ * contents, so any number of them proceed concurrently without locking;
+ * insertions (with the eviction they may cause) copy the contents under a
+ * writer lock and publish the new snapshot. Entry priorities decay with the
+ * number of searches done through the store. Rather than touching every entry
+ * on every search, each priority is kept in a time-invariant (logarithmic)
+ * form, so that decay is free and a hit only updates the entry that was used. */
+class fasstCacheStore {
   public:
-    cFASST(int max = 1000) : FASST() {
-      maxNumResults = max;
-      sf = 10.0;
-      maxNumPressure = (exp(1.0) - 1.0)*maxNumResults/sf; // so that max factor is 2.0 at the start
-      errTolPressure = (exp(0.1) - 1.0)*maxNumResults/sf; // so that error factor is 1.1 at the start
-      readPerm = modPerm = true;
-      /* Because removal of redundancy is done on-the-fly in FASST (as matches
-       * are discovered) and after the fact in cFASST (after fully redundant
-       * matches are first fetched from the cache), the precise set of matches
-       * may be slightly different in the two cases when redundancy filter is
-       * turned on. We can, of course, make sure that cFASST returns the same
-       * exact results as FASST when redundancy is on, but this takes a bit of
-       * extra computation (not too much, but still). Considering that it is
-       * conceptually cleaner to do after-the-fact filtering (as it is indepedent
-       * of the order in which matches are discovered and thus indepedent of the
-       * order in which the database is listed), it does not seem worth ensuring
-       * this exact equivalence in most cases. But in some cases, like when we
-       * are testing the implementation of the cache for correctness, this may
-       * be desired. Setting this flag to true will have this effect. */
-      strictEquiv = false;
-    }
-    ~cFASST() { clear(); }
-    void clear(); // clears cache (removes all solutions)
-    fasstSolutionSet search();
-    int getMaxNumResults() const { return maxNumResults; }
-    void incErrTolPressure(mstreal del = 1.0) { errTolPressure += fabs(del); }
-    void incMaxNumPressure(mstreal del = 1.0) { maxNumPressure += fabs(del); }
-    void decErrTolPressure(mstreal del = 1.0) { errTolPressure -= fabs(del); if (errTolPressure < 0) errTolPressure = 0; }
-    void decMaxNumPressure(mstreal del = 1.0) { maxNumPressure -= fabs(del); if (maxNumPressure < 0) maxNumPressure = 0; }
-    void setReadPermission(bool _perm) { readPerm = _perm; }
-    void setModifyPermission(bool _perm) { modPerm = _perm; }
-    void setStrictEquivalence(bool _eq) { strictEquiv = _eq; }
-    mstreal getErrTolPressure() const { return errTolPressure; }
-    mstreal getMaxNumPressure() const { return maxNumPressure; }
-    mstreal maxNumFactor() const { return log(sf*maxNumPressure/maxNumResults + 1.0) + 1.5; }
-    mstreal errTolFactor() const { return log(sf*errTolPressure/maxNumResults + 1.0) + 1.05; }
-    bool readPermission() const { return readPerm; }
-    bool modifyPermission() const { return modPerm; }
-    bool strictEquivalence() const { return strictEquiv; }
-
-    // write/read cache object to/from a binary file
-    void write(const string& filename) const;
-    void write(ostream &_os) const;
-    void read(const string& filename);
-    void read(istream &_is);
-
-  protected:
-    static vector<int> getStructureTopology(const Structure& S);
-
-  private:
     class cachedResult {
-      friend class cFASST;
+      friend class fasstCacheStore;
       public:
-        cachedResult() { priority = 1.0; searchRMSDcut = rmsdCut = 0.0; searchMaxNumMatches = 0; }
+        cachedResult() { score = 0.0; searchRMSDcut = rmsdCut = 0.0; searchMaxNumMatches = 0; desc[0] = desc[1] = desc[2] = 0; id = 0; }
         cachedResult(const AtomPointerVector& q, const fasstSolutionSet& sols, mstreal cut, int max, vector<int> topo);
         cachedResult(const cachedResult& r);
         ~cachedResult();
-        void upPriority(mstreal del = 1.0) { priority += del; }
-        void elapsePriority(int Thalf) { priority *= pow(0.5, 1.0/Thalf); }
 
         AtomPointerVector getQuery() const { return query; }
-        vector<fasstSolutionAddress>& getSolutions() { return solSet; }
+        const vector<fasstSolutionAddress>& getSolutions() const { return solSet; }
         mstreal getRMSDCutoff() const { return rmsdCut; }
         mstreal getSearchRMSDCutoff() const { return searchRMSDcut; }
         int getSearchMaxNumMatches() const { return searchMaxNumMatches; }
-        mstreal getPriority() const { return priority; }
         vector<int> getTopology() const { return topology; }
+        const mstreal* getDescriptor() const { return desc; }
         bool isSameTopology(const vector<int>& compTopo) const;
         bool isLimitedByMaxNumMatches() const { return solSet.size() == searchMaxNumMatches; }
 
-        friend bool operator<(const cachedResult& ri, const cachedResult& rj) {
-          if (ri.priority != rj.priority) return (ri.priority > rj.priority);
-          if (ri.solSet.size() != rj.solSet.size()) return ri.solSet.size() < rj.solSet.size();
-          if (ri.query.size() != rj.query.size()) return ri.query.size() < rj.query.size();
-          return &ri < &rj;
-        }
-
         friend ostream& operator<<(ostream &_os, const cachedResult& _res) {
-          _os << "[" << MstUtils::vecToString(_res.topology) << "] " << _res.searchRMSDcut << "/" << _res.searchMaxNumMatches << " (" << _res.priority << ")" << endl;
+          _os << "[" << MstUtils::vecToString(_res.topology) << "] " << _res.searchRMSDcut << "/" << _res.searchMaxNumMatches << endl;
           _os << _res.query << endl << MstUtils::vecToString(_res.solSet) << endl;
           return _os;
         }
 
+        // the priority is not part of the stream; the store writes it
         void write(ostream &_os) const;
         void read(istream &_is);
 
+        // shape descriptor (see fasstSegmentIndex::descriptor) of the given atoms
+        static void descriptor(const AtomPointerVector& atoms, mstreal d[3]);
+
       private:
         AtomPointerVector query;
         vector<int> topology;
         vector<fasstSolutionAddress> solSet;
-        mstreal priority;
+        atomic<mstreal> score; // log of the priority, offset by the decay up to the current time (see fasstCacheStore)
+        mstreal desc[3];       // shape descriptor of the query
+        unsigned long long id; // identifies the entry across cache logs (0 if not yet assigned)
         // search parameters
         mstreal searchRMSDcut, rmsdCut;
         int searchMaxNumMatches;
     };
+    typedef vector<shared_ptr<cachedResult> > entryList;
+
+    /* A state of the store: its entries, along with an index of them by
+     * topology and, within a topology, by the shape descriptor of their query.
+     * The RMSD between two queries is bounded from below by the difference of
+     * their descriptors (see fasstSegmentIndex::residualBound), so only entries
+     * with close enough descriptors, found by a range scan over the largest
+     * descriptor component, need to be compared to a new query exactly. */
+    class contents {
+      friend class fasstCacheStore;
+      public:
+        const entryList& getEntries() const { return entries; }
+        int size() const { return entries.size(); }
 
-    struct compResults {
-      bool operator() (const cachedResult* lhs, const cachedResult* rhs) const {
-        return (*lhs < *rhs);
-      }
+        /* Indices into getEntries(), in increasing order, of the entries with
+         * the given topology that may be within getRMSDCutoff() - margin of a
+         * query with n atoms and descriptor d; all others provably are not. */
+        void candidates(const vector<int>& topo, const mstreal d[3], int n, mstreal margin, vector<int>& cands) const;
+
+      protected:
+        void add(const shared_ptr<cachedResult>& res);
+        void remove(int idx);
+
+      private:
+        struct indexed {
+          float d[3];
+          int idx;
+          bool operator<(const indexed& other) const { return d[0] < other.d[0]; }
+        };
+        struct bucket {
+          bucket() { maxCut = 0; }
+          vector<indexed> byDesc; // sorted by the first descriptor component
+          mstreal maxCut;         // largest RMSD cutoff of any entry in the bucket
+        };
+        entryList entries;
+        map<vector<int>, bucket> buckets;
     };
 
+    fasstCacheStore(int max = 1000);
+    ~fasstCacheStore() {}
+
+    /* The current contents. The snapshot remains valid (and unchanged) for as
+     * long as the caller holds on to it, even if entries are inserted or
+     * evicted in the meantime. */
+    shared_ptr<const contents> snapshot() const { return atomic_load(&state); }
+    int size() const { return snapshot()->size(); }
+
+    /* Adds a new entry (with priority 1), taking ownership of it, and evicts
+     * the lowest-priority entry if the store is over capacity. */
+    void insert(cachedResult* result);
+    void clear();
+
+    // priorities halve every getMaxNumResults() searches
+    void elapse() { clock++; }
+    void upPriority(cachedResult& result, mstreal del = 1.0);
+    mstreal getPriority(const cachedResult& result) const;
+
+    int getMaxNumResults() const { return maxNumResults; }
+    void incErrTolPressure(mstreal del = 1.0) { addPressure(errTolPressure, fabs(del)); }
+    void incMaxNumPressure(mstreal del = 1.0) { addPressure(maxNumPressure, fabs(del)); }
+    void decErrTolPressure(mstreal del = 1.0) { addPressure(errTolPressure, -fabs(del)); }
+    void decMaxNumPressure(mstreal del = 1.0) { addPressure(maxNumPressure, -fabs(del)); }
+    mstreal getErrTolPressure() const { return errTolPressure; }
+    mstreal getMaxNumPressure() const { return maxNumPressure; }
+    mstreal maxNumFactor() const { return log(sf*maxNumPressure/maxNumResults + 1.0) + 1.5; }
+    mstreal errTolFactor() const { return log(sf*errTolPressure/maxNumResults + 1.0) + 1.05; }
+
+    // write/read the store to/from a binary stream (reading replaces all entries)
+    void write(ostream &_os) const;
+    void read(istream &_is);
+
+    /* A cache log is an append-only file of entries that any number of
+     * processes (e.g., a cluster of jobs) can share. Once a log is attached,
+     * every new entry inserted into the store is appended to it as a single
+     * record, and entries appended by others are picked up by syncLog(), which
+     * only reads what was added since the last time. Evicted entries stay in
+     * the log until it is compacted, i.e. rewritten (atomically, through a
+     * temporary file) with just the store's current entries; other processes
+     * notice the compaction on their next sync. Appends made by another process
+     * while a compaction is in progress may be lost, which only means that
+     * their searches may have to be redone, so compaction is best done under a
+     * lock shared by all processes (see mstlocks.h). Pressures are not
+     * part of the log. */
+    void attachLog(const string& file, bool append = true); // loads all entries in the log; creates it if needed (and appending)
+    void detachLog();
+    bool isLogAttached();
+    int syncLog(); // returns the number of entries added to the store
+    void compactLog();
+    bool logNeedsCompaction(); // true if the log holds more stale records than the store has room for
+    void writeLog(const string& file) const; // writes the current entries as a new log
+    static bool isLogFile(const string& file);
+
+  protected:
+    mstreal decayRate() const { return log(2.0)/maxNumResults; }
+    static void addPressure(atomic<mstreal>& pressure, mstreal del);
+
+    /* Adds an entry with the given score to the given (yet to be published)
+     * contents, unless the store already has or had an entry with the same id,
+     * and evicts the lowest-priority entry if over capacity. Must be called
+     * with writeLock held. */
+    bool addEntry(contents& updated, const shared_ptr<cachedResult>& res, mstreal score);
+    void appendToLog(const cachedResult& res); // if a log is attached for appending
+
+    // log record I/O (a record is its length, a checksum, then the payload)
+    static string logRecord(const cachedResult& res, mstreal priority);
+    static cachedResult* parseLogRecord(const string& payload, mstreal& priority);
+    static bool readLogHeader(istream& _is, unsigned long long& generation);
+    void writeLog(const string& file, unsigned long long& generation, long& size) const;
+    static unsigned int checksum(const char* data, int len);
+
+  private:
     int maxNumResults; // max number of searches to cache
-    set<cachedResult*, compResults> cache;
+    shared_ptr<contents> state;
+    mutex writeLock;
+    atomic<long> clock;
+    atomic<mstreal> errTolPressure, maxNumPressure;
+    mstreal sf;
+
+    // the attached log, if any (guarded by logLock)
+    mutex logLock;
+    string logFile;
+    bool logAppend;
+    unsigned long long logGeneration; // changes whenever the log is compacted
+    long logOffset;                   // how far the log has been read
+    int logRecords;                   // number of records in the log
+    // guarded by writeLock
+    set<unsigned long long> knownIds;
+    mt19937_64 idEngine;
+};
+
+/* FASST with a cache of past searches (see fasstCacheStore). Each cFASST has
+ * its own query, options and search state, but its cache can be shared with
+ * other cFASST objects: use newCachedSearcher() to get one that also borrows
+ * this object's database, e.g. one per worker thread. */
+class cFASST : public FASST {
+  public:
+    cFASST(int max = 1000) : FASST() {
+      store = new fasstCacheStore(max);
+      ownStore = true;
+      readPerm = modPerm = true;
+      /* Because removal of redundancy is done on-the-fly in FASST (as matches
+       * are discovered) and after the fact in cFASST (after fully redundant
+       * matches are first fetched from the cache), the precise set of matches
+       * may be slightly different in the two cases when redundancy filter is
+       * turned on. We can, of course, make sure that cFASST returns the same
+       * exact results as FASST when redundancy is on, but this takes a bit of
+       * extra computation (not too much, but still). Considering that it is
+       * conceptually cleaner to do after-the-fact filtering (as it is indepedent
+       * of the order in which matches are discovered and thus indepedent of the
+       * order in which the database is listed), it does not seem worth ensuring
+       * this exact equivalence in most cases. But in some cases, like when we
+       * are testing the implementation of the cache for correctness, this may
+       * be desired. Setting this flag to true will have this effect. */
+      strictEquiv = false;
+    }
+    /* Uses the given cache store, which is not owned and must outlive this object. */
+    cFASST(fasstCacheStore* sharedStore) : FASST() {
+      store = sharedStore;
+      ownStore = false;
+      readPerm = modPerm = true;
+      strictEquiv = false;
+    }
+    ~cFASST() { if (ownStore) delete store; }
+    void clear() { store->clear(); } // clears cache (removes all solutions)
+    fasstSolutionSet search();
+
+    /* Creates a new cFASST (caller takes ownership) that searches over this
+     * object's database and shares its cache, with the same search type, grid
+     * spacing, permissions and equivalence setting. This object must outlive
+     * the new one. */
+    cFASST* newCachedSearcher();
+    fasstCacheStore* getCacheStore() { return store; }
+
+    int getMaxNumResults() const { return store->getMaxNumResults(); }
+    void incErrTolPressure(mstreal del = 1.0) { store->incErrTolPressure(del); }
+    void incMaxNumPressure(mstreal del = 1.0) { store->incMaxNumPressure(del); }
+    void decErrTolPressure(mstreal del = 1.0) { store->decErrTolPressure(del); }
+    void decMaxNumPressure(mstreal del = 1.0) { store->decMaxNumPressure(del); }
+    void setReadPermission(bool _perm) { readPerm = _perm; }
+    void setModifyPermission(bool _perm) { modPerm = _perm; }
+    void setStrictEquivalence(bool _eq) { strictEquiv = _eq; }
+    mstreal getErrTolPressure() const { return store->getErrTolPressure(); }
+    mstreal getMaxNumPressure() const { return store->getMaxNumPressure(); }
+    mstreal maxNumFactor() const { return store->maxNumFactor(); }
+    mstreal errTolFactor() const { return store->errTolFactor(); }
+    bool readPermission() const { return readPerm; }
+    bool modifyPermission() const { return modPerm; }
+    bool strictEquivalence() const { return strictEquiv; }
+
+    // write/read cache object to/from a binary file
+    void write(const string& filename) const;
+    void write(ostream &_os) const { store->write(_os); }
+    void read(const string& filename);
+    void read(istream &_is) { store->read(_is); }
+
+  protected:
+    static vector<int> getStructureTopology(const Structure& S);
+
+  private:
+    typedef fasstCacheStore::cachedResult cachedResult;
+    fasstCacheStore* store;
+    bool ownStore;
     RMSDCalculator rc;
-    mstreal errTolPressure, maxNumPressure, sf;
     bool readPerm, modPerm, strictEquiv;
 };
 
@@ -0,0 +1,63 @@
+#ifndef _MSTFASSTSHARD_H
+#define _MSTFASSTSHARD_H
+
+#include "msttypes.h"
+#include "mstfasst.h"
+
+/* Search of a FASST database that is split into shards, each held by its own
+ * process (typically, on its own machine). A fasstShardServer answers searches
+ * over the targets of one shard, and a fasstShardedSearch sends the query and
+ * search options to all shards at once, merges the solutions they send back,
+ * and applies the limits on the number of matches and redundancy filtering to
+ * the combined set. While the shards search, any shard that tightens its RMSD
+ * cutoff (upon collecting the maximum number of matches) reports the new cutoff,
+ * which is relayed to the other shards, just as threads of a parallel search
+ * share theirs.
+ *
+ * Communication is over plain TCP sockets, with one connection per search.
+ * Each message is a one-character type, an 8-byte payload length, and the
+ * payload, which is written with MstUtils::writeBin (so all hosts must share
+ * the same byte order). The coordinator sends 'Q' (query and options) and then
+ * any number of 'C' (a tighter RMSD cutoff); the shard sends back any number of
+ * 'C' and finally either 'R' (its first target index and its solutions) or 'E'
+ * (an error message). Redundancy by relational property is applied within each
+ * shard only, since the coordinator does not hold the property. */
+class fasstShardServer {
+  public:
+    /* Serves searches over the targets of F, which are expected to be targets
+     * firstTarget, firstTarget + 1, ... of the full database (the indices of
+     * solutions are reported in the full database). F must outlive this. */
+    fasstShardServer(FASST& F, int firstTarget = 0);
+    ~fasstShardServer();
+
+    /* Starts listening on the given port (0 picks any free port). */
+    void listen(int port = 0);
+    int getPort() const { return port; }
+
+    /* Answers searches one at a time, until numRequests have been answered
+     * (forever if negative). Each search runs on as many threads as F has. */
+    void serve(int numRequests = -1);
+
+  protected:
+    void answer(int fd);
+
+  private:
+    FASST& F;
+    int firstTarget;
+    int listenFd, port;
+};
+
+class fasstShardedSearch {
+  public:
+    void addShard(const string& host, int port) { shards.push_back(make_pair(host, port)); }
+    void addShard(const string& address); // as "host:port"
+    int numShards() const { return shards.size(); }
+
+    /* Searches all shards. Sequence constraints cannot be sent to shards. */
+    fasstSolutionSet search(const Structure& query, const fasstSearchOptions& opts, bool autoSplitChains = true);
+
+  private:
+    vector<pair<string, int> > shards;
+};
+
+#endif
@@ -4,6 +4,7 @@
 #include "msttypes.h"
 #include "mstoptim.h"
 #include "msttransforms.h"
+#include "msttraj.h"
 #include <chrono>
 
 using namespace std;
@@ -12,7 +13,7 @@ using namespace MST;
 class fusionParams {
   public:
     enum coorInitType { meanCoor = 1, meanIC };
-    enum minimizerType { gradDescent = 1, conjGrad, NelderMead, langevinDyna };
+    enum minimizerType { gradDescent = 1, conjGrad, NelderMead, langevinDyna, lbfgs };
     fusionParams() { // default optimization params
       startType = fusionParams::coorInitType::meanCoor;
       verbose = false;
@@ -36,6 +37,9 @@ class fusionParams {
       saveSteps = -1;
       visc = 10;
       mfact = 1;
+      trajSink = NULL;
+      numThreads = 1;
+      numReps = 1; kTmax = 4; exchSteps = 100;
     }
     mstreal getNoise() const { return noise; }
     fusionParams::coorInitType getCoorInitType() const { return startType; }
@@ -67,6 +71,11 @@ class fusionParams {
     mstreal thermalEnergy() const { return kT; }
     mstreal massFactor() const { return mfact; }
     int saveInterval() const { return saveSteps; }
+    trajectoryWriter* getTrajectorySink() const { return trajSink; }
+    int getNumThreads() const { return numThreads; }
+    int numReplicas() const { return numReps; }
+    mstreal maxThermalEnergy() const { return kTmax; }
+    int exchangeInterval() const { return exchSteps; }
 
     void setNoise(mstreal _noise) { noise = _noise; }
     void setVerbose(bool _verbose = true) { verbose = _verbose; }
@@ -94,6 +103,21 @@ class fusionParams {
     void setThermalEnergy(mstreal v) { kT = v; }
     void setMassFactor(mstreal v) { mfact = v; }
     void setSaveInterval(int v) { saveSteps = v; }
+    /* If set, dynamics snapshots (of every cycle) are streamed to the sink as
+     * they are produced, instead of being kept in memory for fusionOutput or
+     * written to the PDB log. The sink is not owned, and can be shared by
+     * several fusions (including concurrent ones). */
+    void setTrajectorySink(trajectoryWriter* sink) { trajSink = sink; }
+    void setNumThreads(int n) { numThreads = n; }
+    /* With more than one replica, dynamics runs that many replicas, at
+     * temperatures from thermalEnergy() to maxThermalEnergy() (geometrically
+     * spaced), exchanging configurations every exchangeInterval() steps (see
+     * Optim::langevinReplicas). Replicas are advanced on getNumThreads()
+     * threads, and only the one at thermalEnergy() is reported (the solution,
+     * snapshots, and anything streamed to the trajectory sink). */
+    void setNumReplicas(int n) { numReps = n; }
+    void setMaxThermalEnergy(mstreal v) { kTmax = v; }
+    void setExchangeInterval(int n) { exchSteps = n; }
 
   private:
     // start optimization from the averaged Cartesian structure or the structure
@@ -116,6 +140,11 @@ class fusionParams {
     int saveSteps;       // periodicity of recording dynamics snapshot
     mstreal visc;        // viscosity coefficient for Langevin dynamics; viscosity*timeStep should be no less than 10^-5
     mstreal mfact;       // the factor by whichh to multiply atomic masses in Da
+    trajectoryWriter* trajSink; // where to stream dynamics snapshots, if anywhere
+    int numThreads;      // number of threads for scoring restraints within each evaluation
+    int numReps;         // number of replica-exchange dynamics replicas
+    mstreal kTmax;       // k*T of the hottest replica
+    int exchSteps;       // periodicity of replica exchange attempts
 };
 
 struct fusionOutput {
@@ -146,6 +175,7 @@ struct fusionOutput {
       return _os;
     }
 
+    Structure getFused() const { return fused; }
     void setFused(const Structure& f) { fused = f; }
     void addSnapshot(const Structure& snap, mstreal ener);
 
@@ -191,6 +221,16 @@ class fusionTopology {
     void addFragment(Structure& S, const vector<int>& fragResIdx = vector<int>(), mstreal weight = 1.0);
     void addFragment(vector<Residue*>& R, const vector<int>& fragResIdx = vector<int>(), mstreal weight = 1.0);
 
+    /* Incremental edits of an existing topology. replaceFragment swaps the fi-th
+     * fragment for the given residues (with the same conventions as addFragment),
+     * keeping its index; removeFragment drops it, shifting the indices of all
+     * later fragments down by one. Only the positions covered by the old and new
+     * fragments are touched. If aligned fragments were set up, the fused side of
+     * a replaced fragment must be refreshed with setAlignedFrag when it covers
+     * different positions than before. */
+    void replaceFragment(int fi, vector<Residue*>& R, const vector<int>& fragResIdx = vector<int>(), mstreal weight = 1.0);
+    void removeFragment(int fi);
+
     /* These function mark specified position(s) as fixed in the topology. */
     void addFixedPositions(vector<int> fixedInds);
     void addFixedPosition(int i) { fixed[i] = true; }
@@ -202,6 +242,7 @@ class fusionTopology {
      * superposition and other analysis. To do this, the function accepts a reference
      * to a Structure object that represents the structure to be fused. */
     void setAlignedFrags(Structure& fused);
+    void setAlignedFrag(int fi, Structure& fused);
 
     /* Checks whether the given structure is consistent with the topology--i.e.,
      * has the right number of chains of the righht length. */
@@ -214,6 +255,7 @@ class fusionTopology {
     int numUniqueOverlaps() const { return fragsByOverlap.size(); }
     int numFragsOverlapping(int i) const { return fragsByOverlap[i].size(); }
     int getFragOverlapping(int i, int k) const { return fragsByOverlap[i][k]; }
+    const vector<int>& getFragPositions(int fi) const { return fragments[fi].second; }
     AtomPointerVector& getAlignedFragFused(int fi) { return alignedFrags[fi].first; }
     AtomPointerVector& getAlignedFragRef(int fi) { return alignedFrags[fi].second; }
     pair<AtomPointerVector, AtomPointerVector>& getAlignedFragPair(int fi) { return alignedFrags[fi]; }
@@ -257,6 +299,13 @@ class fusionTopology {
      * occur between them. */
     void updateConnectivity();
 
+    /* helpers for adding/editing fragments: makeFragment pairs fragment atoms
+     * with topology positions, while addToOverlaps and removeFromOverlaps keep
+     * overlappingResidues and the overlap groups in sync with the fi-th fragment */
+    pair<AtomPointerVector, vector<int> > makeFragment(vector<Residue*>& R, const vector<int>& fragResIdx, const string& caller);
+    void addToOverlaps(int fi);
+    void removeFromOverlaps(int fi);
+
     static vector<string> bba;
 
   private:
@@ -312,6 +361,7 @@ class fusionEvaluator: public optimizerEvaluator {
 
     mstreal eval(const vector<mstreal>& point);
     mstreal eval(const vector<mstreal>& point, Vector& grad);
+    mstreal eval(const mstreal* point, mstreal* grad, int n);
     vector<mstreal> guessPoint();
     vector<mstreal> getMasses() const { return masses; }
     void setGuessPoint(const vector<mstreal>& _initPoint) { initPoint = _initPoint; }
@@ -332,6 +382,17 @@ class fusionEvaluator: public optimizerEvaluator {
     void chooseBuildOrigin(bool randomize = false);
     fusionOutput getScores();
 
+    /* Incremental edits of the topology being fused (see the same functions
+     * in fusionTopology). Only IC bounds involving positions covered by the old
+     * or the new fragment are recomputed, and the guess point is reset to
+     * represent the current fused coordinates, so that a subsequent optimization
+     * is warm-started from where the previous one ended. If the edit changes the
+     * chain structure of the topology, the evaluator is re-initialized, using
+     * the current fused structure as the starting structure. */
+    void replaceFragment(int fi, vector<Residue*>& R, const vector<int>& fragResIdx = vector<int>(), mstreal weight = 1.0);
+    void removeFragment(int fi);
+    const fusionTopology& getTopology() const { return topo; }
+
   class icBound {
     public:
       icBound(icType _type, mstreal _minVal, mstreal _maxVal, const vector<Atom*>& _atoms, string _name = "") {
@@ -340,7 +401,7 @@ class fusionEvaluator: public optimizerEvaluator {
       icBound(icType _type, const pair<mstreal, mstreal>& b, const vector<Atom*>& _atoms, string _name = "") {
         type = _type; minVal = b.first; maxVal = b.second; name = _name; atoms = _atoms;
       }
-      icBound(const icBound& icb) { type = icb.type; minVal = icb.minVal; maxVal = icb.maxVal; name = icb.name; atoms = icb.atoms; }
+      icBound(const icBound& icb) { type = icb.type; minVal = icb.minVal; maxVal = icb.maxVal; name = icb.name; atoms = icb.atoms; atomIdx = icb.atomIdx; pos = icb.pos; }
       friend ostream & operator<<(ostream &_os, const icBound& _b) {
         _os << "BOUND of type '" << _b.type << "', name '" << _b.name << "', limits [" << _b.minVal << ", " << _b.maxVal << "]";
         return _os;
@@ -370,19 +431,19 @@ class fusionEvaluator: public optimizerEvaluator {
           case icBrokenDihedral:
           case icDihedral:
             grad.resize(12);
-            CartesianGeometry::dihedral(atoms[0], atoms[1], atoms[2], atoms[3], grad);
+            CartesianGeometry::dihedral(Point3(atoms[0]), Point3(atoms[1]), Point3(atoms[2]), Point3(atoms[3]), grad);
             break;
           case icBrokenAngle:
           case icAngle:
             grad.resize(9);
-            CartesianGeometry::angle(atoms[0], atoms[1], atoms[2], grad);
+            CartesianGeometry::angle(Point3(atoms[0]), Point3(atoms[1]), Point3(atoms[2]), grad);
             break;
           case icBrokenBond:
           case icBond:
           case icDistRep:
           case icDistComp:
             grad.resize(6);
-            CartesianGeometry::distance(atoms[0], atoms[1], grad);
+            CartesianGeometry::distance(Point3(atoms[0]), Point3(atoms[1]), grad);
             break;
           default:
             MstUtils::error("unknown variable type", "icBound::getCurrentGradient");
@@ -393,6 +454,8 @@ class fusionEvaluator: public optimizerEvaluator {
       icType type;
       mstreal minVal, maxVal;
       vector<Atom*> atoms; // atoms in the fused structure corresponding to this IC
+      vector<int> atomIdx; // indices of the above atoms (see coordinateJacobian)
+      int pos = -1;        // topology position of the residue of the final atom (-1 if not derived from fragments)
       string name;
   };
 
@@ -405,14 +468,40 @@ class fusionEvaluator: public optimizerEvaluator {
     CartesianPoint bondInstances(int rj, Atom* atomI, Atom* atomJ, bool addToCache = true);
     CartesianPoint angleInstances(int rk, Atom* atomI, Atom* atomJ, Atom* atomK, bool addToCache = true);
     CartesianPoint dihedralInstances(int rl, Atom* atomI, Atom* atomJ, Atom* atomK, Atom* atomL, bool addToCache = true);
+    void refreshBound(int bi); // recomputes the limits of the bi-th IC bound from the current topology
+    // updates bounds involving any of the given positions and warm-starts from the current fused structure
+    void topologyEdited(const set<int>& positions, const vector<int>& oldChainLengths);
     mstreal atomRadius(const Atom& a);
 
     // if the last flag is specified as true, will compute angular differences
     mstreal harmonicPenalty(mstreal val, const icBound& b);
 
+    mstreal evalPoint(const mstreal* point, int n); // n = 0 initializes (see eval(const vector<mstreal>&))
     void resetScore();
-    void scoreIC(const icBound& b);
-    void scoreRMSD();
+
+    /* Scores and gradient (with respect to fused atom coordinates) collected
+     * by one scoring worker. In a threaded evaluation, each worker has its own
+     * accumulator, and accumulators are summed once all workers finish. */
+    struct scoreAccumulator {
+      mstreal bondPenalty, anglPenalty, dihePenalty, rmsdScore, rmsdTot;
+      int N; // number of atoms contributing to rmsdTot
+      vector<mstreal> xyzGrad;
+      RMSDCalculator rms;
+      vector<mstreal> innerGradient; // scratch space
+      void reset(int numCoors);
+    };
+
+    /* Scores all IC bounds and fragment RMSDs, spreading them over the number
+     * of threads given in fusionParams (see fusionParams::setNumThreads). */
+    void scoreRestraints();
+    void scoreIC(const icBound& b, scoreAccumulator& acc);
+    // scores the gi-th aligned fragment (or overlap group if adaptive weighting is on)
+    void scoreRMSD(int gi, const vector<mstreal>& weights, scoreAccumulator& acc);
+    vector<mstreal> fragmentWeights(); // RMSD weight of each aligned fragment
+
+    // places atom A relative to the three reference atoms, using the three search
+    // coordinates starting at index k, and records the partials of the build
+    void buildAtom(Atom* A, Atom* diA, Atom* anA, Atom* thA, const mstreal* point, int k);
 
   private:
     Structure fused, guess;
@@ -437,76 +526,69 @@ class fusionEvaluator: public optimizerEvaluator {
 
     vector<mstreal> initPoint, masses;
     fusionParams params;
-
-    /* Class for storing the gradient of a Cartesian coordinate set with respect
-     * to some alternative set of coordinates. E.g., could be used for storing
-     * partial derivatives of Cartesian coordinates with respect to BAT
-     * coordinates. Can also simply store partial derivatives of Cartesian
-     * coordinates with respect to the same Cartesian coordinates, which serves
-     * the purpose of defining a mapping between Atoms and corresponding
-     * Cartesian coordinate indices. */
-    class coordinateGradient {
+    bool warmStart = false; // initialize from current fused coordinates, keeping existing bounds
+
+    /* Sparse Jacobian of the Cartesian coordinates of fused atoms with respect
+     * to the search coordinates (either also Cartesian or BAT). In a build from
+     * internal coordinates, each placed atom depends directly on only three
+     * search coordinates and on the coordinates of three previously placed
+     * reference atoms, so only those 3 x 3 and 3 x 9 partials are stored per
+     * build step. Any other dependencies (e.g., Cartesian search coordinates, or
+     * the first atoms of an unanchored build) are stored as explicit partials.
+     * The search gradient is obtained from the gradient with respect to atom
+     * coordinates by one reverse sweep over the build steps, so its cost is
+     * linear in the number of atoms and restraints. */
+    class coordinateJacobian {
       public:
-        coordinateGradient() {}
+        coordinateJacobian() {}
+
+        /* Sets the atoms whose coordinates are tracked, and clears all partials.
+         * Atoms are referred to by their index in this list. */
+        void setAtoms(const vector<Atom*>& atoms);
+        int numAtoms() const { return atomIdx.size(); }
+        int index(Atom* A) const;
+        vector<int> indices(const vector<Atom*>& atoms) const;
+
         /* store the partial derivative of the dim-th Cartesian coordinate of atom
-         * A (i.e., the X-, Y-, or the Z-coordinate) with respect to the alternative
+         * A (i.e., the X-, Y-, or the Z-coordinate) with respect to the search
          * coordinate with index coorIdx. */
-        void addPartial(Atom* A, int dim, int coorIdx, mstreal partialVal) {
-          partials[A][dim][coorIdx] = partialVal;
-        }
+        void addPartial(Atom* A, int dim, int coorIdx, mstreal partialVal);
         void addPartial(Atom& A, int dim, int coorIdx, mstreal partialVal) { addPartial(&A, dim, coorIdx, partialVal); }
 
-        /* store the partial derivative of all Cartesian coordinates of atom A
-         * with respect to all alternative coordinates with indices listed in
-         * coorIdx (i.e., all combinations). */
-        void addPartials(Atom* A, const vector<int>& coorIdx, const vector<mstreal>& partialVals) {
-          if (coorIdx.size() * 3 != partialVals.size()) MstUtils::error("inconsistent number of defining variables and partial values provided", "coordinateGradient::addPartials(Atom*, const vector<int>&, const vector<mstreal>&)");
-          int k = 0;
-          for (int dim = 0; dim < 3; dim++) {
-            for (int ci = 0; ci < coorIdx.size(); ci++) {
-              addPartial(A, dim, coorIdx[ci], partialVals[k]);
-              k++;
-            }
-          }
-        }
+        /* record that atom A was built from reference atoms diA, anA, and thA,
+         * using the search coordinates with indices coorIdx, coorIdx + 1, and
+         * coorIdx + 2. The partials are as computed by Atom::build. Build steps
+         * must be recorded in the order in which atoms are built. */
+        void addBuildStep(Atom* A, Atom* diA, Atom* anA, Atom* thA, int coorIdx, const mstreal* icPartials, const mstreal* xyzPartials);
 
-        /* This is for the case when the Cartesian coordinates of some target atom
-         * T are dependent (e.g., built from) the Cartesian coordinates of some
-         * atom D, and the latter are already known within this object to be
-         * dependent on some set of alternative coordinates {A}, with computed
-         * partials. The function then computes and stores the partial derivatives
-         * of the Cartesian coordinates of T with respect to all coordinates in {A}
-         * by applying the chain rule. */
-        void addRecursivePartials(Atom* T, Atom* D, const vector<mstreal>& partialVals) {
-          if (partials.find(D) == partials.end()) return;
-          if (partialVals.size() != 9) MstUtils::error("nine partial derivatives are expected for the dependance of two atoms", "coordinateGradient::addPartialss(Atom*, Atom*, const vector<mstreal>&)");
-          int k = 0;
-          for (int dimTarg = 0; dimTarg < 3; dimTarg++) {
-            for (int dimDef = 0; dimDef < 3; dimDef++) {
-              map<int, mstreal>& defPartials = getPartials(D, dimDef);
-              for (auto it = defPartials.begin(); it != defPartials.end(); ++it) {
-                addPartial(T, dimTarg, it->first, it->second * partialVals[k]);
-              }
-              k++;
-            }
-          }
-        }
+        /* Adds to grad the gradient with respect to search coordinates, given the
+         * gradient with respect to atom coordinates in xyzGrad (at index 3*ai + dim
+         * for atom with index ai). xyzGrad is overwritten in the process. */
+        void chain(vector<mstreal>& xyzGrad, vector<mstreal>& grad) const;
 
-        int numDefiningVars(Atom* a, int dim) { return partials[a][dim].size(); }
-        vector<int> getDefiningVars(Atom* a, int dim) { return MstUtils::keys(partials[a][dim]); }
-        vector<mstreal> getPartialValues(Atom* a, int dim) { return MstUtils::values(partials[a][dim]); }
-        map<int, mstreal>& getPartials(Atom* a, int dim) { return partials[a][dim]; }
-        mstreal getPartial(Atom* a, int dim, int coorIdx) { return partials[a][dim][coorIdx]; }
-
-        void clear() { partials.clear(); }
+        /* clear all partials, but keep the tracked atoms */
+        void clearPartials();
+        void clear() { atomIdx.clear(); clearPartials(); }
 
       private:
-        map<Atom*, map<int, map<int, mstreal> > > partials;
+        map<Atom*, int> atomIdx;
+
+        // explicit partials: coordinate (3*ai + dim), search coordinate, and value
+        vector<int> partXYZ, partCoor;
+        vector<mstreal> partVals;
+
+        // build steps, four atom indices (placed atom and its three reference
+        // atoms), the first search coordinate, and 9 + 27 partials per step
+        vector<int> stepAtoms, stepCoor;
+        vector<mstreal> stepPartials;
     };
 
     // stores information on the gradient of Cartesian coordinates of fused atoms
     // with respect to the search coordinate vector (either also Cartesian or BAT)
-    coordinateGradient gradOfXYZ;
+    coordinateJacobian gradOfXYZ;
+    vector<mstreal> xyzGrad; // current gradient with respect to fused atom coordinates
+    vector<vector<int> > fragAtomIdx; // indices of atoms in aligned fragments (see topo.getAlignedFragFused)
+    vector<scoreAccumulator> workerScores;
     mstreal bondPenalty, anglPenalty, dihePenalty, rmsdScore, rmsdTot, score; // current scores
     vector<mstreal> gradient; // current search gradient
 };
@@ -523,6 +605,20 @@ class Fuser {
     static Structure fuse(const fusionTopology& topo, fusionOutput& scores, const fusionParams& params = fusionParams());
     static Structure fuse(const fusionTopology& topo, const fusionParams& params = fusionParams());
 
+    /* Runs numStarts independent fusions of the given topology, each as fuse()
+     * would (i.e., with params.numCycles() cycles), on up to numThreads threads.
+     * Every start has its own evaluator and its own random number stream, seeded
+     * from MstUtils::randEngine() before any start runs, so results do not
+     * depend on the number of threads. All starts but the first begin from a
+     * noisified guess and a randomly chosen build origin. If some start reaches
+     * a score of stopScore or lower, starts that have not yet begun are skipped
+     * (those already running are finished). Returns the outputs of the starts
+     * that ran, in the order of starts; fused structures are in each output
+     * (see fusionOutput::getFused). */
+    static vector<fusionOutput> fuseMulti(const fusionTopology& topo, const fusionParams& params, int numStarts, int numThreads = 1, mstreal stopScore = -numeric_limits<mstreal>::infinity());
+    // same as above, but returns the best fused structure (and its scores in best)
+    static Structure fuseMulti(const fusionTopology& topo, fusionOutput& best, const fusionParams& params, int numStarts, int numThreads = 1, mstreal stopScore = -numeric_limits<mstreal>::infinity());
+
     /* This function is a simplified version of Fuser::fuse(), in that it guesses
      * the topology automatically. Argument residues is a flat vector of all the
      * residues from all the different fragments that are to be fused. residues
@@ -532,6 +628,12 @@ class Fuser {
      * likely overlapping (i.e., have close CA atoms). This should not give
      * incorrect topologies in "normal" circumstances, but in strange cases can. */
     static Structure autofuse(const vector<Residue*>& residues, int flexOnlyNearOverlaps = -1, const fusionParams& params = fusionParams());
+
+  protected:
+    /* One fusion run, of params.numCycles() cycles. If perturbStart is true,
+     * the first cycle already starts from a noisified guess and a random build
+     * origin (as do later cycles in any case). */
+    static Structure fuseStart(const fusionTopology& topo, fusionOutput& scores, const fusionParams& params, bool perturbStart);
 };
 
 
@@ -9,39 +9,46 @@ using namespace std;
 
 namespace MST {
 
+// Matrices store their elements in one contiguous, row-major block. Sub-matrix
+// views (see row() and column()) point into the block of the matrix they came
+// from and address it via row and column strides, so writing into a view
+// writes into the underlying matrix. As before, a view must not outlive the
+// matrix it came from.
 class Matrix {
   public:
     Matrix(int rows, int cols, mstreal val = 0.0);
     Matrix(const vector<vector<mstreal> >& _M);
     Matrix(const Matrix& _M);
+    Matrix(Matrix&& _M);
     Matrix(const vector<mstreal>& p, bool col = false); // by default makes row vectors
     ~Matrix();
 
     int size(int dim = 1) const;
     int length() const { return MstUtils::max(size(1), size(2)); }
-    int numRows() const { return size(1); }
-    int numCols() const { return size(2); }
-    mstreal& operator()(int i, int j) { return *(M[i][j]); }
-    mstreal operator()(int i, int j) const { return *(M[i][j]); }
+    int numRows() const { return nr; }
+    int numCols() const { return nc; }
+    mstreal& operator()(int i, int j) { return vals[i*rs + j*cs]; }
+    mstreal operator()(int i, int j) const { return vals[i*rs + j*cs]; }
 
     // single-subscript access (column-major order, as in Matlab)
-    mstreal& operator()(int i) { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal operator()(int i) const { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal& operator[](int i) { int n = numRows(); return *(M[i % n][i / n]); }
-    mstreal operator[](int i) const { int n = numRows(); return *(M[i % n][i / n]); }
+    mstreal& operator()(int i) { return vals[linearOffset(i)]; }
+    mstreal operator()(int i) const { return vals[linearOffset(i)]; }
+    mstreal& operator[](int i) { return vals[linearOffset(i)]; }
+    mstreal operator[](int i) const { return vals[linearOffset(i)]; }
 
     Matrix& operator=(const Matrix& _M);
+    Matrix& operator=(Matrix&& _M);
     Matrix& operator/=(const mstreal& s);
     Matrix& operator*=(const mstreal& s);
-    const Matrix operator/(const mstreal& s) const;
-    const Matrix operator*(const mstreal& s) const;
+    Matrix operator/(const mstreal& s) const;
+    Matrix operator*(const mstreal& s) const;
     Matrix& operator*=(const Matrix& P);
-    const Matrix operator*(const Matrix& P) const;
+    Matrix operator*(const Matrix& P) const;
     Matrix& operator+=(const Matrix& P);
-    const Matrix operator+(const Matrix& P) const;
+    Matrix operator+(const Matrix& P) const;
     Matrix& operator-=(const Matrix& P);
-    const Matrix operator-(const Matrix& P) const;
-    const Matrix operator-() const;
+    Matrix operator-(const Matrix& P) const;
+    Matrix operator-() const;
     // so that we can also do scalar * Matrix (this is a global operator, not a member operator)
     friend Matrix operator* (mstreal s, const Matrix& M) { return M*s; }
 
@@ -64,6 +71,10 @@ class Matrix {
     Matrix mult(const Matrix& other) const; // element-wise multiply
     Matrix div(const Matrix& other) const;  // element-wise divide
 
+    // is the matrix laid out as one dense row-major block (true of all matrices
+    // other than column views and views into views)?
+    bool isContiguous() const { return (cs == 1) && ((rs == nc) || (nr <= 1)); }
+
     friend ostream & operator<<(ostream &_os, const Matrix& _M) {
       for (int i = 0; i < _M.numRows(); i++) {
         for (int j = 0; j < _M.numCols(); j++) {
@@ -75,11 +86,24 @@ class Matrix {
     }
 
   protected:
-    Matrix(const vector<vector<mstreal*> >& _M, int rowBeg = 0, int rowEnd = -1, int colBeg = 0, int colEnd = -1);
+    // a view into the elements of another matrix
+    Matrix(mstreal* _vals, int rows, int cols, int rowStride, int colStride);
     void setOwnFlag(bool _own) { own = _own; }
     bool getOwnFlag() { return own; }
+    void allocate(int rows, int cols);
     void clear();
-    vector<vector<mstreal*> > M;
+    int linearOffset(int i) const {
+      if (nr == 1) return i*cs;
+      if (nc == 1) return i*rs;
+      return (i % nr)*rs + (i / nr)*cs;
+    }
+    // stride between consecutive elements, in single-subscript order, of a
+    // matrix with a unit dimension
+    int linearStride() const { return (nr == 1) ? cs : rs; }
+
+    mstreal* vals;             // first element
+    int nr, nc;                // dimensions
+    int rs, cs;                // row and column strides: element (i, j) is at vals[i*rs + j*cs]
     bool own;                  // do I own the data in the matrix, or is my matrix a sub-matrix from some other matrix?
 };
 
@@ -90,7 +114,11 @@ class Vector : public Matrix {
     Vector(int numel = 0, mstreal val = 0.0, bool col = false) : Matrix(vector<mstreal>(numel, val), col) {}
     Vector(const vector<mstreal>& p, bool col = false) : Matrix(p, col) {}
     Vector(const Vector& V) : Matrix(V) {}
+    Vector(Vector&& V) : Matrix(std::move(V)) {}
     Vector(const Matrix& _M) : Matrix(_M) { MstUtils::assertCond((_M.numRows() == 1) || (_M.numCols() == 1), "cannot construct a vector from a matrix with non-unitary dimensions", "Vector::Vector(const Matrix& _M)"); }
+    Vector(Matrix&& _M) : Matrix(std::move(_M)) { MstUtils::assertCond((numRows() == 1) || (numCols() == 1), "cannot construct a vector from a matrix with non-unitary dimensions", "Vector::Vector(Matrix&& _M)"); }
+    Vector& operator=(const Vector& V) { Matrix::operator=(V); return *this; }
+    Vector& operator=(Vector&& V) { Matrix::operator=(std::move(V)); return *this; }
     int size() const { return length(); }
     mstreal dot(const Vector& v) const;
     Vector getUnit() const { return (*this)/this->norm(); }
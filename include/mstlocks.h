@@ -3,7 +3,92 @@
 
 #include "msttypes.h"
 #include "mstsystem.h"
+#include <memory>
+#include <mutex>
+#include <condition_variable>
 
+/* Named reader/writer locks for coordinating jobs (and threads within a job)
+ * that share a file, such as a FASST cache log. A lock is identified by a tag
+ * and can be held shared (by any number of holders at once) or exclusively.
+ * The actual locking is done by a backend; the default is a fileLockBackend,
+ * which locks a file in /tmp and so coordinates all processes on the host. To
+ * coordinate jobs across machines, set a backend that reaches a common place,
+ * e.g. a fileLockBackend with a directory on a shared file system that supports
+ * flock (e.g., NFSv4), or an sshLockBackend. */
+class lockBackend {
+  public:
+    virtual ~lockBackend() {}
 
+    /* Gets the lock with the given tag, waiting up to timeout seconds (forever
+     * if negative). Returns false if the lock could not be had in time. */
+    virtual bool acquire(const string& tag, bool shared, mstreal timeout) = 0;
+    virtual bool release(const string& tag) = 0;
+};
+
+/* Locks a file named .mst-<tag>.lock in the given directory with flock. Threads
+ * of this process are arbitrated in memory first (shared holders within the
+ * process share the one file lock), so only one file lock is ever taken per tag
+ * and process. Since the kernel drops file locks of processes that exit, locks
+ * of jobs that died never need to be broken. Waiting for a lock held by another
+ * process polls, starting at tens of microseconds and backing off to at most
+ * ten milliseconds between attempts. */
+class fileLockBackend : public lockBackend {
+  public:
+    fileLockBackend(const string& dir = "/tmp") { lockDir = dir; }
+    ~fileLockBackend();
+    bool acquire(const string& tag, bool shared, mstreal timeout);
+    bool release(const string& tag);
+    string lockFile(const string& tag) const { return lockDir + "/.mst-" + tag + ".lock"; }
+
+  private:
+    struct lockState {
+      mutex m;
+      condition_variable cv;
+      int readers = 0;         // shared holders within this process
+      bool writer = false;     // held exclusively within this process
+      bool acquiring = false;  // a thread is waiting for the file lock
+      int fd = -1;
+    };
+    lockState& getState(const string& tag);
+
+    string lockDir;
+    mutex statesLock;
+    map<string, unique_ptr<lockState> > states;
+};
+
+/* Locks through MstSys::getNetLock on a given host, reached with ssh. This takes
+ * seconds per lock, so is only for clusters without a shared file system. */
+class sshLockBackend : public lockBackend {
+  public:
+    sshLockBackend(const string& host) { linuxHost = host; }
+    bool acquire(const string& tag, bool shared, mstreal timeout) { return MstSys::getNetLock(tag, shared, linuxHost); }
+    bool release(const string& tag) { return MstSys::releaseNetLock(tag, linuxHost); }
+
+  private:
+    string linuxHost;
+};
+
+class MstLocks {
+  public:
+    static bool getLock(const string& tag, bool shared = false, mstreal timeout = 5*60) { return getBackend().acquire(tag, shared, timeout); }
+    static bool releaseLock(const string& tag) { return getBackend().release(tag); }
+
+    /* Locks with the given tag are henceforth handled by this backend. Should
+     * be set before any locks are taken. */
+    static void setBackend(const shared_ptr<lockBackend>& backend);
+    static lockBackend& getBackend();
+};
+
+/* Holds a lock for as long as it is in scope. */
+class scopedLock {
+  public:
+    scopedLock(const string& _tag, bool shared = false, mstreal timeout = 5*60) : tag(_tag) {
+      if (!MstLocks::getLock(tag, shared, timeout)) MstUtils::error("could not get lock '" + tag + "' in time", "scopedLock::scopedLock");
+    }
+    ~scopedLock() { MstLocks::releaseLock(tag); }
+
+  private:
+    string tag;
+};
 
 #endif
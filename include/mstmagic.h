@@ -51,6 +51,11 @@ class TERMUtils {
      * residue also has the number of flanking residues specified individually.
      * Returns indices of central residues in the final motif structure. */
        static vector<int> selectTERM(const vector<Residue*>& cenRes, Structure& frag, vector<int> pm, vector<int>* fragResIdx = NULL, bool contiguous = true);
+    /* cases 5 and 6, with the TERM given as a view of the structure the
+     * central residues belong to, rather than a copy (see StructureView). Any
+     * residues already in the view are cleared first. */
+    static vector<int> selectTERM(const vector<Residue*>& cenRes, StructureView& frag, int pm = 2, vector<int>* fragResIdx = NULL, bool contiguous = true);
+    static vector<int> selectTERM(const vector<Residue*>& cenRes, StructureView& frag, vector<int> pm, vector<int>* fragResIdx = NULL, bool contiguous = true);
 
     // /* The following function is a little different, in that it simply cuts out
     //  * one segment at a time, and splices them together. It does not worry about
@@ -3,6 +3,7 @@
 
 #include <vector>
 #include <algorithm>    // for sort to work on linux
+#include <functional>
 #include "mstlinalg.h"
 
 using namespace std;
@@ -15,6 +16,13 @@ class optimizerEvaluator {
     virtual mstreal eval(const vector<mstreal>& point) { return 0.0; }
     virtual mstreal eval(const vector<mstreal>& point, Vector& grad) { grad = finiteDifferenceGradient(point); return eval(point); }
     virtual Vector finiteDifferenceGradient(const vector<mstreal>& point, vector<mstreal> eps = vector<mstreal>(0));
+
+    /* Evaluates at the n-dimensional point x and, if grad is not NULL, writes
+     * the gradient into grad (n values). This is what the L-BFGS minimizers
+     * call, on buffers allocated once per minimization. By default, it goes
+     * through the vector-based functions above, so existing evaluators work
+     * unchanged; evaluators that override it directly save the copies. */
+    virtual mstreal eval(const mstreal* x, mstreal* grad, int n);
 };
 
 class Optim {
@@ -31,6 +39,19 @@ class Optim {
     static mstreal conjGradMin(optimizerEvaluator& E, vector<mstreal>& solution, int numIters = 1000, mstreal tol = 10E-8, bool verbose = false);
     static mstreal lineSearch(optimizerEvaluator& E, const vector<mstreal>& point, vector<mstreal>& solution, const Vector& dir = Vector(), mstreal startStepSize = 0.01, bool verbose = false);
 
+    /* --- Limited-memory BFGS, keeping the last m correction pairs, with a
+     * line search satisfying the strong Wolfe conditions. Stops once an
+     * iteration lowers the function by less than tol. */
+    static mstreal lbfgs(optimizerEvaluator& E, vector<mstreal>& solution, int numIters = 1000, mstreal tol = 10E-8, bool verbose = false, int m = 8);
+
+    /* --- The same, with each coordinate i kept within [lo[i], hi[i]] (either
+     * can be infinite). Coordinates at a bound, with the gradient pushing them
+     * outward, are held for the iteration; the L-BFGS step over the rest is
+     * then projected onto the box, with a backtracking line search along the
+     * projected path. This is a simpler scheme than the original L-BFGS-B (no
+     * generalized Cauchy point), which works well when few bounds are active. */
+    static mstreal lbfgsb(optimizerEvaluator& E, vector<mstreal>& solution, const vector<mstreal>& lo, const vector<mstreal>& hi, int numIters = 1000, mstreal tol = 10E-8, bool verbose = false, int m = 8);
+
     /* --- Langevin integrator (second-order), implemented as in eq. 98 of molecular_dynamics_2015.pdf
      *  + masses  -- the mass of every particle. This vector must be of length
      *               k times the number of dimensions (i.e., the size of E.guessPoint()),
@@ -51,6 +72,36 @@ class Optim {
      *               [units of coordinate vector]^2 / [units of timeStep]^2.
      */
     static vector<mstreal> langevinDynamics(optimizerEvaluator& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, mstreal kT, int numIters, vector<vector<mstreal> >& trajectory, int saveInterval = -1, bool verbose = false);
+
+    /* Same as above, but rather than accumulating snapshots in memory, hands
+     * each one (the coordinate vector and its energy) to the snapshot function
+     * as it is produced (e.g., to stream it to disk; see trajectoryWriter).
+     * The final point goes into solution, and its energy is returned. */
+    static mstreal langevinDynamics(optimizerEvaluator& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, mstreal kT, int numIters, vector<mstreal>& solution, const function<void(const vector<mstreal>&, mstreal)>& snapshot, int saveInterval = -1, bool verbose = false);
+
+    /* --- Replica-exchange Langevin dynamics: one replica per entry of kTs,
+     * advanced in lockstep with the Bussi and Parrinello integrator (as in
+     * langevinDynamics), with the replicas of each step evaluated in parallel
+     * on up to numThreads threads. Replica k starts from E[k]->guessPoint()
+     * and is always evaluated by E[k], so evaluators must compute the same
+     * function, and must be distinct objects if numThreads > 1. Every
+     * exchangeInterval steps (never, if not positive), neighboring temperatures
+     * attempt to swap configurations (with the Metropolis criterion, pairs
+     * alternating between even and odd), with velocities rescaled to the new
+     * temperature. Snapshots, every saveInterval steps (only at the end, if
+     * negative), go to the snapshot function along with the index of their
+     * temperature, in the calling thread. Final points are placed in solutions
+     * and their energies returned, both by temperature. Each replica draws its
+     * noise from its own generator, seeded from MstUtils::randEngine(), so runs
+     * are reproducible regardless of the number of threads. */
+    static vector<mstreal> langevinReplicas(const vector<optimizerEvaluator*>& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, const vector<mstreal>& kTs, int numIters, vector<vector<mstreal> >& solutions, const function<void(int, const vector<mstreal>&, mstreal)>& snapshot = nullptr, int saveInterval = -1, int exchangeInterval = 100, int numThreads = 1, bool verbose = false);
+
+    // a geometric ladder of n temperatures (as kT), from kTmin to kTmax
+    static vector<mstreal> temperatureLadder(mstreal kTmin, mstreal kTmax, int n);
+
+  private:
+    // shared by lbfgs() and lbfgsb(); lo and hi are NULL if unbounded
+    static mstreal lbfgsMin(optimizerEvaluator& E, vector<mstreal>& solution, const vector<mstreal>* lo, const vector<mstreal>* hi, int numIters, mstreal tol, bool verbose, int m);
 };
 
 }
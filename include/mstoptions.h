@@ -18,6 +18,7 @@ using namespace MST;
 class MstOptions {
   public:
     MstOptions() { w = 80; p1 = 3; p2 = p1+8; }
+    // all programs take --profile (see MstProfiler), which is listed in the usage after their own options
     MstOptions(int argc, char** argv) : MstOptions() { setOptions(argc, argv); }
 
     // formatting of usage information
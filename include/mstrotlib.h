@@ -4,6 +4,7 @@
 #include "msttypes.h"
 #include "msttransforms.h"
 #include <algorithm> // needed for sort
+#include <stdint.h>
 
 namespace MST {
 
@@ -24,12 +25,25 @@ class rotamerID {
 class RotamerLibrary {
   public:
     enum bbAtomType { bbN = 0, bbCA, bbC, bbO, bbH };
-    RotamerLibrary() { loaded = false; }
+    RotamerLibrary() { loaded = false; mapBase = NULL; mapLen = 0; }
     RotamerLibrary(string rotLibFile);
     ~RotamerLibrary();
 
+    /* Reads either the original binary format or a compiled library (see
+     * writeCompiledLibrary), telling the two apart by the start of the file. */
     void readRotamerLibrary(string rotLibFile);
 
+    /* Writes the library in the compiled format, which is mmap-ed rather than
+     * read: loading takes milliseconds regardless of library size, and processes
+     * on the same host share one read-only copy through the page cache. The file
+     * consists of a fixed header, followed by (8-byte aligned) flat arrays: a
+     * table of amino acids, a table of backbone bins, the real-valued data, and a
+     * blob of names. For each (amino acid, bin), rotamer probabilities, chi
+     * angles, and side-chain coordinates (in the layout of rotamerCoordinates)
+     * are contiguous. All data are in native byte order. */
+    void writeCompiledLibrary(const string& file);
+    static bool isCompiledLibrary(const string& file); // based on its header
+
     /* returns the index of the bin into which the given phi/psi value combination
      * maps for the given amino acid. */
     int getBackboneBin(string aa, mstreal phi, mstreal psi, bool assumeDefault = true);
@@ -51,14 +65,15 @@ class RotamerLibrary {
 
     /* decides whether the atom is a backbone atom basded on the name */
     static bool isHydrogen(string atomName);
-    static bool isHydrogen(Atom& atom) { return isHydrogen(atom.getName()); }
-    static bool isHydrogen(Atom* atom) { return isHydrogen(atom->getName()); }
+    static bool isHydrogen(const Atom& atom) { return atom.getNameC()[0] == 'H'; }
+    static bool isHydrogen(const Atom* atom) { return isHydrogen(*atom); }
     static bool isBackboneAtom(string atomName, bool noHyd = true) { return backboneAtomType(atomName, noHyd) >= 0; }
-    static bool isBackboneAtom(const Atom& atom, bool noHyd = true) { return backboneAtomType(atom.getName(), noHyd) >= 0; }
-    static bool isBackboneAtom(Atom* atom, bool noHyd = true) { return backboneAtomType(atom->getName(), noHyd) >= 0; }
+    static bool isBackboneAtom(const Atom& atom, bool noHyd = true) { return backboneAtomType(atom, noHyd) >= 0; }
+    static bool isBackboneAtom(Atom* atom, bool noHyd = true) { return backboneAtomType(*atom, noHyd) >= 0; }
     static int backboneAtomType(string atomName, bool noHyd = true);
-    static int backboneAtomType(const Atom& atom, bool noHyd = true) { return backboneAtomType(atom.getName(), noHyd); }
-    static int backboneAtomType(Atom* atom, bool noHyd = true) { return backboneAtomType(atom->getName(), noHyd); }
+    // checks the most common backbone atom names by their interned IDs (see MstNames) before parsing the name
+    static int backboneAtomType(const Atom& atom, bool noHyd = true);
+    static int backboneAtomType(Atom* atom, bool noHyd = true) { return backboneAtomType(*atom, noHyd); }
     static string standardBackboneAtomName(string atomName, bool noHyd = true);
     static string standardBackboneAtomName(Atom* atom, bool noHyd = true) { return standardBackboneAtomName(atom->getName(), noHyd); }
     static string standardBackboneAtomName(const Atom& atom, bool noHyd = true) { return standardBackboneAtomName(atom.getName(), noHyd); }
@@ -70,14 +85,45 @@ class RotamerLibrary {
     static void standardizeBackboneNames(System& S);
     static bool hasFullBackbone(System& S, bool noHyd = true);
     static vector<Atom*> getBackbone(const System& S, bool noHyd = true);
+    static vector<Atom*> getBackbone(const StructureView& V, bool noHyd = true);
 
     int numberOfRotamers(string aa, mstreal phi = Residue::badDihedral, mstreal psi = Residue::badDihedral, bool strict = false);
     mstreal rotamerProbability(string aa, int ri, mstreal phi = Residue::badDihedral, mstreal psi = Residue::badDihedral, bool strict = false);
     mstreal rotamerProbability(rotamerID& rot) { return rotamerProbability(&rot); }
     mstreal rotamerProbability(rotamerID* rot);
-    vector<string> availableAminoAcids() { return keys(rotamers); }
+    vector<string> availableAminoAcids() { return aaByIndex; }
     bool isLoaded() { return loaded; }
 
+    /* An index-addressed view of the library, compiled when it is read, for
+     * placing many rotamers without name lookups or building Residue objects.
+     * Amino acids are numbered in the order of availableAminoAcids(), and
+     * within each backbone bin, the side-chain coordinates of all rotamers are
+     * stored contiguously in the standard backbone frame: rotamer after
+     * rotamer, atom after atom (in the order of rotamerAtomNames), 3
+     * coordinates each. The library reads all data into this view (and, for
+     * compiled libraries, the arrays are in the mapped file). */
+    int numberOfAminoAcids() const { return aaByIndex.size(); }
+    int aminoAcidIndex(const string& aa);
+    const string& aminoAcidName(int ai) const { return aaByIndex[ai]; }
+    int getBackboneBin(int ai, mstreal phi, mstreal psi, bool assumeDefault = true);
+    int numberOfBackboneBins(int ai) const { return bins[ai].size(); }
+    int numberOfRotamers(int ai, int bi) const { return bins[ai][bi].numRots; }
+    int numberOfRotamerAtoms(int ai) const { return rotAtomNames[ai].size(); }
+    const vector<string>& rotamerAtomNames(int ai) const { return rotAtomNames[ai]; }
+    mstreal rotamerProbability(int ai, int bi, int ri) const { return bins[ai][bi].prob[ri]; }
+    const mstreal* rotamerCoordinates(int ai, int bi) const { return bins[ai][bi].coor; }
+
+    /* the transformation from the standard backbone frame (in which rotamer
+     * coordinates are stored) to the backbone of the given residue */
+    static Transform backboneFrame(Residue& res);
+
+    /* writes the coordinates of all rotamers of amino acid ai in backbone bin
+     * bi, transformed by T (e.g., backboneFrame of some residue), into coor, in
+     * the layout of rotamerCoordinates. So coor must have room for
+     * 3 * numberOfRotamers(ai, bi) * numberOfRotamerAtoms(ai) values. The
+     * result is the same as placing each rotamer with placeRotamer. */
+    void placeRotamers(Transform& T, int ai, int bi, mstreal* coor);
+
   protected:
     /* given an array of angles, stored in ascending order (i.e., in the counter-clockwise
      * direction), find the array index with the angle closest to the given angle */
@@ -85,7 +131,12 @@ class RotamerLibrary {
 
     /* make newAtoms be a vector of atoms corresponding to the given rotamer, upon
      * transformation according to the given Transform. */
-    void transformRotamerAtoms(Transform& T, Residue& rots, int rotIndex, vector<Atom*>& newAtoms);
+    void transformRotamerAtoms(Transform& T, int ai, int bi, int rotIndex, vector<Atom*>& newAtoms);
+
+    // maps a compiled library (see writeCompiledLibrary)
+    void mapCompiledLibrary(const string& rotLibFile);
+    // forgets any previously read library
+    void clear();
 
     // computes the difference between two angles, choosing the closest direction
     // (i.e., either clockwise, indicated by a negative difference or counter-clockwise,
@@ -109,17 +160,6 @@ class RotamerLibrary {
     }
 
   private:
-    /* the map is keyed by amino-acid name, the vector goes over phi/psi bins, and
-     * the inner Residue object stores atom information and coordinates for all
-     * rotamers of the amino acid in the backbone bin. The first rotamer is stored
-     * in the main coordinates of the Residue's constituent atoms, and the remaining
-     * rotamers, if any, in the alternative coordinates. */
-    map<string, vector<Residue*> > rotamers;
-
-    /* rotamer probabilities. As above, the map is keyed by amino acid, the outer vector
-     * goes over phi/psi bins and the inner vector over rotamers. */
-    map<string, vector<vector<mstreal> > > prob;
-
     /* for a given amino acid, binFreq[aa] stores the frequencies of each phi/psi bin. These
      * are stored as reals, so they can be either counts (i.e., number of occurrences) as with
      * Dunbrack's rotamer library or true frequencies (i.e., probabilities). */
@@ -128,15 +168,6 @@ class RotamerLibrary {
     /* the default phi/psi bin for each amino acid; assumed in the absence of a valid phi/psi pair. */
     map<string, int> defaultBin;
 
-    /* here the structure is similar, except rather than storing a Residue object with
-     * all the rotamers, here we store a vector<vector<real> > that defines the chi
-     * angles of each rotamer. The outer vector is over rotamers and the inner over chi
-     * angles (e.g., chi1 through chi4). So,
-     * chi["ARG"][i][13][2].first is the chi3 value for the 14th rotamer of ARG in phi/psi bin i
-     * and
-     * chi["ARG"][i][13][2].second -- is the standard deviation around this value (sigma). */
-    map<string, vector<vector<vector<pair<mstreal, mstreal> > > > > chi;
-
     /* definitions of chi angles (via atom names). The key is the amino acid name, the
      * outer vector is over chi angles and the inner vector is over atoms comprising each
      * chi angle. E.g., chidef["ASP"][1][0] is the first atom of chi2 for ASP. */
@@ -150,6 +181,46 @@ class RotamerLibrary {
     map<string, vector<mstreal> > binPhiCenters;
     map<string, vector<mstreal> > binPsiCenters;
 
+    /* the index-addressed view: amino-acid names by index, atom names of each
+     * amino acid, and the data of each backbone bin of each amino acid. In a bin,
+     * prob has the probability of each rotamer, chi the mean and the standard
+     * deviation of each chi angle of each rotamer (so chi[2*(nc*ri + k) + 1] is
+     * the sigma of chi k+1 of rotamer ri, with nc chi angles), and coor the
+     * local-frame coordinates (see rotamerCoordinates). The arrays point either
+     * into ownedData (one array per amino acid) or into the mapped file. */
+    struct rotamerBin {
+      int numRots;
+      const mstreal *prob, *chi, *coor;
+    };
+    vector<string> aaByIndex;
+    map<string, int> aaIndices;
+    vector<vector<string> > rotAtomNames;
+    vector<vector<rotamerBin> > bins;
+    vector<vector<mstreal> > ownedData;
+    void* mapBase;  // the mapped compiled library, if any
+    size_t mapLen;
+
+    /* On-disk records of the compiled format. Offsets in the header are in bytes
+     * from the start of the file; in amino-acid entries, name offsets are in
+     * bytes into the name blob (atom and chi-definition names follow one another,
+     * null-terminated), binStart indexes into the bin table, and the remaining
+     * offsets (here and in bin entries) are in reals into the real-valued data. */
+    struct compiledHeader {
+      char magic[8];
+      int32_t version, numAA;
+      int64_t aaOff, binOff, realOff, nameOff, fileSize;
+    };
+    struct compiledAA {
+      int64_t nameOff, atomNamesOff, chiDefsOff, binStart, phiOff, psiOff, freqOff;
+      int32_t numChi, numAtoms, numBins, numPhi, numPsi, defaultBin;
+    };
+    struct compiledBin {
+      int64_t probOff, chiOff, coorOff;
+      int32_t numRots, pad;
+    };
+    static const char* compiledMagic() { return "MSTROTC"; }
+    static const int compiledVersion = 1;
+
     bool loaded;
 };
 
@@ -26,6 +26,7 @@ class Sequence {
     string getResidue(int i, bool triple = false) const;
     res_t& operator[] (int i) { return seq[i]; }
     res_t operator[] (int i) const { return seq[i]; }
+    const res_t* data() const { return seq.data(); }
     Sequence subSequence(const vector<int>& inds) const;
     Sequence extractRange(int min, int max) const; //boundaries are inclusive
     int length() const { return seq.size(); }
@@ -88,6 +89,13 @@ class SeqTools {
     static bool areSequencesWithinID(const Sequence& seqA, const Sequence& seqB, int numID);
     static bool areSequencesWithinID(const Sequence& seqA, const Sequence& seqB, mstreal idCut);
     static int sequenceIdentity(const Sequence& seqA, const Sequence& seqB);
+    /* The number of positions at which residue arrays A and B, both of length
+     * L, differ. Compares four residues at a time within a 64-bit word. If the
+     * count exceeds maxMismatches, stops early and returns some number above
+     * maxMismatches. */
+    static int countMismatches(const res_t* A, const res_t* B, int L, int maxMismatches = numeric_limits<int>::max());
+    // whether A and B (of length L) are identical in at least numID positions
+    static bool areWithinID(const res_t* A, const res_t* B, int L, int numID) { return countMismatches(A, B, L, L - numID) <= L - numID; }
 
     /* Performs an all-by-all sequence identity search (ungapped) using a
      * randomized algorithm inspired by the USEARCH method (Robert C. Edgar,
@@ -103,8 +111,11 @@ class SeqTools {
      * the query to each of these sequences), we will eventually reach a pretty
      * high chance of recovering all matches. This algorithm chooses a word size
      * and number of iterations to get to any desired level of accuracy a (i.e.,
-     * expected fracton of matches found) while minimizing the running time. */
-    static vector<vector<int> > rSearch(const vector<Sequence>& seqs, mstreal idCut, mstreal a = 0.99, bool verb = false);
+     * expected fracton of matches found) while minimizing the running time.
+     * The lookup cycles are independent, and are spread over numThreads
+     * threads (the random word positions of all cycles are drawn up front, so
+     * the result does not depend on the number of threads). */
+    static vector<vector<int> > rSearch(const vector<Sequence>& seqs, mstreal idCut, mstreal a = 0.99, bool verb = false, int numThreads = 1);
 
     /* A fast sort algorithm specialized for sequence data. Uses radix sort,
      * since residue values have an a priori known maximum value. Sorts in
@@ -11,7 +11,7 @@ using namespace MST;
 
 class TERMANAL {
   public:
-    TERMANAL(FASST* _F = NULL) { F = _F; cdCut = 0.1; pad = 2; pseudoCount = 0.01; matchCount = 50; rmsdCut = 2.0; compatMode = false; compatSearchLimit = 1000; }
+    TERMANAL(FASST* _F = NULL) { F = _F; cdCut = 0.1; pad = 2; pseudoCount = 0.01; matchCount = 50; rmsdCut = 2.0; compatMode = false; compatSearchLimit = 1000; numThreads = 1; }
     void setFASST(FASST* _F) { F = _F; }
 
     /* Computes the structure score for the given TERM, following roughly the
@@ -47,13 +47,28 @@ class TERMANAL {
     void setCompatMode(bool _compatMode) { compatMode = _compatMode; }
     int getCompatSearchLimit() { return compatSearchLimit; }
     void setCompatSearchLimit(int _compatSearchLimit) { compatSearchLimit = _compatSearchLimit; }
+    /* Number of threads for scoring TERMs in scoreStructure(). Both the batch
+     * searches (overriding the thread count of the FASST object for their
+     * duration) and the per-TERM processing of matches are spread over them;
+     * scores do not depend on the number of threads. Verbose scoring runs on
+     * one thread, to keep the output in order. */
+    int getNumThreads() { return numThreads; }
+    void setNumThreads(int _numThreads) { numThreads = _numThreads; }
 
   protected:
+    fasstSearchOptions searchOptions(); // the FASST options TERMANAL searches with
     fasstSearchOptions setupSearch(const Structure& S);
+    void rankMatches(const Structure& term, fasstSolutionSet& matches, vector<fasstSolution*>& topMatches, vector<mstreal>& rmsds);
     vector<fasstSolution*> getTopMatches(FASST* F, fasstSolutionSet& matches, vector<Atom*>& queryA, vector<mstreal>* topRmsds = NULL);
     mstreal calcSeqLikelihood(vector<fasstSolution*>& matches, const vector<Residue*>& central, bool verbose);
     mstreal calcSeqFreq(Residue* res, vector<Sequence>& matchSeqs);
     mstreal calcStructFreq(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, bool verbose);
+    mstreal structFreqFromNativeMatches(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, const Structure& firstMatch, fasstSolutionSet& matchesToClosestNative, bool verbose);
+
+    /* Computes score parts for the TERMs with the given indices (into terms and
+     * centrals), searching for all of them as a batch, and stores them in
+     * structScoreParts keyed by TERM index. */
+    void scoreTERMs(const vector<Structure>& terms, const vector<Residue*>& centrals, const vector<int>& termIdx, map<int, pair<mstreal, mstreal>>& structScoreParts, bool verbose);
     vector<Structure> collectTERMs(ConFind& C, const vector<Residue*>& subregion, vector<Residue*>& centrals, vector<vector<int>>& resOverlaps);
     pair<mstreal, mstreal> smoothScores(map<int, pair<mstreal, mstreal>>& structScoreParts, vector<int>& overlapResInds);
 
@@ -70,6 +85,7 @@ class TERMANAL {
     // Note also that the original method uses a different sequence redundancy filter, which is not implemented the way it is here (FASST::setRedundancyCut)
     bool compatMode; // if true, assumes the FASST search is by CA RMSD and then sorts by full backbone RMSD
     int compatSearchLimit; // maximum number of matches to return when searching in compatibility mode
+    int numThreads; // threads to score TERMs on
 };
 
 
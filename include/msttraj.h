@@ -0,0 +1,79 @@
+#ifndef _MSTTRAJ_H
+#define _MSTTRAJ_H
+
+#include "msttypes.h"
+#include <mutex>
+
+namespace MST {
+
+/* Compact binary trajectories (e.g., of dynamics runs), written as snapshots
+ * are produced rather than accumulated in memory. The file starts with the
+ * topology (a Structure, whose atoms every snapshot lists in the same order),
+ * followed by frames. Coordinates are quantized to a fixed precision (in
+ * Angstrom) and, except in key frames, stored as differences from the previous
+ * frame, zig-zag and variable-length encoded, so that the small moves between
+ * consecutive snapshots take one or two bytes per coordinate. Every frame also
+ * carries a score (e.g., the energy of the snapshot). A frame cut short (e.g.,
+ * by a crash while writing) ends the trajectory for the reader. */
+class trajectoryWriter {
+  public:
+    /* If append is true and the file already has frames, new ones are added
+     * after them (the topology must have the same number of atoms). If the
+     * topology is not given, the structure of the first frame added becomes
+     * the topology. Key frames (stored in full) come every keyInterval frames. */
+    trajectoryWriter(const string& file, mstreal precision = 0.001, int keyInterval = 100, bool append = false);
+    trajectoryWriter(const string& file, const Structure& topology, mstreal precision = 0.001, int keyInterval = 100, bool append = false);
+    ~trajectoryWriter() { close(); }
+
+    /* Snapshots must list the atoms of the topology in the same order, either
+     * as a Structure or as 3N coordinates (x1, y1, z1, x2, ...). Adding frames
+     * is thread safe (frames from different threads go in the order added). */
+    void addFrame(const Structure& S, mstreal score = 0);
+    void addFrame(const vector<mstreal>& coords, mstreal score = 0);
+    int numFrames() const { return nFrames; }     // added through this object
+    int numAtoms() const { return nAtoms; }
+    mstreal getPrecision() const { return prec; }
+    void flush();
+    void close();
+
+  private:
+    void writeHeader(const Structure& topology);
+    void addFrame(const mstreal* coords, int n, mstreal score);
+
+    string fileName;
+    fstream out;
+    mstreal prec;
+    int keyInt, nAtoms, nFrames;
+    bool headerWritten, appending;
+    vector<long> prev; // quantized coordinates of the previous frame
+    string buf;        // encoded frame
+    mutex lock;
+};
+
+class trajectoryReader {
+  public:
+    trajectoryReader(const string& file);
+
+    /* Reads the next frame, returning false at the end of the trajectory. In
+     * the Structure version, S receives a copy of the topology, with the atoms
+     * moved to the snapshot. */
+    bool readFrame(vector<mstreal>& coords, mstreal& score);
+    bool readFrame(Structure& S, mstreal& score);
+    const Structure& getTopology() const { return topo; }
+    int numAtoms() const { return topo.atomSize(); }
+    mstreal getPrecision() const { return prec; }
+    int numFramesRead() const { return nFrames; }
+
+    static bool isTrajectoryFile(const string& file); // based on its header
+
+  private:
+    fstream in;
+    Structure topo;
+    mstreal prec;
+    int nFrames;
+    vector<long> prev;
+};
+
+}
+
+#endif
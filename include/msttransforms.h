@@ -66,6 +66,7 @@ class Transform {
     Transform& operator*=(const Transform& rhs);
     const Transform operator*(const Transform& rhs) const;
     const CartesianPoint operator*(const CartesianPoint& rhs) const;
+    const Point3 operator*(const Point3& rhs) const;
     Transform inverse();                   // return the einverse transform
     Transform rotation();                  // extract the rotation component
     Transform translation();               // extract the translation component
@@ -79,6 +80,7 @@ class Transform {
 
     CartesianPoint applyToCopy(CartesianPoint& p);
     void apply(CartesianPoint& p);
+    void apply(Point3& p) { apply(p[0], p[1], p[2]); }
     void apply(Frame& f);
     void apply(Atom& a) { apply(&a); }
     void apply(Atom* a);
@@ -91,6 +93,23 @@ class Transform {
     void apply(Structure* S);
     void apply(const AtomPointerVector& vec);
 
+    /* Batch application to n points stored contiguously as x, y, z triplets
+     * (i.e., 3*n values). The matrix is read once per call rather than once per
+     * coordinate, and the inner loop has no dependencies between points, so it
+     * vectorizes. In the copying version, out may be the same as coor. */
+    void apply(mstreal* coor, int n) const { applyToCopy(coor, n, coor); }
+    void applyToCopy(const mstreal* coor, int n, mstreal* out) const;
+
+    /* Applies each of the given transforms to the same n points, writing the
+     * result of transforms[t] into out + 3*n*t (so out must hold 3*n*transforms.size()
+     * values). Useful for scoring many poses of the same rigid body. */
+    static void applyEach(const vector<Transform>& transforms, const mstreal* coor, int n, mstreal* out);
+
+    /* Returns the single transform equivalent to applying the given transforms
+     * in order (transforms[0] first). Applying the result moves coordinates in
+     * one pass instead of one pass per transform. */
+    static Transform compose(const vector<Transform>& transforms);
+
     void write(ostream& _os) const; // write Tansform to a binary stream
     void read(istream& _is);  // read Tansform from a binary stream
 
@@ -11,6 +11,7 @@
 #include <iomanip>
 #include <vector>
 #include <map>
+#include <unordered_map>
 #include <set>
 #include <limits>
 #include <algorithm>
@@ -23,6 +24,14 @@
 #include <execinfo.h>
 #include <signal.h>
 #include <random>
+#include <functional>
+#include <thread>
+#include <atomic>
+#include <exception>
+#include <array>
+#include <mutex>
+#include <type_traits>
+#include <memory>
 #undef assert
 
 using namespace std;
@@ -35,12 +44,105 @@ class Residue;
 class Atom;
 class Structure;
 class CartesianPoint;
+class CellList;
 
 typedef double mstreal;
+/* Element type of bulk coordinate stores (FASST target coordinates, ConFind
+ * rotamer clouds). Single precision (the MST_SINGLE_COORDS build flag) halves
+ * their memory and bandwidth; arithmetic on them is still done in mstreal. */
+#ifdef MST_SINGLE_COORDS
+typedef float mstcoor;
+#else
+typedef double mstcoor;
+#endif
 typedef Structure System;                // for interchangability with MSL
 
+/* An arena (bump) allocator for the objects that make up Structures: their
+ * Chains, Residues, Atoms and atom names. While a Scope is alive, all such
+ * objects created by that thread come from its arena rather than one at a
+ * time from the general-purpose allocator, and are kept together in memory.
+ * Arena memory is carved in chunks out of one reserved region of address
+ * space, so whether an object came from an arena is a range check. Deleting
+ * such an object only drops a reference to its arena (all the usual APIs are
+ * unchanged); an arena counts a reference for every live object and for each
+ * of its users (see acquire()/release()), and returns all of its chunks at
+ * once when the last one goes. If the address space can not be reserved,
+ * allocations quietly go to the heap instead. */
+class MstArena {
+  public:
+    // a new arena, with one reference (held by the caller)
+    static MstArena* create() { return new MstArena(); }
+    void acquire() { refs++; }
+    void release();
+    size_t bytesUsed() const { return used; }
+    int numChunks() const { return chunks.size(); }
+
+    /* Allocates from the current arena of the calling thread, if there is one,
+     * and from the heap otherwise. deallocate() takes either kind of pointer. */
+    static void* allocate(size_t n);
+    static void deallocate(void* p);
+    static bool fromArena(const void* p);
+    static MstArena* current() { return currentArena; }
+
+    // makes the given arena (may be NULL, for the heap) current for its lifetime
+    class Scope {
+      public:
+        Scope(MstArena* arena) { prev = currentArena; currentArena = arena; }
+        ~Scope() { currentArena = prev; }
+      private:
+        MstArena* prev;
+    };
+
+  private:
+    MstArena() : refs(1), pos(NULL), end(NULL), used(0) {}
+    MstArena(const MstArena& other);
+    ~MstArena();
+    void* bump(size_t n);
+
+    atomic<long> refs;
+    vector<char*> chunks;
+    char *pos, *end;
+    size_t used;
+    mutex lock; // arenas can be shared between threads
+
+    static const size_t chunkSize = 1 << 20;
+    static thread_local MstArena* currentArena;
+    // the reserved region from which chunks come
+    static char* takeChunk();
+    static void returnChunk(char* chunk);
+    static atomic<char*> regionBase;
+    static size_t regionSize, regionNext;
+    static vector<char*> freeChunks;
+    static mutex regionLock;
+};
+
+/* Interned atom and residue names. Each distinct name gets a small integer ID
+ * the first time it is interned, which then stays the same for the life of the
+ * program, so names can be compared as integers and the characters of each name
+ * are kept only once (atoms and residues store just the ID). Interning is safe
+ * to do from multiple threads, and each thread remembers the names it has seen
+ * so that the shared table is only locked for names new to the thread. */
+class MstNames {
+  public:
+    static int intern(const char* name);
+    static int intern(const string& name) { return intern(name.c_str()); }
+    static int find(const char* name); // the ID of the name, or -1 if it was never interned
+    static int find(const string& name) { return find(name.c_str()); }
+    static const char* name(int id) { return blocks[id >> blockBits][id & (blockSize - 1)]; }
+    static int size() { return numNames; }
+
+  private:
+    static const int blockBits = 10, blockSize = 1 << blockBits, maxBlocks = 1 << 12;
+    static const char** blocks[maxBlocks];
+    static atomic<int> numNames;
+    static unordered_map<string, int>* ids;
+    static mutex lock;
+    static thread_local unordered_map<string, int> seen;
+};
+
 class Structure {
   friend class Chain;
+  friend class Residue;
 
   public:
     Structure();
@@ -57,14 +159,38 @@ class Structure {
      * into residues of the second one, preserving the chain topology of the latter. */
     static Structure combine(const Structure& atomsStruct, const Structure& topoStruct, bool renameResidues = true);
 
+    /* Files are read in one go and may be gzip-compressed. readPDB() hands files
+     * with a .cif or .mmcif extension (optionally followed by .gz) to readCIF(),
+     * which reads the first model of the atom_site table of an mmCIF file,
+     * taking the same options as readPDB(). */
     void readPDB(const string& pdbFile, string options = "");
     void readPDB(istream& is, string options = "");
+    void readCIF(const string& cifFile, string options = "");
+    void readCIF(istream& is, string options = "");
+
+    /* Reads the given files (as readPDB() would) using up to numThreads threads,
+     * in the order in which they are given. The caller owns the structures. */
+    static vector<Structure*> readMany(const vector<string>& files, int numThreads = 1, string options = "", MstArena* arena = NULL);
     void writePDB(const string& pdbFile, string options = "") const;
     void writePDB(ostream& ofs, string options = "") const;
-    void writeData(const string& dataFile) const;
-    void writeData(ostream& ofs) const;
+    /* Binary serialization. By default, the compact format (version 2) is
+     * written, with names interned in a dictionary and all coordinates in one
+     * contiguous block; version 1 writes the original per-atom format (e.g.,
+     * for older readers). readData() recognizes either. */
+    void writeData(const string& dataFile, int version = 2) const;
+    void writeData(ostream& ofs, int version = 2) const;
     void readData(const string& dataFile);
     void readData(istream& ifs);
+
+    /* Arena mode (see MstArena): the chains, residues and atoms that this
+     * Structure creates (when reading, copying or adding to it) come from the
+     * given arena, which the Structure holds a reference to. NULL goes back to
+     * the heap for anything created from then on. useArena() gives it an arena
+     * of its own, as does the "ARENA" option of readPDB(). Copies made with the
+     * copy constructor share the arena of the original. */
+    void setArena(MstArena* _arena);
+    void useArena() { MstArena* a = MstArena::create(); setArena(a); a->release(); }
+    MstArena* getArena() const { return arena; }
     void reset();
     Structure& operator=(const Structure& A);
     int chainSize() const { return chains.size(); }
@@ -112,6 +238,20 @@ class Structure {
 
     int getResidueIndex(Residue* res);
 
+    /* Backbone cache: once cacheBackbone() is called, the N, CA, C and O atoms of
+     * every residue, along with which residues precede and follow it in its
+     * chain, are kept indexed, so that Residue::getPhi(), getPsi() and getOmega()
+     * skip atom-name and neighbor look-ups. Only atoms are cached, not dihedrals,
+     * so moving atoms needs no care. Adding or removing atoms, residues or chains
+     * drops the cache (call cacheBackbone() again to rebuild it); renaming
+     * backbone atoms is not noticed and calls for clearBackboneCache(). */
+    void cacheBackbone();
+    void clearBackboneCache();
+    bool isBackboneCached() const { return bbCache.valid; }
+    /* Phi, psi and omega of every residue, in order (Residue::badDihedral where
+     * not defined), caching the backbone first if it is not already cached. */
+    void backboneDihedrals(vector<mstreal>& phi, vector<mstreal>& psi, vector<mstreal>& omega);
+
     /* == and != operators are needed to convert vector<Structure> into python
      * lists via boost.python. This is because python lists are quite a bit more
      * powerful than C++ vectors, enabling, for example, contains queries. */
@@ -119,19 +259,84 @@ class Structure {
     bool operator!=(const Structure& other) { return (this != &other); }
 
   protected:
-    void incrementNumAtoms(int delta = 1) { numAtoms += delta; }
-    void incrementNumResidues(int delta = 1) { numResidues += delta; }
+    void incrementNumAtoms(int delta = 1) { numAtoms += delta; bbCache.valid = false; }
+    void incrementNumResidues(int delta = 1) { numResidues += delta; bbCache.valid = false; }
     void deletePointers();
     void copy(const Structure& S);
 
   private:
+    struct backboneCache {
+      enum atomType { N = 0, CA, C, O };
+      bool valid = false;
+      vector<Atom*> atoms;    // N, CA, C and O of each residue (NULL if missing)
+      vector<int> prev, next; // indices of the neighboring residues in the same chain (-1 if none)
+      unordered_map<const Residue*, int> index;
+      Atom* atom(int ri, atomType t) const { return atoms[4*ri + t]; }
+    };
+
     vector<Chain*> chains;
     string name;
     int numResidues, numAtoms;
+    MstArena* arena;
+    backboneCache bbCache;
     // NOTE: thse two maps are maintained for convenience and will not guarantee the lack of collisions. That is,
     // if more than one chain use the same ID or segment ID, these maps will only store the last one added.
     map<string, Chain*> chainsByID;
     map<string, Chain*> chainsBySegID;
+
+    static void writePDB(ostream& ofs, const vector<vector<Residue*> >& chains, string options);
+    friend class StructureView;
+};
+
+/* A non-owning view of part of a Structure (e.g., a TERM), as a list of
+ * segments, each a run of consecutive residues of the parent (by residue
+ * index), which play the part of chains. Views are cheap to make and pass
+ * around, so fragments that are only searched for or scored need not be
+ * copied; toStructure() makes the copy when one is needed (e.g., to modify
+ * it). The parent must outlive the view and keep its residues while the view
+ * is in use (moving atoms is fine). */
+class StructureView {
+  public:
+    StructureView() : parent(NULL) {}
+    explicit StructureView(const Structure& S) : parent(&S) {}
+    void setParent(const Structure& S) { parent = &S; clear(); }
+    const Structure* getParent() const { return parent; }
+    void clear() { segStart.clear(); segOff.assign(1, 0); }
+
+    /* Appends residue ri of the parent. It continues the last segment if it
+     * follows the residue last added in the same chain, unless newSegment. */
+    void addResidue(int ri, bool newSegment = false);
+    // appends residues first through last (inclusive) as a segment of their own
+    void addSegment(int first, int last);
+
+    int chainSize() const { return segStart.size(); }
+    int residueSize() const { return segOff.empty() ? 0 : segOff.back(); }
+    int atomSize() const;
+    int chainResidueSize(int s) const { return segOff[s + 1] - segOff[s]; }
+    Residue& getResidue(int i) const;
+    int parentIndex(int i) const { int s = chainIndex(i); return segStart[s] + i - segOff[s]; }
+    int chainIndex(int i) const { return upper_bound(segOff.begin(), segOff.end(), i) - segOff.begin() - 1; }
+    int residueIndexInChain(int i) const { return i - segOff[chainIndex(i)]; }
+    vector<Residue*> getResidues() const;
+    vector<Residue*> getChainResidues(int s) const;
+    vector<Atom*> getAtoms() const; // atoms of the parent, not copies
+
+    // splits segments wherever the peptide bond is broken, as the Structure version
+    StructureView reassignChainsByConnectivity(mstreal maxPeptideBond = 2.0) const;
+
+    /* Copies of the residues, with one chain per segment. Chains are named as
+     * those of the parent, or chainID if given (with renaming on collision). */
+    void appendTo(Structure& S, const string& chainID = "") const;
+    Structure toStructure(const string& chainID = "") const;
+
+    // as Structure::writePDB, with the chain IDs of the parent
+    void writePDB(const string& pdbFile, string options = "") const;
+    void writePDB(ostream& ofs, string options = "") const;
+
+  private:
+    const Structure* parent;
+    vector<int> segStart;       // parent residue index of the first residue of each segment
+    vector<int> segOff = {0};   // view index of the first residue of each segment (plus the total)
 };
 
 class Chain {
@@ -139,6 +344,10 @@ class Chain {
   friend class Structure;
 
   public:
+    // allocated from the current arena, if any (see MstArena)
+    static void* operator new(size_t n) { return MstArena::allocate(n); }
+    static void operator delete(void* p) { MstArena::deallocate(p); }
+
     Chain();
     Chain(const Chain& C);
     Chain(const string& chainID, const string& segID);
@@ -193,6 +402,10 @@ class Residue {
   friend class Atom;
 
   public:
+    // allocated from the current arena, if any (see MstArena)
+    static void* operator new(size_t n) { return MstArena::allocate(n); }
+    static void operator delete(void* p) { MstArena::deallocate(p); }
+
     Residue();
     Residue(const Residue& R, bool copyAlt = true);
     Residue(string _resname, int _resnum, char _icode = ' ');
@@ -204,18 +417,21 @@ class Residue {
     Atom& getAtom(int i) const { return *(atoms[i]); }
     Chain* getChain() const { return parent; }
     string getChainID(bool strict = true);
-    string getName() const { return resname; }
+    string getName() const { return MstNames::name(resnameID); }
+    int getNameID() const { return resnameID; }
     int getNum() const { return resnum; }
     char getIcode() const { return icode; }
-    bool isNamed(const string& _name) const { return (resname.compare(_name) == 0); }
-    bool isNamed(const char* _name) const { return (strcmp(resname.c_str(), _name) == 0); }
+    bool isNamed(const string& _name) const { return isNamed(_name.c_str()); }
+    bool isNamed(const char* _name) const { return (strcmp(MstNames::name(resnameID), _name) == 0); }
+    bool isNamed(int _nameID) const { return resnameID == _nameID; } // see MstNames
     Atom* findAtom(string _name, bool strict = true) const; // returns NULL if not found and if strict is false
+    Atom* findAtom(int _nameID, bool strict = true) const;   // by interned name (see MstNames)
     bool atomExists(string _name) { return (findAtom(_name, false) != NULL); } // mostly for interchangeability with MSL, better to use findAtom and check for NULL
     Chain* getParent() const { return parent; }
     Structure* getStructure() const { return (parent == NULL) ? NULL : parent->getParent(); }
 
-    void setName(const char* _name) { resname = (string) _name; }
-    void setName(const string& _name) { resname = _name; }
+    void setName(const char* _name) { resnameID = MstNames::intern(_name); }
+    void setName(const string& _name) { resnameID = MstNames::intern(_name); }
     void setIcode(char _icode) { icode = _icode; }
     void setNum(int num) { resnum = num; }
     void copyAtoms(Residue& R, bool copyAlt = true);
@@ -276,12 +492,14 @@ class Residue {
 
   protected:
     void setParent(Chain* _parent) { parent = _parent; } // will not itself update residue/atom counts in parents
+    // the backbone cache of the parent structure, or NULL if there is none
+    const Structure::backboneCache* cachedBackbone() const;
 
   private:
     vector<Atom*> atoms;
     Chain* parent;
     int resnum;
-    string resname;
+    int resnameID;
     char icode;
 };
 
@@ -293,6 +511,10 @@ class Atom {
   friend class AtomContainer;
 
   public:
+    // allocated from the current arena, if any (see MstArena)
+    static void* operator new(size_t n) { return MstArena::allocate(n); }
+    static void operator delete(void* p) { MstArena::deallocate(p); }
+
     Atom();
     Atom(const Atom& A, bool copyAlt = true);
     Atom(const Atom* A, bool copyAlt = true) : Atom(*A, copyAlt) {}
@@ -312,21 +534,23 @@ class Atom {
     char getAltLocID(int altInd) const  { return info->getAltLocID(altInd); }
     mstreal getB() const { return info->B; }
     mstreal getOcc() const { return info->occ; }
-    string getName() const { return string(info->name); }
-    char* getNameC() { return info->name; }
+    string getName() const { return string(MstNames::name(info->nameID)); }
+    const char* getNameC() const { return MstNames::name(info->nameID); }
+    int getNameID() const { return info->nameID; }
     bool isHetero() const { return info->het; }
     int getIndex() const { return info->index; }
     char getAlt() const { return info->alt; }
     void setAlt(char a) const { info->alt = a; }
-    bool isNamed(const char* _name) const { return (strcmp(info->name, _name) == 0); }
+    bool isNamed(const char* _name) const { return (strcmp(getNameC(), _name) == 0); }
     bool isNamed(const string& _name) const { return isNamed(_name.c_str()); }
+    bool isNamed(int _nameID) const { return info->nameID == _nameID; } // see MstNames
     bool hasAlternatives() const { return (info->alternatives != NULL); }
     int numAlternatives() const { return (info->alternatives == NULL) ? 0 : info->alternatives->size(); }
     Residue* getParent() const { return info->parent; }
     Residue* getResidue() const { return info->parent; }
     Chain* getChain() const { return (info->parent == NULL) ? NULL : info->parent->getParent(); }
     Structure* getStructure() { Chain* chain = getChain(); return (chain == NULL) ? NULL : chain->getParent(); }
-    mstreal getMass() const { return Atom::getMass(info->name); }
+    mstreal getMass() const { return Atom::getMass(getNameC()); }
     static mstreal getMass(const char* name);
 
     void setName(const char* _name) { info->setName(_name); }
@@ -380,6 +604,14 @@ class Atom {
       return build(*diA, *anA, *thA, di, an, th, radians);
     }
 
+    /* Same as above, but also computes the partial derivatives of the placed
+     * coordinates. icPartials (9 values) receives the partials of X, Y, and Z
+     * with respect to di, an, and th (at index 3*dim + ic; angle partials are
+     * per degree unless radians is true). xyzPartials (27 values) receives the
+     * partials with respect to the coordinates of diA, anA, and thA (at index
+     * 9*ref + 3*dim + refDim). Either pointer may be NULL. */
+    bool build(const Atom& diA, const Atom& anA, const Atom& thA, mstreal di, mstreal an, mstreal th, mstreal* icPartials, mstreal* xyzPartials, bool radians = false);
+
     void write(ostream& _os) const; // write Atom to a binary stream
     void read(istream& _is);  // read Atom from a binary stream
     friend ostream & operator<<(ostream &_os, const Atom& _atom);
@@ -409,13 +641,15 @@ class Atom {
             char alt;
         };
 
+        static void* operator new(size_t n) { return MstArena::allocate(n); }
+        static void operator delete(void* p) { MstArena::deallocate(p); }
         atomInfo();
         atomInfo(const atomInfo& other, bool copyAlt = true);
         atomInfo(int _index, const string& _name, mstreal _B, mstreal _occ, bool _het, char _alt = ' ', Residue* _parent = NULL);
         ~atomInfo();
 
-        void setName(const char* _name);
-        void setName(const string& _name) { setName(_name.c_str()); }
+        void setName(const char* _name) { nameID = MstNames::intern(_name); }
+        void setName(const string& _name) { nameID = MstNames::intern(_name); }
         CartesianPoint getAltCoor(int altInd) const;
         mstreal getAltB(int altInd) const;
         mstreal getAltOcc(int altInd) const;
@@ -427,7 +661,8 @@ class Atom {
         void clearAlternatives();
 
         mstreal occ, B;
-        char *name, alt;
+        int nameID; // see MstNames
+        char alt;
         Residue* parent;
         bool het;
         int index;
@@ -508,12 +743,62 @@ class CartesianPoint : public vector<mstreal> {
     }
 };
 
+/* A fixed-size, trivially copyable 3D point, with the same arithmetic as a 3D
+ * CartesianPoint but no heap storage, so that temporaries on hot paths cost
+ * nothing to make. Converts implicitly to a CartesianPoint; the conversion
+ * from a CartesianPoint (which must be 3D) or an Atom is explicit. */
+class Point3 {
+  public:
+    Point3() { c[0] = c[1] = c[2] = 0; }
+    Point3(mstreal x, mstreal y, mstreal z) { c[0] = x; c[1] = y; c[2] = z; }
+    explicit Point3(const CartesianPoint& p);
+    explicit Point3(const Atom& A) { c[0] = A.getX(); c[1] = A.getY(); c[2] = A.getZ(); }
+    explicit Point3(const Atom* A) : Point3(*A) {}
+    operator CartesianPoint() const { return CartesianPoint(c[0], c[1], c[2]); }
+
+    mstreal& operator[](int i) { return c[i]; }
+    mstreal operator[](int i) const { return c[i]; }
+    int size() const { return 3; }
+    mstreal getX() const { return c[0]; }
+    mstreal getY() const { return c[1]; }
+    mstreal getZ() const { return c[2]; }
+
+    Point3& operator+=(const Point3& rhs) { c[0] += rhs.c[0]; c[1] += rhs.c[1]; c[2] += rhs.c[2]; return *this; }
+    Point3& operator-=(const Point3& rhs) { c[0] -= rhs.c[0]; c[1] -= rhs.c[1]; c[2] -= rhs.c[2]; return *this; }
+    Point3& operator*=(mstreal s) { c[0] *= s; c[1] *= s; c[2] *= s; return *this; }
+    Point3& operator/=(mstreal s) { c[0] /= s; c[1] /= s; c[2] /= s; return *this; }
+    Point3 operator+(const Point3& other) const { return Point3(c[0] + other.c[0], c[1] + other.c[1], c[2] + other.c[2]); }
+    Point3 operator-(const Point3& other) const { return Point3(c[0] - other.c[0], c[1] - other.c[1], c[2] - other.c[2]); }
+    Point3 operator*(mstreal s) const { return Point3(c[0]*s, c[1]*s, c[2]*s); }
+    Point3 operator/(mstreal s) const { return Point3(c[0]/s, c[1]/s, c[2]/s); }
+    Point3 operator-() const { return Point3(-c[0], -c[1], -c[2]); }
+    mstreal operator*(const Point3& other) const { return dot(other); }
+
+    mstreal dot(const Point3& other) const { return c[0]*other.c[0] + c[1]*other.c[1] + c[2]*other.c[2]; }
+    Point3 cross(const Point3& other) const { return Point3(c[1]*other.c[2] - c[2]*other.c[1], c[2]*other.c[0] - c[0]*other.c[2], c[0]*other.c[1] - c[1]*other.c[0]); }
+    mstreal norm2() const { return dot(*this); }
+    mstreal norm() const { return sqrt(norm2()); }
+    Point3 getUnit() const { return (*this)/norm(); }
+    mstreal distance2(const Point3& another) const { return (*this - another).norm2(); }
+    mstreal distance(const Point3& another) const { return sqrt(distance2(another)); }
+
+    friend ostream & operator<<(ostream &_os, const Point3& _p) {
+      _os << _p[0] << " " << _p[1] << " " << _p[2];
+      return _os;
+    }
+
+  private:
+    mstreal c[3];
+};
+
 class CartesianGeometry {
   public:
     static mstreal dihedral(const CartesianPoint & _p1, const CartesianPoint & _p2, const CartesianPoint & _p3, const CartesianPoint & _p4, bool radians = false);
     static mstreal dihedral(const CartesianPoint * _p1, const CartesianPoint * _p2, const CartesianPoint * _p3, const CartesianPoint * _p4, bool radians = false);
+    static mstreal dihedral(const Point3& _p1, const Point3& _p2, const Point3& _p3, const Point3& _p4, bool radians = false);
     static mstreal angle(const CartesianPoint & _p1, const CartesianPoint & _p2, const CartesianPoint & _p3, bool radians = false);
     static mstreal angle(const CartesianPoint * _p1, const CartesianPoint * _p2, const CartesianPoint * _p3, bool radians = false);
+    static mstreal angle(const Point3& _p1, const Point3& _p2, const Point3& _p3, bool radians = false);
     static mstreal angleDiff(mstreal A, mstreal B, bool radians = false);
     static mstreal angleDiffCCW(mstreal A, mstreal B, bool radians = false);
 
@@ -539,18 +824,24 @@ class CartesianGeometry {
      * atom, then second atom. */
     template <class T>
     static mstreal distance(const CartesianPoint& atom1, const CartesianPoint& atom2, T& grad);
+    template <class T>
+    static mstreal distance(const Point3& atom1, const Point3& atom2, T& grad);
 
     /* gradient vector must be of length 9, and will be filled with partial
      * derivatives d(distance)/dc, where c runs over x, y, and z of the first
      * atom, then second atom, then third atom. */
     template <class T>
     static mstreal angle(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, T& grad, bool radians = false);
+    template <class T>
+    static mstreal angle(const Point3& atom1, const Point3& atom2, const Point3& atom3, T& grad, bool radians = false);
 
     /* gradient vector must be of length 12, and will be filled with partial
      * derivatives d(distance)/dc, where c runs over x, y, and z of the first
      * atom, then second atom, then third atom, then fourth atom. */
     template <class T>
     static mstreal dihedral(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, const CartesianPoint& atom4, T& grad, bool radians = false);
+    template <class T>
+    static mstreal dihedral(const Point3& atom1, const Point3& atom2, const Point3& atom3, const Point3& atom4, T& grad, bool radians = false);
 
     /* Tests implementation of analytical gradients of bond, angle, and dihedral
      * using finite difference for comparison. */
@@ -639,13 +930,35 @@ class expressionTree {
     vector<expressionTree*> children;
 };
 
+/* A selection expression parsed once, so that it can be evaluated many times
+ * (e.g., by selectors of different structures) without re-parsing. Copies
+ * share the parsed tree. */
+class compiledSelection {
+  public:
+    compiledSelection(const string& selStr);
+    const string& getString() const { return str; }
+    expressionTree* getTree() const { return tree.get(); }
+
+  private:
+    string str;
+    shared_ptr<expressionTree> tree;
+};
+
+/* Evaluates selection expressions over the atoms of a structure. Every node of
+ * the expression is evaluated into flags over all atoms, so that logical
+ * operators, byres and bychain take linear time. Proximity ("around") uses a
+ * cell list of all atoms, built upon the first such selection and reused by
+ * later ones, so atoms should not move while the selector is in use (make a
+ * new selector if they do). Selections come out in the order of the structure. */
 class selector {
   public:
     selector(const Structure& S);
     AtomPointerVector select(string selStr);
+    AtomPointerVector select(const compiledSelection& sel);
     vector<Residue*> selectRes(string selStr);
+    vector<Residue*> selectRes(const compiledSelection& sel);
     void select(expressionTree* tree, AtomPointerVector& sel);
-    expressionTree* buildExpressionTree(string selStr);
+    static expressionTree* buildExpressionTree(string selStr);
     AtomPointerVector around(AtomPointerVector& selAtoms, mstreal dcut);
     AtomPointerVector byRes(AtomPointerVector& selAtoms);
     AtomPointerVector byChain(AtomPointerVector& selAtoms);
@@ -654,10 +967,20 @@ class selector {
     AtomPointerVector combine(AtomPointerVector& selA, AtomPointerVector& selB);
 
   private:
-    string getNextSelectionToken(string& selStr);
+    static string getNextSelectionToken(string& selStr);
+    void evaluate(expressionTree* tree, vector<bool>& in);
+    void aroundFlags(const vector<bool>& in, mstreal dcut, vector<bool>& out);
+    // flags every atom in a group (residue or chain, per groupIdx) with any flagged atom
+    void expandFlags(const vector<bool>& in, const vector<int>& groupIdx, vector<bool>& out);
+    vector<bool> toFlags(const AtomPointerVector& sel);
+    AtomPointerVector fromFlags(const vector<bool>& in);
+
     vector<Atom*> atoms;
     vector<Residue*> atomResidues, residues;
     vector<Chain*> atomChains;
+    vector<int> atomResIdx, atomChainIdx;  // index of the residue/chain of each atom
+    map<Atom*, int> atomIndex;             // built when first needed
+    shared_ptr<CellList> grid;             // of all atoms, built when first needed
 };
 
 class RMSDCalculator {
@@ -683,6 +1006,37 @@ class RMSDCalculator {
     vector<mstreal> bestRMSD(const vector<vector<Atom*>> &_align, const vector<Atom*> &_ref, int, int);
     mstreal bestResidual(const vector<Atom*> &_align, const vector<Atom*> &_ref, bool setTransRot = false, bool* _suc = NULL);
 
+    /* Same as the above two, but for raw coordinate spans, each holding n points
+     * as consecutive x, y, z triples (e.g., packed coordinate buffers). T and U
+     * can be either mstreal or float; accumulation is always in mstreal. */
+    template <class T, class U>
+    mstreal bestRMSD(const T* _align, const U* _ref, int n, bool setTransRot = false, bool* _suc = NULL);
+    template <class T, class U>
+    mstreal bestResidual(const T* _align, const U* _ref, int n, bool setTransRot = false, bool* _suc = NULL);
+
+    /* Slides the n-point reference _ref along the packed span coords, in steps
+     * of step points, and stores in res[w] the optimal superposition residual
+     * of _ref onto the n points starting at point w*step, for each of the
+     * numWindows windows. Window centroids and squared norms are updated
+     * incrementally, the reference is centered only once, and windows are
+     * solved in blocks with the batch QCP kernel below. If ok is given,
+     * windows with ok false are skipped (their res entries are left as they
+     * are); if cents is given, it receives the packed centroids of all windows.
+     * Steps of 1 and 4 points (CA-only and full-backbone residues) run through
+     * kernels specialized at compile time; other steps use a generic one. */
+    template <class T>
+    void windowResiduals(const mstreal* _ref, int n, const T* coords, int numWindows, int step, vector<mstreal>& res, vector<mstreal>* cents = NULL, const vector<bool>* ok = NULL);
+
+    /* Batch QCP: optimal-superposition RMSDs (or residuals, if residuals is
+     * true) of the n-point packed reference _ref against numCands candidates,
+     * each given as a pointer to n packed points, written into out. Candidates
+     * are processed qcpLanes at a time, with inner products accumulated in
+     * vector registers when compiled with AVX (scalar otherwise) and the
+     * characteristic polynomial solved on all lanes together. */
+    template <class T>
+    void qcpRMSDBatch(const mstreal* _ref, int n, const T* const* cands, int numCands, mstreal* out, bool residuals = false);
+    static const int qcpLanes = 4;
+
     // in-place RMSD (no transformations)
     static mstreal rmsd(const vector<Atom*>& A, const vector<Atom*>& B);
     static mstreal rmsd(const Structure& A, const Structure& B);
@@ -693,6 +1047,7 @@ class RMSDCalculator {
     static mstreal rmsdCutoff(const vector<int>& L, mstreal rmsdMax = 1.1, mstreal L0 = 15);
     /* Takes every chain in S to be independent. */
     static mstreal rmsdCutoff(const Structure& S, mstreal rmsdMax = 1.1, mstreal L0 = 15);
+    static mstreal rmsdCutoff(const StructureView& V, mstreal rmsdMax = 1.1, mstreal L0 = 15);
     /* I stores residue indices of residues in each chain, so that non-contiguous
      * residues within a chain can be treated. Residues in different chains are
      * still assumed to be independent. */
@@ -715,6 +1070,34 @@ class RMSDCalculator {
  protected:
     // implemetation of Kabsch algoritm for optimal superposition
     bool Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_ref, int mode);
+    template <class T, class U>
+    bool Kabsch(const T& _align, const U& _ref, int n, int mode);
+    // the part of Kabsch after centering: given centroids, covariance r and e0
+    bool kabschSolve(const mstreal xc[3], const mstreal yc[3], mstreal r[3][3], mstreal e0, int n, int mode);
+
+    // pieces of the batch QCP kernel: centering of the reference (returns its
+    // inner product), the correlation matrices of one block of candidates
+    // against the centered reference, and the largest key-matrix eigenvalue of
+    // every lane given the inner-product sums E0 = GA + GB
+    static mstreal qcpCenter(const mstreal* _ref, int n, vector<mstreal>& ref);
+    // G > 1 accumulates G points per iteration (n must be a multiple of G)
+    template <int G, class T>
+    static void qcpCovarianceBlock(const mstreal* ref, int n, const T* const* c, mstreal S[9][qcpLanes]);
+    static void qcpEigenBlock(const mstreal S[9][qcpLanes], const mstreal* E0, mstreal* L);
+
+    /* windowResiduals with the step fixed at compile time when STEP > 0, so
+     * the window slide and the per-residue covariance loops fully unroll (the
+     * public version dispatches here on step; STEP = 0 is the generic case) */
+    template <int STEP, class T>
+    void windowResidualsKernel(const mstreal* _ref, int n, const T* coords, int numWindows, int step, vector<mstreal>& res, vector<mstreal>* cents, const vector<bool>* ok);
+
+    // uniform coordinate access for the above, over atoms or raw spans
+    static mstreal coorX(const vector<Atom*>& A, int i) { return A[i]->getX(); }
+    static mstreal coorY(const vector<Atom*>& A, int i) { return A[i]->getY(); }
+    static mstreal coorZ(const vector<Atom*>& A, int i) { return A[i]->getZ(); }
+    template <class T> static mstreal coorX(const T* A, int i) { return A[3*i]; }
+    template <class T> static mstreal coorY(const T* A, int i) { return A[3*i + 1]; }
+    template <class T> static mstreal coorZ(const T* A, int i) { return A[3*i + 2]; }
 
  private:
     mstreal _res;
@@ -847,13 +1230,261 @@ class DecoratedProximitySearch : public ProximitySearch {
     vector<T> tags;
 };
 
+/* A static cell list for fast range queries over a fixed set of points. The
+ * points are sorted by cell into one contiguous coordinate array, with a
+ * prefix sum over cells giving where each cell starts, so a row of cells along
+ * z is a single contiguous range. Unlike ProximitySearch, points can not be
+ * added after construction, and queries append to a caller-provided buffer
+ * (which can be reused between queries) or call a function for each point
+ * found, rather than returning a freshly allocated vector. Point indices are
+ * in the order in which the points were given; results come in no particular
+ * order. */
+class CellList {
+  public:
+    CellList() : cellSize(1), numPoints(0) { lo[0] = lo[1] = lo[2] = 0; dim[0] = dim[1] = dim[2] = 0; }
+    /* cellSize is best on the order of typical query distances. Tags, if given,
+     * are reported instead of point indices by queries with byTag = true. */
+    CellList(const vector<Atom*>& atoms, mstreal cellSize, const vector<int>* tags = NULL);
+    CellList(const vector<mstreal>& coords, mstreal cellSize, const vector<int>* tags = NULL); // flat x, y, z coordinates
+    void build(const mstreal* coords, int n, mstreal cellSize, const int* tags = NULL);
+
+    int pointSize() const { return numPoints; }
+    Point3 getPoint(int i) const { const mstreal* c = &coor[3*position[i]]; return Point3(c[0], c[1], c[2]); }
+    int getPointTag(int i) const { return tags.empty() ? i : tags[i]; }
+
+    /* Calls f(i, d2) for every point i with squared distance d2 from c in the
+     * range [dmin^2, dmax^2]. If f returns a bool, returning false stops the
+     * search (and forEachWithin returns false); f may also return nothing. */
+    template <class F>
+    bool forEachWithin(const Point3& c, mstreal dmin, mstreal dmax, F f) const;
+
+    // appends indices (or tags) of the points within [dmin, dmax] of c; returns the number appended
+    int pointsWithin(const Point3& c, mstreal dmin, mstreal dmax, vector<int>& list, bool byTag = false) const;
+    bool anyWithin(const Point3& c, mstreal dmin, mstreal dmax) const;
+    int numPointsWithin(const Point3& c, mstreal dmin, mstreal dmax) const;
+
+    /* Batch query: the points within [dmin, dmax] of centers[q] are written to
+     * list[offsets[q]] through list[offsets[q+1] - 1]. Centers are processed in
+     * parallel with numThreads threads. */
+    void pointsWithin(const vector<Point3>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+    void pointsWithin(const vector<Atom*>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+
+  private:
+    friend class KDTree;
+
+    // calls f, treating a void return as a request to keep going
+    template <class F>
+    static bool visit(F& f, int i, mstreal d2, typename enable_if<is_void<decltype(f(i, d2))>::value>::type* = NULL) { f(i, d2); return true; }
+    template <class F>
+    static bool visit(F& f, int i, mstreal d2, typename enable_if<!is_void<decltype(f(i, d2))>::value>::type* = NULL) { return f(i, d2); }
+
+    mstreal lo[3], cellSize;
+    int dim[3], numPoints;
+    vector<int> cellStart;  // points of cell c are at positions [cellStart[c], cellStart[c+1]), with cells ordered x, y, z (z fastest)
+    vector<mstreal> coor;   // coordinates of points, by position
+    vector<int> pointAt;    // original index of the point at each position
+    vector<int> position;   // position of each original point
+    vector<int> tags;
+};
+
+template <class F>
+bool CellList::forEachWithin(const Point3& c, mstreal dmin, mstreal dmax, F f) const {
+  if (numPoints == 0) return true;
+  int clo[3], chi[3];
+  for (int d = 0; d < 3; d++) {
+    mstreal a = (c[d] - dmax - lo[d]) / cellSize, b = (c[d] + dmax - lo[d]) / cellSize;
+    if ((b < 0) || (a >= dim[d])) return true;
+    clo[d] = (a < 0) ? 0 : (int) a;
+    chi[d] = (b >= dim[d]) ? dim[d] - 1 : (int) b;
+  }
+  mstreal dmin2 = dmin*dmin, dmax2 = dmax*dmax;
+  for (int i = clo[0]; i <= chi[0]; i++) {
+    for (int j = clo[1]; j <= chi[1]; j++) {
+      // cells along z are contiguous, so this row of cells is one range of points
+      int row = (i*dim[1] + j)*dim[2];
+      int from = cellStart[row + clo[2]], to = cellStart[row + chi[2] + 1];
+      const mstreal* p = coor.data() + 3*from;
+      for (int k = from; k < to; k++, p += 3) {
+        mstreal dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+        mstreal d2 = dx*dx + dy*dy + dz*dz;
+        if ((d2 <= dmax2) && (d2 >= dmin2)) {
+          if (!visit(f, pointAt[k], d2)) return false;
+        }
+      }
+    }
+  }
+  return true;
+}
+
+
+/* A k-d tree over 3D points, for k-nearest-neighbor queries and for range
+ * queries over point sets that are too sparse or uneven for a CellList. Points
+ * are kept in a balanced tree with small leaf buckets, their coordinates stored
+ * contiguously in tree order. Points can also be added, moved, and removed after
+ * construction (e.g., for point sets that change along a trajectory): added and
+ * moved points go into a small buffer that is searched linearly, and the tree
+ * is rebuilt once the buffer and the removed points become a sizable fraction
+ * of it. Point indices are assigned in the order in which points are given or
+ * added, and do not change; results of range queries are in no particular
+ * order, while nearest-neighbor results are by increasing distance. */
+class KDTree {
+  public:
+    KDTree() { numRemoved = 0; numStale = 0; }
+    KDTree(const vector<Atom*>& atoms, const vector<int>* tags = NULL);
+    KDTree(const vector<Point3>& points, const vector<int>* tags = NULL);
+
+    int addPoint(const Point3& p, int tag = -1); // returns the index of the new point; the tag defaults to the index
+    void movePoint(int i, const Point3& p);
+    void removePoint(int i);
+    void rebuild(); // rebuilds the tree over all current points (done automatically as needed)
+
+    int pointSize() const { return points.size(); } // including removed points
+    int numActivePoints() const { return points.size() - numRemoved; }
+    bool isRemoved(int i) const { return removed[i]; }
+    const Point3& getPoint(int i) const { return points[i]; }
+    int getPointTag(int i) const { return tags[i]; }
+
+    /* Appends to list the indices (or tags) of the k points nearest to c, closest
+     * first and breaking ties by index, and optionally their squared distances to
+     * dist2. Fewer than k points are appended if there are fewer points or if
+     * some are farther than dmax. Returns the number appended. */
+    int nearest(const Point3& c, int k, vector<int>& list, vector<mstreal>* dist2 = NULL, bool byTag = false, mstreal dmax = numeric_limits<mstreal>::max()) const;
+    int nearest(const Point3& c) const; // the index of the nearest point, or -1 if there are none
+
+    // same semantics as the corresponding CellList queries
+    template <class F>
+    bool forEachWithin(const Point3& c, mstreal dmin, mstreal dmax, F f) const;
+    int pointsWithin(const Point3& c, mstreal dmin, mstreal dmax, vector<int>& list, bool byTag = false) const;
+    bool anyWithin(const Point3& c, mstreal dmin, mstreal dmax) const;
+    int numPointsWithin(const Point3& c, mstreal dmin, mstreal dmax) const;
+
+    /* Batch queries: results for centers[q] are in list[offsets[q]] through
+     * list[offsets[q+1] - 1]. Centers are processed with numThreads threads. */
+    void pointsWithin(const vector<Point3>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+    void pointsWithin(const vector<Atom*>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+    void nearest(const vector<Point3>& centers, int k, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+    void nearest(const vector<Atom*>& centers, int k, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const;
+
+  private:
+    struct node {
+      int begin, end;      // range of tree slots in the sub-tree
+      int left, right;     // children (-1 for leaves)
+      mstreal lo[3], hi[3]; // bounding box of the sub-tree's points
+    };
+    static const int leafSize = 8;
+
+    int buildNode(int begin, int end);
+    void toBuffer(int i);
+    void maybeRebuild();
+    mstreal boxDistance2(const node& n, const Point3& c) const;
+    mstreal boxFarDistance2(const node& n, const Point3& c) const;
+    void nearestInNode(int ni, const Point3& c, int k, vector<pair<mstreal, int> >& heap, mstreal& worst2) const;
+    void offerNearest(const Point3& c, int i, int k, vector<pair<mstreal, int> >& heap, mstreal& worst2) const;
+
+    vector<Point3> points;   // current coordinates of all points, by index
+    vector<int> tags;
+    vector<bool> removed;
+    vector<int> slot;        // tree slot of each point, or -1 if not in the tree
+    vector<int> bufferPos;   // position of each point in the buffer, or -1 if not in it
+    vector<node> nodes;
+    vector<mstreal> coor;    // coordinates of points by tree slot
+    vector<int> slotPoint;   // index of the point in each tree slot, or -1 if it has since moved or been removed
+    vector<int> buffer;      // points added or moved since the tree was last built
+    int numRemoved, numStale;
+};
+
+template <class F>
+bool KDTree::forEachWithin(const Point3& c, mstreal dmin, mstreal dmax, F f) const {
+  mstreal dmin2 = dmin*dmin, dmax2 = dmax*dmax;
+  if (!nodes.empty()) {
+    int stack[128], top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+      const node& n = nodes[stack[--top]];
+      if ((boxDistance2(n, c) > dmax2) || (boxFarDistance2(n, c) < dmin2)) continue;
+      if (n.left >= 0) { stack[top++] = n.left; stack[top++] = n.right; continue; }
+      const mstreal* p = coor.data() + 3*n.begin;
+      for (int k = n.begin; k < n.end; k++, p += 3) {
+        if (slotPoint[k] < 0) continue;
+        mstreal dx = p[0] - c[0], dy = p[1] - c[1], dz = p[2] - c[2];
+        mstreal d2 = dx*dx + dy*dy + dz*dz;
+        if ((d2 <= dmax2) && (d2 >= dmin2)) {
+          if (!CellList::visit(f, slotPoint[k], d2)) return false;
+        }
+      }
+    }
+  }
+  for (int b = 0; b < buffer.size(); b++) {
+    mstreal d2 = points[buffer[b]].distance2(c);
+    if ((d2 <= dmax2) && (d2 >= dmin2)) {
+      if (!CellList::visit(f, buffer[b], d2)) return false;
+    }
+  }
+  return true;
+}
+
+/* Range search over a fixed set of points that picks between a CellList and a
+ * KDTree, depending on how densely the points fill their bounding box at the
+ * scale of the typical query distance: a grid is best when most of its cells
+ * are occupied, while a tree is best for sparse or clumpy point sets, where a
+ * grid would be mostly empty cells. */
+class RangeSearch {
+  public:
+    RangeSearch(const vector<Atom*>& atoms, mstreal queryDist, const vector<int>* tags = NULL);
+    RangeSearch(const vector<Point3>& points, mstreal queryDist, const vector<int>* tags = NULL);
+    bool usesCellList() const { return useGrid; }
+    int pointSize() const { return useGrid ? grid.pointSize() : tree.pointSize(); }
+
+    template <class F>
+    bool forEachWithin(const Point3& c, mstreal dmin, mstreal dmax, F f) const {
+      return useGrid ? grid.forEachWithin(c, dmin, dmax, f) : tree.forEachWithin(c, dmin, dmax, f);
+    }
+    int pointsWithin(const Point3& c, mstreal dmin, mstreal dmax, vector<int>& list, bool byTag = false) const {
+      return useGrid ? grid.pointsWithin(c, dmin, dmax, list, byTag) : tree.pointsWithin(c, dmin, dmax, list, byTag);
+    }
+    bool anyWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+      return useGrid ? grid.anyWithin(c, dmin, dmax) : tree.anyWithin(c, dmin, dmax);
+    }
+    int numPointsWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+      return useGrid ? grid.numPointsWithin(c, dmin, dmax) : tree.numPointsWithin(c, dmin, dmax);
+    }
+    void pointsWithin(const vector<Point3>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const {
+      if (useGrid) grid.pointsWithin(centers, dmin, dmax, offsets, list, byTag, numThreads);
+      else tree.pointsWithin(centers, dmin, dmax, offsets, list, byTag, numThreads);
+    }
+    void pointsWithin(const vector<Atom*>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag = false, int numThreads = 1) const {
+      if (useGrid) grid.pointsWithin(centers, dmin, dmax, offsets, list, byTag, numThreads);
+      else tree.pointsWithin(centers, dmin, dmax, offsets, list, byTag, numThreads);
+    }
+
+  private:
+    void init(const vector<Point3>& points, mstreal queryDist, const vector<int>* tags);
+
+    bool useGrid;
+    CellList grid;
+    KDTree tree;
+};
 
 class Clusterer {
   public:
-    Clusterer(bool _flag = true) { optimAlign = _flag; }
+    Clusterer(bool _flag = true) { optimAlign = _flag; numThreads = 1; indexed = true; }
     void optimizeAlignments(bool _flag) { optimAlign = _flag; }
     bool getOptimizeAlignments() { return optimAlign; }
 
+    /* RMSD computations are spread over this many threads. */
+    void setNumThreads(int _n) { numThreads = (_n < 1) ? 1 : _n; }
+    int getNumThreads() const { return numThreads; }
+
+    /* By default, the all-by-all step of greedy clustering finds the neighbors
+     * of each unit once, with a vantage-point tree over RMSD pruning the pairs
+     * that the triangle inequality shows to be too far apart, and then picks
+     * clusters by keeping the neighbor counts up to date as units are taken.
+     * This gives the same clusters as recomputing all RMSDs among the remaining
+     * units for every cluster (done if indexing is turned off), at a small
+     * fraction of the cost. */
+    void setIndexed(bool _indexed) { indexed = _indexed; }
+    bool isIndexed() const { return indexed; }
+
     /* Will greedy cluster the given set of units (must all have the same number of atoms),
      * using the given RMSD cutoff, while making sure that no more than ~Nmax x Nmax RMSD
      * computations are done per iteration. So, if the number of units is below Nmax, a
@@ -874,12 +1505,22 @@ class Clusterer {
     // computed RMSDs is in a good state (so don't want external calls)
     vector<vector<int> > greedyClusterBruteForce(const vector<vector<Atom*> >& units, set<int> remIndices, mstreal rmsdCut, int nClusts = -1);
     vector<int> elementsWithin(const vector<vector<Atom*> >& units, set<int>& remIndices, const vector<Atom*>& fromUnit, mstreal rmsdCut);
+    // same, but with the units packed into pointers to n-point coordinate spans
+    // (needs optimal alignment), so that RMSDs are computed in batches
+    vector<int> elementsWithin(const vector<const mstreal*>& packed, int n, set<int>& remIndices, int fromIdx, mstreal rmsdCut);
     set<int> randomSubsample(set<int>& indices, int N);
 
+    /* Neighbor lists (within the cutoff, by ascending index, along with RMSDs
+     * from the unit whose list it is) of all units in indices, found with a
+     * vantage-point tree. */
+    void findNeighbors(const vector<vector<Atom*> >& units, const vector<const mstreal*>& packed, int n, const vector<int>& indices, mstreal rmsdCut, vector<vector<pair<int, mstreal> > >& neighbors);
+    vector<vector<int> > greedyClusterIndexed(const vector<vector<Atom*> >& units, const vector<const mstreal*>& packed, int n, const set<int>& remIndices, mstreal rmsdCut, int nClusts);
+
   private:
     // won't cache for now (need careful memory management)
     map<int, map<int, mstreal > > coputedRMSDs;
-    bool optimAlign;
+    bool optimAlign, indexed;
+    int numThreads;
     RMSDCalculator rCalc;
 };
 
@@ -1034,6 +1675,54 @@ class MstTimer {
     chrono::high_resolution_clock::duration elapsed;
 };
 
+/* A registry of named profiling counters, aggregated over all threads. Each
+ * entry accumulates the number of calls and the total (and maximal) time spent
+ * in scopes with that name, plus any counts added to it. Profiling is off by
+ * default, in which case a scope costs a single flag check. It is turned on by
+ * setting the environment variable MST_PROFILE, or by passing --profile to any
+ * program that parses its options with MstOptions, to the name of the file to
+ * dump the entries into upon exit (as CSV if the name ends with ".csv", and as
+ * JSON otherwise; "-" means standard error). Names are best kept to
+ * "Class::stage", so that dumps from different releases or machines line up. */
+class MstProfiler {
+  public:
+    /* Times the enclosing scope, e.g.: MstProfiler::scope prof("FASST::search"); */
+    class scope {
+      public:
+        scope(const char* _name) {
+          name = _name;
+          if (MstProfiler::isEnabled()) begin = chrono::steady_clock::now();
+          else name = NULL;
+        }
+        ~scope() { if (name != NULL) MstProfiler::addTime(name, chrono::duration<double>(chrono::steady_clock::now() - begin).count()); }
+
+      private:
+        const char* name;
+        chrono::steady_clock::time_point begin;
+    };
+
+    static bool isEnabled() { return enabled; }
+    // starts profiling, with the entries to be written to the given file upon exit (if not empty)
+    static void enable(const string& outFile = "");
+    static void disable() { enabled = false; }
+    static void addTime(const string& name, double seconds);
+    static void addCount(const string& name, long n = 1);
+    static void reset();
+    static void writeJSON(ostream& os);
+    static void writeCSV(ostream& os);
+    static void write(); // writes to the file given upon enabling
+
+  private:
+    struct entry {
+      long calls = 0, count = 0;
+      double total = 0, max = 0;
+    };
+    static atomic<bool> enabled;
+    static mutex lock;
+    static map<string, entry> entries;
+    static string outFile;
+};
+
 /* Utilities class, with a bunch of useful static functions, is defined outside of the MST namespace because:
  * 1) it really represents a different beast, not an MST type
  * 2) some of its functions (like assert) are likely to clash with function names in other project
@@ -1045,6 +1734,7 @@ class MstUtils {
     static void fileToArray(const string& _filename, vector<string>& lines); // reads lines from the file and appends them to the given vector
     static vector<string> fileToArray(const string& _filename) { vector<string> lines; fileToArray(_filename, lines); return lines; }
     static FILE* openFileC (const char* filename, const char* mode, string from = "");
+    static void fileToString(const string& filename, string& contents, string from = ""); // reads the whole file, decompressing it if gzipped
     static vector<string> trim(const vector<string>& strings, string delimiters = " \t\n\v\f\r");
     static string trim(const string& str, string delimiters = " \t\n\v\f\r");
     static void warn(const string& message, string from = "");
@@ -1073,6 +1763,12 @@ class MstUtils {
     static string readNullTerminatedString(fstream& ifs);
     static string getDate();
     static vector<pair<int, int> > splitTasks(int numTasks, int numJobs);
+    /* Runs task(i, w) for every i in [0, numTasks) using up to numThreads
+     * threads, where w is the index of the worker running the task. Tasks are
+     * handed out one at a time, so uneven tasks still balance. An exception
+     * thrown by any task is re-thrown in the calling thread after all workers
+     * finish. With a single thread, tasks run in order in the calling thread. */
+    static void parallelFor(int numTasks, int numThreads, const function<void(int, int)>& task);
     static void setSignalHandlers();
     static void errorHandler(int sig);
 
@@ -1174,7 +1870,11 @@ class MstUtils {
     static void readBin(istream& ifs, MST::Structure& S) { S.readData(ifs); }
 
     private:
-      static mt19937 mt; // A Mersenne Twister pseudo-random generator of 32-bit numbers with a state size of 19937 bits.
+      // A Mersenne Twister pseudo-random generator of 32-bit numbers with a state
+      // size of 19937 bits. Each thread has its own, so that threads can draw
+      // random numbers without racing (and can be seeded to give independent,
+      // reproducible streams).
+      static thread_local mt19937 mt;
 };
 
 template <class F>
@@ -14,6 +14,9 @@
 #include "mstoptions.h"
 #include "mstmagic.h"
 #include "mstsystem.h"
+#include "mstlocks.h"
+#include <thread>
+#include <deque>
 
 using namespace std;
 using namespace MST;
@@ -47,7 +50,9 @@ void numberResidues(Structure& S, const vector<int>& resIdx) {
   for (int k = 0; k < S.residueSize(); k++) S.getResidue(k).setNum(resIdx[k]);
 }
 
-vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& fragResIdx, int need = 5, const vector<int>& centIdx = vector<int>()) {
+/* Match structures are cut out of the database through owner, if given (e.g.,
+ * when C is a searcher borrowing the database of owner), or C otherwise. */
+vector<Structure*> getMatches(FASST& C, const StructureView& frag, const vector<int>& fragResIdx, int need = 5, const vector<int>& centIdx = vector<int>(), FASST* owner = NULL) {
   vector<Structure*> matchStructures;
   if (need == 0) return matchStructures;
   C.setQuery(frag, false);
@@ -58,11 +63,10 @@ vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& frag
 
   // add sequence constraints, as needed
   fasstSeqConstSimple seqConst(centIdx.size());
-  Structure splitQuery = C.getQuery();
   for (int i = 0; i < centIdx.size(); i++) {
-    if (!SeqTools::isUnknown(frag.getResidue(centIdx[i]).getName())) {
-      const Residue& res = splitQuery.getResidue(centIdx[i]);
-      seqConst.addConstraint(res.getChain()->getIndex(), res.getResidueIndexInChain(), {res.getName()});
+    const Residue& res = frag.getResidue(centIdx[i]);
+    if (!SeqTools::isUnknown(res.getName())) {
+      seqConst.addConstraint(frag.chainIndex(centIdx[i]), frag.residueIndexInChain(centIdx[i]), {res.getName()});
     }
   }
   if (seqConst.hasConstraints()) C.options().setSequenceConstraints(seqConst);
@@ -72,7 +76,7 @@ vector<Structure*> getMatches(FASST& C, Structure& frag, const vector<int>& frag
   while (true) {
     fasstSolutionSet matches = C.search();
     for (auto it = matches.begin(); (it != matches.end()) && (matchStructures.size() != need); ++it) {
-      matchStructures.push_back(new Structure(C.getMatchStructure(*it, false, FASST::matchType::REGION)));
+      matchStructures.push_back(new Structure(((owner == NULL) ? C : *owner).getMatchStructure(*it, false, FASST::matchType::REGION)));
       Structure& match = *(matchStructures.back());
       if (!RotamerLibrary::hasFullBackbone(match)) {
         delete(matchStructures.back()); matchStructures.pop_back();
@@ -172,6 +176,65 @@ bool sameSize(Structure& A, Structure& B) {
   return true;
 }
 
+/* A bounded, closable queue, connecting TERM extraction to the search workers
+ * within a cycle: push() waits while the queue is full, and pop() waits while
+ * it is empty and open (returning false once it is closed and drained). */
+template <class T>
+class boundedQueue {
+  public:
+    boundedQueue(int _capacity) : capacity(_capacity), closed(false) {}
+    void push(const T& x) {
+      unique_lock<mutex> lk(m);
+      notFull.wait(lk, [&]() { return q.size() < capacity; });
+      q.push_back(x);
+      notEmpty.notify_one();
+    }
+    bool pop(T& x) {
+      unique_lock<mutex> lk(m);
+      notEmpty.wait(lk, [&]() { return !q.empty() || closed; });
+      if (q.empty()) return false;
+      x = q.front(); q.pop_front();
+      notFull.notify_one();
+      return true;
+    }
+    void close() {
+      lock_guard<mutex> lk(m);
+      closed = true;
+      notEmpty.notify_all();
+    }
+
+  private:
+    int capacity;
+    bool closed;
+    deque<T> q;
+    mutex m;
+    condition_variable notEmpty, notFull;
+};
+
+// a TERM of the current structure, and the database matches found for it
+struct termJob {
+  vector<int> centers;        // indices of the central residue(s) in the current structure
+  int pm;
+  StructureView frag;         // a view of the current structure, which stays put while TERMs are searched for
+  vector<int> fragResIdx, centIdx;
+  vector<Structure*> matches;
+  bool reused;
+};
+
+// the matches a TERM had in a previous cycle, with the TERM as it was then
+struct termRecord {
+  Structure frag;
+  vector<Structure> matches;
+};
+
+// TERMs are identified across cycles by their central residues and residue content
+vector<int> termKey(const termJob& job) {
+  vector<int> key = job.centers;
+  key.push_back(-1);
+  key.insert(key.end(), job.fragResIdx.begin(), job.fragResIdx.end());
+  return key;
+}
+
 int main(int argc, char** argv) {
   // TODO: debug Neilder-Meid optimization by comparing a simple case with Matlab
   // TODO: enable a setting in Fuser, whereby fully overlapping segments are scored
@@ -197,11 +260,19 @@ int main(int argc, char** argv) {
   op.addOption("us", "a selection string for residues to mark as having unknown identity (i.e., their identity will not matter if accounting for sequence).");
   op.addOption("rad", "compactness radius. Default will be based on protein length.");
   op.addOption("c", "path to a FASST cache file to use for initializing the cache.");
-  op.addOption("w", "flag; if specified, the FASST cache will be periodically updated.");
+  op.addOption("w", "flag; if specified, new searches are added to the FASST cache file given with --c as they are done (the file is created if needed, or converted to a log if it was written by an older version). Any number of jobs can share the same file.");
+  op.addOption("lockDir", "directory in which to keep the lock that jobs sharing the FASST cache file take while reading or compacting it (default is /tmp, which only coordinates jobs on the same host; use a directory on a shared file system for jobs on different hosts).");
+  op.addOption("lockHost", "if given, the lock is instead kept on this host and reached with ssh (slow; for clusters without a shared file system).");
   op.addOption("app", "flag; if specified, will append to the output PDB file (e.g., for the purpose of accumulating a trajectory from multiple runs).");
   op.addOption("dyn", "use dynamics rather than optimization to search for a solution. If a number is specified, it is interpreted as the length of the dynamics simulation (relative to the length of a typical minimization run); default is 100.");
+  op.addOption("btraj", "flag; with --dyn, stream dynamics snapshots of all cycles, as they are produced, to <o>.dyn.trj in a compact binary format (see trajToPDB), rather than keeping the last run in memory and writing it to <o>.dyn.pdb. With --app, snapshots are appended to an existing <o>.dyn.trj.");
+  op.addOption("rep", "with --dyn, run this many replicas at once, at temperatures from 1 to --rkT (in units of kT, geometrically spaced), with replica exchange (default is 1). The threads given with --j advance the replicas in parallel. Only the replica at kT = 1 is used and output.");
+  op.addOption("rkT", "with --rep, the temperature (in units of kT) of the hottest replica (default is 4).");
   op.addOption("alt", "alternative conformation PDB file (must have the same length/topology as the starting conformation file). If given, for each TERM the corresponding segment of structure will be added as a \"match\".");
   op.addOption("orig", "If given, each TERM's original conformation (from the starting structure) will be explicitly added as a \"match\".");
+  op.addOption("j", "number of threads with which to score fuser restraints within each evaluation (default is 1). Worthwhile for large structures.");
+  op.addOption("sj", "number of threads searching for TERM matches (default is 1). TERMs are extracted (and contacts computed) while earlier ones are being searched for.");
+  op.addOption("reuse", "if given, a TERM seen in the previous cycle whose backbone has since moved by no more than this RMSD (in Angstrom) takes its matches from that cycle (superimposed onto the TERM) rather than being searched for again.");
   op.addOption("v", "set verbose output flag.");
   op.addOption("cycCheck","flag; if given, will check whether the fused structure has converged and will potentially quick early. Convergence is established by comparing the RMSD resultant from the current cycle to the average RMSD from the first 10 cycles. If the latter is less than a third of the former, the cycling is said to have converged.");
   if (op.isGiven("f") && op.isGiven("fs")) MstUtils::error("only one of --f or --fs can be given!");
@@ -209,13 +280,14 @@ int main(int argc, char** argv) {
   op.setOptions(argc, argv);
   RMSDCalculator rc;
   Structure I(op.getString("p")), A;
+  trajectoryWriter* dynOut = (op.isGiven("dyn") && op.isGiven("btraj")) ? new trajectoryWriter(op.getString("o") + ".dyn.trj", 0.001, 100, op.isGiven("app")) : NULL;
   vector<int> fixed;
   if (op.isGiven("f")) {
     fixed = MstUtils::splitToInt(op.getString("f"));
     cout << "fix specification gave " << fixed.size() << " residues, fixing..." << endl;
   }
+  selector sel(I); // shared by the selections below (I does not change in between)
   if (op.isGiven("fs")) {
-    selector sel(I);
     vector<Residue*> fixedResidues = sel.selectRes(op.getString("fs"));
     cout << "fix selection gave " << fixedResidues.size() << " residues, fixing..." << endl;
     map<Residue*, int> indices = MstUtils::indexMap(I.getResidues());
@@ -226,7 +298,6 @@ int main(int argc, char** argv) {
   // define any custom TERMs
   vector<Structure> customTERMs(op.timesGiven("frag"));
   for (int fi = 0; fi < op.timesGiven("frag"); fi++) {
-    selector sel(I);
     vector<Residue*> customResidues = sel.selectRes(op.getString("frag", "", fi));
     cout << "defining custom TERM " << fi << " with " << customResidues.size() << " residues..." << endl;
     customTERMs[fi] = Structure(customResidues);
@@ -238,6 +309,8 @@ int main(int argc, char** argv) {
   if (op.isGiven("s") && (op.isGiven("c") || op.isGiven("w"))) MstUtils::error("cannot specify --s with caching");
   fasstCache withCache((I.residueSize() - fixed.size())*10); FASST woCache;
   string tag = "TERMify-" + MstSys::getUserName();
+  if (op.isGiven("lockHost")) MstLocks::setBackend(shared_ptr<lockBackend>(new sshLockBackend(op.getString("lockHost"))));
+  else if (op.isGiven("lockDir")) MstLocks::setBackend(shared_ptr<lockBackend>(new fileLockBackend(op.getString("lockDir"))));
   bool useCache = op.isGiven("c") || op.isGiven("w") || !op.isGiven("s");
   FASST& search = useCache ? withCache : woCache;
   if (useCache) {
@@ -246,12 +319,25 @@ int main(int argc, char** argv) {
     if (op.isGiven("c") && op.getString("c").empty()) MstUtils::error("--c must be a valid file path");
     // read initial cache
     if (op.isGiven("c")) {
-      if (op.getString("c").empty()) MstUtils::error("--c must be a valid file path");
-      if (MstSys::fileExists(op.getString("c"))) MstUtils::error("--c is not an existing file");
-      MstSys::getNetLock(tag, true);
-      cout << "reading cache from " << op.getString("c") << "... " << endl;
-      withCache.read(op.getString("c"));
-      MstSys::releaseNetLock(tag);
+      string cacheFile = op.getString("c");
+      if (cacheFile.empty()) MstUtils::error("--c must be a valid file path");
+      if (!op.isGiven("w") && !MstSys::fileExists(cacheFile)) MstUtils::error("--c is not an existing file");
+      MstLocks::getLock(tag, !op.isGiven("w"));
+      bool isLog = !MstSys::fileExists(cacheFile) || fasstCacheStore::isLogFile(cacheFile);
+      if (!isLog) {
+        // a cache written in one go (by cFASST::write); when updating, convert
+        // it to a log that this and other jobs can append to
+        cout << "reading cache from " << cacheFile << "... " << endl;
+        withCache.read(cacheFile);
+        if (op.isGiven("w")) withCache.getCacheStore()->writeLog(cacheFile);
+        isLog = op.isGiven("w");
+      }
+      if (isLog) {
+        cout << "attaching to cache log " << cacheFile << "... " << endl;
+        withCache.getCacheStore()->attachLog(cacheFile, op.isGiven("w"));
+        cout << "cache has " << withCache.getCacheStore()->size() << " entries" << endl;
+      }
+      MstLocks::releaseLock(tag);
     }
   }
   if (op.isGiven("d")) {
@@ -266,7 +352,6 @@ int main(int argc, char** argv) {
   }
 
   if (op.isGiven("us")) {
-    selector sel(I);
     vector<Residue*> unkResidues = sel.selectRes(op.getString("us"));
     cout << "unknown sequence selection gave " << unkResidues.size() << " residues, marking unknown..." << endl;
     for (int i = 0; i < unkResidues.size(); i++) unkResidues[i]->setName("UNK");
@@ -281,7 +366,7 @@ int main(int argc, char** argv) {
   else search.setRedundancyCut(0.5);
   RotamerLibrary RL(op.getString("rLib"));
   int pmSelf = 2, pmPair = 1;
-  int Ni = 1000, lastWriteTime;
+  int Ni = 1000, lastWriteTime = time(NULL);
   fusionOutput bestScore, currScore;
   fstream out, shellOut, dummy;
   contactList L;
@@ -331,6 +416,19 @@ int main(int argc, char** argv) {
   out << "MODEL " << 0 << endl; S.writePDB(out); out << "ENDMDL" << endl;
   //create a vector of RMSD_final of each cycle
   vector<mstreal> cyc_rmsd;
+
+  // TERM search workers each have their own searcher over the database
+  int numSearchThreads = op.getInt("sj", 1);
+  if (numSearchThreads < 1) MstUtils::error("--sj must be a positive integer");
+  vector<FASST*> searchers(numSearchThreads, &search);
+  for (int w = 1; w < numSearchThreads; w++) {
+    searchers[w] = search.newSearcher();
+    if (search.isRedundancyPropertySet()) searchers[w]->setRedundancyProperty(search.getRedundancyProperty());
+    else searchers[w]->setRedundancyCut(search.getRedundancyCut());
+    searchers[w]->setVerbose(search.isVerbose());
+  }
+  mstreal reuseTol = op.getReal("reuse", -1);
+  map<vector<int>, termRecord> prevTERMs;
   for (int c = 0; c < Ncyc; c++) {
     cout << "Cycle " << c+1 << "..." << endl;
     if (c == 0) {
@@ -338,42 +436,70 @@ int main(int argc, char** argv) {
     } else if (c == Ncyc - 1) {
       MstUtils::openFile(shellOut, op.getString("o") + ".shell.pdb", ios::out);
     }
-    if (op.isGiven("c") && op.isGiven("w")) {
-      if ((c == 0) || (time(NULL) - lastWriteTime > 5*60)) { // write every five minutes or so
-        cout << "dumping cache to " << op.getString("c") << "... " << endl;
-        MstSys::getNetLock(tag);
-        withCache.write(op.getString("c"));
-        MstSys::releaseNetLock(tag);
+    if (useCache && withCache.getCacheStore()->isLogAttached()) {
+      // new searches are appended to the log as they are done, so only pick up
+      // what other jobs have added, and occasionally drop stale entries
+      int n = withCache.getCacheStore()->syncLog();
+      if (n > 0) cout << "read " << n << " new cache entries from " << op.getString("c") << endl;
+      if (op.isGiven("w") && (time(NULL) - lastWriteTime > 5*60) && withCache.getCacheStore()->logNeedsCompaction()) {
+        cout << "compacting cache log " << op.getString("c") << "... " << endl;
+        MstLocks::getLock(tag);
+        withCache.getCacheStore()->compactLog();
+        MstLocks::releaseLock(tag);
         lastWriteTime = time(NULL);
       }
     }
 
     /* --- Decorate the current conformation with TERMs --- */
+    // TERMs are extracted here and handed to search workers as they come, so
+    // that searching for self TERMs overlaps with finding contacts for pair TERMs
+    vector<termJob*> jobs;
+    boundedQueue<termJob*> pending(2*numSearchThreads);
+    vector<thread> workers;
+    for (int w = 0; w < numSearchThreads; w++) {
+      workers.push_back(thread([&, w]() {
+        termJob* job;
+        while (pending.pop(job)) {
+          job->reused = false;
+          if (reuseTol >= 0) {
+            auto prev = prevTERMs.find(termKey(*job));
+            if (prev != prevTERMs.end()) {
+              RMSDCalculator wrc;
+              AtomPointerVector prevBB = RotamerLibrary::getBackbone(prev->second.frag), currBB = RotamerLibrary::getBackbone(job->frag);
+              if ((prevBB.size() == currBB.size()) && (wrc.bestRMSD(prevBB, currBB) <= reuseTol)) {
+                // matches were superimposed onto the TERM as it was, so move them to where it is now
+                for (const Structure& m : prev->second.matches) {
+                  Structure* match = new Structure(m);
+                  wrc.align(prevBB, currBB, *match);
+                  job->matches.push_back(match);
+                }
+                job->reused = true;
+                continue;
+              }
+            }
+          }
+          searchers[w]->setRMSDCutoff(RMSDCalculator::rmsdCutoff(job->fragResIdx, S)); // account for spacing between residues from the same chain
+          job->matches = getMatches(*searchers[w], job->frag, job->fragResIdx, numPerTERM, op.isGiven("s") ? job->centIdx : vector<int>(), &search);
+        }
+      }));
+    }
+    auto addTERM = [&](const vector<Residue*>& centers, int pm) -> bool {
+      termJob* job = new termJob();
+      for (Residue* res : centers) job->centers.push_back(res->getResidueIndex());
+      job->pm = pm;
+      job->centIdx = TERMUtils::selectTERM(centers, job->frag, pm, &(job->fragResIdx), false);
+      if (MstUtils::setdiff(job->fragResIdx, fixed).empty()) { delete job; return false; } // TERMs composed entirely of fixed residues have no impact
+      jobs.push_back(job);
+      pending.push(job);
+      return true;
+    };
+
     // first self TERMs
     cout << "Searching for self TERMs..." << endl;
-    vector<vector<Structure*>> allMatches;
     for (int ci = 0; ci < S.chainSize(); ci++) {
       Chain& C = S[ci];
       for (int ri = 0; ri < C.residueSize(); ri++) {
-        Structure frag; vector<int> fragResIdx;
-        vector<int> centIdx = TERMUtils::selectTERM({&C[ri]}, frag, pmSelf, &fragResIdx, false);
-        if (MstUtils::setdiff(fragResIdx, fixed).empty()) continue; // TERMs composed entirely of fixed residues have no impact
-        cout << "TERM around " << C[ri] << endl;
-        search.setRMSDCutoff(RMSDCalculator::rmsdCutoff(fragResIdx, S)); // account for spacing between residues from the same chain
-        vector<Structure*> matches = getMatches(search, frag, fragResIdx, numPerTERM, op.isGiven("s") ? centIdx : vector<int>());
-        for (int ii = 0; ii < O.size(); ii++) {
-          if (O[ii] == NULL) continue;
-          Structure* altFrag = new Structure();
-          TERMUtils::selectTERM({&(O[ii]->getResidue(C[ri].getResidueIndex()))}, *altFrag, pmSelf, NULL, false);
-          numberResidues(*altFrag, fragResIdx);
-          matches.push_back(altFrag);
-        }
-        if (!matches.empty()) {
-          allMatches.push_back(matches);
-          int lastIdx = MstUtils::min(MstUtils::max(numPerTERM, 1), (int) matches.size());
-          Structure* last = matches[lastIdx - 1];
-          if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(frag)) << endl;
-        }
+        if (addTERM({&C[ri]}, pmSelf)) cout << "TERM around " << C[ri] << endl;
       }
     }
 
@@ -391,28 +517,47 @@ int main(int argc, char** argv) {
     for (int k = 0; k < contactList.size(); k++) {
       Residue* resA = contactList[k].first;
       Residue* resB = contactList[k].second;
-      Structure frag; vector<int> fragResIdx;
-      vector<int> centIdx = TERMUtils::selectTERM({resA, resB}, frag, pmPair, &fragResIdx, false);
-      if (MstUtils::setdiff(fragResIdx, fixed).empty()) continue; // TERMs composed entirely of fixed residues have no impact
-      cout << "TERM around " << *resA << " x " << *resB << endl;
-      search.setRMSDCutoff(RMSDCalculator::rmsdCutoff(fragResIdx, S)); // account for spacing between residues from the same chain
-      vector<Structure*> matches = getMatches(search, frag, fragResIdx, numPerTERM, op.isGiven("s") ? centIdx : vector<int>());
+      if (addTERM({resA, resB}, pmPair)) cout << "TERM around " << *resA << " x " << *resB << endl;
+    }
+    pending.close();
+    for (int w = 0; w < workers.size(); w++) workers[w].join();
+
+    // collect matches in TERM order, remembering them for the next cycle
+    vector<vector<Structure*>> allMatches;
+    map<vector<int>, termRecord> currTERMs;
+    int numReused = 0;
+    for (termJob* job : jobs) {
+      vector<Structure*>& matches = job->matches;
+      if (job->reused) numReused++;
+      if (reuseTol >= 0) {
+        termRecord& rec = currTERMs[termKey(*job)];
+        rec.frag = job->frag.toStructure();
+        for (Structure* m : matches) rec.matches.push_back(*m);
+      }
       for (int ii = 0; ii < O.size(); ii++) {
         if (O[ii] == NULL) continue;
+        vector<Residue*> altCenters;
+        for (int ri : job->centers) altCenters.push_back(&(O[ii]->getResidue(ri)));
         Structure* altFrag = new Structure();
-        TERMUtils::selectTERM({&(O[ii]->getResidue(resA->getResidueIndex())), &(O[ii]->getResidue(resB->getResidueIndex()))}, *altFrag, pmPair, NULL, false);
-        numberResidues(*altFrag, fragResIdx);
+        TERMUtils::selectTERM(altCenters, *altFrag, job->pm, NULL, false);
+        numberResidues(*altFrag, job->fragResIdx);
         matches.push_back(altFrag);
       }
       if (!matches.empty()) {
         allMatches.push_back(matches);
         int lastIdx = MstUtils::min(MstUtils::max(numPerTERM, 1), (int) matches.size());
         Structure* last = matches[lastIdx - 1];
-        if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(frag)) << endl;
+        if (op.isGiven("v")) cout << "\tRMSD of match " << lastIdx << " is " << rc.bestRMSD(RotamerLibrary::getBackbone(*last), RotamerLibrary::getBackbone(job->frag)) << endl;
       }
+      delete job;
     }
+    prevTERMs = currTERMs;
+    if (reuseTol >= 0) cout << "matches of " << numReused << " of " << jobs.size() << " TERMs were reused from the previous cycle" << endl;
+
     // fuser options
     fusionParams opts; opts.setNumIters(Ni); opts.setVerbose(false);
+    opts.setNumThreads(op.getInt("j", 1));
+    opts.setTrajectorySink(dynOut);
     opts.setMinimizerType(fusionParams::gradDescent);
     opts.setRepFC(1);
     opts.setCompFC(0.1);
@@ -463,6 +608,8 @@ int main(int argc, char** argv) {
         opts.setNumIters((op.isInt("dyn") ? op.getInt("dyn") : 100)*Ni);
         opts.setLogBase(op.getString("o"));
         opts.setThermalEnergy(1.0);
+        opts.setNumReplicas(op.getInt("rep", 1));
+        opts.setMaxThermalEnergy(op.getReal("rkT", 4.0));
         opts.setSaveInterval(MstUtils::max(1, opts.numIters()/1000));
         opts.setAdaptiveWeighting(true);
         propFused = Fuser::fuse(propTopo, propScore, opts);
@@ -533,5 +680,7 @@ int main(int argc, char** argv) {
     }
   }
   out.close();
+  if (dynOut != NULL) delete dynOut;
+  for (int w = 1; w < numSearchThreads; w++) delete searchers[w];
   Structure::combine(S, I).writePDB(op.getString("o") + ".fin.pdb");
 }
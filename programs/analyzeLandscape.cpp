@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <typeinfo>
 #include <stdio.h>
+#include <climits>
 
 #include "msttypes.h"
 #include "mstoptions.h"
@@ -120,12 +121,92 @@ class Landscape {
     mstreal meanEner;    // the running mean energy
 };
 
-int distance(const vector<int>& seqi, const vector<int>& seqj) {
-  int d = 0;
-  for (int i = 0; i < seqi.size(); i++) {
-    d += (seqi[i] != seqj[i]);
+/* Solutions bit-packed for fast Hamming distances: each position takes just
+ * enough bits to hold the largest amino-acid index, and positions are packed
+ * into 64-bit words, so that comparing two sequences takes a handful of XORs
+ * and population counts per word rather than one comparison per position. */
+class packedSequences {
+  public:
+    packedSequences(const vector<vector<int> >& seqs) {
+      int maxVal = 1;
+      for (int i = 0; i < seqs.size(); i++) {
+        for (int k = 0; k < seqs[i].size(); k++) maxVal = MstUtils::max(maxVal, seqs[i][k]);
+      }
+      bits = 1;
+      while ((1 << bits) <= maxVal) bits++;
+      perWord = 64/bits;
+      int L = seqs.empty() ? 0 : seqs[0].size();
+      W = MstUtils::max(1, (L + perWord - 1)/perWord);
+      lowBits = 0;
+      for (int f = 0; f < perWord; f++) lowBits |= uint64_t(1) << (f*bits);
+      words.assign(seqs.size()*W, 0);
+      for (int i = 0; i < seqs.size(); i++) {
+        for (int k = 0; k < seqs[i].size(); k++) words[i*W + k/perWord] |= uint64_t(seqs[i][k]) << ((k % perWord)*bits);
+      }
+    }
+    int size() const { return words.size()/W; }
+
+    // number of positions at which sequences i and j differ
+    int distance(int i, int j) const {
+      const uint64_t* a = words.data() + i*W;
+      const uint64_t* b = words.data() + j*W;
+      int d = 0;
+      for (int w = 0; w < W; w++) {
+        // fold each differing field onto its lowest bit, then count fields
+        uint64_t x = a[w] ^ b[w], y = x;
+        for (int k = 1; k < bits; k++) y |= x >> k;
+        d += __builtin_popcountll(y & lowBits);
+      }
+      return d;
+    }
+
+  private:
+    int bits, perWord, W;
+    uint64_t lowBits;
+    vector<uint64_t> words;
+};
+
+/* Writes, one text row per sequence in rows, the distances of that sequence
+ * to every sequence in cols. Rows are computed in parallel, a block at a time,
+ * and each block is written out before the next one is computed, so memory
+ * does not grow with the number of rows. */
+void writeDistances(const string& file, const packedSequences& P, const vector<int>& rows, const vector<int>& cols, int numThreads) {
+  fstream of; MstUtils::openFile(of, file, ios::out);
+  int blockSize = 64*numThreads;
+  vector<string> block(blockSize);
+  for (int b = 0; b < rows.size(); b += blockSize) {
+    int n = MstUtils::min(blockSize, (int) rows.size() - b);
+    MstUtils::parallelFor(n, numThreads, [&](int k, int) {
+      string& line = block[k];
+      line.clear();
+      char buf[16];
+      for (int j = 0; j < cols.size(); j++) {
+        int len = snprintf(buf, sizeof(buf), "%d ", P.distance(rows[b + k], cols[j]));
+        line.append(buf, len);
+      }
+      line.push_back('\n');
+    });
+    for (int k = 0; k < n; k++) of << block[k];
   }
-  return d;
+  of.close();
+}
+
+/* Picks m landmark sequences by farthest-point traversal from a random start:
+ * each next landmark is the sequence farthest from all landmarks so far. */
+vector<int> pickLandmarks(const packedSequences& P, int m, int numThreads) {
+  int n = P.size();
+  m = MstUtils::min(m, n);
+  vector<int> landmarks;
+  if (m <= 0) return landmarks;
+  vector<int> closest(n, INT_MAX);
+  int next = MstUtils::randInt(n);
+  while (landmarks.size() < m) {
+    landmarks.push_back(next);
+    int l = next;
+    MstUtils::parallelFor(n, numThreads, [&](int i, int) { closest[i] = MstUtils::min(closest[i], P.distance(i, l)); });
+    next = max_element(closest.begin(), closest.end()) - closest.begin();
+  }
+  return landmarks;
 }
 
 int main(int argc, char** argv) {
@@ -137,6 +218,8 @@ int main(int argc, char** argv) {
   op.addOption("n", "number of intervals of this size to track. Default is 40.");
   op.addOption("k", "number of sequences to sub-sample in each interval at the end to compute an embedding. Default is 1000.");
   op.addOption("nat", "native sequence, single-letter.");
+  op.addOption("lmk", "instead of the all-by-all distance matrix, output distances of all sequences to this many landmark sequences (picked by farthest-point traversal), for a landmark/Nystrom embedding. Landmark indices (1-based) go into the _lmk.dat file.");
+  op.addOption("j", "number of threads for sampling and distance calculations. Default is 1.");
   op.setOptions(argc, argv);
   MstUtils::setSignalHandlers();
 
@@ -144,7 +227,10 @@ int main(int argc, char** argv) {
   int N = op.getInt("n", 40);
   MstUtils::assertCond(dE > 0, "energy step must be positive!");
   MstUtils::assertCond(N > 0, "number of energy intervals must be positive integer!");
+  int numThreads = op.getInt("j", 1);
+  MstUtils::assertCond(numThreads > 0, "number of threads must be positive!");
   srand(time(NULL) + (int) getpid());
+  MstUtils::seedRandEngine();
 
   EnergyTable Etab(op.getString("e"));
 
@@ -171,7 +257,8 @@ int main(int argc, char** argv) {
   int stuck = 0;       // for how many cycles have we been stuck? (no improvement)
   int prevNeed = L.getTotalNeed(cap); int need = prevNeed;
   while ((MstUtils::min(L.getNumHits()) < cap) || (stuck > 100)) {
-    Etab.mc(1, Ni, kT, kT, 1, &L, &Landscape::recordSolution, Ne);
+    // the iterations of a cycle are split between independent chains
+    Etab.mcParallel(numThreads, (Ni + numThreads - 1)/numThreads, kT, kT, 1, numThreads, 0, &L, &Landscape::recordSolution, Ne);
     mstreal Ed = L.getMeanDefitiency(cap);
     mstreal Es = L.getMeanEnergy();
     int need = L.getTotalNeed(cap);
@@ -206,15 +293,21 @@ int main(int argc, char** argv) {
   }
 
   // output distances for Matlab analysis
-  cout << "calculating all-by-all for a subset of " << allSeqs.size() << " sequences..." << endl;
-  fstream of; MstUtils::openFile(of, op.getString("o") + "_mat.dat", ios::out);
-  for (int i = 0; i < allSeqs.size(); i++) {
-    for (int j = 0; j < allSeqs.size(); j++) {
-      of << distance(allSeqs[i], allSeqs[j]) << " ";
-    }
-    of << endl;
+  packedSequences P(allSeqs);
+  vector<int> all(allSeqs.size());
+  for (int i = 0; i < all.size(); i++) all[i] = i;
+  if (op.isGiven("lmk")) {
+    vector<int> landmarks = pickLandmarks(P, op.getInt("lmk"), numThreads);
+    cout << "calculating distances of " << allSeqs.size() << " sequences to " << landmarks.size() << " landmarks..." << endl;
+    writeDistances(op.getString("o") + "_mat.dat", P, all, landmarks, numThreads);
+    fstream of; MstUtils::openFile(of, op.getString("o") + "_lmk.dat", ios::out);
+    for (int i = 0; i < landmarks.size(); i++) of << landmarks[i] + 1 << endl;
+    of.close();
+  } else {
+    cout << "calculating all-by-all for a subset of " << allSeqs.size() << " sequences..." << endl;
+    writeDistances(op.getString("o") + "_mat.dat", P, all, all, numThreads);
   }
-  of.close();
+  fstream of;
 
   // output energies
   MstUtils::openFile(of, op.getString("o") + "_ener.dat", ios::out);
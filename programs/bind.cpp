@@ -4,6 +4,7 @@
 #include <stdlib.h>
 #include <typeinfo>
 #include <stdio.h>
+#include <mutex>
 
 #include "msttypes.h"
 #include "mstfasst.h"
@@ -16,16 +17,41 @@
 using namespace std;
 using namespace MST;
 
+/* Contact TERMs (see mineAttachments) of database residues, excised once and
+ * shared by all sites and threads. */
+class contactTERMCache {
+  public:
+    typedef shared_ptr<const vector<Structure> > entry;
+    entry get(int ti, int ri) {
+      lock_guard<mutex> lock(cacheLock);
+      auto it = terms.find(make_pair(ti, ri));
+      return (it == terms.end()) ? NULL : it->second;
+    }
+    entry put(int ti, int ri, const vector<Structure>& contactTERMs) {
+      lock_guard<mutex> lock(cacheLock);
+      auto it = terms.insert(make_pair(make_pair(ti, ri), make_shared<const vector<Structure> >(contactTERMs))).first;
+      return it->second;
+    }
+
+  private:
+    mutex cacheLock;
+    map<pair<int, int>, entry> terms;
+};
+
 class bindOptions {
   public:
     bindOptions(FASST* _F = NULL, RotamerLibrary* _RL = NULL) {
       F = _F;
+      S = NULL;
       RL = _RL;
+      cache = NULL;
       pm = 1;
       pcut = 0.0;
       setDefaultRMSDCutoffs();
     }
     FASST* getFASST() { return F; }
+    FASST* getSearcher() { return (S == NULL) ? F : S; }
+    contactTERMCache* getContactCache() { return cache; }
     RotamerLibrary* getRotamerLibrary() { return RL; }
     int contextLen() { return pm; }
     mstreal getRMSDCut() { return rmsdCut; }
@@ -39,13 +65,16 @@ class bindOptions {
     }
     void setContextLen(int _pm) { pm = _pm; }
     void setFASST(FASST* _F) { F = _F; }
+    void setSearcher(FASST* _S) { S = _S; } // searches with a different object than the one owning the database (e.g., one per thread)
+    void setContactCache(contactTERMCache* _cache) { cache = _cache; }
     void setRotamerLibrary(RotamerLibrary* _RL) { RL = _RL; }
     void setMinProb(mstreal _pcut) { pcut = _pcut; }
     void setContSectName(const string& _contSec) { contSec = _contSec; }
 
   private:
-    FASST* F;
+    FASST* F, *S;
     RotamerLibrary* RL;
+    contactTERMCache* cache;
     int pm;
     mstreal pcut, rmsdCut, rmsdCut2;
     RMSDCalculator rc;
@@ -108,7 +137,8 @@ int main(int argc, char** argv) {
   op.addOption("s", "surface site selection (procedure will be repeated for each residue in the selection).", true);
   op.addOption("db", "a binary FASST database file. This database needs to have the \"conts\" residue property section populated with contacts.", true);
   op.addOption("rLib", "rotamer library file path.", true);
-  op.addOption("o", "output base name.", true);
+  op.addOption("o", "output base name. Ranked poses for each site are written to <o>.<chain ID><residue number>.pdb as soon as the site is done.", true);
+  op.addOption("j", "number of sites to process in parallel (default 1). All sites share the database and the contacts excised from it.");
   op.setOptions(argc, argv);
   string contSec = "conts";
   RMSDCalculator rc;
@@ -125,27 +155,51 @@ int main(int argc, char** argv) {
   if (!F.isResiduePairPropertyPopulated(contSec)) MstUtils::error("the FASST database does not appear to have a contact section");
   F.setRedundancyCut(0.5);
   F.setMaxNumMatches(1000);
+  contactTERMCache cache;
   opts.setFASST(&F);
   opts.setContSectName(contSec);
+  opts.setContactCache(&cache);
 
-  for (int i = 0; i < surf.size(); i++) {
+  // each thread searches with its own searcher over the shared database
+  int numThreads = MstUtils::max(1, MstUtils::min(op.getInt("j", 1), (int) surf.size()));
+  vector<FASST*> searchers(numThreads);
+  for (int w = 0; w < numThreads; w++) {
+    searchers[w] = F.newSearcher();
+    searchers[w]->setOptions(F.options());
+  }
+  mutex outLock;
+  MstUtils::parallelFor(surf.size(), numThreads, [&](int i, int w) {
     Residue* sR = surf[i];
+    bindOptions siteOpts = opts;
+    siteOpts.setSearcher(searchers[w]);
     cout << "visiting residue " << *sR << endl;
 
-    vector<attachment> A = getAttachments(sR, opts);
+    vector<attachment> A = getAttachments(sR, siteOpts);
     cout << "found " << A.size() << " attachments" << endl;
-    vector<mstreal> scores;
-    for (int i = 0; i < MstUtils::min((int) A.size(), 8); i++) {
-      scores.push_back(scoreAttachment(A[i], opts));
-      cout << "\tscore of attachment " << i << " --> " << scores[i] << endl;
+    vector<pair<mstreal, int> > scores;
+    for (int k = 0; k < MstUtils::min((int) A.size(), 8); k++) {
+      scores.push_back(make_pair(scoreAttachment(A[k], siteOpts), k));
+      cout << "\tscore of attachment " << k << " --> " << scores.back().first << endl;
     }
-    if (scores.size() > 0) {
-      int bi = 0;
-      MstUtils::min(scores, 0, scores.size() - 1, &bi);
-      cout << "best attachment has score " << scores[bi] << ", writing..." << endl;
-      A[bi].getStructure().writePDB("/tmp/att.pdb");
+    sort(scores.begin(), scores.end());
+
+    // stream out ranked poses for this site
+    string outFile = op.getString("o") + "." + sR->getChainID() + MstUtils::toString(sR->getNum()) + ".pdb";
+    if (!scores.empty()) {
+      fstream out; MstUtils::openFile(out, outFile, ios::out);
+      for (int k = 0; k < scores.size(); k++) {
+        out << "REMARK score " << scores[k].first << endl;
+        out << "MODEL " << k + 1 << endl;
+        A[scores[k].second].getStructure().writePDB(out);
+        out << "ENDMDL" << endl;
+      }
+      out.close();
     }
-  }
+    lock_guard<mutex> lock(outLock);
+    if (scores.empty()) cout << "site " << *sR << ": no attachments" << endl;
+    else cout << "site " << *sR << ": best attachment has score " << scores[0].first << ", wrote " << scores.size() << " ranked poses to " << outFile << endl;
+  });
+  for (int w = 0; w < numThreads; w++) delete searchers[w];
 }
 
 mstreal scoreAttachment(attachment& A, bindOptions& opts) {
@@ -168,33 +222,60 @@ int mineAttachments(Residue* sR, bindOptions& opts, vector<Structure>& contactTE
   Structure anchor;
   TERMUtils::selectTERM(vector<Residue*>(1, sR), anchor, opts.contextLen());
   FASST& F = *(opts.getFASST());
-  F.setRMSDCutoff(opts.getRMSDCut());
-  F.setQuery(anchor);
+  FASST& S = *(opts.getSearcher());
+  S.setRMSDCutoff(opts.getRMSDCut());
+  S.setQuery(anchor);
   cout << "\tsearching for a local " << anchor.chainSize() << "-segment TERM..." << endl;
-  fasstSolutionSet sols = F.search();
+  fasstSolutionSet sols = S.search();
   vector<Structure> matches; F.getMatchStructures(sols, matches);
   int Ne = 0, Nc = 0;
+  int contID = F.getResiduePairPropertyID(opts.getContSectName());
   cout << "\tfound " << matches.size() << " matches, excising local context..." << endl;
+  vector<contactTERMCache::entry> hits(matches.size());
+  vector<int> toExcise;
   for (int k = 0; k < matches.size(); k++) {
     Residue cR = matches[k].getResidue(opts.contextLen());
     if (!cR.isNamed(sR->getName())) continue;
 
-    // iterate over all contacts
     int ti = sols[k].getTargetIndex();
     int ri = (sols[k].getAlignment())[0] + opts.contextLen();
-    Structure* mT = F.getTarget(ti);
-    if (F.hasResiduePairProperties(ti, opts.getContSectName(), ri)) {
-      map<int, mstreal> C = F.getResiduePairProperties(ti, opts.getContSectName(), ri);
-      for (auto rj = C.begin(); rj != C.end(); ++rj) {
+    const int* partners; const mstreal* vals;
+    if (F.getResiduePairProperties(ti, contID, ri, partners, vals) < 0) {
+      Ne++; // counts as non-contacting "exposed" residue
+      continue;
+    }
+    if (opts.getContactCache() != NULL) hits[k] = opts.getContactCache()->get(ti, ri);
+    if (hits[k] == NULL) toExcise.push_back(k);
+  }
+
+  // excise contact TERMs of residues not seen before, from their full targets
+  if (!toExcise.empty()) {
+    vector<fasstSolutionAddress> addresses;
+    for (int k : toExcise) addresses.push_back(sols[k].getAddress());
+    fasstSolutionSet toVisit(addresses, {2*opts.contextLen() + 1});
+    map<pair<int, int>, int> solIndex; // (target, residue) to index in sols
+    for (int k : toExcise) solIndex[make_pair(sols[k].getTargetIndex(), sols[k].getAlignment()[0])] = k;
+    F.visitMatchStructures(toVisit, [&](int i, const Structure& target) {
+      int k = solIndex[make_pair(toVisit[i].getTargetIndex(), toVisit[i].getAlignment()[0])];
+      int ti = sols[k].getTargetIndex();
+      int ri = (sols[k].getAlignment())[0] + opts.contextLen();
+      Structure mT(target);
+      const int* partners; const mstreal* vals;
+      int n = F.getResiduePairProperties(ti, contID, ri, partners, vals);
+      vector<Structure> excised;
+      for (int j = 0; j < n; j++) {
         Structure contactTERM;
-        if (!TERMUtils::exciseTERM({&(mT->getResidue(ri)), &(mT->getResidue(rj->first))}, contactTERM, opts.contextLen())) continue;
+        if (!TERMUtils::exciseTERM({&(mT.getResidue(ri)), &(mT.getResidue(partners[j]))}, contactTERM, opts.contextLen())) continue;
         if (contactTERM.residueSize() != 2*(2*opts.contextLen() + 1)) continue; // if ran into end of chain, some segments are not complete
-        contactTERMs.push_back(contactTERM);
-        Nc++;
+        excised.push_back(contactTERM);
       }
-    } else {
-      Ne++; // counts as non-contacting "exposed" residue
-    }
+      hits[k] = (opts.getContactCache() != NULL) ? opts.getContactCache()->put(ti, ri, excised) : make_shared<const vector<Structure> >(excised);
+    }, false, FASST::matchType::FULL, false);
+  }
+  for (int k = 0; k < hits.size(); k++) {
+    if (hits[k] == NULL) continue;
+    contactTERMs.insert(contactTERMs.end(), hits[k]->begin(), hits[k]->end());
+    Nc += hits[k]->size();
   }
 
   return Ne;
@@ -225,7 +306,7 @@ vector<attachment> getAttachments(Residue* sR, bindOptions& opts) {
     mstreal p = (cIs[ci].size()*1.0)/(Nc + Ne);
     if (p > opts.minProb()) {
       Structure cent(contactTERMs[cIs[ci][0]]);
-      rc.align(cent[0].getAtoms(), opts.getFASST()->getQuerySearchedAtoms(), cent);
+      rc.align(cent[0].getAtoms(), opts.getSearcher()->getQuerySearchedAtoms(), cent);
       A.push_back(attachment(cent, -log(p)));
     }
   }
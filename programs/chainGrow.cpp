@@ -48,14 +48,19 @@ vector<mstreal> chainAutocorr(const vector<Residue*> chain) {
   return cosines;
 }
 
-/* Picks a suitable match for extending the structure S from within the set of
- * FASST solutions matchList. F is the FASST object used to locate the matches.
- * endIdx is the index of the residue (in the searched TERM) from which the
- * chain is supposed to grow. del is the amount (and direction) of the growth,
- * in residues, and op contains the options passed to the program. */
-int pickMatch(fasstSolutionSet& matchList, Structure& S, FASST& F, int endIdx, int del, MstOptions& op) {
+/* Weighs the matches in matchList as options for extending the structure S,
+ * returning one weight for each suitable match (one with a residue past the
+ * growing end), whose indices into matchList go into matchInds. F is the FASST
+ * object owning the database the matches come from, and rmsdCut the cutoff
+ * they were searched with. endIdx is the index of the residue (in the searched
+ * TERM) from which the chain is supposed to grow. del is the amount (and
+ * direction) of the growth, in residues, and op contains the options passed to
+ * the program. If nextResOut is given, it receives the residue each suitable
+ * match would add (caller takes ownership of the atoms); otherwise, these are
+ * cleaned up. */
+vector<mstreal> scoreMatches(fasstSolutionSet& matchList, Structure& S, FASST& F, mstreal rmsdCut, int endIdx, int del, MstOptions& op, vector<int>& matchInds, vector<AtomPointerVector>* nextResOut = NULL) {
   // find suitable matches (those with enough context)
-  vector<vector<Atom*> > nextRes; vector<int> matchInds;
+  vector<vector<Atom*> > nextRes; matchInds.clear();
   for (int m = 0; m < matchList.size(); m++) {
     vector<int> resIndices = F.getMatchResidueIndices(matchList[m], FASST::matchType::REGION);
     Structure target = F.getMatchStructure(matchList[m], false, FASST::matchType::FULL, true);
@@ -68,14 +73,14 @@ int pickMatch(fasstSolutionSet& matchList, Structure& S, FASST& F, int endIdx, i
     matchInds.push_back(m);
   }
   cout << "\tout of these, found " << matchInds.size() << " suitable matches" << endl;
-  if (matchInds.size() == 0) return -1;
+  if (matchInds.size() == 0) return vector<mstreal>();
   CartesianPoint weights(matchInds.size(), 1.0);
   // vector<vector<int>> clusters = clusterGuru.greedyCluster(nextRes, 0.3);
   // cout << "\tresulted in " << clusters.size() << " clusters" << endl;
 
   // unless we were asked to flatten matches, weight by RMSD
   if (!op.isGiven("f")) {
-    mstreal rmsdFactor = F.getRMSDCutoff() / 10.0;
+    mstreal rmsdFactor = rmsdCut / 10.0;
     for (int i = 0; i < matchInds.size(); i++) {
       weights[i] *= exp(-matchList[matchInds[i]].getRMSD() / rmsdFactor);
     }
@@ -117,6 +122,22 @@ int pickMatch(fasstSolutionSet& matchList, Structure& S, FASST& F, int endIdx, i
 cout << "weights: " << MstUtils::vecToString(weights) << endl;
     }
   }
+  if (nextResOut != NULL) {
+    nextResOut->clear();
+    for (int m = 0; m < nextRes.size(); m++) nextResOut->push_back(AtomPointerVector(nextRes[m]));
+  } else {
+    for (int m = 0; m < nextRes.size(); m++) { AtomPointerVector(nextRes[m]).deletePointers(); } // clean up cloned fragments
+  }
+  return weights;
+}
+
+/* Picks a suitable match for extending the structure S from within the set of
+ * FASST solutions matchList (see scoreMatches for the arguments). Returns -1
+ * if no match is suitable. */
+int pickMatch(fasstSolutionSet& matchList, Structure& S, FASST& F, int endIdx, int del, MstOptions& op) {
+  vector<int> matchInds;
+  CartesianPoint weights(scoreMatches(matchList, S, F, F.getRMSDCutoff(), endIdx, del, op, matchInds));
+  if (matchInds.size() == 0) return -1;
 
   // pick either the best scoring option or probabilistically, depending on
   // whether randomization was requested
@@ -131,12 +152,75 @@ cout << "weights: " << MstUtils::vecToString(weights) << endl;
   } else {
     MstUtils::max((vector<mstreal>) weights, 0, weights.size()-1, &pick);
   }
-  for (int m = 0; m < nextRes.size(); m++) { AtomPointerVector(nextRes[m]).deletePointers(); } // clean up cloned fragments
   cout << "\tpicked match with index " << matchInds[pick] << endl;
 
   return matchInds[pick];
 }
 
+/* Selects the TERM around the growing end of S (the N-terminal end, if nc is
+ * true, or the C-terminal one otherwise), of the chain picked by --cid/--sid or
+ * else the first (last) chain. termResIndices receives the indices of TERM
+ * residues in S, and cresIdx the index of the end residue within the TERM. */
+Structure selectGrowthTERM(Structure& S, RotamerLibrary& RL, bool nc, MstOptions& op, int pm, mstreal cdCut, vector<int>& termResIndices, int& cresIdx) {
+  ConFind C(&RL, S);
+  Chain* cChain = &(nc ? S[0] : S.getChain(S.chainSize() - 1)); // default chain of residues to grow
+  if (op.isGiven("cid")) {
+    cChain = S.getChainByID(op.getString("cid"));
+    MstUtils::assertCond(cChain != NULL, "did not find chain with ID " + op.getString("cid"));
+  } else if (op.isGiven("sid")) {
+    cChain = S.getChainBySegID(op.getString("sid"));
+    MstUtils::assertCond(cChain != NULL, "did not find segment with ID " + op.getString("sid"));
+  }
+  Residue* cres = &(nc ? cChain->getResidue(0) : cChain->getResidue(cChain->residueSize() - 1));
+  termResIndices.clear();
+  Structure term = TERMUtils::selectTERM({cres}, C, pm, cdCut, &termResIndices);
+  cresIdx = MstUtils::indexMap(termResIndices).at(cres->getResidueIndex());
+  return term;
+}
+
+/* Fuses S with the given match to its growth TERM (see selectGrowthTERM),
+ * extended by dN residues past the growing end in the direction del. Only
+ * residues within pm of the TERM are allowed to move. */
+Structure extendByMatch(Structure& S, FASST& F, const fasstSolution& sol, const vector<int>& termResIndices, int cresIdx, bool nc, int del, int dN, int pm, const fusionParams& fuserOpts) {
+  vector<int> resIndices = F.getMatchResidueIndices(sol, FASST::matchType::REGION);
+  Structure match = F.getMatchStructure(sol, false, FASST::matchType::FULL, true);
+  vector<vector<Residue*> > resTopo(S.residueSize(), vector<Residue*>());
+  for (int ri = 0; ri < S.residueSize(); ri++) resTopo[ri].push_back(&(S.getResidue(ri)));
+  vector<bool> isFixed(resTopo.size(), true);
+  for (int ri = 0; ri < resIndices.size(); ri++) {
+    resTopo[termResIndices[ri]].push_back(&(match.getResidue(resIndices[ri])));
+    for (int d = -pm; d <= pm; d++) {
+      int idx = termResIndices[ri] + d;
+      if ((idx >= 0) && (idx < S.residueSize())) isFixed[idx] = false;
+    }
+  }
+
+  // extend the match by dN residues
+  for (int ii = 1; ii <= dN; ii++) {
+    int nextIdx = resIndices[cresIdx] + ii*del;
+    vector<Residue*> newPos(1, &(match.getResidue(nextIdx)));
+    if (nc) {
+      resTopo.insert(resTopo.begin(), newPos);
+      isFixed.insert(isFixed.begin(), false);
+    } else {
+      resTopo.push_back(newPos);
+      isFixed.push_back(false);
+    }
+  }
+
+  vector<int> fixed;
+  for (int ri = 0; ri < isFixed.size(); ri++) {
+    if (isFixed[ri]) fixed.push_back(ri);
+  }
+  return Fuser::fuse(resTopo, fixed, fuserOpts);
+}
+
+// a partially grown chain in beam-search mode
+struct growthState {
+  Structure S;
+  mstreal logProb; // log-probability of the sequence of picks that produced it
+};
+
 int main(int argc, char** argv) {
   MstOptions op;
   op.setTitle("Grows a chain from either the N- or the C-terminus, by the specified number of residues, aiming to make the overall structure as designable as possible. Options:");
@@ -153,6 +237,8 @@ int main(int argc, char** argv) {
   op.addOption("m", "enforce a minimum of this many number of matches at each branch. By default, uses only an automatic RMSD cutoff, so some branches will terminate.");
   op.addOption("R", "radius of gyration factor. If specified, will preferrentially choose more compact solutions, with this exponential pre-factor (i.e., exp[-Rg/factor]).");
   op.addOption("P", "impose native-like persistence length of the protein chain. Probably best to use either --R or --P.");
+  op.addOption("beam", "beam-search mode: rather than committing to one match at each step, keep this many of the most probable partial chains (by the product of their pick probabilities, from the same weights used to pick matches, including --R/--P), extending all of them at each step, and write each chain that survives to the end.");
+  op.addOption("j", "number of threads for beam-search mode (default 1); the TERMs of all chains in the beam are searched for as one batch.");
   op.setOptions(argc, argv);
   if (op.isGiven("R") && (!op.isReal("R") || (op.getReal("R") <= 0))) MstUtils::error("-R must be a positive number!");
   int pm = 2;
@@ -176,6 +262,87 @@ int main(int argc, char** argv) {
   // TERMify loop
   fstream out; MstUtils::openFile(out, op.getString("o") + ".grow.pdb", ios_base::out);
   out << "MODEL " << 0 << endl; S.writePDB(out); out << "ENDMDL" << endl;
+  if (op.isGiven("beam")) {
+    int B = op.getInt("beam");
+    if (B < 1) MstUtils::error("--beam must be a positive integer!");
+    int numThreads = op.getInt("j", 1);
+    F.setNumThreads(numThreads);
+    vector<growthState> beam(1, growthState{S, 0.0});
+    for (int nc = 0; nc < 2; nc++) {
+      int del = nc ? -1 : 1;
+      if ((nc == 0) && !op.isGiven("c")) continue;
+      if ((nc == 1) && !op.isGiven("n")) continue;
+      for (int i = 0; i < op.getInt("L"); i++) {
+        cout << "growing " << beam.size() << " chain(s) in the " << (nc ? "N" : "C") << "-terminal direction, cycle " << i+1 << endl;
+        // TERMs at the growing ends of all chains, searched for as one batch
+        int nb = beam.size();
+        vector<Structure> terms(nb);
+        vector<vector<int> > termResIndices(nb);
+        vector<int> cresIdx(nb);
+        MstUtils::parallelFor(nb, numThreads, [&](int k, int) {
+          terms[k] = selectGrowthTERM(beam[k].S, RL, nc, op, pm, cdCut, termResIndices[k], cresIdx[k]);
+        });
+        vector<fasstSearchOptions> termOpts(nb, F.options());
+        for (int k = 0; k < nb; k++) {
+          termOpts[k].setRMSDCutoff(RMSDCalculator::rmsdCutoff(terms[k]));
+          if (op.isGiven("m")) termOpts[k].setMinNumMatches(op.getInt("m"));
+          termOpts[k].setMaxNumMatches(1000);
+        }
+        vector<fasstSolutionSet> matchLists = F.searchBatch(terms, termOpts, false);
+
+        // every suitable match of every chain is a candidate extension
+        struct candidate { int parent, match; mstreal logProb; AtomPointerVector nextRes; };
+        vector<vector<candidate> > cands(nb);
+        MstUtils::parallelFor(nb, numThreads, [&](int k, int) {
+          vector<int> matchInds; vector<AtomPointerVector> nextRes;
+          vector<mstreal> weights = scoreMatches(matchLists[k], beam[k].S, F, termOpts[k].getRMSDCutoff(), cresIdx[k], dN*del, op, matchInds, &nextRes);
+          mstreal tot = 0;
+          for (mstreal w : weights) tot += w;
+          for (int j = 0; j < matchInds.size(); j++) {
+            cands[k].push_back(candidate{k, matchInds[j], beam[k].logProb + log(weights[j]/tot), nextRes[j]});
+          }
+        });
+        vector<candidate> all;
+        for (int k = 0; k < nb; k++) all.insert(all.end(), cands[k].begin(), cands[k].end());
+        sort(all.begin(), all.end(), [](const candidate& a, const candidate& b) { return a.logProb > b.logProb; });
+
+        // keep the B most probable, skipping ones that would add (nearly) the
+        // same residue to the same chain as a more probable one
+        vector<candidate> kept;
+        for (int j = 0; (j < all.size()) && (kept.size() < B); j++) {
+          bool redundant = false;
+          for (const candidate& other : kept) {
+            if ((other.parent == all[j].parent) && (other.nextRes.size() == all[j].nextRes.size()) && (RMSDCalculator::rmsd(other.nextRes, all[j].nextRes) < 0.5)) { redundant = true; break; }
+          }
+          if (!redundant) kept.push_back(all[j]);
+        }
+        if (kept.empty()) {
+          cout << "	no suitable matches for any chain, stopping current direction..." << endl;
+          for (candidate& cand : all) cand.nextRes.deletePointers();
+          break;
+        }
+
+        cout << "fusing " << kept.size() << " extensions..." << endl;
+        vector<growthState> next(kept.size());
+        MstUtils::parallelFor(kept.size(), numThreads, [&](int j, int) {
+          const candidate& cand = kept[j];
+          next[j].S = extendByMatch(beam[cand.parent].S, F, matchLists[cand.parent][cand.match], termResIndices[cand.parent], cresIdx[cand.parent], nc, del, dN, pm, fuserOpts);
+          next[j].logProb = cand.logProb;
+        });
+        for (candidate& cand : all) cand.nextRes.deletePointers();
+        beam = next;
+        out << "MODEL " << i+1 << endl;
+        beam[0].S.writePDB(out); out << "ENDMDL" << endl;
+      }
+    }
+    out.close();
+    for (int k = 0; k < beam.size(); k++) {
+      cout << "chain " << k+1 << " has log-probability " << beam[k].logProb << endl;
+      beam[k].S.writePDB(op.getString("o") + ".beam" + MstUtils::toString(k+1) + ".pdb");
+    }
+    return 0;
+  }
+
   for (int nc = 0; nc < 2; nc++) {
     int del = nc ? -1 : 1;
     int c = 0;
@@ -184,22 +351,10 @@ int main(int argc, char** argv) {
     int N = op.getInt("L");
     for (int i = 0; i < N; i++) {
       cout << "growing in the " << (nc ? "N" : "C") << "-terminal direction, cycle " << i+1 << endl;
-      ConFind C(&RL, S);
-
       // define TERM at the terminus
       cout << "selecting TERM..." << endl;
-      vector<int> termResIndices;
-      Chain* cChain = &(nc ? S[0] : S.getChain(S.chainSize() - 1)); // default chain of residues to grow
-      if (op.isGiven("cid")) {
-        Chain* cChain = S.getChainByID(op.getString("cid"));
-        MstUtils::assertCond(cChain != NULL, "did not find chain with ID " + op.getString("cid"));
-      } else if (op.isGiven("sid")) {
-        Chain* cChain = S.getChainBySegID(op.getString("sid"));
-        MstUtils::assertCond(cChain != NULL, "did not find segment with ID " + op.getString("sid"));
-      }
-      Residue* cres = &(nc ? cChain->getResidue(0) : cChain->getResidue(cChain->residueSize() - 1));
-      Structure term = TERMUtils::selectTERM({cres}, C, pm, cdCut, &termResIndices);
-      int cresIdx = MstUtils::indexMap(termResIndices).at(cres->getResidueIndex());
+      vector<int> termResIndices; int cresIdx;
+      Structure term = selectGrowthTERM(S, RL, nc, op, pm, cdCut, termResIndices, cresIdx);
       cout << AtomPointerVector(term.getAtoms()) << endl;
 
       // find matches to it
@@ -225,38 +380,8 @@ int main(int argc, char** argv) {
         }
       }
       cout << "fusing..." << endl;
-      vector<int> resIndices = F.getMatchResidueIndices(matchList[m], FASST::matchType::REGION);
-      Structure match = F.getMatchStructure(matchList[m], false, FASST::matchType::FULL, true);
-      vector<vector<Residue*> > resTopo(S.residueSize(), vector<Residue*>());
-      for (int ri = 0; ri < S.residueSize(); ri++) resTopo[ri].push_back(&(S.getResidue(ri)));
-      vector<bool> isFixed(resTopo.size(), true);
-      for (int ri = 0; ri < resIndices.size(); ri++) {
-        resTopo[termResIndices[ri]].push_back(&(match.getResidue(resIndices[ri])));
-        for (int d = -pm; d <= pm; d++) {
-          int idx = termResIndices[ri] + d;
-          if ((idx >= 0) && (idx < S.residueSize())) isFixed[idx] = false;
-        }
-      }
-
-      // extend the match by dN residues
-      for (int ii = 1; ii <= dN; ii++) {
-        int nextIdx = resIndices[cresIdx] + ii*del;
-        vector<Residue*> newPos(1, &(match.getResidue(nextIdx)));
-        if (nc) {
-          resTopo.insert(resTopo.begin(), newPos);
-          isFixed.insert(isFixed.begin(), false);
-        } else {
-          resTopo.push_back(newPos);
-          isFixed.push_back(false);
-        }
-      }
-
-      vector<int> fixed;
-      for (int ri = 0; ri < isFixed.size(); ri++) {
-        if (isFixed[ri]) fixed.push_back(ri);
-      }
       Sp = S;
-      S = Fuser::fuse(resTopo, fixed, fuserOpts);
+      S = extendByMatch(S, F, matchList[m], termResIndices, cresIdx, nc, del, dN, pm, fuserOpts);
       out << "MODEL " << c+1 << endl;
       S.writePDB(out); out << "ENDMDL" << endl;
       c++;
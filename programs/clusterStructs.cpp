@@ -21,6 +21,7 @@ int main(int argc, char *argv[]) {
   op.addOption("r", "RMSD cutoff to use for the clustering (greedy clustering is done).", true);
   op.addOption("oc", "optional: base name for outputing clusters as PDB files.");
   op.addOption("os", "optional: file name for outputing cluster sequences.");
+  op.addOption("j", "optional: number of threads to cluster with (default 1).");
   op.setOptions(argc, argv);
   double rmsdCut = op.getReal("r");
   string obasePDB = op.getString("oc", "");
@@ -39,6 +40,7 @@ int main(int argc, char *argv[]) {
 
   // cluster
   Clusterer C;
+  C.setNumThreads(op.getInt("j", 1));
   vector<vector<int>> clusters = C.greedyCluster(backbones, rmsdCut, 1000);
 
   // output clusters
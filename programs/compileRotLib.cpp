@@ -0,0 +1,22 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstrotlib.h"
+
+using namespace MST;
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Compiles a rotamer library into the mmap-able format, which programs taking a rotamer library load in milliseconds (and processes on the same host share). Options:");
+  op.addOption("i", "input rotamer library (in the original binary format, or already compiled).", true);
+  op.addOption("o", "output compiled rotamer library.", true);
+  op.setOptions(argc, argv);
+
+  RotamerLibrary RL(op.getString("i"));
+  RL.writeCompiledLibrary(op.getString("o"));
+  int numBins = 0, numRots = 0;
+  for (int ai = 0; ai < RL.numberOfAminoAcids(); ai++) {
+    for (int bi = 0; bi < RL.numberOfBackboneBins(ai); bi++) numRots += RL.numberOfRotamers(ai, bi);
+    numBins += RL.numberOfBackboneBins(ai);
+  }
+  cout << "compiled " << RL.numberOfAminoAcids() << " amino acids, " << numBins << " backbone bins, and " << numRots << " rotamers into " << op.getString("o") << endl;
+}
@@ -32,6 +32,8 @@ int main(int argc, char** argv) {
   op.addOption("b", "binary FASST database to use.", true);
   op.addOption("o", "output base name.", true);
   op.addOption("tol", "RMSD tolerance to consider the trajectory as having arrived at the last structure.");
+  op.addOption("j", "number of threads to search with (default 1).");
+  op.addOption("cold", "search from scratch at each step, rather than seeding each search with the matches of the previous one.");
   op.setOptions(argc, argv);
   RMSDCalculator rc;
 
@@ -44,6 +46,7 @@ int main(int argc, char** argv) {
   FASST F;
   F.readDatabase(op.getString("b"), 1);
   F.setRedundancyCut(0.5);
+  F.setNumThreads(op.getInt("j", 1));
 
   // start the trajectory output
   int c = 0;
@@ -73,12 +76,12 @@ int main(int argc, char** argv) {
     F.setMaxNumMatches(currNumMatches);
     F.setMinNumMatches(currNumMatches);
     fasstSolutionSet matchList = F.search();
+    // consecutive points are close, so the matches of this one make a good
+    // starting point for the next search (or for this one, with more matches)
+    if (!op.isGiven("cold")) F.setWarmStart(matchList);
 
-    // identify the one closest to the final point
-    vector<mstreal> rmsds(matchList.size());
-    for (int i = 0; i < matchList.size(); i++) {
-      rmsds[i] = rc.bestRMSD(RotamerLibrary::getBackbone(E), F.getMatchStructure(matchList[i]).getAtoms());
-    }
+    // identify the one closest to the final point (all candidates at once)
+    vector<mstreal> rmsds = F.matchRMSDs(matchList, RotamerLibrary::getBackbone(E));
     int mi; MstUtils::min(rmsds, -1, -1, &mi);
     if (c > 0) {
       if (prevMatch == matchList[mi].getAddress()) {
@@ -21,6 +21,9 @@ int main(int argc, char *argv[]) {
   op.addOption("aa3", "accept 3 letter amino acid codes (not 1 letter) for input to --seq");
   op.addOption("o", "output base.", true);
   op.addOption("w", "if specified, will write to a file with extension .dat all TERM data that are used for energy-table calculation.");
+  op.addOption("j", "number of threads to compute the energy table and run Monte Carlo chains with (default is 1). With more than one thread, the Monte Carlo cycles run as independent chains (see EnergyTable::mcParallel).");
+  op.addOption("store", "a file with a store of TERM matches to reuse across designs on the same template. If the file exists, searches for TERMs in it are "
+                        "skipped; the store, with any new searches added, is written back at the end.");
   op.setOptions(argc, argv);
 
   Structure So(op.getString("p")), S;
@@ -82,8 +85,14 @@ int main(int argc, char *argv[]) {
     }
   } else {
     if (!MstSys::fileExists(etabFile)) {
-      dTERMen D(op.getString("c"));
+      dTERMen D;
+      D.setNumThreads(op.getInt("j", 1)); // before reading the configuration, so background potentials are built with these threads too
+      D.readConfigFile(op.getString("c"));
       if (op.isGiven("w")) D.setRecordFlag(true);
+      if (op.isGiven("store")) {
+        if (MstSys::fileExists(op.getString("store"))) D.readMatchStore(op.getString("store"));
+        else D.setMatchStoreFlag(true);
+      }
       if (specContext.empty()) {
         E = D.buildEnergyTable(variable, vector<vector<string>>(), images);
         E.writeToFile(etabFile);
@@ -93,13 +102,14 @@ int main(int argc, char *argv[]) {
         specE.writeToFile(specEtabFile);
       }
       if (op.isGiven("w")) D.writeRecordedData(op.getString("o") + ".dat");
+      if (op.isGiven("store")) D.writeMatchStore(op.getString("store"));
     } else {
       cout << "reading previous energy table from " << etabFile << endl;
       E.readFromFile(etabFile);
       if (E.numSites() != variable.size()) MstUtils::error("pre-existing energy table has " + MstUtils::toString(E.numSites()) + " sites, while "  + MstUtils::toString(variable.size()) + " are selected for design");
     }
 
-    vector<int> bestSol = E.mc(100, 1000000, 1.0, 0.01);
+    vector<int> bestSol = (op.getInt("j", 1) > 1) ? E.mcParallel(100, 1000000, 1.0, 0.01, 1, op.getInt("j")) : E.mc(100, 1000000, 1.0, 0.01);
     mstreal lowE = E.scoreSolution(bestSol);
     bestSeq = E.solutionToSequence(bestSol);
     Sequence origSeq(variable);
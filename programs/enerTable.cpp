@@ -34,12 +34,17 @@ int main(int argc, char *argv[]) {
   op.addOption("e", "Energy table file.", true);
   op.addOption("p", "PDB file. If provided, will score the sequence of the structure. Note: must have the same number of residues as the energy table.");
   op.addOption("s", "Single-letter amino-acid sequence. If provided, will score. Must have the same number of residues as the energy table");
+  op.addOption("sf", "file with single-letter amino-acid sequences, one per line. If provided, will score all of them (in bulk, see EnergyTable::scoreSequences), writing each score and sequence on a line of the output.");
   op.addOption("opt", "If provided, will perform MCMC simulated annealing to find the optimal sequence with default parameters. If an integer is specified, will use this many iterations per cycle (otherwise 1E6 by default).");
   op.addOption("kTi", "if --opt is given, this will set the initial sampling temperature (default is 1.0).");
   op.addOption("kTf", "if --opt is given, this will set the final annealed temperature (default is 0.1).");
   op.addOption("lc", "if --opt is givem, will add a low-complexity penalty to the energy scaled by this factor (should be positive).");
   op.addOption("fcut", "if --opt is given, will set a limit on the fraction of positions allowed to be occupied by a single amino acid type. If specified, will use the simpler complexity penalty rather than the one based on number of arrangements of the letter distribution.");
   op.addOption("cyc", "if --opt is given, this will set the number of MC cycles to run (default is 100).");
+  op.addOption("j", "number of threads to use: with --opt, will run MC cycles as independent chains on this many threads (see EnergyTable::mcParallel); with --sf, will score sequences on this many threads.");
+  op.addOption("rex", "if --opt is given, will run the cycles as replica-exchange chains, at temperatures between --kTi and --kTf, attempting swaps every this many iterations.");
+  op.addOption("exact", "if given, will find the lowest-energy sequences deterministically, by dead-end elimination and A* search (see EnergyTable::optimalSolutions). If an integer is specified, will find this many of the lowest-energy sequences (otherwise just one).");
+  op.addOption("maxTime", "if --exact is given, the limit on the search time in seconds (default is no limit).");
   op.addOption("randomSeed","If --randomSeed is given, will set a new random seed each time the program is run. Otherwise will use the same random seed and provide consistent results");
   op.addOption("o", "output file name of the energy table in case it needs to be written.");
   op.addOption("es", "indicates that the energy table is written in single-letter code for residue names rather than three-letter code");
@@ -72,27 +77,37 @@ int main(int argc, char *argv[]) {
     cout << score << " " << seq.toString() << endl;
   }
 
+  if (op.isGiven("sf")) E.scoreSequences(op.getString("sf"), cout, op.getInt("j", 1));
+
   // print mean and standard deviation
   if (op.isGiven("m")) cout << "mean " << E.meanEnergy() << endl;
   if (op.isGiven("std")) cout << "stdev " << E.energyStdEst(op.isInt("std") ? op.getInt("std") : 1000) << endl;
 
+  if (op.isGiven("exact")) {
+    bool optimal;
+    vector<vector<int>> best = E.optimalSolutions(op.isInt("exact") ? op.getInt("exact") : 1, op.getReal("maxTime", -1), -1, &optimal);
+    if (!optimal) cout << "search did not finish within limits, so the following are not guaranteed to be the best sequences" << endl;
+    for (int i = 0; i < best.size(); i++) cout << (E.solutionToSequence(best[i])).toString() << " " << E.scoreSolution(best[i]) << endl;
+  }
+
   if (op.isGiven("opt")) {
     int Ni = 1000000;
     if (op.isInt("opt")) Ni = op.getInt("opt");
     vector<int> lastSol;
     auto recordLast = [](void* cont, const vector<int>& sol, mstreal ener) { *((vector<int>*) cont) = sol; };
     vector<int> bestSol;
+    mstreal lcsf = op.getReal("lc", 0);
+    mstreal params[] = {lcsf, op.getReal("fcut", 0)};
+    void* extra = NULL;
+    mstreal (*penalty)(void*, const vector<int>&, EnergyTable&, int, int) = NULL;
     if (op.isGiven("lc")) {
-
-      if (op.isGiven("fcut")) {
-        mstreal params[] = {op.getReal("lc"), op.getReal("fcut")};
-        bestSol = E.mc(op.getInt("cyc", 100), Ni, op.getReal("kTi", 10.0), op.getReal("kTf", 0.1), 1, &lastSol, recordLast, -1, &params, &sequenceComplexityPenaltySimple);
-      } else {
-        mstreal lcsf = op.getReal("lc");
-        bestSol = E.mc(op.getInt("cyc", 100), Ni, op.getReal("kTi", 10.0), op.getReal("kTf", 0.1), 1, &lastSol, recordLast, -1, &lcsf, &sequenceComplexityPenalty);
-      }
+      if (op.isGiven("fcut")) { extra = &params; penalty = &sequenceComplexityPenaltySimple; }
+      else { extra = &lcsf; penalty = &sequenceComplexityPenalty; }
+    }
+    if (op.isGiven("j") || op.isGiven("rex")) {
+      bestSol = E.mcParallel(op.getInt("cyc", 100), Ni, op.getReal("kTi", 10.0), op.getReal("kTf", 0.1), 1, op.getInt("j", 1), op.getInt("rex", 0), &lastSol, recordLast, -1, extra, penalty);
     } else {
-      bestSol = E.mc(op.getInt("cyc", 100), Ni, op.getReal("kTi", 10.0), op.getReal("kTf", 0.1), 1, &lastSol, recordLast);
+      bestSol = E.mc(op.getInt("cyc", 100), Ni, op.getReal("kTi", 10.0), op.getReal("kTf", 0.1), 1, &lastSol, recordLast, -1, extra, penalty);
     }
     if (!lastSol.empty()) cout << "last sequence visited: " << (E.solutionToSequence(lastSol)).toString() << endl;
     cout << "lowest-energy sequence found: " << (E.solutionToSequence(bestSol)).toString() << endl;
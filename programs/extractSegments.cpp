@@ -45,18 +45,112 @@ mstreal scoreAlignmentSegment(const vector<Sequence>& M, const vector<int>& posi
   return score;
 }
 
+/* Fast scoring of alignment segments, equivalent to scoreAlignmentSegment().
+ * The MSA is stored column by column as small integer codes, identical
+ * sequences are collapsed into one row with a multiplicity, and scores of
+ * segments already seen are cached. Scoring is safe from several threads. */
+class segmentScorer {
+  public:
+    segmentScorer(const vector<Sequence>& M) {
+      N = M.size();
+      L = M.empty() ? 0 : M[0].length();
+      // collapse identical sequences
+      map<Sequence, int> uniq;
+      for (int i = 0; i < M.size(); i++) uniq[M[i]]++;
+      U = uniq.size();
+      cols.assign(L, vector<int>(U));
+      counts.reserve(U);
+      vector<map<res_t, int>> codes(L);
+      int k = 0;
+      for (auto it = uniq.begin(); it != uniq.end(); ++it, ++k) {
+        counts.push_back(it->second);
+        for (int p = 0; p < L; p++) {
+          map<res_t, int>& code = codes[p];
+          auto c = code.find(it->first[p]);
+          if (c == code.end()) c = code.insert(make_pair(it->first[p], code.size())).first;
+          cols[p][k] = c->second;
+        }
+      }
+    }
+
+    mstreal score(const vector<int>& positions) {
+      // the cache is keyed on the set of positions
+      string key(L, 0);
+      for (int p : positions) key[p] = 1;
+      {
+        lock_guard<mutex> guard(cacheLock);
+        auto it = cache.find(key);
+        if (it != cache.end()) return it->second;
+      }
+
+      // group sequences by their sub-sequence, refining the grouping one column at a time
+      vector<int> group(U, 0);
+      int numGroups = 1;
+      unordered_map<long, int> refined;
+      for (int p : positions) {
+        refined.clear();
+        const vector<int>& col = cols[p];
+        for (int k = 0; k < U; k++) {
+          long id = ((long) group[k]) * U + col[k];
+          auto it = refined.find(id);
+          if (it == refined.end()) it = refined.insert(make_pair(id, (int) refined.size())).first;
+          group[k] = it->second;
+        }
+        numGroups = refined.size();
+      }
+      vector<int> f(numGroups, 0);
+      for (int k = 0; k < U; k++) f[group[k]] += counts[k];
+
+      // negative Shannon entropy, with the same small-sample correction as scoreAlignmentSegment()
+      int P = numGroups;
+      mstreal H = 0;
+      for (int g = 0; g < numGroups; g++) {
+        mstreal fg = f[g]*1.0/N;
+        H -= fg * log(fg);
+      }
+      H += P/(2*N);
+      mstreal score = -H;
+
+      lock_guard<mutex> guard(cacheLock);
+      cache[key] = score;
+      return score;
+    }
+
+    mstreal score(const vector<vector<int>>& segments) {
+      mstreal s = 1;
+      for (int i = 0; i < segments.size(); i++) s = MstUtils::min(s, score(segments[i]));
+      return s;
+    }
+
+  private:
+    int N, L, U;                  // number of sequences, positions, and unique sequences
+    vector<vector<int>> cols;     // cols[p][k] is the code of the residue at position p of unique sequence k
+    vector<int> counts;           // multiplicity of each unique sequence
+    unordered_map<string, mstreal> cache;
+    mutex cacheLock;
+};
+
 mstreal scoreAlignmentSegments(const vector<Sequence>& M, const vector<vector<int>>& segments) {
   mstreal score = 1;
   for (int i = 0; i < segments.size(); i++) score = MstUtils::min(score, scoreAlignmentSegment(M, segments[i]));
   return score;
 }
 
-vector<vector<int>> optimalSplit(const vector<Sequence>& M, const vector<int>& positions, bool verbose = false) {
+/* Independent MC runs, each from a random split, are done in parallel (each
+ * with its own random stream, seeded from the global one), and the best split
+ * found by any of them is returned. */
+vector<vector<int>> optimalSplit(segmentScorer& scorer, const vector<int>& positions, int numThreads = 1, bool verbose = false) {
   if (positions.size() < 2) MstUtils::error("have to have at least two positions to split!");
-  vector<vector<int>> bestSegments; mstreal bestScore;
-  for (int c = 0; c < 10; c++) {
+  int numRuns = 10;
+  vector<unsigned> seeds(numRuns);
+  for (int c = 0; c < numRuns; c++) seeds[c] = MstUtils::randEngine()();
+  vector<vector<vector<int>>> runSegments(numRuns);
+  vector<mstreal> runScores(numRuns);
+  MstUtils::parallelFor(numRuns, numThreads, [&](int c, int) {
+    MstUtils::seedRandEngine(seeds[c]);
     // start with a random split
-    vector<vector<int>> segments(2);
+    vector<vector<int>>& segments = runSegments[c];
+    segments.resize(2);
     if (MstUtils::randUnit() < 0.5) { segments[0].push_back(positions[0]); segments[1].push_back(positions[1]); }
     else { segments[0].push_back(positions[1]); segments[1].push_back(positions[0]); }
     for (int i = 2; i < positions.size(); i++) {
@@ -65,7 +159,7 @@ vector<vector<int>> optimalSplit(const vector<Sequence>& M, const vector<int>& p
     }
 
     // now do MC sampling that randomly moves positions between segments and scores
-    mstreal score = scoreAlignmentSegments(M, segments);
+    mstreal score = scorer.score(segments);
     if (verbose) {
       cout << "------------" << endl;
       cout << "segments[0] = " << MstUtils::vecToString(segments[0]) << endl;
@@ -82,7 +176,7 @@ vector<vector<int>> optimalSplit(const vector<Sequence>& M, const vector<int>& p
       segments[fromSide].erase(segments[fromSide].begin() + idx);
 
       // score
-      mstreal newScore = scoreAlignmentSegments(M, segments);
+      mstreal newScore = scorer.score(segments);
 
       // accept or reject
       if (newScore > score) {
@@ -97,13 +191,14 @@ vector<vector<int>> optimalSplit(const vector<Sequence>& M, const vector<int>& p
         segments[toSide].pop_back();
       }
     }
-    if ((c == 0) || (score > bestScore)) {
-      bestScore = score;
-      bestSegments = segments;
-    }
-  }
+    runScores[c] = score;
+  });
 
-  return bestSegments;
+  int best = 0;
+  for (int c = 1; c < numRuns; c++) {
+    if (runScores[c] > runScores[best]) best = c;
+  }
+  return runSegments[best];
 }
 
 int main(int argc, char *argv[]) {
@@ -117,6 +212,7 @@ int main(int argc, char *argv[]) {
   op.addOption("nc", "number of MC cycles. One sequence will be taken from each cycle (the one sampled last).");
   op.addOption("ni", "number of iteration per cycle");
   op.addOption("kTf", "if specified, will anneal from the temperature specified by --kT to this temperature during sampling.");
+  op.addOption("j", "number of threads for searching for optimal splits (default 1).");
   op.setOptions(argc, argv);
   if (!op.isGiven("f") && !op.isGiven("s") && !op.isGiven("e")) { cout << op.usage(); MstUtils::error("neither --f, --s, nor --e were given"); }
   vector<Sequence> M;
@@ -125,6 +221,7 @@ int main(int argc, char *argv[]) {
 
   long int x = std::chrono::time_point_cast<std::chrono::nanoseconds>(std::chrono::high_resolution_clock::now()).time_since_epoch().count();
   srand(x);
+  MstUtils::seedRandEngine(x);
 
   if (op.isGiven("e")) {
     MstUtils::assertCond(op.isGiven("nc") && op.isGiven("ni") && op.isGiven("kT"), "not all MC-related parameters are specifieed");
@@ -186,12 +283,13 @@ int main(int argc, char *argv[]) {
     cout << "before splitting:" << endl;
     vector<vector<int>> segments(1, MstUtils::range(0, (int) M[0].size()));
     scoreAlignmentSegment(M, segments[0], true);
+    segmentScorer scorer(M);
     for (int c = 0; c < 2; c++) {
       cout << "cycle " << c << endl;
       vector<vector<int>> newSegments;
       for (int i = 0; i < segments.size(); i++) {
         cout << "\tsplitting segment " << i << ": " << MstUtils::vecToString(MstUtils::keys(MstUtils::contents(segments[i]))) << endl;
-        vector<vector<int>> split = optimalSplit(M, segments[i]);
+        vector<vector<int>> split = optimalSplit(scorer, segments[i], op.getInt("j", 1));
         cout << "\n\t\tsub-segment 0: " << MstUtils::vecToString(MstUtils::keys(MstUtils::contents(split[0]))) << endl;
         scoreAlignmentSegment(M, split[0], true);
         cout << "\n\t\tsub-segment 1: " << MstUtils::vecToString(MstUtils::keys(MstUtils::contents(split[1]))) << endl;
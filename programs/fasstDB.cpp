@@ -16,6 +16,9 @@ int main(int argc, char *argv[]) {
   op.addOption("dL", "a file with a list of FASST databases (will consolidate into one).");
   op.addOption("o", "output database file name.", true);
   op.addOption("m", "memory save flag (will store backbone only).");
+  op.addOption("mmap", "write the output database in the memory-mapped format, which is searched in place without being read into memory (backbone only; all residues must be searchable, so consider --c).");
+  op.addOption("sidx", "segment lengths (in residues) for which to build a segment descriptor index, which lets searches skip windows that cannot match. Either a comma-separated list (e.g., '3,5,7') or a range (e.g., '3-9'). The index is written next to the output database, as <out>.sidx, and is loaded along with it.");
+  op.addOption("j", "number of threads with which to read and clean up the files in --pL, compute per-target properties, and search for similar windows with --sim (default is 1). Everything is done within this one process, so on a single large machine this can take the place of --batch. Files may be PDB or mmCIF (by extension), and either may be gzipped.");
   op.addOption("c", "clean up PDB files, so that only protein residues with enough of a backbone to support rotamer building survive.");
   op.addOption("s", "split final PDB files into chains by connectivity. Among other things, this avoids \"gaps\" within chains (where missing residues would go), which may simplify redundancy identification.");
   op.addOption("pp", "store phi/psi/omega properties in the database.");
@@ -24,7 +27,7 @@ int main(int argc, char *argv[]) {
   op.addOption("contSeq", "store a specific version of inter-residue contact information which is calculated with amino acid constraints (for all residue pairs with contact degrees above the specified threshold). If this is given, --rLib must also be given.");
   op.addOption("int", "store residue to backbone contact information (for all residue pairs with contact degrees above the specified threshold). If this is given, --rLib must also be given.");
   op.addOption("bb", "store the minimum distance between backbone atoms of two residues (for all residue pairs below the specified cutoff).");
-  op.addOption("stride", "store residue secondary structure classifications computed by STRIDE (external program). Argument must be the path to a STRIDE binary file.");
+  op.addOption("stride", "store residue secondary structure classifications (in the STRIDE alphabet). If an argument is given, it must be the path to a STRIDE binary file, which will be run on every target (external program). Otherwise, classifications are computed within this process, from backbone hydrogen bonds (as DSSP does).");
   op.addOption("sim", "percent sequence identity cutoff. If specified, will store local-window sequence similarity between all pairs of positions in the database, using this cutoff.");
   op.addOption("win", "window size to use with the similarity searching with --sim; must be an odd integer. Default is 31 (i.e., +/- 15 from the residue in question).");
   op.addOption("rLib", "path to an MST rotamer library file.");
@@ -49,6 +52,21 @@ int main(int argc, char *argv[]) {
   if (op.isGiven("sim") && (!op.isReal("sim") || (op.getReal("sim") < 0) || (op.getReal("sim") > 100))) MstUtils::error("--sim must be a non-negative value below 100.");
   if (op.isGiven("win") && (!op.isInt("win") || (op.getInt("win") <= 0) || (op.getInt("win") % 2 == 0))) MstUtils::error("--win must be a positive odd integer.");
   short memSave = op.isGiven("m");
+  vector<int> indexLengths;
+  if (op.isGiven("sidx")) {
+    string spec = op.getString("sidx");
+    if (spec.find("-") != string::npos) {
+      vector<string> range = MstUtils::split(spec, "-");
+      if (range.size() != 2) MstUtils::error("could not parse --sidx range '" + spec + "'");
+      for (int L = MstUtils::toInt(range[0]); L <= MstUtils::toInt(range[1]); L++) indexLengths.push_back(L);
+    } else {
+      vector<string> lens = MstUtils::split(spec, ",");
+      for (int i = 0; i < lens.size(); i++) indexLengths.push_back(MstUtils::toInt(lens[i]));
+    }
+    for (int i = 0; i < indexLengths.size(); i++) {
+      if (indexLengths[i] <= 0) MstUtils::error("--sidx lengths must be positive integers");
+    }
+  }
   
   // create map of prop names for contact degree with amino acid constraints
   vector<string> aaNames = {"ARG", "ASN", "ASP", "CYS", "GLN", "GLU", "HIS", "ILE", "LEU",
@@ -61,21 +79,33 @@ int main(int argc, char *argv[]) {
     cout << "Reading structures..." << endl;
     if (op.isGiven("pL")) {
       vector<string> pdbFiles = MstUtils::fileToArray(op.getString("pL"));
-      for (int i = 0; i < pdbFiles.size(); i++) {
-        Structure P(pdbFiles[i]);
-        if (op.isGiven("c")) {
-          Structure C; RotamerLibrary::extractProtein(C, P);
-          if (P.residueSize() != C.residueSize()) {
-            cout << pdbFiles[i] << ", had " << P.residueSize() << " residues, and " << C.residueSize() << " residues after cleaning..." << endl;
+      // files are parsed in parallel, a batch at a time, but added in order
+      int numThreads = op.getInt("j", 1), batchSize = 16 * numThreads;
+      for (int b = 0; b < pdbFiles.size(); b += batchSize) {
+        vector<string> batchFiles(pdbFiles.begin() + b, pdbFiles.begin() + min(b + batchSize, (int) pdbFiles.size()));
+        vector<Structure*> batch = Structure::readMany(batchFiles, numThreads);
+        // clean up in parallel too, keeping any messages in order
+        vector<string> notes(batch.size());
+        MstUtils::parallelFor(batch.size(), numThreads, [&](int k, int) {
+          Structure& P = *(batch[k]);
+          if (op.isGiven("c")) {
+            Structure C; RotamerLibrary::extractProtein(C, P);
+            if (P.residueSize() != C.residueSize()) {
+              notes[k] = batchFiles[k] + ", had " + MstUtils::toString(P.residueSize()) + " residues, and " + MstUtils::toString(C.residueSize()) + " residues after cleaning...";
+            }
+            C.setName(P.getName()); P = C;
           }
-          C.setName(P.getName()); P = C;
-        }
-        if (op.isGiven("s")) {
-          P = P.reassignChainsByConnectivity();
-          P.deleteShortChains();
+          if (op.isGiven("s")) {
+            P = P.reassignChainsByConnectivity();
+            P.deleteShortChains();
+          }
+        });
+        for (int k = 0; k < batch.size(); k++) {
+          if (!notes[k].empty()) cout << notes[k] << endl;
+          if (batch[k]->residueSize() != 0) S.addTarget(*(batch[k]), memSave);
+          else cout << "skipping " << batchFiles[k] << " as it ends up having no residues..." << endl;
+          delete batch[k];
         }
-        if (P.residueSize() != 0) S.addTarget(P, memSave);
-        else cout << "skipping " << pdbFiles[i] << " as it ends up having no residues..." << endl;
       }
     }
     if (op.isGiven("db")) {
@@ -106,49 +136,45 @@ int main(int argc, char *argv[]) {
     }
     if (op.isGiven("pp") || op.isGiven("env") || op.isGiven("cont") || op.isGiven("contSeq") || op.isGiven("int") || op.isGiven("bb") || op.isGiven("stride")) {
       cout << "Computing per-target residue properties..." << endl;
-      // compute and add some properties
-      for (int ti = 0; ti < S.numTargets(); ti++) {
-        cout << "\ttarget " << ti+1 << "/" << S.numTargets() << "..." << endl;
+      // properties of each target, computed independently of other targets
+      // residue-pair values, in the row form of contactList::pairTable
+      struct pairRows {
+        vector<int> rowLen, partners;
+        vector<mstreal> vals;
+      };
+      struct targetProps {
+        vector<mstreal> phi, psi, omega, env;
+        vector<string> stride;
+        pairRows cont, interfering, interfered, bb;
+        map<string, map<int, map<int, mstreal> > > contSeq;
+      };
+      auto computeProps = [&](int ti, targetProps& props) {
         Structure P = S.getTargetCopy(ti);
-        if (op.isGiven("pp")) {
-          vector<Residue*> residues = P.getResidues();
-          vector<mstreal> phi(residues.size()), psi(residues.size()), omega(residues.size());
-          for (int ri = 0; ri < residues.size(); ri++) {
-            phi[ri] = residues[ri]->getPhi(false);
-            psi[ri] = residues[ri]->getPsi(false);
-            omega[ri] = residues[ri]->getOmega(false);
-          }
-          S.addResidueProperties(ti, "phi", phi);
-          S.addResidueProperties(ti, "psi", psi);
-          S.addResidueProperties(ti, "omega", omega);
-        }
+        if (op.isGiven("pp")) P.backboneDihedrals(props.phi, props.psi, props.omega);
         if (op.isGiven("stride")) {
           string strideBin = op.getString("stride","");
-          strideInterface stride(strideBin,&P);
-          stride.computeSTRIDEClassifications();
-          vector<string> strideSSType = stride.getSTRIDEClassifications();
-          S.addResidueStringProperties(ti, "stride", strideSSType);
+          if (strideBin.empty()) {
+            props.stride = secondaryStructureAssigner::assign(P);
+          } else {
+            // STRIDE files are named after the structure, so keep them distinct between threads
+            Structure Q = P; Q.setName(MstSys::splitPath(P.getName(), 1) + "_" + MstUtils::toString(ti));
+            strideInterface stride(strideBin,&Q);
+            stride.computeSTRIDEClassifications();
+            props.stride = stride.getSTRIDEClassifications();
+          }
         }
         if (op.isGiven("env") || op.isGiven("cont") || op.isGiven("contSeq") || op.isGiven("int") || op.isGiven("bb")) {
           ConFind C(&RL, P); // both need the confind object
           // environment
           if (op.isGiven("env")) {
             vector<Residue*> residues = P.getResidues();
-            vector<mstreal> freedoms = C.getFreedom(residues);
-            S.addResidueProperties(ti, "env", freedoms);
+            props.env = C.getFreedom(residues);
           }
           // contact degree
           if (op.isGiven("cont")) {
             mstreal cdcut = op.getReal("cont");
             contactList list = C.getContacts(P, cdcut);
-            map<int, map<int, mstreal> > conts;
-            for (int i = 0; i < list.size(); i++) {
-              int rA = list.residueA(i)->getResidueIndex();
-              int rB = list.residueB(i)->getResidueIndex();
-              conts[rA][rB] = list.degree(i);
-              conts[rB][rA] = list.degree(i);
-            }
-            S.addResiduePairProperties(ti, "cont", conts);
+            list.pairTable(P.residueSize(), props.cont.rowLen, props.cont.partners, props.cont.vals);
           }
           // contact degree, with amino acid constraints
           /* Contact degree is calculated between residues i and j, with the rotamers at position i
@@ -159,10 +185,10 @@ int main(int argc, char *argv[]) {
           if (op.isGiven("contSeq")) {
             mstreal cdcut = op.getReal("contSeq");
             contactList list = C.getConstrainedContacts(P.getResidues(), cdcut);
-            
+
             set<string> aaNames = C.getAANames();
             for (string aa : aaNames) {
-              map<int, map<int, mstreal> > conts;
+              map<int, map<int, mstreal> >& conts = props.contSeq[aa];
               for (int i = 0; i < list.size(); i++) {
                 const set<string>& alphaA = list.alphabetA(i);
                 // skip if the A alphabet does not match current aa
@@ -171,7 +197,6 @@ int main(int argc, char *argv[]) {
                 int rB = list.residueB(i)->getResidueIndex();
                 conts[rA][rB] = list.degree(i);
               }
-              S.addResiduePairProperties(ti, aaToProp[aa], conts);
             }
           }
           // interference
@@ -182,35 +207,50 @@ int main(int argc, char *argv[]) {
            map with residues whose sidechains are interfered by the backbone of res. Note that while
            these store the exact same info, they simplify access.
            */
-            if (op.isGiven("int")) {
-                mstreal incut = op.getReal("int");
-                contactList list = C.getInterference(P, incut);
-                map<int, map<int, mstreal> > interfering;
-                map<int, map<int, mstreal> > interfered;
-                for (int i = 0; i < list.size(); i++) {
-                    // rB backbone interferes with rA sidechain
-                    int rA = list.residueA(i)->getResidueIndex();
-                    int rB = list.residueB(i)->getResidueIndex();
-                    interfering[rA][rB] = list.degree(i);
-                    interfered[rB][rA] = list.degree(i);
-                }
-                S.addResiduePairProperties(ti, "interfering", interfering);
-                S.addResiduePairProperties(ti, "interfered", interfered);
-            }
+          if (op.isGiven("int")) {
+            mstreal incut = op.getReal("int");
+            contactList list = C.getInterference(P, incut);
+            // the backbone of residue B interferes with the sidechain of A
+            list.pairTable(P.residueSize(), props.interfering.rowLen, props.interfering.partners, props.interfering.vals, true, false);
+            list.pairTable(P.residueSize(), props.interfered.rowLen, props.interfered.partners, props.interfered.vals, false, true);
+          }
           // backbone-backbone interaction
           if (op.isGiven("bb")) {
-              mstreal dcut = op.getReal("bb");
-              contactList list = C.getBBInteraction(P,dcut);
-              map<int, map<int, mstreal>> bbInteraction;
-              for (int i = 0; i < list.size(); i++) {
-                  int rA = list.residueA(i)->getResidueIndex();
-                  int rB = list.residueB(i)->getResidueIndex();
-                  bbInteraction[rA][rB] = list.degree(i);
-                  bbInteraction[rB][rA] = list.degree(i);
-              }
-              S.addResiduePairProperties(ti, "bb", bbInteraction);
+            mstreal dcut = op.getReal("bb");
+            contactList list = C.getBBInteraction(P,dcut);
+            list.pairTable(P.residueSize(), props.bb.rowLen, props.bb.partners, props.bb.vals);
           }
         }
+      };
+
+      // targets are processed in parallel, a batch at a time, and their
+      // properties are added to the database in order
+      int numThreads = op.getInt("j", 1), batchSize = 16 * numThreads;
+      for (int b = 0; b < S.numTargets(); b += batchSize) {
+        int n = min(batchSize, S.numTargets() - b);
+        vector<targetProps> batch(n);
+        MstUtils::parallelFor(n, numThreads, [&](int k, int) { computeProps(b + k, batch[k]); });
+        for (int k = 0; k < n; k++) {
+          int ti = b + k;
+          targetProps& props = batch[k];
+          cout << "\ttarget " << ti+1 << "/" << S.numTargets() << "..." << endl;
+          if (op.isGiven("pp")) {
+            S.addResidueProperties(ti, "phi", props.phi);
+            S.addResidueProperties(ti, "psi", props.psi);
+            S.addResidueProperties(ti, "omega", props.omega);
+          }
+          if (op.isGiven("stride")) S.addResidueStringProperties(ti, "stride", props.stride);
+          if (op.isGiven("env")) S.addResidueProperties(ti, "env", props.env);
+          if (op.isGiven("cont")) S.addResiduePairProperties(ti, "cont", props.cont.rowLen, props.cont.partners, props.cont.vals);
+          if (op.isGiven("contSeq")) {
+            for (auto it = props.contSeq.begin(); it != props.contSeq.end(); ++it) S.addResiduePairProperties(ti, aaToProp[it->first], it->second);
+          }
+          if (op.isGiven("int")) {
+            S.addResiduePairProperties(ti, "interfering", props.interfering.rowLen, props.interfering.partners, props.interfering.vals);
+            S.addResiduePairProperties(ti, "interfered", props.interfered.rowLen, props.interfered.partners, props.interfered.vals);
+          }
+          if (op.isGiven("bb")) S.addResiduePairProperties(ti, "bb", props.bb.rowLen, props.bb.partners, props.bb.vals);
+        }
       }
     }
     if (op.isGiven("sim")) {
@@ -241,7 +281,7 @@ int main(int argc, char *argv[]) {
         }
       }
       cout << "\tclustering " << wins.size() << " windows at " << op.getInt("sim") << "\% sequence identity..." << endl;
-      vector<vector<int> > clusts = SeqTools::rSearch(wins, op.getInt("sim")/100.0, 0.999, true);
+      vector<vector<int> > clusts = SeqTools::rSearch(wins, op.getInt("sim")/100.0, 0.999, true, op.getInt("j", 1));
       cout << "\tfound " << clusts.size() << " clusters..." << endl;
 
       // then visit all similar pairs and mark what residues that makes similar
@@ -273,7 +313,13 @@ int main(int argc, char *argv[]) {
       }
       cout << "\trecorded " << symN << " similar windows, from a total of " << Nr << " residues" << endl;
     }
-    S.writeDatabase(op.getString("o"));
+    if (op.isGiven("mmap")) S.writeMappedDatabase(op.getString("o"));
+    else S.writeDatabase(op.getString("o"));
+    if (op.isGiven("sidx")) {
+      cout << "Building segment descriptor index..." << endl;
+      S.buildSegmentIndex(indexLengths);
+      S.writeSegmentIndex(op.getString("o"));
+    }
   } else {
     if (!op.isGiven("pL")) MstUtils::error("--pL must be given with --batch");
     if (!op.isInt("batch") || (op.getInt("batch") <= 0)) MstUtils::error("--batch must be a positive integer!");
@@ -305,7 +351,7 @@ int main(int argc, char *argv[]) {
       int time_per_structure = 5;
       vector<string> allOpts = op.getAllGivenOptions();
       for (int j = 0; j < allOpts.size(); j++) {
-        if ((allOpts[j].compare("cont") == 0) || (allOpts[j].compare("contSeq") == 0) || (allOpts[j].compare("int") == 0) || (allOpts[j].compare("stride") == 0)) time_per_structure += 5 ;
+        if ((allOpts[j].compare("cont") == 0) || (allOpts[j].compare("contSeq") == 0) || (allOpts[j].compare("int") == 0) || ((allOpts[j].compare("stride") == 0) && !op.getString("stride").empty())) time_per_structure += 5 ;
       }
       cout << "Given options, calculating that " << time_per_structure << " min are needed per structure (on average)" << endl;
       int hrs = (int) ceil(time_per_structure*(tasks[i].second - tasks[i].first + 1)/60.0); // fifteen minutes per structure should be plenty
@@ -322,7 +368,7 @@ int main(int argc, char *argv[]) {
       outf << op.getExecName() << " --pL " << listFile << " --o " << dbFile;
       // keep all other options from the call to self
       for (int j = 0; j < allOpts.size(); j++) {
-        if ((allOpts[j].compare("batch") == 0) || (allOpts[j].compare("pL") == 0) || (allOpts[j].compare("o") == 0) || (allOpts[j].compare("sim") == 0)) continue;
+        if ((allOpts[j].compare("batch") == 0) || (allOpts[j].compare("pL") == 0) || (allOpts[j].compare("o") == 0) || (allOpts[j].compare("sim") == 0) || (allOpts[j].compare("mmap") == 0) || (allOpts[j].compare("sidx") == 0)) continue;
         outf << " --" << allOpts[j] << " " << op.getString(allOpts[j]);
       }
       outf << endl;
@@ -334,6 +380,10 @@ int main(int argc, char *argv[]) {
     fstream fin; MstUtils::openFile(fin, "fin." + MstSys::pathBase(op.getString("o")) + ".sh", ios::out);
     fin << op.getExecName() << " --dL " << dbListFile << " --o " << op.getString("o");
     if (op.isGiven("sim")) fin << " --sim " << op.getInt("sim");
+    if (op.isGiven("win")) fin << " --win " << op.getInt("win");
+    if (op.isGiven("j")) fin << " --j " << op.getInt("j");
+    if (op.isGiven("mmap")) fin << " --mmap";
+    if (op.isGiven("sidx")) fin << " --sidx " << op.getString("sidx");
     fin << endl;
     fin << "if [ $? -eq 0 ]; then # only clean up if database creation was successful" << endl;
     for (int k = 0; k < toClean.size(); k++) {
@@ -0,0 +1,52 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstfasst.h"
+#include "mstfasstshard.h"
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Serves one shard of a FASST database over a socket, or searches a database split into shards that are being served. Options:");
+  op.addOption("serve", "serve searches over the shard given with --b on this port.");
+  op.addOption("b", "binary database file of the shard to serve.");
+  op.addOption("first", "index (in the full database) of the first target in this shard (default is 0).");
+  op.addOption("m", "memory saving mode when reading the shard (default is 2; see FASST::readDatabase).");
+  op.addOption("j", "number of threads to search the shard with (default is 1).");
+  op.addOption("shards", "comma-separated list of host:port addresses of the shards to search across.");
+  op.addOption("q", "query PDB file.");
+  op.addOption("r", "RMSD cutoff (takes the size-dependent cutoff by default).");
+  op.addOption("red", "set redundancy cutoff level in percent (default is 100, so no redundancy filtering).");
+  op.addOption("min", "min number of matches.");
+  op.addOption("max", "max number of matches.");
+  op.addOption("matchOut", "match output file (matches are written to standard output otherwise).");
+  op.setOptions(argc, argv);
+
+  if (op.isGiven("serve")) {
+    if (!op.isGiven("b")) MstUtils::error("--serve requires --b");
+    FASST F;
+    F.readDatabase(op.getString("b"), op.getInt("m", 2));
+    F.setNumThreads(op.getInt("j", 1));
+    fasstShardServer server(F, op.getInt("first", 0));
+    server.listen(op.getInt("serve"));
+    cout << "serving " << F.numTargets() << " targets on port " << server.getPort() << endl;
+    server.serve();
+    return 0;
+  }
+
+  if (!op.isGiven("shards") || !op.isGiven("q")) MstUtils::error("either --serve or both --shards and --q must be given!");
+  fasstShardedSearch search;
+  vector<string> shards = MstUtils::split(op.getString("shards"), ",");
+  for (int i = 0; i < shards.size(); i++) search.addShard(MstUtils::trim(shards[i]));
+  Structure query(op.getString("q"));
+  fasstSearchOptions opts;
+  opts.setRMSDCutoff(op.isGiven("r") ? op.getReal("r") : RMSDCalculator::rmsdCutoff(query));
+  if (op.isGiven("max")) opts.setMaxNumMatches(op.getInt("max"));
+  if (op.isGiven("min")) opts.setMinNumMatches(op.getInt("min"));
+  if (op.isGiven("red")) opts.setRedundancyCut(op.getReal("red")/100.0);
+  fasstSolutionSet matches = search.search(query, opts);
+
+  fstream of;
+  if (op.isGiven("matchOut")) MstUtils::openFile(of, op.getString("matchOut"), ios::out);
+  ostream& out = op.isGiven("matchOut") ? of : cout;
+  for (auto it = matches.begin(); it != matches.end(); ++it) out << it->getAddress() << " " << it->getRMSD() << endl;
+  if (op.isGiven("matchOut")) of.close();
+}
@@ -22,6 +22,7 @@ int main(int argc, char *argv[]) {
   op.addOption("o", "output file (prints to STDOUT if not specified).");
   op.addOption("new", "use the new style of pair-energy calculation, where homo-dimeric matches are accounted for in the statistics.");
   op.addOption("new2", "use the new style of pair-energy calculation, where homo-dimeric matches are accounted for in the statistics.");
+  op.addOption("store", "a file with a store of TERM matches to reuse across runs on the same template (see design). Read if it exists, and written back at the end.");
   op.setOptions(argc, argv);
   if (!(op.isGiven("sites") || op.isGiven("sitesL"))) MstUtils::error("either --sites or --sitesL must be specified!");
 
@@ -56,6 +57,10 @@ int main(int argc, char *argv[]) {
   }
 
   dTERMen D(op.getString("c"));
+  if (op.isGiven("store")) {
+    if (MstSys::fileExists(op.getString("store"))) D.readMatchStore(op.getString("store"));
+    else D.setMatchStoreFlag(true);
+  }
   vector<res_t> alpha = D.getGlobalAlphabet();
   set<pair<Residue*, Residue*>> visited;
   vector<vector<mstreal>> pE;
@@ -85,5 +90,6 @@ int main(int argc, char *argv[]) {
     }
     visited.insert(pairs[i]);
   }
+  if (op.isGiven("store")) D.writeMatchStore(op.getString("store"));
   cout << "Done" << endl;
 }
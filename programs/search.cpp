@@ -23,6 +23,11 @@ int main(int argc, char *argv[]) {
   op.addOption("matchOut", "match output file.");
   op.addOption("m", "memory saving mode: 0 means does not do any memory savings; 1 means strip the side-chains; 2 (default) means destroy the original target structure upon reading, and only keep backbone coordinates.");
   op.addOption("sc", "dump sidechains (not only the backbone).");
+  op.addOption("maxTime", "stop searching after this many seconds, reporting the matches found until then.");
+  op.addOption("maxNodes", "stop searching after visiting this many recursion nodes, reporting the matches found until then.");
+  op.addOption("stats", "flag; if given, will report per-phase search times and counts of scored windows, pruned options, visited nodes, and redundant solutions.");
+  op.addOption("order", "flag; if given, will visit targets in the order of their residual bounds from the database's segment index (if it has one), which can end searches with --max early.");
+  op.addOption("j", "number of threads to search with (and to read the files in --d with; default is 1).");
   op.setOptions(argc, argv);
   int memInit = MstSys::memUsage();
   if (op.isGiven("redProp")) MstUtils::assertCond(!op.getString("redProp").empty(), "--redProp must specify a property name");
@@ -50,9 +55,14 @@ int main(int argc, char *argv[]) {
   }
   if (op.isGiven("d")) {
     vector<string> pdbFiles = MstUtils::fileToArray(op.getString("d"));
-    for (int i = 0; i < pdbFiles.size(); i++) {
-      Structure P(pdbFiles[i]);
-      S.addTarget(P);
+    int numThreads = op.getInt("j", 1), batchSize = 16 * numThreads;
+    for (int b = 0; b < pdbFiles.size(); b += batchSize) {
+      vector<string> batchFiles(pdbFiles.begin() + b, pdbFiles.begin() + min(b + batchSize, (int) pdbFiles.size()));
+      vector<Structure*> batch = Structure::readMany(batchFiles, numThreads);
+      for (int k = 0; k < batch.size(); k++) {
+        S.addTarget(*(batch[k]));
+        delete batch[k];
+      }
     }
   }
   if (op.isGiven("r")) { S.setRMSDCutoff(op.getReal("r")); }
@@ -60,10 +70,14 @@ int main(int argc, char *argv[]) {
     cout << "setting RMSD cutoff to " << RMSDCalculator::rmsdCutoff(query) << endl;
     S.setRMSDCutoff(RMSDCalculator::rmsdCutoff(query));
   }
+  S.setNumThreads(op.getInt("j", 1));
   S.setMaxNumMatches(op.getInt("max", -1));
   S.setMinNumMatches(op.getInt("min", -1));
   S.setRedundancyCut(op.getReal("red", 100.0)/100.0);
   if (op.isGiven("redProp")) S.setRedundancyProperty(op.getString("redProp"));
+  if (op.isGiven("maxTime")) S.options().setMaxSearchTime(op.getReal("maxTime"));
+  if (op.isGiven("maxNodes")) S.options().setMaxSearchNodes(op.getInt("maxNodes"));
+  if (op.isGiven("order")) S.options().setTargetOrdering();
   fasstSeqConstSimple seqConst(S.getNumQuerySegments());
   if (op.isGiven("seqConst")) {
     vector<string> cons = MstUtils::split(op.getString("seqConst"), ";");
@@ -98,6 +112,8 @@ int main(int argc, char *argv[]) {
   S.search();
   end = chrono::high_resolution_clock::now();
   cout << "Search took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  if (op.isGiven("stats")) cout << S.getSearchStats() << endl;
+  if (S.isSearchPartial()) cout << "search ran out of its budget, so matches are the best ones found until then" << endl;
   cout << "found " << S.numMatches() << " matches:" << endl;
   cout << "memory usage: " << MstSys::memUsage() << " KB" << endl;
   fasstSolutionSet matches = S.getMatches(); int i = 0;
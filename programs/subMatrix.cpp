@@ -62,9 +62,7 @@ void selectAround(const vector<Residue*>& cenRes, int pm, Structure& frag, bool
   }
 }
 
-Structure getTERM(Residue& res, RotamerLibrary& RL, vector<int>& keyResidues, vector<vector<int> >& resSpacing, mstreal cdcut = 0.0, bool verbose = false) {
-  Structure& S = *(res.getStructure());
-  ConFind C(&RL, S);
+Structure getTERM(Residue& res, ConFind& C, vector<int>& keyResidues, vector<vector<int> >& resSpacing, mstreal cdcut = 0.0, bool verbose = false) {
   contactList list = C.getContacts(&res, cdcut);
   // cout << "found " << list.size() << " contacts for residue " << res << " with CD cutoff " << cdcut << endl;
   vector<Residue*> residues(1, &res);
@@ -86,6 +84,44 @@ Structure getTERM(Residue& res, RotamerLibrary& RL, vector<int>& keyResidues, ve
   return frag;
 }
 
+/* Full structures of database targets, each with its own ConFind object, so
+ * that backbone grids and rotamer placements are computed once per structure
+ * however many times it is visited. Holds up to capacity structures, evicting
+ * the least recently used; entries handed out stay valid while referenced. */
+class confindCache {
+  public:
+    struct entry {
+      entry(const Structure& _S, RotamerLibrary* RL) : S(_S), C(RL, S) {}
+      Structure S;
+      ConFind C;
+    };
+
+    confindCache(FASST& _F, RotamerLibrary& _RL, int _capacity) : F(_F), RL(_RL), capacity(_capacity) {}
+
+    shared_ptr<entry> get(int ti) {
+      auto it = index.find(ti);
+      if (it != index.end()) {
+        order.splice(order.begin(), order, it->second);
+        return it->second->second;
+      }
+      shared_ptr<entry> e = make_shared<entry>(F.getTargetCopy(ti), &RL);
+      order.push_front(make_pair(ti, e));
+      index[ti] = order.begin();
+      while (order.size() > MstUtils::max(capacity, 1)) {
+        index.erase(order.back().first);
+        order.pop_back();
+      }
+      return e;
+    }
+
+  private:
+    FASST& F;
+    RotamerLibrary& RL;
+    int capacity;
+    list<pair<int, shared_ptr<entry> > > order; // most recently used first
+    map<int, list<pair<int, shared_ptr<entry> > >::iterator> index;
+};
+
 int main(int argc, char *argv[]) {
   MstOptions op;
   op.setTitle("Compute the TERM-induced amino-acid substitution matrix. Options:");
@@ -95,18 +131,17 @@ int main(int argc, char *argv[]) {
   op.addOption("r", "path to rotamer library file.", true);
   op.addOption("o", "output base for the substitution table and the log file.", true);
   op.addOption("c", "contact degree cutoff for defining contacts.");
+  op.addOption("j", "number of threads; sampled structures are processed in parallel (default 1).");
+  op.addOption("cache", "number of structures (with their contact information) each thread keeps around for reuse (default 64).");
   op.addOption("v", "verbose output.");
   op.setOptions(argc, argv);
   RotamerLibrary RL(op.getString("r"));
-  RMSDCalculator rc;
   FASST F;
-  int N = 1000; // number of structures to randomly sample
-  int n = 1;    // number
-  int centResIdx;
   mstreal cdcut = op.getReal("c", 0.05);
   string matFile = op.getString("o") + ".mat";
   string logFile = op.getString("o") + ".log";
   bool verbose = op.isGiven("v");
+  int numThreads = op.getInt("j", 1);
   // srand(123456789);
   srand(time(NULL) + (int) getpid());
   fstream logfs; MstUtils::openFile(logfs, logFile, ios::out);
@@ -114,36 +149,56 @@ int main(int argc, char *argv[]) {
   // prepare substitution counts matrix
   vector<vector<int> > subMatrix(20, vector<int>(20, 0));
 
-  // prepare FASST object
-  F.readDatabase(op.getString("d"), 2);
-  F.options().setRedundancyCut(0.5);
+  // prepare FASST object; side-chains are not needed, but target structures
+  // are, since contacts are computed on them
+  F.readDatabase(op.getString("d"), 1);
   // F.setMaxNumMatches(1000); // these many matches are enough to compute reasonable frequencies
   // F.setMinNumMatches(20);   // need at least this many to compute anything reasonable
 
-  for (int c = 0; c < op.getInt("N"); c++) {
-    // pick a random structure from the database
-    int ti = MstUtils::randInt(0, F.numTargets() - 1);
-    Structure S(F.getTargetCopy(ti));
+  // draw the random structures and residues up front, so that the sample does
+  // not depend on how the work is split between threads
+  vector<pair<int, vector<int> > > samples(op.getInt("N"));
+  for (int c = 0; c < samples.size(); c++) {
+    samples[c].first = MstUtils::randInt(0, F.numTargets() - 1);
+    for (int r = 0; r < op.getInt("n"); r++) samples[c].second.push_back(MstUtils::randInt(0, F.getTargetResidueSize(samples[c].first) - 1));
+  }
+
+  // every thread has its own searcher (sharing the database) and structure cache
+  vector<FASST*> searchers(numThreads);
+  vector<confindCache*> caches(numThreads);
+  for (int w = 0; w < numThreads; w++) {
+    searchers[w] = F.newSearcher();
+    searchers[w]->options().setRedundancyCut(0.5);
+    caches[w] = new confindCache(F, RL, op.getInt("cache", 64));
+  }
+  mutex outLock;
 
-    for (int r = 0; r < op.getInt("n"); c++) {
-      // pick a random residue
-      int ri = MstUtils::randInt(0, S.residueSize() - 1);
-      Residue& res = S.getResidue(ri);
+  MstUtils::parallelFor(samples.size(), numThreads, [&](int c, int w) {
+    FASST& searcher = *(searchers[w]);
+    int ti = samples[c].first;
+    shared_ptr<confindCache::entry> query = caches[w]->get(ti);
+    Structure& Q = query->S;
+    stringstream log, out;
+    // substitutions counted for this structure, added to the total when done
+    vector<vector<int> > counts(20, vector<int>(20, 0));
+
+    for (int ri : samples[c].second) {
+      Residue& res = Q.getResidue(ri);
       int aai = SeqTools::aaToIdx(SeqTools::toSingle(res.getName()));
-      if (aai >= subMatrix.size()) continue;
+      if (aai >= counts.size()) continue;
       /* Will contain indices of the residues defining the TERM (first the
        * central residue, and then residues it is in contact with, if any).
        * Indices are into the TERM structure, not the original structure. */
       vector<int> keyResidues;
       vector<vector<int> > resSpacing; // will store the spacing between residues, in the original structure
-      Structure term = getTERM(res, RL, keyResidues, resSpacing, cdcut, verbose);
-      F.setQuery(term);
-      F.setRMSDCutoff(rc.rmsdCutoff(resSpacing));
-      if (verbose) cout << "term.ressidueSize() = " << term.residueSize() << ", term.chainSize() = " << term.chainSize() << ", RMSD cutoff = " << rc.rmsdCutoff(resSpacing) << endl;
-      fasstSolutionSet matches = F.search();
-      if (verbose) cout << "found " << matches.size() << " matches" << endl;
-      logfs << S.getName() << " " << ti << " " << ri << " " << res << " " << keyResidues.size() << " "
-            << term.residueSize() << " " << term.chainSize() << " " << matches.size();
+      Structure term = getTERM(res, query->C, keyResidues, resSpacing, cdcut, verbose);
+      searcher.setQuery(term);
+      searcher.setRMSDCutoff(RMSDCalculator::rmsdCutoff(resSpacing));
+      if (verbose) out << "term.ressidueSize() = " << term.residueSize() << ", term.chainSize() = " << term.chainSize() << ", RMSD cutoff = " << RMSDCalculator::rmsdCutoff(resSpacing) << endl;
+      fasstSolutionSet matches = searcher.search();
+      if (verbose) out << "found " << matches.size() << " matches" << endl;
+      log << Q.getName() << " " << ti << " " << ri << " " << res << " " << keyResidues.size() << " "
+          << term.residueSize() << " " << term.chainSize() << " " << matches.size();
       int Na = 0; // number of accepted matches
       // split matches by target
       map<int, vector<fasstSolution> > matchesByTarget;
@@ -156,15 +211,14 @@ int main(int argc, char *argv[]) {
       for (auto it = matchesByTarget.begin(); it != matchesByTarget.end(); ++it) {
         int idx = it->first;
         vector<fasstSolution>& sols = it->second;
-        Structure target = F.getTargetCopy(idx);
-        ConFind C(&RL, target);
+        shared_ptr<confindCache::entry> target = caches[w]->get(idx);
         for (int i = 0; i < sols.size(); i++) {
-          vector<int> residues = F.getMatchResidueIndices(sols[i], FASST::matchType::REGION);
+          vector<int> residues = searcher.getMatchResidueIndices(sols[i], FASST::matchType::REGION);
 
           // make sure that the central residue within this match does not have
           // any additional contacts within its structure
-          Residue& subRes = target.getResidue(residues[keyResidues[0]]);
-          vector<Residue*> conts = C.getContactingResidues(&subRes, cdcut);
+          Residue& subRes = target->S.getResidue(residues[keyResidues[0]]);
+          vector<Residue*> conts = target->C.getContactingResidues(&subRes, cdcut);
           set<int> keyResidueSet;
           for (int ri = 0; ri < keyResidues.size(); ri++) keyResidueSet.insert(residues[keyResidues[ri]]);
           bool reject = false;
@@ -175,22 +229,33 @@ int main(int argc, char *argv[]) {
             }
           }
           if (reject) {
-            if (verbose) cout << "\tmatch " << i+1 << " from target " << idx << " rejected due to extra contacts..." << endl;
+            if (verbose) out << "\tmatch " << i+1 << " from target " << idx << " rejected due to extra contacts..." << endl;
             continue;
           }
-          if (verbose) cout << "\tmatch " << i+1 << " accepted!" << endl;
+          if (verbose) out << "\tmatch " << i+1 << " accepted!" << endl;
 
           // match is accepted, so count the substitution
           int aaj = SeqTools::aaToIdx(SeqTools::toSingle(subRes.getName()));
-          if (aaj >= subMatrix.size()) continue;
-          if (verbose) cout << "\t\tcounting substitution between " << res.getName() << " and " << subRes.getName() << endl;
-          subMatrix[aai][aaj]++;
+          if (aaj >= counts.size()) continue;
+          if (verbose) out << "\t\tcounting substitution between " << res.getName() << " and " << subRes.getName() << endl;
+          counts[aai][aaj]++;
           Na++;
-          writeMatrix(matFile, subMatrix, verbose);
         }
       }
-      logfs << " " << Na << endl;
+      log << " " << Na << endl;
+    }
+
+    lock_guard<mutex> guard(outLock);
+    cout << out.str();
+    logfs << log.str() << flush;
+    for (int i = 0; i < subMatrix.size(); i++) {
+      for (int j = 0; j < subMatrix.size(); j++) subMatrix[i][j] += counts[i][j];
     }
+    writeMatrix(matFile, subMatrix, verbose);
+  });
+  for (int w = 0; w < numThreads; w++) {
+    delete searchers[w];
+    delete caches[w];
   }
   logfs.close();
 }
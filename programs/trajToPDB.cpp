@@ -0,0 +1,37 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "msttraj.h"
+
+using namespace MST;
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Exports a binary trajectory (e.g., one streamed by TERMify --btraj) as multi-model PDB. Options:");
+  op.addOption("t", "input trajectory file.", true);
+  op.addOption("o", "output PDB file name.", true);
+  op.addOption("every", "only export every this many frames (default 1).");
+  op.addOption("first", "first frame to export, counting from 1 (default 1).");
+  op.addOption("last", "last frame to export (default is the last one in the file).");
+  op.addOption("s", "write the score of each frame as a REMARK line before its model.");
+  op.setOptions(argc, argv);
+  int every = op.getInt("every", 1);
+  int first = op.getInt("first", 1);
+  int last = op.getInt("last", -1);
+  if (every < 1) MstUtils::error("--every must be a positive integer");
+
+  trajectoryReader R(op.getString("t"));
+  fstream out; MstUtils::openFile(out, op.getString("o"), ios::out);
+  Structure S; mstreal score;
+  int n = 0;
+  while (((last < 0) || (R.numFramesRead() < last)) && R.readFrame(S, score)) {
+    int fi = R.numFramesRead();
+    if ((fi < first) || ((fi - first) % every != 0)) continue;
+    if (op.isGiven("s")) out << "REMARK frame " << fi << " score " << score << endl;
+    out << "MODEL " << fi << endl;
+    S.writePDB(out);
+    out << "ENDMDL" << endl;
+    n++;
+  }
+  out.close();
+  cout << "exported " << n << " of " << R.numFramesRead() << " frames read (" << R.numAtoms() << " atoms each)" << endl;
+}
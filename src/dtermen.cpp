@@ -1,4 +1,5 @@
 #include "dtermen.h"
+#include <queue>
 
 dTERMen::dTERMen() {
   init();
@@ -10,6 +11,7 @@ dTERMen::dTERMen(const string& configFile) {
 }
 
 void dTERMen::init() {
+  MstProfiler::scope prof("dTERMen::init");
   kT = 1.0;
   aaMapType = 1;
   cdCut = 0.01;
@@ -25,7 +27,10 @@ void dTERMen::init() {
   pairMinN = 1000;
   pairMaxN = 5000;
   recordData = false;
+  useStore = false;
+  numThreads = 1;
   homCut = 0.6;
+  bkPotKeySet = false;
   setAminoAcidMap();
   setEnergyFunction("35");
 
@@ -58,6 +63,8 @@ void dTERMen::readConfigFile(const string& configFile) {
       fasstdbPath = ents[1];
     } else if (ents[0].compare("rotlib") == 0) {
       rotLibFile = ents[1];
+    } else if (ents[0].compare("backpot") == 0) {
+      backPotFile = ents[1];
     } else if (ents[0].compare("efun") == 0) {
       setEnergyFunction(ents[1]);
     } else if (ents[0].compare("selfCorrMaxCliqueSize") == 0) {
@@ -86,10 +93,11 @@ void dTERMen::readConfigFile(const string& configFile) {
 
   if (fasstdbPath.empty()) MstUtils::error("FASST database not defined in configuration file " + configFile, "dTERMen::dTERMen(const string&)");
   F.readDatabase(fasstdbPath, 2);
-  if (!backPotFile.empty()) {
-    readBackgroundPotentials(backPotFile);
-  } else {
-    buildBackgroundPotentials();
+  vector<int> aa; map<string, vector<mstreal> > propVals;
+  collectBackgroundData(aa, propVals);
+  if (backPotFile.empty() || !readBackgroundPotentials(backPotFile)) {
+    buildBackgroundPotentials(aa, propVals);
+    if (!backPotFile.empty()) writeBackgroundPotentials(backPotFile);
   }
   if (rotLibFile.empty()) { MstUtils::error("dTERMen configuration file does not specify a rotamer library, '" + configFile + "'", "dTERMen::readConfigFile"); }
   else {
@@ -141,9 +149,11 @@ vector<pair<Residue*, Residue*>> dTERMen::getContactsWith(const vector<Residue*>
 
 
 EnergyTable dTERMen::buildEnergyTable(const vector<Residue*>& variable, const vector<vector<string>>& allowed, const vector<vector<Residue*>>& images, EnergyTable* specTable, const vector<Residue*>& specContext) {
+  MstProfiler::scope prof("dTERMen::buildEnergyTable");
   EnergyTable E;
   if (variable.empty()) return E;
   Structure* S = variable[0]->getStructure();
+  S->cacheBackbone(); // backbone dihedrals of every residue are looked up many times below
   set<Residue*> variableSet = MstUtils::contents(variable);
   map<Residue*, string> siteNames;
   for (int i = 0; i < variable.size(); i++) {
@@ -240,10 +250,24 @@ EnergyTable dTERMen::buildEnergyTable(const vector<Residue*>& variable, const ve
     targetResidueProperties["env"].push_back(C.getFreedom(R));
   }
 
-  // compute self energies
+  // compute self and pair energies, either here or as independent TERM-level tasks
+  vector<vector<mstreal>> allSelfE(variable.size());
+  vector<vector<vector<mstreal>>> allPairE;
+  if (numThreads <= 1) {
+    for (int i = 0; i < variable.size(); i++) {
+      cout << "computing self energy for position " << *(variable[i]) << ", " << i+1 << "/" << variable.size() << endl;
+      allSelfE[i] = selfEnergies(variable[i], C, true);
+    }
+    // TERM searches for all contacts are done in one batch
+    cout << "computing pair energies for " << conts.size() << " contacts..." << endl;
+    allPairE = pairEnergies(conts, true);
+  } else {
+    termEnergiesParallel(variable, conts, C, allSelfE, allPairE);
+  }
+
+  // self energies
   for (int i = 0; i < variable.size(); i++) {
-    cout << "computing self energy for position " << *(variable[i]) << ", " << i+1 << "/" << variable.size() << endl;
-    vector<mstreal> selfE = selfEnergies(variable[i], C, true);
+    vector<mstreal>& selfE = allSelfE[i];
     vector<string> alpha = E.getSiteAlphabet(i);
     for (int k = 0; k < alpha.size(); k++) {
       int aai = aaToIndex(alpha[k]);
@@ -252,12 +276,11 @@ EnergyTable dTERMen::buildEnergyTable(const vector<Residue*>& variable, const ve
     }
   }
 
-  // compute pair energies
+  // pair energies
   for (int i = 0; i < conts.size(); i++) {
     Residue* resA = conts[i].first;
     Residue* resB = conts[i].second;
-    cout << "computing pair energy for positions " << *resA << " x " << *resB << ", " << i+1 << "/" << conts.size() << endl;
-    vector<vector<mstreal>> pairE = pairEnergies(resA, resB, true);
+    vector<vector<mstreal>>& pairE = allPairE[i];
     int si = E.siteIndex(siteNames[resA]); // residue A will always be a variable one (that's how we constructed conts)
     vector<string> alphaA = E.getSiteAlphabet(si);
 
@@ -330,6 +353,99 @@ EnergyTable dTERMen::buildEnergyTable(const vector<Residue*>& variable, const ve
   return E;
 }
 
+void dTERMen::termEnergiesParallel(const vector<Residue*>& variable, const vector<pair<Residue*, Residue*>>& conts, ConFind& C, vector<vector<mstreal>>& selfE, vector<vector<vector<mstreal>>>& pairE) {
+  // everything that needs ConFind is figured out up front, since it is not thread safe
+  int nSelf = variable.size(), nTasks = variable.size() + conts.size();
+  vector<mstreal> freedoms(nSelf);
+  vector<vector<pair<Residue*, Residue*>>> selfConts(nSelf);
+  for (int i = 0; i < nSelf; i++) {
+    if (variable[i]->getStructure() == NULL) MstUtils::error("cannot operate on a disembodied residue!", "dTERMen::termEnergiesParallel");
+    freedoms[i] = C.getFreedom(variable[i]);
+    if (needSelfCorrection()) selfConts[i] = getContactsWith({variable[i]}, C, 0, true);
+  }
+
+  // each worker searches with its own context over the shared (read-only) database;
+  // lazily-built parts of the database are built here, before anyone reads them
+  F.setOptions(foptsBase);
+  F.getRedundancyPropertyMap();
+  vector<FASST*> workers(numThreads, NULL);
+  for (int w = 0; w < numThreads; w++) workers[w] = F.newSearcher();
+
+  // one task per self and per pair TERM; results and recorded TERMs are kept
+  // per task, so that the outcome is independent of scheduling
+  selfE.clear(); selfE.resize(nSelf);
+  pairE.clear(); pairE.resize(conts.size());
+  vector<vector<termData>> recorded(nTasks);
+  mutex progressLock; int numDone = 0;
+  cout << "computing energies for " << nSelf << " positions and " << conts.size() << " contacts with " << numThreads << " threads..." << endl;
+  try {
+    MstUtils::parallelFor(nTasks, numThreads, [&](int t, int w) {
+      if (t < nSelf) {
+        selfE[t] = selfEnergies(variable[t], freedoms[t], selfConts[t], *(workers[w]), recorded[t]);
+      } else {
+        int i = t - nSelf;
+        pairE[i] = pairEnergies(conts[i].first, conts[i].second, *(workers[w]), recorded[t]);
+      }
+      lock_guard<mutex> lock(progressLock);
+      numDone++;
+      if (t < nSelf) cout << "\tcomputed self energy for position " << *(variable[t]) << ", " << numDone << "/" << nTasks << " done" << endl;
+      else cout << "\tcomputed pair energy for " << *(conts[t - nSelf].first) << " and " << *(conts[t - nSelf].second) << ", " << numDone << "/" << nTasks << " done" << endl;
+    });
+  } catch (...) {
+    for (int w = 0; w < numThreads; w++) delete workers[w];
+    throw;
+  }
+  for (int w = 0; w < numThreads; w++) delete workers[w];
+  for (int t = 0; t < nTasks; t++) data.insert(data.end(), recorded[t].begin(), recorded[t].end());
+}
+
+fasstSolutionSet dTERMen::searchTERM(FASST& fasst, const Structure& term, const fasstSearchOptions& opts, bool autoSplitChains) {
+  fasst.setOptions(opts);
+  string key = useStore ? termMatchStore::key(term, opts, autoSplitChains) : "";
+  fasstSolutionSet sols;
+  if (!key.empty() && store.find(key, sols)) return sols;
+  fasst.setQuery(term, autoSplitChains);
+  sols = fasst.search();
+  if (!key.empty()) store.insert(key, sols);
+  return sols;
+}
+
+vector<fasstSolutionSet> dTERMen::searchTERMs(FASST& fasst, const vector<Structure>& terms, const vector<fasstSearchOptions>& opts) {
+  if (!useStore) return fasst.searchBatch(terms, opts);
+  vector<fasstSolutionSet> sols(terms.size());
+  vector<string> keys(terms.size());
+  vector<Structure> missing; vector<fasstSearchOptions> missingOpts; vector<int> missingIdx;
+  for (int i = 0; i < terms.size(); i++) {
+    keys[i] = termMatchStore::key(terms[i], opts[i]);
+    if (!keys[i].empty() && store.find(keys[i], sols[i])) continue;
+    missing.push_back(terms[i]);
+    missingOpts.push_back(opts[i]);
+    missingIdx.push_back(i);
+  }
+  if (missing.empty()) return sols;
+  vector<fasstSolutionSet> found = fasst.searchBatch(missing, missingOpts);
+  for (int k = 0; k < missingIdx.size(); k++) {
+    int i = missingIdx[k];
+    sols[i] = found[k];
+    if (!keys[i].empty()) store.insert(keys[i], sols[i]);
+  }
+  return sols;
+}
+
+void dTERMen::readMatchStore(const string& file) {
+  store.read(file, F.numTargets());
+  useStore = true;
+}
+
+void dTERMen::writeMatchStore(const string& file) {
+  store.write(file, F.numTargets());
+}
+
+void dTERMen::setNumThreads(int n) {
+  if (n < 1) MstUtils::error("number of threads must be positive, got " + MstUtils::toString(n), "dTERMen::setNumThreads");
+  numThreads = n;
+}
+
 void dTERMen::setAminoAcidMap() {
   /* Perfectly corresponding to standard residues. */
   map<string, string> standard = {{"HSD", "HIS"}, {"HSE", "HIS"}, {"HSC", "HIS"}, {"HSP", "HIS"}};
@@ -447,50 +563,133 @@ res_t dTERMen::indexToAA(int idx) const {
 }
 
 void dTERMen::buildBackgroundPotentials() {
+  vector<int> aa; map<string, vector<mstreal> > propVals;
+  collectBackgroundData(aa, propVals);
+  buildBackgroundPotentials(aa, propVals);
+}
+
+void dTERMen::collectBackgroundData(vector<int>& aa, map<string, vector<mstreal> >& propVals) {
+  MstProfiler::scope prof("dTERMen::collectBackgroundData");
   // extract all necessary residue properties
   vector<string> propNames = {"phi", "psi", "omega", "env"};
-  map<string, vector<mstreal> > propVals;
-  vector<int> aa;
-  for (int i = 0; i < propNames.size(); i++) MstUtils::assertCond(F.isResiduePropertyDefined(propNames[i]), "property " + propNames[i] + " is not defined in the FASST database", "dTERMen::buildBackgroundPotentials()");
-
-  for (int ti = 0; ti < F.numTargets(); ti++) {
+  for (int i = 0; i < propNames.size(); i++) MstUtils::assertCond(F.isResiduePropertyDefined(propNames[i]), "property " + propNames[i] + " is not defined in the FASST database", "dTERMen::collectBackgroundData()");
+  vector<int> propIDs(propNames.size());
+  for (int i = 0; i < propNames.size(); i++) propIDs[i] = F.getResiduePropertyID(propNames[i]);
+
+  // gather each target's residues separately, then concatenate in target order
+  // (relationships are only looked up if present, so that lookups never add them)
+  bool haveSims = F.isResidueRelationshipPopulated("sim");
+  int nt = F.numTargets();
+  vector<vector<int> > targAA(nt);
+  vector<vector<vector<mstreal> > > targProps(nt, vector<vector<mstreal> >(propNames.size() + 1));
+  MstUtils::parallelFor(nt, numThreads, [&](int ti, int w) {
     Sequence S = F.getTargetSequence(ti);
     int N = S.length();
 
     // compute multiplicity of each residue
     vector<mstreal> mult(N, 1); // multiplicity of each residue in the structure
-    map<int, vector<FASST::resAddress>> simsToTarget = F.getResidueRelationships(ti, "sim");
-    for (auto it = simsToTarget.begin(); it != simsToTarget.end(); ++it) {
-      mult[it->first] += (it->second).size();
+    if (haveSims) {
+      map<int, vector<FASST::resAddress>> simsToTarget = F.getResidueRelationships(ti, "sim");
+      for (auto it = simsToTarget.begin(); it != simsToTarget.end(); ++it) {
+        mult[it->first] += (it->second).size();
+      }
     }
 
-    // store all properties
+    // store all properties (multiplicity last)
     for (int ri = 0; ri < N; ri++) {
       string aaName = S.getResidue(ri, true);
       if (!isInGlobalAlphabet(aaName)) continue;
-      aa.push_back(aaToIndex(aaName));
+      targAA[ti].push_back(aaToIndex(aaName));
       for (int i = 0; i < propNames.size(); i++) {
-        propVals[propNames[i]].push_back(F.getResidueProperty(ti, propNames[i], ri));
+        targProps[ti][i].push_back(F.getResidueProperty(ti, propIDs[i], ri));
       }
-      propVals["mult"].push_back(mult[ri]);
+      targProps[ti][propNames.size()].push_back(mult[ri]);
     }
+  });
+  propNames.push_back("mult");
+  aa.clear(); propVals.clear();
+  for (int ti = 0; ti < nt; ti++) {
+    aa.insert(aa.end(), targAA[ti].begin(), targAA[ti].end());
+    for (int i = 0; i < propNames.size(); i++) {
+      vector<mstreal>& col = propVals[propNames[i]];
+      col.insert(col.end(), targProps[ti][i].begin(), targProps[ti][i].end());
+    }
+  }
+
+  // the checksum (64-bit FNV-1a) of the data and the alphabet they are indexed by
+  uint64_t h = 14695981039346656037ULL;
+  auto add = [&h](const void* data, size_t len) {
+    for (size_t i = 0; i < len; i++) { h ^= ((const unsigned char*) data)[i]; h *= 1099511628211ULL; }
+  };
+  add(globAlph.data(), globAlph.size() * sizeof(res_t));
+  add(aa.data(), aa.size() * sizeof(int));
+  for (int i = 0; i < propNames.size(); i++) {
+    const vector<mstreal>& col = propVals[propNames[i]];
+    add(col.data(), col.size() * sizeof(mstreal));
   }
+  bkPotKey = h; bkPotKeySet = true;
+}
+
+void dTERMen::buildBackgroundPotentials(const vector<int>& aa, map<string, vector<mstreal> >& propVals) {
+  MstProfiler::scope prof("dTERMen::buildBackgroundPotentials");
+  // bin the data for each potential (binning does not depend on the potentials)
+  twoDimHist ppHist; oneDimHist omHist, envHist;
+  MstUtils::parallelFor(3, MstUtils::min(numThreads, 3), [&](int k, int w) {
+    if (k == 0) ppHist = binData(propVals["phi"], propVals["psi"], {-180, 180, 36}, {-180, 180, 36}, propVals["mult"], true);
+    else if (k == 1) omHist = binData(propVals["omega"], 2, {-180, 180, 1000, 1}, propVals["mult"], true);
+    else envHist = binData(propVals["env"], 1, {0, 1, 75}, propVals["mult"], false);
+  });
 
   // for each position in the database, accumulate total statistical potential,
   // for  all possible amino acids, from all known pseudo-energy types
   vector<vector<mstreal> > back(aa.size(), vector<mstreal> (globalAlphabetSize(), 0.0));
   bkPot = buildZeroDimPotential(aa, back);
   // cout << "Background frequency potential:\n"; printZeroDimPotential(bkPot);
-  ppPot = buildTwoDimPotential(binData(propVals["phi"], propVals["psi"], {-180, 180, 36}, {-180, 180, 36}, propVals["mult"], true), aa, 10.0, back, true);
+  ppPot = buildTwoDimPotential(ppHist, aa, 10.0, back, true);
   // cout << "Phi/psi potential:\n"; printTwoDimPotential(ppPot);
-  omPot = buildOneDimPotential(binData(propVals["omega"], 2, {-180, 180, 1000, 1}, propVals["mult"], true), aa, 10.0, back, true);
+  omPot = buildOneDimPotential(omHist, aa, 10.0, back, true);
   // cout << "Omega potential:\n"; printOneDimPotential(omPot);
-  envPot = buildOneDimPotential(binData(propVals["env"], 1, {0, 1, 75}, propVals["mult"], false), aa, 10.0, back, true);
+  envPot = buildOneDimPotential(envHist, aa, 10.0, back, true);
   // cout << "Env potential:\n"; printOneDimPotential(envPot);
 // TODO: could also do an end potential: 1, 2, 3 treated specially and N-2, N-1
 // N also.
 }
 
+bool dTERMen::readBackgroundPotentials(const string& file) {
+  fstream ifs(file.c_str(), fstream::in | fstream::binary);
+  if (!ifs.is_open()) return false;
+  if (!bkPotKeySet) { vector<int> aa; map<string, vector<mstreal> > propVals; collectBackgroundData(aa, propVals); }
+  char sect; int ver; uint64_t key;
+  MstUtils::readBin(ifs, sect); MstUtils::readBin(ifs, ver); MstUtils::readBin(ifs, key);
+  if (ifs.fail() || (sect != 'V') || (ver != 1) || (key != bkPotKey)) return false;
+  zeroDimPotType bk; oneDimPotType om, env; twoDimPotType pp;
+  MstUtils::readBin(ifs, bk.aaEnergies);
+  MstUtils::readBin(ifs, pp.xBinEdges); MstUtils::readBin(ifs, pp.yBinEdges); MstUtils::readBin(ifs, pp.aaEnergies);
+  MstUtils::readBin(ifs, om.binEdges); MstUtils::readBin(ifs, om.aaEnergies);
+  MstUtils::readBin(ifs, env.binEdges); MstUtils::readBin(ifs, env.aaEnergies);
+  if (ifs.fail()) MstUtils::error("error reading background potential file " + file, "dTERMen::readBackgroundPotentials");
+  ifs.close();
+  pp.compile(); om.compile(); env.compile();
+  bkPot = bk; ppPot = pp; omPot = om; envPot = env;
+  return true;
+}
+
+void dTERMen::writeBackgroundPotentials(const string& file) {
+  if (!bkPotKeySet) { vector<int> aa; map<string, vector<mstreal> > propVals; collectBackgroundData(aa, propVals); }
+  // write to a temporary file first, so that jobs starting at the same time
+  // never read a partially written file
+  string tmpFile = file + ".tmp" + MstUtils::toString((long) getpid());
+  fstream ofs; MstUtils::openFile(ofs, tmpFile, fstream::out | fstream::binary, "dTERMen::writeBackgroundPotentials");
+  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 1); // format version
+  MstUtils::writeBin(ofs, bkPotKey);
+  MstUtils::writeBin(ofs, bkPot.aaEnergies);
+  MstUtils::writeBin(ofs, ppPot.xBinEdges); MstUtils::writeBin(ofs, ppPot.yBinEdges); MstUtils::writeBin(ofs, ppPot.aaEnergies);
+  MstUtils::writeBin(ofs, omPot.binEdges); MstUtils::writeBin(ofs, omPot.aaEnergies);
+  MstUtils::writeBin(ofs, envPot.binEdges); MstUtils::writeBin(ofs, envPot.aaEnergies);
+  ofs.close();
+  if (rename(tmpFile.c_str(), file.c_str()) != 0) MstUtils::error("could not write background potential file " + file, "dTERMen::writeBackgroundPotentials");
+}
+
 int dTERMen::findBin(const vector<mstreal>& binEdges, mstreal x) {
   if ((x < binEdges.front()) || (x > binEdges.back())) return -1;
   // do a binary search
@@ -514,17 +713,63 @@ mstreal dTERMen::lookupZeroDimPotential(const zeroDimPotType& P, int aa) {
 }
 
 mstreal dTERMen::lookupOneDimPotential(const oneDimPotType& P, mstreal x, int aa) {
-  int k = findBin(P.binEdges, x);
-  if (k < 0) return 0;
-  return P.aaEnergies[k][aa];
+  const mstreal* ener = P.energies(x);
+  return (ener == NULL) ? 0 : ener[aa];
 }
 
 mstreal dTERMen::lookupTwoDimPotential(const twoDimPotType& P, mstreal x, mstreal y, int aa) {
-  int kx = findBin(P.xBinEdges, x);
-  if (kx < 0) return 0;
-  int ky = findBin(P.yBinEdges, y);
-  if (ky < 0) return 0;
-  return P.aaEnergies[kx][ky][aa];
+  const mstreal* ener = P.energies(x, y);
+  return (ener == NULL) ? 0 : ener[aa];
+}
+
+void dTERMen::backgroundEnergies(mstreal phi, mstreal psi, mstreal omg, mstreal env, mstreal* ener) {
+  const mstreal* om = omPot.energies(omg);
+  const mstreal* pp = ppPot.energies(phi, psi);
+  const mstreal* en = envPot.energies(env);
+  for (int aai = 0; aai < globalAlphabetSize(); aai++) {
+    // in the same order as adding up individual lookups (out-of-range ones are 0)
+    ener[aai] = bkPot.aaEnergies[aai] + ((om == NULL) ? 0 : om[aai]) + ((pp == NULL) ? 0 : pp[aai]) + ((en == NULL) ? 0 : en[aai]);
+  }
+}
+
+const int dTERMen::binLookup::maxCells;
+
+void dTERMen::binLookup::compile(const vector<mstreal>& binEdges) {
+  edges = binEdges;
+  cellBin.clear();
+  if (edges.size() < 2) { lo = 1; hi = 0; return; } // no bins, so nothing is in range
+  lo = edges.front(); hi = edges.back();
+  mstreal minWidth = hi - lo;
+  for (int k = 0; k + 1 < edges.size(); k++) {
+    if (edges[k+1] > edges[k]) minWidth = MstUtils::min(minWidth, edges[k+1] - edges[k]);
+  }
+  int nc = (minWidth > 0) ? MstUtils::min((int) ceil((hi - lo)/minWidth), maxCells) : 1;
+  invWidth = (hi > lo) ? nc/(hi - lo) : 0;
+  cellBin.resize(nc);
+  int nb = edges.size() - 1;
+  for (int c = 0, k = 0; c < nc; c++) {
+    mstreal start = lo + c/invWidth;
+    while ((k < nb - 1) && (start >= edges[k+1])) k++;
+    cellBin[c] = k;
+  }
+}
+
+void dTERMen::oneDimPotType::compile() {
+  bins.compile(binEdges);
+  naa = aaEnergies.empty() ? 0 : aaEnergies[0].size();
+  flat.resize(aaEnergies.size() * naa);
+  for (int k = 0; k < aaEnergies.size(); k++) copy(aaEnergies[k].begin(), aaEnergies[k].end(), flat.begin() + k*naa);
+}
+
+void dTERMen::twoDimPotType::compile() {
+  xBins.compile(xBinEdges);
+  yBins.compile(yBinEdges);
+  nyb = aaEnergies.empty() ? 0 : aaEnergies[0].size();
+  naa = (nyb == 0) ? 0 : aaEnergies[0][0].size();
+  flat.resize(aaEnergies.size() * nyb * naa);
+  for (int i = 0; i < aaEnergies.size(); i++) {
+    for (int j = 0; j < nyb; j++) copy(aaEnergies[i][j].begin(), aaEnergies[i][j].end(), flat.begin() + (i*nyb + j)*naa);
+  }
 }
 
 dTERMen::twoDimHist dTERMen::binData(const vector<mstreal>& X, const vector<mstreal>& Y, const vector<mstreal>& xBinSpec, const vector<mstreal>& yBinSpec, const vector<mstreal>& M, bool isAngle) {
@@ -801,6 +1046,7 @@ dTERMen::oneDimPotType dTERMen::buildOneDimPotential(const oneDimHist& H, const
     }
   }
 
+  pot.compile();
   return pot;
 }
 
@@ -871,6 +1117,7 @@ dTERMen::twoDimPotType dTERMen::buildTwoDimPotential(const twoDimHist& H, const
     }
   }
 
+  pot.compile();
   return pot;
 }
 
@@ -916,10 +1163,6 @@ void dTERMen::printTwoDimPotential(const twoDimPotType& P) {
   }
 }
 
-void dTERMen::readBackgroundPotentials(const string& file) {
-
-}
-
 void dTERMen::writeRecordedData(const string& file) {
   // find any duplicate TERMs
   map<set<int>, int> byResidueSet;
@@ -974,40 +1217,48 @@ vector<mstreal> dTERMen::selfEnergies(Residue* R, bool verbose) {
 }
 
 vector<mstreal> dTERMen::selfEnergies(Residue* R, ConFind& C, bool verbose) {
+  if (R->getStructure() == NULL) MstUtils::error("cannot operate on a disembodied residue!", "dTERMen::selfEnergies(Residue*, ConFind&, bool)");
+  mstreal freedom = C.getFreedom(R);
+  vector<pair<Residue*, Residue*>> conts;
+  if (needSelfCorrection()) conts = getContactsWith({R}, C, 0, verbose);
+  vector<termData> recorded;
+  vector<mstreal> selfE = selfEnergies(R, freedom, conts, F, recorded, verbose);
+  data.insert(data.end(), recorded.begin(), recorded.end());
+  return selfE;
+}
+
+vector<mstreal> dTERMen::selfEnergies(Residue* R, mstreal freedom, const vector<pair<Residue*, Residue*>>& conts, FASST& fasst, vector<termData>& recorded, bool verbose) {
+  MstProfiler::scope prof("dTERMen::selfEnergies");
   auto rmsdCutSelfRes = [](const vector<int>& fragResIdx, const Structure& S) { return RMSDCalculator::rmsdCutoff(fragResIdx, S, 1.0, 20); };
   auto rmsdCutSelfCor = [](const vector<int>& fragResIdx, const Structure& S) { return RMSDCalculator::rmsdCutoff(fragResIdx, S, 1.1, 15); };
-  if (R->getStructure() == NULL) MstUtils::error("cannot operate on a disembodied residue!", "dTERMen::selfEnergies(Residue*, ConFind&, bool)");
+  if (R->getStructure() == NULL) MstUtils::error("cannot operate on a disembodied residue!", "dTERMen::selfEnergies(Residue*, mstreal, const vector<pair<Residue*, Residue*>>&, FASST&, vector<termData>&, bool)");
   Structure& S = *(R->getStructure());
 
   // -- simple environment components
   if (verbose) cout << "\tdTERMen::selfEnergies -> trivial statistical components..." << endl;
   int naa = globalAlphabetSize();
   CartesianPoint selfE(naa, 0.0);
-  for (int aai = 0; aai < naa; aai++) {
-    selfE[aai] = backEner(aai) + bbOmegaEner(R->getOmega(), aai) + bbPhiPsiEner(R->getPhi(), R->getPsi(), aai) + envEner(C.getFreedom(R), aai);
-  }
+  backgroundEnergies(R->getPhi(), R->getPsi(), R->getOmega(), freedom, selfE.data());
   if (verbose) printSelfComponent(selfE, "\t");
 
   // -- self residual
   if (verbose) cout << "\tdTERMen::selfEnergies -> self residual..." << endl;
   termData sT({R}, pmSelf);
-  F.setOptions(foptsBase);
-  F.setQuery(sT.getTERM());
-  F.setRMSDCutoff(rmsdCutSelfRes(sT.getResidueIndices(), S));
-  F.setMinNumMatches(selfResidualMinN);
-  F.setMaxNumMatches(selfResidualMaxN);
-  sT.setMatches(F.search(), homCut, &F);
-  CartesianPoint selfResidual = singleBodyStatEnergy(sT.getMatches(), sT.getCentralResidueIndices()[0], selfResidualPC);
-  if (recordData) data.push_back(sT);
+  fasstSearchOptions selfOpts = foptsBase;
+  selfOpts.setRMSDCutoff(rmsdCutSelfRes(sT.getResidueIndices(), S));
+  selfOpts.setMinNumMatches(selfResidualMinN);
+  selfOpts.setMaxNumMatches(selfResidualMaxN);
+  sT.setMatches(searchTERM(fasst, sT.getTERM(), selfOpts), homCut, &fasst);
+  CartesianPoint selfResidual = singleBodyStatEnergy(sT.getMatches(), sT.getCentralResidueIndices()[0], selfResidualPC, &fasst);
+  if (recordData) recorded.push_back(sT);
   if (verbose) printSelfComponent(selfResidual, "\t");
   selfE += selfResidual;
 
   // -- self correction
-  if ((selfCorrMaxCliqueSize >= 0) && (selfCorrMaxCliqueSize < 2)) return selfE; // if max clique size is less than 2, then there is effectively no self residual
+  if (!needSelfCorrection()) return selfE; // if max clique size is less than 2, then there is effectively no self residual
   if (verbose) cout << "\tdTERMen::selfEnergies -> self correction..." << endl;
 
-  // -- get contacts
-  vector<pair<Residue*, Residue*>> conts = getContactsWith({R}, C, 0, verbose);
+  // -- contacts
   vector<Residue*> contResidues(conts.size(), NULL);
   for (int i = 0; i < conts.size(); i++) contResidues[i] = conts[i].second;
 
@@ -1016,16 +1267,23 @@ vector<mstreal> dTERMen::selfEnergies(Residue* R, ConFind& C, bool verbose) {
   // create a clique (with number of matches), which will not be grown.
   vector<termData> finalCliques;
   map<Residue*, termData> cliquesToGrow;
+  vector<termData> seeds(contResidues.size());
+  vector<Structure> seedTERMs(contResidues.size());
+  vector<fasstSearchOptions> seedOpts(contResidues.size(), foptsBase);
   for (int i = 0; i < contResidues.size(); i++) {
     if (verbose) cout << "\t\tdTERMen::selfEnergies -> seed clique with contact " << *(contResidues[i]) << "..." << endl;
-    termData c({R, contResidues[i]}, pmSelf);
-    F.setOptions(foptsBase);
-    F.setQuery(c.getTERM());
-    F.setRMSDCutoff(rmsdCutSelfCor(c.getResidueIndices(), S));
-    F.setMinNumMatches(selfCorrMinN);
-    F.setMaxNumMatches(selfCorrMaxN);
-    c.setMatches(F.search(), homCut, &F);
-    if ((c.numMatches() < selfCorrMinN) || (c.getMatch(selfCorrMinN - 1).getRMSD()) > F.getRMSDCutoff()) { finalCliques.push_back(c); }
+    seeds[i] = termData({R, contResidues[i]}, pmSelf);
+    seedTERMs[i] = seeds[i].getTERM();
+    seedOpts[i].setRMSDCutoff(rmsdCutSelfCor(seeds[i].getResidueIndices(), S));
+    seedOpts[i].setMinNumMatches(selfCorrMinN);
+    seedOpts[i].setMaxNumMatches(selfCorrMaxN);
+  }
+  vector<fasstSolutionSet> seedMatches = searchTERMs(fasst, seedTERMs, seedOpts);
+  fasst.setOptions(foptsBase);
+  for (int i = 0; i < contResidues.size(); i++) {
+    termData& c = seeds[i];
+    c.setMatches(seedMatches[i], homCut, &fasst);
+    if ((c.numMatches() < selfCorrMinN) || (c.getMatch(selfCorrMinN - 1).getRMSD()) > seedOpts[i].getRMSDCutoff()) { finalCliques.push_back(c); }
     else { cliquesToGrow[contResidues[i]] = c; }
   }
 
@@ -1044,15 +1302,21 @@ vector<mstreal> dTERMen::selfEnergies(Residue* R, ConFind& C, bool verbose) {
     while (!remConts.empty()) {
       if ((selfCorrMaxCliqueSize >= 0) && (parentClique.numCentralResidues() >= selfCorrMaxCliqueSize)) break;
       // try to add every remaining contact
+      vector<termData> newCliques(remConts.size(), parentClique);
+      vector<Structure> newTERMs(remConts.size());
+      vector<fasstSearchOptions> newOpts(remConts.size(), foptsBase);
       for (int j = 0; j < remConts.size(); j++) {
         if (verbose) cout << "\t\t\tdTERMen::selfEnergies -> trying to add " << *(remConts[j]) << "..." << endl;
-        termData newClique = parentClique;
-        newClique.addCentralResidue(remConts[j], pmSelf);
-        F.setOptions(foptsBase);
-        F.setQuery(newClique.getTERM());
-        F.setRMSDCutoff(rmsdCutSelfCor(newClique.getResidueIndices(), S));
-        F.setMaxNumMatches(selfCorrMaxN);
-        newClique.setMatches(F.search(), homCut, &F);
+        newCliques[j].addCentralResidue(remConts[j], pmSelf);
+        newTERMs[j] = newCliques[j].getTERM();
+        newOpts[j].setRMSDCutoff(rmsdCutSelfCor(newCliques[j].getResidueIndices(), S));
+        newOpts[j].setMaxNumMatches(selfCorrMaxN);
+      }
+      vector<fasstSolutionSet> newMatches = searchTERMs(fasst, newTERMs, newOpts);
+      fasst.setOptions(foptsBase);
+      for (int j = 0; j < remConts.size(); j++) {
+        termData& newClique = newCliques[j];
+        newClique.setMatches(newMatches[j], homCut, &fasst);
         if ((j == 0) || (newClique.numMatches() > grownClique.numMatches())) {
           if (verbose) cout << "\t\t\t\tdTERMen::selfEnergies -> new best" << endl;
           grownClique = newClique;
@@ -1088,8 +1352,8 @@ vector<mstreal> dTERMen::selfEnergies(Residue* R, ConFind& C, bool verbose) {
   if (verbose) cout << "\tdTERMen::selfEnergies -> final cliques:" << endl;
   for (int i = 0; i < finalCliques.size(); i++) {
     if (verbose) cout << "\t\t" << finalCliques[i].toString() << endl;
-    if (recordData) data.push_back(finalCliques[i]);
-    CartesianPoint cliqueDelta = singleBodyStatEnergy(finalCliques[i].getMatches(), finalCliques[i].getCentralResidueIndices()[0], selfCorrPC);
+    if (recordData) recorded.push_back(finalCliques[i]);
+    CartesianPoint cliqueDelta = singleBodyStatEnergy(finalCliques[i].getMatches(), finalCliques[i].getCentralResidueIndices()[0], selfCorrPC, &fasst);
     if (verbose) printSelfComponent(cliqueDelta, "\t\t\t");
     selfE += cliqueDelta;
   }
@@ -1102,22 +1366,53 @@ mstreal dTERMen::pairEnergy(Residue* Ri, Residue* Rj, const string& aai, const s
                                [dTERMen::aaToIndex(aaj.empty() ? Rj->getName() : aaj)];
 }
 
+fasstSearchOptions dTERMen::pairSearchOptions(Residue* Ri, Residue* Rj, termData& pT) {
+  if ((Ri->getStructure() == NULL) || (Rj->getStructure() == NULL)) MstUtils::error("cannot operate on a disembodied residues!", "dTERMen::pairSearchOptions(Residue*, Residue*, termData&)");
+  if (Ri->getStructure() != Rj->getStructure()) MstUtils::error("specified residues belong to different structures!", "dTERMen::pairSearchOptions(Residue*, Residue*, termData&)");
+  pT = termData({Ri, Rj}, pmPair);
+  fasstSearchOptions opts = foptsBase;
+  opts.setRMSDCutoff(RMSDCalculator::rmsdCutoff(pT.getResidueIndices(), *(Ri->getStructure()), 1.0, 20));
+  opts.setMinNumMatches(pairMinN);
+  opts.setMaxNumMatches(pairMaxN);
+  return opts;
+}
+
 vector<vector<mstreal>> dTERMen::pairEnergies(Residue* Ri, Residue* Rj, bool verbose) {
-  auto rmsdCutPair = [](const vector<int>& fragResIdx, const Structure& S) { return RMSDCalculator::rmsdCutoff(fragResIdx, S, 1.0, 20); };
-  if ((Ri->getStructure() == NULL) || (Rj->getStructure() == NULL)) MstUtils::error("cannot operate on a disembodied residues!", "dTERMen::pairEnergies(Residue*, Residue*, bool)");
-  if (Ri->getStructure() != Rj->getStructure()) MstUtils::error("specified residues belong to different structures!", "dTERMen::pairEnergies(Residue*, Residue*, bool)");
-  Structure& S = *(Ri->getStructure());
+  return pairEnergies(Ri, Rj, F, data);
+}
 
+vector<vector<mstreal>> dTERMen::pairEnergies(Residue* Ri, Residue* Rj, FASST& fasst, vector<termData>& recorded) {
+  MstProfiler::scope prof("dTERMen::pairEnergies");
   // isolate TERM and get matches
-  int naa = globalAlphabetSize();
-  termData pT({Ri, Rj}, pmPair);
+  termData pT;
+  fasstSearchOptions opts = pairSearchOptions(Ri, Rj, pT);
+  pT.setMatches(searchTERM(fasst, pT.getTERM(), opts), homCut, &fasst);
+  if (recordData) recorded.push_back(pT);
+  return pairEnergiesFromMatches(pT, &fasst);
+}
+
+vector<vector<vector<mstreal>>> dTERMen::pairEnergies(const vector<pair<Residue*, Residue*>>& pairs, bool verbose) {
+  vector<termData> pTs(pairs.size());
+  vector<Structure> terms(pairs.size());
+  vector<fasstSearchOptions> opts(pairs.size());
+  for (int i = 0; i < pairs.size(); i++) {
+    opts[i] = pairSearchOptions(pairs[i].first, pairs[i].second, pTs[i]);
+    terms[i] = pTs[i].getTERM();
+  }
+  if (verbose) cout << "\tdTERMen::pairEnergies -> searching for " << terms.size() << " pair TERMs..." << endl;
+  vector<fasstSolutionSet> matches = searchTERMs(F, terms, opts);
   F.setOptions(foptsBase);
-  F.setQuery(pT.getTERM());
-  F.setRMSDCutoff(rmsdCutPair(pT.getResidueIndices(), S));
-  F.setMinNumMatches(pairMinN);
-  F.setMaxNumMatches(pairMaxN);
-  pT.setMatches(F.search(), homCut, &F);
-  if (recordData) data.push_back(pT);
+  vector<vector<vector<mstreal>>> pairEs(pairs.size());
+  for (int i = 0; i < pairs.size(); i++) {
+    pTs[i].setMatches(matches[i], homCut, &F);
+    if (recordData) data.push_back(pTs[i]);
+    pairEs[i] = pairEnergiesFromMatches(pTs[i]);
+  }
+  return pairEs;
+}
+
+vector<vector<mstreal>> dTERMen::pairEnergiesFromMatches(termData& pT, FASST* fasst) {
+  int naa = globalAlphabetSize();
 
   // for each of the two positions, compute expectation of every amino acid in
   // the context of every match, based on background "trivial" energies and
@@ -1126,11 +1421,11 @@ vector<vector<mstreal>> dTERMen::pairEnergies(Residue* Ri, Residue* Rj, bool ver
   vector<CartesianPoint> Pi, Pj;
   vector<vector<mstreal> > pairE(naa, vector<mstreal>(naa, 0.0));
   int cIndI = pT.getCentralResidueIndices()[0]; int cIndJ = pT.getCentralResidueIndices()[1];
-  CartesianPoint NoI = dTERMen::singleBodyObservations(pT.getMatches(), cIndI);
-  CartesianPoint NeI = dTERMen::singleBodyExpectations(pT.getMatches(), cIndI, &Pi);
-  CartesianPoint NoJ = dTERMen::singleBodyObservations(pT.getMatches(), cIndJ);
-  CartesianPoint NeJ = dTERMen::singleBodyExpectations(pT.getMatches(), cIndJ, &Pj);
-  CartesianPoint NoIJ = dTERMen::twoBodyObservations(pT.getMatches(), cIndI, cIndJ);
+  CartesianPoint NoI = dTERMen::singleBodyObservations(pT.getMatches(), cIndI, fasst);
+  CartesianPoint NeI = dTERMen::singleBodyExpectations(pT.getMatches(), cIndI, &Pi, fasst);
+  CartesianPoint NoJ = dTERMen::singleBodyObservations(pT.getMatches(), cIndJ, fasst);
+  CartesianPoint NeJ = dTERMen::singleBodyExpectations(pT.getMatches(), cIndJ, &Pj, fasst);
+  CartesianPoint NoIJ = dTERMen::twoBodyObservations(pT.getMatches(), cIndI, cIndJ, fasst);
   for (int aai = 0; aai < naa; aai++) {
     for (int aaj = 0; aaj < naa; aaj++) {
       mstreal Ne = 0;
@@ -1157,12 +1452,11 @@ vector<vector<mstreal>> dTERMen::pairEnergiesNew(Residue* Ri, Residue* Rj, bool
   // isolate TERM and get matches
   int naa = globalAlphabetSize();
   termData pT({Ri, Rj}, pmPair);
-  F.setOptions(foptsBase);
-  F.setQuery(pT.getTERM(), false);
-  F.setRMSDCutoff(rmsdCutPair(pT.getResidueIndices(), S));
-  F.setMinNumMatches(pairMinN);
-  F.setMaxNumMatches(pairMaxN);
-  pT.setMatches(F.search(), homCut, &F);
+  fasstSearchOptions opts = foptsBase;
+  opts.setRMSDCutoff(rmsdCutPair(pT.getResidueIndices(), S));
+  opts.setMinNumMatches(pairMinN);
+  opts.setMaxNumMatches(pairMaxN);
+  pT.setMatches(searchTERM(F, pT.getTERM(), opts, false), homCut, &F);
   if (recordData) data.push_back(pT);
 
   // figure out which matches are from "homo-dimers"
@@ -1216,12 +1510,11 @@ vector<vector<mstreal>> dTERMen::pairEnergiesNew2(Residue* Ri, Residue* Rj, bool
   // isolate TERM and get matches
   int naa = globalAlphabetSize();
   termData pT({Ri, Rj}, pmPair);
-  F.setOptions(foptsBase);
-  F.setQuery(pT.getTERM());
-  F.setRMSDCutoff(rmsdCutPair(pT.getResidueIndices(), S));
-  F.setMinNumMatches(pairMinN);
-  F.setMaxNumMatches(pairMaxN);
-  pT.setMatches(F.search(), homCut, &F);
+  fasstSearchOptions opts = foptsBase;
+  opts.setRMSDCutoff(rmsdCutPair(pT.getResidueIndices(), S));
+  opts.setMinNumMatches(pairMinN);
+  opts.setMaxNumMatches(pairMaxN);
+  pT.setMatches(searchTERM(F, pT.getTERM(), opts), homCut, &F);
   if (recordData) data.push_back(pT);
 
   // figure out which matches are from "homo-dimers"
@@ -1277,10 +1570,10 @@ void dTERMen::printSelfComponent(const CartesianPoint& ener, const string& prefi
   cout << endl;
 }
 
-CartesianPoint dTERMen::singleBodyStatEnergy(fasstSolutionSet& matches, int cInd, int pc) {
+CartesianPoint dTERMen::singleBodyStatEnergy(fasstSolutionSet& matches, int cInd, int pc, FASST* fasst) {
   CartesianPoint selfE(globalAlphabetSize(), 0.0);
-  CartesianPoint Ne = dTERMen::singleBodyExpectations(matches, cInd);
-  CartesianPoint No = dTERMen::singleBodyObservations(matches, cInd);
+  CartesianPoint Ne = dTERMen::singleBodyExpectations(matches, cInd, NULL, fasst);
+  CartesianPoint No = dTERMen::singleBodyObservations(matches, cInd, fasst);
   for (int aai = 0; aai < selfE.size(); aai++) {
     selfE[aai] = -kT*log((No[aai] + pc)/(Ne[aai] + pc));
   }
@@ -1288,55 +1581,56 @@ CartesianPoint dTERMen::singleBodyStatEnergy(fasstSolutionSet& matches, int cInd
   return selfE;
 }
 
-CartesianPoint dTERMen::singleBodyObservations(fasstSolutionSet& matches, int cInd) {
+CartesianPoint dTERMen::singleBodyObservations(fasstSolutionSet& matches, int cInd, FASST* fasst) {
   CartesianPoint No(globalAlphabetSize(), 0.0);
   for (int i = 0; i < matches.size(); i++) {
-    int aaIdx = dTERMen::aaToIndex(F.getMatchSequence(matches[i])[cInd]);
+    int aaIdx = dTERMen::aaToIndex(searcher(fasst).getMatchSequence(matches[i])[cInd]);
     if (!aaIndexKnown(aaIdx)) continue; // this match has some amino acid that is not known in the current alphabet
     No[aaIdx] += 1.0;
   }
   return No;
 }
 
-CartesianPoint dTERMen::twoBodyObservations(fasstSolutionSet& matches, int cIndI, int cIndJ) {
+CartesianPoint dTERMen::twoBodyObservations(fasstSolutionSet& matches, int cIndI, int cIndJ, FASST* fasst) {
   CartesianPoint No(globalAlphabetSize()*globalAlphabetSize(), 0.0);
   for (int i = 0; i < matches.size(); i++) {
-    int aaiIdx = dTERMen::aaToIndex(F.getMatchSequence(matches[i])[cIndI]);
-    int aajIdx = dTERMen::aaToIndex(F.getMatchSequence(matches[i])[cIndJ]);
+    Sequence seq = searcher(fasst).getMatchSequence(matches[i]);
+    int aaiIdx = dTERMen::aaToIndex(seq[cIndI]);
+    int aajIdx = dTERMen::aaToIndex(seq[cIndJ]);
     if (!aaIndexKnown(aaiIdx) || !aaIndexKnown(aajIdx)) continue;
     No[dTERMen::pairToIdx(aaiIdx, aajIdx)] += 1.0;
   }
   return No;
 }
 
-CartesianPoint dTERMen::singleBodyExpectations(fasstSolutionSet& matches, int cInd, vector<CartesianPoint>* breakDown) {
+CartesianPoint dTERMen::singleBodyExpectations(fasstSolutionSet& matches, int cInd, vector<CartesianPoint>* breakDown, FASST* fasst) {
   CartesianPoint Ne(globalAlphabetSize(), 0.0);
   if (breakDown != NULL) { breakDown->clear(); breakDown->resize(matches.size()); }
   for (int i = 0; i < matches.size(); i++) {
-    int aaIdx = dTERMen::aaToIndex(F.getMatchSequence(matches[i])[cInd]);
+    int aaIdx = dTERMen::aaToIndex(searcher(fasst).getMatchSequence(matches[i])[cInd]);
     if (!aaIndexKnown(aaIdx)) continue; // this match has some amino acid that is not known in the current alphabet
-    CartesianPoint inMatchExp = backExpectation(matches[i], cInd);
+    CartesianPoint inMatchExp = backExpectation(matches[i], cInd, fasst);
     if (breakDown != NULL) (*breakDown)[i] = inMatchExp;
     Ne += inMatchExp;
   }
   return Ne;
 }
 
-vector<CartesianPoint> dTERMen::singleBodyExpectationsMatchedMarginals(fasstSolutionSet& matches, int cInd) {
+vector<CartesianPoint> dTERMen::singleBodyExpectationsMatchedMarginals(fasstSolutionSet& matches, int cInd, FASST* fasst) {
   // compute initial expected amino-acid distributions in each match
   vector<CartesianPoint> mlogP;
   CartesianPoint Ne(globalAlphabetSize(), 0.0);
   vector<int> validMatches;
   for (int i = 0; i < matches.size(); i++) {
-    int aaIdx = dTERMen::aaToIndex(F.getMatchSequence(matches[i])[cInd]);
+    int aaIdx = dTERMen::aaToIndex(searcher(fasst).getMatchSequence(matches[i])[cInd]);
     if (!aaIndexKnown(aaIdx)) continue; // this match has some amino acid that is not known in the current alphabet
     validMatches.push_back(i);
-    CartesianPoint inMatchExp = backExpectation(matches[i], cInd);
+    CartesianPoint inMatchExp = backExpectation(matches[i], cInd, fasst);
     Ne += inMatchExp;
     mlogP.push_back(inMatchExp);
     for (int j = 0; j < mlogP.back().size(); j++) mlogP.back()[j] = -log(mlogP.back()[j]);
   }
-  CartesianPoint No = dTERMen::singleBodyObservations(matches, cInd);
+  CartesianPoint No = dTERMen::singleBodyObservations(matches, cInd, fasst);
 
   // next, iterate to find optimal amino-acid bias energies to get marginals to agree
   CartesianPoint delE(globalAlphabetSize(), 0.0);
@@ -1358,15 +1652,14 @@ vector<CartesianPoint> dTERMen::singleBodyExpectationsMatchedMarginals(fasstSolu
   return breakDown;
 }
 
-CartesianPoint dTERMen::backExpectation(const fasstSolution& m, int cInd) {
+CartesianPoint dTERMen::backExpectation(const fasstSolution& m, int cInd, FASST* fasst) {
   vector<mstreal> p(globalAlphabetSize(), 0);
-  mstreal phi = F.getResidueProperties(m, "phi")[cInd];
-  mstreal psi = F.getResidueProperties(m, "psi")[cInd];
-  mstreal omg = F.getResidueProperties(m, "omega")[cInd];
-  mstreal env = F.getResidueProperties(m, "env")[cInd];
-  for (int aai = 0; aai < globalAlphabetSize(); aai++) {
-    p[aai] = backEner(aai) + bbOmegaEner(omg, aai) + bbPhiPsiEner(phi, psi, aai) + envEner(env, aai);
-  }
+  FASST& S = searcher(fasst);
+  mstreal phi = S.getResidueProperties(m, "phi")[cInd];
+  mstreal psi = S.getResidueProperties(m, "psi")[cInd];
+  mstreal omg = S.getResidueProperties(m, "omega")[cInd];
+  mstreal env = S.getResidueProperties(m, "env")[cInd];
+  backgroundEnergies(phi, psi, omg, env, p.data());
   dTERMen::enerToProb(p);
   return p;
 }
@@ -1387,6 +1680,118 @@ pair<int, int> dTERMen::idxToPair(int idx) const {
   return pair<int, int>(idx / globalAlphabetSize(), idx % globalAlphabetSize());
 }
 
+/* ----------- termMatchStore --------------- */
+string termMatchStore::key(const Structure& term, const fasstSearchOptions& opts, bool autoSplitChains) {
+  if (opts.gapConstraintsExist() || opts.diffChainsConstsExist() || opts.sequenceConstraintsSet()) return "";
+  stringstream ss;
+  MstUtils::writeBin(ss, autoSplitChains);
+  MstUtils::writeBin(ss, opts.getRMSDCutoff());
+  MstUtils::writeBin(ss, opts.getMinNumMatches());
+  MstUtils::writeBin(ss, opts.getMaxNumMatches());
+  MstUtils::writeBin(ss, opts.getSufficientNumMatches());
+  MstUtils::writeBin(ss, opts.getContextLength());
+  MstUtils::writeBin(ss, opts.getRedundancyCut());
+  MstUtils::writeBin(ss, opts.getRedundancyProperty());
+  MstUtils::writeBin(ss, term.chainSize());
+  for (int ci = 0; ci < term.chainSize(); ci++) {
+    Chain& chain = term[ci];
+    MstUtils::writeBin(ss, chain.residueSize());
+    for (int ri = 0; ri < chain.residueSize(); ri++) {
+      Residue& res = chain[ri];
+      MstUtils::writeBin(ss, res.atomSize());
+      for (int ai = 0; ai < res.atomSize(); ai++) {
+        MstUtils::writeBin(ss, res[ai].getName());
+        MstUtils::writeBin(ss, res[ai].getX());
+        MstUtils::writeBin(ss, res[ai].getY());
+        MstUtils::writeBin(ss, res[ai].getZ());
+      }
+    }
+  }
+  return ss.str();
+}
+
+bool termMatchStore::find(const string& key, fasstSolutionSet& sols) const {
+  lock_guard<mutex> guard(lock);
+  auto it = entries.find(key);
+  if (it == entries.end()) return false;
+  const entry& e = it->second;
+  sols.clear();
+  for (int i = 0; i < e.addresses.size(); i++) {
+    fasstSolution sol(e.addresses[i], e.segLengths);
+    sol.setRMSD(e.rmsds[i]);
+    sols.insert(sol);
+  }
+  return true;
+}
+
+void termMatchStore::insert(const string& key, const fasstSolutionSet& sols) {
+  entry e;
+  if (sols.size() > 0) e.segLengths = sols.begin()->getSegLengths();
+  for (auto it = sols.begin(); it != sols.end(); ++it) {
+    e.addresses.push_back(it->getAddress());
+    e.rmsds.push_back(it->getRMSD());
+  }
+  lock_guard<mutex> guard(lock);
+  entries[key] = e;
+}
+
+int termMatchStore::size() const {
+  lock_guard<mutex> guard(lock);
+  return entries.size();
+}
+
+void termMatchStore::clear() {
+  lock_guard<mutex> guard(lock);
+  entries.clear();
+}
+
+void termMatchStore::write(const string& file, int numTargets) const {
+  lock_guard<mutex> guard(lock);
+  fstream ofs; MstUtils::openFile(ofs, file, fstream::out | fstream::binary, "termMatchStore::write");
+  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 1); // format version
+  MstUtils::writeBin(ofs, numTargets);
+  MstUtils::writeBin(ofs, (int) entries.size());
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    // keys are binary, so are written with their length
+    MstUtils::writeBin(ofs, (int) it->first.size());
+    ofs.write(it->first.data(), it->first.size());
+    const entry& e = it->second;
+    MstUtils::writeBin(ofs, e.segLengths);
+    MstUtils::writeBin(ofs, (int) e.addresses.size());
+    for (int i = 0; i < e.addresses.size(); i++) {
+      e.addresses[i].write(ofs);
+      MstUtils::writeBin(ofs, e.rmsds[i]);
+    }
+  }
+  ofs.close();
+}
+
+void termMatchStore::read(const string& file, int numTargets) {
+  fstream ifs; MstUtils::openFile(ifs, file, fstream::in | fstream::binary, "termMatchStore::read");
+  char sect; int ver, nt, ne;
+  MstUtils::readBin(ifs, sect); MstUtils::readBin(ifs, ver);
+  if ((sect != 'V') || (ver != 1)) MstUtils::error("unknown format of TERM match store file " + file, "termMatchStore::read");
+  MstUtils::readBin(ifs, nt);
+  if (nt != numTargets) MstUtils::error("TERM match store " + file + " was built with a database of " + MstUtils::toString(nt) + " targets, while the current one has " + MstUtils::toString(numTargets), "termMatchStore::read");
+  MstUtils::readBin(ifs, ne);
+  lock_guard<mutex> guard(lock);
+  for (int k = 0; k < ne; k++) {
+    int len; MstUtils::readBin(ifs, len);
+    string key(len, '\0');
+    ifs.read(&key[0], len);
+    entry& e = entries[key];
+    MstUtils::readBin(ifs, e.segLengths);
+    int n; MstUtils::readBin(ifs, n);
+    e.addresses.resize(n); e.rmsds.resize(n);
+    for (int i = 0; i < n; i++) {
+      e.addresses[i].read(ifs);
+      MstUtils::readBin(ifs, e.rmsds[i]);
+    }
+  }
+  if (ifs.fail()) MstUtils::error("error reading TERM match store file " + file, "termMatchStore::read");
+  ifs.close();
+}
+
 /* ----------- EnergyTable --------------- */
 int termData::setMatches(const fasstSolutionSet& _matches, mstreal homologyCutoff, FASST* F) {
   if (F == NULL) { matches = _matches; return matches.size(); }
@@ -1435,6 +1840,7 @@ int termData::setMatches(const fasstSolutionSet& _matches, mstreal homologyCutof
 
 /* ----------- EnergyTable --------------- */
 EnergyTable::EnergyTable(const string& tabFile) {
+  compiled = false;
   readFromFile(tabFile);
 }
 
@@ -1517,6 +1923,7 @@ EnergyTable EnergyTable::restrictSiteAlphabet(const Structure& S, bool constrain
 
 void EnergyTable::addSite(const string& siteName) {
   if (siteIndices.find(siteName) != siteIndices.end()) MstUtils::error("site '" + siteName + "' is already present!", "EnergyTable::addSite(const string&)");
+  compiled = false;
   siteIndices[siteName] = sites.size();
   sites.push_back(siteName);
   aaAlpha.resize(aaAlpha.size() + 1);
@@ -1533,6 +1940,7 @@ void EnergyTable::addSites(const vector<string>& siteNames) {
 void EnergyTable::setSiteAlphabet(int siteIdx, const vector<string>& alpha) {
 //  if (!empty()) MstUtils::error("site alphabets must be set before populating energies", "EnergyTable::setSiteAlphabet(int, const vector<string>&)");
   if (aaAlpha.size() < siteIdx + 1) MstUtils::error("site index out of range", "EnergyTable::setSiteAlphabet(int, const vector<string>&)");
+  compiled = false;
   aaAlpha[siteIdx] = alpha;
   for (int i = 0; i < alpha.size(); i++) aaIndices[siteIdx][alpha[i]] = i;
   selfE[siteIdx].clear(); selfE[siteIdx].resize(alpha.size(), 0.0);
@@ -1546,6 +1954,7 @@ void EnergyTable::setSiteAlphabet(int siteIdx, const vector<string>& alpha) {
 
 int EnergyTable::addToSiteAlphabet(int siteIdx, const string& aa) {
   if (aaIndices[siteIdx].find(aa) != aaIndices[siteIdx].end()) MstUtils::error("tried to add an amino acid that already exists at the site!", "EnergyTable::addToSiteAlphabet(int, const string&)");
+  compiled = false;
   int a = aaIndices[siteIdx].size();
   aaIndices[siteIdx][aa] = a;
   aaAlpha[siteIdx].push_back(aa);
@@ -1561,6 +1970,8 @@ void EnergyTable::renameSiteResidue(int si, int ai, const string& aa) {
 }
 
 void EnergyTable::clear() {
+  compiled = false;
+  nbrStart.clear(); nbrSite.clear(); nbrOffset.clear(); nbrAlphaSize.clear(); nbrE.clear();
   siteIndices.clear();
   sites.clear();
   aaIndices.clear();
@@ -1675,6 +2086,7 @@ void EnergyTable::setSelfEnergy(int s, int aa, mstreal ener) {
 }
 
 void EnergyTable::setPairEnergy(int si, int sj, int aai, int aaj, mstreal ener) {
+  compiled = false;
   // store each interaction energy in one order only
   if (sj < si) {
     int tmp = si; si = sj; sj = tmp;
@@ -1698,9 +2110,49 @@ void EnergyTable::setPairEnergy(int si, int sj, int aai, int aaj, mstreal ener)
   pairE[si][k][aai][aaj] = ener;
 }
 
+void EnergyTable::compile() {
+  int L = numSites();
+  nbrStart.resize(L + 1);
+  nbrSite.clear(); nbrOffset.clear(); nbrAlphaSize.clear(); nbrE.clear();
+  for (int si = 0; si < L; si++) {
+    nbrStart[si] = nbrSite.size();
+    int ni = aaAlpha[si].size();
+    for (auto it = pairMaps[si].begin(); it != pairMaps[si].end(); ++it) {
+      int sj = it->first, k = it->second, nj = aaAlpha[sj].size();
+      nbrSite.push_back(sj);
+      nbrAlphaSize.push_back(nj);
+      nbrOffset.push_back(nbrE.size());
+      nbrE.resize(nbrE.size() + ni*nj, 0.0);
+      mstreal* block = nbrE.data() + nbrOffset.back();
+      // energies are stored in pairE[min(si, sj)] (blocks may be smaller than
+      // the alphabets, if these grew after energies were set, with the rest zero)
+      const vector<vector<mstreal>>& E = (sj > si) ? pairE[si][k] : pairE[sj][k];
+      for (int aai = 0; aai < ni; aai++) {
+        for (int aaj = 0; aaj < nj; aaj++) {
+          int r = (sj > si) ? aai : aaj, c = (sj > si) ? aaj : aai;
+          if ((r < E.size()) && (c < E[r].size())) block[aai*nj + aaj] = E[r][c];
+        }
+      }
+    }
+  }
+  nbrStart[L] = nbrSite.size();
+  compiled = true;
+}
+
 mstreal EnergyTable::scoreSolution(const vector<int>& sol) {
   if (sol.size() != selfE.size()) MstUtils::error("solution of wrong length for table", "EnergyTable::scoreSolution(const vector<int>&)");
   mstreal ener = 0;
+  if (compiled) {
+    for (int si = 0; si < selfE.size(); si++) {
+      ener += selfE[si][sol[si]];
+      for (int k = nbrStart[si]; k < nbrStart[si + 1]; k++) {
+        int sj = nbrSite[k];
+        if (sj < si) continue; // do not overcount pairs
+        ener += nbrE[nbrOffset[k] + sol[si]*nbrAlphaSize[k] + sol[sj]];
+      }
+    }
+    return ener;
+  }
   for (int si = 0; si < selfE.size(); si++) {
     ener += selfE[si][sol[si]];
     for (auto it = pairMaps[si].begin(); it != pairMaps[si].end(); ++it) {
@@ -1715,11 +2167,117 @@ mstreal EnergyTable::scoreSequence(const Sequence& seq) {
   return scoreSolution(sequenceToSolution(seq));
 }
 
+void EnergyTable::scoreBlock(const int* aa, int n, mstreal* ener) const {
+  for (int b = 0; b < n; b++) ener[b] = 0;
+  // same order of summation as scoreSolution(), for identical scores
+  for (int si = 0; si < selfE.size(); si++) {
+    const int* aai = aa + si*n;
+    const mstreal* self = selfE[si].data();
+    for (int b = 0; b < n; b++) ener[b] += self[aai[b]];
+    for (int k = nbrStart[si]; k < nbrStart[si + 1]; k++) {
+      int sj = nbrSite[k];
+      if (sj < si) continue; // do not overcount pairs
+      const int* aaj = aa + sj*n;
+      const mstreal* block = nbrE.data() + nbrOffset[k];
+      int nj = nbrAlphaSize[k];
+      for (int b = 0; b < n; b++) ener[b] += block[aai[b]*nj + aaj[b]];
+    }
+  }
+}
+
+vector<mstreal> EnergyTable::scoreSequences(const vector<Sequence>& seqs, int numThreads, bool strict) {
+  if (!compiled) compile();
+  int L = numSites(), N = seqs.size();
+  vector<mstreal> ener(N);
+
+  // alphabet index at each site of every amino-acid index (-1 if not in the
+  // alphabet), consistent with sequenceToSolution()
+  int maxIdx = SeqTools::maxIndex();
+  for (int si = 0; si < L; si++) {
+    for (int a = 0; a < aaAlpha[si].size(); a++) maxIdx = MstUtils::max(maxIdx, (int) SeqTools::aaToIdx(aaAlpha[si][a]));
+  }
+  vector<int> lookup(L*(maxIdx + 1), -1);
+  for (int si = 0; si < L; si++) {
+    for (int a = 0; a < aaAlpha[si].size(); a++) {
+      res_t idx = SeqTools::aaToIdx(aaAlpha[si][a]);
+      if ((idx >= 0) && (SeqTools::idxToTriple(idx) == aaAlpha[si][a])) lookup[si*(maxIdx + 1) + idx] = a;
+    }
+  }
+
+  const int B = 256; // sequences per block
+  int numBlocks = (N + B - 1)/B;
+  numThreads = MstUtils::max(1, MstUtils::min(numThreads, numBlocks));
+  vector<vector<int> > aa(numThreads, vector<int>(L*B));
+  MstUtils::parallelFor(numBlocks, numThreads, [&](int bi, int w) {
+    int start = bi*B, n = MstUtils::min(B, N - start);
+    int* blockAA = aa[w].data();
+    vector<bool> bad(n, false);
+    for (int b = 0; b < n; b++) {
+      const Sequence& seq = seqs[start + b];
+      bad[b] = (seq.size() != L);
+      for (int si = 0; si < L; si++) {
+        int a = -1;
+        if (!bad[b] && (seq[si] >= 0) && (seq[si] <= maxIdx)) a = lookup[si*(maxIdx + 1) + seq[si]];
+        if (a < 0) {
+          if (strict) MstUtils::error("sequence " + MstUtils::toString(start + b) + " is of wrong length or not from table alphabet", "EnergyTable::scoreSequences(const vector<Sequence>&, int, bool)");
+          bad[b] = true;
+          a = 0;
+        }
+        blockAA[si*n + b] = a;
+      }
+    }
+    scoreBlock(blockAA, n, ener.data() + start);
+    for (int b = 0; b < n; b++) {
+      if (bad[b]) ener[start + b] = NAN;
+    }
+  });
+  return ener;
+}
+
+long EnergyTable::scoreSequences(const string& seqFile, ostream& out, int numThreads, bool strict, int chunkSize) {
+  if (chunkSize < 1) MstUtils::error("chunk size must be positive", "EnergyTable::scoreSequences(const string&, ostream&, int, bool, int)");
+  fstream file;
+  MstUtils::openFile(file, seqFile, fstream::in, "EnergyTable::scoreSequences(const string&, ostream&, int, bool, int)");
+  vector<string> lines;
+  vector<Sequence> seqs;
+  long numScored = 0;
+  string line;
+  while (true) {
+    bool more = (bool) getline(file, line);
+    if (more) {
+      line = MstUtils::trim(line);
+      if (line.empty()) continue;
+      lines.push_back(line);
+      seqs.push_back(Sequence(line, ""));
+    }
+    if ((seqs.size() == chunkSize) || (!more && !seqs.empty())) {
+      vector<mstreal> ener = scoreSequences(seqs, numThreads, strict);
+      for (int i = 0; i < seqs.size(); i++) out << ener[i] << " " << lines[i] << "\n";
+      numScored += seqs.size();
+      lines.clear(); seqs.clear();
+    }
+    if (!more) break;
+  }
+  file.close();
+  out.flush();
+  return numScored;
+}
+
 mstreal EnergyTable::scoreMutation(const vector<int>& sol, int mutSite, int mutAA) {
   if (sol.size() != selfE.size()) MstUtils::error("wild-type solution of wrong length for table", "EnergyTable::scoreMutation(const vector<int>&, int, const string&)");
   if ((mutSite < 0) || (mutSite >= selfE.size())) MstUtils::error("mutation site index out of range for table", "EnergyTable::scoreMutation(const vector<int>&, int, const string&)");
 
   mstreal dE = selfE[mutSite][mutAA] - selfE[mutSite][sol[mutSite]];
+  if (compiled) {
+    const mstreal* E = nbrE.data();
+    int wtAA = sol[mutSite];
+    for (int k = nbrStart[mutSite]; k < nbrStart[mutSite + 1]; k++) {
+      int nj = nbrAlphaSize[k];
+      const mstreal* block = E + nbrOffset[k] + sol[nbrSite[k]];
+      dE += block[mutAA*nj] - block[wtAA*nj];
+    }
+    return dE;
+  }
   if (!pairMaps[mutSite].empty()) {
     for (auto it = pairMaps[mutSite].begin(); it != pairMaps[mutSite].end(); ++it) {
       int intSite = it->first; // interacting site index
@@ -1758,6 +2316,7 @@ int EnergyTable::randomResidue(int si) const {
 
 vector<int> EnergyTable::mc(int Nc, int Ni, mstreal kTi, mstreal kTf, int annealType, void* rec, void (*add)(void*, const vector<int>&, mstreal), int Ne, void* extra, mstreal (*additionalScore)(void*, const vector<int>&, EnergyTable&, int mutSite, int mutAA)) {
   if (kTf < 0) kTf = kTi;
+  if (!compiled) compile();
   mstreal kT = kTi;
   int L = numSites();
   if (Ne < 0) Ne = int(0.2*Ni + 1);
@@ -1821,6 +2380,368 @@ vector<int> EnergyTable::mc(int Nc, int Ni, mstreal kTi, mstreal kTf, int anneal
   return bS;
 }
 
+void EnergyTable::mcSteps(mcChain& ch, int n, mstreal kTi, mstreal kTf, int annealType, bool record, mutex& recLock, void* rec, mcRecordFunc add, void* extra, mcScoreFunc additionalScore) {
+  int L = numSites();
+  uniform_int_distribution<int> siteDist(0, L - 1);
+  uniform_real_distribution<mstreal> unitDist(0, 1.0);
+  mstreal kT = kTi;
+  for (int i = 0; i < n; i++) {
+    // every now and again, calculate the total energy to avoid accumulation of addition errors
+    if ((i+1) % 10000 == 0) {
+      ch.ener = scoreSolution(ch.seq);
+      if (additionalScore != NULL) ch.ener += (*additionalScore)(extra, ch.seq, *this, -1, -1);
+    }
+    int s = siteDist(ch.rng);
+    int aa = uniform_int_distribution<int>(0, selfE[s].size() - 1)(ch.rng);
+    mstreal dE = scoreMutation(ch.seq, s, aa);
+    if (additionalScore != NULL) dE += (*additionalScore)(extra, ch.seq, *this, s, aa);
+    if (kTi != kTf) {
+      mstreal f = (n > 1) ? i*1.0/(n-1) : 1.0;
+      switch (annealType) {
+        case 1:
+          // linear
+          kT = kTf*f + kTi*(1-f);
+          break;
+        case 2:
+          // exponential
+          kT = kTi*pow(kTf/kTi, f);
+          break;
+        default:
+          MstUtils::error("unrecognized annealing schedule type '" + MstUtils::toString(annealType) + "'", "EnergyTable::mcSteps");
+      }
+    }
+    if (unitDist(ch.rng) < exp(-dE/kT)) {
+      ch.seq[s] = aa;
+      ch.ener += dE;
+      if (record && (ch.ener < ch.bestEner)) {
+        ch.bestEner = ch.ener;
+        ch.bestSeq = ch.seq;
+      }
+    }
+    if (record && (rec != NULL) && (add != NULL)) {
+      lock_guard<mutex> lock(recLock);
+      (*add)(rec, ch.seq, ch.ener);
+    }
+  }
+}
+
+vector<int> EnergyTable::mcParallel(int Nc, int Ni, mstreal kTi, mstreal kTf, int annealType, int numThreads, int exchange, void* rec, void (*add)(void*, const vector<int>&, mstreal), int Ne, void* extra, mstreal (*additionalScore)(void*, const vector<int>&, EnergyTable&, int mutSite, int mutAA)) {
+  if (Nc < 1) MstUtils::error("need at least one chain", "EnergyTable::mcParallel");
+  if (exchange < 0) MstUtils::error("exchange interval cannot be negative", "EnergyTable::mcParallel");
+  if ((annealType != 1) && (annealType != 2)) MstUtils::error("unrecognized annealing schedule type '" + MstUtils::toString(annealType) + "'", "EnergyTable::mcParallel");
+  if (kTf < 0) kTf = kTi;
+  if (!compiled) compile();
+  if (Ne < 0) Ne = int(0.2*Ni + 1);
+  mutex recLock;
+
+  // chains start from random solutions, each with its own random stream
+  vector<mcChain> chains(Nc);
+  for (int c = 0; c < Nc; c++) {
+    chains[c].rng.seed(MstUtils::randEngine()());
+    chains[c].seq.resize(numSites());
+    for (int i = 0; i < numSites(); i++) chains[c].seq[i] = uniform_int_distribution<int>(0, selfE[i].size() - 1)(chains[c].rng);
+  }
+  auto startRecording = [&](mcChain& ch) {
+    ch.ener = scoreSolution(ch.seq);
+    if (additionalScore != NULL) ch.ener += (*additionalScore)(extra, ch.seq, *this, -1, -1);
+    ch.bestEner = ch.ener; ch.bestSeq = ch.seq;
+  };
+
+  if (exchange == 0) {
+    // independent annealing cycles: equilibrate at kTi, then anneal down to kTf
+    MstUtils::parallelFor(Nc, numThreads, [&](int c, int w) {
+      mcChain& ch = chains[c];
+      startRecording(ch);
+      mcSteps(ch, Ne, kTi, kTi, annealType, false, recLock, rec, add, extra, additionalScore);
+      startRecording(ch);
+      mcSteps(ch, Ni, kTi, kTf, annealType, true, recLock, rec, add, extra, additionalScore);
+    });
+  } else {
+    // replica exchange over a geometric temperature ladder
+    vector<mstreal> kTs(Nc, kTi);
+    for (int c = 1; c < Nc; c++) kTs[c] = kTi*pow(kTf/kTi, c*1.0/(Nc - 1));
+    MstUtils::parallelFor(Nc, numThreads, [&](int c, int w) {
+      startRecording(chains[c]);
+      mcSteps(chains[c], Ne, kTs[c], kTs[c], annealType, false, recLock, rec, add, extra, additionalScore);
+      startRecording(chains[c]);
+    });
+    mt19937 swapRng(MstUtils::randEngine()());
+    uniform_real_distribution<mstreal> unitDist(0, 1.0);
+    for (int done = 0, round = 0; done < Ni; done += exchange, round++) {
+      int n = MstUtils::min(exchange, Ni - done);
+      MstUtils::parallelFor(Nc, numThreads, [&](int c, int w) {
+        mcSteps(chains[c], n, kTs[c], kTs[c], annealType, true, recLock, rec, add, extra, additionalScore);
+      });
+      // alternate between swapping even and odd neighbor pairs
+      for (int c = round % 2; c + 1 < Nc; c += 2) {
+        mcChain& a = chains[c]; mcChain& b = chains[c + 1];
+        mstreal x = (1/kTs[c] - 1/kTs[c + 1])*(a.ener - b.ener);
+        if ((x >= 0) || (unitDist(swapRng) < exp(x))) {
+          swap(a.seq, b.seq);
+          swap(a.ener, b.ener);
+        }
+      }
+    }
+  }
+
+  int best = 0;
+  for (int c = 1; c < Nc; c++) {
+    if (chains[c].bestEner < chains[best].bestEner) best = c;
+  }
+  return chains[best].bestSeq;
+}
+
+void EnergyTable::deadEndElimination(vector<vector<int>>& alive, mstreal margin) {
+  int L = numSites();
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    for (int i = 0; i < L; i++) {
+      vector<int>& ai = alive[i];
+      // r is a dead end if replacing it with some t always gains more than the margin
+      for (int ri = 0; ri < ai.size(); ri++) {
+        int r = ai[ri];
+        bool dead = false;
+        for (int ti = 0; (ti < ai.size()) && !dead; ti++) {
+          int t = ai[ti];
+          if (t == r) continue;
+          mstreal x = selfE[i][r] - selfE[i][t];
+          for (int k = nbrStart[i]; k < nbrStart[i + 1]; k++) {
+            int nj = nbrAlphaSize[k];
+            const mstreal* blockR = nbrE.data() + nbrOffset[k] + r*nj;
+            const mstreal* blockT = nbrE.data() + nbrOffset[k] + t*nj;
+            mstreal m = INFINITY;
+            for (int u : alive[nbrSite[k]]) m = MstUtils::min(m, blockR[u] - blockT[u]);
+            x += m;
+          }
+          dead = (x > margin);
+        }
+        if (dead) {
+          ai.erase(ai.begin() + ri);
+          ri--;
+          changed = true;
+        }
+      }
+    }
+  }
+}
+
+EnergyTable::searchBound::searchBound(EnergyTable& _E, const vector<vector<int>>& _alive) : E(_E), alive(_alive) {
+  int L = E.numSites();
+  // assign the most constrained sites first
+  order.resize(L); pos.resize(L); assign.assign(L, -1);
+  for (int i = 0; i < L; i++) order[i] = i;
+  stable_sort(order.begin(), order.end(), [this](int i, int j) { return alive[i].size() < alive[j].size(); });
+  for (int d = 0; d < L; d++) pos[order[d]] = d;
+
+  // for each neighbor k of site j that comes after it, the best interaction of
+  // every amino acid at j with anything alive at k (the lower bound counts each
+  // interaction between unassigned sites once, from the earlier site)
+  minAhead.resize(E.nbrSite.size());
+  for (int j = 0; j < L; j++) {
+    for (int k = E.nbrStart[j]; k < E.nbrStart[j + 1]; k++) {
+      if (pos[E.nbrSite[k]] < pos[j]) continue;
+      int nj = E.nbrAlphaSize[k];
+      minAhead[k].assign(E.selfE[j].size(), INFINITY);
+      for (int s : alive[j]) {
+        const mstreal* block = E.nbrE.data() + E.nbrOffset[k] + s*nj;
+        for (int u : alive[E.nbrSite[k]]) minAhead[k][s] = MstUtils::min(minAhead[k][s], block[u]);
+      }
+    }
+  }
+}
+
+mstreal EnergyTable::searchBound::assignedEner(int j, int s) const {
+  mstreal e = 0;
+  for (int k = E.nbrStart[j]; k < E.nbrStart[j + 1]; k++) {
+    int a = assign[E.nbrSite[k]];
+    if (a >= 0) e += E.nbrE[E.nbrOffset[k] + s*E.nbrAlphaSize[k] + a];
+  }
+  return e;
+}
+
+mstreal EnergyTable::searchBound::lowerBound(int d) const {
+  mstreal h = 0;
+  for (; d < order.size(); d++) {
+    int j = order[d];
+    if (assign[j] >= 0) continue;
+    mstreal best = INFINITY;
+    for (int s : alive[j]) {
+      mstreal e = E.selfE[j][s] + assignedEner(j, s);
+      for (int k = E.nbrStart[j]; k < E.nbrStart[j + 1]; k++) {
+        if (!minAhead[k].empty() && (assign[E.nbrSite[k]] < 0)) e += minAhead[k][s];
+      }
+      best = MstUtils::min(best, e);
+    }
+    h += best;
+  }
+  return h;
+}
+
+void EnergyTable::boundElimination(vector<vector<int>>& alive, mstreal maxEner, mstreal margin) {
+  int L = numSites();
+  mstreal tol = 10E-9 * MstUtils::max(1.0, fabs(maxEner));
+  bool changed = true;
+  while (changed) {
+    changed = false;
+    searchBound B(*this, alive);
+    for (int i = 0; i < L; i++) {
+      vector<int>& ai = alive[i];
+      for (int ri = 0; (ri < ai.size()) && (ai.size() > 1); ri++) {
+        B.assign[i] = ai[ri];
+        mstreal lb = selfE[i][ai[ri]] + B.lowerBound();
+        B.assign[i] = -1;
+        if (lb > maxEner + tol) {
+          // bounds computed before the removal remain valid (if looser)
+          ai.erase(ai.begin() + ri);
+          ri--;
+          changed = true;
+        }
+      }
+    }
+    if (changed) deadEndElimination(alive, margin);
+  }
+}
+
+vector<int> EnergyTable::localOptimum(const vector<vector<int>>& alive, vector<int> sol) {
+  bool improved = true;
+  while (improved) {
+    improved = false;
+    for (int i = 0; i < sol.size(); i++) {
+      int bestAA = sol[i];
+      mstreal bestDE = 0;
+      for (int a : alive[i]) {
+        if (a == sol[i]) continue;
+        mstreal dE = scoreMutation(sol, i, a);
+        if (dE < bestDE - 10E-9) { bestDE = dE; bestAA = a; }
+      }
+      if (bestAA != sol[i]) { sol[i] = bestAA; improved = true; }
+    }
+  }
+  return sol;
+}
+
+bool EnergyTable::aStar(const vector<vector<int>>& alive, int K, mstreal maxEner, chrono::steady_clock::time_point deadline, bool timed, long maxNodes, vector<vector<int>>& sols, vector<mstreal>& eners) {
+  int L = numSites();
+  sols.clear(); eners.clear();
+  searchBound B(*this, alive);
+  const vector<int>& order = B.order;
+  vector<int>& assign = B.assign;
+
+  struct node { int parent, depth, aa; mstreal g; };
+  vector<node> nodes;
+  typedef pair<mstreal, pair<int, int>> entry; // (f, (-depth, node index)): best bound first, deeper first on ties
+  priority_queue<entry, vector<entry>, greater<entry>> open;
+  nodes.push_back({-1, 0, -1, 0.0});
+  open.push(entry(B.lowerBound(0), make_pair(0, 0)));
+  mstreal tol = 10E-9 * MstUtils::max(1.0, fabs(maxEner));
+  auto restore = [&](int ni) {
+    for (int i = 0; i < L; i++) assign[i] = -1;
+    for (; nodes[ni].depth > 0; ni = nodes[ni].parent) assign[order[nodes[ni].depth - 1]] = nodes[ni].aa;
+  };
+
+  long numExpanded = 0;
+  while (!open.empty()) {
+    entry top = open.top();
+    if (top.first > maxEner + tol) return true;
+    bool outOfBudget = ((maxNodes > 0) && (nodes.size() > maxNodes)) || (timed && (numExpanded % 256 == 0) && (chrono::steady_clock::now() > deadline));
+    if (outOfBudget) {
+      if (sols.empty()) {
+        // complete the most promising partial solution greedily
+        int ni = top.second.second;
+        restore(ni);
+        for (int d = nodes[ni].depth; d < L; d++) {
+          int j = order[d], bestAA = alive[j][0];
+          mstreal bestE = INFINITY;
+          for (int s : alive[j]) {
+            mstreal e = selfE[j][s] + B.assignedEner(j, s);
+            if (e < bestE) { bestE = e; bestAA = s; }
+          }
+          assign[j] = bestAA;
+        }
+        sols.push_back(localOptimum(alive, assign));
+        eners.push_back(scoreSolution(sols.back()));
+      }
+      return false;
+    }
+    open.pop();
+    numExpanded++;
+    int ni = top.second.second;
+    node cur = nodes[ni];
+    restore(ni);
+    if (cur.depth == L) {
+      sols.push_back(assign);
+      eners.push_back(cur.g);
+      if (sols.size() == K) return true;
+      continue;
+    }
+    int site = order[cur.depth];
+    for (int a : alive[site]) {
+      mstreal g = cur.g + selfE[site][a] + B.assignedEner(site, a);
+      assign[site] = a;
+      mstreal f = g + B.lowerBound(cur.depth + 1);
+      assign[site] = -1;
+      if (f > maxEner + tol) continue;
+      nodes.push_back({ni, cur.depth + 1, a, g});
+      open.push(entry(f, make_pair(-(cur.depth + 1), (int) nodes.size() - 1)));
+    }
+  }
+  return true;
+}
+
+vector<vector<int>> EnergyTable::optimalSolutions(int K, mstreal maxTime, long maxNodes, bool* optimal) {
+  if (K < 1) MstUtils::error("need to ask for at least one solution", "EnergyTable::optimalSolutions");
+  if (!compiled) compile();
+  int L = numSites();
+  vector<vector<int>> sols;
+  vector<mstreal> eners;
+  if (optimal != NULL) *optimal = true;
+  if (L == 0) return sols;
+  bool timed = (maxTime > 0);
+  chrono::steady_clock::time_point deadline = chrono::steady_clock::now() + chrono::microseconds((long) (MstUtils::max(maxTime, 0.0)*1E6));
+  vector<vector<int>> all(L);
+  for (int i = 0; i < L; i++) {
+    for (int a = 0; a < selfE[i].size(); a++) all[i].push_back(a);
+  }
+
+  // the best solution, with pruning of anything that can not be in it; a local
+  // optimum (starting from the best self energies) bounds it from above
+  vector<vector<int>> alive = all;
+  deadEndElimination(alive, 0);
+  vector<int> start(L);
+  for (int i = 0; i < L; i++) {
+    start[i] = alive[i][0];
+    for (int a : alive[i]) if (selfE[i][a] < selfE[i][start[i]]) start[i] = a;
+  }
+  vector<int> upper = localOptimum(alive, start);
+  mstreal upperEner = scoreSolution(upper);
+  boundElimination(alive, upperEner, 0);
+  bool done = aStar(alive, 1, upperEner, deadline, timed, maxNodes, sols, eners);
+  if (sols.empty() || (eners[0] > upperEner)) {
+    // either the budget ran out, or nothing beats the local optimum
+    sols.assign(1, upper);
+    eners.assign(1, upperEner);
+  }
+
+  // more solutions, widening the margin of pruning until K are found in it
+  mstreal margin = 1.0;
+  while (done && (K > 1)) {
+    alive = all;
+    deadEndElimination(alive, margin);
+    bool pruned = false;
+    for (int i = 0; i < L; i++) pruned = pruned || (alive[i].size() < all[i].size());
+    if (pruned) boundElimination(alive, eners[0] + margin, margin);
+    vector<vector<int>> moreSols; vector<mstreal> moreEners;
+    // without any pruning, simply enumerate
+    done = aStar(alive, K, pruned ? eners[0] + margin : INFINITY, deadline, timed, maxNodes, moreSols, moreEners);
+    if ((moreSols.size() > sols.size()) || (done && (moreSols.size() == sols.size()))) { sols = moreSols; eners = moreEners; }
+    if ((sols.size() == K) || !pruned) break;
+    margin *= 4;
+  }
+  if (optimal != NULL) *optimal = done;
+  return sols;
+}
+
 Sequence EnergyTable::solutionToSequence(const vector<int>& sol) {
   Sequence seq(sol.size());
   for (int i = 0; i < sol.size(); i++) {
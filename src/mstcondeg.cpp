@@ -2,38 +2,147 @@
 
 /* contactList */
 
-void contactList::sortByDegree() {
-  vector<int> sortedIndices = MstUtils::sortIndices(degrees, true);
-  vector<Residue*> resiOld = resi, resjOld = resj;
-  vector<mstreal> degreesOld = degrees;
-  vector<string> infosOld = infos;
-  for (int i = 0; i < sortedIndices.size(); i++) {
-    resi[i] = resiOld[sortedIndices[i]];
-    resj[i] = resjOld[sortedIndices[i]];
-    degrees[i] = degreesOld[sortedIndices[i]];
-    infos[i] = infosOld[sortedIndices[i]];
+namespace {
+  // v[i] = v[order[i]] for all i, following one permutation cycle at a time
+  template <class T>
+  void permuteInPlace(vector<T>& v, const vector<int>& order) {
+    if (v.empty()) return;
+    vector<bool> done(order.size(), false);
+    for (int i = 0; i < order.size(); i++) {
+      if (done[i]) continue;
+      T first = v[i];
+      int k = i;
+      for (; order[k] != i; k = order[k]) { v[k] = v[order[k]]; done[k] = true; }
+      v[k] = first; done[k] = true;
+    }
   }
 }
 
+void contactList::addContact(Residue* _resi, Residue* _resj, mstreal _degree, string _info, bool directional, set<string> _resi_aa, set<string> _resj_aa) {
+  int a = residueKey(_resi), b = residueKey(_resj), c = degrees.size();
+  ci.push_back(a);
+  cj.push_back(b);
+  degrees.push_back(_degree);
+  directed.push_back(directional);
+  if (!_info.empty() || !infos.empty()) { infos.resize(c); infos.push_back(_info); }
+  if (!_resi_aa.empty() || !_resj_aa.empty() || !resi_aa.empty()) {
+    resi_aa.resize(c); resi_aa.push_back(_resi_aa);
+    resj_aa.resize(c); resj_aa.push_back(_resj_aa);
+  }
+  link(a, b, c);
+  if (!directional && (a != b)) link(b, a, c);
+}
+
+void contactList::reserve(int n) {
+  ci.reserve(n); cj.reserve(n); degrees.reserve(n); directed.reserve(n);
+  adj.reserve(2*n); pairHead.reserve(2*n);
+}
+
+int contactList::residueKey(Residue* res) {
+  auto it = resIdx.find(res);
+  if (it != resIdx.end()) return it->second;
+  resIdx[res] = residues.size();
+  residues.push_back(res);
+  return residues.size() - 1;
+}
+
+void contactList::link(int a, int b, int c) {
+  auto it = pairHead.insert(pair<uint64_t, int>(pairKey(a, b), -1)).first;
+  adj.push_back(adjEntry{c, it->second});
+  it->second = adj.size() - 1;
+}
+
+vector<Residue*> contactList::srcResidues() {
+  vector<Residue*> res(ci.size());
+  for (int i = 0; i < ci.size(); i++) res[i] = residues[ci[i]];
+  return res;
+}
+
+vector<Residue*> contactList::destResidues() {
+  vector<Residue*> res(cj.size());
+  for (int i = 0; i < cj.size(); i++) res[i] = residues[cj[i]];
+  return res;
+}
+
+void contactList::sortByDegree() {
+  vector<int> order = MstUtils::sortIndices(degrees, true);
+  permuteInPlace(ci, order); permuteInPlace(cj, order); permuteInPlace(degrees, order); permuteInPlace(directed, order);
+  permuteInPlace(infos, order); permuteInPlace(resi_aa, order); permuteInPlace(resj_aa, order);
+  vector<int> newIndex(order.size());
+  for (int i = 0; i < order.size(); i++) newIndex[order[i]] = i;
+  for (adjEntry& e : adj) e.contact = newIndex[e.contact];
+}
+
 vector<pair<Residue*, Residue*> > contactList::getOrderedContacts() {
-  vector<pair<Residue*, Residue*> > conts(orderedContacts.size());
-  int i = 0;
-  for (set<pair<Residue*, Residue*>, contComp>::iterator it = orderedContacts.begin(); it != orderedContacts.end(); ++it, i++) {
-    conts[i] = *it;
+  // pairs of residues in contact (lower index first, unless the contact is
+  // directional), ordered and made unique by residue indices
+  int n = size();
+  vector<pair<Residue*, Residue*> > conts(n);
+  vector<pair<int, int> > keys(n);
+  for (int i = 0; i < n; i++) {
+    Residue* A = residues[ci[i]]; Residue* B = residues[cj[i]];
+    if (!directed[i] && (A->getResidueIndex() > B->getResidueIndex())) swap(A, B);
+    conts[i] = pair<Residue*, Residue*>(A, B);
+    keys[i] = pair<int, int>(A->getResidueIndex(), B->getResidueIndex());
   }
-  return conts;
+  vector<int> order(n);
+  for (int i = 0; i < n; i++) order[i] = i;
+  stable_sort(order.begin(), order.end(), [&keys](int i, int j) { return keys[i] < keys[j]; });
+  vector<pair<Residue*, Residue*> > ret;
+  for (int k = 0; k < n; k++) {
+    if ((k > 0) && (keys[order[k]] == keys[order[k - 1]])) continue;
+    ret.push_back(conts[order[k]]);
+  }
+  return ret;
 }
 
 mstreal contactList::degree(Residue* _resi, Residue* _resj) {
-  if (inContact.find(_resi) == inContact.end()) return 0;
-  if (inContact[_resi].find(_resj) == inContact[_resi].end()) return 0;
-  return degrees[*inContact[_resi][_resj].begin()];
+  set<int> conts = getContacts(_resi, _resj);
+  return conts.empty() ? 0 : degrees[*conts.begin()];
 }
 
 bool contactList::areInContact(Residue* _resi, Residue* _resj) {
-  if (inContact.find(_resi) == inContact.end()) return false;
-  if (inContact[_resi].find(_resj) == inContact[_resi].end()) return false;
-  return true;
+  auto a = resIdx.find(_resi), b = resIdx.find(_resj);
+  if ((a == resIdx.end()) || (b == resIdx.end())) return false;
+  return pairHead.find(pairKey(a->second, b->second)) != pairHead.end();
+}
+
+set<int> contactList::getContacts(Residue* _resi, Residue* _resj) {
+  set<int> conts;
+  auto a = resIdx.find(_resi), b = resIdx.find(_resj);
+  if ((a == resIdx.end()) || (b == resIdx.end())) return conts;
+  auto it = pairHead.find(pairKey(a->second, b->second));
+  if (it == pairHead.end()) return conts;
+  for (int e = it->second; e >= 0; e = adj[e].next) conts.insert(adj[e].contact);
+  return conts;
+}
+
+void contactList::pairTable(int numRes, vector<int>& rowLen, vector<int>& partners, vector<mstreal>& vals, bool forward, bool reverse) {
+  // entries (row, partner, contact), sorted by row and partner with later
+  // contacts first, so that the first entry of each pair is the one to keep
+  vector<int> row, col, cont;
+  for (int i = 0; i < size(); i++) {
+    int rA = residues[ci[i]]->getResidueIndex(), rB = residues[cj[i]]->getResidueIndex();
+    if ((rA < 0) || (rA >= numRes) || (rB < 0) || (rB >= numRes)) MstUtils::error("contact between residues " + MstUtils::toString(rA) + " and " + MstUtils::toString(rB) + " out of range for " + MstUtils::toString(numRes) + " residues", "contactList::pairTable");
+    if (forward) { row.push_back(rA); col.push_back(rB); cont.push_back(i); }
+    if (reverse) { row.push_back(rB); col.push_back(rA); cont.push_back(i); }
+  }
+  vector<int> order(row.size());
+  for (int k = 0; k < order.size(); k++) order[k] = k;
+  sort(order.begin(), order.end(), [&](int a, int b) {
+    if (row[a] != row[b]) return row[a] < row[b];
+    if (col[a] != col[b]) return col[a] < col[b];
+    return cont[a] > cont[b];
+  });
+  rowLen.assign(numRes, -1);
+  partners.clear(); vals.clear();
+  for (int k = 0; k < order.size(); k++) {
+    int e = order[k];
+    if ((k > 0) && (row[e] == row[order[k - 1]]) && (col[e] == col[order[k - 1]])) continue;
+    rowLen[row[e]] = MstUtils::max(rowLen[row[e]], 0) + 1;
+    partners.push_back(col[e]);
+    vals.push_back(degrees[cont[e]]);
+  }
 }
 
 /* ConFind */
@@ -67,6 +176,9 @@ void ConFind::setParams() {
   loCollProbCut = 0.5;
   hiCollProbCut = 2.0;
   freedomType = 2;
+  numThreads = 1;
+  int ai = 0;
+  for (string aa : aaNames) aaIndex[aa] = ai++;
 }
 
 ConFind::~ConFind() {
@@ -77,11 +189,6 @@ ConFind::~ConFind() {
     vector<rotamerID*>& rots = it->second;
     for (int i = 0; i < rots.size(); i++) delete(rots[i]);
   }
-  for (auto res_it = rotamerHeavySC.begin(); res_it != rotamerHeavySC.end(); ++res_it) {
-    for (auto aa_it = rotamerHeavySC[res_it->first].begin(); aa_it != rotamerHeavySC[res_it->first].end(); ++aa_it) {
-      if (aa_it->second != NULL) delete(aa_it->second);
-    }
-  }
 }
 
 void ConFind::init(const Structure& S) {
@@ -93,17 +200,23 @@ void ConFind::init(const Structure& S) {
     if (idx >= 0) backbone.push_back(a);
     if (idx == RotamerLibrary::bbCA) ca.push_back(a);
   }
-  bbNN = new ProximitySearch(backbone, clashDist/2);
-  caNN = new ProximitySearch(ca, dcut/2);
+  bbNN = new CellList(backbone, clashDist);
+  caNN = new CellList(ca, dcut/2);
 }
 
 void ConFind::cache(Residue* res) {
+  if (cachedIndex.find(res) != cachedIndex.end()) return;
+  residueCache rc;
+  computeCache(res, rc);
+  storeCache(res, rc);
+}
+
+void ConFind::computeCache(Residue* res, residueCache& rc) {
   string res_name = res->getName();
-  if (rotamerHeavySC.find(res) != rotamerHeavySC.end()) return;
-  AtomPointerVector pointCloud;      // side-chain atoms of surviving rotames
-  vector<rotamerID*> pointCloudTags; // corresponding tags (i.e.,  rotamer identity)
-  survivingRotamers[res].resize(0);
+  vector<mstcoor> coor; // side-chain atoms of surviving rotamers (in storage precision, which binning below then agrees with)
+  vector<int> atomRot;  // corresponding (local) rotamer indices
   bool writeLog = rotOut.is_open();
+  stringstream log;
 
   // make sure this residue has a proper backbone, otherwise adding rotamers will fail
   vector<Atom*> bb = RotamerLibrary::getBackbone(res);
@@ -111,30 +224,38 @@ void ConFind::cache(Residue* res) {
     MstUtils::error("cannot build rotamers at position " + MstUtils::toString(*res) + " as it lacks proper backbone!", "ConFind::cache(Residue*)");
   }
   mstreal phi = res->getPhi(false); mstreal psi = res->getPsi(false);
+  Transform T = RotamerLibrary::backboneFrame(*res);
 
-  // load rotamers of each amino acid
+  // load rotamers of each amino acid, placing all rotamers in the backbone bin at once
   int numRemRotsInPosition = 0; int totNumRotsInPosition = 0;
+  vector<mstreal> rotCoor;
   for (string aa : aaNames) {
     if (aaProp.find(aa) == aaProp.end()) MstUtils::error("no propensity defined for amino acid " + aa);
-    rotamerHeavySC[res][aa] = NULL;
-    double aaP = aaProp[aa];
+    int aai = aaIndex.find(aa)->second;
+    double aaP = aaProp.find(aa)->second;
     if (strict && res_name != aa && res_name != "UNK") continue;
-    int nr = rotLib->numberOfRotamers(aa, phi, psi);
-    Residue rot;
+    int li = rotLib->aminoAcidIndex(aa);
+    int bi = rotLib->getBackboneBin(li, phi, psi);
+    int nr = rotLib->numberOfRotamers(li, bi), na = rotLib->numberOfRotamerAtoms(li);
+    const vector<string>& atomNames = rotLib->rotamerAtomNames(li);
+    vector<bool> sideChain(na);
+    for (int k = 0; k < na; k++) sideChain[k] = countsAsSidechain(atomNames[k], aa);
+    rotCoor.resize(3*nr*na);
+    rotLib->placeRotamers(T, li, bi, rotCoor.data());
+    Residue rot; // built only for the rotamer log
     for (int ri = 0; ri < nr; ri++) {
-      rotamerID rID = rotLib->placeRotamer(*res, aa, ri, &rot);
-      double rotP = rotLib->rotamerProbability(aa, ri, phi, psi);
+      const mstreal* x = rotCoor.data() + 3*na*ri;
+      double rotP = rotLib->rotamerProbability(li, bi, ri);
 
       // see if the rotamer needs to be pruned (clash with the backbone).
       bool prune = false;
       vector<int> closeOnes;
-      for (int k = 0; k < rot.atomSize(); k++) {
-        Atom& a = rot[k];
-        if (!countsAsSidechain(a)) continue;
+      for (int k = 0; k < na; k++) {
+        if (!sideChain[k]) continue;
 
         // should the rotamer be pruned based on this atom's clash(es)?
         closeOnes.clear();
-        bbNN->pointsWithin(a.getCoor(), 0.0, clashDist, &closeOnes);
+        bbNN->pointsWithin(Point3(x[3*k], x[3*k + 1], x[3*k + 2]), 0.0, clashDist, closeOnes);
         for (int ci = 0; ci < closeOnes.size(); ci++) {
           // backbone atoms of the same residue do not count as clashing (the
           // rotamer library should not allow true clashes with own backbone)
@@ -142,7 +263,7 @@ void ConFind::cache(Residue* res) {
             prune = true;
             // clashes with ALA have a special meaning (permanent "unavoidable" contacts;
             // need to find all of them, though unlikely to have more than one)
-            if (rot.isNamed("ALA")) permanentContacts[res].insert(closeOnes[ci]);
+            if (aa == "ALA") rc.permanentContacts.insert(closeOnes[ci]);
             else break;
           }
         }
@@ -154,8 +275,9 @@ void ConFind::cache(Residue* res) {
           if (interfering.find(resB) != interfering.end()) continue;
           if (resB != res) {
             interfering.insert(resB);
-            if (interference[res][resB].count(aa) == 0) interference[res][resB][aa] = 0.0;
-            interference[res][resB][aa] += aaP * rotP/100.0;
+            vector<mstreal>& in = rc.interference[resB];
+            if (in.empty()) in.resize(aaNames.size(), 0.0);
+            in[aai] += aaP * rotP/100.0;
           }
         }
 
@@ -163,40 +285,138 @@ void ConFind::cache(Residue* res) {
       }
       if (prune) continue;
       if (writeLog) {
-        rotOut << "REM " << *res << " (" << rot.getName() << "), rotamer " << ri+1 << endl;
-        Structure S(rot); S.writePDB(rotOut, "RENUMBER");
+        rotLib->placeRotamer(*res, aa, ri, &rot);
+        log << "REM " << *res << " (" << rot.getName() << "), rotamer " << ri+1 << endl;
+        Structure S(rot); S.writePDB(log, "RENUMBER");
       }
 
       // if not pruned, collect atoms needed later
-      rotamerID* rotTag = new rotamerID(rID);
-      survivingRotamers[res].push_back(rotTag);
-      for (int ai = 0; ai < rot.atomSize(); ai++) {
-        if (!countsAsSidechain(rot[ai])) continue;
-        pointCloud.push_back(new Atom(rot[ai]));
-        pointCloudTags.push_back(rotTag);
+      rotamerID* rotTag = new rotamerID(aa, bi, ri);
+      rc.survivingRotamers.push_back(rotTag);
+      rc.rotAA.push_back(aai);
+      rc.rotProb.push_back(rotP);
+      for (int k = 0; k < na; k++) {
+        if (!sideChain[k]) continue;
+        for (int d = 0; d < 3; d++) coor.push_back(x[3*k + d]);
+        atomRot.push_back(rc.survivingRotamers.size() - 1);
       }
       numRemRotsInPosition++;
     }
-    
-    // cash all the rotamer heavy atoms from rotamers of this amino acid for faster distance-based searches
-    if (pointCloud.size() != 0) rotamerHeavySC[res][aa] = new DecoratedProximitySearch<rotamerID*>(pointCloud, contDist/2, pointCloudTags);
-    pointCloud.deletePointers();
-    pointCloudTags.clear();
-    
     totNumRotsInPosition += nr;
   }
-  fractionPruned[res] = (totNumRotsInPosition - numRemRotsInPosition)*1.0/totNumRotsInPosition;
-  numLibraryRotamers[res] = totNumRotsInPosition;
+  rc.fractionPruned = (totNumRotsInPosition - numRemRotsInPosition)*1.0/totNumRotsInPosition;
+  rc.numLibraryRotamers = totNumRotsInPosition;
+  rc.log = log.str();
+
+  // bin all side-chain atoms of surviving rotamers into a grid with cells of
+  // the contact distance, so that contacts are only looked for in adjacent cells
+  int n = atomRot.size();
+  for (int k = 0; k < 3; k++) { rc.lo[k] = 0; rc.hi[k] = -1; rc.dims[k] = 0; } // empty box
+  for (int i = 0; i < n; i++) {
+    for (int k = 0; k < 3; k++) {
+      mstreal x = coor[3*i + k];
+      if ((i == 0) || (x < rc.lo[k])) rc.lo[k] = x;
+      if ((i == 0) || (x > rc.hi[k])) rc.hi[k] = x;
+    }
+  }
+  if (n > 0) {
+    for (int k = 0; k < 3; k++) rc.dims[k] = int((rc.hi[k] - rc.lo[k])/contDist) + 1;
+  }
+  vector<int> cell(n);
+  rc.cellStart.assign(rc.dims[0]*rc.dims[1]*rc.dims[2] + 1, 0);
+  for (int i = 0; i < n; i++) {
+    int c[3];
+    for (int k = 0; k < 3; k++) c[k] = MstUtils::min(int((coor[3*i + k] - rc.lo[k])/contDist), rc.dims[k] - 1);
+    cell[i] = c[0] + rc.dims[0]*(c[1] + rc.dims[1]*c[2]);
+    rc.cellStart[cell[i] + 1]++;
+  }
+  for (int c = 1; c < rc.cellStart.size(); c++) rc.cellStart[c] += rc.cellStart[c - 1];
+  vector<int> fill(rc.cellStart.begin(), rc.cellStart.end() - 1);
+  rc.coor.resize(3*n); rc.atomRot.resize(n);
+  for (int i = 0; i < n; i++) {
+    int j = fill[cell[i]]++;
+    for (int k = 0; k < 3; k++) rc.coor[3*j + k] = coor[3*i + k];
+    rc.atomRot[j] = atomRot[i];
+  }
+}
+
+void ConFind::storeCache(Residue* res, residueCache& rc) {
+  cachedResidue cr;
+  cr.firstAtom = scRot.size(); cr.numAtoms = rc.atomRot.size();
+  cr.firstRot = rotAA.size(); cr.numRots = rc.survivingRotamers.size();
+  cr.firstCell = cellStart.size();
+  for (int k = 0; k < 3; k++) { cr.lo[k] = rc.lo[k]; cr.hi[k] = rc.hi[k]; cr.dims[k] = rc.dims[k]; }
+  scCoor.insert(scCoor.end(), rc.coor.begin(), rc.coor.end());
+  for (int i = 0; i < rc.atomRot.size(); i++) scRot.push_back(cr.firstRot + rc.atomRot[i]);
+  cellStart.insert(cellStart.end(), rc.cellStart.begin(), rc.cellStart.end());
+  rotAA.insert(rotAA.end(), rc.rotAA.begin(), rc.rotAA.end());
+  rotProb.insert(rotProb.end(), rc.rotProb.begin(), rc.rotProb.end());
+  for (int i = 0; i < rc.rotAA.size(); i++) rotAAProp.push_back(aaProp[aaList(rc.rotAA[i])]);
+  cachedIndex[res] = cached.size();
+  cached.push_back(cr);
+
+  survivingRotamers[res] = rc.survivingRotamers;
+  if (!rc.permanentContacts.empty()) permanentContacts[res].insert(rc.permanentContacts.begin(), rc.permanentContacts.end());
+  for (auto it = rc.interference.begin(); it != rc.interference.end(); ++it) {
+    vector<mstreal>& in = interference[res][it->first];
+    if (in.empty()) in.resize(aaNames.size(), 0.0);
+    for (int ai = 0; ai < it->second.size(); ai++) in[ai] += it->second[ai];
+  }
+  fractionPruned[res] = rc.fractionPruned;
+  numLibraryRotamers[res] = rc.numLibraryRotamers;
+  if (rotOut.is_open()) rotOut << rc.log;
 }
 
 bool ConFind::countsAsSidechain(Atom& a) {
-  if (RotamerLibrary::isHydrogen(a) || RotamerLibrary::isBackboneAtom(a)) return false;
-  if (doNotCountCB && a.isNamed("CB") && !(a.getResidue()->isNamed("ALA"))) return false;
+  return countsAsSidechain(a.getName(), a.getResidue()->getName());
+}
+
+bool ConFind::countsAsSidechain(const string& atomName, const string& resName) {
+  if (RotamerLibrary::isHydrogen(atomName) || RotamerLibrary::isBackboneAtom(atomName)) return false;
+  if (doNotCountCB && (atomName == "CB") && (resName != "ALA")) return false;
   return true;
 }
 
+unsigned int ConFind::aaMask(const set<string>& aas) {
+  unsigned int mask = 0;
+  for (string aa : aas) {
+    auto it = aaIndex.find(aa);
+    if (it == aaIndex.end()) MstUtils::error("amino acid with the name: "+aa+" not in list of allowable amino acids");
+    mask |= (1u << it->second);
+  }
+  return mask;
+}
+
+string ConFind::aaList(int ai) {
+  auto it = aaNames.begin();
+  advance(it, ai);
+  return *it;
+}
+
 void ConFind::cache(const vector<Residue*>& residues) {
-  for (int i = 0; i < residues.size(); i++) cache(residues[i]);
+  MstProfiler::scope prof("ConFind::cache");
+  if (numThreads <= 1) {
+    for (int i = 0; i < residues.size(); i++) cache(residues[i]);
+    return;
+  }
+
+  // residues not cached yet (each once), computed in parallel, stored in order
+  vector<Residue*> todo;
+  set<Residue*> seen;
+  for (int i = 0; i < residues.size(); i++) {
+    if ((cachedIndex.find(residues[i]) == cachedIndex.end()) && (seen.find(residues[i]) == seen.end())) {
+      todo.push_back(residues[i]);
+      seen.insert(residues[i]);
+    }
+  }
+  vector<residueCache> caches(todo.size());
+  MstUtils::parallelFor(todo.size(), numThreads, [&](int i, int w) { computeCache(todo[i], caches[i]); });
+  for (int i = 0; i < todo.size(); i++) storeCache(todo[i], caches[i]);
+}
+
+void ConFind::setNumThreads(int n) {
+  if (n < 1) MstUtils::error("number of threads must be positive, got " + MstUtils::toString(n), "ConFind::setNumThreads");
+  numThreads = n;
 }
 
 void ConFind::cache(const Structure& S) {
@@ -219,53 +439,52 @@ mstreal ConFind::contactDegree(Residue* resA, Residue* resB, bool cacheA, bool c
   if (cacheB) cache(resB);
   if (checkNeighbors && !areNeighbors(resA, resB)) return 0;
   
-  // get point clouds for each amino acid from the A/B sets and find interacting rotamer pairs
-  fastmap<rotamerID*, fastmap<rotamerID*, bool> > clashing;
-  DecoratedProximitySearch<rotamerID*>* cloudA;
-  DecoratedProximitySearch<rotamerID*>* cloudB;
-  for (string resA_aa : aaAllowedA) {
-    if (aaNames.find(resA_aa) == aaNames.end()) MstUtils::error("amino acid with the name: "+resA_aa+" not in list of allowable amino acids");
-    if (rotamerHeavySC[resA].count(resA_aa) != 0) cloudA = rotamerHeavySC[resA][resA_aa];
-    else continue;
-    if (cloudA == NULL) continue;
-    
-    for (string resB_aa : aaAllowedB) {
-      if (aaNames.find(resB_aa) == aaNames.end()) MstUtils::error("amino acid with the name: "+resB_aa+" not in list of allowable amino acids");
-      if (rotamerHeavySC[resB].count(resB_aa) != 0) cloudB = rotamerHeavySC[resB][resB_aa];
-      else continue;
-      
-      if (cloudB == NULL) continue;
-
-      // check if the point clouds representing the two rotamer trees even overlap
-      if (!cloudA->overlaps(*cloudB,contDist)) continue;
-      
-      // if so, find rotamer pairs that clash
-      // NOTE: this is the slow part of contact finding; could perhaps speed up by
-      // storing smaller ProximitySearch object (not decorated) for each rotamer
-      vector<rotamerID*> p;
-      for (int ai = 0; ai < cloudA->pointSize(); ai++) {
-        cloudB->getPointsWithin(cloudA->getPoint(ai), 0, contDist, &p);
-        if (p.size() == 0) continue;
-        rotamerID* rID = cloudA->getPointTag(ai);
-        for (int i = 0; i < p.size(); i++) clashing[rID][p[i]] = true;
-      }
-    }
-  }
-  
-  // compute contact degree
+  // find interacting rotamer pairs: for every side-chain atom of an allowed
+  // rotamer at A, look for atoms of allowed rotamers at B in the adjacent cells
+  // of B's grid
   mstreal cd = 0.0;
-  for (fastmap<rotamerID*, fastmap<rotamerID*, bool> >::iterator itA = clashing.begin(); itA != clashing.end(); ++itA) {
-    rotamerID* rotA = itA->first;
-    mstreal rotProbA = rotLib->rotamerProbability(rotA);
-    mstreal aaPropA = aaProp[rotA->aminoAcid()];
-    for (fastmap<rotamerID*, bool>::iterator itB = itA->second.begin(); itB != itA->second.end(); ++itB) {
-      rotamerID* rotB = itB->first;
-      mstreal rotProbB = rotLib->rotamerProbability(rotB);
-      mstreal aaPropB = aaProp[rotB->aminoAcid()];
-      cd += aaPropA * aaPropB * rotProbA * rotProbB;
-      if (updateA) collProb[resA][rotA] += aaPropB * rotProbB;
-      if (updateB) collProb[resB][rotB] += aaPropA * rotProbA;
+  unsigned int maskA = aaMask(aaAllowedA), maskB = aaMask(aaAllowedB);
+  vector<long> clashing; // pairs of (local) rotamer indices, encoded as rA * (number of rotamers at B) + rB
+  auto itA = cachedIndex.find(resA), itB = cachedIndex.find(resB);
+  if ((itA != cachedIndex.end()) && (itB != cachedIndex.end())) {
+    const cachedResidue& A = cached[itA->second];
+    const cachedResidue& B = cached[itB->second];
+    bool overlap = (A.numAtoms > 0) && (B.numAtoms > 0);
+    for (int k = 0; overlap && (k < 3); k++) overlap = (A.lo[k] - contDist <= B.hi[k]) && (B.lo[k] - contDist <= A.hi[k]);
+    if (overlap) {
+      mstreal d2max = contDist*contDist;
+      const int* cellsB = cellStart.data() + B.firstCell;
+      const mstcoor* coorB = scCoor.data() + 3*B.firstAtom;
+      const int* rotsB = scRot.data() + B.firstAtom;
+      for (int ai = A.firstAtom; ai < A.firstAtom + A.numAtoms; ai++) {
+        int rA = scRot[ai];
+        if (!(maskA & (1u << rotAA[rA]))) continue;
+        const mstcoor* x = scCoor.data() + 3*ai;
+        int clo[3], chi[3]; bool inRange = true;
+        for (int k = 0; inRange && (k < 3); k++) {
+          clo[k] = MstUtils::max(int(floor((x[k] - contDist - B.lo[k])/contDist)), 0);
+          chi[k] = MstUtils::min(int(floor((x[k] + contDist - B.lo[k])/contDist)), B.dims[k] - 1);
+          inRange = (clo[k] <= chi[k]);
+        }
+        if (!inRange) continue;
+        for (int cz = clo[2]; cz <= chi[2]; cz++) {
+          for (int cy = clo[1]; cy <= chi[1]; cy++) {
+            int c = B.dims[0]*(cy + B.dims[1]*cz);
+            for (int bi = cellsB[c + clo[0]]; bi < cellsB[c + chi[0] + 1]; bi++) {
+              int rB = rotsB[bi];
+              if (!(maskB & (1u << rotAA[rB]))) continue;
+              const mstcoor* y = coorB + 3*bi;
+              mstreal dx = (mstreal) x[0] - y[0], dy = (mstreal) x[1] - y[1], dz = (mstreal) x[2] - y[2];
+              if (dx*dx + dy*dy + dz*dz <= d2max) clashing.push_back(((long) (rA - A.firstRot))*B.numRots + (rB - B.firstRot));
+            }
+          }
+        }
+      }
     }
+    sort(clashing.begin(), clashing.end());
+    clashing.erase(unique(clashing.begin(), clashing.end()), clashing.end());
+
+    cd = clashingPairsWeight(resA, resB, clashing, updateA, updateB);
   }
   
   // in case there are no available rotamer pairs, avoid division and just set to 0.0
@@ -280,6 +499,133 @@ mstreal ConFind::contactDegree(Residue* resA, Residue* resB, bool cacheA, bool c
   return cd;
 }
 
+mstreal ConFind::clashingPairsWeight(Residue* resA, Residue* resB, const vector<long>& clashing, bool updateA, bool updateB) {
+  mstreal cd = 0.0;
+  if (clashing.empty()) return cd;
+  const cachedResidue& A = cached[cachedIndex[resA]];
+  const cachedResidue& B = cached[cachedIndex[resB]];
+  vector<rotamerID*>& rotsAtA = survivingRotamers[resA];
+  vector<rotamerID*>& rotsAtB = survivingRotamers[resB];
+  fastmap<rotamerID*, mstreal>* collProbA = updateA ? &(collProb[resA]) : NULL;
+  fastmap<rotamerID*, mstreal>* collProbB = updateB ? &(collProb[resB]) : NULL;
+  for (int i = 0; i < clashing.size(); i++) {
+    int rA = clashing[i] / B.numRots, rB = clashing[i] % B.numRots;
+    mstreal rotProbA = rotProb[A.firstRot + rA], aaPropA = rotAAProp[A.firstRot + rA];
+    mstreal rotProbB = rotProb[B.firstRot + rB], aaPropB = rotAAProp[B.firstRot + rB];
+    cd += aaPropA * aaPropB * rotProbA * rotProbB;
+    if (collProbA != NULL) (*collProbA)[rotsAtA[rA]] += aaPropB * rotProbB;
+    if (collProbB != NULL) (*collProbB)[rotsAtB[rB]] += aaPropA * rotProbA;
+  }
+  return cd;
+}
+
+void ConFind::buildSweepGrid(const vector<int>& residues, sweepGrid& G) {
+  int n = 0;
+  for (int i = 0; i < residues.size(); i++) {
+    const cachedResidue& cr = cached[residues[i]];
+    if (cr.numAtoms == 0) continue;
+    for (int k = 0; k < 3; k++) {
+      if ((n == 0) || (cr.lo[k] < G.lo[k])) G.lo[k] = cr.lo[k];
+    }
+    n += cr.numAtoms;
+  }
+  mstreal hi[3];
+  for (int k = 0; k < 3; k++) { G.dims[k] = 0; hi[k] = 0; }
+  for (int i = 0, m = 0; i < residues.size(); i++) {
+    const cachedResidue& cr = cached[residues[i]];
+    if (cr.numAtoms == 0) continue;
+    for (int k = 0; k < 3; k++) {
+      if ((m == 0) || (cr.hi[k] > hi[k])) hi[k] = cr.hi[k];
+    }
+    m++;
+  }
+  if (n > 0) {
+    for (int k = 0; k < 3; k++) G.dims[k] = int((hi[k] - G.lo[k])/contDist) + 1;
+  }
+
+  // counting sort of atoms by cell; since residues are visited in order, atoms
+  // of the same residue end up contiguous within each cell
+  int nc = G.dims[0]*G.dims[1]*G.dims[2];
+  vector<int> cellStart(nc + 1, 0), cell(n), atom(n), res(n);
+  for (int i = 0, m = 0; i < residues.size(); i++) {
+    const cachedResidue& cr = cached[residues[i]];
+    for (int ai = cr.firstAtom; ai < cr.firstAtom + cr.numAtoms; ai++, m++) {
+      int c[3];
+      for (int k = 0; k < 3; k++) c[k] = MstUtils::min(int((scCoor[3*ai + k] - G.lo[k])/contDist), G.dims[k] - 1);
+      cell[m] = c[0] + G.dims[0]*(c[1] + G.dims[1]*c[2]);
+      atom[m] = ai; res[m] = residues[i];
+      cellStart[cell[m] + 1]++;
+    }
+  }
+  for (int c = 1; c < cellStart.size(); c++) cellStart[c] += cellStart[c - 1];
+  vector<int> fill(cellStart.begin(), cellStart.end() - 1), order(n);
+  for (int m = 0; m < n; m++) order[fill[cell[m]]++] = m;
+  G.coor.resize(3*n); G.rot.resize(n);
+  G.runRes.clear(); G.runStart.clear(); G.cellRun.assign(nc + 1, 0);
+  for (int c = 0; c < nc; c++) {
+    G.cellRun[c] = G.runRes.size();
+    for (int j = cellStart[c]; j < cellStart[c + 1]; j++) {
+      int m = order[j];
+      for (int k = 0; k < 3; k++) G.coor[3*j + k] = scCoor[3*atom[m] + k];
+      G.rot[j] = scRot[atom[m]];
+      if ((j == cellStart[c]) || (res[m] != G.runRes.back())) {
+        G.runRes.push_back(res[m]);
+        G.runStart.push_back(j);
+      }
+    }
+  }
+  G.cellRun[nc] = G.runRes.size();
+  G.runStart.push_back(n);
+}
+
+void ConFind::sweepClashing(int ci, const vector<int>& partners, const sweepGrid& G, vector<int>& slotOf, vector<vector<long> >& clashing) {
+  // rotamer pairs in contact are marked in a bit set per partner (allocated on
+  // first contact), which is then read out in order
+  vector<vector<uint64_t> > pairBits(partners.size());
+  for (int s = 0; s < partners.size(); s++) slotOf[partners[s]] = s;
+  const cachedResidue& A = cached[ci];
+  mstreal d2max = contDist*contDist;
+  for (int ai = A.firstAtom; ai < A.firstAtom + A.numAtoms; ai++) {
+    long rA = scRot[ai] - A.firstRot;
+    const mstcoor* x = scCoor.data() + 3*ai;
+    int clo[3], chi[3]; bool inRange = true;
+    for (int k = 0; inRange && (k < 3); k++) {
+      clo[k] = MstUtils::max(int(floor((x[k] - contDist - G.lo[k])/contDist)), 0);
+      chi[k] = MstUtils::min(int(floor((x[k] + contDist - G.lo[k])/contDist)), G.dims[k] - 1);
+      inRange = (clo[k] <= chi[k]);
+    }
+    if (!inRange) continue;
+    for (int cz = clo[2]; cz <= chi[2]; cz++) {
+      for (int cy = clo[1]; cy <= chi[1]; cy++) {
+        int c = G.dims[0]*(cy + G.dims[1]*cz);
+        for (int r = G.cellRun[c + clo[0]]; r < G.cellRun[c + chi[0] + 1]; r++) {
+          int s = slotOf[G.runRes[r]];
+          if (s < 0) continue;
+          const cachedResidue& B = cached[G.runRes[r]];
+          for (int bi = G.runStart[r]; bi < G.runStart[r + 1]; bi++) {
+            const mstcoor* y = G.coor.data() + 3*bi;
+            mstreal dx = (mstreal) x[0] - y[0], dy = (mstreal) x[1] - y[1], dz = (mstreal) x[2] - y[2];
+            if (dx*dx + dy*dy + dz*dz <= d2max) {
+              vector<uint64_t>& bits = pairBits[s];
+              if (bits.empty()) bits.resize((((long) A.numRots)*B.numRots + 63)/64, 0);
+              long code = rA*B.numRots + (G.rot[bi] - B.firstRot);
+              bits[code >> 6] |= (uint64_t(1) << (code & 63));
+            }
+          }
+        }
+      }
+    }
+  }
+  clashing.assign(partners.size(), vector<long>());
+  for (int s = 0; s < partners.size(); s++) {
+    const vector<uint64_t>& bits = pairBits[s];
+    for (long k = 0; k < bits.size(); k++) {
+      for (uint64_t word = bits[k]; word != 0; word &= word - 1) clashing[s].push_back(64*k + __builtin_ctzll(word));
+    }
+    slotOf[partners[s]] = -1;
+  }
+}
+
 contactList ConFind::getContacts(Residue* res, mstreal cdcut, contactList* list) {
   // this way, the contact computing code lives only in one place (minimal cost)
   return getContacts(vector<Residue*>(1, res), cdcut, list);
@@ -304,44 +650,93 @@ contactList ConFind::getContacts(Structure& S, mstreal cdcut, contactList* list)
 }
 
 contactList ConFind::getContacts(const vector<Residue*>& residues, mstreal cdcut, contactList* list) {
+  MstProfiler::scope prof("ConFind::getContacts");
   cache(residues);
   fastmap<Residue*, fastmap<Residue*, bool> > checked;
   fastmap<Residue*, bool> ofInterest;
   for (int i = 0; i < residues.size(); i++) ofInterest[residues[i]] = true;
 
-  contactList L;
-  if (list == NULL) list = &L;
+  // the pairs to visit: each residue of interest with those of its neighbors
+  // not already visited from the other side
+  vector<vector<Residue*> > partners(residues.size());
+  vector<Residue*> toCache;
   for (int i = 0; i < residues.size(); i++) {
     Residue* resi = residues[i];
-    collProbUpdateOn(resi);
     vector<Residue*> neighborhood = getNeighbors(resi);
     for (int j = 0; j < neighborhood.size(); j++) {
       Residue* resj = neighborhood[j];
       if ((resi != resj) && (checked[resi].find(resj) == checked[resi].end())) {
-        if (ofInterest.find(resj) != ofInterest.end()) collProbUpdateOn(resj);
         checked[resj][resi] = true;
-        mstreal cd = contactDegree(resi, resj, false, true, false);
+        partners[i].push_back(resj);
+        toCache.push_back(resj);
+      }
+    }
+  }
+  cache(toCache);
+
+  // one grid over the rotamers of all residues involved, so that all pairs of
+  // a residue are found in one sweep over its atoms
+  vector<int> involved(cached.size(), 0), gridResidues;
+  for (int i = 0; i < residues.size(); i++) involved[cachedIndex[residues[i]]] = 1;
+  for (int i = 0; i < toCache.size(); i++) involved[cachedIndex[toCache[i]]] = 1;
+  for (int ci = 0; ci < involved.size(); ci++) {
+    if (involved[ci]) gridResidues.push_back(ci);
+  }
+  sweepGrid G;
+  buildSweepGrid(gridResidues, G);
+
+  // sweeps of residues are independent, so are done in parallel over blocks of
+  // residues; collision probabilities and contacts are then accumulated in
+  // order, exactly as when computing contact degrees one pair at a time
+  int blockSize = 4*numThreads;
+  vector<vector<int> > slotOf(numThreads, vector<int>(cached.size(), -1));
+  vector<vector<vector<long> > > clashing(blockSize);
+  contactList L;
+  if (list == NULL) list = &L;
+  for (int b = 0; b < residues.size(); b += blockSize) {
+    int nb = MstUtils::min(blockSize, (int) residues.size() - b);
+    MstUtils::parallelFor(nb, numThreads, [&](int k, int w) {
+      vector<int> p(partners[b + k].size());
+      for (int j = 0; j < p.size(); j++) p[j] = cachedIndex.find(partners[b + k][j])->second;
+      sweepClashing(cachedIndex.find(residues[b + k])->second, p, G, slotOf[w], clashing[k]);
+    });
+    for (int k = 0; k < nb; k++) {
+      Residue* resi = residues[b + k];
+      collProbUpdateOn(resi);
+      mstreal weightI = weightOfAvailableRotamers(resi, aaNames);
+      for (int j = 0; j < partners[b + k].size(); j++) {
+        Residue* resj = partners[b + k][j];
+        if (ofInterest.find(resj) != ofInterest.end()) collProbUpdateOn(resj);
+        bool updateJ = (updateCollProb.find(resj) != updateCollProb.end()) && updateCollProb[resj];
+        mstreal cd = clashingPairsWeight(resi, resj, clashing[k][j], true, updateJ);
+        mstreal denom = weightI * weightOfAvailableRotamers(resj, aaNames);
+        if (denom == 0.0) cd = 0.0;
+        else cd /= denom;
+        degrees[resi][resj] = cd;
+        degrees[resj][resi] = cd;
         if (cd > cdcut) {
           list->addContact(resi, resj, cd);
         }
         if (ofInterest.find(resj) != ofInterest.end()) collProbUpdateOff(resj);
       }
+      clashing[k].clear();
+      collProbUpdateOff(resi);
+      // since all contacts for this residue have now been visited, we have all the
+      // information we need to compute freedom. If the rotamers surviving at this
+      // position happen not to clash with any other rotamers at all (e.g., no
+      // rotamers survive at the position but could be that some survive and never
+      // clash), the collision probably map for this position will not exist, so
+      // make it empty.
+      if (collProb.find(resi) == collProb.end()) collProb[resi] = fastmap<rotamerID*, mstreal>();
+      computeFreedom(resi);
     }
-    collProbUpdateOff(resi);
-    // since all contacts for this residue have now been visited, we have all the
-    // information we need to compute freedom. If the rotamers surviving at this
-    // position happen not to clash with any other rotamers at all (e.g., no
-    // rotamers survive at the position but could be that some survive and never
-    // clash), the collision probably map for this position will not exist, so
-    // make it empty.
-    if (collProb.find(resi) == collProb.end()) collProb[resi] = fastmap<rotamerID*, mstreal>();
-    computeFreedom(resi);
   }
 
   return *list;
 }
 
 contactList ConFind::getConstrainedContacts(const vector<Residue *> &residues, mstreal cdcut, contactList* list) {
+  MstProfiler::scope prof("ConFind::getConstrainedContacts");
   contactList L;
   if (list == NULL) list = &L;
   
@@ -367,6 +762,7 @@ contactList ConFind::getConstrainedContacts(const vector<Residue *> &residues, m
 }
 
 contactList ConFind::getInterference(const vector<Residue*>& residues, mstreal incut, contactList* list) {
+  MstProfiler::scope prof("ConFind::getInterference");
   cache(residues);
   contactList L;
   if (list == NULL) list = &L;
@@ -376,7 +772,7 @@ contactList ConFind::getInterference(const vector<Residue*>& residues, mstreal i
   // because interference is directional, need to check if the desired residues
   // are involved in either direction
   for (auto itA = interference.begin(); itA != interference.end(); ++itA) {
-    fastmap<Residue*, fastmap<string,mstreal>>& interB = itA->second;
+    fastmap<Residue*, vector<mstreal> >& interB = itA->second;
     bool wantA = (wanted.find(itA->first) != wanted.end());
     for (auto itB = interB.begin(); itB != interB.end(); ++itB) {
       if (wantA || (wanted.find(itB->first) != wanted.end())) {
@@ -410,7 +806,7 @@ contactList ConFind::getInterfering(const vector<Residue*>& residues, mstreal in
   for (int i = 0; i < residues.size(); i++) {
     Residue* resA = residues[i];
     if (interference.find(resA) == interference.end()) continue;
-    fastmap<Residue*, fastmap<string, mstreal>>& interB = interference[resA];
+    fastmap<Residue*, vector<mstreal> >& interB = interference[resA];
     for (auto itB = interB.begin(); itB != interB.end(); ++itB) {
       mstreal in = interferenceValue(resA, itB->first);
       if (in >= incut) {
@@ -432,13 +828,17 @@ contactList ConFind::getInterfering(const Structure& S, mstreal incut, contactLi
 
 mstreal ConFind::interferenceValue(Residue* resA, Residue* resB, set<string> aaAllowed) {
   mstreal in = 0.0;
-  if (interference[resA].count(resB) == 0) return in;
+  auto itA = interference.find(resA);
+  if (itA == interference.end()) return in;
+  auto itB = itA->second.find(resB);
+  if (itB == itA->second.end()) return in;
   if (aaAllowed.empty()) aaAllowed = aaNames;
   
   // sum up interference of resB backbone on resA sidechain (considering only allowed amino acids)
-  for (string aa : aaAllowed) {
-    if (aaNames.find(aa) == aaNames.end()) MstUtils::error("amino acid with the name: "+aa+" not in list of allowable amino acids");
-    in += interference[resA][resB][aa];
+  const vector<mstreal>& inAB = itB->second;
+  unsigned int mask = aaMask(aaAllowed);
+  for (int ai = 0; ai < inAB.size(); ai++) {
+    if (mask & (1u << ai)) in += inAB[ai];
   }
   
   // normalize the interference by the weight of available rotamers at resA
@@ -470,6 +870,7 @@ contactList ConFind::getBBInteraction(Residue* res, mstreal dcut, int ignoreFlan
 }
 
 contactList ConFind::getBBInteraction(Structure& S, mstreal dcut, int ignoreFlanking, contactList* list) {
+  MstProfiler::scope prof("ConFind::getBBInteraction");
   contactList L;
   if (list == NULL) list = &L;
   vector<Residue*> allRes = S.getResidues();
@@ -518,12 +919,12 @@ vector<mstreal> ConFind::getCrowdedness(vector<Residue*>& residues) {
 
 mstreal ConFind::weightOfAvailableRotamers(Residue* res, set<string> available_aa) {
   mstreal weight = 0;
-  if (survivingRotamers.find(res) == survivingRotamers.end()) MstUtils::error("residue not cached: " + MstUtils::toString(res), "ConFind::weightOfAvailableRotamers");
-  vector<rotamerID*>& rots = survivingRotamers[res];
-  for (int i = 0; i < rots.size(); i++) {
-    rotamerID& rot = *(rots[i]);
-    if (available_aa.find(rot.aminoAcid()) == available_aa.end()) continue;
-    weight += aaProp[rot.aminoAcid()] * rotLib->rotamerProbability(rot);
+  auto it = cachedIndex.find(res);
+  if (it == cachedIndex.end()) MstUtils::error("residue not cached: " + MstUtils::toString(res), "ConFind::weightOfAvailableRotamers");
+  const cachedResidue& cr = cached[it->second];
+  unsigned int mask = aaMask(available_aa);
+  for (int ri = cr.firstRot; ri < cr.firstRot + cr.numRots; ri++) {
+    if (mask & (1u << rotAA[ri])) weight += rotAAProp[ri] * rotProb[ri];
   }
   return weight;
 }
@@ -542,6 +943,7 @@ mstreal ConFind::getFreedom(Residue* res) {
 }
 
 vector<mstreal> ConFind::getFreedom(vector<Residue*>& residues) {
+  MstProfiler::scope prof("ConFind::getFreedom");
   vector<mstreal> freedoms(residues.size());
   for (int i = 0; i < residues.size(); i++) freedoms[i] = getFreedom(residues[i]);
   return freedoms;
@@ -590,7 +992,9 @@ mstreal ConFind::computeFreedom(Residue* res) {
 
 vector<Residue*> ConFind::getNeighbors(Residue* residue) {
   // find all residues around this one that are within cutoff distance and can affects it
-  vector<int> close = caNN->getPointsWithin(residue->findAtom("CA"), 0, dcut);
+  vector<int> close;
+  caNN->pointsWithin(Point3(residue->findAtom("CA")), 0, dcut, close);
+  sort(close.begin(), close.end());
   vector<Residue*> neighborhood(close.size(), NULL);
   bool foundSelf = false;
   for (int i = 0; i < close.size(); i++) {
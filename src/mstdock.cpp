@@ -0,0 +1,231 @@
+#include "mstdock.h"
+
+using namespace MST;
+
+/* --------- RigidBodyDocker ------------ */
+RigidBodyDocker::RigidBodyDocker(const AtomPointerVector& receptor, const AtomPointerVector& ligand) {
+  recCenter = AtomPointerVector(receptor).getGeometricCenter();
+  ligCenter = AtomPointerVector(ligand).getGeometricCenter();
+  recXYZ.resize(3*receptor.size());
+  for (int i = 0; i < receptor.size(); i++) {
+    for (int d = 0; d < 3; d++) recXYZ[3*i + d] = (*receptor[i])[d];
+    if (receptor[i]->getName() == "CA") recContIdx.push_back(i);
+  }
+  ligXYZ.resize(3*ligand.size());
+  for (int i = 0; i < ligand.size(); i++) {
+    for (int d = 0; d < 3; d++) ligXYZ[3*i + d] = (*ligand[i])[d] - ligCenter[d];
+    if (ligand[i]->getName() == "CA") ligContIdx.push_back(i);
+  }
+  clashDist = 3.0; contDist = 8.0; pullSigma = 1.0; maxSeparation = 8.0;
+  clashesAllowed = 3; contactsRequired = 1; numThreads = 1; batchSize = 256;
+  fixedPull = ligContactsGiven = gridsSet = false;
+}
+
+void RigidBodyDocker::setReceptorContactAtoms(const vector<int>& idx) {
+  recContIdx = idx;
+  gridsSet = false;
+}
+
+void RigidBodyDocker::setLigandContactAtoms(const vector<int>& idx) {
+  ligContIdx = idx;
+  ligContactsGiven = true;
+}
+
+void RigidBodyDocker::setDisallowedContacts(const vector<int>& receptorIdx, const vector<int>& ligandIdx) {
+  recBadIdx = receptorIdx;
+  ligBadIdx = ligandIdx;
+  gridsSet = false;
+}
+
+void RigidBodyDocker::setPullDirection(const CartesianPoint& u) {
+  CartesianPoint v = u;
+  pullFrame = TransformFactory::alignVectorWithXAxis(v);
+  fixedPull = true;
+}
+
+vector<mstreal> RigidBodyDocker::coordinateSubset(const vector<mstreal>& xyz, const vector<int>& idx) {
+  vector<mstreal> sub(3*idx.size());
+  for (int i = 0; i < idx.size(); i++) {
+    for (int d = 0; d < 3; d++) sub[3*i + d] = xyz[3*idx[i] + d];
+  }
+  return sub;
+}
+
+void RigidBodyDocker::setGrids() {
+  clashGrid = CellList(recXYZ, clashDist);
+  contactGrid = CellList(coordinateSubset(recXYZ, recContIdx), contDist);
+  disallowedGrid = CellList(coordinateSubset(recXYZ, recBadIdx), contDist);
+  gridsSet = true;
+}
+
+int RigidBodyDocker::countWithin(const CellList& grid, const vector<mstreal>& placed, int i, mstreal d, int maxCount) {
+  int count = 0;
+  grid.forEachWithin(Point3(placed[3*i], placed[3*i + 1], placed[3*i + 2]), 0, d, [&](int j, mstreal d2) { count++; return count <= maxCount; });
+  return count;
+}
+
+void RigidBodyDocker::projectedExtent(const vector<mstreal>& xyz, const vector<int>* idx, const CartesianPoint& axis, mstreal& lo, mstreal& hi) {
+  int n = (idx == NULL) ? xyz.size()/3 : idx->size();
+  lo = numeric_limits<mstreal>::infinity(); hi = -numeric_limits<mstreal>::infinity();
+  for (int k = 0; k < n; k++) {
+    int i = (idx == NULL) ? k : (*idx)[k];
+    mstreal p = axis[0]*xyz[3*i] + axis[1]*xyz[3*i + 1] + axis[2]*xyz[3*i + 2];
+    lo = MstUtils::min(lo, p);
+    hi = MstUtils::max(hi, p);
+  }
+}
+
+int RigidBodyDocker::countClashes(const vector<mstreal>& placed, vector<int>& recent, int maxCount) const {
+  // atoms that clashed at the previous step are the most likely to clash again,
+  // so check them first; the atoms clashing now are appended after them
+  int np = recent.size(), count = 0;
+  for (int k = 0; (k < np) && (count <= maxCount); k++) {
+    int i = recent[k];
+    int c = countWithin(clashGrid, placed, i, clashDist, maxCount - count);
+    if (c > 0) { recent.push_back(i); count += c; }
+  }
+  for (int i = 0; (i < placed.size()/3) && (count <= maxCount); i++) {
+    if (find(recent.begin(), recent.begin() + np, i) != recent.begin() + np) continue;
+    int c = countWithin(clashGrid, placed, i, clashDist, maxCount - count);
+    if (c > 0) { recent.push_back(i); count += c; }
+  }
+  recent.erase(recent.begin(), recent.begin() + np);
+  return count;
+}
+
+int RigidBodyDocker::countContacts(const vector<mstreal>& placed, const vector<int>& idx, const CellList& grid, int maxCount) const {
+  int count = 0;
+  for (int k = 0; (k < idx.size()) && (count <= maxCount); k++) {
+    count += countWithin(grid, placed, idx[k], contDist, maxCount - count);
+  }
+  return count;
+}
+
+RigidBodyDocker::trialOutcome RigidBodyDocker::trial(unsigned seed, vector<mstreal>& placed, vector<int>& recent, Transform& T) const {
+  mt19937 rng(seed);
+  uniform_real_distribution<mstreal> angle(0, 360);
+  normal_distribution<mstreal> step(0, pullSigma);
+
+  /* Relative orientation, as if each partner was rotated around the X, Y, and
+   * then Z axes in the laboratory frame with the ligand pulled along X. Here,
+   * the receptor stays put, so the pull direction and lateral axes are the
+   * laboratory axes expressed in the receptor frame. */
+  Transform RA = pullFrame;
+  if (!fixedPull) {
+    mstreal xa = angle(rng), ya = angle(rng), za = angle(rng);
+    RA = TransformFactory::rotateAroundZ(za) * TransformFactory::rotateAroundY(ya) * TransformFactory::rotateAroundX(xa);
+  }
+  mstreal xb = angle(rng), yb = angle(rng), zb = angle(rng);
+  Transform RB = TransformFactory::rotateAroundZ(zb) * TransformFactory::rotateAroundY(yb) * TransformFactory::rotateAroundX(xb);
+  Transform RAi = RA.inverse();
+  CartesianPoint u = RAi * CartesianPoint(1, 0, 0);
+  Transform base = TransformFactory::translate(recCenter) * RAi * RB; // applies to the centered ligand
+  placed.resize(ligXYZ.size());
+  base.applyToCopy(ligXYZ.data(), ligXYZ.size()/3, placed.data());
+
+  CartesianPoint shift(0, 0, 0);
+  mstreal ligLo, ligHi, recLo, recHi;
+  if (fixedPull) {
+    CartesianPoint ey = RAi * CartesianPoint(0, 1, 0), ez = RAi * CartesianPoint(0, 0, 1);
+    mstreal aylo, ayhi, azlo, azhi, bylo, byhi, bzlo, bzhi;
+    projectedExtent(recXYZ, &recContIdx, ey, aylo, ayhi);
+    projectedExtent(recXYZ, &recContIdx, ez, azlo, azhi);
+    projectedExtent(placed, NULL, ey, bylo, byhi);
+    projectedExtent(placed, NULL, ez, bzlo, bzhi);
+    mstreal yRand = uniform_real_distribution<mstreal>(0, 0.5*((ayhi - aylo) + (byhi - bylo)))(rng);
+    mstreal zRand = uniform_real_distribution<mstreal>(0, 0.5*((azhi - azlo) + (bzhi - bzlo)))(rng);
+    shift = ey*yRand + ez*zRand;
+
+    if (ligContactsGiven) {
+      // skip if ligand contact atoms could never meet receptor contact atoms
+      projectedExtent(placed, &ligContIdx, ey, bylo, byhi);
+      projectedExtent(placed, &ligContIdx, ez, bzlo, bzhi);
+      bylo += yRand; byhi += yRand; bzlo += zRand; bzhi += zRand;
+      if ((bylo > ayhi) || (byhi < aylo) || (bzlo > azhi) || (bzhi < azlo)) return trialSkipped;
+
+      // ... or if they face away from the receptor
+      CartesianPoint ligContCenter(0, 0, 0);
+      for (int i : ligContIdx) ligContCenter += CartesianPoint(placed[3*i], placed[3*i + 1], placed[3*i + 2]);
+      if (!ligContIdx.empty() && (ligContCenter/ligContIdx.size() - recCenter).dot(u) > 0) return trialSkipped;
+
+      // speed up by making a single big pull apart
+      projectedExtent(recXYZ, &recContIdx, u, recLo, recHi);
+      projectedExtent(placed, &ligContIdx, u, ligLo, ligHi);
+      shift += u * (0.75*MstUtils::min(recHi - recLo, ligHi - ligLo));
+    }
+  }
+  for (int i = 0; i < placed.size(); i += 3) {
+    placed[i] += shift[0]; placed[i+1] += shift[1]; placed[i+2] += shift[2];
+  }
+
+  // a trial fails once the ligand has been pulled past the far end of the receptor
+  projectedExtent(recXYZ, NULL, u, recLo, recHi);
+  projectedExtent(placed, NULL, u, ligLo, ligHi);
+  recent.clear();
+  while (true) {
+    mstreal ds = fabs(step(rng));
+    shift += u * ds; ligLo += ds;
+    for (int i = 0; i < placed.size(); i += 3) {
+      placed[i] += ds*u[0]; placed[i+1] += ds*u[1]; placed[i+2] += ds*u[2];
+    }
+    if (countClashes(placed, recent, clashesAllowed) > clashesAllowed) continue;
+    if (!ligBadIdx.empty() && (countContacts(placed, ligBadIdx, disallowedGrid, 0) > 0)) return trialFailed;
+    if (countContacts(placed, ligContIdx, contactGrid, MstUtils::max(0, contactsRequired - 1)) >= contactsRequired) {
+      T = TransformFactory::translate(shift) * base * TransformFactory::translate(-ligCenter);
+      return trialAccepted;
+    }
+    if (ligLo - recHi > maxSeparation) return trialFailed;
+  }
+}
+
+long RigidBodyDocker::sample(int n, const function<void(const Transform&)>& onAccept, long maxTrials) {
+  if (!gridsSet) setGrids();
+  int nt = MstUtils::max(1, numThreads), bs = MstUtils::max(1, batchSize);
+  vector<vector<mstreal> > placed(nt);
+  vector<vector<int> > recent(nt);
+  long failed = 0, trials = 0;
+  int accepted = 0;
+  while ((accepted < n) && ((maxTrials <= 0) || (trials < maxTrials))) {
+    int nb = (maxTrials > 0) ? (int) MstUtils::min((long) bs, maxTrials - trials) : bs;
+    vector<unsigned> seeds(nb);
+    for (int i = 0; i < nb; i++) seeds[i] = MstUtils::randEngine()();
+    vector<trialOutcome> outcomes(nb);
+    vector<Transform> poses(nb);
+    MstUtils::parallelFor(nb, nt, [&](int i, int w) {
+      outcomes[i] = trial(seeds[i], placed[w], recent[w], poses[i]);
+    });
+    // report in trial order, up to the n-th accepted pose
+    for (int i = 0; (i < nb) && (accepted < n); i++) {
+      trials++;
+      if (outcomes[i] == trialAccepted) {
+        accepted++;
+        onAccept(poses[i]);
+      } else if (outcomes[i] == trialFailed) {
+        failed++;
+      }
+    }
+  }
+  return failed;
+}
+
+vector<Transform> RigidBodyDocker::sample(int n, long* numFailed) {
+  vector<Transform> poses;
+  long failed = sample(n, [&](const Transform& T) { poses.push_back(T); });
+  if (numFailed != NULL) *numFailed = failed;
+  return poses;
+}
+
+int RigidBodyDocker::numClashes(const Transform& T) {
+  if (!gridsSet) setGrids();
+  vector<mstreal> placed(ligXYZ.size());
+  vector<int> recent;
+  (T * TransformFactory::translate(ligCenter)).applyToCopy(ligXYZ.data(), ligXYZ.size()/3, placed.data());
+  return countClashes(placed, recent, INT_MAX - 1);
+}
+
+int RigidBodyDocker::numContacts(const Transform& T) {
+  if (!gridsSet) setGrids();
+  vector<mstreal> placed(ligXYZ.size());
+  (T * TransformFactory::translate(ligCenter)).applyToCopy(ligXYZ.data(), ligXYZ.size()/3, placed.data());
+  return countContacts(placed, ligContIdx, contactGrid, INT_MAX - 1);
+}
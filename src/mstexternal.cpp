@@ -66,3 +66,181 @@ vector<string> strideInterface::getSTRIDEClassifications(bool strict) {
   }
   return ssClassifications;
 }
+
+constexpr mstreal secondaryStructureAssigner::maxHBondEnergy;
+
+mstreal secondaryStructureAssigner::hBondEnergy(const backbone& donor, const backbone& acceptor) {
+  // DSSP's electrostatic model: partial charges of 0.42e and 0.20e on C=O and N-H, with f = 332 (kcal/mol)*A/e^2
+  const mstreal q = -27.888, minEnergy = -9.9, minDist = 0.5;
+  mstreal dHO = donor.H.distance(acceptor.O), dHC = donor.H.distance(acceptor.C);
+  mstreal dNC = donor.N.distance(acceptor.C), dNO = donor.N.distance(acceptor.O);
+  if ((dHO < minDist) || (dHC < minDist) || (dNC < minDist) || (dNO < minDist)) return minEnergy;
+  return MstUtils::max(q*(1/dHO - 1/dHC + 1/dNC - 1/dNO), minEnergy);
+}
+
+void secondaryStructureAssigner::addHBond(vector<backbone>& bb, int d, int a, mstreal E) {
+  auto keep = [](int* partner, mstreal* energy, int k, mstreal e) {
+    if ((partner[0] < 0) || (e < energy[0])) {
+      partner[1] = partner[0]; energy[1] = energy[0];
+      partner[0] = k; energy[0] = e;
+    } else if ((partner[1] < 0) || (e < energy[1])) {
+      partner[1] = k; energy[1] = e;
+    }
+  };
+  keep(bb[d].acceptor, bb[d].acceptorEnergy, a, E);
+  keep(bb[a].donor, bb[a].donorEnergy, d, E);
+}
+
+bool secondaryStructureAssigner::hBonded(const vector<backbone>& bb, int d, int a) {
+  if ((d < 0) || (a < 0) || (d >= bb.size()) || (a >= bb.size())) return false;
+  for (int k = 0; k < 2; k++) {
+    if ((bb[d].acceptor[k] == a) && (bb[d].acceptorEnergy[k] < maxHBondEnergy)) return true;
+  }
+  return false;
+}
+
+bool secondaryStructureAssigner::connected(const vector<backbone>& bb, int i, int j) {
+  if ((i < 0) || (j >= bb.size()) || (i > j)) return false;
+  return (bb[i].segment >= 0) && (bb[i].segment == bb[j].segment);
+}
+
+vector<string> secondaryStructureAssigner::assign(const Structure& S) {
+  vector<Residue*> residues = S.getResidues();
+  int N = residues.size();
+  vector<backbone> bb(N);
+
+  // backbone coordinates, with amide hydrogens placed as in DSSP, and covalently connected segments
+  const mstreal maxPeptideBond = 2.5;
+  static const int idN = MstNames::intern("N"), idCA = MstNames::intern("CA"), idC = MstNames::intern("C"), idO = MstNames::intern("O");
+  static const int idPRO = MstNames::intern("PRO");
+  for (int i = 0, seg = -1; i < N; i++) {
+    Atom* n = residues[i]->findAtom(idN, false); Atom* ca = residues[i]->findAtom(idCA, false);
+    Atom* c = residues[i]->findAtom(idC, false); Atom* o = residues[i]->findAtom(idO, false);
+    if ((n == NULL) || (ca == NULL) || (c == NULL) || (o == NULL)) continue;
+    backbone& B = bb[i];
+    B.N = Point3(n); B.CA = Point3(ca); B.C = Point3(c); B.O = Point3(o); B.H = B.N;
+    B.complete = true;
+    bool linked = (i > 0) && bb[i-1].complete && (residues[i-1]->getParent() == residues[i]->getParent()) && (bb[i-1].C.distance(B.N) < maxPeptideBond);
+    B.segment = linked ? seg : ++seg;
+    if (linked && !residues[i]->isNamed(idPRO)) {
+      B.H = B.N + (bb[i-1].C - bb[i-1].O).getUnit();
+      B.hasH = true;
+    }
+  }
+
+  // hydrogen bonds between residues with CA atoms close enough for one to be possible
+  const mstreal maxCADist = 9.0;
+  vector<mstreal> caCoords; vector<int> caRes;
+  for (int i = 0; i < N; i++) {
+    if (!bb[i].complete) continue;
+    for (int k = 0; k < 3; k++) caCoords.push_back(bb[i].CA[k]);
+    caRes.push_back(i);
+  }
+  CellList caGrid(caCoords, maxCADist);
+  for (int i = 0; i < N; i++) {
+    if (!bb[i].complete) continue;
+    caGrid.forEachWithin(bb[i].CA, 0, maxCADist, [&](int k, mstreal d2) {
+      int j = caRes[k];
+      if (j <= i) return;
+      if (bb[i].hasH) addHBond(bb, i, j, hBondEnergy(bb[i], bb[j]));
+      if (bb[j].hasH && (j != i + 1)) addHBond(bb, j, i, hBondEnergy(bb[j], bb[i]));
+    });
+  }
+
+  // n-turns, starting at each residue
+  vector<vector<bool> > turn(6, vector<bool>(N, false));
+  for (int n = 3; n <= 5; n++) {
+    for (int i = 0; i + n < N; i++) turn[n][i] = connected(bb, i, i + n) && hBonded(bb, i + n, i);
+  }
+
+  vector<char> ss(N, 'C');
+
+  // beta bridges, grouped into ladders of consecutive bridges of the same type
+  struct ladder { bool parallel; vector<int> i, j; bool linked = false; };
+  vector<ladder> ladders;
+  for (int i = 1; i + 4 < N; i++) {
+    if (!connected(bb, i - 1, i + 1)) continue;
+    for (int j = i + 3; j + 1 < N; j++) {
+      if (!connected(bb, j - 1, j + 1)) continue;
+      bool parallel = (hBonded(bb, i + 1, j) && hBonded(bb, j, i - 1)) || (hBonded(bb, j + 1, i) && hBonded(bb, i, j - 1));
+      bool antiparallel = !parallel && ((hBonded(bb, i + 1, j - 1) && hBonded(bb, j + 1, i - 1)) || (hBonded(bb, j, i) && hBonded(bb, i, j)));
+      if (!parallel && !antiparallel) continue;
+      bool extended = false;
+      for (ladder& L : ladders) {
+        if ((L.parallel != parallel) || (i != L.i.back() + 1)) continue;
+        if ((parallel && (j == L.j.back() + 1)) || (!parallel && (j == L.j.back() - 1))) {
+          L.i.push_back(i); L.j.push_back(j);
+          extended = true;
+          break;
+        }
+      }
+      if (!extended) {
+        ladder L; L.parallel = parallel;
+        L.i.push_back(i); L.j.push_back(j);
+        ladders.push_back(L);
+      }
+    }
+  }
+  // ladders of the same type separated by a beta bulge (a gap of at most one residue on one
+  // strand and at most four on the other) make up one ladder, bulge residues included
+  auto markStrand = [&](int from, int to) { for (int k = from; k <= to; k++) ss[k] = 'E'; };
+  for (int a = 0; a < ladders.size(); a++) {
+    for (int b = a + 1; b < ladders.size(); b++) {
+      ladder& A = ladders[a]; ladder& B = ladders[b];
+      if (A.parallel != B.parallel) continue;
+      int gi = B.i.front() - A.i.back() - 1;
+      int gj = A.parallel ? B.j.front() - A.j.back() - 1 : A.j.back() - B.j.front() - 1;
+      if ((gi < 0) || (gj < 0) || !connected(bb, A.i.back(), B.i.front())) continue;
+      if (!(((gi <= 1) && (gj <= 4)) || ((gi <= 4) && (gj <= 1)))) continue;
+      if (A.parallel && !connected(bb, A.j.back(), B.j.front())) continue;
+      if (!A.parallel && !connected(bb, B.j.front(), A.j.back())) continue;
+      A.linked = B.linked = true;
+      markStrand(A.i.back(), B.i.front());
+      if (A.parallel) markStrand(A.j.back(), B.j.front());
+      else markStrand(B.j.front(), A.j.back());
+    }
+  }
+  for (const ladder& L : ladders) {
+    char label = ((L.i.size() > 1) || L.linked) ? 'E' : 'B';
+    for (int k = 0; k < L.i.size(); k++) {
+      if (ss[L.i[k]] != 'E') ss[L.i[k]] = label;
+      if (ss[L.j[k]] != 'E') ss[L.j[k]] = label;
+    }
+  }
+
+  // helices: two consecutive n-turns starting at i - 1 and i make residues i through i + n - 1
+  // helical. Alpha helices take precedence over everything, and 3-10 and pi helices are only
+  // placed where nothing else (but a helix of the same kind) already is
+  for (int i = 1; i + 4 <= N; i++) {
+    if (turn[4][i-1] && turn[4][i]) for (int k = i; k < i + 4; k++) ss[k] = 'H';
+  }
+  const char helixLabel[6] = {0, 0, 0, 'G', 'H', 'I'};
+  for (int n : {3, 5}) {
+    for (int i = 1; i + n <= N; i++) {
+      if (!turn[n][i-1] || !turn[n][i]) continue;
+      bool empty = true;
+      for (int k = i; k < i + n; k++) empty = empty && ((ss[k] == 'C') || (ss[k] == helixLabel[n]));
+      if (empty) for (int k = i; k < i + n; k++) ss[k] = helixLabel[n];
+    }
+  }
+
+  // turns: residues inside of an n-turn that are nothing else
+  for (int i = 0; i < N; i++) {
+    if (ss[i] != 'C') continue;
+    for (int n = 3; (n <= 5) && (ss[i] == 'C'); n++) {
+      for (int k = 1; k < n; k++) {
+        if ((i - k >= 0) && turn[n][i - k]) { ss[i] = 'T'; break; }
+      }
+    }
+  }
+
+  vector<string> labels(N);
+  for (int i = 0; i < N; i++) labels[i] = string(1, ss[i]);
+  return labels;
+}
+
+vector<vector<string> > secondaryStructureAssigner::assign(const vector<Structure*>& structs, int numThreads) {
+  vector<vector<string> > labels(structs.size());
+  MstUtils::parallelFor(structs.size(), numThreads, [&](int i, int) { labels[i] = assign(*(structs[i])); });
+  return labels;
+}
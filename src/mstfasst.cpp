@@ -1,7 +1,12 @@
 #include "mstfasst.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <chrono>
 
 /* --------- FASST::optList --------- */
-void FASST::optList::setOptions(const vector<mstreal>& _costs, bool add) {
+void FASST::optList::setOptions(const vector<mstreal>& _costs, bool add, mstreal maxCost) {
   // sort costs and keep track of indices to know the rank-to-index mapping
   costs = _costs;
   rankToIdx.resize(_costs.size());
@@ -15,99 +20,109 @@ void FASST::optList::setOptions(const vector<mstreal>& _costs, bool add) {
   sort(idxToRank.begin(), idxToRank.end(), [this](int i, int j) { return rankToIdx[i] < rankToIdx[j]; });
 
   // either include or exclude all options to start off, as instructed
-  isIn.resize(costs.size(), add);
-  if (add) {
-    bestCostRank = 0;
-    numIn = costs.size();
-  } else {
-    bestCostRank = -1;
-    numIn = 0;
+  int n = costs.size();
+  int m = add ? upper_bound(costs.begin(), costs.end(), maxCost) - costs.begin() : 0; // options to include
+  inBits.assign((n + 63)/64, (m == n) ? ~((uint64_t) 0) : 0);
+  if ((m == n) && (n % 64 != 0)) inBits.back() = (((uint64_t) 1) << (n % 64)) - 1;
+  if (m < n) {
+    // only the cheapest options; typically few of them
+    for (int r = 0; r < m; r++) inBits[rankToIdx[r] >> 6] |= ((uint64_t) 1) << (rankToIdx[r] & 63);
   }
+  bestCostRank = (m > 0) ? 0 : n;
+  numIn = m;
 }
 
 void FASST::optList::addOption(int k) {
-  if (!isIn[k]) {
+  if (!isIn(k)) {
     numIn++;
-    isIn[k] = true;
+    inBits[k >> 6] |= ((uint64_t) 1) << (k & 63);
     // update best, if the newly inserted option is better
-    if ((bestCostRank < 0) || (costs[bestCostRank] > costs[idxToRank[k]])) {
-      bestCostRank = idxToRank[k];
-    }
+    bestCostRank = MstUtils::min(bestCostRank, idxToRank[k]);
   }
 }
 
 bool FASST::optList::consistencyCheck() {
   int nn = 0;
-  for (int i = 0; i < isIn.size(); i++) {
-    if (isIn[i]) nn++;
+  for (int i = 0; i < costs.size(); i++) {
+    if (isIn(i)) nn++;
   }
   if (nn != numIn) {
     return false;
   }
-  if (numIn == 0) {
-    if (bestCostRank != -1) return false;
-  } else {
-    if ((bestCostRank < 0) || (bestCostRank >= costs.size())) return false;
-    if (!isIn[rankToIdx[bestCostRank]]) return false;
+  // no available option may rank ahead of the best
+  for (int r = 0; r < MstUtils::min(bestCostRank, (int) costs.size()); r++) {
+    if (isIn(rankToIdx[r])) return false;
   }
   return true;
 }
 
 void FASST::optList::removeOption(int k) {
   // if ((k < 0) || (k >= costs.size())) MstUtils::error("out-of-range index specified: " + MstUtils::toString(k), "FASST::optList::removeOption(int)");
-  if (isIn[k]) {
+  if (isIn(k)) {
     numIn--;
-    isIn[k] = false;
-    // find new best, if this was the best
-    if (bestCostRank == idxToRank[k]) {
-      int oldBestRank = bestCostRank;
-      bestCostRank = -1;
-      for (int r = oldBestRank + 1; r < costs.size(); r++) {
-        if (isIn[rankToIdx[r]]) { bestCostRank = r; break; }
-      }
-    }
+    inBits[k >> 6] &= ~(((uint64_t) 1) << (k & 63));
+  }
+}
+
+void FASST::optList::clearRange(int b, int e) {
+  if (b > e) return;
+  int wb = b >> 6, we = e >> 6;
+  uint64_t first = ~((uint64_t) 0) << (b & 63), last = ~((uint64_t) 0) >> (63 - (e & 63));
+  for (int w = wb; w <= we; w++) {
+    uint64_t mask = ~((uint64_t) 0);
+    if (w == wb) mask &= first;
+    if (w == we) mask &= last;
+    numIn -= __builtin_popcountll(inBits[w] & mask);
+    inBits[w] &= ~mask;
+  }
+}
+
+void FASST::optList::intersectBits(const vector<uint64_t>& bits) {
+  numIn = 0;
+  for (int w = 0; w < inBits.size(); w++) {
+    inBits[w] &= bits[w];
+    numIn += __builtin_popcountll(inBits[w]);
   }
 }
 
 void FASST::optList::removeOptions(int b, int e) {
   if (b < 0) b = 0;
   if (e >= totNumOptions()) e = totNumOptions() - 1;
-  for (int k = b; k <= e; k++) removeOption(k);
+  clearRange(b, e);
 }
 
 void FASST::optList::removeAllOptions() {
-  for (int i = 0; i < isIn.size(); i++) isIn[i] = false;
+  inBits.assign(inBits.size(), 0);
   numIn = 0;
-  bestCostRank = -1;
+  bestCostRank = costs.size();
 }
 
 void FASST::optList::copyIn(const FASST::optList& opt) {
-  isIn = opt.isIn;
+  inBits.assign(opt.inBits.begin(), opt.inBits.end());
   bestCostRank = opt.bestCostRank;
   numIn = opt.numIn;
 }
 
 void FASST::optList::intersectOptions(const vector<int>& opts) {
-  vector<bool> isOK(isIn.size(), false);
-  for (int i = 0; i < opts.size(); i++) isOK[opts[i]] = true;
-  for (int i = 0; i < isIn.size(); i++) {
-    if (isIn[i] && !isOK[i]) removeOption(i);
-  }
+  okBits.assign(inBits.size(), 0);
+  for (int i = 0; i < opts.size(); i++) okBits[opts[i] >> 6] |= ((uint64_t) 1) << (opts[i] & 63);
+  intersectBits(okBits);
 }
 
 void FASST::optList::intersectOptions(const vector<bool>& isOK) {
-  for (int i = 0; i < isIn.size(); i++) {
-    if (isIn[i] && !isOK[i]) removeOption(i);
+  okBits.assign(inBits.size(), 0);
+  for (int i = 0; i < isOK.size(); i++) {
+    if (isOK[i]) okBits[i >> 6] |= ((uint64_t) 1) << (i & 63);
   }
+  intersectBits(okBits);
 }
 
 void FASST::optList::constrainLE(int idx) {
-  for (int i = MstUtils::max(idx+1, 0); i < isIn.size(); i++) removeOption(i);
+  removeOptions(MstUtils::max(idx + 1, 0), totNumOptions() - 1);
 }
 
 void FASST::optList::constrainGE(int idx) {
-  int UB = MstUtils::min(idx, (int) isIn.size());
-  for (int i = 0; i < UB; i++) removeOption(i);
+  removeOptions(0, MstUtils::min(idx, totNumOptions()) - 1);
 }
 
 void FASST::optList::constrainRange(int idxLow, int idxHigh) {
@@ -188,7 +203,437 @@ bool fasstSearchOptions::validateSearchRequest(int numQuerySegs) const {
   return validateGapConstraints(numQuerySegs);
 }
 
+fasstSearchOptions& fasstSearchOptions::operator=(const fasstSearchOptions& other) {
+  if (this == &other) return *this;
+  rmsdCutRequested = other.rmsdCutRequested;
+  contextLength = other.contextLength;
+  redundancyCut = other.redundancyCut;
+  redundancyProp = other.redundancyProp;
+  minGap = other.minGap; maxGap = other.maxGap;
+  minGapSet = other.minGapSet; maxGapSet = other.maxGapSet; diffChainSet = other.diffChainSet;
+  gapConstSet = other.gapConstSet; diffChainRestSet = other.diffChainRestSet; verb = other.verb;
+  maxNumMatches = other.maxNumMatches; minNumMatches = other.minNumMatches; suffNumMatches = other.suffNumMatches;
+  maxSearchTime = other.maxSearchTime; maxSearchNodes = other.maxSearchNodes; orderTargets = other.orderTargets;
+  if (seqConst != NULL) delete(seqConst);
+  seqConst = (other.seqConst == NULL) ? NULL : other.seqConst->clone();
+  return *this;
+}
+
+void fasstSearchOptions::write(ostream& _os) const {
+  if (seqConst != NULL) MstUtils::error("sequence constraints cannot be written", "fasstSearchOptions::write");
+  MstUtils::writeBin(_os, rmsdCutRequested);
+  MstUtils::writeBin(_os, contextLength);
+  MstUtils::writeBin(_os, redundancyCut);
+  MstUtils::writeBin(_os, redundancyProp);
+  MstUtils::writeBin(_os, minGap); MstUtils::writeBin(_os, maxGap);
+  vector<vector<vector<bool> > const*> masks = {&minGapSet, &maxGapSet, &diffChainSet};
+  for (auto m : masks) {
+    // vector<bool> has no addressable elements, so go through ints
+    vector<vector<int> > M(m->size());
+    for (int i = 0; i < m->size(); i++) M[i] = vector<int>((*m)[i].begin(), (*m)[i].end());
+    MstUtils::writeBin(_os, M);
+  }
+  MstUtils::writeBin(_os, gapConstSet); MstUtils::writeBin(_os, diffChainRestSet); MstUtils::writeBin(_os, verb);
+  MstUtils::writeBin(_os, maxNumMatches); MstUtils::writeBin(_os, minNumMatches); MstUtils::writeBin(_os, suffNumMatches);
+  MstUtils::writeBin(_os, maxSearchTime); MstUtils::writeBin(_os, maxSearchNodes); MstUtils::writeBin(_os, orderTargets);
+}
+
+void fasstSearchOptions::read(istream& _is) {
+  unsetSequenceConstraints();
+  MstUtils::readBin(_is, rmsdCutRequested);
+  MstUtils::readBin(_is, contextLength);
+  MstUtils::readBin(_is, redundancyCut);
+  MstUtils::readBin(_is, redundancyProp);
+  MstUtils::readBin(_is, minGap); MstUtils::readBin(_is, maxGap);
+  vector<vector<vector<bool> >*> masks = {&minGapSet, &maxGapSet, &diffChainSet};
+  for (auto m : masks) {
+    vector<vector<int> > M; MstUtils::readBin(_is, M);
+    m->resize(M.size());
+    for (int i = 0; i < M.size(); i++) (*m)[i] = vector<bool>(M[i].begin(), M[i].end());
+  }
+  MstUtils::readBin(_is, gapConstSet); MstUtils::readBin(_is, diffChainRestSet); MstUtils::readBin(_is, verb);
+  MstUtils::readBin(_is, maxNumMatches); MstUtils::readBin(_is, minNumMatches); MstUtils::readBin(_is, suffNumMatches);
+  MstUtils::readBin(_is, maxSearchTime); MstUtils::readBin(_is, maxSearchNodes); MstUtils::readBin(_is, orderTargets);
+}
+
+/* --------- fasstMappedDB --------- */
+fasstMappedDB::fasstMappedDB(const string& dbFile) {
+  file = dbFile;
+  int fd = open(dbFile.c_str(), O_RDONLY);
+  if (fd < 0) MstUtils::error("could not open file '" + dbFile + "'", "fasstMappedDB::fasstMappedDB");
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size < sizeof(header))) {
+    close(fd);
+    MstUtils::error("'" + dbFile + "' is too short to be a mapped FASST database", "fasstMappedDB::fasstMappedDB");
+  }
+  len = st.st_size;
+  base = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping remains valid after the descriptor is closed
+  if (base == MAP_FAILED) MstUtils::error("could not map file '" + dbFile + "'", "fasstMappedDB::fasstMappedDB");
+
+  const char* b = (const char*) base;
+  hdr = (const header*) b;
+  if ((strncmp(hdr->magic, magicString(), sizeof(hdr->magic)) != 0) || (hdr->fileSize != len)) {
+    munmap(base, len);
+    MstUtils::error("'" + dbFile + "' is not a valid mapped FASST database (or is truncated)", "fasstMappedDB::fasstMappedDB");
+  }
+  if (hdr->version != currentVersion) {
+    munmap(base, len);
+    MstUtils::error("unknown mapped database version " + MstUtils::toString(hdr->version) + " in '" + dbFile + "'", "fasstMappedDB::fasstMappedDB");
+  }
+  targ = (const targetEntry*) (b + hdr->targOff);
+  chainLens = (const int32_t*) (b + hdr->chainOff);
+  coords = (const float*) (b + hdr->coordOff);
+  seqs = (const res_t*) (b + hdr->seqOff);
+  names = b + hdr->nameOff;
+  props = (const propertyEntry*) (b + hdr->propOff);
+  for (int k = 0; k < hdr->numProps; k++) propIdx[propertyName(k)] = k;
+}
+
+fasstMappedDB::~fasstMappedDB() {
+  munmap(base, len);
+}
+
+bool fasstMappedDB::isMappedDatabase(const string& dbFile) {
+  fstream ifs; MstUtils::openFile(ifs, dbFile, fstream::in | fstream::binary, "fasstMappedDB::isMappedDatabase");
+  char magic[8] = {0};
+  ifs.read(magic, sizeof(magic));
+  ifs.close();
+  return (strncmp(magic, magicString(), sizeof(magic)) == 0);
+}
+
+void fasstMappedDB::targetExtent(int ti, mstreal& xlo, mstreal& ylo, mstreal& zlo, mstreal& xhi, mstreal& yhi, mstreal& zhi) const {
+  const targetEntry& t = targ[ti];
+  xlo = t.lo[0]; ylo = t.lo[1]; zlo = t.lo[2];
+  xhi = t.hi[0]; yhi = t.hi[1]; zhi = t.hi[2];
+}
+
+int fasstMappedDB::propertyIndex(const string& propType) const {
+  auto it = propIdx.find(propType);
+  return (it == propIdx.end()) ? -1 : it->second;
+}
+
+const double* fasstMappedDB::propertyValues(int k, int ti) const {
+  const char* b = (const char*) base;
+  const uint8_t* present = (const uint8_t*) (b + props[k].presentOff);
+  if (!present[ti]) return NULL;
+  return ((const double*) (b + props[k].valuesOff)) + targ[ti].resOff;
+}
+
+/* --------- fasstSegmentIndex --------- */
+vector<int> fasstSegmentIndex::getLengths() const {
+  vector<int> lens;
+  for (auto it = desc.begin(); it != desc.end(); ++it) lens.push_back(it->first);
+  return lens;
+}
+
+const float* fasstSegmentIndex::descriptors(int L, int ti) const {
+  auto it = desc.find(L);
+  if ((it == desc.end()) || (ti >= it->second.size()) || it->second[ti].empty()) return NULL;
+  return it->second[ti].data();
+}
+
+void fasstSegmentIndex::setDescriptors(int L, int ti, const vector<float>& d) {
+  vector<vector<float> >& byTarget = desc[L];
+  if (byTarget.size() <= ti) byTarget.resize(ti + 1);
+  byTarget[ti] = d;
+}
+
+void fasstSegmentIndex::write(const string& file, int firstTarget, int numTargets, const vector<int>& numRes, int atomsPerRes) const {
+  fstream ofs; MstUtils::openFile(ofs, file, fstream::out | fstream::binary, "fasstSegmentIndex::write");
+  MstUtils::writeBin(ofs, string("MSTFSIDX")); MstUtils::writeBin(ofs, (int) 1); // format version
+  MstUtils::writeBin(ofs, atomsPerRes);
+  MstUtils::writeBin(ofs, numRes);
+  MstUtils::writeBin(ofs, (int) desc.size());
+  for (auto it = desc.begin(); it != desc.end(); ++it) {
+    MstUtils::writeBin(ofs, it->first);
+    for (int ti = firstTarget; ti < firstTarget + numTargets; ti++) {
+      const float* d = descriptors(it->first, ti);
+      int len = (d == NULL) ? 0 : it->second[ti].size();
+      MstUtils::writeBin(ofs, len);
+      if (len > 0) ofs.write((const char*) d, len * sizeof(float));
+    }
+  }
+  ofs.close();
+}
+
+void fasstSegmentIndex::read(const string& file, int firstTarget, const vector<int>& numRes, int atomsPerRes) {
+  fstream ifs; MstUtils::openFile(ifs, file, fstream::in | fstream::binary, "fasstSegmentIndex::read");
+  string magic; int ver, apr, numLens, L, len;
+  vector<int> fileRes;
+  MstUtils::readBin(ifs, magic);
+  if (magic != "MSTFSIDX") MstUtils::error("'" + file + "' is not a FASST segment index", "fasstSegmentIndex::read");
+  MstUtils::readBin(ifs, ver);
+  if (ver != 1) MstUtils::error("unknown segment index version " + MstUtils::toString(ver) + " in '" + file + "'", "fasstSegmentIndex::read");
+  MstUtils::readBin(ifs, apr);
+  MstUtils::readBin(ifs, fileRes);
+  bool match = (apr == atomsPerRes) && (fileRes.size() <= numRes.size());
+  for (int i = 0; match && (i < fileRes.size()); i++) match = (fileRes[i] == numRes[i]);
+  if (!match) MstUtils::error("segment index '" + file + "' does not match the database it is read for", "fasstSegmentIndex::read");
+  MstUtils::readBin(ifs, numLens);
+  for (int k = 0; k < numLens; k++) {
+    MstUtils::readBin(ifs, L);
+    vector<vector<float> >& byTarget = desc[L];
+    if (byTarget.size() < firstTarget + fileRes.size()) byTarget.resize(firstTarget + fileRes.size());
+    for (int i = 0; i < fileRes.size(); i++) {
+      MstUtils::readBin(ifs, len);
+      vector<float>& d = byTarget[firstTarget + i];
+      d.resize(len);
+      if (len > 0) ifs.read((char*) d.data(), len * sizeof(float));
+    }
+  }
+  if (!ifs) MstUtils::error("segment index '" + file + "' is truncated", "fasstSegmentIndex::read");
+  ifs.close();
+}
+
+template <class T>
+void fasstSegmentIndex::descriptor(const T* coords, int n, mstreal d[3]) {
+  // scatter matrix of the centered points
+  mstreal c[3] = {0, 0, 0}, M[3][3] = {{0, 0, 0}, {0, 0, 0}, {0, 0, 0}};
+  for (int k = 0; k < 3*n; k += 3) {
+    for (int i = 0; i < 3; i++) c[i] += coords[k + i];
+  }
+  for (int i = 0; i < 3; i++) c[i] /= n;
+  for (int k = 0; k < 3*n; k += 3) {
+    mstreal x[3] = {coords[k] - c[0], coords[k + 1] - c[1], coords[k + 2] - c[2]};
+    for (int i = 0; i < 3; i++) {
+      for (int j = i; j < 3; j++) M[i][j] += x[i]*x[j];
+    }
+  }
+
+  // its eigenvalues (closed form for symmetric 3x3 matrices), which are the
+  // squares of the singular values of the centered coordinate matrix
+  mstreal e[3];
+  mstreal p1 = M[0][1]*M[0][1] + M[0][2]*M[0][2] + M[1][2]*M[1][2];
+  mstreal q = (M[0][0] + M[1][1] + M[2][2])/3;
+  mstreal p2 = (M[0][0] - q)*(M[0][0] - q) + (M[1][1] - q)*(M[1][1] - q) + (M[2][2] - q)*(M[2][2] - q) + 2*p1;
+  if (p2 <= 0) {
+    e[0] = e[1] = e[2] = q;
+  } else {
+    mstreal p = sqrt(p2/6);
+    mstreal B[3][3];
+    for (int i = 0; i < 3; i++) {
+      for (int j = i; j < 3; j++) B[i][j] = B[j][i] = (M[i][j] - ((i == j) ? q : 0))/p;
+    }
+    mstreal r = (B[0][0]*(B[1][1]*B[2][2] - B[1][2]*B[2][1]) - B[0][1]*(B[1][0]*B[2][2] - B[1][2]*B[2][0]) + B[0][2]*(B[1][0]*B[2][1] - B[1][1]*B[2][0]))/2;
+    mstreal phi = (r <= -1) ? M_PI/3 : ((r >= 1) ? 0 : acos(r)/3);
+    e[0] = q + 2*p*cos(phi);
+    e[2] = q + 2*p*cos(phi + 2*M_PI/3);
+    e[1] = 3*q - e[0] - e[2];
+  }
+  for (int i = 0; i < 3; i++) d[i] = sqrt(MstUtils::max(e[i], 0.0));
+  if (d[1] > d[0]) swap(d[0], d[1]);
+  if (d[2] > d[1]) swap(d[1], d[2]);
+  if (d[1] > d[0]) swap(d[0], d[1]);
+}
+
+template void fasstSegmentIndex::descriptor<mstreal>(const mstreal* coords, int n, mstreal d[3]);
+
+template <class T>
+void fasstSegmentIndex::windowDescriptors(const T* coords, int numWindows, int n, int step, vector<float>& d) {
+  d.resize(3*MstUtils::max(numWindows, 0));
+  mstreal w[3];
+  for (int j = 0; j < numWindows; j++) {
+    descriptor(coords + 3*j*step, n, w);
+    for (int k = 0; k < 3; k++) d[3*j + k] = w[k];
+  }
+}
+
+mstreal fasstSegmentIndex::residualBound(const mstreal* a, const float* b) {
+  // differences are shrunk by a margin well above the round-off of computing
+  // and storing descriptors, so that the bound stays a bound
+  mstreal bound = 0;
+  for (int i = 0; i < 3; i++) {
+    mstreal del = fabs(a[i] - b[i]) - (10E-5 + 10E-6*(a[i] + b[i]));
+    if (del > 0) bound += del*del;
+  }
+  return bound;
+}
+
+/* --------- fasstSequenceIndex --------- */
+void fasstSequenceIndex::build(const vector<Sequence>& seqs) {
+  targStart.assign(1, 0);
+  codes.clear(); lists.clear();
+  for (int ti = 0; ti < seqs.size(); ti++) {
+    for (int ri = 0; ri < seqs[ti].length(); ri++) {
+      lists[seqs[ti][ri]].push_back(codes.size());
+      codes.push_back(seqs[ti][ri]);
+    }
+    targStart.push_back(codes.size());
+  }
+}
+
+const vector<int>& fasstSequenceIndex::postings(res_t aa) const {
+  static const vector<int> none;
+  auto it = lists.find(aa);
+  return (it == lists.end()) ? none : it->second;
+}
+
+void fasstSequenceIndex::admissibleStarts(const vector<int>& positions, const vector<set<res_t> >& allowed, int L, vector<int>& starts) const {
+  starts.clear();
+  if (positions.empty()) return;
+  // drive by the position whose allowed residues are the rarest
+  int d = 0; long best = -1;
+  for (int k = 0; k < positions.size(); k++) {
+    long n = 0;
+    for (res_t aa : allowed[k]) n += postings(aa).size();
+    if ((best < 0) || (n < best)) { best = n; d = k; }
+  }
+  for (res_t aa : allowed[d]) {
+    for (int off : postings(aa)) {
+      int s = off - positions[d];
+      int ti = targetOf(off);
+      if ((s < targStart[ti]) || (s + L > targStart[ti + 1])) continue;
+      bool ok = true;
+      for (int k = 0; ok && (k < positions.size()); k++) {
+        if (k != d) ok = (allowed[k].find(codes[s + positions[k]]) != allowed[k].end());
+      }
+      if (ok) starts.push_back(s);
+    }
+  }
+  // lists of different residues interleave
+  if (allowed[d].size() > 1) sort(starts.begin(), starts.end());
+}
+
+/* --------- fasstPropertyStore --------- */
+int fasstPropertyStore::propertyID(const string& name) const {
+  auto it = colIdx.find(name);
+  return (it == colIdx.end()) ? -1 : it->second;
+}
+
+int fasstPropertyStore::addProperty(const string& name) {
+  auto it = colIdx.find(name);
+  if (it != colIdx.end()) return it->second;
+  cols.push_back(column());
+  cols.back().name = name;
+  colIdx[name] = cols.size() - 1;
+  return cols.size() - 1;
+}
+
+void fasstPropertyStore::extendColumn(column& c, int ti) {
+  if ((ti < 0) || (ti >= numTargets())) MstUtils::error("target index " + MstUtils::toString(ti) + " out of range", "fasstPropertyStore::extendColumn");
+  if (c.own.size() < numTargets()) {
+    c.own.resize(numTargets(), false);
+    c.ext.resize(numTargets(), NULL);
+  }
+}
+
+void fasstPropertyStore::setValues(int id, int ti, const vector<mstreal>& vals) {
+  column& c = cols[id];
+  extendColumn(c, ti);
+  if (vals.size() != residueSize(ti)) MstUtils::error("expected " + MstUtils::toString(residueSize(ti)) + " values for target " + MstUtils::toString(ti) + ", got " + MstUtils::toString(vals.size()), "fasstPropertyStore::setValues");
+  if (c.vals.size() < resOff[ti + 1]) c.vals.resize(resOff.back(), 0.0);
+  copy(vals.begin(), vals.end(), c.vals.begin() + resOff[ti]);
+  c.own[ti] = true;
+}
+
+void fasstPropertyStore::setExternalValues(int id, int ti, const mstreal* vals) {
+  column& c = cols[id];
+  extendColumn(c, ti);
+  c.ext[ti] = vals;
+}
+
+bool fasstPropertyStore::isPopulated(int id) const {
+  for (int ti = 0; ti < cols[id].own.size(); ti++) {
+    if (values(id, ti) != NULL) return true;
+  }
+  return false;
+}
+
+int fasstPropertyStore::pairPropertyID(const string& name) const {
+  auto it = pairColIdx.find(name);
+  return (it == pairColIdx.end()) ? -1 : it->second;
+}
+
+int fasstPropertyStore::addPairProperty(const string& name) {
+  auto it = pairColIdx.find(name);
+  if (it != pairColIdx.end()) return it->second;
+  pairCols.push_back(pairColumn());
+  pairCols.back().name = name;
+  pairColIdx[name] = pairCols.size() - 1;
+  return pairCols.size() - 1;
+}
+
+void fasstPropertyStore::setPairValues(int id, int ti, const map<int, map<int, mstreal> >& vals) {
+  int L = residueSize(ti);
+  vector<int> rowLen(L, -1), partners;
+  vector<mstreal> pvals;
+  for (auto i = vals.begin(); i != vals.end(); ++i) {
+    if ((i->first < 0) || (i->first >= L)) MstUtils::error("residue index " + MstUtils::toString(i->first) + " out of range for target " + MstUtils::toString(ti), "fasstPropertyStore::setPairValues");
+    rowLen[i->first] = (i->second).size();
+    for (auto j = (i->second).begin(); j != (i->second).end(); ++j) {
+      partners.push_back(j->first);
+      pvals.push_back(j->second);
+    }
+  }
+  setPairValues(id, ti, rowLen, partners, pvals);
+}
+
+void fasstPropertyStore::setPairValues(int id, int ti, const vector<int>& rowLen, const vector<int>& partners, const vector<mstreal>& vals) {
+  if ((ti < 0) || (ti >= numTargets())) MstUtils::error("target index " + MstUtils::toString(ti) + " out of range", "fasstPropertyStore::setPairValues");
+  if (rowLen.size() != residueSize(ti)) MstUtils::error("expected " + MstUtils::toString(residueSize(ti)) + " rows for target " + MstUtils::toString(ti) + ", got " + MstUtils::toString(rowLen.size()), "fasstPropertyStore::setPairValues");
+  if (partners.size() != vals.size()) MstUtils::error("the numbers of partners and values disagree", "fasstPropertyStore::setPairValues");
+  pairColumn& c = pairCols[id];
+  if (c.present.size() < numTargets()) c.present.resize(numTargets(), false);
+  if (c.rowBeg.size() < resOff[ti + 1]) {
+    c.rowBeg.resize(resOff.back(), 0);
+    c.rowLen.resize(resOff.back(), -1);
+  }
+  // rows are appended, so values set for a target more than once leave behind
+  // unused entries (which does not happen in the normal course of things)
+  int64_t beg = c.partners.size(), n = 0;
+  for (int ri = 0; ri < rowLen.size(); ri++) {
+    c.rowBeg[resOff[ti] + ri] = beg + n;
+    c.rowLen[resOff[ti] + ri] = rowLen[ri];
+    n += max(rowLen[ri], 0);
+  }
+  if (n != partners.size()) MstUtils::error("row lengths inconsistent with the number of partners for target " + MstUtils::toString(ti), "fasstPropertyStore::setPairValues");
+  c.partners.insert(c.partners.end(), partners.begin(), partners.end());
+  c.vals.insert(c.vals.end(), vals.begin(), vals.end());
+  c.present[ti] = true;
+}
+
+map<int, map<int, mstreal> > fasstPropertyStore::getPairValues(int id, int ti) const {
+  map<int, map<int, mstreal> > ret;
+  const int* partners; const mstreal* vals;
+  for (int ri = 0; ri < residueSize(ti); ri++) {
+    int n = pairs(id, ti, ri, partners, vals);
+    if (n < 0) continue;
+    map<int, mstreal>& row = ret[ri];
+    for (int k = 0; k < n; k++) row[partners[k]] = vals[k];
+  }
+  return ret;
+}
+
 /* --------- FASST --------- */
+void fasstSearchStats::reset() {
+  scoringTime = placementTime = redundancyTime = mergeTime = 0;
+  targetsSearched = targetsSkipped = windowsScored = windowsKept = nodesVisited = boundPruned = gapPruned = proximityPruned = solutionsFound = redundantRejected = 0;
+  partial = false;
+}
+
+fasstSearchStats& fasstSearchStats::operator+=(const fasstSearchStats& other) {
+  scoringTime += other.scoringTime; placementTime += other.placementTime;
+  redundancyTime += other.redundancyTime; mergeTime += other.mergeTime;
+  targetsSearched += other.targetsSearched; targetsSkipped += other.targetsSkipped; windowsScored += other.windowsScored;
+  windowsKept += other.windowsKept;
+  nodesVisited += other.nodesVisited; boundPruned += other.boundPruned;
+  gapPruned += other.gapPruned; proximityPruned += other.proximityPruned;
+  solutionsFound += other.solutionsFound; redundantRejected += other.redundantRejected;
+  partial = partial || other.partial;
+  return *this;
+}
+
+ostream& operator<<(ostream &_os, const fasstSearchStats& stats) {
+  _os << "segment scoring: " << stats.scoringTime*1000 << " ms (" << stats.windowsScored << " windows in " << stats.targetsSearched << " targets, " << stats.windowsKept << " kept under the cutoff, " << stats.targetsSkipped << " skipped by bound)" << endl;
+  _os << "placement: " << stats.placementTime*1000 << " ms (" << stats.nodesVisited << " nodes visited, " << stats.boundPruned << " rejected by residual bound; "
+      << stats.gapPruned << " options pruned by gap/chain constraints, " << stats.proximityPruned << " by centroid distances)" << endl;
+  _os << "redundancy filtering: " << stats.redundancyTime*1000 << " ms (" << stats.solutionsFound << " solutions found, " << stats.redundantRejected << " rejected as redundant)" << endl;
+  _os << "merging: " << stats.mergeTime*1000 << " ms";
+  if (stats.partial) _os << endl << "search was stopped early (partial results)";
+  return _os;
+}
+
 FASST::FASST() {
   recLevel = 0;
   opts.setRMSDCutoff(1.0);
@@ -196,17 +641,70 @@ FASST::FASST() {
   querySize = 0;
   updateGrids = false;
   gridSpacing = 15.0;
+  db = this;
+  numThreads = 1;
+  shared = NULL;
+  arena = NULL;
+  cacheBudget = cacheBytes = 0;
+  warmCut = -1;
 }
 
 FASST::~FASST() {
-  // need to delete atoms only on the lowest level of recursion, because at
-  // higher levels we point to the same atoms
-  if (targetMasks.size()) targetMasks.back().deletePointers();
   for (int i = 0; i < targetStructs.size(); i++) {
     if (targetStructs[i]) delete targetStructs[i];
     else targets[i].deletePointers();
   }
   for (int i = 0; i < ps.size(); i++) delete ps[i];
+  for (int i = 0; i < mappedDBs.size(); i++) delete mappedDBs[i];
+  if (arena != NULL) arena->release();
+}
+
+void FASST::setTargetCacheBudget(size_t bytes) {
+  lock_guard<mutex> lock(cacheLock);
+  cacheBudget = bytes;
+  while ((cacheBytes > cacheBudget) && !cacheOrder.empty()) {
+    cacheBytes -= structureBytes(*(cacheOrder.back().second));
+    cacheIndex.erase(cacheOrder.back().first);
+    cacheOrder.pop_back();
+  }
+}
+
+size_t FASST::structureBytes(const Structure& S) {
+  return sizeof(Structure) + S.chainSize()*sizeof(Chain) + S.residueSize()*sizeof(Residue) + S.atomSize()*sizeof(Atom);
+}
+
+shared_ptr<Structure> FASST::cachedTarget(int idx) {
+  lock_guard<mutex> lock(cacheLock);
+  auto it = cacheIndex.find(idx);
+  if (it == cacheIndex.end()) return shared_ptr<Structure>();
+  cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second);
+  return it->second->second;
+}
+
+shared_ptr<Structure> FASST::cacheTarget(int idx, const Structure& S) {
+  size_t bytes = structureBytes(S);
+  lock_guard<mutex> lock(cacheLock);
+  if (bytes > cacheBudget) return shared_ptr<Structure>();
+  auto it = cacheIndex.find(idx);
+  if (it != cacheIndex.end()) { // another thread got here first
+    cacheOrder.splice(cacheOrder.begin(), cacheOrder, it->second);
+    return it->second->second;
+  }
+  while (cacheBytes + bytes > cacheBudget) {
+    cacheBytes -= structureBytes(*(cacheOrder.back().second));
+    cacheIndex.erase(cacheOrder.back().first);
+    cacheOrder.pop_back();
+  }
+  cacheOrder.push_front(make_pair(idx, make_shared<Structure>(S)));
+  cacheIndex[idx] = cacheOrder.begin();
+  cacheBytes += bytes;
+  return cacheOrder.front().second;
+}
+
+void FASST::setArenaMode(bool on) {
+  if (on == (arena != NULL)) return;
+  if (on) arena = MstArena::create();
+  else { arena->release(); arena = NULL; }
 }
 
 void FASST::setCurrentRMSDCutoff(mstreal cut, int p) {
@@ -242,6 +740,7 @@ void FASST::resetCurrentRMSDCutoff(int p) {
  * interpreted differently. E.g., only some residue matches (parents of atoms)
  * may be accepted or some of the atoms can be dummy/empty ones. */
 void FASST::setQuery(const string& pdbFile, bool autoSplitChains) {
+  queryView = StructureView();
   queryStruct.reset();
   queryStruct.readPDB(pdbFile);
   if (autoSplitChains) queryStruct = queryStruct.reassignChainsByConnectivity();
@@ -249,19 +748,29 @@ void FASST::setQuery(const string& pdbFile, bool autoSplitChains) {
 }
 
 void FASST::setQuery(const Structure& Q, bool autoSplitChains) {
+  queryView = StructureView();
   queryStruct = Q;
   if (autoSplitChains) queryStruct = queryStruct.reassignChainsByConnectivity();
   processQuery();
 }
 
+void FASST::setQuery(const StructureView& Q, bool autoSplitChains) {
+  if (Q.getParent() == NULL) MstUtils::error("query view has no parent structure", "FASST::setQuery");
+  queryView = autoSplitChains ? Q.reassignChainsByConnectivity() : Q;
+  queryStruct.reset();
+  processQuery();
+}
+
 void FASST::processQuery() {
   querySize = 0;
   // auto-splitting segments by connectivity, but can do differently
-  if (queryStruct.chainSize() == 0) MstUtils::error("query should not be an empty structure", "FASST::processQuery");
-  query.resize(queryStruct.chainSize());
-  for (int i = 0; i < queryStruct.chainSize(); i++) {
+  bool isView = (queryView.getParent() != NULL);
+  int numSegs = isView ? queryView.chainSize() : queryStruct.chainSize();
+  if (numSegs == 0) MstUtils::error("query should not be an empty structure", "FASST::processQuery");
+  query.resize(numSegs);
+  for (int i = 0; i < numSegs; i++) {
     query[i].resize(0);
-    if (!parseChain(queryStruct[i], &(query[i]))) {
+    if (!(isView ? parseResidues(queryView.getChainResidues(i), &(query[i])) : parseChain(queryStruct[i], &(query[i])))) {
       MstUtils::error("could not set query, because some atoms for the specified search type were missing", "FASST::processQuery");
     }
     MstUtils::assertCond(query[i].size() > 0, "query contains empty segment(s)", "FASST::processQuery");
@@ -285,7 +794,7 @@ void FASST::processQuery() {
     CartesianPoint ci = query[L].getGeometricCenter();
     int n = query[L].size();
     C = (C*N + ci*n)/(N + n);
-    centToCentDist[L].resize(n);
+    centToCentDist[L].resize(query.size());
     for (int i = L + 1; i < query.size(); i++) {
       centToCentDist[L][i] = C.distance(query[i].getGeometricCenter());
     }
@@ -301,6 +810,11 @@ void FASST::processQuery() {
       }
     }
   }
+  AtomPointerVector& fullMask = queryMasks.back();
+  queryMaskCoor.resize(3*fullMask.size());
+  for (int i = 0; i < fullMask.size(); i++) {
+    for (int k = 0; k < 3; k++) queryMaskCoor[3*i + k] = (*(fullMask[i]))[k];
+  }
   updateGrids = true;
 
   // set gap constraints structure
@@ -321,13 +835,17 @@ AtomPointerVector FASST::getQuerySearchedAtoms() const {
 }
 
 void FASST::addTarget(const string& pdbFile, short memSave) {
-  Structure* targetStruct = new Structure(pdbFile, "QUIET");
+  Structure* targetStruct = new Structure();
+  targetStruct->setArena(arena);
+  targetStruct->readPDB(pdbFile, "QUIET");
   targetSource.push_back(targetInfo(pdbFile, targetFileType::PDB, 0, memSave));
   addTargetStructure(targetStruct, memSave);
 }
 
 void FASST::addTarget(const Structure& T, short memSave) {
-  Structure* targetStruct = new Structure(T);
+  Structure* targetStruct = new Structure();
+  targetStruct->setArena(arena);
+  *targetStruct = T;
   targetSource.push_back(targetInfo(T.getName(), targetFileType::STRUCTURE, 0, memSave));
   addTargetStructure(targetStruct, memSave);
 }
@@ -336,6 +854,9 @@ void FASST::addTargetStructure(Structure* targetStruct, short memSave) {
   if (memSave == 1) stripSidechains(*targetStruct);
   targetStructs.push_back(targetStruct);
   targets.push_back(AtomPointerVector());
+  targetCoords.push_back(vector<mstcoor>());
+  targetMap.push_back(NULL);
+  targetMapIdx.push_back(-1);
   targSeqs.push_back(Sequence());
   AtomPointerVector& target = targets.back();
   Sequence& seq = targSeqs.back();
@@ -354,42 +875,73 @@ void FASST::addTargetStructure(Structure* targetStruct, short memSave) {
   // update extent for when will be creating proximity search objects
   mstreal _xlo, _ylo, _zlo, _xhi, _yhi, _zhi;
   ProximitySearch::calculateExtent(*targetStruct, _xlo, _ylo, _zlo, _xhi, _yhi, _zhi);
-  if (targetStructs.size() == 1) {
-    xlo = _xlo; ylo = _ylo; zlo = _zlo;
-    xhi = _xhi; yhi = _yhi; zhi = _zhi;
-  } else {
-    xlo = min(xlo, _xlo); ylo = min(ylo, _ylo); zlo = min(zlo, _zlo);
-    xhi = max(xhi, _xhi); yhi = max(yhi, _yhi); zhi = max(zhi, _zhi);
-  }
-  updateGrids = true;
+  expandExtent(_xlo, _ylo, _zlo, _xhi, _yhi, _zhi);
 
   // chain lengths
   tightvector<int> chainLens(targetStruct->chainSize(), 0);
   for (int i = 0; i < chainLens.size(); i++) chainLens[i] = targetStruct->getChain(i).residueSize();
   targetChainLen.push_back(chainLens);
 
-  // make stripped copies of atoms and destroy original target
+  // pack coordinates of searchable atoms (in the common frame) for searching
+  vector<mstcoor>& coords = targetCoords.back();
+  coords.resize(3*target.size());
+  for (int i = 0; i < target.size(); i++) {
+    for (int k = 0; k < 3; k++) coords[3*i + k] = (*(target[i]))[k];
+  }
+
+  // destroy the original target, keeping only the packed coordinates
   if (memSave == 2) {
-    target = target.clone();
-    for (int i = 0; i < target.size(); i++) target[i]->stripInfo();
+    target.clear();
     targetStructs.back() = NULL;
     delete targetStruct;
   }
+  props.addTarget(getTargetResidueSize(targetStructs.size() - 1));
+}
+
+void FASST::expandExtent(mstreal _xlo, mstreal _ylo, mstreal _zlo, mstreal _xhi, mstreal _yhi, mstreal _zhi) {
+  if (targetStructs.size() == 1) {
+    xlo = _xlo; ylo = _ylo; zlo = _zlo;
+    xhi = _xhi; yhi = _yhi; zhi = _zhi;
+  } else {
+    xlo = min(xlo, _xlo); ylo = min(ylo, _ylo); zlo = min(zlo, _zlo);
+    xhi = max(xhi, _xhi); yhi = max(yhi, _yhi); zhi = max(zhi, _zhi);
+  }
+  updateGrids = true;
 }
 
 void FASST::addTargets(const vector<string>& pdbFiles, short memSave) {
-  for (int i = 0; i < pdbFiles.size(); i++) addTarget(pdbFiles[i], memSave);
+  MstProfiler::scope prof("FASST::addTargets");
+  // files are parsed in parallel, a batch at a time, but added in order
+  int batchSize = 16 * max(numThreads, 1);
+  for (int b = 0; b < pdbFiles.size(); b += batchSize) {
+    vector<string> batchFiles(pdbFiles.begin() + b, pdbFiles.begin() + min(b + batchSize, (int) pdbFiles.size()));
+    vector<Structure*> batch = Structure::readMany(batchFiles, numThreads, "QUIET", arena);
+    for (int k = 0; k < batch.size(); k++) {
+      targetSource.push_back(targetInfo(batchFiles[k], targetFileType::PDB, 0, memSave));
+      addTargetStructure(batch[k], memSave);
+    }
+  }
 }
 
 bool FASST::parseChain(const Chain& C, AtomPointerVector* searchable, Sequence* seq) {
+  vector<Residue*> residues(C.residueSize());
+  for (int i = 0; i < C.residueSize(); i++) residues[i] = &(C.getResidue(i));
+  return parseResidues(residues, searchable, seq);
+}
+
+bool FASST::parseResidues(const vector<Residue*>& residues, AtomPointerVector* searchable, Sequence* seq) {
   bool foundAll = true;
-  for (int i = 0; i < C.residueSize(); i++) {
-    Residue& res = C.getResidue(i);
+  vector<vector<int> > typeIDs(searchableAtomTypes.size());
+  for (int k = 0; k < searchableAtomTypes.size(); k++) {
+    for (const string& name : searchableAtomTypes[k]) typeIDs[k].push_back(MstNames::intern(name));
+  }
+  for (int i = 0; i < residues.size(); i++) {
+    Residue& res = *(residues[i]);
     AtomPointerVector bb;
-    for (int k = 0; k < searchableAtomTypes.size(); k++) {
+    for (int k = 0; k < typeIDs.size(); k++) {
       Atom* a = NULL;
-      for (int kk = 0; kk < searchableAtomTypes[k].size(); kk++) {
-        if ((a = res.findAtom(searchableAtomTypes[k][kk], false)) != NULL) break;
+      for (int kk = 0; kk < typeIDs[k].size(); kk++) {
+        if ((a = res.findAtom(typeIDs[k][kk], false)) != NULL) break;
       }
       if (a == NULL) { foundAll = false; break; }
       bb.push_back(a);
@@ -407,20 +959,26 @@ bool FASST::parseChain(const Chain& C, AtomPointerVector* searchable, Sequence*
 
 void FASST::addResidueStringProperties(int ti, const string& propType, const vector<string>& propVals) {
   if ((ti < 0) || (ti >= targetStructs.size())) MstUtils::error("requested target out of range: " + MstUtils::toString(ti), "FASST::addResidueStringProperties");
-  int N = targetStructs[ti]->residueSize();
+  int N = getTargetResidueSize(ti);
   if (N != propVals.size()) MstUtils::error("size of properties vector (" + MstUtils::toString(propVals.size()) + ") inconsistent with number of residues ("+ MstUtils::toString(N) +") for target: " + MstUtils::toString(ti), "FASST::addResidueStringProperties");
   resStringProperties[propType][ti] = propVals;
 }
 
 void FASST::addResidueProperties(int ti, const string& propType, const vector<mstreal>& propVals) {
   if ((ti < 0) || (ti >= targetStructs.size())) MstUtils::error("requested target out of range: " + MstUtils::toString(ti), "FASST::addResidueProperties");
-  int N = targetStructs[ti]->residueSize();
+  int N = getTargetResidueSize(ti);
   if (N != propVals.size()) MstUtils::error("size of properties vector inconsistent with number of residues for target: " + MstUtils::toString(ti), "FASST::addResidueProperties");
-  resProperties[propType][ti] = propVals;
+  props.setValues(props.addProperty(propType), ti, propVals);
 }
 
 void FASST::addResiduePairProperties(int ti, const string& propType, const map<int, map<int, mstreal> >& propVals) {
-  resPairProperties[propType][ti] = propVals;
+  if ((ti < 0) || (ti >= targetStructs.size())) MstUtils::error("requested target out of range: " + MstUtils::toString(ti), "FASST::addResiduePairProperties");
+  props.setPairValues(props.addPairProperty(propType), ti, propVals);
+}
+
+void FASST::addResiduePairProperties(int ti, const string& propType, const vector<int>& rowLen, const vector<int>& partners, const vector<mstreal>& propVals) {
+  if ((ti < 0) || (ti >= targetStructs.size())) MstUtils::error("requested target out of range: " + MstUtils::toString(ti), "FASST::addResiduePairProperties");
+  props.setPairValues(props.addPairProperty(propType), ti, rowLen, partners, propVals);
 }
 
 void FASST::addResidueRelationship(int ti, const string& propType, int ri, int tj, int rj) {
@@ -440,9 +998,12 @@ map<int, vector<FASST::resAddress>> FASST::getResidueRelationships(int ti, const
 }
 
 bool FASST::hasResidueProperty(int ti, const string& propType, int ri) {
-  return ((resProperties.find(propType) != resProperties.end()) &&
-          (resProperties[propType].find(ti) != resProperties[propType].end()) &&
-          (resProperties[propType][ti].size() > ri) && (ri >= 0));
+  return hasResidueProperty(ti, getResiduePropertyID(propType), ri);
+}
+
+bool FASST::hasResidueProperty(int ti, int propID, int ri) const {
+  if ((propID < 0) || (ti < 0) || (ti >= db->props.numTargets())) return false;
+  return (db->props.values(propID, ti) != NULL) && (ri >= 0) && (ri < db->props.residueSize(ti));
 }
 
 bool FASST::hasResidueStringProperty(int ti, const string& propType, int ri) {
@@ -452,7 +1013,11 @@ bool FASST::hasResidueStringProperty(int ti, const string& propType, int ri) {
 }
 
 mstreal FASST::getResidueProperty(int ti, const string& propType, int ri) {
-  return hasResidueProperty(ti, propType, ri) ? resProperties[propType][ti][ri] : 0.0;
+  return getResidueProperty(ti, getResiduePropertyID(propType), ri);
+}
+
+mstreal FASST::getResidueProperty(int ti, int propID, int ri) const {
+  return hasResidueProperty(ti, propID, ri) ? db->props.values(propID, ti)[ri] : 0.0;
 }
 
 string FASST::getResidueStringProperty(int ti, const string& propType, int ri) {
@@ -460,13 +1025,12 @@ string FASST::getResidueStringProperty(int ti, const string& propType, int ri) {
 }
 
 bool FASST::hasResiduePairProperties(int ti, const string& propType, int ri) {
-  return ((resPairProperties.find(propType) != resPairProperties.end()) &&
-          (resPairProperties[propType].find(ti) != resPairProperties[propType].end()) &&
-          (resPairProperties[propType][ti].find(ri) != resPairProperties[propType][ti].end()));
+  const int* partners; const mstreal* vals;
+  return getResiduePairProperties(ti, getResiduePairPropertyID(propType), ri, partners, vals) >= 0;
 }
 
 mstreal FASST::isResiduePairPropertyPopulated(const string& propType) {
-  return (resPairProperties.find(propType) != resPairProperties.end());
+  return (getResiduePairPropertyID(propType) >= 0);
 }
 
 mstreal FASST::isResidueRelationshipPopulated(const string& propType) {
@@ -474,25 +1038,25 @@ mstreal FASST::isResidueRelationshipPopulated(const string& propType) {
 }
 
 map<int, mstreal> FASST::getResiduePairProperties(int ti, const string& propType, int ri) {
-  return hasResiduePairProperties(ti, propType, ri) ? resPairProperties[propType][ti][ri] : map<int, mstreal>();
+  const int* partners; const mstreal* vals;
+  int n = getResiduePairProperties(ti, getResiduePairPropertyID(propType), ri, partners, vals);
+  map<int, mstreal> ret;
+  for (int k = 0; k < n; k++) ret[partners[k]] = vals[k];
+  return ret;
+}
+
+int FASST::getResiduePairProperties(int ti, int propID, int ri, const int*& partners, const mstreal*& vals) const {
+  if ((propID < 0) || (ti < 0) || (ti >= db->props.numTargets())) return -1;
+  return db->props.pairs(propID, ti, ri, partners, vals);
 }
 
 void FASST::writeDatabase(const string& dbFile) {
   fstream ofs; MstUtils::openFile(ofs, dbFile, fstream::out | fstream::binary, "FASST::writeDatabase");
-  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 1); // format version
+  MstUtils::writeBin(ofs, 'V'); MstUtils::writeBin(ofs, (int) 2); // format version
   for (int ti = 0; ti < targetStructs.size(); ti++) {
     if (targetStructs[ti] == NULL) MstUtils::error("cannot write a database, in which full structures are not populated", "FASST::writeDatabase");
     MstUtils::writeBin(ofs, 'S'); // marks the start of a structure section
     targetStructs[ti]->writeData(ofs);
-    for (auto p = resProperties.begin(); p != resProperties.end(); ++p) {
-      if ((p->second).find(ti) != (p->second).end()) {
-        vector<mstreal>& vals = (p->second)[ti];
-        MstUtils::writeBin(ofs, 'P'); // marks the start of a residue property section
-        MstUtils::writeBin(ofs, (string) p->first);
-        MstUtils::assertCond(targetStructs[ti]->residueSize() == vals.size(), "the number of residue properties and residues does not agree for database entry", "FASST::writeDatabase(const string&)");
-        for (int ri = 0; ri < vals.size(); ri++) MstUtils::writeBin(ofs, vals[ri]);
-      }
-    }
     for (auto p = resStringProperties.begin(); p != resStringProperties.end(); ++p) {
       if ((p->second).find(ti) != (p->second).end()) {
         vector<string>& vals = (p->second)[ti];
@@ -502,21 +1066,49 @@ void FASST::writeDatabase(const string& dbFile) {
         for (int ri = 0; ri < vals.size(); ri++) MstUtils::writeBin(ofs, vals[ri]);
       }
     }
-    for (auto p = resPairProperties.begin(); p != resPairProperties.end(); ++p) {
-      if ((p->second).find(ti) != (p->second).end()) {
-        map<int, map<int, mstreal> >& vals = (p->second)[ti];
-        MstUtils::writeBin(ofs, 'I'); // marks the start of a residue pair interaction property section
-        MstUtils::writeBin(ofs, (string) p->first);
-        MstUtils::writeBin(ofs, (int) vals.size());
-        for (auto i = vals.begin(); i != vals.end(); ++i) {
-          MstUtils::writeBin(ofs, (int) i->first);
-          MstUtils::writeBin(ofs, (int) (i->second).size());
-          for (auto j = (i->second).begin(); j != (i->second).end(); ++j) {
-            MstUtils::writeBin(ofs, (int) j->first);
-            MstUtils::writeBin(ofs, (mstreal) j->second);
-          }
-        }
+  }
+
+  // since version 2, real-valued residue and residue-pair properties are
+  // written by property at the end, each in the columnar form it is kept in
+  for (int id = 0; id < props.numProperties(); id++) {
+    vector<int> targs;
+    for (int ti = 0; ti < numTargets(); ti++) {
+      if (props.values(id, ti) != NULL) targs.push_back(ti);
+    }
+    if (targs.empty()) continue;
+    MstUtils::writeBin(ofs, 'C'); // marks the start of a residue property column section
+    MstUtils::writeBin(ofs, props.propertyName(id));
+    MstUtils::writeBin(ofs, (int) targs.size());
+    for (int i = 0; i < targs.size(); i++) {
+      int ti = targs[i];
+      MstUtils::assertCond(targetStructs[ti]->residueSize() == props.residueSize(ti), "the number of residue properties and residues does not agree for database entry", "FASST::writeDatabase(const string&)");
+      const mstreal* vals = props.values(id, ti);
+      MstUtils::writeBin(ofs, ti);
+      MstUtils::writeBin(ofs, vector<mstreal>(vals, vals + props.residueSize(ti)));
+    }
+  }
+  for (int id = 0; id < props.numPairProperties(); id++) {
+    vector<int> targs;
+    for (int ti = 0; ti < numTargets(); ti++) {
+      if (props.hasPairValues(id, ti)) targs.push_back(ti);
+    }
+    MstUtils::writeBin(ofs, 'J'); // marks the start of a residue pair property section, in CSR form
+    MstUtils::writeBin(ofs, props.pairPropertyName(id));
+    MstUtils::writeBin(ofs, (int) targs.size());
+    for (int i = 0; i < targs.size(); i++) {
+      int ti = targs[i];
+      vector<int> rowLen(props.residueSize(ti)), partners;
+      vector<mstreal> vals;
+      const int* p; const mstreal* v;
+      for (int ri = 0; ri < rowLen.size(); ri++) {
+        rowLen[ri] = props.pairs(id, ti, ri, p, v);
+        partners.insert(partners.end(), p, p + max(rowLen[ri], 0));
+        vals.insert(vals.end(), v, v + max(rowLen[ri], 0));
       }
+      MstUtils::writeBin(ofs, ti);
+      MstUtils::writeBin(ofs, rowLen);
+      MstUtils::writeBin(ofs, partners);
+      MstUtils::writeBin(ofs, vals);
     }
   }
 
@@ -541,10 +1133,12 @@ void FASST::writeDatabase(const string& dbFile) {
 }
 
 void FASST::readDatabase(const string& dbFile, short memSave) {
+  MstProfiler::scope prof("FASST::readDatabase");
+  if (fasstMappedDB::isMappedDatabase(dbFile)) { mapDatabase(dbFile); return; }
   fstream ifs; MstUtils::openFile(ifs, dbFile, fstream::in | fstream::binary, "FASST::readDatabase");
   char sect; string name; mstreal val; string sval;
   int ver = 0;
-  int ti = numTargets();
+  int ti = numTargets(), ti0 = ti;
   MstUtils::readBin(ifs, sect);
   if (sect == 'V') {
     MstUtils::readBin(ifs, ver);
@@ -553,6 +1147,7 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
   if (sect != 'S') MstUtils::error("first section must be a structure one, while reading database file " + dbFile, "FASST::readDatabase(const string&)");
   while (ifs.peek() != EOF) {
     Structure* targetStruct = new Structure();
+    targetStruct->setArena(arena);
     streampos loc = ifs.tellg();
     targetStruct->readData(ifs);
     targetSource.push_back(targetInfo(dbFile, targetFileType::BINDATABASE, loc, memSave));
@@ -562,12 +1157,12 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
       MstUtils::readBin(ifs, sect);
       if (sect == 'P') {
         MstUtils::readBin(ifs, name);
-        vector<mstreal>& vals = resProperties[name][ti];
-        vals.resize(L, 0);
+        vector<mstreal> vals(L, 0);
         for (int i = 0; i < L; i++) {
           MstUtils::readBin(ifs, val);
           vals[i] = val;
         }
+        props.setValues(props.addProperty(name), ti, vals);
       } else if (sect == 'N') {
         MstUtils::readBin(ifs, name);
         vector<string>& vals = resStringProperties[name][ti];
@@ -578,7 +1173,7 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
         }
       } else if (sect == 'I') {
         MstUtils::readBin(ifs, name);
-        map<int, map<int, mstreal> >& vals = resPairProperties[name][ti];
+        map<int, map<int, mstreal> > vals;
         int ri, rj, N, n; mstreal cd;
         MstUtils::readBin(ifs, N);
         for (int i = 0; i < N; i++) {
@@ -590,6 +1185,32 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
             vals[ri][rj] = cd;
           }
         }
+        props.setPairValues(props.addPairProperty(name), ti, vals);
+      } else if (sect == 'C') {
+        // property columns, which come after all structures (target indices
+        // in the file are relative to the first target of the file)
+        MstUtils::readBin(ifs, name);
+        int id = props.addProperty(name), N, tj;
+        vector<mstreal> vals;
+        MstUtils::readBin(ifs, N);
+        for (int i = 0; i < N; i++) {
+          MstUtils::readBin(ifs, tj);
+          MstUtils::readBin(ifs, vals);
+          props.setValues(id, ti0 + tj, vals);
+        }
+      } else if (sect == 'J') {
+        MstUtils::readBin(ifs, name);
+        int id = props.addPairProperty(name), N, tj;
+        vector<int> rowLen, partners;
+        vector<mstreal> vals;
+        MstUtils::readBin(ifs, N);
+        for (int i = 0; i < N; i++) {
+          MstUtils::readBin(ifs, tj);
+          MstUtils::readBin(ifs, rowLen);
+          MstUtils::readBin(ifs, partners);
+          MstUtils::readBin(ifs, vals);
+          props.setPairValues(id, ti0 + tj, rowLen, partners, vals);
+        }
       } else if (sect == 'R') {
         MstUtils::readBin(ifs, name);
         simpleMap<resAddress, tightvector<resAddress>>& resRelProperty = resRelProperties[name];
@@ -614,7 +1235,8 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
             }
             break;
           }
-          case 1: {
+          case 1:
+          case 2: {
             // in the new version, we read them all at once
             resAddress ri, rj; int N, n;
             MstUtils::readBin(ifs, N);
@@ -645,6 +1267,313 @@ void FASST::readDatabase(const string& dbFile, short memSave) {
     ti++;
   }
   ifs.close();
+  struct stat st;
+  if (stat(segmentIndexFile(dbFile).c_str(), &st) == 0) readSegmentIndex(dbFile, ti0); // load the segment index kept alongside, if any
+}
+
+void FASST::writeMappedDatabase(const string& dbFile) {
+  typedef fasstMappedDB::header header;
+  typedef fasstMappedDB::targetEntry targetEntry;
+  typedef fasstMappedDB::propertyEntry propertyEntry;
+  auto align = [](int64_t off, int64_t a) { return ((off + a - 1) / a) * a; };
+  int N = numTargets();
+
+  // target table, chain lengths and names
+  vector<targetEntry> entries(N);
+  vector<int32_t> chainLens;
+  string nameBlob;
+  int64_t numRes = 0;
+  for (int ti = 0; ti < N; ti++) {
+    targetEntry& e = entries[ti];
+    memset(&e, 0, sizeof(e));
+    int L = atomToResIdx(searchableAtomSize(ti));
+    if (L != getTargetResidueSize(ti)) MstUtils::error("target " + MstUtils::toString(ti) + " has residues that are not searchable, so it cannot be written to a mapped database", "FASST::writeMappedDatabase");
+    e.resOff = numRes; e.numRes = L;
+    e.chainOff = chainLens.size(); e.numChains = targetChainLen[ti].size();
+    for (int ci = 0; ci < targetChainLen[ti].size(); ci++) chainLens.push_back(targetChainLen[ti][ci]);
+    e.nameOff = nameBlob.size();
+    nameBlob += targSeqs[ti].getName(); nameBlob.push_back('\0');
+    for (int k = 0; k < 3; k++) e.trans[k] = tr[ti](k, 3);
+    numRes += L;
+  }
+
+  // real-valued residue properties from both the in-memory and mapped targets
+  set<string> propNames;
+  for (int id = 0; id < props.numProperties(); id++) {
+    if (props.isPopulated(id)) propNames.insert(props.propertyName(id));
+  }
+  vector<string> propList(propNames.begin(), propNames.end());
+  vector<propertyEntry> propEntries(propList.size());
+  for (int k = 0; k < propList.size(); k++) {
+    propEntries[k].nameOff = nameBlob.size();
+    nameBlob += propList[k]; nameBlob.push_back('\0');
+  }
+
+  // lay out the file
+  header hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  strncpy(hdr.magic, fasstMappedDB::magicString(), sizeof(hdr.magic));
+  hdr.version = fasstMappedDB::currentVersion;
+  hdr.atomsPerRes = atomsPerRes;
+  hdr.numTargets = N; hdr.numChains = chainLens.size(); hdr.numResidues = numRes; hdr.numProps = propList.size();
+  hdr.targOff = align(sizeof(header), 64);
+  hdr.chainOff = align(hdr.targOff + N * sizeof(targetEntry), 8);
+  hdr.coordOff = align(hdr.chainOff + chainLens.size() * sizeof(int32_t), 64);
+  hdr.seqOff = align(hdr.coordOff + numRes * atomsPerRes * 3 * sizeof(float), 8);
+  hdr.nameOff = align(hdr.seqOff + numRes * sizeof(res_t), 8);
+  hdr.propOff = align(hdr.nameOff + nameBlob.size(), 8);
+  int64_t off = hdr.propOff + propList.size() * sizeof(propertyEntry);
+  for (int k = 0; k < propList.size(); k++) {
+    propEntries[k].presentOff = off; off = align(off + N, 8);
+    propEntries[k].valuesOff = off; off += numRes * sizeof(double);
+  }
+  hdr.extraOff = off;
+
+  fstream ofs; MstUtils::openFile(ofs, dbFile, fstream::out | fstream::binary, "FASST::writeMappedDatabase");
+  auto pad = [&ofs](int64_t to) { while (ofs.tellp() < to) ofs.put(0); };
+  ofs.write((const char*) &hdr, sizeof(hdr));
+
+  // coordinates go after the target table, but the table holds their extents,
+  // so write coordinates first and come back for the table
+  pad(hdr.coordOff);
+  vector<float> buf;
+  for (int ti = 0; ti < N; ti++) {
+    targetEntry& e = entries[ti];
+    int n = searchableAtomSize(ti);
+    const float* mapped = mappedCoordinates(ti);
+    buf.resize(3*n);
+    for (int ai = 0; ai < n; ai++) {
+      for (int k = 0; k < 3; k++) {
+        buf[3*ai + k] = (mapped == NULL) ? targetCoords[ti][3*ai + k] : mapped[3*ai + k];
+        if ((ai == 0) || (buf[3*ai + k] < e.lo[k])) e.lo[k] = buf[3*ai + k];
+        if ((ai == 0) || (buf[3*ai + k] > e.hi[k])) e.hi[k] = buf[3*ai + k];
+      }
+    }
+    ofs.write((const char*) buf.data(), buf.size() * sizeof(float));
+  }
+  pad(hdr.seqOff);
+  for (int ti = 0; ti < N; ti++) {
+    const Sequence& seq = targSeqs[ti];
+    for (int ri = 0; ri < seq.size(); ri++) { res_t aa = seq[ri]; ofs.write((const char*) &aa, sizeof(res_t)); }
+  }
+  pad(hdr.nameOff);
+  ofs.write(nameBlob.data(), nameBlob.size());
+  pad(hdr.propOff);
+  ofs.write((const char*) propEntries.data(), propEntries.size() * sizeof(propertyEntry));
+  for (int k = 0; k < propList.size(); k++) {
+    vector<uint8_t> present(N, 0);
+    vector<double> vals(numRes, 0.0);
+    int id = props.propertyID(propList[k]);
+    for (int ti = 0; ti < N; ti++) {
+      const mstreal* tvals = props.values(id, ti);
+      if (tvals == NULL) continue;
+      present[ti] = 1;
+      for (int ri = 0; ri < entries[ti].numRes; ri++) vals[entries[ti].resOff + ri] = tvals[ri];
+    }
+    pad(propEntries[k].presentOff);
+    ofs.write((const char*) present.data(), N);
+    pad(propEntries[k].valuesOff);
+    ofs.write((const char*) vals.data(), numRes * sizeof(double));
+  }
+
+  // irregular properties, in the stream format
+  pad(hdr.extraOff);
+  for (auto p = resStringProperties.begin(); p != resStringProperties.end(); ++p) {
+    for (auto t = (p->second).begin(); t != (p->second).end(); ++t) {
+      MstUtils::writeBin(ofs, 'N');
+      MstUtils::writeBin(ofs, (string) p->first);
+      MstUtils::writeBin(ofs, (int) t->first);
+      MstUtils::writeBin(ofs, (int) (t->second).size());
+      for (int ri = 0; ri < (t->second).size(); ri++) MstUtils::writeBin(ofs, (t->second)[ri]);
+    }
+  }
+  for (int id = 0; id < props.numPairProperties(); id++) {
+    for (int ti = 0; ti < N; ti++) {
+      if (!props.hasPairValues(id, ti)) continue;
+      map<int, map<int, mstreal> > vals = props.getPairValues(id, ti);
+      MstUtils::writeBin(ofs, 'I');
+      MstUtils::writeBin(ofs, props.pairPropertyName(id));
+      MstUtils::writeBin(ofs, ti);
+      MstUtils::writeBin(ofs, (int) vals.size());
+      for (auto i = vals.begin(); i != vals.end(); ++i) {
+        MstUtils::writeBin(ofs, (int) i->first);
+        MstUtils::writeBin(ofs, (int) (i->second).size());
+        for (auto j = (i->second).begin(); j != (i->second).end(); ++j) {
+          MstUtils::writeBin(ofs, (int) j->first);
+          MstUtils::writeBin(ofs, (mstreal) j->second);
+        }
+      }
+    }
+  }
+  for (auto p = resRelProperties.begin(); p != resRelProperties.end(); ++p) {
+    simpleMap<resAddress, tightvector<resAddress>>& resRelProperty = p->second;
+    MstUtils::writeBin(ofs, 'R');
+    MstUtils::writeBin(ofs, (string) p->first);
+    MstUtils::writeBin(ofs, (int) resRelProperty.size());
+    for (int i = 0; i < resRelProperty.size(); i++) {
+      MstUtils::writeBin(ofs, resRelProperty.key(i).targIndex());
+      MstUtils::writeBin(ofs, resRelProperty.key(i).resIndex());
+      tightvector<resAddress>& relatedList = resRelProperty.value(i);
+      MstUtils::writeBin(ofs, (int) relatedList.size());
+      for (int j = 0; j < relatedList.size(); j++) {
+        MstUtils::writeBin(ofs, relatedList[j].targIndex());
+        MstUtils::writeBin(ofs, relatedList[j].resIndex());
+      }
+    }
+  }
+  hdr.fileSize = ofs.tellp();
+
+  // now that everything is known, fill in the header and the target table
+  ofs.seekp(0);
+  ofs.write((const char*) &hdr, sizeof(hdr));
+  ofs.seekp(hdr.targOff);
+  ofs.write((const char*) entries.data(), entries.size() * sizeof(targetEntry));
+  ofs.seekp(hdr.chainOff);
+  ofs.write((const char*) chainLens.data(), chainLens.size() * sizeof(int32_t));
+  ofs.close();
+}
+
+void FASST::mapDatabase(const string& dbFile) {
+  fasstMappedDB* mdb = new fasstMappedDB(dbFile);
+  if (mdb->atomsPerResidue() != atomsPerRes) {
+    delete mdb;
+    MstUtils::error("mapped database '" + dbFile + "' was written for a different search type", "FASST::mapDatabase");
+  }
+  mappedDBs.push_back(mdb);
+  int ti0 = numTargets();
+  for (int i = 0; i < mdb->numTargets(); i++) {
+    targetStructs.push_back(NULL);
+    targets.push_back(AtomPointerVector());
+    targetCoords.push_back(vector<mstcoor>());
+    targetMap.push_back(mdb);
+    targetMapIdx.push_back(i);
+    const res_t* seq = mdb->sequence(i);
+    targSeqs.push_back(Sequence(vector<res_t>(seq, seq + mdb->residueSize(i)), mdb->targetName(i)));
+    targetSource.push_back(targetInfo(dbFile, targetFileType::MAPPEDDATABASE, i, 2));
+    tightvector<int> chainLens(mdb->chainSize(i), 0);
+    for (int ci = 0; ci < chainLens.size(); ci++) chainLens[ci] = mdb->chainLength(i, ci);
+    targetChainLen.push_back(chainLens);
+    mstreal x, y, z;
+    mdb->targetTranslation(i, x, y, z);
+    tr.push_back(TransformFactory::translate(x, y, z));
+    mstreal _xlo, _ylo, _zlo, _xhi, _yhi, _zhi;
+    mdb->targetExtent(i, _xlo, _ylo, _zlo, _xhi, _yhi, _zhi);
+    expandExtent(_xlo, _ylo, _zlo, _xhi, _yhi, _zhi);
+    props.addTarget(mdb->residueSize(i));
+  }
+
+  // real-valued residue properties are read in place
+  for (int k = 0; k < mdb->numProperties(); k++) {
+    int id = props.addProperty(mdb->propertyName(k));
+    for (int i = 0; i < mdb->numTargets(); i++) {
+      const double* vals = mdb->propertyValues(k, i);
+      if (vals != NULL) props.setExternalValues(id, ti0 + i, vals);
+    }
+  }
+
+  // irregular properties are read into memory, with target indices offset by
+  // the number of targets that were already present
+  fstream ifs; MstUtils::openFile(ifs, dbFile, fstream::in | fstream::binary, "FASST::mapDatabase");
+  ifs.seekg(mdb->extraSectionOffset());
+  char sect; string name; int ti, N, n;
+  while (ifs.peek() != EOF) {
+    MstUtils::readBin(ifs, sect);
+    MstUtils::readBin(ifs, name);
+    if (sect == 'N') {
+      MstUtils::readBin(ifs, ti);
+      MstUtils::readBin(ifs, N);
+      vector<string>& vals = resStringProperties[name][ti0 + ti];
+      vals.resize(N);
+      for (int i = 0; i < N; i++) MstUtils::readBin(ifs, vals[i]);
+    } else if (sect == 'I') {
+      MstUtils::readBin(ifs, ti);
+      map<int, map<int, mstreal> > vals;
+      int ri, rj; mstreal cd;
+      MstUtils::readBin(ifs, N);
+      for (int i = 0; i < N; i++) {
+        MstUtils::readBin(ifs, ri);
+        MstUtils::readBin(ifs, n);
+        for (int j = 0; j < n; j++) {
+          MstUtils::readBin(ifs, rj);
+          MstUtils::readBin(ifs, cd);
+          vals[ri][rj] = cd;
+        }
+      }
+      props.setPairValues(props.addPairProperty(name), ti0 + ti, vals);
+    } else if (sect == 'R') {
+      simpleMap<resAddress, tightvector<resAddress>>& resRelProperty = resRelProperties[name];
+      resAddress ri, rj;
+      MstUtils::readBin(ifs, N);
+      for (int i = 0; i < N; i++) {
+        MstUtils::readBin(ifs, ri.targIndex());
+        MstUtils::readBin(ifs, ri.resIndex());
+        tightvector<resAddress>& relatedList = resRelProperty[resAddress(ti0 + ri.targIndex(), ri.resIndex())];
+        MstUtils::readBin(ifs, n);
+        int off = relatedList.size();
+        relatedList.resize(off + n);
+        for (int j = 0; j < n; j++) {
+          MstUtils::readBin(ifs, rj.targIndex());
+          MstUtils::readBin(ifs, rj.resIndex());
+          relatedList[off + j] = resAddress(ti0 + rj.targIndex(), rj.resIndex());
+        }
+      }
+    } else {
+      MstUtils::error("unknown section type " + MstUtils::toString(sect) + ", while reading mapped database file " + dbFile, "FASST::mapDatabase");
+    }
+  }
+  ifs.close();
+  struct stat st;
+  if (stat(segmentIndexFile(dbFile).c_str(), &st) == 0) readSegmentIndex(dbFile, ti0); // load the segment index kept alongside, if any
+}
+
+void FASST::buildSegmentIndex(const vector<int>& lengths) {
+  for (int ti = 0; ti < numTargets(); ti++) {
+    const float* mapped = mappedCoordinates(ti);
+    int numRes = atomToResIdx(searchableAtomSize(ti));
+    for (int k = 0; k < lengths.size(); k++) {
+      int L = lengths[k];
+      if (L <= 0) MstUtils::error("segment lengths must be positive", "FASST::buildSegmentIndex");
+      vector<float> d;
+      if (mapped == NULL) fasstSegmentIndex::windowDescriptors(targetCoords[ti].data(), numRes - L + 1, resToAtomIdx(L), atomsPerRes, d);
+      else fasstSegmentIndex::windowDescriptors(mapped, numRes - L + 1, resToAtomIdx(L), atomsPerRes, d);
+      segIndex.setDescriptors(L, ti, d);
+    }
+  }
+}
+
+void FASST::writeSegmentIndex(const string& dbFile) {
+  vector<int> numRes(numTargets());
+  for (int ti = 0; ti < numTargets(); ti++) numRes[ti] = atomToResIdx(searchableAtomSize(ti));
+  segIndex.write(segmentIndexFile(dbFile), 0, numTargets(), numRes, atomsPerRes);
+}
+
+void FASST::readSegmentIndex(const string& dbFile, int firstTarget) {
+  vector<int> numRes;
+  for (int ti = firstTarget; ti < numTargets(); ti++) numRes.push_back(atomToResIdx(searchableAtomSize(ti)));
+  segIndex.read(segmentIndexFile(dbFile), firstTarget, numRes, atomsPerRes);
+}
+
+Structure FASST::mappedTargetStructure(int ti) {
+  fasstMappedDB* mdb = targetMap[ti];
+  int mi = targetMapIdx[ti];
+  const float* c = mdb->coordinates(mi);
+  const res_t* seq = mdb->sequence(mi);
+  Structure S;
+  S.setName(mdb->targetName(mi));
+  int ri = 0, ai = 0;
+  for (int ci = 0; ci < mdb->chainSize(mi); ci++) {
+    Chain* C = new Chain("A", "");
+    S.appendChain(C);
+    for (int i = 0; i < mdb->chainLength(mi, ci); i++, ri++) {
+      Residue* res = new Residue(SeqTools::idxToTriple(seq[ri]), ri + 1);
+      for (int k = 0; k < atomsPerRes; k++, ai++, c += 3) {
+        res->appendAtom(new Atom(ai + 1, searchableAtomTypes[k][0], c[0], c[1], c[2], 0, 1, false));
+      }
+      C->appendResidue(res);
+    }
+  }
+  tr[ti].inverse().apply(S);
+  return S;
 }
 
 void FASST::setSearchType(searchType _searchType) {
@@ -669,6 +1598,7 @@ void FASST::stripSidechains(Structure& S) {
 }
 
 void FASST::rebuildProximityGrids() {
+  mstreal xlo = db->xlo, ylo = db->ylo, zlo = db->zlo, xhi = db->xhi, yhi = db->yhi, zhi = db->zhi;
   if (xlo == xhi) { xlo -= gridSpacing/2; xhi += gridSpacing/2; }
   if (ylo == yhi) { ylo -= gridSpacing/2; yhi += gridSpacing/2; }
   if (zlo == zhi) { zlo -= gridSpacing/2; zhi += gridSpacing/2; }
@@ -681,10 +1611,29 @@ void FASST::rebuildProximityGrids() {
   updateGrids = false;
 }
 
+template <class T>
+void FASST::scoreSegmentAlignments(int i, const T* coords, int Na, const vector<bool>& okAlignments) {
+  bool seqConst = !okAlignments.empty();
+  int n = query[i].size();
+  const mstreal* seg = queryMaskCoor.data() + 3*(queryMasks[i].size() - n); // segment i in the packed query
+  if (Na <= 0) return;
+  // all windows at once, with centroids slid from one alignment to the next
+  vector<mstreal> cents;
+  RC.windowResiduals(seg, n, coords, Na, atomsPerRes, segmentResiduals[i], (query.size() > 1) ? &cents : NULL, seqConst ? &okAlignments : NULL);
+  if (query.size() > 1) {
+    for (int j = 0; j < Na; j++) {
+      // disallowed alignments get a dummy point, so point indexing is preserved
+      if (seqConst && !okAlignments[j]) ps[i]->addPoint(0, 0, 0, j);
+      else ps[i]->addPoint(cents[3*j], cents[3*j + 1], cents[3*j + 2], j);
+    }
+  }
+}
+
 void FASST::prepForSearch(int ti) {
   recLevel = 0;
-  AtomPointerVector& target = targets[ti];
-  if ((query.size() == 0) || (target.size() == 0)) {
+  const float* mapped = db->mappedCoordinates(ti);
+  int targAtoms = db->searchableAtomSize(ti);
+  if ((query.size() == 0) || (targAtoms == 0)) {
     MstUtils::error("query and target must be set before starting search", "FASST::prepForSearch");
   }
 
@@ -692,40 +1641,40 @@ void FASST::prepForSearch(int ti) {
   if (updateGrids) rebuildProximityGrids();
 
   // align every segment onto every admissible location on the target
-  mstreal xc, yc, zc;
   segmentResiduals.resize(query.size());
   vector<vector<bool> > okAlignments(query.size());
   for (int i = 0; i < query.size(); i++) {
     bool seqConst = options().sequenceConstraintsSet() && options().getSequenceConstraints()->isSegmentConstrained(qSegOrd[i]);
     ps[i]->dropAllPoints();
     AtomPointerVector& seg = query[i];
-    int Na = atomToResIdx(target.size()) - atomToResIdx(seg.size()) + 1; // number of possible alignments
+    int Na = atomToResIdx(targAtoms) - atomToResIdx(seg.size()) + 1; // number of possible alignments
     // make the default bad, so alignments skipped due to sequence constraints
     // get sorted to the bottom of the options list before they are removed
     segmentResiduals[i].resize(MstUtils::max(Na, 0), 9999.0);
-    if (seqConst) {
+    if (seqConst && seqStarts && seqIndexed[i]) {
+      // admissible alignments were looked up in the sequence index
+      okAlignments[i].assign(segmentResiduals[i].size(), false);
+      const vector<int>& st = (*seqStarts)[i];
+      int off = db->seqIndex.residueOffset(ti);
+      for (auto it = lower_bound(st.begin(), st.end(), off); (it != st.end()) && (*it - off < Na); ++it) okAlignments[i][*it - off] = true;
+    } else if (seqConst) {
       okAlignments[i].resize(segmentResiduals[i].size());
-      options().getSequenceConstraints()->evalConstraint(qSegOrd[i], targSeqs[ti], okAlignments[i]);
+      options().getSequenceConstraints()->evalConstraint(qSegOrd[i], db->targSeqs[ti], okAlignments[i]);
     }
-    AtomPointerVector targSeg(query[i].size(), NULL);
-    for (int j = 0; j < Na; j++) {
-      if (seqConst && !okAlignments[i][j]) { // save on calculating RMSDs for disallowed segment alignments
-        if (query.size() > 1) ps[i]->addPoint(0, 0, 0, j); // add a dummy point, so point indexing is preserved
-        continue;
-      }
-      // NOTE: can save on this in several ways:
-      // 1. the centroid calculation is effectively already done inside RMSDCalculator::bestRMSD
-      // 2. updating just one atom involves a simple centroid adjustment, rather than recalculation
-      // 3. is there a speedup to be gained from re-calculating RMSD with one atom updated only?
-      int off = resToAtomIdx(j);
-      for (int k = 0; k < query[i].size(); k++) targSeg[k] = target[off + k];
-      // AtomPointerVector targSeg = target.subvector(resToAtomIdx(j), resToAtomIdx(j) + query[i].size());
-      segmentResiduals[i][j] = RC.bestResidual(query[i], targSeg);
-      if (query.size() > 1) {
-        targSeg.getGeometricCenter(xc, yc, zc);
-        ps[i]->addPoint(xc, yc, zc, j);
+    // with a segment index, disallow alignments whose descriptors already
+    // imply a residual above the cutoff (a segment's residual can only grow
+    // when superimposed jointly with the other segments)
+    const float* desc = qSegDesc.empty() ? NULL : db->segIndex.descriptors(segLen[i], ti);
+    if ((desc != NULL) && (residualCut < INFINITY)) {
+      if (!seqConst) okAlignments[i].assign(segmentResiduals[i].size(), true);
+      for (int j = 0; j < Na; j++) {
+        if (okAlignments[i][j] && (fasstSegmentIndex::residualBound(&(qSegDesc[3*i]), desc + 3*j) > residualCut)) okAlignments[i][j] = false;
       }
     }
+    if (okAlignments[i].empty()) stats.windowsScored += MstUtils::max(Na, 0);
+    else stats.windowsScored += count(okAlignments[i].begin(), okAlignments[i].end(), true);
+    if (mapped == NULL) scoreSegmentAlignments(i, db->targetCoords[ti].data(), Na, okAlignments[i]);
+    else scoreSegmentAlignments(i, mapped, Na, okAlignments[i]);
   }
 
   // initialize remOptions; all options are available at top level
@@ -736,9 +1685,12 @@ void FASST::prepForSearch(int ti) {
       // remOptions[L][i], where i < L, will hold an empty list of options, but
       // it won't be used and it is more convenient to access without thinking
       // of offsets (a tiny bit of memory waste for convenience)
-      remOptions[L][i].setOptions(segmentResiduals[i], L == 0);
+      // a segment's residual can only grow when superimposed jointly with the
+      // others, so windows already above the cutoff are never options
+      remOptions[L][i].setOptions(segmentResiduals[i], L == 0, residualCut);
       if (!okAlignments[i].empty()) remOptions[L][i].intersectOptions(okAlignments[i]);
     }
+    stats.windowsKept += remOptions[0][L].size();
   }
 
   // current residual starts with 0, since nothing is aligned yet
@@ -746,23 +1698,8 @@ void FASST::prepForSearch(int ti) {
   currResiduals.resize(query.size(), 0);
   currRemBound = boundOnRemainder(true);
 
-  // make room for target atom masks at different recursion levels
-  if (targetMasks.size()) targetMasks.back().deletePointers();
-  targetMasks.clear(); targetMasks.resize(query.size());
-  for (int i = 0; i < query.size(); i++) {
-    for (int L = i; L < query.size(); L++) {
-      for (int j = 0; j < query[i].size(); j++) {
-        if (L > i) {
-          // for any repeated atoms on this level, make sure to point to the
-          // same atoms as the mask on the previous level
-          targetMasks[L].push_back(targetMasks[L-1][targetMasks[L-1].size() - query[i].size() + j]);
-        } else {
-          // and only create new atoms for the last segment
-          targetMasks[L].push_back(new Atom(*(query[i][j])));
-        }
-      }
-    }
-  }
+  // make room for the target counterpart of the packed query
+  targetMaskCoor.assign(queryMaskCoor.size(), 0.0);
 
   // room for centroids of aligned sub-structure, at each recursion level
   currCents.clear();
@@ -777,11 +1714,11 @@ void FASST::prepForSearch(int ti) {
 }
 
 void FASST::fillTargetChainInfo(int ti) {
-  AtomPointerVector& target = targets[ti];
-  targChainBeg.resize(atomToResIdx(target.size()));
-  targChainEnd.resize(atomToResIdx(target.size()));
+  int L = atomToResIdx(db->searchableAtomSize(ti));
+  targChainBeg.resize(L);
+  targChainEnd.resize(L);
 
-  tightvector<int>& chainLengths = targetChainLen[ti];
+  tightvector<int>& chainLengths = db->targetChainLen[ti];
   int ri = 0, cb = 0;
   for (int i = 0; i < chainLengths.size(); i++) {
     for (int j = 0; j < chainLengths[i]; j++, ri++) {
@@ -807,171 +1744,355 @@ mstreal FASST::centToCentTol(int i) {
 }
 
 fasstSolutionSet FASST::search() {
-  // auto begin = chrono::high_resolution_clock::now();
-  // int prepTime = 0;
+  MstProfiler::scope prof("FASST::search");
+  auto run = [this]() {
+    if ((numThreads > 1) && (db->targets.size() > 1)) { parallelSearch(); return; }
+    initSearch();
+    boundTargets();
+    int numTargs = db->targets.size();
+    for (int k = 0; k < numTargs; k++) {
+      int ti = targetOrder.empty() ? k : targetOrder[k];
+      if (!searchTarget(ti)) {
+        // in the order of bounds, all remaining targets are skipped too
+        if (!targetOrder.empty() && (targetBounds[ti] > residualCut)) stats.targetsSkipped += numTargs - k - 1;
+        break;
+      }
+    }
+    collectSolutions();
+    solutions.clearTempData();
+  };
+  // seeds re-scored against this query bound the RMSD of the K-th best match
+  int numWarm = 0;
+  warmCut = -1;
+  if (!warmStart.empty() && (opts.isMinNumMatchesSet() || opts.isMaxNumMatchesSet())) {
+    vector<mstreal> seedRMSDs = warmStartRMSDs();
+    auto seedBound = [&seedRMSDs](int K) { return (K <= seedRMSDs.size()) ? seedRMSDs[K-1]*(1 + 10E-6) + 10E-6 : INFINITY; };
+    mstreal coldCut = opts.isMinNumMatchesSet() ? INFINITY : opts.getRMSDCutoff();
+    mstreal cut = opts.isMinNumMatchesSet() ? MstUtils::max(opts.getRMSDCutoff(), seedBound(opts.getMinNumMatches())) : coldCut;
+    numWarm = opts.isMinNumMatchesSet() ? opts.getMinNumMatches() : 0;
+    if (opts.isMaxNumMatchesSet() && (seedBound(opts.getMaxNumMatches()) < cut)) {
+      cut = seedBound(opts.getMaxNumMatches());
+      numWarm = opts.getMaxNumMatches();
+    }
+    if (cut < coldCut) warmCut = cut;
+  }
+  run();
+  if ((warmCut >= 0) && (solutions.size() < numWarm) && !stats.partial) {
+    // the seeded cutoff was too tight (e.g., due to redundancy), so start over
+    warmCut = -1;
+    fasstSearchStats warmStats = stats;
+    run();
+    stats += warmStats;
+  }
+  warmCut = -1;
+  if (MstProfiler::isEnabled()) {
+    MstProfiler::addCount("FASST::search:windowsScored", stats.windowsScored);
+    MstProfiler::addCount("FASST::search:nodesVisited", stats.nodesVisited);
+    MstProfiler::addCount("FASST::search:solutionsFound", stats.solutionsFound);
+  }
+  return solutions;
+}
+
+void FASST::initSearch() {
   int numSegs = query.size();
   opts.validateSearchRequest(numSegs);
-  if (opts.isMinNumMatchesSet()) setCurrentRMSDCutoff(INFINITY);
+  stats.reset();
+  nodesReported = 0;
+  if (opts.isMaxSearchTimeSet()) searchDeadline = chrono::steady_clock::now() + chrono::duration_cast<chrono::steady_clock::duration>(chrono::duration<double>(opts.getMaxSearchTime()));
+  if (warmCut >= 0) setCurrentRMSDCutoff(warmCut);
+  else if (opts.isMinNumMatchesSet()) setCurrentRMSDCutoff(INFINITY);
   else setCurrentRMSDCutoff(opts.getRMSDCutoff());
   solutions.init(numSegs);
   bool redSet = opts.isRedundancyCutSet() || opts.isRedundancyPropertySet();
-  bool doRedBar = redSet && (numSegs > 1); // should we apply special "barrier" RMSD cutoffs to partial matches that are
-                                           // already known to be redundant to something in the current list of solutions?
-  vector<int> segLen(numSegs); // number of residues in each query segment
+  useHeap = !redSet; // redundancy filtering compares solutions to one another, so needs them in full
+  found.init(numSegs);
+  doRedBar = redSet && (numSegs > 1); // should we apply special "barrier" RMSD cutoffs to partial matches that are
+                                      // already known to be redundant to something in the current list of solutions?
+  segLen.resize(numSegs); // number of residues in each query segment
   for (int i = 0; i < numSegs; i++) segLen[i] = atomToResIdx(query[i].size());
-  vector<mstreal> ccTol(numSegs, -1.0);
-  for (currentTarget = 0; currentTarget < targets.size(); currentTarget++) {
-    // auto beginPrep = chrono::high_resolution_clock::now();
-    if (doRedBar) {
-      resetCurrentRMSDCutoff(); // if it was previously temporarily set
-      solutions.resetAlignRedBarrierData(targets[currentTarget].size());
-    }
-    prepForSearch(currentTarget);
-    // auto endPrep = chrono::high_resolution_clock::now();
-    // prepTime += chrono::duration_cast<std::chrono::microseconds>(endPrep-beginPrep).count();
-    vector<int> okLocations, badLocations;
-    okLocations.reserve(targets[currentTarget].size()); badLocations.reserve(targets[currentTarget].size());
-    while (true) {
-      // Have to do three things:
-      // 1. pick the best choice (from available ones) for the current segment,
-      // remove it from the list of options, and move onto the next recursion level
-      if (remOptions[recLevel][recLevel].empty()) {
-        currAlignment[recLevel] = -1;
-        if (recLevel > 0) {
-          recLevel--;
-          continue;
-        } else {
-          break; // search exhausted
-        }
-      }
-      currAlignment[recLevel] = remOptions[recLevel][recLevel].bestChoice();
-      remOptions[recLevel][recLevel].removeOption(currAlignment[recLevel]);
-
-      // if redundancy removal is set, and there are matches in the current list
-      // of solutions that are redundant with the current partial solution, any
-      // full realization of the current partial solution will only be accepted
-      // if they it improves upon the best RMSD of any of these redundant solu-
-      // tions. So, temporarily lower the current RMSD threshold, if applicable,
-      // but keep track of which segment in the current alignment this was due
-      // to (which segment had the redundancy), so that this chane can be unwound
-      // when this segment's alignment changes in the partial solution.
-      if (doRedBar) {
-        if (rmsdPriority() >= recLevel) resetCurrentRMSDCutoff(recLevel - 1);
-        mstreal barrier = solutions.alignRedBarrier(qSegOrd[recLevel], currAlignment[recLevel]);
-        if (getCurrentRMSDCutoff() > barrier) setCurrentRMSDCutoff(barrier, recLevel);
+  vector<int> origSegLen(numSegs);
+  for (int i = 0; i < numSegs; i++) origSegLen[qSegOrd[i]] = segLen[i];
+  solSegLen = make_shared<const vector<int> >(origSegLen);
+  origAlignment.resize(numSegs);
+  ccTol.assign(numSegs, -1.0);
+  qSegDesc.clear();
+  if (!db->segIndex.empty()) {
+    qSegDesc.resize(3*numSegs);
+    for (int i = 0; i < numSegs; i++) {
+      const mstreal* seg = queryMaskCoor.data() + 3*(queryMasks[i].size() - query[i].size());
+      fasstSegmentIndex::descriptor(seg, query[i].size(), &(qSegDesc[3*i]));
+    }
+  }
+}
+
+void FASST::boundTargets() {
+  targetBounds.clear(); targetOrder.clear();
+  filterBySequence();
+  if (qSegDesc.empty()) return;
+  int numTargs = db->targets.size(), numSegs = query.size();
+  targetBounds.assign(numTargs, 0);
+  for (int ti = 0; ti < numTargs; ti++) {
+    int numRes = atomToResIdx(db->searchableAtomSize(ti));
+    for (int i = 0; i < numSegs; i++) {
+      int Na = numRes - segLen[i] + 1;
+      if (Na <= 0) { targetBounds[ti] = INFINITY; break; }
+      const float* desc = db->segIndex.descriptors(segLen[i], ti);
+      if (desc == NULL) continue;
+      mstreal best = INFINITY;
+      for (int j = 0; j < Na; j++) best = MstUtils::min(best, fasstSegmentIndex::residualBound(&(qSegDesc[3*i]), desc + 3*j));
+      targetBounds[ti] += best;
+    }
+  }
+  if (opts.isTargetOrderingSet()) {
+    targetOrder.resize(numTargs);
+    for (int ti = 0; ti < numTargs; ti++) targetOrder[ti] = ti;
+    stable_sort(targetOrder.begin(), targetOrder.end(), [this](int a, int b) { return targetBounds[a] < targetBounds[b]; });
+  }
+}
+
+void FASST::filterBySequence() {
+  int numSegs = query.size();
+  seqIndexed.assign(numSegs, false);
+  seqStarts.reset();
+  fasstSeqConst* C = opts.getSequenceConstraints();
+  if (C == NULL) return;
+  shared_ptr<vector<vector<int> > > starts = make_shared<vector<vector<int> > >(numSegs);
+  vector<int> positions; vector<set<res_t> > allowed;
+  for (int i = 0; i < numSegs; i++) {
+    if (!C->isSegmentConstrained(qSegOrd[i]) || !C->positionalConstraints(qSegOrd[i], positions, allowed)) continue;
+    db->getSequenceIndex().admissibleStarts(positions, allowed, segLen[i], (*starts)[i]);
+    seqIndexed[i] = true;
+  }
+  if (find(seqIndexed.begin(), seqIndexed.end(), true) != seqIndexed.end()) seqStarts = starts;
+}
+
+const fasstSequenceIndex& FASST::getSequenceIndex() {
+  lock_guard<mutex> lock(seqIndexLock);
+  if (seqIndex.numTargets() != targSeqs.size()) seqIndex.build(targSeqs);
+  return seqIndex;
+}
+
+bool FASST::outOfBudget() {
+  if (stats.partial) return true;
+  if (shared != NULL) {
+    if (opts.isMaxSearchNodesSet()) {
+      shared->numNodes += stats.nodesVisited - nodesReported;
+      nodesReported = stats.nodesVisited;
+      if (shared->numNodes >= opts.getMaxSearchNodes()) shared->stop = true;
+    }
+    if (shared->stop) stats.partial = true;
+  } else if (opts.isMaxSearchNodesSet() && (stats.nodesVisited >= opts.getMaxSearchNodes())) {
+    stats.partial = true;
+  }
+  if (opts.isMaxSearchTimeSet() && (chrono::steady_clock::now() > searchDeadline)) stats.partial = true;
+  if (stats.partial && (shared != NULL)) shared->stop = true;
+  return stats.partial;
+}
+
+bool FASST::searchTarget(int ti) {
+  if (outOfBudget()) return false;
+  int numSegs = query.size();
+  bool more = true;
+  currentTarget = ti;
+  int targAtoms = db->searchableAtomSize(currentTarget);
+  if (doRedBar) {
+    resetCurrentRMSDCutoff(); // if it was previously temporarily set
+    solutions.resetAlignRedBarrierData(targAtoms);
+  }
+  if (shared != NULL) {
+    // other workers may have found enough good matches to tighten the cutoff
+    if (opts.isSufficientNumMatchesSet() && (shared->numFound >= opts.getSufficientNumMatches())) return false;
+    mstreal cut = shared->rmsdCut;
+    if (cut < getCurrentRMSDCutoff()) setCurrentRMSDCutoff(cut);
+  }
+  if (!targetBounds.empty() && (targetBounds[ti] > residualCut)) {
+    stats.targetsSkipped++;
+    return targetOrder.empty(); // in the order of bounds, no later target can do better
+  }
+  if (seqStarts) {
+    // some constrained segment has no admissible alignment in this target
+    const fasstSequenceIndex& SI = db->seqIndex;
+    for (int i = 0; i < numSegs; i++) {
+      if (!seqIndexed[i]) continue;
+      const vector<int>& st = (*seqStarts)[i];
+      auto it = lower_bound(st.begin(), st.end(), SI.residueOffset(ti));
+      if ((it == st.end()) || (*it >= SI.residueOffset(ti + 1))) { stats.targetsSkipped++; return true; }
+    }
+  }
+  auto beginScoring = chrono::steady_clock::now();
+  prepForSearch(currentTarget);
+  auto beginPlacement = chrono::steady_clock::now();
+  stats.scoringTime += chrono::duration<double>(beginPlacement - beginScoring).count();
+  stats.targetsSearched++;
+  double redTime = 0;
+  vector<int> okLocations, badLocations;
+  okLocations.reserve(targAtoms); badLocations.reserve(targAtoms);
+  while (true) {
+    // Have to do three things:
+    // 1. pick the best choice (from available ones) for the current segment,
+    // remove it from the list of options, and move onto the next recursion level
+    if (remOptions[recLevel][recLevel].empty()) {
+      currAlignment[recLevel] = -1;
+      if (recLevel > 0) {
+        recLevel--;
+        continue;
+      } else {
+        break; // search exhausted
       }
+    }
+    currAlignment[recLevel] = remOptions[recLevel][recLevel].bestChoice();
+    remOptions[recLevel][recLevel].removeOption(currAlignment[recLevel]);
+    stats.nodesVisited++;
+    if (((stats.nodesVisited & 255) == 0) && outOfBudget()) { more = false; break; }
+
+    // if redundancy removal is set, and there are matches in the current list
+    // of solutions that are redundant with the current partial solution, any
+    // full realization of the current partial solution will only be accepted
+    // if they it improves upon the best RMSD of any of these redundant solu-
+    // tions. So, temporarily lower the current RMSD threshold, if applicable,
+    // but keep track of which segment in the current alignment this was due
+    // to (which segment had the redundancy), so that this chane can be unwound
+    // when this segment's alignment changes in the partial solution.
+    if (doRedBar) {
+      if (rmsdPriority() >= recLevel) resetCurrentRMSDCutoff(recLevel - 1);
+      mstreal barrier = solutions.alignRedBarrier(qSegOrd[recLevel], currAlignment[recLevel]);
+      if (getCurrentRMSDCutoff() > barrier) setCurrentRMSDCutoff(barrier, recLevel);
+    }
 
-      // 2. compute the total residual from the current alignment
-      mstreal curBound = currentAlignmentResidual(true) + boundOnRemainder(true);
-      if (curBound > residualCut) continue;
-      // if (query.size() > 1) updateQueryCentroids();
-
-      // 3. update update remaining options for subsequent segments based on the
-      // newly made choice. The set of options on the next recursion level is a
-      // subset of the set of options on the previous level.
-      int remSegs = numSegs - (recLevel + 1);
-      if (remSegs > 0) {
-        bool levelExhausted = false;
-        int nextLevel = recLevel + 1;
-        // copy remaining options from the previous recursion level. This way,
-        // we can compute bounds on this level and can do set intersections to
-        // further narrow this down
-        for (int i = nextLevel; i < numSegs; i++) {
-          remOptions[nextLevel][i].copyIn(remOptions[nextLevel-1][i]);
-          // except that segments cannot overlap, so remove from consideration
-          // all alignments that overlap with the segments that was just placed
-          remOptions[nextLevel][i].removeOptions(currAlignment[recLevel] - segLen[i] + 1,
-                                                 currAlignment[recLevel] + segLen[recLevel] - 1);
-        }
-        if (opts.gapConstraintsExist() || opts.diffChainsConstsExist()) {
-          for (int j = 0; j < nextLevel; j++) {
-            for (int i = nextLevel; i < numSegs; i++) {
-              if (opts.diffChainsConstrained(qSegOrd[i], qSegOrd[j])) {
-                int testingCurrAlignment = currAlignment[j];
-                string tcaString = to_string(testingCurrAlignment);
-                int targChainBegSize = targChainBeg.size();
-                string tcbString = to_string(targChainBegSize);
-                int startRemove = targChainBeg[currAlignment[j]];
-                int endRemove = targChainEnd[currAlignment[j]];
-                remOptions[nextLevel][i].removeOptions(startRemove,endRemove);
-              }
-              else if (gapConstrained(qSegOrd[i], qSegOrd[j]) || gapConstrained(qSegOrd[j], qSegOrd[i])) {
-                remOptions[nextLevel][i].constrainRange(targChainBeg[currAlignment[j]], targChainEnd[currAlignment[j]]);
-                if (opts.minGapConstrained(qSegOrd[i], qSegOrd[j]))
-                  remOptions[nextLevel][i].constrainLE(currAlignment[j] - opts.getMinGap(qSegOrd[i], qSegOrd[j]) - segLen[i]);
-                if (opts.maxGapConstrained(qSegOrd[i], qSegOrd[j]))
-                  remOptions[nextLevel][i].constrainGE(currAlignment[j] - opts.getMaxGap(qSegOrd[i], qSegOrd[j]) - segLen[i]);
-                if (opts.minGapConstrained(qSegOrd[j], qSegOrd[i]))
-                  remOptions[nextLevel][i].constrainGE(currAlignment[j] + opts.getMinGap(qSegOrd[j], qSegOrd[i]) + segLen[j]);
-                if (opts.maxGapConstrained(qSegOrd[j], qSegOrd[i]))
-                  remOptions[nextLevel][i].constrainLE(currAlignment[j] + opts.getMaxGap(qSegOrd[j], qSegOrd[i]) + segLen[j]);
-                    // if (minGapSet[qSegOrd[i]][qSegOrd[j]]) remOptions[nextLevel][i].constrainLE(currAlignment[j] - minGap[qSegOrd[i]][qSegOrd[j]] - segLen[i]);
-                    // if (maxGapSet[qSegOrd[i]][qSegOrd[j]]) remOptions[nextLevel][i].constrainGE(currAlignment[j] - maxGap[qSegOrd[i]][qSegOrd[j]] - segLen[i]);
-                    // if (minGapSet[qSegOrd[j]][qSegOrd[i]]) remOptions[nextLevel][i].constrainGE(currAlignment[j] + minGap[qSegOrd[j]][qSegOrd[i]] + segLen[j]);
-                    // if (maxGapSet[qSegOrd[j]][qSegOrd[i]]) remOptions[nextLevel][i].constrainLE(currAlignment[j] + maxGap[qSegOrd[j]][qSegOrd[i]] + segLen[j]);
-              }
-              if (remOptions[nextLevel][i].empty()) { levelExhausted = true; break; }
-            }
-            if (levelExhausted) break;
-          }
-          if (levelExhausted) continue;
-        }
-        mstreal di, de, d, dePrev, eps = 10E-8;
-        CartesianPoint& currCent = currCents[recLevel];
-        for (int c = 0; true; c++) {
-          bool updated = false;
+    // 2. compute the total residual from the current alignment
+    mstreal curBound = currentAlignmentResidual(true) + boundOnRemainder(true);
+    if (curBound > residualCut) { stats.boundPruned++; continue; }
+    // if (query.size() > 1) updateQueryCentroids();
+
+    // 3. update update remaining options for subsequent segments based on the
+    // newly made choice. The set of options on the next recursion level is a
+    // subset of the set of options on the previous level.
+    int remSegs = numSegs - (recLevel + 1);
+    if (remSegs > 0) {
+      bool levelExhausted = false;
+      int nextLevel = recLevel + 1;
+      // copy remaining options from the previous recursion level. This way,
+      // we can compute bounds on this level and can do set intersections to
+      // further narrow this down
+      for (int i = nextLevel; i < numSegs; i++) {
+        remOptions[nextLevel][i].copyIn(remOptions[nextLevel-1][i]);
+        // except that segments cannot overlap, so remove from consideration
+        // all alignments that overlap with the segments that was just placed
+        remOptions[nextLevel][i].removeOptions(currAlignment[recLevel] - segLen[i] + 1,
+                                               currAlignment[recLevel] + segLen[recLevel] - 1);
+      }
+      if (opts.gapConstraintsExist() || opts.diffChainsConstsExist()) {
+        for (int j = 0; j < nextLevel; j++) {
           for (int i = nextLevel; i < numSegs; i++) {
-            FASST::optList& remSet = remOptions[nextLevel][i];
-            de = centToCentTol(i);
-            if (de < 0) { levelExhausted = true; break; }
-            di = centToCentDist[recLevel][i];
-            dePrev = ((c == 0) ? -1 : ccTol[i]);
-            int numLocs = remSet.size();
-
-            // If the set of options for the current segment was arrived at,
-            // in part, by limiting center-to-center distances, then we will
-            // tighten that list by removing options that are outside of the
-            // range allowed at this recursion level. Otherwise, we will do a
-            // general proximity search given the current tolerance and will
-            // tighten the list that way.
-            if (dePrev < 0) {
-              okLocations.resize(0);
-              ps[i]->pointsWithin(currCent, max(di - de, 0.0), di + de, &okLocations);
-              remSet.intersectOptions(okLocations);
-            } else if (dePrev - de > eps) {
-              badLocations.resize(0);
-              ps[i]->pointsWithin(currCent, max(di - dePrev, 0.0), di - de - eps, &badLocations);
-              ps[i]->pointsWithin(currCent, di + de + eps, di + dePrev, &badLocations);
-              for (int k = 0; k < badLocations.size(); k++) {
-                remSet.removeOption(badLocations[k]);
-              }
+            int numOpts = remOptions[nextLevel][i].size();
+            if (opts.diffChainsConstrained(qSegOrd[i], qSegOrd[j])) {
+              int testingCurrAlignment = currAlignment[j];
+              string tcaString = to_string(testingCurrAlignment);
+              int targChainBegSize = targChainBeg.size();
+              string tcbString = to_string(targChainBegSize);
+              int startRemove = targChainBeg[currAlignment[j]];
+              int endRemove = targChainEnd[currAlignment[j]];
+              remOptions[nextLevel][i].removeOptions(startRemove,endRemove);
             }
-            ccTol[i] = de;
-            if (numLocs != remSet.size()) {
-              // this both updates the bound and checks that there are still
-              // feasible solutions left
-              if ((remSet.empty()) || (currResidual + boundOnRemainder(true) > residualCut)) {
-                levelExhausted = true; break;
-              }
-              updated = true;
+            else if (gapConstrained(qSegOrd[i], qSegOrd[j]) || gapConstrained(qSegOrd[j], qSegOrd[i])) {
+              remOptions[nextLevel][i].constrainRange(targChainBeg[currAlignment[j]], targChainEnd[currAlignment[j]]);
+              if (opts.minGapConstrained(qSegOrd[i], qSegOrd[j]))
+                remOptions[nextLevel][i].constrainLE(currAlignment[j] - opts.getMinGap(qSegOrd[i], qSegOrd[j]) - segLen[i]);
+              if (opts.maxGapConstrained(qSegOrd[i], qSegOrd[j]))
+                remOptions[nextLevel][i].constrainGE(currAlignment[j] - opts.getMaxGap(qSegOrd[i], qSegOrd[j]) - segLen[i]);
+              if (opts.minGapConstrained(qSegOrd[j], qSegOrd[i]))
+                remOptions[nextLevel][i].constrainGE(currAlignment[j] + opts.getMinGap(qSegOrd[j], qSegOrd[i]) + segLen[j]);
+              if (opts.maxGapConstrained(qSegOrd[j], qSegOrd[i]))
+                remOptions[nextLevel][i].constrainLE(currAlignment[j] + opts.getMaxGap(qSegOrd[j], qSegOrd[i]) + segLen[j]);
+                  // if (minGapSet[qSegOrd[i]][qSegOrd[j]]) remOptions[nextLevel][i].constrainLE(currAlignment[j] - minGap[qSegOrd[i]][qSegOrd[j]] - segLen[i]);
+                  // if (maxGapSet[qSegOrd[i]][qSegOrd[j]]) remOptions[nextLevel][i].constrainGE(currAlignment[j] - maxGap[qSegOrd[i]][qSegOrd[j]] - segLen[i]);
+                  // if (minGapSet[qSegOrd[j]][qSegOrd[i]]) remOptions[nextLevel][i].constrainGE(currAlignment[j] + minGap[qSegOrd[j]][qSegOrd[i]] + segLen[j]);
+                  // if (maxGapSet[qSegOrd[j]][qSegOrd[i]]) remOptions[nextLevel][i].constrainLE(currAlignment[j] + maxGap[qSegOrd[j]][qSegOrd[i]] + segLen[j]);
             }
+            stats.gapPruned += numOpts - remOptions[nextLevel][i].size();
+            if (remOptions[nextLevel][i].empty()) { levelExhausted = true; break; }
           }
           if (levelExhausted) break;
-          if (!updated) break;
         }
         if (levelExhausted) continue;
-        recLevel = nextLevel;
+      }
+      mstreal di, de, d, dePrev, eps = 10E-8;
+      CartesianPoint& currCent = currCents[recLevel];
+      for (int c = 0; true; c++) {
+        bool updated = false;
+        for (int i = nextLevel; i < numSegs; i++) {
+          FASST::optList& remSet = remOptions[nextLevel][i];
+          de = centToCentTol(i);
+          if (de < 0) { levelExhausted = true; break; }
+          di = centToCentDist[recLevel][i];
+          dePrev = ((c == 0) ? -1 : ccTol[i]);
+          int numLocs = remSet.size();
+
+          // If the set of options for the current segment was arrived at,
+          // in part, by limiting center-to-center distances, then we will
+          // tighten that list by removing options that are outside of the
+          // range allowed at this recursion level. Otherwise, we will do a
+          // general proximity search given the current tolerance and will
+          // tighten the list that way.
+          if (dePrev < 0) {
+            okLocations.resize(0);
+            ps[i]->pointsWithin(currCent, max(di - de, 0.0), di + de, &okLocations);
+            remSet.intersectOptions(okLocations);
+          } else if (dePrev - de > eps) {
+            badLocations.resize(0);
+            ps[i]->pointsWithin(currCent, max(di - dePrev, 0.0), di - de - eps, &badLocations);
+            ps[i]->pointsWithin(currCent, di + de + eps, di + dePrev, &badLocations);
+            for (int k = 0; k < badLocations.size(); k++) {
+              remSet.removeOption(badLocations[k]);
+            }
+          }
+          ccTol[i] = de;
+          if (numLocs != remSet.size()) {
+            stats.proximityPruned += numLocs - remSet.size();
+            // this both updates the bound and checks that there are still
+            // feasible solutions left
+            if ((remSet.empty()) || (currResidual + boundOnRemainder(true) > residualCut)) {
+              levelExhausted = true; break;
+            }
+            updated = true;
+          }
+        }
+        if (levelExhausted) break;
+        if (!updated) break;
+      }
+      if (levelExhausted) continue;
+      recLevel = nextLevel;
+    } else {
+      // if at the lowest recursion level already, then record the solution
+      mstreal rmsd = sqrt(currResidual/querySize);
+      bool inserted = false;
+      stats.solutionsFound++;
+      if (useHeap) {
+        // the transform is only computed for solutions that survive the search (or that a callback needs to see)
+        for (int i = 0; i < numSegs; i++) origAlignment[qSegOrd[i]] = currAlignment[i];
+        found.push(origAlignment.data(), rmsd, currentTarget);
+        inserted = true;
+        if (solutionCallback && !solutionCallback(fasstSolution(origAlignment, rmsd, currentTarget, currentTransform(), solSegLen))) {
+          stats.partial = true;
+          if (shared != NULL) shared->stop = true;
+          more = false; break;
+        }
       } else {
-        // if at the lowest recursion level already, then record the solution
-        fasstSolution sol(currAlignment, sqrt(currResidual/querySize), currentTarget, currentTransform(), segLen, qSegOrd);
-        bool inserted = false;
+        fasstSolution sol(currAlignment, rmsd, currentTarget, currentTransform(), segLen, qSegOrd);
+        auto beginRed = chrono::steady_clock::now();
         if (opts.isRedundancyCutSet()) {
           addSequenceContext(sol);
           inserted = solutions.insert(sol, opts.getRedundancyCut());
-        } else if (opts.isRedundancyPropertySet()) {
-          inserted = solutions.insert(sol, getRedundancyPropertyMap());
         } else {
-          inserted = solutions.insert(sol);
+          inserted = solutions.insert(sol, getRedundancyPropertyMap());
+        }
+        redTime += chrono::duration<double>(chrono::steady_clock::now() - beginRed).count();
+        if (!inserted) stats.redundantRejected++;
+
+        if (inserted && solutionCallback && !solutionCallback(sol)) {
+          stats.partial = true;
+          if (shared != NULL) shared->stop = true;
+          more = false; break;
         }
 
         if (doRedBar && !inserted) {
@@ -980,29 +2101,213 @@ fasstSolutionSet FASST::search() {
             if (getCurrentRMSDCutoff() > barrier) setCurrentRMSDCutoff(barrier, rL);
           }
         }
+      }
 
-        if (opts.isSufficientNumMatchesSet() && (solutions.size() == opts.getSufficientNumMatches())) return solutions;
-        if (opts.isMaxNumMatchesSet() && (solutions.size() > opts.getMaxNumMatches())) {
-          solutions.erase(--solutions.end());
-          setCurrentRMSDCutoff(solutions.worstRMSD());
-        } else if (opts.isMinNumMatchesSet() && (solutions.size() > opts.getMinNumMatches()) && (rmsdCut > opts.getRMSDCutoff())) {
-          if (solutions.worstRMSD() > opts.getRMSDCutoff()) solutions.erase(--solutions.end());
-          setCurrentRMSDCutoff(MstUtils::max(solutions.worstRMSD(), opts.getRMSDCutoff()));
-        }
+      if (opts.isSufficientNumMatchesSet()) {
+        if (shared == NULL) {
+          if (numFoundSolutions() == opts.getSufficientNumMatches()) { more = false; break; }
+        } else if (inserted && (++(shared->numFound) >= opts.getSufficientNumMatches())) { more = false; break; }
       }
+      if (opts.isMaxNumMatchesSet() && (numFoundSolutions() > opts.getMaxNumMatches())) {
+        removeWorstFound();
+        setCurrentRMSDCutoff(worstFoundRMSD());
+        if (shared != NULL) shared->tightenRMSDCutoff(rmsdCut);
+      } else if (opts.isMinNumMatchesSet() && (numFoundSolutions() > opts.getMinNumMatches()) && (rmsdCut > opts.getRMSDCutoff())) {
+        if (worstFoundRMSD() > opts.getRMSDCutoff()) removeWorstFound();
+        setCurrentRMSDCutoff(MstUtils::max(worstFoundRMSD(), opts.getRMSDCutoff()));
+      }
+    }
+  }
+  stats.redundancyTime += redTime;
+  stats.placementTime += chrono::duration<double>(chrono::steady_clock::now() - beginPlacement).count() - redTime;
+  return more;
+}
+
+void FASST::collectSolutions() {
+  if (!useHeap) return;
+  found.forEach([this](const int* algn, mstreal rmsd, int ti) {
+    vector<int> alignment(algn, algn + query.size());
+    solutions.insert(fasstSolution(alignment, rmsd, ti, alignmentTransform(ti, algn), solSegLen));
+  });
+  found.clear();
+}
+
+Transform FASST::alignmentTransform(int ti, const int* origAlignment) {
+  // pack target coordinates of all segments, in search order, as a search would have
+  const float* mapped = db->mappedCoordinates(ti);
+  for (int L = 0; L < query.size(); L++) {
+    int n = query[L].size();
+    int si = resToAtomIdx(origAlignment[qSegOrd[L]]);
+    mstreal* dest = targetMaskCoor.data() + 3*(queryMasks[L].size() - n);
+    if (mapped == NULL) {
+      const mstcoor* src = db->targetCoords[ti].data() + 3*si;
+      for (int k = 0; k < 3*n; k++) dest[k] = src[k];
+    } else {
+      const float* src = mapped + 3*si;
+      for (int k = 0; k < 3*n; k++) dest[k] = src[k];
+    }
+  }
+  RC.bestResidual(targetMaskCoor.data(), queryMaskCoor.data(), queryMasks.back().size(), true);
+  return Transform(RC.lastRotation(), RC.lastTranslation());
+}
+
+void FASST::setNumThreads(int n) {
+  if (n < 1) MstUtils::error("number of threads must be positive, got " + MstUtils::toString(n), "FASST::setNumThreads");
+  numThreads = n;
+}
+
+void FASST::borrowDatabase(FASST* owner) {
+  if (!targets.empty()) MstUtils::error("cannot borrow a database when own targets are present", "FASST::borrowDatabase");
+  db = owner->db;
+  gridSpacing = owner->gridSpacing;
+  updateGrids = true;
+}
+
+void FASST::sharedSearchState::tightenRMSDCutoff(mstreal cut) {
+  mstreal curr = rmsdCut;
+  while ((cut < curr) && !rmsdCut.compare_exchange_weak(curr, cut));
+}
+
+FASST* FASST::newSearcher() {
+  FASST* searcher = new FASST();
+  searcher->setSearchType(type);
+  searcher->borrowDatabase(this);
+  return searcher;
+}
+
+fasstSolutionSet FASST::parallelSearch() {
+  sharedSearchState state(INFINITY);
+  return parallelSearch(state);
+}
+
+fasstSolutionSet FASST::parallelSearch(sharedSearchState& state) {
+  MstProfiler::scope prof("FASST::parallelSearch");
+  int numSegs = query.size();
+  opts.validateSearchRequest(numSegs);
+  if (opts.isRedundancyPropertySet()) getRedundancyPropertyMap(); // make sure the map exists before workers look it up
+
+  // each worker gets its own copy of the query and options, and claims targets
+  // one at a time from the shared database, to balance the load
+  int numWorkers = MstUtils::max(1, MstUtils::min(numThreads, (int) db->targets.size()));
+  // target bounds (and order) are computed once, and shared with the workers
+  initSearch();
+  boundTargets();
+  state.tightenRMSDCutoff(rmsdCut); // in case it was seeded (see setWarmStart)
+  vector<FASST*> workers(numWorkers);
+  for (int w = 0; w < numWorkers; w++) {
+    workers[w] = newSearcher();
+    if (queryView.getParent() != NULL) workers[w]->setQuery(queryView, false);
+    else workers[w]->setQuery(queryStruct, false);
+    workers[w]->setOptions(opts);
+    workers[w]->shared = &state;
+    workers[w]->initSearch();
+    workers[w]->targetBounds = targetBounds;
+    workers[w]->seqIndexed = seqIndexed;
+    workers[w]->seqStarts = seqStarts;
+  }
+  mutex callbackLock;
+  if (solutionCallback) {
+    for (int w = 0; w < numWorkers; w++) {
+      workers[w]->solutionCallback = [this, &callbackLock](const fasstSolution& sol) {
+        lock_guard<mutex> lock(callbackLock);
+        return solutionCallback(sol);
+      };
     }
   }
-  // auto end = chrono::high_resolution_clock::now();
-  // int searchTime = chrono::duration_cast<std::chrono::milliseconds>(end-begin).count();
-  // prepTime = prepTime/1000;
-  // cout << "prep time " << prepTime << " ms" << std::endl;
-  // cout << "total time " << searchTime << " ms" << std::endl;
-  // cout << "prep time was " << (100.0*prepTime/searchTime) << " % of the total" << std::endl;
+  try {
+    MstUtils::parallelFor(db->targets.size(), numWorkers, [&](int k, int w) { workers[w]->searchTarget(targetOrder.empty() ? k : targetOrder[k]); });
+    MstUtils::parallelFor(numWorkers, numWorkers, [&workers](int w, int) { workers[w]->collectSolutions(); });
+  } catch (...) {
+    for (int w = 0; w < numWorkers; w++) delete workers[w];
+    throw;
+  }
 
-  solutions.clearTempData();
+  auto beginMerge = chrono::steady_clock::now();
+  stats.reset();
+  vector<const fasstSolution*> pool;
+  for (int w = 0; w < numWorkers; w++) {
+    for (auto it = workers[w]->solutions.begin(); it != workers[w]->solutions.end(); ++it) pool.push_back(&(*it));
+    stats += workers[w]->stats;
+  }
+  solutions = mergeSolutions(pool, numSegs, opts, opts.isRedundancyPropertySet() ? &getRedundancyPropertyMap() : NULL);
+  for (int w = 0; w < numWorkers; w++) delete workers[w];
+  stats.mergeTime = chrono::duration<double>(chrono::steady_clock::now() - beginMerge).count();
   return solutions;
 }
 
+fasstSolutionSet FASST::mergeSolutions(vector<const fasstSolution*>& pool, int numSegs, const fasstSearchOptions& opts, simpleMap<resAddress, tightvector<resAddress>>* relMap) {
+  fasstSolutionSet merged;
+  merged.init(numSegs);
+  sort(pool.begin(), pool.end(), [](const fasstSolution* a, const fasstSolution* b) { return *a < *b; });
+  for (int i = 0; i < pool.size(); i++) {
+    if (opts.isRedundancyCutSet()) merged.insert(*(pool[i]), opts.getRedundancyCut());
+    else if (opts.isRedundancyPropertySet() && (relMap != NULL)) merged.insert(*(pool[i]), *relMap);
+    else merged.insert(*(pool[i]));
+  }
+  if (opts.isMaxNumMatchesSet()) {
+    while (merged.size() > opts.getMaxNumMatches()) merged.erase(--merged.end());
+  }
+  if (opts.isMinNumMatchesSet()) {
+    while ((merged.size() > opts.getMinNumMatches()) && (merged.worstRMSD() > opts.getRMSDCutoff())) merged.erase(--merged.end());
+  }
+  if (opts.isSufficientNumMatchesSet()) {
+    while (merged.size() > opts.getSufficientNumMatches()) merged.erase(--merged.end());
+  }
+  merged.clearTempData();
+  return merged;
+}
+
+vector<fasstSolutionSet> FASST::searchBatch(const vector<Structure>& queries, const vector<fasstSearchOptions>& queryOpts, bool autoSplitChains) {
+  MstProfiler::scope prof("FASST::searchBatch");
+  int numQueries = queries.size();
+  if (!queryOpts.empty() && (queryOpts.size() != numQueries)) MstUtils::error("got " + MstUtils::toString(queryOpts.size()) + " option sets for " + MstUtils::toString(numQueries) + " queries", "FASST::searchBatch");
+  vector<fasstSolutionSet> results(numQueries);
+  if (numQueries == 0) return results;
+
+  vector<FASST*> searchers(numQueries);
+  for (int q = 0; q < numQueries; q++) {
+    searchers[q] = newSearcher();
+    searchers[q]->setOptions(queryOpts.empty() ? opts : queryOpts[q]);
+    searchers[q]->setQuery(queries[q], autoSplitChains);
+    if (searchers[q]->options().isRedundancyPropertySet()) searchers[q]->getRedundancyPropertyMap();
+  }
+
+  // each worker takes an interleaved subset of queries and walks the database
+  // once for all of them, dropping queries as they finish early
+  int numWorkers = MstUtils::min(numThreads, numQueries);
+  int numTargs = db->targets.size();
+  try {
+    MstUtils::parallelFor(numWorkers, numWorkers, [&](int w, int) {
+      vector<FASST*> active;
+      for (int q = w; q < numQueries; q += numWorkers) {
+        searchers[q]->initSearch();
+        searchers[q]->boundTargets();
+        searchers[q]->targetOrder.clear(); // queries share the walk over the database, in database order
+        active.push_back(searchers[q]);
+      }
+      for (int ti = 0; (ti < numTargs) && !active.empty(); ti++) {
+        int k = 0;
+        for (int i = 0; i < active.size(); i++) {
+          if (active[i]->searchTarget(ti)) active[k++] = active[i];
+        }
+        active.resize(k);
+      }
+    });
+  } catch (...) {
+    for (int q = 0; q < numQueries; q++) delete searchers[q];
+    throw;
+  }
+  stats.reset();
+  for (int q = 0; q < numQueries; q++) {
+    searchers[q]->collectSolutions();
+    searchers[q]->solutions.clearTempData();
+    results[q] = searchers[q]->solutions;
+    stats += searchers[q]->stats;
+    delete searchers[q];
+  }
+  return results;
+}
+
 mstreal FASST::currentAlignmentResidual(bool compute, bool setTransform) {
   if (compute) {
     if ((query.size() == 1) && !setTransform) {
@@ -1010,19 +2315,23 @@ mstreal FASST::currentAlignmentResidual(bool compute, bool setTransform) {
       // locations for subsequent sub-queries
       currResidual = segmentResiduals[0][currAlignment[0]];
     } else {
-      // fill up sub-alignment with target atoms
-      AtomPointerVector& queryMask = queryMasks[recLevel];
-      AtomPointerVector& targetMask = targetMasks[recLevel];
-      int N = targetMask.size();
+      // fill up sub-alignment with target coordinates; the sub-alignment at
+      // this level is the first N points of the packed query and target masks
+      int N = queryMasks[recLevel].size();
       int n = query[recLevel].size();
       int dN = N - n;
       int currPos = currAlignment[recLevel];
       int si = resToAtomIdx(currPos);
-      AtomPointerVector& target = targets[currentTarget];
-      for (int i = 0; i < n; i++) {
-        targetMask[dN + i]->setCoor(target[si + i]->getX(), target[si + i]->getY(), target[si + i]->getZ());
+      mstreal* dest = targetMaskCoor.data() + 3*dN;
+      const float* mapped = db->mappedCoordinates(currentTarget);
+      if (mapped == NULL) {
+        const mstcoor* src = db->targetCoords[currentTarget].data() + 3*si;
+        for (int k = 0; k < 3*n; k++) dest[k] = src[k];
+      } else {
+        const float* src = mapped + 3*si;
+        for (int k = 0; k < 3*n; k++) dest[k] = src[k];
       }
-      currResidual = RC.bestResidual(targetMask, queryMask, setTransform);
+      currResidual = RC.bestResidual(targetMaskCoor.data(), queryMaskCoor.data(), N, setTransform);
       currResiduals[recLevel] = currResidual;
       if (query.size() > 1) {
         if (recLevel == 0) {
@@ -1060,59 +2369,87 @@ Structure FASST::getMatchStructure(const fasstSolution& sol, bool detailed, matc
 }
 
 void FASST::getMatchStructures(fasstSolutionSet& sols, vector<Structure>& matches, bool detailed, matchType type, bool algn) {
+  matches.resize(sols.size(), Structure());
+  visitMatchStructures(sols, [&](int i, const Structure& match) { matches[i] = match; }, detailed, type, algn);
+}
+
+void FASST::visitMatchStructures(fasstSolutionSet& sols, const function<void(int, const Structure&)>& visitor, bool detailed, matchType type, bool algn) {
+  MstProfiler::scope prof("FASST::visitMatchStructures");
   // hash solutions by the target they come from, to visit each target only once
   map<int, vector<int> > solsFromTarget;
   for (int i = 0; i < sols.size(); i++) {
     const fasstSolution& sol = sols[i];
     int idx = sol.getTargetIndex();
     if ((idx < 0) || (idx >= targets.size())) {
-      MstUtils::error("supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchStructures");
+      MstUtils::error("supplied FASST solution is pointing to an out-of-range target", "FASST::visitMatchStructures");
     }
     solsFromTarget[idx].push_back(i);
   }
 
+  // order targets by where they live on disk, so that re-reading is sequential
+  vector<int> targetOrder;
+  for (auto it = solsFromTarget.begin(); it != solsFromTarget.end(); ++it) targetOrder.push_back(it->first);
+  sort(targetOrder.begin(), targetOrder.end(), [&](int i, int j) {
+    int c = targetSource[i].file.compare(targetSource[j].file);
+    return (c != 0) ? (c < 0) : (targetSource[i].loc < targetSource[j].loc);
+  });
+
   // visit each target
-  Structure dummy; RMSDCalculator rc;
-  AtomPointerVector matchAtoms;
-  matches.resize(sols.size(), Structure());
-  for (auto it = solsFromTarget.begin(); it != solsFromTarget.end(); ++it) {
-    int idx = it->first;
+  Structure dummy, match;
+  fstream ifs; string openFile;
+  for (int ti = 0; ti < targetOrder.size(); ti++) {
+    int idx = targetOrder[ti];
     Structure* targetStruct = targetStructs[idx];
     AtomPointerVector& target = targets[idx];
     bool reread = (detailed && targetSource[idx].memSave) || (targetStruct == NULL); // should we re-read the target structure?
     Transform& transf = tr[idx];
-    if (reread) {
+    shared_ptr<Structure> full; // keeps a cached target alive while its matches are cut out
+    if (reread) full = cachedTarget(idx);
+    if (reread && (full == NULL)) {
       dummy.reset();
       // re-read structure
       if (targetSource[idx].type == targetFileType::PDB) {
         dummy.readPDB(targetSource[idx].file, "QUIET");
       } else if (targetSource[idx].type == targetFileType::BINDATABASE) {
-        fstream ifs; MstUtils::openFile(ifs, targetSource[idx].file, fstream::in | fstream::binary, "FASST::getMatchStructures");
+        if (!ifs.is_open() || (openFile != targetSource[idx].file)) {
+          if (ifs.is_open()) ifs.close();
+          MstUtils::openFile(ifs, targetSource[idx].file, fstream::in | fstream::binary, "FASST::visitMatchStructures");
+          openFile = targetSource[idx].file;
+        }
         ifs.seekg(targetSource[idx].loc);
         dummy.readData(ifs);
-        ifs.close();
+      } else if (targetSource[idx].type == targetFileType::MAPPEDDATABASE) {
+        if (detailed) MstUtils::error("cannot produce a detailed match for a target from a mapped database", "FASST::visitMatchStructures");
+        dummy = mappedTargetStructure(idx);
       } else if (targetSource[idx].type == targetFileType::STRUCTURE) {
-        MstUtils::error("cannot produce a detailed match if target was initialized from object", "FASST::getMatchStructures");
+        MstUtils::error("cannot produce a detailed match if target was initialized from object", "FASST::visitMatchStructures");
       } else {
-        MstUtils::error("don't know how to re-read target of this type", "FASST::getMatchStructures");
+        MstUtils::error("don't know how to re-read target of this type", "FASST::visitMatchStructures");
       }
       transf.apply(dummy);
-      targetStruct = &dummy;
-      if (!detailed) stripSidechains(*targetStruct);
+      if ((cacheBudget > 0) && (targetSource[idx].type != targetFileType::MAPPEDDATABASE)) full = cacheTarget(idx, dummy);
+    }
+    if (reread) {
+      if ((full != NULL) && detailed) {
+        targetStruct = full.get();
+      } else {
+        if (full != NULL) dummy = *full;
+        targetStruct = &dummy;
+        if (!detailed) stripSidechains(*targetStruct);
+      }
     }
 
     // visit each solution from this target
-    vector<int>& solIndices = it->second;
+    vector<int>& solIndices = solsFromTarget[idx];
     for (int i = 0; i < solIndices.size(); i++) {
       int solIndex = solIndices[i];
       const fasstSolution& sol = sols[solIndex];
-      Structure& match = matches[solIndex];
-      match.setName(targetStruct->getName());
 
-      // cut out the part of the target Structure that will constitute the returned match
+      // cut out the part of the target Structure that will constitute the match
       if (type == matchType::FULL) {
         match = *targetStruct;
       } else {
+        match.reset();
         vector<int> resIndices = getMatchResidueIndices(sol, type);
         for (auto ri = resIndices.begin(); ri != resIndices.end(); ri++) {
           if (targetStructs[idx] == NULL) {
@@ -1124,6 +2461,7 @@ void FASST::getMatchStructures(fasstSolutionSet& sols, vector<Structure>& matche
           }
         }
       }
+      match.setName(targetStruct->getName());
 
       // align matching region onto query, transforming the match itself
       if (algn) {
@@ -1131,8 +2469,10 @@ void FASST::getMatchStructures(fasstSolutionSet& sols, vector<Structure>& matche
       } else {
         transf.inverse().apply(match);
       }
+      visitor(solIndex, match);
     }
   }
+  if (ifs.is_open()) ifs.close();
 }
 
 vector<Sequence> FASST::getMatchSequences(fasstSolutionSet& sols, matchType type) {
@@ -1140,13 +2480,14 @@ vector<Sequence> FASST::getMatchSequences(fasstSolutionSet& sols, matchType type
   for (int i = 0; i < sols.size(); i++) {
     const fasstSolution& sol = sols[i];
     int idx = sol.getTargetIndex();
-    MstUtils::assertCond((idx >= 0) && (idx < targSeqs.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchSequences");
+    MstUtils::assertCond((idx >= 0) && (idx < db->targSeqs.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchSequences");
     vector<int> alignment = sol.getAlignment();
-    seqs[i].setName(targSeqs[idx].getName());
+    const Sequence& targSeq = db->targSeqs[idx];
+    seqs[i].setName(targSeq.getName());
 
     // isolate out the part of the target Sequence that will constitute the returned match
     vector<int> resIndices = getMatchResidueIndices(sol, type);
-    for (auto ri = resIndices.begin(); ri != resIndices.end(); ri++) seqs[i].appendResidue(targSeqs[idx][*ri]);
+    for (auto ri = resIndices.begin(); ri != resIndices.end(); ri++) seqs[i].appendResidue(targSeq[*ri]);
   }
   return seqs;
 }
@@ -1165,17 +2506,18 @@ vector<mstreal> FASST::getResidueProperties(const fasstSolution& sol, const stri
 
 vector<vector<mstreal> > FASST::getResidueProperties(fasstSolutionSet& sols, const string& propType, matchType type) {
   vector<vector<mstreal> > props(sols.size());
+  int propID = getResiduePropertyID(propType);
   for (int i = 0; i < sols.size(); i++) {
     const fasstSolution& sol = sols[i];
     int idx = sol.getTargetIndex();
-    MstUtils::assertCond((idx >= 0) && (idx < targets.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchSequences");
-    AtomPointerVector& target = targets[idx];
+    MstUtils::assertCond((idx >= 0) && (idx < db->targets.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchSequences");
+    AtomPointerVector& target = db->targets[idx];
     if (!isResiduePropertyDefined(propType, idx)) {
       MstUtils::error("target with index " + MstUtils::toString(idx) + " does not have property type " + propType, "FASST::getResidueProperties(fasstSolutionSet&, const string&, matchType)");
     }
-    vector<mstreal>& propVals = resProperties[propType][idx];
     vector<int> resIndices = getMatchResidueIndices(sol, type);
     props[i].resize(resIndices.size()); int ii = 0;
+    const mstreal* propVals = db->props.values(propID, idx);
     for (auto ri = resIndices.begin(); ri != resIndices.end(); ri++, ii++) {
       // if we have the full structure, then we have the ability to differentiate
       // between the original structure and the part that is searched over (e.g.,
@@ -1183,18 +2525,20 @@ vector<vector<mstreal> > FASST::getResidueProperties(fasstSolutionSet& sols, con
       // mode where the original structure was not saved, that implies that all
       // residues in the original structure made it to the portion being searched
       // over (otherwise, discarding the original would have been caught as an error)
-      props[i][ii] = (targetStructs[idx] != NULL) ? propVals[target[resToAtomIdx(*ri)]->getResidue()->getResidueIndex()] : propVals[*ri];
+      props[i][ii] = (db->targetStructs[idx] != NULL) ? propVals[target[resToAtomIdx(*ri)]->getResidue()->getResidueIndex()] : propVals[*ri];
     }
   }
   return props;
 }
 
 bool FASST::isResiduePropertyDefined(const string& propType, int ti) {
-  return ((resProperties.find(propType) != resProperties.end()) || (resProperties[propType].find(ti) != resProperties[propType].end()));
+  // reads only the database, so may be called on searchers borrowing it
+  int propID = getResiduePropertyID(propType);
+  return (propID >= 0) && (ti >= 0) && (ti < db->props.numTargets()) && (db->props.values(propID, ti) != NULL);
 }
 
 bool FASST::isResiduePropertyDefined(const string& propType) {
-  return (resProperties.find(propType) != resProperties.end());
+  return (getResiduePropertyID(propType) >= 0);
 }
 
 bool FASST::isResidueStringPropertyDefined(const string& propType, int ti) {
@@ -1241,8 +2585,8 @@ vector<int> FASST::getMatchResidueIndices(const fasstSolution& sol, matchType ty
     }
     case matchType::FULL: {
       int idx = sol.getTargetIndex();
-      MstUtils::assertCond((idx >= 0) && (idx < targetStructs.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchResidueIndices");
-      for (int i = 0; i < getTargetResidueSize(idx); i++) residueIndices.push_back(i);
+      MstUtils::assertCond((idx >= 0) && (idx < db->targetStructs.size()), "supplied FASST solution is pointing to an out-of-range target", "FASST::getMatchResidueIndices");
+      for (int i = 0; i < db->getTargetResidueSize(idx); i++) residueIndices.push_back(i);
       break;
     }
     default:
@@ -1252,33 +2596,72 @@ vector<int> FASST::getMatchResidueIndices(const fasstSolution& sol, matchType ty
   return residueIndices;
 }
 
+void FASST::setWarmStart(const fasstSolutionSet& sols) {
+  warmStart.clear();
+  for (auto it = sols.begin(); it != sols.end(); ++it) warmStart.push_back(it->getAddress());
+}
+
+vector<mstreal> FASST::warmStartRMSDs() {
+  // keep only the seeds that can be placed with the current query segments
+  vector<int> segLengths(queryOrig.size());
+  for (int i = 0; i < queryOrig.size(); i++) segLengths[i] = atomToResIdx(queryOrig[i].size());
+  vector<fasstSolutionAddress> fits;
+  for (const fasstSolutionAddress& addr : warmStart) {
+    if ((addr.targetIndex < 0) || (addr.targetIndex >= db->targets.size()) || (addr.alignment.size() != segLengths.size())) continue;
+    int numRes = atomToResIdx(db->searchableAtomSize(addr.targetIndex)), i;
+    for (i = 0; i < segLengths.size(); i++) {
+      if ((addr.alignment[i] < 0) || (addr.alignment[i] + segLengths[i] > numRes)) break;
+    }
+    if (i == segLengths.size()) fits.push_back(addr);
+  }
+  if (fits.empty()) return vector<mstreal>();
+  fasstSolutionSet seeds(fits, segLengths);
+  vector<mstreal> rmsds = matchRMSDs(seeds, getQuerySearchedAtoms());
+  sort(rmsds.begin(), rmsds.end());
+  return rmsds;
+}
+
 vector<mstreal> FASST::matchRMSDs(fasstSolutionSet& sols, const AtomPointerVector& query, bool update) {
   vector<mstreal> rmsds(sols.size(), 0);
   if (sols.size() == 0) return rmsds;
-  AtomPointerVector match(query.size(), NULL);
+  vector<mstreal> queryCoor(3*query.size()), match(3*query.size());
+  for (int i = 0; i < query.size(); i++) {
+    for (int k = 0; k < 3; k++) queryCoor[3*i + k] = (*(query[i]))[k];
+  }
   RMSDCalculator rc;
+  // without updates, no transformations are needed, so gather all matches and
+  // compute their RMSDs with the batch kernel
+  vector<mstreal> allMatches;
+  vector<const mstreal*> matchPtrs;
+  if (!update) allMatches.resize(3*query.size()*sols.size());
   for (int c = 0; c < sols.size(); c++) {
     fasstSolution& sol = sols[c];
+    mstreal* dest = update ? match.data() : allMatches.data() + 3*query.size()*c;
     int idx = sol.getTargetIndex();
-    AtomPointerVector& target = targets[idx];
+    const float* mapped = db->mappedCoordinates(idx);
     int k = 0;
     for (int i = 0; i < sol.numSegments(); i++) {
       int si = sol[i];
       int L = sol.segLength(i);
-      if (k + resToAtomIdx(L) > match.size()) MstUtils::error("solution alignment size is larger than the specified query", "FASST::matchRMSDs(const fasstSolutionSet& sols, AtomPointerVector& query)");
+      if (k + resToAtomIdx(L) > query.size()) MstUtils::error("solution alignment size is larger than the specified query", "FASST::matchRMSDs(const fasstSolutionSet& sols, AtomPointerVector& query)");
       for (int ri = si; ri < si + L; ri++) {
-        for (int ai = resToAtomIdx(ri); ai < resToAtomIdx(ri) + atomsPerRes; ai++) {
-          match[k] = target[ai]; k++;
+        for (int ai = resToAtomIdx(ri); ai < resToAtomIdx(ri) + atomsPerRes; ai++, k++) {
+          for (int d = 0; d < 3; d++) dest[3*k + d] = (mapped == NULL) ? db->targetCoords[idx][3*ai + d] : mapped[3*ai + d];
         }
       }
     }
-    if (k != match.size()) MstUtils::error("solution alignment size is smaller than the specified query", "FASST::matchRMSDs(const fasstSolutionSet& sols, AtomPointerVector& query)");
-    rmsds[c] = rc.bestRMSD(match, query, update);
+    if (k != query.size()) MstUtils::error("solution alignment size is smaller than the specified query", "FASST::matchRMSDs(const fasstSolutionSet& sols, AtomPointerVector& query)");
     if (update) {
+      rmsds[c] = rc.bestRMSD(match.data(), queryCoor.data(), query.size(), true);
       sol.setTransform(Transform(rc.lastRotation(), rc.lastTranslation()));
       sol.setRMSD(rmsds[c]);
     }
   }
+  if (!update) {
+    matchPtrs.resize(sols.size());
+    for (int c = 0; c < sols.size(); c++) matchPtrs[c] = allMatches.data() + 3*query.size()*c;
+    rc.qcpRMSDBatch(queryCoor.data(), query.size(), matchPtrs.data(), sols.size(), rmsds.data());
+  }
   return rmsds;
 }
 
@@ -1292,9 +2675,9 @@ string FASST::toString(const fasstSolution& sol) {
 
 void FASST::addSequenceContext(fasstSolution& sol) {
   int currentTarget = sol.getTargetIndex();
-  Sequence& targSeq = targSeqs[currentTarget];
+  Sequence& targSeq = db->targSeqs[currentTarget];
   if (targChainEnd.empty()) FASST::fillTargetChainInfo(currentTarget);
-  sol.addSequenceContext(targSeqs[currentTarget], opts.getContextLength(), targChainBeg, targChainEnd);
+  sol.addSequenceContext(targSeq, opts.getContextLength(), targChainBeg, targChainEnd);
 }
 
 void FASST::addSequenceContext(fasstSolutionSet& sols) {
@@ -1312,13 +2695,21 @@ void FASST::addSequenceContext(fasstSolutionSet& sols) {
 
 /* --------- fasstSolution --------- */
 fasstSolution::fasstSolution(const vector<int>& _alignment, mstreal _rmsd, int _target, const Transform& _tr, const vector<int>& _segLengths, vector<int> segOrder) {
-  alignment = _alignment; rmsd = _rmsd; targetIndex = _target; segLengths = _segLengths; tr = _tr;
+  alignment = _alignment; rmsd = _rmsd; targetIndex = _target; tr = _tr;
+  vector<int> lengths = _segLengths;
   if (!segOrder.empty()) {
     for (int i = 0; i < _alignment.size(); i++) {
       alignment[segOrder[i]] = _alignment[i];
-      segLengths[segOrder[i]] = _segLengths[i];
+      lengths[segOrder[i]] = _segLengths[i];
     }
   }
+  segLengths = make_shared<const vector<int> >(lengths);
+  context = NULL;
+}
+
+fasstSolution::fasstSolution(const vector<int>& _alignment, mstreal _rmsd, int _target, const Transform& _tr, const shared_ptr<const vector<int> >& _segLengths) {
+  alignment = _alignment; rmsd = _rmsd; targetIndex = _target; tr = _tr;
+  segLengths = _segLengths;
   context = NULL;
 }
 
@@ -1329,7 +2720,9 @@ fasstSolution::fasstSolution(const fasstSolution& _sol) {
   else context = NULL;
 }
 
-fasstSolution::fasstSolution(const fasstSolutionAddress& addr, const vector<int> segLen) {
+fasstSolution::fasstSolution(const fasstSolutionAddress& addr, const vector<int> segLen) : fasstSolution(addr, make_shared<const vector<int> >(segLen)) {}
+
+fasstSolution::fasstSolution(const fasstSolutionAddress& addr, const shared_ptr<const vector<int> >& segLen) {
   alignment = addr.alignment;
   targetIndex = addr.targetIndex;
   segLengths = segLen;
@@ -1353,7 +2746,7 @@ void fasstSolution::write(ostream& _os) const {
   MstUtils::writeBin(_os, (int) alignment.size());
   for (int i = 0; i < alignment.size(); i++) {
     MstUtils::writeBin(_os, alignment[i]);
-    MstUtils::writeBin(_os, segLengths[i]);
+    MstUtils::writeBin(_os, (*segLengths)[i]);
   }
   tr.write(_os);
   if (context == NULL) MstUtils::writeBin(_os, false);
@@ -1364,11 +2757,13 @@ void fasstSolution::read(istream& _is) {
   MstUtils::readBin(_is, rmsd);
   MstUtils::readBin(_is, targetIndex);
   int len; MstUtils::readBin(_is, len);
-  alignment.resize(len); segLengths.resize(len);
+  alignment.resize(len);
+  vector<int> lengths(len);
   for (int i = 0; i < alignment.size(); i++) {
     MstUtils::readBin(_is, alignment[i]);
-    MstUtils::readBin(_is, segLengths[i]);
+    MstUtils::readBin(_is, lengths[i]);
   }
+  segLengths = make_shared<const vector<int> >(lengths);
   tr.read(_is);
   bool hasCont; MstUtils::readBin(_is, hasCont);
   if (context != NULL) { delete(context); context = NULL; }
@@ -1431,6 +2826,39 @@ void fasstSolutionAddress::read(istream& _is) {
   for (int i = 0; i < alignment.size(); i++) MstUtils::readBin(_is, alignment[i]);
 }
 
+/* --------- fasstSolutionHeap --------- */
+bool fasstSolutionHeap::before(const record& a, const record& b) const {
+  if (a.rmsd != b.rmsd) return a.rmsd < b.rmsd;
+  if (a.targetIndex != b.targetIndex) return a.targetIndex < b.targetIndex;
+  const int* algnA = &(alignments[a.slot * numSegs]);
+  const int* algnB = &(alignments[b.slot * numSegs]);
+  for (int k = 0; k < numSegs; k++) {
+    if (algnA[k] != algnB[k]) return algnA[k] < algnB[k];
+  }
+  return false;
+}
+
+void fasstSolutionHeap::push(const int* alignment, mstreal rmsd, int targetIndex) {
+  record r;
+  r.rmsd = rmsd; r.targetIndex = targetIndex;
+  if (freeSlots.empty()) {
+    r.slot = alignments.size() / MstUtils::max(numSegs, 1);
+    alignments.resize(alignments.size() + numSegs);
+  } else {
+    r.slot = freeSlots.back();
+    freeSlots.pop_back();
+  }
+  for (int k = 0; k < numSegs; k++) alignments[r.slot * numSegs + k] = alignment[k];
+  heap.push_back(r);
+  push_heap(heap.begin(), heap.end(), [this](const record& a, const record& b) { return before(a, b); });
+}
+
+void fasstSolutionHeap::popWorst() {
+  pop_heap(heap.begin(), heap.end(), [this](const record& a, const record& b) { return before(a, b); });
+  freeSlots.push_back(heap.back().slot);
+  heap.pop_back();
+}
+
 /* --------- fasstSolutionSet --------- */
 fasstSolutionSet::fasstSolutionSet(const fasstSolutionSet& sols) {
   *this = sols;
@@ -1443,7 +2871,8 @@ fasstSolutionSet::fasstSolutionSet(const fasstSolution& sol) {
 
 fasstSolutionSet::fasstSolutionSet(const vector<fasstSolutionAddress>& addresses, const vector<int>& segLengths) {
   updated = false;
-  for (int i = 0; i < addresses.size(); i++) insert(fasstSolution(addresses[i], segLengths));
+  shared_ptr<const vector<int> > lengths = make_shared<const vector<int> >(segLengths);
+  for (int i = 0; i < addresses.size(); i++) insert(fasstSolution(addresses[i], lengths));
 }
 
 fasstSolutionSet& fasstSolutionSet::operator=(const fasstSolutionSet& sols) {
@@ -1480,11 +2909,15 @@ bool fasstSolutionSet::insert(const fasstSolution& sol, mstreal redundancyCut) {
          * by constructoin, we can deduce max(L, Li) as Li + max(0, L - Li). */
         int contextLength = segSeqs[i].size() + nTermPad[i].size();
 
-        // first the segment itself
-        for (int k = 0; k < segSeqs[i].size(); k++) {
-          numTot++;
-          if (segSeqs[i][k] == segSeqsPrev[i][k]) numID++;
-        }
+        /* first the segment itself. The alignment can not grow beyond
+         * contextLength, and the effective cutoff for shorter alignments is
+         * only higher, so more than contextLength * (1 - redundancyCut)
+         * mismatches here means that the segment can not be redundant. */
+        int maxMismatches = (int) floor(contextLength * (1 - redundancyCut) + 10E-9);
+        int numMis = SeqTools::countMismatches(segSeqs[i].data(), segSeqsPrev[i].data(), segSeqs[i].size(), maxMismatches);
+        if (numMis > maxMismatches) continue;
+        numTot = segSeqs[i].size();
+        numID = numTot - numMis;
 
         // then alternate expanding in C- and N-terminal directions
         bool nEnd = false, cEnd = false;
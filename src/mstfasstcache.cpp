@@ -1,41 +1,374 @@
 #include "mstfasstcache.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cstring>
 
-/* --------- cFASST --------- */
-void cFASST::write(const string& filename) const {
-  fstream out;
-  MstUtils::openFile(out, filename, fstream::out | fstream::binary, "cFASST::write");
-  write(out);
-  out.close();
+/* --------- fasstCacheStore --------- */
+fasstCacheStore::fasstCacheStore(int max) {
+  maxNumResults = max;
+  sf = 10.0;
+  maxNumPressure = (exp(1.0) - 1.0)*maxNumResults/sf; // so that max factor is 2.0 at the start
+  errTolPressure = (exp(0.1) - 1.0)*maxNumResults/sf; // so that error factor is 1.1 at the start
+  state = make_shared<contents>();
+  clock = 0;
+  logAppend = false;
+  logGeneration = 0; logOffset = 0; logRecords = 0;
+  idEngine.seed(random_device()());
 }
 
-void cFASST::write(ostream &_os) const {
-  MstUtils::writeBin(_os, maxNumResults);
-  MstUtils::writeBin(_os, errTolPressure);
-  MstUtils::writeBin(_os, maxNumPressure);
-  MstUtils::writeBin(_os, sf);
-  MstUtils::writeBin(_os, (int) cache.size());
-  for (auto it = cache.begin(); it != cache.end(); ++it) (*it)->write(_os);
+void fasstCacheStore::addPressure(atomic<mstreal>& pressure, mstreal del) {
+  mstreal curr = pressure;
+  while (!pressure.compare_exchange_weak(curr, MstUtils::max(curr + del, 0.0)));
 }
 
-void cFASST::read(const string& filename) {
-  fstream in;
-  MstUtils::openFile(in, filename, fstream::in | fstream::binary, "cFASST::read");
-  read(in);
-  in.close();
+/* A priority p at time t is stored as the score log(p) + t*decayRate(), which
+ * does not change as time passes, while the priority it corresponds to at any
+ * later time t' is exp(score - t'*decayRate()). So ordering entries by score
+ * is ordering them by current priority. */
+mstreal fasstCacheStore::getPriority(const cachedResult& result) const {
+  return exp(result.score - clock*decayRate());
 }
 
-void cFASST::read(istream &_is) { // read object from a binary stream
-  clear();
+void fasstCacheStore::upPriority(cachedResult& result, mstreal del) {
+  mstreal now = clock*decayRate();
+  mstreal curr = result.score;
+  while (!result.score.compare_exchange_weak(curr, log(exp(curr - now) + del) + now));
+}
+
+void fasstCacheStore::insert(cachedResult* result) {
+  shared_ptr<cachedResult> res(result);
+  lock_guard<mutex> lock(writeLock);
+  shared_ptr<contents> updated = make_shared<contents>(*state);
+  addEntry(*updated, res, clock*decayRate()); // priority 1 now
+  atomic_store(&state, updated);
+  appendToLog(*res);
+}
+
+bool fasstCacheStore::addEntry(contents& updated, const shared_ptr<cachedResult>& res, mstreal score) {
+  if (res->id == 0) {
+    do { res->id = idEngine(); } while ((res->id == 0) || (knownIds.find(res->id) != knownIds.end()));
+  } else if (knownIds.find(res->id) != knownIds.end()) {
+    return false;
+  }
+  knownIds.insert(res->id);
+  res->score = score;
+  updated.add(res);
+  const entryList& entries = updated.entries;
+  if (entries.size() > maxNumResults) {
+    // bump off the least useful entry (lowest priority; then largest)
+    int worst = 0;
+    for (int i = 1; i < entries.size(); i++) {
+      const cachedResult& ri = *(entries[i]);
+      const cachedResult& rw = *(entries[worst]);
+      if (ri.score != rw.score) { if (ri.score < rw.score) worst = i; }
+      else if (ri.solSet.size() != rw.solSet.size()) { if (ri.solSet.size() > rw.solSet.size()) worst = i; }
+      else if (ri.query.size() > rw.query.size()) worst = i;
+    }
+    updated.remove(worst);
+  }
+  return true;
+}
+
+void fasstCacheStore::clear() {
+  lock_guard<mutex> lock(writeLock);
+  atomic_store(&state, make_shared<contents>());
+}
+
+void fasstCacheStore::write(ostream &_os) const {
+  const entryList& current = snapshot()->getEntries();
+  MstUtils::writeBin(_os, maxNumResults);
+  MstUtils::writeBin(_os, (mstreal) errTolPressure);
+  MstUtils::writeBin(_os, (mstreal) maxNumPressure);
+  MstUtils::writeBin(_os, sf);
+  MstUtils::writeBin(_os, (int) current.size());
+  for (int i = 0; i < current.size(); i++) {
+    const cachedResult& res = *(current[i]);
+    MstUtils::writeBin(_os, res.topology);
+    MstUtils::writeBin(_os, getPriority(res));
+    res.write(_os);
+  }
+}
+
+void fasstCacheStore::read(istream &_is) { // read object from a binary stream
+  mstreal p;
+  lock_guard<mutex> lock(writeLock);
   MstUtils::readBin(_is, maxNumResults);
-  MstUtils::readBin(_is, errTolPressure);
-  MstUtils::readBin(_is, maxNumPressure);
+  MstUtils::readBin(_is, p); errTolPressure = p;
+  MstUtils::readBin(_is, p); maxNumPressure = p;
   MstUtils::readBin(_is, sf);
   int numResults; MstUtils::readBin(_is, numResults);
+  shared_ptr<contents> updated = make_shared<contents>();
   for (int i = 0; i < numResults; i++) {
     cachedResult* result = new cachedResult();
+    MstUtils::readBin(_is, result->topology);
+    MstUtils::readBin(_is, p);
+    result->score = log(p) + clock*decayRate();
     result->read(_is);
-    cache.insert(result);
+    do { result->id = idEngine(); } while ((result->id == 0) || (knownIds.find(result->id) != knownIds.end()));
+    knownIds.insert(result->id);
+    updated->add(shared_ptr<cachedResult>(result));
+  }
+  atomic_store(&state, updated);
+}
+
+/* --------- fasstCacheStore: cache logs --------- */
+void fasstCacheStore::appendToLog(const cachedResult& res) {
+  lock_guard<mutex> lock(logLock);
+  if (logFile.empty() || !logAppend) return;
+  // a single write to a file opened for appending, so that records from
+  // different processes do not interleave
+  string rec = logRecord(res, getPriority(res));
+  int fd = open(logFile.c_str(), O_WRONLY | O_APPEND);
+  if (fd < 0) MstUtils::error("could not open cache log '" + logFile + "' for appending", "fasstCacheStore::appendToLog");
+  for (int done = 0; done < rec.size(); ) {
+    ssize_t n = ::write(fd, rec.data() + done, rec.size() - done);
+    if (n < 0) { close(fd); MstUtils::error("could not append to cache log '" + logFile + "'", "fasstCacheStore::appendToLog"); }
+    done += n;
   }
+  close(fd);
+}
+
+unsigned int fasstCacheStore::checksum(const char* data, int len) {
+  unsigned int h = 2166136261u; // FNV-1a
+  for (int i = 0; i < len; i++) { h ^= (unsigned char) data[i]; h *= 16777619u; }
+  return h;
+}
+
+string fasstCacheStore::logRecord(const cachedResult& res, mstreal priority) {
+  stringstream payload, rec;
+  MstUtils::writeBin(payload, res.id);
+  MstUtils::writeBin(payload, res.topology);
+  MstUtils::writeBin(payload, priority);
+  res.write(payload);
+  string data = payload.str();
+  MstUtils::writeBin(rec, (unsigned int) data.size());
+  MstUtils::writeBin(rec, checksum(data.data(), data.size()));
+  rec.write(data.data(), data.size());
+  return rec.str();
+}
+
+fasstCacheStore::cachedResult* fasstCacheStore::parseLogRecord(const string& payload, mstreal& priority) {
+  stringstream in(payload);
+  cachedResult* result = new cachedResult();
+  MstUtils::readBin(in, result->id);
+  MstUtils::readBin(in, result->topology);
+  MstUtils::readBin(in, priority);
+  result->read(in);
+  if (!in) { delete result; return NULL; }
+  return result;
+}
+
+bool fasstCacheStore::readLogHeader(istream& _is, unsigned long long& generation) {
+  string magic; int ver;
+  MstUtils::readBin(_is, magic);
+  if (!_is || (magic != "MSTFCLOG")) return false;
+  MstUtils::readBin(_is, ver);
+  if (ver != 1) MstUtils::error("unknown cache log version " + MstUtils::toString(ver), "fasstCacheStore::readLogHeader");
+  MstUtils::readBin(_is, generation);
+  return (bool) _is;
+}
+
+bool fasstCacheStore::isLogFile(const string& file) {
+  ifstream in(file.c_str(), ios::in | ios::binary);
+  unsigned long long gen;
+  return in && readLogHeader(in, gen);
+}
+
+void fasstCacheStore::writeLog(const string& file) const {
+  unsigned long long gen; long size;
+  writeLog(file, gen, size);
+}
+
+void fasstCacheStore::writeLog(const string& file, unsigned long long& generation, long& size) const {
+  random_device rd;
+  do { generation = (((unsigned long long) rd()) << 32) | rd(); } while (generation == 0);
+  string tmp = file + ".tmp" + MstUtils::toString(generation);
+  fstream out;
+  MstUtils::openFile(out, tmp, fstream::out | fstream::binary, "fasstCacheStore::writeLog");
+  MstUtils::writeBin(out, string("MSTFCLOG")); MstUtils::writeBin(out, (int) 1); // format version
+  MstUtils::writeBin(out, generation);
+  const entryList& current = snapshot()->getEntries();
+  for (int i = 0; i < current.size(); i++) {
+    string rec = logRecord(*(current[i]), getPriority(*(current[i])));
+    out.write(rec.data(), rec.size());
+  }
+  size = out.tellp();
+  out.close();
+  if (rename(tmp.c_str(), file.c_str()) != 0) MstUtils::error("could not replace cache log '" + file + "'", "fasstCacheStore::writeLog");
+}
+
+void fasstCacheStore::attachLog(const string& file, bool append) {
+  {
+    lock_guard<mutex> lock(logLock);
+    struct stat st;
+    if (stat(file.c_str(), &st) != 0) {
+      if (!append) MstUtils::error("cache log '" + file + "' does not exist", "fasstCacheStore::attachLog");
+      int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_EXCL, 0666);
+      if (fd >= 0) {
+        stringstream header;
+        MstUtils::writeBin(header, string("MSTFCLOG")); MstUtils::writeBin(header, (int) 1); // format version
+        unsigned long long gen;
+        do { gen = idEngine(); } while (gen == 0);
+        MstUtils::writeBin(header, gen);
+        string h = header.str();
+        bool ok = (::write(fd, h.data(), h.size()) == h.size());
+        close(fd);
+        if (!ok) MstUtils::error("could not create cache log '" + file + "'", "fasstCacheStore::attachLog");
+      } else if (errno != EEXIST) {
+        MstUtils::error("could not create cache log '" + file + "'", "fasstCacheStore::attachLog");
+      } // else, someone else just created it
+    } else if ((st.st_size > 0) && !isLogFile(file)) {
+      MstUtils::error("'" + file + "' is not a FASST cache log", "fasstCacheStore::attachLog");
+    }
+    logFile = file;
+    logAppend = append;
+    logGeneration = 0; logOffset = 0; logRecords = 0;
+  }
+  syncLog();
+}
+
+void fasstCacheStore::detachLog() {
+  lock_guard<mutex> lock(logLock);
+  logFile.clear();
+}
+
+bool fasstCacheStore::isLogAttached() {
+  lock_guard<mutex> lock(logLock);
+  return !logFile.empty();
+}
+
+int fasstCacheStore::syncLog() {
+  vector<pair<cachedResult*, mstreal> > loaded;
+  bool compacted = false;
+  {
+    lock_guard<mutex> lock(logLock);
+    if (logFile.empty()) return 0;
+    ifstream in(logFile.c_str(), ios::in | ios::binary);
+    unsigned long long gen;
+    if (!in || !readLogHeader(in, gen)) return 0; // e.g., being created by someone else
+    if (gen != logGeneration) {
+      // first read, or the log was compacted since: read it all
+      compacted = (logGeneration != 0);
+      logGeneration = gen;
+      logOffset = in.tellg();
+      logRecords = 0;
+    }
+    in.seekg(logOffset);
+    string buf((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+    int pos = 0, headSize = 2*sizeof(unsigned int);
+    while (pos + headSize <= buf.size()) {
+      unsigned int len, sum;
+      memcpy(&len, buf.data() + pos, sizeof(unsigned int));
+      memcpy(&sum, buf.data() + pos + sizeof(unsigned int), sizeof(unsigned int));
+      if (pos + headSize + len > buf.size()) break; // not completely written yet
+      const char* payload = buf.data() + pos + headSize;
+      pos += headSize + len;
+      logRecords++;
+      if (checksum(payload, len) != sum) continue; // damaged record
+      mstreal p;
+      cachedResult* result = parseLogRecord(string(payload, len), p);
+      if (result != NULL) loaded.push_back(make_pair(result, p));
+    }
+    logOffset += pos;
+  }
+
+  lock_guard<mutex> lock(writeLock);
+  if (compacted) {
+    // entries evicted here may be back in the compacted log
+    knownIds.clear();
+    const entryList& entries = state->getEntries();
+    for (int i = 0; i < entries.size(); i++) knownIds.insert(entries[i]->id);
+  }
+  int n = 0;
+  shared_ptr<contents> updated = make_shared<contents>(*state);
+  for (int i = 0; i < loaded.size(); i++) {
+    shared_ptr<cachedResult> res(loaded[i].first);
+    if (addEntry(*updated, res, log(loaded[i].second) + clock*decayRate())) n++;
+  }
+  atomic_store(&state, updated);
+  return n;
+}
+
+void fasstCacheStore::compactLog() {
+  syncLog();
+  lock_guard<mutex> wlock(writeLock);
+  lock_guard<mutex> llock(logLock);
+  if (logFile.empty()) MstUtils::error("no cache log is attached", "fasstCacheStore::compactLog");
+  if (!logAppend) MstUtils::error("cache log '" + logFile + "' is attached read-only", "fasstCacheStore::compactLog");
+  writeLog(logFile, logGeneration, logOffset);
+  logRecords = state->size();
+}
+
+bool fasstCacheStore::logNeedsCompaction() {
+  lock_guard<mutex> lock(logLock);
+  return !logFile.empty() && (logRecords > size() + maxNumResults);
+}
+
+/* --------- fasstCacheStore::contents --------- */
+void fasstCacheStore::contents::add(const shared_ptr<cachedResult>& res) {
+  indexed e;
+  for (int k = 0; k < 3; k++) e.d[k] = res->desc[k];
+  e.idx = entries.size();
+  entries.push_back(res);
+  bucket& b = buckets[res->topology];
+  b.byDesc.insert(upper_bound(b.byDesc.begin(), b.byDesc.end(), e), e);
+  b.maxCut = MstUtils::max(b.maxCut, res->rmsdCut);
+}
+
+void fasstCacheStore::contents::remove(int idx) {
+  auto bi = buckets.find(entries[idx]->topology);
+  bucket& b = bi->second;
+  b.maxCut = 0;
+  for (int i = b.byDesc.size() - 1; i >= 0; i--) {
+    if (b.byDesc[i].idx == idx) b.byDesc.erase(b.byDesc.begin() + i);
+    else b.maxCut = MstUtils::max(b.maxCut, entries[b.byDesc[i].idx]->rmsdCut);
+  }
+  if (b.byDesc.empty()) buckets.erase(bi);
+  entries.erase(entries.begin() + idx);
+  for (auto it = buckets.begin(); it != buckets.end(); ++it) {
+    vector<indexed>& byDesc = it->second.byDesc;
+    for (int i = 0; i < byDesc.size(); i++) {
+      if (byDesc[i].idx > idx) byDesc[i].idx--;
+    }
+  }
+}
+
+void fasstCacheStore::contents::candidates(const vector<int>& topo, const mstreal d[3], int n, mstreal margin, vector<int>& cands) const {
+  cands.clear();
+  auto bi = buckets.find(topo);
+  if (bi == buckets.end()) return;
+  const bucket& b = bi->second;
+  if (b.maxCut <= margin) return;
+  /* An entry with cutoff c can only be within c - margin of the query if the
+   * residual bound of their descriptors is at most n*(c - margin)^2, which in
+   * particular requires the first components to differ by about sqrt(n)*(c -
+   * margin) or less. The scanned range is widened well beyond the tolerance
+   * residualBound allows, as it only narrows down the exact check below. */
+  mstreal R = sqrt(n)*(b.maxCut - margin);
+  mstreal slack = 10E-4 + 10E-4*(d[0] + R);
+  indexed lo; lo.d[0] = d[0] - R - slack;
+  for (auto it = lower_bound(b.byDesc.begin(), b.byDesc.end(), lo); it != b.byDesc.end(); ++it) {
+    if (it->d[0] > d[0] + R + slack) break;
+    mstreal r = entries[it->idx]->rmsdCut - margin;
+    if ((r > 0) && (fasstSegmentIndex::residualBound(d, it->d) <= n*r*r)) cands.push_back(it->idx);
+  }
+  sort(cands.begin(), cands.end());
+}
+
+/* --------- cFASST --------- */
+void cFASST::write(const string& filename) const {
+  fstream out;
+  MstUtils::openFile(out, filename, fstream::out | fstream::binary, "cFASST::write");
+  write(out);
+  out.close();
+}
+
+void cFASST::read(const string& filename) {
+  fstream in;
+  MstUtils::openFile(in, filename, fstream::in | fstream::binary, "cFASST::read");
+  read(in);
+  in.close();
 }
 
 vector<int> cFASST::getStructureTopology(const Structure& S) {
@@ -44,9 +377,14 @@ vector<int> cFASST::getStructureTopology(const Structure& S) {
   return topo;
 }
 
-void cFASST::clear() {
-  for (auto it = cache.begin(); it != cache.end(); ++it) delete(*it);
-  cache.clear();
+cFASST* cFASST::newCachedSearcher() {
+  cFASST* searcher = new cFASST(store);
+  searcher->setSearchType(getSearchType());
+  searcher->borrowDatabase(this);
+  searcher->readPerm = readPerm;
+  searcher->modPerm = modPerm;
+  searcher->strictEquiv = strictEquiv;
+  return searcher;
 }
 
 fasstSolutionSet cFASST::search() {
@@ -71,22 +409,24 @@ fasstSolutionSet cFASST::search() {
    * slightly first. This way, cached results that have not been used in a while
    * will eventually have a lower priority than brand new searches and these
    * will then push out these old (aparently) useless results. */
-  if (modifyPermission()) {
-    for (auto it = cache.begin(); it != cache.end(); it++) {
-      // NOTE: gets rid of const qualifier! This is safe to do only because I know
-      // I will monotonically lower everybody's priority (order will not change).
-      cachedResult* res = &(*(*it));
-      res->elapsePriority(getMaxNumResults());
-    }
-  }
+  if (modifyPermission()) store->elapse();
 
   /* See whether all matches for the current query, within the given cutoff, are
-   * among the list of matches of some previously cached query. */
+   * among the list of matches of some previously cached query. Only cached
+   * queries that the index cannot rule out (see fasstCacheStore::contents) are
+   * compared with the current one, in the order they were cached. */
   vector<int> topo = cFASST::getStructureTopology(getQuery());
-  auto bestComp = cache.end(); mstreal bestDist = -1, safeRadius = -1;
+  shared_ptr<const fasstCacheStore::contents> snap = store->snapshot();
+  const fasstCacheStore::entryList* cache = &(snap->getEntries());
+  auto bestComp = cache->end(); mstreal bestDist = -1, safeRadius = -1;
   if (readPermission()) {
-    for (auto it = cache.begin(); it != cache.end(); ++it) {
-      cachedResult* result = *it;
+    mstreal qDesc[3];
+    vector<int> cands;
+    cachedResult::descriptor(queryAtoms, qDesc);
+    snap->candidates(topo, qDesc, queryAtoms.size(), maxSet ? 0.0 : cut, cands);
+    for (int ci = 0; ci < cands.size(); ci++) {
+      auto it = cache->begin() + cands[ci];
+      cachedResult* result = it->get();
       // TODO: should consider permutations! Both when comparing and when calculating
       // best RMSD. isSameTopology should compare sets. Then, depending on which
       // permutation has the best RMSD, return the order, and remap query atoms.
@@ -106,7 +446,7 @@ fasstSolutionSet cFASST::search() {
         // not set, then all suitable queries are safe, so we want as few extra
         // fluff to search through as possible
         mstreal curSafeRadius = result->getRMSDCutoff() - r;
-        if ((bestComp == cache.end()) || ((maxSet && (bestDist < curSafeRadius)) || (!maxSet && (bestDist > curSafeRadius)))) {
+        if ((bestComp == cache->end()) || ((maxSet && (bestDist < curSafeRadius)) || (!maxSet && (bestDist > curSafeRadius)))) {
           bestComp = it;
           safeRadius = curSafeRadius;
           bestDist = safeRadius; // could optimize in terms of things other than safe radius
@@ -116,7 +456,7 @@ fasstSolutionSet cFASST::search() {
   }
 
   // first try going through matches of a close query
-  if (bestComp != cache.end()) {
+  if (bestComp != cache->end()) {
     if (isVerbose()) begin = chrono::high_resolution_clock::now();
     // visit all matches of the most suitable cached result
     fasstSolutionSet sols((*bestComp)->getSolutions(), topo);
@@ -161,12 +501,12 @@ fasstSolutionSet cFASST::search() {
    *       was no smaller than the cutoff, so these are all the matches that
    *       there are in the full database (under the cutoff).
    * */
-  bool noNeedForNewSearch = (bestComp != cache.end()) &&
+  bool noNeedForNewSearch = (bestComp != cache->end()) &&
                             (!maxSet || ((safeRadius >= cut) || ((matches.size() >= maxN) && (matches.worstRMSD() < safeRadius))));
   if (!noNeedForNewSearch) {
     // if there was a suitable neighbor cached, but the list of matches was not
     // deep enough, put some pressure on tollerance parameters
-    if (bestComp != cache.end()) {
+    if (bestComp != cache->end()) {
       if ((*bestComp)->isLimitedByMaxNumMatches()) { incMaxNumPressure(); }
       else { incErrTolPressure(); }
     }
@@ -190,16 +530,10 @@ fasstSolutionSet cFASST::search() {
     if (modifyPermission()) {
       if (matches.size() > 0) {
         cachedResult* result = new cachedResult(queryAtoms, matches, getRMSDCutoff(), getMaxNumMatches(), topo);
-        cache.insert(result);
+        store->insert(result); // bumps off the least used cached result if reached limit
         if (isVerbose()) {
           cout << "\t\tfound " << matches.size() << " matches, last RMSD " << matches.rbegin()->getRMSD() << ", cutoff was " << getRMSDCutoff() << endl;
-          cout << "\t\tcache now has " << cache.size() << " elements" << endl;
-        }
-        if (cache.size() > maxNumResults) {
-          auto leastUseful = --cache.end();
-          if (isVerbose()) cout << "\t\t\t\tERASING entry with priority " << (*leastUseful)->getPriority() << endl;
-          delete(*leastUseful);
-          cache.erase(leastUseful); // bump off the least used cached result if reached limit
+          cout << "\t\tcache now has " << store->size() << " elements" << endl;
         }
       }
     }
@@ -245,10 +579,7 @@ fasstSolutionSet cFASST::search() {
     }
 
     // up the priority of this cached result just used
-    cachedResult* result = *bestComp;
-    cache.erase(bestComp);
-    result->upPriority();
-    cache.insert(result);
+    store->upPriority(**bestComp);
     if (isVerbose()) {
       cout << "\tdone upping priority" << std::endl;
       cout << "\tSUCCEEDED, NO need to search!!!" << endl;
@@ -263,28 +594,39 @@ fasstSolutionSet cFASST::search() {
 }
 
 
-/* --------- cFASST::cachedResult --------- */
-cFASST::cachedResult::cachedResult(const AtomPointerVector& q, const fasstSolutionSet& sols, mstreal cut, int max, vector<int> topo) {
+/* --------- fasstCacheStore::cachedResult --------- */
+fasstCacheStore::cachedResult::cachedResult(const AtomPointerVector& q, const fasstSolutionSet& sols, mstreal cut, int max, vector<int> topo) {
   q.clone(query);
   solSet = sols.extractAddresses();
-  priority = 1.0; topology = topo;
+  score = 0.0; topology = topo;
   searchRMSDcut = cut; searchMaxNumMatches = max;
   rmsdCut = sols.rbegin()->getRMSD();
+  descriptor(query, desc);
+  id = 0;
 }
 
-cFASST::cachedResult::cachedResult(const cachedResult& r) {
+fasstCacheStore::cachedResult::cachedResult(const cachedResult& r) {
   r.query.clone(query);
   solSet = r.solSet;
-  priority = r.priority; topology = r.topology;
+  score = (mstreal) r.score; topology = r.topology;
   searchRMSDcut = r.searchRMSDcut; searchMaxNumMatches = r.searchMaxNumMatches;
-  rmsdCut = r.rmsdCut;
+  rmsdCut = r.rmsdCut; id = r.id;
+  for (int k = 0; k < 3; k++) desc[k] = r.desc[k];
 }
 
-cFASST::cachedResult::~cachedResult() {
+fasstCacheStore::cachedResult::~cachedResult() {
   query.deletePointers();
 }
 
-bool cFASST::cachedResult::isSameTopology(const vector<int>& compTopo) const {
+void fasstCacheStore::cachedResult::descriptor(const AtomPointerVector& atoms, mstreal d[3]) {
+  vector<mstreal> coords(3*atoms.size());
+  for (int i = 0; i < atoms.size(); i++) {
+    for (int k = 0; k < 3; k++) coords[3*i + k] = (*atoms[i])[k];
+  }
+  fasstSegmentIndex::descriptor(coords.data(), atoms.size(), d);
+}
+
+bool fasstCacheStore::cachedResult::isSameTopology(const vector<int>& compTopo) const {
   if (topology.size() != compTopo.size()) return false;
   for (int i = 0; i < topology.size(); i++) {
     if (topology[i] != compTopo[i]) return false;
@@ -292,9 +634,7 @@ bool cFASST::cachedResult::isSameTopology(const vector<int>& compTopo) const {
   return true;
 }
 
-void cFASST::cachedResult::write(ostream &_os) const {
-  MstUtils::writeBin(_os, topology);
-  MstUtils::writeBin(_os, priority);
+void fasstCacheStore::cachedResult::write(ostream &_os) const {
   MstUtils::writeBin(_os, searchRMSDcut);
   MstUtils::writeBin(_os, rmsdCut);
   MstUtils::writeBin(_os, searchMaxNumMatches);
@@ -304,7 +644,7 @@ void cFASST::cachedResult::write(ostream &_os) const {
   // solSet->write(_os);
 }
 
-void cFASST::cachedResult::read(istream &_is) {
+void fasstCacheStore::cachedResult::read(istream &_is) {
   // MstUtils::readBin(_is, topology);
   // MstUtils::readBin(_is, priority);
   // MstUtils::readBin(_is, searchRMSDcut);
@@ -315,8 +655,6 @@ void cFASST::cachedResult::read(istream &_is) {
   // query.deletePointers();
   // query.read(_is);
 
-  MstUtils::readBin(_is, topology);
-  MstUtils::readBin(_is, priority);
   MstUtils::readBin(_is, searchRMSDcut);
   MstUtils::readBin(_is, rmsdCut);
   MstUtils::readBin(_is, searchMaxNumMatches);
@@ -325,4 +663,5 @@ void cFASST::cachedResult::read(istream &_is) {
   int numSols; MstUtils::readBin(_is, numSols);
   solSet.clear(); solSet.resize(numSols);
   for (int i = 0; i < numSols; i++) solSet[i].read(_is);
+  descriptor(query, desc);
 }
@@ -0,0 +1,250 @@
+#include "mstfasstshard.h"
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <thread>
+
+/* --------- socket messaging ------------ */
+static void sendMessage(int fd, char type, const string& payload) {
+  string msg(1, type);
+  uint64_t len = payload.size();
+  msg.append((const char*) &len, sizeof(len));
+  msg.append(payload);
+  const char* buf = msg.data();
+  size_t left = msg.size();
+  while (left > 0) {
+    ssize_t n = send(fd, buf, left, MSG_NOSIGNAL);
+    if (n <= 0) MstUtils::error("could not send message", "fasstShard::sendMessage");
+    buf += n; left -= n;
+  }
+}
+
+static bool receiveBytes(int fd, char* buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = recv(fd, buf, len, 0);
+    if (n <= 0) return false;
+    buf += n; len -= n;
+  }
+  return true;
+}
+
+// returns false if the connection was closed
+static bool receiveMessage(int fd, char& type, string& payload) {
+  uint64_t len;
+  if (!receiveBytes(fd, &type, 1) || !receiveBytes(fd, (char*) &len, sizeof(len))) return false;
+  payload.resize(len);
+  return (len == 0) || receiveBytes(fd, &payload[0], len);
+}
+
+static string cutoffPayload(mstreal cut) {
+  stringstream ss; MstUtils::writeBin(ss, cut); return ss.str();
+}
+
+static mstreal readCutoff(const string& payload) {
+  stringstream ss(payload); mstreal cut; MstUtils::readBin(ss, cut); return cut;
+}
+
+/* --------- fasstShardServer ------------ */
+fasstShardServer::fasstShardServer(FASST& _F, int _firstTarget) : F(_F) {
+  firstTarget = _firstTarget;
+  listenFd = -1; port = 0;
+}
+
+fasstShardServer::~fasstShardServer() {
+  if (listenFd >= 0) close(listenFd);
+}
+
+void fasstShardServer::listen(int _port) {
+  if (listenFd >= 0) close(listenFd);
+  listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  if (listenFd < 0) MstUtils::error("could not create socket", "fasstShardServer::listen");
+  int on = 1;
+  setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+  struct sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(_port);
+  if ((::bind(listenFd, (struct sockaddr*) &addr, sizeof(addr)) != 0) || (::listen(listenFd, 16) != 0)) {
+    MstUtils::error("could not listen on port " + MstUtils::toString(_port), "fasstShardServer::listen");
+  }
+  socklen_t len = sizeof(addr);
+  getsockname(listenFd, (struct sockaddr*) &addr, &len);
+  port = ntohs(addr.sin_port);
+}
+
+void fasstShardServer::serve(int numRequests) {
+  if (listenFd < 0) MstUtils::error("not listening", "fasstShardServer::serve");
+  for (int k = 0; (numRequests < 0) || (k < numRequests); k++) {
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd < 0) MstUtils::error("could not accept connection", "fasstShardServer::serve");
+    try {
+      answer(fd);
+    } catch (...) {
+      // the coordinator went away (or could not be told about an error)
+    }
+    close(fd);
+  }
+}
+
+void fasstShardServer::answer(int fd) {
+  char type; string payload;
+  if (!receiveMessage(fd, type, payload) || (type != 'Q')) return;
+  fasstSolutionSet sols;
+  try {
+    stringstream ss(payload);
+    bool autoSplitChains; Structure query; fasstSearchOptions opts;
+    MstUtils::readBin(ss, autoSplitChains);
+    query.readData(ss);
+    opts.read(ss);
+    // gap and same-chain constraints are only sent if some were set (for a
+    // query split the same way), otherwise they are reset for the query
+    F.setQuery(query, autoSplitChains);
+    int numSegs = F.getNumQuerySegments();
+    if (!opts.gapConstraintsExist()) opts.resetGapConstraints(numSegs);
+    if (!opts.diffChainsConstsExist()) opts.resetDiffChainConstraints(numSegs);
+    F.setOptions(opts);
+
+    // while searching, report this shard's cutoff whenever it tightens, and
+    // apply any tighter cutoff found by other shards
+    FASST::sharedSearchState state(INFINITY);
+    atomic<bool> done(false);
+    thread relay([&]() {
+      mstreal reported = INFINITY;
+      bool open = true;
+      struct pollfd pfd = {fd, POLLIN, 0};
+      while (!done) {
+        if (open && (poll(&pfd, 1, 20) > 0)) {
+          char t; string p;
+          if (!receiveMessage(fd, t, p)) open = false;
+          else if (t == 'C') state.tightenRMSDCutoff(readCutoff(p));
+        } else if (!open) {
+          this_thread::sleep_for(chrono::milliseconds(20));
+        }
+        mstreal cut = state.rmsdCut;
+        if (open && (cut < reported)) {
+          try { sendMessage(fd, 'C', cutoffPayload(cut)); } catch (...) { open = false; }
+          reported = cut;
+        }
+      }
+    });
+    try {
+      sols = F.parallelSearch(state);
+    } catch (...) {
+      done = true; relay.join();
+      throw;
+    }
+    done = true; relay.join();
+  } catch (...) {
+    sendMessage(fd, 'E', "search failed on shard starting at target " + MstUtils::toString(firstTarget) + " (see its error output)");
+    return;
+  }
+  stringstream ss;
+  MstUtils::writeBin(ss, firstTarget);
+  sols.write(ss);
+  sendMessage(fd, 'R', ss.str());
+}
+
+/* --------- fasstShardedSearch ------------ */
+void fasstShardedSearch::addShard(const string& address) {
+  size_t pos = address.rfind(":");
+  if (pos == string::npos) MstUtils::error("shard address '" + address + "' is not of the form host:port", "fasstShardedSearch::addShard");
+  addShard(address.substr(0, pos), MstUtils::toInt(address.substr(pos + 1)));
+}
+
+static int connectToShard(const string& host, int port) {
+  struct addrinfo hints = {}, *res;
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), MstUtils::toString(port).c_str(), &hints, &res) != 0) {
+    MstUtils::error("could not resolve shard host '" + host + "'", "fasstShardedSearch::search");
+  }
+  int fd = -1;
+  for (struct addrinfo* ai = res; ai != NULL; ai = ai->ai_next) {
+    fd = socket(ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+    if (fd < 0) continue;
+    if (connect(fd, ai->ai_addr, ai->ai_addrlen) == 0) break;
+    close(fd); fd = -1;
+  }
+  freeaddrinfo(res);
+  if (fd < 0) MstUtils::error("could not connect to shard " + host + ":" + MstUtils::toString(port), "fasstShardedSearch::search");
+  return fd;
+}
+
+fasstSolutionSet fasstShardedSearch::search(const Structure& query, const fasstSearchOptions& opts, bool autoSplitChains) {
+  int numShards = shards.size();
+  stringstream ss;
+  MstUtils::writeBin(ss, autoSplitChains);
+  query.writeData(ss);
+  opts.write(ss);
+  string request = ss.str();
+
+  vector<int> fds;
+  vector<fasstSolutionSet> results(numShards);
+  try {
+    for (int s = 0; s < numShards; s++) {
+      fds.push_back(connectToShard(shards[s].first, shards[s].second));
+      sendMessage(fds[s], 'Q', request);
+    }
+
+    // relay cutoffs among shards until each has sent its solutions
+    mstreal cut = INFINITY;
+    vector<bool> finished(numShards, false);
+    int numFinished = 0;
+    while (numFinished < numShards) {
+      vector<struct pollfd> pfds;
+      vector<int> shardOf;
+      for (int s = 0; s < numShards; s++) {
+        if (finished[s]) continue;
+        struct pollfd pfd = {fds[s], POLLIN, 0};
+        pfds.push_back(pfd); shardOf.push_back(s);
+      }
+      if (poll(pfds.data(), pfds.size(), -1) < 0) MstUtils::error("could not poll shards", "fasstShardedSearch::search");
+      for (int k = 0; k < pfds.size(); k++) {
+        if (pfds[k].revents == 0) continue;
+        int s = shardOf[k];
+        char type; string payload;
+        string shardName = shards[s].first + ":" + MstUtils::toString(shards[s].second);
+        if (!receiveMessage(fds[s], type, payload)) MstUtils::error("shard " + shardName + " closed the connection", "fasstShardedSearch::search");
+        if (type == 'C') {
+          mstreal c = readCutoff(payload);
+          if (c >= cut) continue;
+          cut = c;
+          for (int o = 0; o < numShards; o++) {
+            if ((o == s) || finished[o]) continue;
+            try { sendMessage(fds[o], 'C', payload); } catch (...) {} // the shard may just be finishing
+          }
+        } else if (type == 'R') {
+          stringstream rs(payload);
+          int first; MstUtils::readBin(rs, first);
+          results[s].read(rs);
+          // re-address solutions in the full database
+          fasstSolutionSet shifted;
+          for (auto it = results[s].begin(); it != results[s].end(); ++it) {
+            fasstSolution sol(*it);
+            sol.setTargetIndex(it->getTargetIndex() + first);
+            shifted.insert(sol);
+          }
+          results[s] = shifted;
+          finished[s] = true; numFinished++;
+        } else if (type == 'E') {
+          MstUtils::error("shard " + shardName + ": " + payload, "fasstShardedSearch::search");
+        } else {
+          MstUtils::error("unexpected message from shard " + shardName, "fasstShardedSearch::search");
+        }
+      }
+    }
+  } catch (...) {
+    for (int s = 0; s < fds.size(); s++) close(fds[s]);
+    throw;
+  }
+  for (int s = 0; s < fds.size(); s++) close(fds[s]);
+
+  vector<const fasstSolution*> pool;
+  for (int s = 0; s < numShards; s++) {
+    for (auto it = results[s].begin(); it != results[s].end(); ++it) pool.push_back(&(*it));
+  }
+  int numSegs = pool.empty() ? 0 : pool[0]->numSegments();
+  return FASST::mergeSolutions(pool, numSegs, opts);
+}
@@ -96,24 +96,85 @@ fusionTopology& fusionTopology::operator=(const fusionTopology& topo) {
 }
 
 void fusionTopology::addFragment(vector<Residue*>& R, const vector<int>& fragResIdx, mstreal weight) {
-  if (fragResIdx.size() != 0) MstUtils::assertCond(R.size() == fragResIdx.size(), "fragment residue index vector not the same length as the number of residues in the fragment", "fusionTopology::addFragment(vector<Residue*>&, mstreal, const vector<int>&)");
+  fragments.push_back(makeFragment(R, fragResIdx, "fusionTopology::addFragment(vector<Residue*>&, mstreal, const vector<int>&)"));
+  fragWeights.push_back(weight);
+  addToOverlaps(fragments.size() - 1);
+  updated = true;
+}
+
+void fusionTopology::replaceFragment(int fi, vector<Residue*>& R, const vector<int>& fragResIdx, mstreal weight) {
+  if ((fi < 0) || (fi >= fragments.size())) MstUtils::error("fragment index " + MstUtils::toString(fi) + " out of range", "fusionTopology::replaceFragment");
+  removeFromOverlaps(fi);
+  fragments[fi] = makeFragment(R, fragResIdx, "fusionTopology::replaceFragment");
+  fragWeights[fi] = weight;
+  addToOverlaps(fi);
+  if (fi < alignedFrags.size()) alignedFrags[fi].second = fragments[fi].first;
+  updated = true;
+}
+
+void fusionTopology::removeFragment(int fi) {
+  if ((fi < 0) || (fi >= fragments.size())) MstUtils::error("fragment index " + MstUtils::toString(fi) + " out of range", "fusionTopology::removeFragment");
+  removeFromOverlaps(fi);
+  fragments.erase(fragments.begin() + fi);
+  fragWeights.erase(fragWeights.begin() + fi);
+  if (fi < alignedFrags.size()) alignedFrags.erase(alignedFrags.begin() + fi);
+  for (int i = 0; i < fragsByOverlap.size(); i++) {
+    for (int k = 0; k < fragsByOverlap[i].size(); k++) {
+      if (fragsByOverlap[i][k] > fi) fragsByOverlap[i][k]--;
+    }
+  }
+  updated = true;
+}
+
+pair<AtomPointerVector, vector<int> > fusionTopology::makeFragment(vector<Residue*>& R, const vector<int>& fragResIdx, const string& caller) {
+  if (fragResIdx.size() != 0) MstUtils::assertCond(R.size() == fragResIdx.size(), "fragment residue index vector not the same length as the number of residues in the fragment", caller);
   AtomPointerVector fragAtoms; vector<int> fragRes = fragResIdx;
   for (int i = 0; i < R.size(); i++) {
     for (int j = 0; j < bba.size(); j++) {
       fragAtoms.push_back(R[i]->findAtom(bba[j]));
     }
     if (fragResIdx.size() == 0) fragRes.push_back(R[i]->getNum());
-    overlappingResidues[fragRes[i]].push_back(R[i]);
   }
-  fragments.push_back(pair<AtomPointerVector, vector<int> > (fragAtoms, fragRes));
-  fragWeights.push_back(weight);
+  return pair<AtomPointerVector, vector<int> > (fragAtoms, fragRes);
+}
+
+void fusionTopology::addToOverlaps(int fi) {
+  AtomPointerVector& fragAtoms = fragments[fi].first;
+  vector<int>& fragRes = fragments[fi].second;
+  for (int i = 0; i < fragRes.size(); i++) {
+    overlappingResidues[fragRes[i]].push_back(fragAtoms[bba.size()*i]->getResidue());
+  }
   set<int> fragResSet = MstUtils::contents(fragRes);
   if (overlap.find(fragResSet) == overlap.end()) {
     overlap[fragResSet] = fragsByOverlap.size();
     fragsByOverlap.resize(fragsByOverlap.size() + 1);
   }
-  fragsByOverlap[overlap[fragResSet]].push_back(fragments.size() - 1);
-  updated = true;
+  fragsByOverlap[overlap[fragResSet]].push_back(fi);
+}
+
+void fusionTopology::removeFromOverlaps(int fi) {
+  AtomPointerVector& fragAtoms = fragments[fi].first;
+  vector<int>& fragRes = fragments[fi].second;
+  for (int i = 0; i < fragRes.size(); i++) {
+    vector<Residue*>& posRes = overlappingResidues[fragRes[i]];
+    auto it = find(posRes.begin(), posRes.end(), fragAtoms[bba.size()*i]->getResidue());
+    if (it != posRes.end()) posRes.erase(it);
+  }
+
+  // topologies built from a resTopo array do not keep track of overlap groups
+  set<int> fragResSet = MstUtils::contents(fragRes);
+  if (overlap.find(fragResSet) == overlap.end()) return;
+  int gi = overlap[fragResSet];
+  vector<int>& group = fragsByOverlap[gi];
+  group.erase(remove(group.begin(), group.end(), fi), group.end());
+  if (!group.empty()) return;
+
+  // drop the now empty overlap group and re-index the ones after it
+  fragsByOverlap.erase(fragsByOverlap.begin() + gi);
+  overlap.erase(fragResSet);
+  for (auto it = overlap.begin(); it != overlap.end(); ++it) {
+    if (it->second > gi) it->second--;
+  }
 }
 
 void fusionTopology::addFragment(Structure& S, const vector<int>& fragResIdx, mstreal weight) {
@@ -124,19 +185,22 @@ void fusionTopology::addFragment(Structure& S, const vector<int>& fragResIdx, ms
 void fusionTopology::setAlignedFrags(Structure& fused) {
   alignedFrags.resize(0);
   alignedFrags.resize(fragments.size());
-  for (int i = 0; i < fragments.size(); i++) {
-    AtomPointerVector& refFrag = fragments[i].first;
-    AtomPointerVector fusedFrag;
-    vector<int>& fragResIdx = fragments[i].second;
-    for (int j = 0; j < fragResIdx.size(); j++) {
-      Residue& fusedRes = fused.getResidue(fragResIdx[j]);
-      for (int k = 0; k < bba.size(); k++) {
-        fusedFrag.push_back(fusedRes.findAtom(bba[k]));
-      }
+  for (int i = 0; i < fragments.size(); i++) setAlignedFrag(i, fused);
+}
+
+void fusionTopology::setAlignedFrag(int fi, Structure& fused) {
+  if (alignedFrags.size() < fragments.size()) alignedFrags.resize(fragments.size());
+  AtomPointerVector& refFrag = fragments[fi].first;
+  AtomPointerVector fusedFrag;
+  vector<int>& fragResIdx = fragments[fi].second;
+  for (int j = 0; j < fragResIdx.size(); j++) {
+    Residue& fusedRes = fused.getResidue(fragResIdx[j]);
+    for (int k = 0; k < bba.size(); k++) {
+      fusedFrag.push_back(fusedRes.findAtom(bba[k]));
     }
-    alignedFrags[i].first = fusedFrag;
-    alignedFrags[i].second = refFrag;
   }
+  alignedFrags[fi].first = fusedFrag;
+  alignedFrags[fi].second = refFrag;
 }
 
 bool fusionTopology::isConsistent(const Structure& S) {
@@ -193,6 +257,8 @@ void fusionTopology::updateConnectivity() {
   if (!updated) return;
   int L = overlappingResidues.size();
   int nbba = fusionTopology::bba.size();
+  chainLengths.clear();
+  fixedInChain.clear();
   vector<bool> connectedToNext(L, false); // whether each residue is bonded to the next one in the topology
 
   for (int i = 0; i < fragments.size(); i++) {
@@ -317,9 +383,9 @@ void fusionEvaluator::init() {
   // orient so that the first atom is at the origin, the second is along the X-
   // axis and the third is in the XY plane
   Frame L(CartesianPoint(0, 0, 0), CartesianPoint(1, 0, 0), CartesianPoint(0, 1, 0), CartesianPoint(0, 0, 1));
-  CartesianPoint A(fused[0][0][0]), B(fused[0][0][1]), C(fused[0][0][2]);
-  CartesianPoint X = (B - A).getUnit();
-  CartesianPoint Z = (X.cross(C - B)).getUnit();
+  Point3 A(fused[0][0][0]), B(fused[0][0][1]), C(fused[0][0][2]);
+  Point3 X = (B - A).getUnit();
+  Point3 Z = (X.cross(C - B)).getUnit();
   Frame F(A, X, Z.cross(X), Z);
   Transform T = TransformFactory::switchFrames(L, F);
   T.apply(fused);
@@ -353,21 +419,33 @@ Structure fusionEvaluator::getAlignedStructure() {
 }
 
 mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
-  bool init = point.empty();
+  return evalPoint(point.data(), point.size());
+}
+
+mstreal fusionEvaluator::eval(const mstreal* point, mstreal* grad, int n) {
+  mstreal val = evalPoint(point, n);
+  if ((grad != NULL) && (n > 0)) copy(gradient.begin(), gradient.end(), grad);
+  return val;
+}
+
+mstreal fusionEvaluator::evalPoint(const mstreal* point, int n) {
+  bool init = (n == 0);
   if (init) {
     initPoint.resize(0);
-    gradOfXYZ.clear();
+    gradOfXYZ.setAtoms(fused.getAtoms());
+    xyzGrad.resize(3*gradOfXYZ.numAtoms());
     gradient.resize(numDF());
-    bounds.clear();
+    if (!warmStart) bounds.clear();
     masses.clear();
   }
   mstreal bR = 0.01; mstreal aR = 1.0; mstreal dR = 1.0; mstreal xyzR = 0.01; // randomness scale factors
-  if (!init && (point.size() != numDF())) MstUtils::error("need to place " + MstUtils::toString(topo.numMobileAtoms()) + " atoms, with " + MstUtils::toString(topo.numFixedPositions()) + " fixed residues, and received " + MstUtils::toString(point.size()) + " parameters: that appears wrong!", "fusionEvaluator::eval");
+  if (!init && (n != numDF())) MstUtils::error("need to place " + MstUtils::toString(topo.numMobileAtoms()) + " atoms, with " + MstUtils::toString(topo.numFixedPositions()) + " fixed residues, and received " + MstUtils::toString(n) + " parameters: that appears wrong!", "fusionEvaluator::eval");
   int k = 0;
   Atom *pN = NULL, *pCA = NULL, *pC = NULL, *pO = NULL;
   mstreal noise = params.getNoise();
 
   if (params.getOptimCartesian()) {
+    // the Jacobian of Cartesian search coordinates is set upon initialization
     for (int i = 0; i < fused.residueSize(); i++) {
       if (topo.isFixed(i)) continue;
       Residue& res = fused.getResidue(i);
@@ -392,6 +470,9 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
       }
     }
   } else {
+    // the Jacobian of a build from internal coordinates is recomputed every time
+    if (!init) gradOfXYZ.clearPartials();
+
     // compute all reduced masses
     mstreal m_N_CA, m_CA_C, m_N_C, m_C_O, m_N_CA_C, m_CA_C_O, m_N_C_O, m_N_CA_C_N, m_CA_C_N_CA, m_C_N_CA_C, m_N_CA_C_O;
     if (init) { // these "seem" right, but I have not checked (good enough for now)
@@ -440,9 +521,9 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
             C->setCoor(d0 - d1*cos(a0), d1*sin(a0), 0.0);
             gradOfXYZ.addPartial(C, 0, k, 1.0);
             gradOfXYZ.addPartial(C, 0, k+1, -cos(a0));
-            gradOfXYZ.addPartial(C, 0, k+2, sin(a0)*r2d);
+            gradOfXYZ.addPartial(C, 0, k+2, d1*sin(a0)*r2d);
             gradOfXYZ.addPartial(C, 1, k+1, sin(a0));
-            gradOfXYZ.addPartial(C, 1, k+2, cos(a0)*r2d);
+            gradOfXYZ.addPartial(C, 1, k+2, d1*cos(a0)*r2d);
             k += 3;
           }
         } else {
@@ -455,20 +536,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
             initPoint.push_back(dihedralInitValue(i-1, i-1, i-1, i, "N", "CA", "C", "N") + dR * MstUtils::randUnit() * noise);
             masses.push_back(m_N_CA_C_N);
           } else {
-            N->build(pC, pCA, pN, point[k], point[k+1], point[k+2]);
-            // TODO: when we want to enable gradient calculation
-            // // partial derivatives of XYZ coordinates of the placed atom with
-            // // respect to bond, angle, and dihedral
-            // vector<mstreal> icPartials(9, 0.0);
-            // // partial derivatives of XYZ coordinates of the placed atom with
-            // // respect to XYZ coordinates of each of the anchoring atoms
-            // vector<vector<mstreal> > xyzPartials(3, vector<mstreal>(9, 0.0));
-            // N->build(pC, pCA, pN, point[k], point[k+1], point[k+2], partials, xyzPartials);
-            // gradOfXYZ.addPartials(N, {k, k+1, k+2}, icPartials);
-            // gradOfXYZ.addRecursivePartials(N, pC, xyzPartials[0]);
-            // gradOfXYZ.addRecursivePartials(N, pCA, xyzPartials[1]);
-            // gradOfXYZ.addRecursivePartials(N, pN, xyzPartials[2]);
-            k += 3;
+            buildAtom(N, pC, pCA, pN, point, k); k += 3;
           }
 
           // place CA relative to pCA, pC, N
@@ -480,7 +548,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
             initPoint.push_back(dihedralInitValue(i-1, i-1, i, i, "CA", "C", "N", "CA") + dR * MstUtils::randUnit() * noise);
             masses.push_back(m_CA_C_N_CA);
           } else {
-            CA->build(N, pC, pCA, point[k], point[k+1], point[k+2]); k += 3;
+            buildAtom(CA, N, pC, pCA, point, k); k += 3;
           }
 
           // place C relative to pC, N, CA
@@ -492,7 +560,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
             initPoint.push_back(dihedralInitValue(i-1, i, i, i, "C", "N", "CA", "C") + dR * MstUtils::randUnit() * noise);
             masses.push_back(m_C_N_CA_C);
           } else {
-            C->build(CA, N, pC, point[k], point[k+1], point[k+2]); k += 3;
+            buildAtom(C, CA, N, pC, point, k); k += 3;
           }
 
           // if this is the last residue, place the O relative to N-CA-C
@@ -505,7 +573,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
               initPoint.push_back(dihedralInitValue(i, i, i, i, "N", "CA", "C", "O") + dR * MstUtils::randUnit() * noise);
               masses.push_back(m_N_CA_C_O);
             } else {
-              O->build(C, CA, N, point[k], point[k+1], point[k+2]); k += 3;
+              buildAtom(O, C, CA, N, point, k); k += 3;
             }
           }
         }
@@ -520,7 +588,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
           initPoint.push_back(dihedralInitValue(i-1, i, i-1, i-1, "CA", "N", "C", "O") + dR * MstUtils::randUnit() * noise);
           masses.push_back(m_N_CA_C_O);
         } else {
-          pO->build(pC, N, pCA, point[k], point[k+1], point[k+2]); k += 3;
+          buildAtom(pO, pC, N, pCA, point, k); k += 3;
         }
       }
       pN = N; pCA = CA; pC = C; pO = O;
@@ -544,7 +612,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
           initPoint.push_back(dihedralInitValue(i+1, i+1, i+1, i, "C", "CA", "N", "C") + dR * MstUtils::randUnit() * noise);
           masses.push_back(m_C_N_CA_C);
         } else {
-          C->build(pN, pCA, pC, point[k], point[k+1], point[k+2]); k += 3;
+          buildAtom(C, pN, pCA, pC, point, k); k += 3;
         }
 
         // place CA relative to pCA, pN, C
@@ -556,7 +624,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
           initPoint.push_back(dihedralInitValue(i+1, i+1, i, i, "CA", "N", "C", "CA") + dR * MstUtils::randUnit() * noise);
           masses.push_back(m_CA_C_N_CA);
         } else {
-          CA->build(C, pN, pCA, point[k], point[k+1], point[k+2]); k += 3;
+          buildAtom(CA, C, pN, pCA, point, k); k += 3;
         }
 
         // place N relative to pN, C, CA
@@ -568,7 +636,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
           initPoint.push_back(dihedralInitValue(i+1, i, i, i, "N", "C", "CA", "N") + dR * MstUtils::randUnit() * noise);
           masses.push_back(m_N_CA_C_N);
         } else {
-          N->build(CA, C, pN, point[k], point[k+1], point[k+2]); k += 3;
+          buildAtom(N, CA, C, pN, point, k); k += 3;
         }
 
         // place O relative to pCA, pN, C (an improper)
@@ -580,7 +648,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
           initPoint.push_back(dihedralInitValue(i, i+1, i, i, "CA", "N", "C", "O") + dR * MstUtils::randUnit() * noise);
           masses.push_back(m_N_CA_C_O);
         } else {
-          O->build(C, pN, CA, point[k], point[k+1], point[k+2]); k += 3;
+          buildAtom(O, C, pN, CA, point, k); k += 3;
         }
       }
       pN = N; pCA = CA; pC = C; pO = O;
@@ -588,7 +656,7 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
   }
 
   // built up a list of restraining ICs
-  if (init) {
+  if (init && !warmStart) {
     k = 0;
     for (int ci = 0; ci < fused.chainSize(); ci++) {
       Chain& chain = fused[ci];
@@ -658,12 +726,17 @@ mstreal fusionEvaluator::eval(const vector<mstreal>& point) {
       }
     }
   }
-  if (init) return 0.0;
+  if (init) {
+    for (int k = 0; k < bounds.size(); k++) bounds[k].atomIdx = gradOfXYZ.indices(bounds[k].atoms);
+    fragAtomIdx.resize(topo.numAlignedFrags());
+    for (int i = 0; i < topo.numAlignedFrags(); i++) fragAtomIdx[i] = gradOfXYZ.indices(topo.getAlignedFragFused(i));
+    return 0.0;
+  }
 
   // compute penalty score for out-of-range ICs and best-fit RMSDs
   resetScore();
-  for (int k = 0; k < bounds.size(); k++) scoreIC(bounds[k]);
-  scoreRMSD();
+  scoreRestraints();
+  gradOfXYZ.chain(xyzGrad, gradient);
 
   return score;
 }
@@ -699,9 +772,48 @@ vector<mstreal> fusionEvaluator::guessPoint() {
 void fusionEvaluator::resetScore() {
   score = bondPenalty = anglPenalty = dihePenalty = rmsdScore = rmsdTot = 0;
   for (int k = 0; k < gradient.size(); k++) gradient[k] = 0;
+  for (int k = 0; k < xyzGrad.size(); k++) xyzGrad[k] = 0;
+}
+
+void fusionEvaluator::scoreAccumulator::reset(int numCoors) {
+  bondPenalty = anglPenalty = dihePenalty = rmsdScore = rmsdTot = 0; N = 0;
+  xyzGrad.assign(numCoors, 0.0);
+}
+
+void fusionEvaluator::scoreRestraints() {
+  vector<mstreal> weights = fragmentWeights();
+  int nt = MstUtils::max(1, params.getNumThreads());
+  int numGroups = params.adaptiveWeighting() ? topo.numUniqueOverlaps() : topo.numAlignedFrags();
+  vector<pair<int, int> > icBlocks = MstUtils::splitTasks(bounds.size(), MstUtils::max(1, MstUtils::min((int) bounds.size(), 4*nt)));
+  vector<pair<int, int> > rmsdBlocks = MstUtils::splitTasks(numGroups, MstUtils::max(1, MstUtils::min(numGroups, 4*nt)));
+  workerScores.resize(MstUtils::min(nt, (int) (icBlocks.size() + rmsdBlocks.size())));
+  for (int w = 0; w < workerScores.size(); w++) workerScores[w].reset(xyzGrad.size());
+
+  // IC bounds and fragments (or overlap groups) are scored independently, each
+  // worker adding into its own accumulator
+  MstUtils::parallelFor(icBlocks.size() + rmsdBlocks.size(), nt, [&](int b, int w) {
+    scoreAccumulator& acc = workerScores[w];
+    if (b < icBlocks.size()) {
+      for (int k = icBlocks[b].first; k <= icBlocks[b].second; k++) scoreIC(bounds[k], acc);
+    } else {
+      b -= icBlocks.size();
+      for (int g = rmsdBlocks[b].first; g <= rmsdBlocks[b].second; g++) scoreRMSD(g, weights, acc);
+    }
+  });
+
+  int N = 0;
+  for (int w = 0; w < workerScores.size(); w++) {
+    scoreAccumulator& acc = workerScores[w];
+    bondPenalty += acc.bondPenalty; anglPenalty += acc.anglPenalty; dihePenalty += acc.dihePenalty;
+    rmsdScore += acc.rmsdScore; rmsdTot += acc.rmsdTot; N += acc.N;
+    for (int k = 0; k < xyzGrad.size(); k++) xyzGrad[k] += acc.xyzGrad[k];
+  }
+  score = bondPenalty + anglPenalty + dihePenalty + rmsdScore;
+  rmsdTot = sqrt(rmsdTot/N);
+  if (params.isVerbose()) cout << "rmsdScore = " << rmsdScore << " (overall RMSD " << rmsdTot << "), bond penalty = " << bondPenalty << ",  angle penalty = " << anglPenalty << ", dihedral penalty = " << dihePenalty << endl;
 }
 
-void fusionEvaluator::scoreIC(const icBound& b) {
+void fusionEvaluator::scoreIC(const icBound& b, scoreAccumulator& acc) {
   mstreal val = b.getCurrentValue();
   mstreal del = 0.0, f, *comp;
   switch (b.type) {
@@ -718,26 +830,26 @@ void fusionEvaluator::scoreIC(const icBound& b) {
         if (dmax < dmin) del = dmax;
         else del = -dmin;
       }
-      f = params.getDihedralFC(); comp = &dihePenalty;
+      f = params.getDihedralFC(); comp = &(acc.dihePenalty);
       break;
     }
     case icAngle:
       if (val < b.minVal) { del = val - b.minVal; }
       else if (val > b.maxVal) { del = val - b.maxVal; }
-      f = params.getAngleFC(); comp = &anglPenalty;
+      f = params.getAngleFC(); comp = &(acc.anglPenalty);
       break;
     case icBond:
       if (val < b.minVal) { del = val - b.minVal; }
       else if (val > b.maxVal) { del = val - b.maxVal; }
-      f = params.getBondFC(); comp = &bondPenalty;
+      f = params.getBondFC(); comp = &(acc.bondPenalty);
       break;
     case icDistRep:
       if (val < b.minVal) { del = val - b.minVal; }
-      f = params.getRepFC(); comp = &bondPenalty;
+      f = params.getRepFC(); comp = &(acc.bondPenalty);
       break;
     case icDistComp:
       if (val > b.maxVal) { del = val - b.maxVal; }
-      f = params.getCompFC(); comp = &bondPenalty;
+      f = params.getCompFC(); comp = &(acc.bondPenalty);
       break;
     case icBrokenDihedral:
     case icBrokenAngle:
@@ -747,32 +859,19 @@ void fusionEvaluator::scoreIC(const icBound& b) {
       MstUtils::error("unknown variable type", "fusionEvaluator::scoreIC");
   }
   if (del != 0) {
-    mstreal pen = f * del * del;
-    score += pen;
-    *comp += pen;
+    *comp += f * del * del;
 
     // update the gradient
     vector<mstreal> innerGradient = b.getCurrentGradient();
     int j = 0;
-    for (int i = 0; i < b.atoms.size(); i++) {
-      Atom* a = b.atoms[i];
-      for (int d = 0; d < 3; d++) {
-        map<int, mstreal>& parts = gradOfXYZ.getPartials(a, d);
-        for (auto it = parts.begin(); it != parts.end(); ++it) {
-          gradient[it->first] += 2 * f * del * innerGradient[j] * it->second;
-        }
-        j++;
-      }
+    for (int i = 0; i < b.atomIdx.size(); i++) {
+      for (int d = 0; d < 3; d++, j++) acc.xyzGrad[3*b.atomIdx[i] + d] += 2 * f * del * innerGradient[j];
     }
   }
 }
 
-void fusionEvaluator::scoreRMSD() {
-  RMSDCalculator rms;
-  rmsdScore = rmsdTot = 0; int N = 0;
-  vector<mstreal> innerGradient;
+vector<mstreal> fusionEvaluator::fragmentWeights() {
   vector<mstreal> weights = topo.getFragWeights();
-  int df = 3;
   if (params.fragRedundancyWeighting()) { // down-weight RMSD contributions from regions with many overlapped fragments
     map<Residue*, int> numOcc; // proportional to the number of times each residue is overlapped
     mstreal Wo = 0, W = 0;
@@ -798,77 +897,72 @@ void fusionEvaluator::scoreRMSD() {
     for (int i = 0; i < topo.numAlignedFrags(); i++) nn += topo.getAlignedFragFused(i).size();
     for (int i = 0; i < topo.numAlignedFrags(); i++) weights[i] *= (1.0*topo.numMobileAtoms())/nn;
   }
+  return weights;
+}
 
+void fusionEvaluator::scoreRMSD(int gi, const vector<mstreal>& weights, scoreAccumulator& acc) {
+  RMSDCalculator& rms = acc.rms;
+  int df = 3;
   if (params.adaptiveWeighting()) {
-    for (int gi = 0; gi < topo.numUniqueOverlaps(); gi++) {
-      int n = topo.numFragsOverlapping(gi);
-      if (n <= 0) MstUtils::error("empty overlap type!", "fusionEvaluator::scoreRMSD");
-      int L = topo.getAlignedFragFused(topo.getFragOverlapping(gi, 0)).size();
-      N += L*n;
-
-      mstreal Z = 0;
-      vector<mstreal> w(n, 1.0), r(n, 0.0);
-      vector<vector<mstreal> > innerGradients(n, vector<mstreal>(L*df, 0.0));
-      vector<mstreal> innerGradientZ(L*df, 0.0);
-
-      // compute partition function and collect RMSD gradients
-      for (int i = 0; i < n; i++) {
-        int fi = topo.getFragOverlapping(gi, i);
-        r[i] = rms.qcpRMSDGrad(topo.getAlignedFragFused(fi), topo.getAlignedFragRef(fi), innerGradients[i]);
-      }
-      mstreal D = MstUtils::min(r); D = D*D;
-      for (int i = 0; i < n; i++) {
-        w[i] = exp(-params.adaptiveBeta() * (r[i] * r[i] - D));
-        Z += w[i];
-      }
-      // compute weights and gradient of partition function
-      for (int j = 0; j < n; j++) {
-        w[j] /= Z;
-        rmsdScore += w[j] * r[j] * r[j] * L * weights[j];
-        rmsdTot += r[j] * r[j] * L;
-        for (int k = 0; k < L*df; k++) {
-          innerGradientZ[k] -= 2 * w[j] * params.adaptiveBeta() * r[j] * innerGradients[j][k];
-        }
+    int n = topo.numFragsOverlapping(gi);
+    if (n <= 0) MstUtils::error("empty overlap type!", "fusionEvaluator::scoreRMSD");
+    int L = topo.getAlignedFragFused(topo.getFragOverlapping(gi, 0)).size();
+    acc.N += L*n;
+
+    mstreal Z = 0;
+    vector<mstreal> w(n, 1.0), r(n, 0.0);
+    vector<vector<mstreal> > innerGradients(n, vector<mstreal>(L*df, 0.0));
+    vector<mstreal> innerGradientZ(L*df, 0.0);
+
+    // compute partition function and collect RMSD gradients
+    for (int i = 0; i < n; i++) {
+      int fi = topo.getFragOverlapping(gi, i);
+      r[i] = rms.qcpRMSDGrad(topo.getAlignedFragFused(fi), topo.getAlignedFragRef(fi), innerGradients[i]);
+    }
+    mstreal D = MstUtils::min(r); D = D*D;
+    for (int i = 0; i < n; i++) {
+      w[i] = exp(-params.adaptiveBeta() * (r[i] * r[i] - D));
+      Z += w[i];
+    }
+    // compute weights and gradient of partition function
+    for (int j = 0; j < n; j++) {
+      w[j] /= Z;
+      acc.rmsdScore += w[j] * r[j] * r[j] * L * weights[j];
+      acc.rmsdTot += r[j] * r[j] * L;
+      for (int k = 0; k < L*df; k++) {
+        innerGradientZ[k] -= 2 * w[j] * params.adaptiveBeta() * r[j] * innerGradients[j][k];
       }
-      // cout << "group " << gi << ": " << MstUtils::vecToString(w, ", ") << endl;
-
-      // update gradient of score
-      for (int i = 0; i < n; i++) {
-        int fi = topo.getFragOverlapping(gi, i);
-        for (int k = 0; k < L*df; k++) {
-          map<int, mstreal>& parts = gradOfXYZ.getPartials(topo.getAlignedFragFused(fi)[k/df], k%df);
-          for (auto it = parts.begin(); it != parts.end(); ++it) {
-            gradient[it->first] += L*weights[i]*(w[i]*r[i]*(2*(1 - params.adaptiveBeta()*r[i]*r[i])*innerGradients[i][k] - r[i]*innerGradientZ[k])) * it->second;
-          }
-        }
+    }
+
+    // update gradient of score
+    for (int i = 0; i < n; i++) {
+      int fi = topo.getFragOverlapping(gi, i);
+      for (int k = 0; k < L*df; k++) {
+        acc.xyzGrad[df*fragAtomIdx[fi][k/df] + k%df] += L*weights[i]*(w[i]*r[i]*(2*(1 - params.adaptiveBeta()*r[i]*r[i])*innerGradients[i][k] - r[i]*innerGradientZ[k]));
       }
     }
   } else {
-    for (int i = 0; i < topo.numAlignedFrags(); i++) {
-      innerGradient.resize(topo.getAlignedFragFused(i).size()*df, 0.0);
-      mstreal r = rms.qcpRMSDGrad(topo.getAlignedFragFused(i), topo.getAlignedFragRef(i), innerGradient);
-      mstreal r2 = r*r;
-      rmsdScore += weights[i] * r2 * topo.getAlignedFragFused(i).size();
-      rmsdTot += r2 * topo.getAlignedFragFused(i).size();
-      N += topo.getAlignedFragFused(i).size();
-
-      // gradient of RMSD
-      int j = 0; // TODO: do as above, where the coordinate index is directly iterated over
-      for (int ai = 0; ai < topo.getAlignedFragFused(i).size(); ai++) {
-        for (int d = 0; d < df; d++) {
-          map<int, mstreal>& parts = gradOfXYZ.getPartials(topo.getAlignedFragFused(i)[ai], d);
-          for (auto it = parts.begin(); it != parts.end(); ++it) {
-            gradient[it->first] += weights[i] * 2 * r * topo.getAlignedFragFused(i).size() * innerGradient[j] * it->second;
-          }
-          j++;
-        }
-      }
+    AtomPointerVector& fused = topo.getAlignedFragFused(gi);
+    vector<mstreal>& innerGradient = acc.innerGradient;
+    innerGradient.resize(fused.size()*df, 0.0);
+    mstreal r = rms.qcpRMSDGrad(fused, topo.getAlignedFragRef(gi), innerGradient);
+    mstreal r2 = r*r;
+    acc.rmsdScore += weights[gi] * r2 * fused.size();
+    acc.rmsdTot += r2 * fused.size();
+    acc.N += fused.size();
+
+    // gradient of RMSD
+    mstreal c = weights[gi] * 2 * r * fused.size();
+    for (int k = 0; k < innerGradient.size(); k++) {
+      acc.xyzGrad[df*fragAtomIdx[gi][k/df] + k%df] += c * innerGradient[k];
     }
   }
+}
 
-  score += rmsdScore;
-  rmsdTot = sqrt(rmsdTot/N);
-  if (params.isVerbose()) cout << "rmsdScore = " << rmsdScore << " (overall RMSD " << rmsdTot << "), bond penalty = " << bondPenalty << ",  angle penalty = " << anglPenalty << ", dihedral penalty = " << dihePenalty << endl;
+void fusionEvaluator::buildAtom(Atom* A, Atom* diA, Atom* anA, Atom* thA, const mstreal* point, int k) {
+  mstreal icPartials[9], xyzPartials[27];
+  A->build(*diA, *anA, *thA, point[k], point[k+1], point[k+2], icPartials, xyzPartials);
+  gradOfXYZ.addBuildStep(A, diA, anA, thA, k, icPartials, xyzPartials);
 }
 
 fusionOutput fusionEvaluator::getScores() {
@@ -889,7 +983,7 @@ AtomPointerVector fusionEvaluator::atomInstances(int ri, const string& ai) {
 }
 
 mstreal fusionEvaluator::bondInitValue(int ri, int rj, const string& ai, const string& aj, bool doNotAverage) {
-  if ((params.getCoorInitType() == fusionParams::coorInitType::meanCoor) || doNotAverage) {
+  if ((params.getCoorInitType() == fusionParams::coorInitType::meanCoor) || doNotAverage || warmStart) {
     return (fused.getResidue(ri).findAtom(ai))->distance(fused.getResidue(rj).findAtom(aj));
   }
   return bondInstances(rj, fused.getResidue(ri).findAtom(ai), fused.getResidue(rj).findAtom(aj), false).mean();
@@ -897,7 +991,7 @@ mstreal fusionEvaluator::bondInitValue(int ri, int rj, const string& ai, const s
 }
 
 mstreal fusionEvaluator::angleInitValue(int ri, int rj, int rk, const string& ai, const string& aj, const string& ak) {
-  if (params.getCoorInitType() == fusionParams::coorInitType::meanCoor) {
+  if ((params.getCoorInitType() == fusionParams::coorInitType::meanCoor) || warmStart) {
     return (fused.getResidue(ri).findAtom(ai))->angle(fused.getResidue(rj).findAtom(aj), fused.getResidue(rk).findAtom(ak));
   }
   return angleInstances(rk, fused.getResidue(ri).findAtom(ai), fused.getResidue(rj).findAtom(aj), fused.getResidue(rk).findAtom(ak), false).mean();
@@ -905,7 +999,7 @@ mstreal fusionEvaluator::angleInitValue(int ri, int rj, int rk, const string& ai
 }
 
 mstreal fusionEvaluator::dihedralInitValue(int ri, int rj, int rk, int rl, const string& ai, const string& aj, const string& ak, const string& al) {
-  if (params.getCoorInitType() == fusionParams::coorInitType::meanCoor) {
+  if ((params.getCoorInitType() == fusionParams::coorInitType::meanCoor) || warmStart) {
     return (fused.getResidue(ri).findAtom(ai))->dihedral(fused.getResidue(rj).findAtom(aj), fused.getResidue(rk).findAtom(ak), fused.getResidue(rl).findAtom(al));
   }
   return CartesianGeometry::angleMean(dihedralInstances(rl, fused.getResidue(ri).findAtom(ai), fused.getResidue(rj).findAtom(aj), fused.getResidue(rk).findAtom(ak), fused.getResidue(rl).findAtom(al), false));
@@ -945,6 +1039,7 @@ CartesianPoint fusionEvaluator::bondInstances(int rj, Atom* atomI, Atom* atomJ,
   }
   if (addToCache) {
     bounds.push_back(icBound(chainBreak ? icBrokenBond : icBond, MstUtils::min(p), MstUtils::max(p), {atomI, atomJ}, MstUtils::toString(ri) + "-" + ai + " : " + MstUtils::toString(rj) + "-" + aj));
+    bounds.back().pos = rj;
   }
 
   return p;
@@ -990,6 +1085,7 @@ CartesianPoint fusionEvaluator::angleInstances(int rk, Atom* atomI, Atom* atomJ,
   }
   if (addToCache) {
     bounds.push_back(icBound(chainBreak ? icBrokenAngle : icAngle, MstUtils::min(p), MstUtils::max(p), {atomI, atomJ, atomK}));
+    bounds.back().pos = rk;
   }
 
   return p;
@@ -1042,19 +1138,95 @@ CartesianPoint fusionEvaluator::dihedralInstances(int rl, Atom* atomI, Atom* ato
   }
   if (addToCache) {
     bounds.push_back(icBound(chainBreak ? icBrokenDihedral : icDihedral, CartesianGeometry::angleRange(p), {atomI, atomJ, atomK, atomL}));
+    bounds.back().pos = rl;
   }
 
   return p;
 }
 
+void fusionEvaluator::refreshBound(int bi) {
+  const icBound& b = bounds[bi];
+  switch (b.type) {
+    case icBond:
+    case icBrokenBond:
+      bondInstances(b.pos, b.atoms[0], b.atoms[1]);
+      break;
+    case icAngle:
+    case icBrokenAngle:
+      angleInstances(b.pos, b.atoms[0], b.atoms[1], b.atoms[2]);
+      break;
+    case icDihedral:
+    case icBrokenDihedral:
+      dihedralInstances(b.pos, b.atoms[0], b.atoms[1], b.atoms[2], b.atoms[3]);
+      break;
+    default:
+      return; // distance restraints do not depend on fragments
+  }
+  // the instance functions append the recomputed bound at the end
+  icBound fresh = bounds.back();
+  bounds.pop_back();
+  fresh.atomIdx = bounds[bi].atomIdx;
+  fresh.name = bounds[bi].name;
+  bounds[bi] = fresh;
+}
+
+void fusionEvaluator::replaceFragment(int fi, vector<Residue*>& R, const vector<int>& fragResIdx, mstreal weight) {
+  vector<int> chainLengths = topo.getChainLengths();
+  set<int> positions = MstUtils::contents(topo.getFragPositions(fi));
+  topo.replaceFragment(fi, R, fragResIdx, weight);
+  const vector<int>& newPositions = topo.getFragPositions(fi);
+  positions.insert(newPositions.begin(), newPositions.end());
+  topo.setAlignedFrag(fi, fused);
+  topologyEdited(positions, chainLengths);
+}
+
+void fusionEvaluator::removeFragment(int fi) {
+  vector<int> chainLengths = topo.getChainLengths();
+  set<int> positions = MstUtils::contents(topo.getFragPositions(fi));
+  topo.removeFragment(fi);
+  topologyEdited(positions, chainLengths);
+}
+
+void fusionEvaluator::topologyEdited(const set<int>& positions, const vector<int>& oldChainLengths) {
+  for (int pi : positions) {
+    if (topo.numOverlappingResidues(pi) == 0) MstUtils::error("position index " + MstUtils::toString(pi) + " has no overlapping residues after the edit", "fusionEvaluator::topologyEdited");
+  }
+  if (topo.getChainLengths() != oldChainLengths) {
+    if (params.isVerbose()) cout << "fusionEvaluator::topologyEdited -> chain structure changed, re-initializing" << endl;
+    params.setStartingStructure(fused);
+    init();
+    return;
+  }
+
+  // bounds are built along with the guess point, so if there is no guess point
+  // yet, they will be built from the edited topology when it is requested
+  if (initPoint.empty()) return;
+
+  // only bounds with an atom at one of the edited positions can change
+  for (int bi = 0; bi < bounds.size(); bi++) {
+    const icBound& b = bounds[bi];
+    if (b.pos < 0) continue;
+    Residue* last = b.atoms.back()->getResidue();
+    for (int ai = 0; ai < b.atoms.size(); ai++) {
+      int pi = b.pos + b.atoms[ai]->getResidue()->getResidueIndex() - last->getResidueIndex();
+      if (positions.find(pi) != positions.end()) { refreshBound(bi); break; }
+    }
+  }
+
+  warmStart = true;
+  eval(vector<mstreal>());
+  warmStart = false;
+}
+
 mstreal fusionEvaluator::atomRadius(const Atom& a) {
-  if (a.isNamed("N")) {
+  static const int idN = MstNames::intern("N"), idCA = MstNames::intern("CA"), idC = MstNames::intern("C"), idO = MstNames::intern("O");
+  if (a.isNamed(idN)) {
     return 1.6;
-  } else if (a.isNamed("CA")) {
+  } else if (a.isNamed(idCA)) {
     return 2.3; // between CH1E and CH2E in param 19
-  } else if (a.isNamed("C")) {
+  } else if (a.isNamed(idC)) {
     return 2.1;
-  } else if (a.isNamed("O")) {
+  } else if (a.isNamed(idO)) {
     return 1.6;
   } else {
     MstUtils::error("do not know radius for atom name " + a.getName(), "fusionEvaluator::atomRadius(const Atom&)");
@@ -1062,14 +1234,80 @@ mstreal fusionEvaluator::atomRadius(const Atom& a) {
   return 0;
 }
 
+void fusionEvaluator::coordinateJacobian::setAtoms(const vector<Atom*>& atoms) {
+  clear();
+  for (int i = 0; i < atoms.size(); i++) atomIdx[atoms[i]] = i;
+}
+
+int fusionEvaluator::coordinateJacobian::index(Atom* A) const {
+  auto it = atomIdx.find(A);
+  if (it == atomIdx.end()) MstUtils::error("atom " + MstUtils::toString(*A) + " is not tracked", "coordinateJacobian::index");
+  return it->second;
+}
+
+vector<int> fusionEvaluator::coordinateJacobian::indices(const vector<Atom*>& atoms) const {
+  vector<int> inds(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) inds[i] = index(atoms[i]);
+  return inds;
+}
+
+void fusionEvaluator::coordinateJacobian::addPartial(Atom* A, int dim, int coorIdx, mstreal partialVal) {
+  partXYZ.push_back(3*index(A) + dim);
+  partCoor.push_back(coorIdx);
+  partVals.push_back(partialVal);
+}
+
+void fusionEvaluator::coordinateJacobian::addBuildStep(Atom* A, Atom* diA, Atom* anA, Atom* thA, int coorIdx, const mstreal* icPartials, const mstreal* xyzPartials) {
+  stepAtoms.push_back(index(A));
+  stepAtoms.push_back(index(diA));
+  stepAtoms.push_back(index(anA));
+  stepAtoms.push_back(index(thA));
+  stepCoor.push_back(coorIdx);
+  stepPartials.insert(stepPartials.end(), icPartials, icPartials + 9);
+  stepPartials.insert(stepPartials.end(), xyzPartials, xyzPartials + 27);
+}
+
+void fusionEvaluator::coordinateJacobian::chain(vector<mstreal>& xyzGrad, vector<mstreal>& grad) const {
+  // in reverse build order, by which time the gradient with respect to the
+  // placed atom has received contributions from all atoms built from it
+  for (int s = stepCoor.size() - 1; s >= 0; s--) {
+    const int* ai = &(stepAtoms[4*s]);
+    const mstreal* icPartials = &(stepPartials[36*s]);
+    const mstreal* xyzPartials = icPartials + 9;
+    const mstreal* g = &(xyzGrad[3*ai[0]]);
+    int k = stepCoor[s];
+    for (int d = 0; d < 3; d++) {
+      grad[k] += g[d] * icPartials[3*d];
+      grad[k+1] += g[d] * icPartials[3*d + 1];
+      grad[k+2] += g[d] * icPartials[3*d + 2];
+    }
+    for (int r = 0; r < 3; r++) {
+      mstreal* gr = &(xyzGrad[3*ai[r+1]]);
+      const mstreal* P = xyzPartials + 9*r;
+      for (int j = 0; j < 3; j++) gr[j] += g[0] * P[j] + g[1] * P[3 + j] + g[2] * P[6 + j];
+    }
+  }
+  for (int i = 0; i < partVals.size(); i++) grad[partCoor[i]] += xyzGrad[partXYZ[i]] * partVals[i];
+}
+
+void fusionEvaluator::coordinateJacobian::clearPartials() {
+  partXYZ.clear(); partCoor.clear(); partVals.clear();
+  stepAtoms.clear(); stepCoor.clear(); stepPartials.clear();
+}
+
 /* --------- Fuser ----------- */
 
 Structure Fuser::fuse(const fusionTopology& topo, fusionOutput& scores, const fusionParams& params) {
+  return fuseStart(topo, scores, params, false);
+}
+
+Structure Fuser::fuseStart(const fusionTopology& topo, fusionOutput& scores, const fusionParams& params, bool perturbStart) {
+  MstProfiler::scope prof("Fuser::fuse");
   fusionEvaluator E(topo, params); E.setVerbose(false);
   vector<mstreal> bestSolution; mstreal score, bestScore; int bestAnchor;
   vector<vector<mstreal> > trajectory, bestTrajectory; vector<mstreal> trajScores, bestTrajScores;
   for (int i = 0; i < params.numCycles(); i++) {
-    if (i > 0) {
+    if ((i > 0) || perturbStart) {
       E.noisifyGuessPoint(0.2);
       E.chooseBuildOrigin(true);
     }
@@ -1078,13 +1316,54 @@ Structure Fuser::fuse(const fusionTopology& topo, fusionOutput& scores, const fu
       score = Optim::gradDescent(E, solution, params.numIters(), params.errTol(), params.isVerbose());
     } else if (params.getMinimizerType() == fusionParams::conjGrad) {
       score = Optim::conjGradMin(E, solution, params.numIters(), params.errTol(), params.isVerbose());
+    } else if (params.getMinimizerType() == fusionParams::lbfgs) {
+      score = Optim::lbfgs(E, solution, params.numIters(), params.errTol(), params.isVerbose());
     } else if (params.getMinimizerType() == fusionParams::langevinDyna) {
       trajectory.clear();
       E.guessPoint(); // fills masses (among other things)
-      trajScores = Optim::langevinDynamics(E, CartesianPoint(E.getMasses())*params.massFactor(), params.timeStep(), params.viscosity(), params.thermalEnergy(), params.numIters(), trajectory, params.saveInterval(), true);
-      score = trajScores.back();
-      solution = trajectory.back();
-      if (params.logBaseDefined()) {
+      if (params.numReplicas() > 1) {
+        // replica exchange, with the replicas splitting the threads among
+        // themselves, and keeping (or streaming) only the coldest replica
+        int R = params.numReplicas();
+        fusionParams rp = params;
+        rp.setNumThreads(MstUtils::max(1, params.getNumThreads()/R));
+        rp.setVerbose(false);
+        vector<fusionEvaluator*> reps(R);
+        for (int k = 0; k < R; k++) {
+          reps[k] = new fusionEvaluator(topo, rp);
+          reps[k]->setBuildOrigin(E.getBuildOrigin());
+          reps[k]->guessPoint();
+          reps[k]->setGuessPoint(E.guessPoint());
+        }
+        trajectoryWriter* sink = params.getTrajectorySink();
+        vector<vector<mstreal> > finals;
+        trajScores.clear();
+        vector<mstreal> finalScores = Optim::langevinReplicas(vector<optimizerEvaluator*>(reps.begin(), reps.end()), CartesianPoint(E.getMasses())*params.massFactor(), params.timeStep(), params.viscosity(), Optim::temperatureLadder(params.thermalEnergy(), params.maxThermalEnergy(), R), params.numIters(), finals, [&](int k, const vector<mstreal>& x, mstreal ener) {
+          if (k != 0) return;
+          if (sink != NULL) {
+            E.eval(x);
+            sink->addFrame(E.getAlignedStructure(), ener);
+          } else {
+            trajectory.push_back(x);
+            trajScores.push_back(ener);
+          }
+        }, params.saveInterval(), params.exchangeInterval(), params.getNumThreads(), true);
+        for (int k = 0; k < R; k++) delete reps[k];
+        score = finalScores[0];
+        solution = finals[0];
+      } else if (params.getTrajectorySink() != NULL) {
+        trajectoryWriter& sink = *(params.getTrajectorySink());
+        score = Optim::langevinDynamics(E, CartesianPoint(E.getMasses())*params.massFactor(), params.timeStep(), params.viscosity(), params.thermalEnergy(), params.numIters(), solution, [&](const vector<mstreal>& x, mstreal ener) {
+          E.eval(x);
+          sink.addFrame(E.getAlignedStructure(), ener);
+        }, params.saveInterval(), true);
+        trajScores.clear();
+      } else {
+        trajScores = Optim::langevinDynamics(E, CartesianPoint(E.getMasses())*params.massFactor(), params.timeStep(), params.viscosity(), params.thermalEnergy(), params.numIters(), trajectory, params.saveInterval(), true);
+        score = trajScores.back();
+        solution = trajectory.back();
+      }
+      if (params.logBaseDefined() && (params.getTrajectorySink() == NULL)) {
         fstream lf;
         MstUtils::openFile(lf, params.getLogBase() + ".dyn.pdb", ios::out);
         for (int k = 0; k < trajectory.size(); k++) {
@@ -1129,6 +1408,42 @@ Structure Fuser::fuse(const fusionTopology& topo, const fusionParams& params) {
   return fuse(topo, scores, params);
 }
 
+vector<fusionOutput> Fuser::fuseMulti(const fusionTopology& topo, const fusionParams& params, int numStarts, int numThreads, mstreal stopScore) {
+  MstProfiler::scope prof("Fuser::fuseMulti");
+  vector<unsigned> seeds(numStarts);
+  for (int s = 0; s < numStarts; s++) seeds[s] = MstUtils::randEngine()();
+  vector<fusionOutput> outputs(numStarts);
+  vector<char> ran(numStarts, false);
+  atomic<bool> stop(false);
+  MstUtils::parallelFor(numStarts, numThreads, [&](int s, int w) {
+    if (stop) return;
+    // seed this thread's generator for the start, leaving its state as it was after
+    mt19937 saved = MstUtils::randEngine();
+    MstUtils::seedRandEngine(seeds[s]);
+    fuseStart(topo, outputs[s], params, s > 0);
+    MstUtils::randEngine() = saved;
+    ran[s] = true;
+    if (outputs[s].getScore() <= stopScore) stop = true;
+  });
+
+  vector<fusionOutput> done;
+  for (int s = 0; s < numStarts; s++) {
+    if (ran[s]) done.push_back(outputs[s]);
+  }
+  return done;
+}
+
+Structure Fuser::fuseMulti(const fusionTopology& topo, fusionOutput& best, const fusionParams& params, int numStarts, int numThreads, mstreal stopScore) {
+  vector<fusionOutput> outputs = fuseMulti(topo, params, numStarts, numThreads, stopScore);
+  if (outputs.empty()) MstUtils::error("no fusion starts were run", "Fuser::fuseMulti");
+  int bi = 0;
+  for (int i = 1; i < outputs.size(); i++) {
+    if (outputs[i].getScore() < outputs[bi].getScore()) bi = i;
+  }
+  best = outputs[bi];
+  return best.getFused();
+}
+
 Structure Fuser::fuse(const vector<vector<Residue*> >& resTopo, fusionOutput& scores, const vector<int>& fixed, const fusionParams& params) {
   fusionTopology topo(resTopo);
   topo.addFixedPositions(fixed);
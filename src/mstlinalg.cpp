@@ -8,80 +8,70 @@ Matrix::~Matrix() {
   if (own) clear();
 }
 
-Matrix::Matrix(int rows, int cols, mstreal val) {
-  if ((rows < 0) || (cols < 0)) MstUtils::error("invalid dimensions specified: " + MstUtils::toString(rows) + " x " + MstUtils::toString(cols), "Matrix::Matrix");
-  M.resize(rows, vector<mstreal*>(cols, NULL));
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = new mstreal(val);
-    }
-  }
+void Matrix::allocate(int rows, int cols) {
+  if ((rows < 0) || (cols < 0)) MstUtils::error("invalid dimensions specified: " + MstUtils::toString(rows) + " x " + MstUtils::toString(cols), "Matrix::allocate");
+  if (rows == 0) cols = 0;
+  nr = rows; nc = cols;
+  rs = cols; cs = 1;
+  vals = (rows*cols > 0) ? new mstreal[rows*cols] : NULL;
   own = true;
 }
 
+void Matrix::clear() {
+  delete[] vals;
+  vals = NULL;
+  nr = nc = 0;
+  rs = cs = 0;
+}
+
+Matrix::Matrix(int rows, int cols, mstreal val) {
+  allocate(rows, cols);
+  std::fill(vals, vals + nr*nc, val);
+}
+
 Matrix::Matrix(const vector<vector<mstreal> >& _M) {
-  int rows = _M.size();
-  int cols = (_M.size() > 0) ? _M[0].size() : 0;
-  M.resize(rows, vector<mstreal*>(cols, NULL));
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = new mstreal(_M[i][j]);
-    }
+  allocate(_M.size(), (_M.size() > 0) ? _M[0].size() : 0);
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) vals[i*rs + j] = _M[i][j];
   }
-  own = true;
 }
 
-Matrix::Matrix(const vector<vector<mstreal*> >& _M, int rowBeg, int rowEnd, int colBeg, int colEnd) {
-  if (rowEnd < 0) rowEnd = _M.size() - 1;
-  if (colEnd < 0) colEnd = ((_M.size() > 0) ? _M[0].size() : 0) - 1;
-  int rows = rowEnd - rowBeg + 1;
-  int cols = colEnd - colBeg + 1;
-  M.resize(rows, vector<mstreal*>(cols, NULL));
-  for (int i = 0; i < rows; i++) {
-    for (int j = 0; j < cols; j++) {
-      M[i][j] = _M[i + rowBeg][j + colBeg];
-    }
-  }
+Matrix::Matrix(mstreal* _vals, int rows, int cols, int rowStride, int colStride) {
+  vals = _vals;
+  nr = rows; nc = cols;
+  rs = rowStride; cs = colStride;
   own = false;
 }
 
-void Matrix::clear() {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      delete(M[i][j]);
-    }
-  }
-  M.clear();
+Matrix::Matrix(const Matrix& _M) {
+  allocate(_M.numRows(), _M.numCols());
+  *this = _M;
 }
 
-Matrix::Matrix(const Matrix& _M) {
-  M.resize(_M.numRows(), vector<mstreal*>(_M.numCols(), NULL));
-  for (int i = 0; i < _M.numRows(); i++) {
-    for (int j = 0; j < _M.numCols(); j++) {
-      M[i][j] = new mstreal(_M(i,j));
-    }
+Matrix::Matrix(Matrix&& _M) {
+  if (_M.own) {
+    vals = _M.vals; nr = _M.nr; nc = _M.nc; rs = _M.rs; cs = _M.cs;
+    own = true;
+    _M.vals = NULL; _M.nr = _M.nc = 0;
+  } else {
+    // a copy of a view is a matrix of its own, whether moved or not
+    allocate(_M.numRows(), _M.numCols());
+    *this = _M;
   }
-  own = true;
 }
 
 Matrix::Matrix(const vector<mstreal>& p, bool col) {
-  if (col) {
-    M.resize(p.size(), vector<mstreal*>(1));
-    for (int i = 0; i < p.size(); i++) M[i][0] = new mstreal(p[i]);
-  } else {
-    M.resize(1, vector<mstreal*>(p.size()));
-    for (int i = 0; i < p.size(); i++) M[0][i] = new mstreal(p[i]);
-  }
-  own = true;
+  if (col) allocate(p.size(), 1);
+  else allocate(1, p.size());
+  std::copy(p.begin(), p.end(), vals);
 }
 
 int Matrix::size(int dim) const {
   switch(dim) {
     case 1:
-      return M.size();
+      return nr;
     case 2:
-      if (M.size() == 0) return 0;
-      return M[0].size();
+      return nc;
     default:
       MstUtils::error("out of range dimension " + MstUtils::toString(dim), "Matrix::size");
       return 0; // to make the compiler happy
@@ -89,75 +79,110 @@ int Matrix::size(int dim) const {
 }
 
 Matrix& Matrix::operator=(const Matrix& _M) {
+  if (this == &_M) return *this;
   if ((numRows() != _M.numRows()) || (numCols() != _M.numCols())) {
     if (!getOwnFlag()) {
       MstUtils::error("dimensions must agree when assigning to a sub-Matrix", "Matrix::operator=");
-    } else {
-      clear();
-      M.resize(_M.numRows(), vector<mstreal*>(_M.numCols(), NULL));
-      for (int i = 0; i < _M.numRows(); i++) {
-        for (int j = 0; j < _M.numCols(); j++) {
-          M[i][j] = new mstreal(_M(i, j));
-        }
-      }
     }
+    clear();
+    allocate(_M.numRows(), _M.numCols());
+  }
+  if (isContiguous() && _M.isContiguous()) {
+    std::copy(_M.vals, _M.vals + nr*nc, vals);
   } else {
-    for (int i = 0; i < this->numRows(); i++) {
-      for (int j = 0; j < this->numCols(); j++) {
-        *(M[i][j]) = _M(i, j);
-      }
+    for (int i = 0; i < nr; i++) {
+      for (int j = 0; j < nc; j++) (*this)(i, j) = _M(i, j);
     }
   }
   return *this;
 }
 
+Matrix& Matrix::operator=(Matrix&& _M) {
+  // views write through into the matrix they came from, so only swap out
+  // storage when both sides own theirs
+  if (!own || !_M.own) return *this = (const Matrix&) _M;
+  std::swap(vals, _M.vals);
+  std::swap(nr, _M.nr); std::swap(nc, _M.nc);
+  std::swap(rs, _M.rs); std::swap(cs, _M.cs);
+  return *this;
+}
+
 Matrix& Matrix::operator/=(const mstreal& s) {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) /= s;
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = vals + i*rs;
+    for (int j = 0; j < nc; j++) r[j*cs] /= s;
   }
   return *this;
 }
 
 Matrix& Matrix::operator*=(const mstreal& s) {
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) *= s;
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = vals + i*rs;
+    for (int j = 0; j < nc; j++) r[j*cs] *= s;
   }
   return *this;
 }
 
-const Matrix Matrix::operator/(const mstreal& s) const {
+Matrix Matrix::operator/(const mstreal& s) const {
   Matrix R = *this;
   R /= s;
   return R;
 }
 
-const Matrix Matrix::operator*(const mstreal& s) const {
+Matrix Matrix::operator*(const mstreal& s) const {
   Matrix R = *this;
   R *= s;
   return R;
 }
 
 Matrix& Matrix::operator*=(const Matrix& P) {
-  Matrix R = *this * P;
-  *this = R;
+  *this = *this * P;
   return *this;
 }
 
-const Matrix Matrix::operator*(const Matrix& P) const {
+Matrix Matrix::operator*(const Matrix& P) const {
   if (this->size(2) != P.size(1)) MstUtils::error("matrix dimensions do not agree", "Matrix::operator*(Matrix&)");
   int n = this->size(1);
   int m = P.size(2);
   int p = this->size(2);
   Matrix R(n, m, 0);
+  if (R.nr*R.nc == 0) return R;
+
+#ifdef ARMA
+  // for larger dense operands, defer to Armadillo (and whatever BLAS it links
+  // against). Armadillo is column-major, so a row-major block reads as the
+  // transpose, and R' = P' * this' is computed into R's storage directly.
+  if (isContiguous() && P.isContiguous() && ((long) n*m*p >= 32*32*32)) {
+    const armaMat At(const_cast<mstreal*>(vals), p, n, false, true);
+    const armaMat Pt(const_cast<mstreal*>(P.vals), m, p, false, true);
+    armaMat Rt(R.vals, m, n, false, true);
+    Rt = Pt * At;
+    return R;
+  }
+#endif
 
-  for (int i = 0; i < n; i++) {
-    for (int j = 0; j < m; j++) {
-      for (int k = 0; k < p; k++) {
-        R(i,j) += (*this)(i,k) * P(k,j);
+  // blocked i-k-j product, so that the rows of P and R being swept stay in
+  // cache, and the innermost loop runs along rows of P and R
+  const int B = 64;
+  for (int i0 = 0; i0 < n; i0 += B) {
+    int i1 = MstUtils::min(i0 + B, n);
+    for (int k0 = 0; k0 < p; k0 += B) {
+      int k1 = MstUtils::min(k0 + B, p);
+      for (int j0 = 0; j0 < m; j0 += B) {
+        int j1 = MstUtils::min(j0 + B, m);
+        for (int i = i0; i < i1; i++) {
+          mstreal* r = R.vals + i*R.rs;
+          const mstreal* a = vals + i*rs;
+          for (int k = k0; k < k1; k++) {
+            mstreal aik = a[k*cs];
+            const mstreal* b = P.vals + k*P.rs;
+            if (P.cs == 1) {
+              for (int j = j0; j < j1; j++) r[j] += aik * b[j];
+            } else {
+              for (int j = j0; j < j1; j++) r[j] += aik * b[j*P.cs];
+            }
+          }
+        }
       }
     }
   }
@@ -168,15 +193,15 @@ Matrix& Matrix::operator+=(const Matrix& P) {
   if ((this->size(1) != P.size(1)) || (this->size(2) != P.size(2))) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::operator+=(Matrix&)");
   }
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) += *(P.M[i][j]);
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = vals + i*rs;
+    const mstreal* q = P.vals + i*P.rs;
+    for (int j = 0; j < nc; j++) r[j*cs] += q[j*P.cs];
   }
   return *this;
 }
 
-const Matrix Matrix::operator+(const Matrix& P) const {
+Matrix Matrix::operator+(const Matrix& P) const {
   Matrix R = *this;
   R += P;
   return R;
@@ -186,38 +211,40 @@ Matrix& Matrix::operator-=(const Matrix& P) {
   if ((this->size(1) != P.size(1)) || (this->size(2) != P.size(2))) {
     MstUtils::error("matrix dimensions do not agree", "Matrix::operator-=(Matrix&)");
   }
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      *(M[i][j]) -= *(P.M[i][j]);
-    }
+  for (int i = 0; i < nr; i++) {
+    mstreal* r = vals + i*rs;
+    const mstreal* q = P.vals + i*P.rs;
+    for (int j = 0; j < nc; j++) r[j*cs] -= q[j*P.cs];
   }
   return *this;
 }
 
-const Matrix Matrix::operator-(const Matrix& P) const {
+Matrix Matrix::operator-(const Matrix& P) const {
   Matrix R = *this;
   R -= P;
   return R;
 }
 
-const Matrix Matrix::operator-() const {
+Matrix Matrix::operator-() const {
   Matrix R = *this;
   R *= -1;
   return R;
 }
 
 Matrix Matrix::row(int i) {
-  Matrix subMat(M, i, i);
-  return subMat;
+  return Matrix(vals + i*rs, 1, nc, rs, cs);
 }
 
 Matrix Matrix::column(int i) {
-  Matrix subMat(M, 0, -1, i, i);
-  return subMat;
+  return Matrix(vals + i*cs, nr, 1, rs, cs);
 }
 
 Matrix::operator vector<mstreal>() const {
   vector<mstreal> cat(numRows() * numCols());
+  if (isContiguous()) {
+    std::copy(vals, vals + cat.size(), cat.begin());
+    return cat;
+  }
   int k = 0;
   for (int i = 0; i < numRows(); i++) {
     for (int j = 0; j < numCols(); j++) {
@@ -298,8 +325,16 @@ Matrix Matrix::inverse() {
 
 Matrix Matrix::transpose() {
   Matrix R(numCols(), numRows());
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) R(j,i) = *(M[i][j]);
+  // in square tiles, so that neither the reads nor the writes stride through
+  // the whole matrix
+  const int B = 32;
+  for (int i0 = 0; i0 < nr; i0 += B) {
+    for (int j0 = 0; j0 < nc; j0 += B) {
+      int i1 = MstUtils::min(i0 + B, nr), j1 = MstUtils::min(j0 + B, nc);
+      for (int i = i0; i < i1; i++) {
+        for (int j = j0; j < j1; j++) R.vals[j*R.rs + i] = (*this)(i, j);
+      }
+    }
   }
   return R;
 }
@@ -336,38 +371,35 @@ Matrix Matrix::sum(int dim, bool norm) const {
 }
 
 mstreal Matrix::norm() const {
-  mstreal n = 0;
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) n += (*(M[i][j])) * (*(M[i][j]));
-  }
-  return sqrt(n);
+  return sqrt(norm2());
 }
 
 mstreal Matrix::norm2() const {
   mstreal n = 0;
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) n += (*(M[i][j])) * (*(M[i][j]));
+  for (int i = 0; i < nr; i++) {
+    const mstreal* r = vals + i*rs;
+    for (int j = 0; j < nc; j++) n += r[j*cs] * r[j*cs];
   }
   return n;
 }
 
 mstreal Matrix::min() const {
-  if (length() == 0) MstUtils::error("called on an empty matrix", "Matrix::min()");
-  mstreal m = *(M[0][0]);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      if (*(M[i][j]) < m) m = *(M[i][j]);
+  if (nr*nc == 0) MstUtils::error("called on an empty matrix", "Matrix::min()");
+  mstreal m = vals[0];
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) {
+      if ((*this)(i, j) < m) m = (*this)(i, j);
     }
   }
   return m;
 }
 
 mstreal Matrix::max() const {
-  if (length() == 0) MstUtils::error("called on an empty matrix", "Matrix::max()");
-  mstreal m = *(M[0][0]);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      if (*(M[i][j]) > m) m = *(M[i][j]);
+  if (nr*nc == 0) MstUtils::error("called on an empty matrix", "Matrix::max()");
+  mstreal m = vals[0];
+  for (int i = 0; i < nr; i++) {
+    for (int j = 0; j < nc; j++) {
+      if ((*this)(i, j) > m) m = (*this)(i, j);
     }
   }
   return m;
@@ -375,11 +407,7 @@ mstreal Matrix::max() const {
 
 Matrix Matrix::abs() const {
   Matrix Ma(*this);
-  for (int i = 0; i < M.size(); i++) {
-    for (int j = 0; j < M[i].size(); j++) {
-      Ma(i, j) = fabs(*(M[i][j]));
-    }
-  }
+  for (int k = 0; k < nr*nc; k++) Ma.vals[k] = fabs(Ma.vals[k]);
   return Ma;
 }
 
@@ -411,8 +439,13 @@ Matrix Matrix::div(const Matrix& other) const {
 
 mstreal Vector::dot(const Vector& v) const {
   if (size() != v.size()) MstUtils::error("mismatching vector lengths", "Vector::dot");
+  int n = nr*nc, a = linearStride(), b = v.linearStride();
   mstreal d = 0;
-  for (int i = 0; i < size(); i++) d += (*this)[i] * v[i];
+  if ((a == 1) && (b == 1)) {
+    for (int i = 0; i < n; i++) d += vals[i] * v.vals[i];
+  } else {
+    for (int i = 0; i < n; i++) d += vals[i*a] * v.vals[i*b];
+  }
   return d;
 }
 
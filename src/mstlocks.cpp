@@ -0,0 +1,82 @@
+#include "mstlocks.h"
+#include <sys/file.h>
+#include <fcntl.h>
+#include <cerrno>
+#include <thread>
+
+/* --------- fileLockBackend ------------ */
+fileLockBackend::~fileLockBackend() {
+  for (auto it = states.begin(); it != states.end(); ++it) {
+    if (it->second->fd >= 0) close(it->second->fd);
+  }
+}
+
+fileLockBackend::lockState& fileLockBackend::getState(const string& tag) {
+  lock_guard<mutex> lock(statesLock);
+  unique_ptr<lockState>& state = states[tag];
+  if (state.get() == NULL) state.reset(new lockState());
+  return *state;
+}
+
+bool fileLockBackend::acquire(const string& tag, bool shared, mstreal timeout) {
+  lockState& state = getState(tag);
+  auto start = chrono::steady_clock::now();
+  auto timedOut = [&]() { return (timeout >= 0) && (chrono::duration<double>(chrono::steady_clock::now() - start).count() > timeout); };
+
+  // first, get in line among the threads of this process
+  unique_lock<mutex> lock(state.m);
+  auto available = [&]() { return !state.writer && !state.acquiring && (shared || (state.readers == 0)); };
+  if (timeout < 0) state.cv.wait(lock, available);
+  else if (!state.cv.wait_for(lock, chrono::duration<double>(timeout), available)) return false;
+  if (shared && (state.readers > 0)) { state.readers++; return true; } // the file lock is already held shared
+
+  // then, get the file lock, while other threads wait
+  state.acquiring = true;
+  lock.unlock();
+  bool success = false;
+  if (state.fd < 0) state.fd = open(lockFile(tag).c_str(), O_RDWR | O_CREAT, 0666);
+  if (state.fd >= 0) {
+    int wait = 20; // in microseconds
+    while (true) {
+      if (flock(state.fd, (shared ? LOCK_SH : LOCK_EX) | LOCK_NB) == 0) { success = true; break; }
+      if ((errno != EWOULDBLOCK) && (errno != EINTR)) break;
+      if (timedOut()) break;
+      this_thread::sleep_for(chrono::microseconds(wait));
+      wait = MstUtils::min(2*wait, 10000);
+    }
+  }
+  lock.lock();
+  state.acquiring = false;
+  if (success) {
+    if (shared) state.readers++;
+    else state.writer = true;
+  }
+  state.cv.notify_all();
+  return success;
+}
+
+bool fileLockBackend::release(const string& tag) {
+  lockState& state = getState(tag);
+  lock_guard<mutex> lock(state.m);
+  if (state.writer) state.writer = false;
+  else if (state.readers > 0) state.readers--;
+  else return false; // not held
+  if (!state.writer && (state.readers == 0)) flock(state.fd, LOCK_UN);
+  state.cv.notify_all();
+  return true;
+}
+
+/* --------- MstLocks ------------ */
+static mutex backendLock;
+static shared_ptr<lockBackend> currentBackend;
+
+void MstLocks::setBackend(const shared_ptr<lockBackend>& backend) {
+  lock_guard<mutex> lock(backendLock);
+  currentBackend = backend;
+}
+
+lockBackend& MstLocks::getBackend() {
+  lock_guard<mutex> lock(backendLock);
+  if (currentBackend.get() == NULL) currentBackend.reset(new fileLockBackend());
+  return *currentBackend;
+}
@@ -174,6 +174,18 @@ vector<int> TERMUtils::selectTERM(const vector<Residue*>& cenRes, Structure& fra
 }
 
 vector<int> TERMUtils::selectTERM(const vector<Residue*>& cenRes, Structure& frag, vector<int> pm, vector<int>* fragResIdx, bool contiguous) {
+  StructureView view;
+  vector<int> centralIdx = TERMUtils::selectTERM(cenRes, view, pm, fragResIdx, contiguous);
+  view.appendTo(frag, "A");
+  return centralIdx;
+}
+
+vector<int> TERMUtils::selectTERM(const vector<Residue*>& cenRes, StructureView& frag, int pm, vector<int>* fragResIdx, bool contiguous) {
+    vector<int> pmCenRes(cenRes.size(),pm);
+    return TERMUtils::selectTERM(cenRes, frag, pmCenRes, fragResIdx, contiguous);
+}
+
+vector<int> TERMUtils::selectTERM(const vector<Residue*>& cenRes, StructureView& frag, vector<int> pm, vector<int>* fragResIdx, bool contiguous) {
   if (cenRes.size() == 0) return vector<int>();
     if (cenRes.size() != pm.size()) MstUtils::error("The length of cenRes and pm vectors must match: "+MstUtils::toString(cenRes.size())+" and "+MstUtils::toString(pm.size()),"TERMUtils::selectTERM");
   Structure* S = cenRes[0]->getChain()->getParent();
@@ -198,15 +210,12 @@ vector<int> TERMUtils::selectTERM(const vector<Residue*>& cenRes, Structure& fra
     }
   }
 
-  Chain* newChain = frag.appendChain("A", true);
+  // where there is a break in the selection (or a chain ends), the view starts a new segment
+  frag.setParent(*S);
   int n = 0; vector<int> centralIdx(cenRes.size(), -1);
   for (int k = 0; k < selected.size(); k++) {
     if (selected[k]) {
-      // where there is a break in the selection, start a new chain
-      if ((newChain->residueSize() > 0) && ((!selected[k-1]) || (S->getResidue(k-1).getChain() != S->getResidue(k).getChain()))) {
-        newChain = frag.appendChain("A", true);
-      }
-      newChain->appendResidue(new Residue(S->getResidue(k)));
+      frag.addResidue(k);
       if (fragResIdx != NULL) fragResIdx->push_back(k);
       if (central[k] >= 0) centralIdx[central[k]] = n;
       n++;
@@ -18,6 +18,16 @@ Vector optimizerEvaluator::finiteDifferenceGradient(const vector<mstreal>& point
   return grad;
 }
 
+mstreal optimizerEvaluator::eval(const mstreal* x, mstreal* grad, int n) {
+  vector<mstreal> point(x, x + n);
+  if (grad == NULL) return eval(point);
+  Vector g(n);
+  mstreal v = eval(point, g);
+  if (g.length() != n) MstUtils::error("gradient of dimension " + MstUtils::toString(g.length()) + " at a point of dimension " + MstUtils::toString(n), "optimizerEvaluator::eval(const mstreal*, mstreal*, int)");
+  for (int i = 0; i < n; i++) grad[i] = g[i];
+  return v;
+}
+
 mstreal Optim::fminsearch(optimizerEvaluator& E, int numIters, vector<mstreal>& solution, bool verbose) {
   mstreal tol = 10E-6;
   Matrix x0(E.guessPoint()); // row vector
@@ -202,7 +212,179 @@ mstreal Optim::lineSearch(optimizerEvaluator& E, const vector<mstreal>& point, v
   return v0;
 }
 
+/* Line search from point x (with function value f), along direction d (with
+ * directional derivative dg0 < 0), for a step satisfying the strong Wolfe
+ * conditions, as in Algorithms 3.5 and 3.6 of Nocedal and Wright, "Numerical
+ * Optimization" (2006). Starts with step t, and on return, t is the accepted
+ * step (or 0 if none lowering the function was found), while xt and gt hold
+ * the corresponding point and its gradient. */
+static mstreal wolfeLineSearch(optimizerEvaluator& E, int n, const mstreal* x, mstreal f, const mstreal* d, mstreal dg0, mstreal& t, mstreal* xt, mstreal* gt) {
+  const mstreal c1 = 10E-5, c2 = 0.9;
+  auto evalAt = [&](mstreal a, mstreal& dg) -> mstreal {
+    for (int i = 0; i < n; i++) xt[i] = x[i] + a*d[i];
+    mstreal v = E.eval(xt, gt, n);
+    dg = 0;
+    for (int i = 0; i < n; i++) dg += gt[i]*d[i];
+    return v;
+  };
+
+  // narrows down the bracket between steps lo and hi, where lo is the best
+  // step so far that satisfies the sufficient decrease condition
+  auto zoom = [&](mstreal lo, mstreal hi, mstreal flo, mstreal fhi, mstreal dglo, mstreal dghi) -> mstreal {
+    mstreal ft, dgt;
+    for (int k = 0; k < 30; k++) {
+      // minimum of the cubic interpolant, if well inside the bracket, or else bisection
+      mstreal a = (lo + hi)/2, w = fabs(hi - lo);
+      mstreal d1 = dglo + dghi - 3*(flo - fhi)/(lo - hi);
+      mstreal disc = d1*d1 - dglo*dghi;
+      if (disc >= 0) {
+        mstreal d2 = ((hi > lo) ? 1 : -1) * sqrt(disc);
+        mstreal den = dghi - dglo + 2*d2;
+        mstreal c = (den != 0) ? hi - (hi - lo)*(dghi + d2 - d1)/den : a;
+        if ((fabs(c - lo) > 0.1*w) && (fabs(c - hi) > 0.1*w) && ((c - lo)*(c - hi) < 0)) a = c;
+      }
+      ft = evalAt(a, dgt);
+      if (!(ft <= f + c1*a*dg0) || (ft >= flo)) {
+        hi = a; fhi = ft; dghi = dgt;
+      } else {
+        if (fabs(dgt) <= -c2*dg0) { t = a; return ft; }
+        if (dgt*(hi - lo) >= 0) { hi = lo; fhi = flo; dghi = dglo; }
+        lo = a; flo = ft; dglo = dgt;
+      }
+      if (w < 10E-15*max(1.0, fabs(lo))) break;
+    }
+    // settle for the best step found
+    t = lo;
+    return (lo == 0) ? f : evalAt(lo, dgt);
+  };
+
+  mstreal tPrev = 0, fPrev = f, dgPrev = dg0, ft, dgt;
+  for (int k = 0; k < 20; k++) {
+    ft = evalAt(t, dgt);
+    if (!(ft <= f + c1*t*dg0) || ((k > 0) && (ft >= fPrev))) return zoom(tPrev, t, fPrev, ft, dgPrev, dgt);
+    if (fabs(dgt) <= -c2*dg0) return ft;
+    if (dgt >= 0) return zoom(t, tPrev, ft, fPrev, dgt, dgPrev);
+    tPrev = t; fPrev = ft; dgPrev = dgt;
+    t *= 2;
+  }
+  t = tPrev; // the last step tried, which satisfies sufficient decrease
+  return fPrev;
+}
+
+mstreal Optim::lbfgs(optimizerEvaluator& E, vector<mstreal>& solution, int numIters, mstreal tol, bool verbose, int m) {
+  return lbfgsMin(E, solution, NULL, NULL, numIters, tol, verbose, m);
+}
+
+mstreal Optim::lbfgsb(optimizerEvaluator& E, vector<mstreal>& solution, const vector<mstreal>& lo, const vector<mstreal>& hi, int numIters, mstreal tol, bool verbose, int m) {
+  return lbfgsMin(E, solution, &lo, &hi, numIters, tol, verbose, m);
+}
+
+mstreal Optim::lbfgsMin(optimizerEvaluator& E, vector<mstreal>& solution, const vector<mstreal>* lo, const vector<mstreal>* hi, int numIters, mstreal tol, bool verbose, int m) {
+  vector<mstreal> x = E.guessPoint();
+  int n = x.size();
+  bool bounded = (lo != NULL);
+  if (bounded && ((lo->size() != n) || (hi->size() != n))) MstUtils::error("bounds given for " + MstUtils::toString(lo->size()) + " and " + MstUtils::toString(hi->size()) + " coordinates in a " + MstUtils::toString(n) + "-dimensional problem", "Optim::lbfgsb");
+  m = max(m, 1);
+  auto project = [&](vector<mstreal>& p) {
+    if (!bounded) return;
+    for (int i = 0; i < n; i++) p[i] = min(max(p[i], (*lo)[i]), (*hi)[i]);
+  };
+  project(x);
+
+  // all working storage is allocated here; S and Y hold the last m correction
+  // pairs (s = x_{k+1} - x_k and y = g_{k+1} - g_k), as rows of a ring buffer
+  vector<mstreal> g(n), xt(n), gt(n), d(n), S(m*n), Y(m*n), rho(m), alpha(m);
+  vector<bool> held(n, false);
+  int numPairs = 0, newest = m - 1;
+  mstreal scale = 1; // initial inverse Hessian is scale times the identity
+  mstreal f = E.eval(x.data(), g.data(), n);
+  for (int it = 0; it < numIters; it++) {
+    // coordinates at a bound, with the gradient pointing outward, are held
+    mstreal gnorm = 0;
+    for (int i = 0; i < n; i++) {
+      held[i] = bounded && (((x[i] <= (*lo)[i]) && (g[i] > 0)) || ((x[i] >= (*hi)[i]) && (g[i] < 0)));
+      if (!held[i]) gnorm += g[i]*g[i];
+    }
+    gnorm = sqrt(gnorm);
+    if (verbose) printf("L-BFGS %d: %e (gradient norm = %e)\n", it+1, f, gnorm);
+    if (gnorm == 0) break;
+
+    // two-loop recursion for the direction -H*g, over the free coordinates
+    for (int i = 0; i < n; i++) d[i] = held[i] ? 0 : g[i];
+    for (int k = 0, j = newest; k < numPairs; k++, j = (j + m - 1) % m) {
+      const mstreal *s = &(S[j*n]), *y = &(Y[j*n]);
+      mstreal a = 0;
+      for (int i = 0; i < n; i++) a += s[i]*d[i];
+      alpha[j] = rho[j]*a;
+      for (int i = 0; i < n; i++) if (!held[i]) d[i] -= alpha[j]*y[i];
+    }
+    if (numPairs > 0) for (int i = 0; i < n; i++) d[i] *= scale;
+    for (int k = 0, j = (newest - numPairs + 1 + m) % m; k < numPairs; k++, j = (j + 1) % m) {
+      const mstreal *s = &(S[j*n]), *y = &(Y[j*n]);
+      mstreal b = 0;
+      for (int i = 0; i < n; i++) b += y[i]*d[i];
+      b *= rho[j];
+      for (int i = 0; i < n; i++) if (!held[i]) d[i] += (alpha[j] - b)*s[i];
+    }
+    mstreal dg = 0;
+    for (int i = 0; i < n; i++) { d[i] = held[i] ? 0 : -d[i]; dg += d[i]*g[i]; }
+    if (!(dg < 0)) {
+      // not a descent direction, so forget the history and go down the gradient
+      numPairs = 0; dg = 0;
+      for (int i = 0; i < n; i++) { d[i] = held[i] ? 0 : -g[i]; dg += d[i]*g[i]; }
+    }
+
+    // line search (the first step, without history, has unit length)
+    mstreal t = (numPairs == 0) ? min(1.0, 1.0/gnorm) : 1.0, ft;
+    if (!bounded) {
+      ft = wolfeLineSearch(E, n, x.data(), f, d.data(), dg, t, xt.data(), gt.data());
+    } else {
+      // backtracking along the projected path, until there is sufficient decrease
+      bool found = false;
+      for (int k = 0; k < 50; k++, t /= 2) {
+        for (int i = 0; i < n; i++) xt[i] = x[i] + t*d[i];
+        project(xt);
+        ft = E.eval(xt.data(), gt.data(), n);
+        mstreal dec = 0;
+        for (int i = 0; i < n; i++) dec += g[i]*(xt[i] - x[i]);
+        if (ft <= f + 10E-5*dec) { found = true; break; }
+      }
+      if (!found) t = 0;
+    }
+    if (t == 0) break; // could not lower the function along the direction
+
+    // store the new correction pair in place of the oldest one, if it has
+    // positive curvature (otherwise, the BFGS update would not be positive definite)
+    int j = (newest + 1) % m;
+    mstreal *s = &(S[j*n]), *y = &(Y[j*n]), sy = 0, yy = 0;
+    for (int i = 0; i < n; i++) {
+      s[i] = xt[i] - x[i]; y[i] = gt[i] - g[i];
+      sy += s[i]*y[i]; yy += y[i]*y[i];
+    }
+    if (sy > 10E-11*yy) {
+      rho[j] = 1/sy; scale = sy/yy;
+      newest = j; numPairs = min(numPairs + 1, m);
+    } else if (numPairs == m) {
+      numPairs--; // slot j held the oldest pair, which was just overwritten
+    }
+    mstreal decrease = f - ft;
+    x.swap(xt); g.swap(gt); f = ft;
+    if (decrease < tol) break;
+  }
+  solution = x;
+  return f;
+}
+
 vector<mstreal> Optim::langevinDynamics(optimizerEvaluator& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, mstreal kT, int numIters, vector<vector<mstreal> >& trajectory, int saveInterval, bool verbose) {
+  vector<mstreal> ener, solution; // snapshot energies
+  langevinDynamics(E, masses, timeStep, gamma, kT, numIters, solution, [&](const vector<mstreal>& x, mstreal en) {
+    trajectory.push_back(x);
+    ener.push_back(en);
+  }, saveInterval, verbose);
+  return ener;
+}
+
+mstreal Optim::langevinDynamics(optimizerEvaluator& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, mstreal kT, int numIters, vector<mstreal>& solution, const function<void(const vector<mstreal>&, mstreal)>& snapshot, int saveInterval, bool verbose) {
   // Integrator type:
   // 0 -- Brooks-Brunger-Karplus (BBK) integration scheme, appropriate for small-gamma regime
   // 1 -- Bussi and Parrinello (May, 2018), works well for large gamma (https://arxiv.org/pdf/0803.4083.pdf)
@@ -210,7 +392,6 @@ vector<mstreal> Optim::langevinDynamics(optimizerEvaluator& E, const vector<mstr
   int integrator = 1;
 
   if (saveInterval < 0) saveInterval = numIters;
-  vector<mstreal> ener; // snapshot energies
 
   // some necessary vectors (needed by all integrators)
   Vector x0(E.guessPoint());    // starting positions (row vector)
@@ -300,12 +481,9 @@ vector<mstreal> Optim::langevinDynamics(optimizerEvaluator& E, const vector<mstr
       if (i % 100 == 0) cout << "Optim::langevinDynamics potential energy = " << en << ", kinetic energy = " << ke << " (running <kT> = " << 2*mke << ") total = " << en + ke << endl;
     }
     f = f1;
-    if ((i + 1) % saveInterval == 0) {
-      // save snapshot
-      trajectory.push_back(x);
-      ener.push_back(en);
-    }
+    if ((i + 1) % saveInterval == 0) snapshot(x, en); // save snapshot
   }
+  solution = x;
 
   // a second-order Langevin integrator
   // Vector x0(E.guessPoint()); // starting positions (row vector)
@@ -356,7 +534,109 @@ vector<mstreal> Optim::langevinDynamics(optimizerEvaluator& E, const vector<mstr
   //   }
   // }
 
-  return ener;
+  return en;
+}
+
+vector<mstreal> Optim::temperatureLadder(mstreal kTmin, mstreal kTmax, int n) {
+  if ((n < 1) || (kTmin <= 0) || (kTmax < kTmin)) MstUtils::error("need n >= 1 and 0 < kTmin <= kTmax", "Optim::temperatureLadder");
+  vector<mstreal> kTs(n, kTmin);
+  for (int k = 1; k < n; k++) kTs[k] = kTmin*pow(kTmax/kTmin, k/(n - 1.0));
+  return kTs;
+}
+
+vector<mstreal> Optim::langevinReplicas(const vector<optimizerEvaluator*>& E, const vector<mstreal>& masses, mstreal timeStep, mstreal gamma, const vector<mstreal>& kTs, int numIters, vector<vector<mstreal> >& solutions, const function<void(int, const vector<mstreal>&, mstreal)>& snapshot, int saveInterval, int exchangeInterval, int numThreads, bool verbose) {
+  int R = kTs.size();
+  if ((R == 0) || (E.size() != R)) MstUtils::error("need one evaluator per temperature, got " + MstUtils::toString(E.size()) + " evaluators and " + MstUtils::toString(R) + " temperatures", "Optim::langevinReplicas");
+  if (saveInterval < 0) saveInterval = numIters;
+
+  // the state of all replicas is kept in contiguous arrays, replica k at
+  // offset k*df (so that each step runs over plain arrays, with no temporaries)
+  vector<mstreal> x0 = E[0]->guessPoint();
+  int df = x0.size();
+  if ((masses.size() == 0) || (df % masses.size() != 0)) {
+    MstUtils::error(MstUtils::toString(df) + "-dimensional system, but received " + MstUtils::toString(masses.size()) + " masses", "Optim::langevinReplicas");
+  }
+  int dim = df / masses.size();
+  vector<mstreal> m(df), x(R*df), V(R*df), f(R*df), f1(R*df), c2(R*df), en(R);
+  for (int i = 0; i < df; i++) m[i] = masses[i / dim];
+  mstreal c1 = exp(-gamma*timeStep/2), timeStep2 = timeStep*timeStep;
+  vector<mt19937> engines(R);
+  for (int k = 0; k < R; k++) {
+    vector<mstreal> xk = (k == 0) ? x0 : E[k]->guessPoint();
+    if (xk.size() != df) MstUtils::error("replicas have different numbers of degrees of freedom", "Optim::langevinReplicas");
+    engines[k].seed(MstUtils::randEngine()());
+    normal_distribution<mstreal> normal(0, 1);
+    for (int i = 0; i < df; i++) {
+      x[k*df + i] = xk[i];
+      V[k*df + i] = sqrt(kTs[k]/m[i]) * normal(engines[k]);
+      c2[k*df + i] = sqrt((1 - c1*c1)*kTs[k]/m[i]);
+    }
+  }
+
+  // forces divided by mass, at the starting points
+  MstUtils::parallelFor(R, numThreads, [&](int k, int w) {
+    mstreal* fk = f.data() + k*df;
+    en[k] = E[k]->eval(x.data() + k*df, fk, df);
+    for (int i = 0; i < df; i++) fk[i] = -fk[i]/m[i];
+  });
+  if (verbose) cout << "Optim::langevinReplicas, " << R << " replicas, initial potential energies = " << MstUtils::vecToString(en, ", ") << endl;
+
+  vector<int> tried(MstUtils::max(R - 1, 0), 0), accepted(MstUtils::max(R - 1, 0), 0);
+  int numExchanges = 0;
+  vector<mstreal> snap(df);
+  for (int it = 0; it < numIters; it++) {
+    // Bussi and Parrinello step of every replica (see langevinDynamics)
+    MstUtils::parallelFor(R, numThreads, [&](int k, int w) {
+      normal_distribution<mstreal> normal(0, 1);
+      mt19937& rng = engines[k];
+      mstreal *xk = x.data() + k*df, *Vk = V.data() + k*df, *fk = f.data() + k*df, *gk = f1.data() + k*df, *ck = c2.data() + k*df;
+      for (int i = 0; i < df; i++) {
+        Vk[i] = c1*Vk[i] + ck[i]*normal(rng); // p(t+) from eq 12a
+        xk[i] += timeStep*Vk[i] + fk[i]*timeStep2/2;
+      }
+      en[k] = E[k]->eval(xk, gk, df);
+      for (int i = 0; i < df; i++) {
+        gk[i] = -gk[i]/m[i];
+        Vk[i] = c1*(Vk[i] + timeStep*(fk[i] + gk[i])/2) + ck[i]*normal(rng);
+      }
+    });
+    f.swap(f1);
+
+    // replica exchange between neighboring temperatures
+    if ((exchangeInterval > 0) && ((it + 1) % exchangeInterval == 0)) {
+      for (int k = numExchanges % 2; k + 1 < R; k += 2) {
+        tried[k]++;
+        mstreal delta = (1/kTs[k] - 1/kTs[k+1])*(en[k] - en[k+1]);
+        if ((delta < 0) && (MstUtils::randUnit() >= exp(delta))) continue;
+        accepted[k]++;
+        int a = k*df, b = (k + 1)*df;
+        swap_ranges(x.begin() + a, x.begin() + b, x.begin() + b);
+        swap_ranges(f.begin() + a, f.begin() + b, f.begin() + b);
+        swap_ranges(V.begin() + a, V.begin() + b, V.begin() + b);
+        mstreal up = sqrt(kTs[k+1]/kTs[k]);
+        for (int i = 0; i < df; i++) { V[a + i] /= up; V[b + i] *= up; }
+        swap(en[k], en[k+1]);
+      }
+      numExchanges++;
+    }
+
+    if (verbose && (it % 100 == 0)) {
+      cout << "Optim::langevinReplicas step " << it << ", potential energies = " << MstUtils::vecToString(en, ", ") << endl;
+    }
+    if ((snapshot != nullptr) && ((it + 1) % saveInterval == 0)) {
+      for (int k = 0; k < R; k++) {
+        copy(x.begin() + k*df, x.begin() + (k + 1)*df, snap.begin());
+        snapshot(k, snap, en[k]);
+      }
+    }
+  }
+  if (verbose) {
+    for (int k = 0; k + 1 < R; k++) cout << "Optim::langevinReplicas, exchanges between kT = " << kTs[k] << " and " << kTs[k+1] << " accepted " << accepted[k] << " of " << tried[k] << " times" << endl;
+  }
+
+  solutions.resize(R);
+  for (int k = 0; k < R; k++) solutions[k].assign(x.begin() + k*df, x.begin() + (k + 1)*df);
+  return en;
 }
 
 // mstreal Optim::lineSearch(optimizerEvaluator& E, const vector<mstreal>& point, vector<mstreal>& solution, const Vector& _dir, mstreal startStepSize, bool verbose) {
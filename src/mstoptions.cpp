@@ -14,6 +14,7 @@ string MstOptions::usage() {
   for (int i = 0; i < options.size(); i++) {
     usageString += formatOptInfo(options[i], optionsInfo[i]) + "\n";
   }
+  usageString += formatOptInfo("profile", "write profiling counters of library stages to this file upon exit (as CSV if it ends with .csv, and JSON otherwise; to standard error if no file is given). Can also be turned on with the MST_PROFILE environment variable.") + "\n";
   return usageString;
 }
 
@@ -66,6 +67,7 @@ void MstOptions::setOptions(int argc, char** argv) {
     cerr << endl;
     MstUtils::error("not all required options were specified!", "MstOptions::setOptions");
   }
+  if (isGiven("profile")) MstProfiler::enable(getString("profile").empty() ? "-" : getString("profile"));
 }
 
 int MstOptions::getInt(const string& opt, int defVal, int idx) {
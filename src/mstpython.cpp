@@ -9,6 +9,7 @@
 #include <iostream>
 #include <list>
 #include <boost/python/stl_iterator.hpp>
+#include <boost/python/numpy.hpp>
 #include "mstrotlib.h"
 #include "msttypes.h"
 #include "mstfasst.h"
@@ -16,6 +17,9 @@
 #include "mstsequence.h"
 #include "mstfuser.h"
 #include "mstrotlib.h"
+#include "dtermen.h"
+
+namespace np = boost::python::numpy;
 
 // Source: https://stackoverflow.com/questions/15842126/feeding-a-python-list-into-a-function-taking-in-a-vector-with-boost-python/15940413#15940413
 
@@ -99,8 +103,58 @@ public:
 
 
 
-// Overloads for functions with optional arguments
-BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(addTargetsOverloads, FASST::addTargets, 1, 2)
+/* Releases the GIL for as long as it is in scope, so that other Python threads
+ * can run during long C++ calls (e.g., several FASST searches at once, each
+ * with its own FASST object). Nothing in its scope may touch Python objects. */
+class releaseGIL {
+public:
+    releaseGIL() { state = PyEval_SaveThread(); }
+    ~releaseGIL() { PyEval_RestoreThread(state); }
+private:
+    PyThreadState* state;
+};
+
+/* Atoms are separate objects, so their coordinates are gathered into (or
+ * scattered from) an (N, 3) array in a single call, rather than an atom at a
+ * time through the Atom wrappers. */
+np::ndarray atomCoordinates(const vector<Atom*>& atoms) {
+    np::ndarray coords = np::empty(boost::python::make_tuple(atoms.size(), 3), np::dtype::get_builtin<mstreal>());
+    mstreal* data = reinterpret_cast<mstreal*>(coords.get_data());
+    for (int i = 0; i < atoms.size(); i++) {
+        data[3*i] = atoms[i]->getX(); data[3*i + 1] = atoms[i]->getY(); data[3*i + 2] = atoms[i]->getZ();
+    }
+    return coords;
+}
+
+void setAtomCoordinates(const vector<Atom*>& atoms, const np::ndarray& coords) {
+    if ((coords.get_nd() != 2) || (coords.shape(0) != atoms.size()) || (coords.shape(1) != 3)) {
+        MstUtils::error("expected an array of shape (" + MstUtils::toString(atoms.size()) + ", 3)", "setAtomCoordinates");
+    }
+    np::ndarray C = coords.astype(np::dtype::get_builtin<mstreal>());
+    const char* data = C.get_data();
+    Py_intptr_t const* strides = C.get_strides();
+    for (int i = 0; i < atoms.size(); i++) {
+        const char* row = data + i*strides[0];
+        atoms[i]->setCoor(*reinterpret_cast<const mstreal*>(row), *reinterpret_cast<const mstreal*>(row + strides[1]), *reinterpret_cast<const mstreal*>(row + 2*strides[1]));
+    }
+}
+
+/* A read-only (n, 3) view of n packed x, y, z triples, without copying; owner
+ * is kept alive for as long as the view is. */
+template <class T>
+np::ndarray coordinateView(const T* coords, int n, boost::python::object owner) {
+    return np::from_data(coords, np::dtype::get_builtin<T>(), boost::python::make_tuple(n, 3), boost::python::make_tuple(3*sizeof(T), sizeof(T)), owner);
+}
+
+// a view of atoms [first, first + n) of the searchable atoms of a FASST target
+np::ndarray targetCoordinateView(boost::python::object self, int ti, int first, int n) {
+    const FASST& F = boost::python::extract<const FASST&>(self);
+    if ((ti < 0) || (ti >= F.numTargets())) MstUtils::error("target index " + MstUtils::toString(ti) + " out of range", "FASST::targetCoordinates");
+    if (n < 0) n = F.getTargetSearchableAtomSize(ti) - first;
+    if ((first < 0) || (first + n > F.getTargetSearchableAtomSize(ti))) MstUtils::error("atom range out of range for target " + MstUtils::toString(ti), "FASST::targetCoordinates");
+    if (F.getTargetCoordinates(ti) != NULL) return coordinateView(F.getTargetCoordinates(ti) + 3*first, n, self);
+    return coordinateView(F.getMappedTargetCoordinates(ti) + 3*first, n, self);
+}
 
 /*
  * This is a macro Boost.Python provides to signify a Python extension module.
@@ -108,6 +162,7 @@ BOOST_PYTHON_MEMBER_FUNCTION_OVERLOADS(addTargetsOverloads, FASST::addTargets, 1
 BOOST_PYTHON_MODULE(mstpython) {
     // An established convention for using boost.python.
     using namespace boost::python;
+    np::initialize();
 
     iterable_converter()
     .from_python<vector<double>>()
@@ -145,7 +200,9 @@ BOOST_PYTHON_MODULE(mstpython) {
 
     class_<AtomPointerVector>("AtomPointerVector", init<const vector<Atom *> &>())
     .def("__getitem__", +[](const AtomPointerVector &a, int i) { return a[i]; }, return_value_policy<reference_existing_object>())
-    .def("__len__", &AtomPointerVector::size);
+    .def("__len__", &AtomPointerVector::size)
+    .def("coordinates", +[](const AtomPointerVector &a) { return atomCoordinates(a); })
+    .def("setCoordinates", +[](const AtomPointerVector &a, const np::ndarray &coords) { setAtomCoordinates(a, coords); });
 
     // expose classes
 
@@ -248,6 +305,8 @@ BOOST_PYTHON_MODULE(mstpython) {
          return_value_policy<reference_existing_object>())
     .def("getAtoms", &MST::Structure::getAtoms)
     .def("getResidues", &MST::Structure::getResidues)
+    .def("coordinates", +[](const MST::Structure& structure) { return atomCoordinates(structure.getAtoms()); })
+    .def("setCoordinates", +[](const MST::Structure& structure, const np::ndarray &coords) { setAtomCoordinates(structure.getAtoms(), coords); })
     .def("appendChain", +[](MST::Structure& structure, MST::Chain *chain) {
         structure.appendChain(new MST::Chain(*chain));
     })/*static_cast<bool (MST::Structure::*) (Chain*, bool)>(&MST::Structure::appendChain))*/
@@ -351,14 +410,15 @@ BOOST_PYTHON_MODULE(mstpython) {
     ;
 
     class_<ConFind, boost::noncopyable>("ConFind", init<string, Structure&>())
-    .def("cache", static_cast<void (ConFind::*) (const Structure&)>(&ConFind::cache))
+    .def("cache", +[](ConFind& C, const Structure& S) { releaseGIL nogil; C.cache(S); })
     .def("getNeighbors", static_cast<std::vector<Residue *> (ConFind::*) (Residue *)>(&ConFind::getNeighbors))
     .def("contactDegree", &ConFind::contactDegree)
-    .def("getContacts", static_cast<contactList (ConFind::*) (Structure&, mstreal, contactList *)>(&ConFind::getContacts))
+    .def("getContacts", +[](ConFind& C, Structure& S, mstreal cdcut, contactList *list) { releaseGIL nogil; return C.getContacts(S, cdcut, list); })
+    .add_property("numThreads", &ConFind::getNumThreads, &ConFind::setNumThreads)
     .def("getResidueContacts", static_cast<contactList (ConFind::*) (Residue *, mstreal, contactList *)>(&ConFind::getContacts))
     ;
 
-    class_<FASST>("FASST", init<>())
+    class_<FASST, boost::noncopyable>("FASST", init<>())
     .add_property("query", &FASST::getQuery)
     .def("setRMSDCutoff", &fasstSearchOptions::setRMSDCutoff)
     .def("setRedundancyCut", &fasstSearchOptions::setRedundancyCut)
@@ -366,10 +426,11 @@ BOOST_PYTHON_MODULE(mstpython) {
     .add_property("numQuerySegments", &FASST::getNumQuerySegments)
     .def("addTargetStructure", static_cast<void (FASST::*) (const Structure&, short)>(&FASST::addTarget))
     .def("addTarget", static_cast<void (FASST::*) (const string&, short)>(&FASST::addTarget))
-    .def("addTargets", &FASST::addTargets, addTargetsOverloads())
+    .def("addTargets", +[](FASST& F, const vector<string>& pdbFiles, short memSave) { releaseGIL nogil; F.addTargets(pdbFiles, memSave); }, (boost::python::arg("pdbFiles"), boost::python::arg("memSave") = 0))
     .add_property("options", make_function(&FASST::options, return_value_policy<reference_existing_object>()), &FASST::setOptions)
     .add_property("numTargets", &FASST::numTargets)
-    .def("search", &FASST::search)
+    .def("search", +[](FASST& F) { releaseGIL nogil; return F.search(); })
+    .add_property("numThreads", &FASST::getNumThreads, &FASST::setNumThreads)
     .add_property("numMatches", &FASST::numMatches)
     .def("getMatches", &FASST::getMatches)
     .def("getTargetCopy",&FASST::getTargetCopy)
@@ -377,7 +438,18 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("getMatchResidueIndices", &FASST::getMatchResidueIndices)
     .def("getMatchSequence", &FASST::getMatchSequence)
     .def("getMatchSequences", &FASST::getMatchSequences)
-    .def("readDatabase", &FASST::readDatabase)
+    .def("readDatabase", +[](FASST& F, const string& dbFile, short memSave) { releaseGIL nogil; F.readDatabase(dbFile, memSave); }, (boost::python::arg("dbFile"), boost::python::arg("memSave") = 0))
+    // zero-copy views of the packed backbone coordinates the search runs over
+    // (float64 for targets held in memory, float32 for ones of a mapped database)
+    .def("targetCoordinates", +[](object self, int ti) { return targetCoordinateView(self, ti, 0, -1); })
+    .def("matchSegmentCoordinates", +[](object self, const fasstSolution& sol) {
+        const FASST& F = extract<const FASST&>(self);
+        boost::python::list segs;
+        for (int i = 0; i < sol.numSegments(); i++) {
+            segs.append(targetCoordinateView(self, sol.getTargetIndex(), sol[i] * F.atomsPerResidue(), sol.segLength(i) * F.atomsPerResidue()));
+        }
+        return segs;
+    })
     ;
 
     boost::python::enum_<FASST::matchType>("matchType")
@@ -421,12 +493,31 @@ BOOST_PYTHON_MODULE(mstpython) {
     .def("fuse", +[](const fusionTopology &topo) {
         fusionOutput output;
         fusionParams params;
-        Structure result = Fuser::fuse(topo, output, params);
+        Structure result;
+        {
+            releaseGIL nogil;
+            result = Fuser::fuse(topo, output, params);
+        }
         return boost::python::make_tuple(result, output);
     })
     .staticmethod("fuse")
     ;
 
+    class_<EnergyTable>("EnergyTable", init<>())
+    .def(init<string>())
+    .def("numSites", &EnergyTable::numSites)
+    .def("getSites", &EnergyTable::getSites)
+    .def("getSiteAlphabet", &EnergyTable::getSiteAlphabet)
+    .def("readFromFile", &EnergyTable::readFromFile)
+    .def("writeToFile", &EnergyTable::writeToFile)
+    .def("scoreSolution", &EnergyTable::scoreSolution)
+    ;
+
+    class_<dTERMen, boost::noncopyable>("dTERMen", init<string>())
+    .def("setNumThreads", &dTERMen::setNumThreads)
+    .def("buildEnergyTable", +[](dTERMen& D, const vector<Residue*>& variable) { releaseGIL nogil; return D.buildEnergyTable(variable); })
+    ;
+
     class_<MST::CartesianPoint>("CartesianPoint",init<Atom&>())
     .def(self + self)
     .def(self - self)
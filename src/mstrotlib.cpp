@@ -1,29 +1,45 @@
 #include "mstrotlib.h"
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 using namespace MST;
 
 RotamerLibrary::RotamerLibrary(string rotLibFile) {
+  loaded = false; mapBase = NULL; mapLen = 0;
   readRotamerLibrary(rotLibFile);
 }
 
 RotamerLibrary::~RotamerLibrary() {
-  for (map<string, vector<Residue*> >::iterator it = rotamers.begin(); it != rotamers.end(); ++it) {
-    vector<Residue*>& residues = it->second;
-    for (int i = 0; i < residues.size(); i++) {
-      delete residues[i];
-    }
-  }
+  clear();
 }
 
+void RotamerLibrary::clear() {
+  binFreq.clear(); defaultBin.clear(); chidef.clear();
+  binPhiCenters.clear(); binPsiCenters.clear();
+  aaByIndex.clear(); aaIndices.clear(); rotAtomNames.clear();
+  bins.clear(); ownedData.clear();
+  if (mapBase != NULL) munmap(mapBase, mapLen);
+  mapBase = NULL; mapLen = 0;
+  loaded = false;
+}
 
 void RotamerLibrary::readRotamerLibrary(string rotLibFile) {
+  clear();
+  if (isCompiledLibrary(rotLibFile)) { mapCompiledLibrary(rotLibFile); return; }
+
   int nc, nb, na, nr;
-  Residue* rot;
-  mstreal x, y, z, phi, psi;
+  mstreal phi, psi;
   float val; // the binary file is written with single precision values, so read as floats and cast as necessary
   fstream inp;
   MstUtils::openFile(inp, rotLibFile, ios_base::in | ios_base::binary, "RotamerLibrary::readRotamerLibrary(string rotLibFile)");
 
+  // per amino acid: atom names, and the data of all bins in one array, with
+  // each bin's offsets into it (as in the compiled format)
+  map<string, vector<string> > atomNames;
+  map<string, vector<compiledBin> > binEntries;
+  map<string, vector<mstreal> > binData;
   while (true) {
     string aa = MstUtils::readNullTerminatedString(inp);
     if (inp.eof()) break;
@@ -31,9 +47,6 @@ void RotamerLibrary::readRotamerLibrary(string rotLibFile) {
     inp.read((char*) &na, sizeof(na)); // number of atoms in the side-chain of this amino acid
     inp.read((char*) &nb, sizeof(nb)); // number of phi/psi bins defined for this amino acid
     chidef[aa] = vector<vector<string> >(nc);
-    chi[aa] = vector<vector<vector<pair<mstreal, mstreal> > > >(nb);
-    rotamers[aa] = vector<Residue*>(nb, NULL);
-    prob[aa] = vector<vector<mstreal> >(nb);
     binFreq[aa] = vector<mstreal>(nb);
 
     // read definitions of chi angles
@@ -44,12 +57,9 @@ void RotamerLibrary::readRotamerLibrary(string rotLibFile) {
       }
     }
 
-    // read rotamer atom names and initialize a residue object
-    Residue res(aa, 1);
-    for (int i = 0; i < na; i++) {
-      string atomname = MstUtils::readNullTerminatedString(inp);
-      res.appendAtom(new Atom(1, atomname, 0, 0, 0, 0, 0, false, ' '));
-    }
+    // read rotamer atom names
+    vector<string>& names = atomNames[aa];
+    for (int i = 0; i < na; i++) names.push_back(MstUtils::readNullTerminatedString(inp));
 
     // read phi/psi angles for each bin, record unique ones.
     map<mstreal, bool> uniquePhi, uniquePsi;
@@ -95,45 +105,212 @@ void RotamerLibrary::readRotamerLibrary(string rotLibFile) {
     }
     defaultBin[aa] = defaultBinIndex;
 
-    // read rotamers in each phi/psi bin
+    // read rotamers in each phi/psi bin: probabilities, chi angles (and their
+    // standard deviations), and coordinates of all rotamers in the bin
+    vector<compiledBin>& entries = binEntries[aa];
+    vector<mstreal>& data = binData[aa];
+    entries.resize(nb);
     for (int ii = 0; ii < nb; ii++) {
-      int i = binIndex[ii];
+      compiledBin& e = entries[binIndex[ii]];
       inp.read((char*) &nr, sizeof(nr));  // number of rotamers in this bin
-      chi[aa][i].resize(nr);
-      prob[aa][i].resize(nr);
-      rot = new Residue(res);
+      e.numRots = nr; e.pad = 0;
+      e.probOff = data.size();
+      e.chiOff = e.probOff + nr;
+      e.coorOff = e.chiOff + 2*nc*nr;
+      data.resize(e.coorOff + 3*na*nr);
       for (int j = 0; j < nr; j++) {
-        // read rotamer probability
         inp.read((char*) &val, sizeof(val));
-        prob[aa][i][j] = (mstreal) val;
-
-        // read chi and chi sigma values for the rotamer
-        chi[aa][i][j].resize(nc);
-        for (int k = 0; k < nc; k++) {
-          inp.read((char*) &val, sizeof(val));
-          chi[aa][i][j][k].first = (mstreal) val;
+        data[e.probOff + j] = (mstreal) val;
+        for (int k = 0; k < 2*nc; k++) {
           inp.read((char*) &val, sizeof(val));
-          chi[aa][i][j][k].second = (mstreal) val;
+          data[e.chiOff + 2*nc*j + k] = (mstreal) val;
         }
-        // read atom coordinates for the rotamer
-        for (int k = 0; k < na; k++) {
-          inp.read((char*) &val, sizeof(val)); x = (mstreal) val;
-          inp.read((char*) &val, sizeof(val)); y = (mstreal) val;
-          inp.read((char*) &val, sizeof(val)); z = (mstreal) val;
-          if (j == 0) {
-            (*rot)[k].setCoor(x, y, z);
-          } else {
-            (*rot)[k].addAlternative(x, y, z, 0, 0, ' ');
-          }
+        for (int k = 0; k < 3*na; k++) {
+          inp.read((char*) &val, sizeof(val));
+          data[e.coorOff + 3*na*j + k] = (mstreal) val;
         }
       }
-      // insert rotamer into the library
-      rotamers[aa][i] = rot;
+    }
+  }
+
+  // index amino acids (alphabetically)
+  aaByIndex = keys(atomNames);
+  rotAtomNames.resize(aaByIndex.size());
+  bins.resize(aaByIndex.size());
+  ownedData.resize(aaByIndex.size());
+  for (int ai = 0; ai < aaByIndex.size(); ai++) {
+    string& aa = aaByIndex[ai];
+    aaIndices[aa] = ai;
+    rotAtomNames[ai] = atomNames[aa];
+    ownedData[ai].swap(binData[aa]);
+    const vector<compiledBin>& entries = binEntries[aa];
+    bins[ai].resize(entries.size());
+    for (int bi = 0; bi < entries.size(); bi++) {
+      const mstreal* data = ownedData[ai].data();
+      bins[ai][bi] = {entries[bi].numRots, data + entries[bi].probOff, data + entries[bi].chiOff, data + entries[bi].coorOff};
+    }
+  }
+  loaded = true;
+}
+
+void RotamerLibrary::mapCompiledLibrary(const string& rotLibFile) {
+  int fd = open(rotLibFile.c_str(), O_RDONLY);
+  if (fd < 0) MstUtils::error("could not open file '" + rotLibFile + "'", "RotamerLibrary::mapCompiledLibrary");
+  struct stat st;
+  if ((fstat(fd, &st) != 0) || (st.st_size < sizeof(compiledHeader))) {
+    close(fd);
+    MstUtils::error("'" + rotLibFile + "' is too short to be a compiled rotamer library", "RotamerLibrary::mapCompiledLibrary");
+  }
+  void* base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // the mapping remains valid after the descriptor is closed
+  if (base == MAP_FAILED) MstUtils::error("could not map file '" + rotLibFile + "'", "RotamerLibrary::mapCompiledLibrary");
+  mapBase = base; mapLen = st.st_size;
+
+  const char* b = (const char*) base;
+  const compiledHeader* hdr = (const compiledHeader*) b;
+  if ((strncmp(hdr->magic, compiledMagic(), sizeof(hdr->magic)) != 0) || (hdr->fileSize != mapLen)) {
+    clear();
+    MstUtils::error("'" + rotLibFile + "' is not a valid compiled rotamer library (or is truncated)", "RotamerLibrary::mapCompiledLibrary");
+  }
+  if (hdr->version != compiledVersion) {
+    int version = hdr->version;
+    clear();
+    MstUtils::error("unknown compiled rotamer library version " + MstUtils::toString(version) + " in '" + rotLibFile + "'", "RotamerLibrary::mapCompiledLibrary");
+  }
+  const compiledAA* aaTable = (const compiledAA*) (b + hdr->aaOff);
+  const compiledBin* binTable = (const compiledBin*) (b + hdr->binOff);
+  const mstreal* reals = (const mstreal*) (b + hdr->realOff);
+  const char* names = b + hdr->nameOff;
+
+  // only the small per-amino-acid tables are copied; bin data stay in the file
+  aaByIndex.resize(hdr->numAA);
+  rotAtomNames.resize(hdr->numAA);
+  bins.resize(hdr->numAA);
+  for (int ai = 0; ai < hdr->numAA; ai++) {
+    const compiledAA& e = aaTable[ai];
+    string aa(names + e.nameOff);
+    aaByIndex[ai] = aa;
+    aaIndices[aa] = ai;
+    const char* name = names + e.atomNamesOff;
+    for (int k = 0; k < e.numAtoms; k++, name += strlen(name) + 1) rotAtomNames[ai].push_back(name);
+    vector<vector<string> >& defs = chidef[aa];
+    defs.resize(e.numChi);
+    name = names + e.chiDefsOff;
+    for (int k = 0; k < 4*e.numChi; k++, name += strlen(name) + 1) defs[k/4].push_back(name);
+    binPhiCenters[aa].assign(reals + e.phiOff, reals + e.phiOff + e.numPhi);
+    binPsiCenters[aa].assign(reals + e.psiOff, reals + e.psiOff + e.numPsi);
+    binFreq[aa].assign(reals + e.freqOff, reals + e.freqOff + e.numBins);
+    defaultBin[aa] = e.defaultBin;
+    bins[ai].resize(e.numBins);
+    for (int bi = 0; bi < e.numBins; bi++) {
+      const compiledBin& be = binTable[e.binStart + bi];
+      bins[ai][bi] = {be.numRots, reals + be.probOff, reals + be.chiOff, reals + be.coorOff};
     }
   }
   loaded = true;
 }
 
+void RotamerLibrary::writeCompiledLibrary(const string& file) {
+  if (!loaded) MstUtils::error("no rotamer library loaded", "RotamerLibrary::writeCompiledLibrary");
+  auto align = [](int64_t off, int64_t a) { return ((off + a - 1) / a) * a; };
+  int N = aaByIndex.size();
+
+  // tables, real-valued data, and names
+  vector<compiledAA> aaTable(N);
+  vector<compiledBin> binTable;
+  vector<mstreal> reals;
+  string nameBlob;
+  for (int ai = 0; ai < N; ai++) {
+    const string& aa = aaByIndex[ai];
+    compiledAA& e = aaTable[ai];
+    memset(&e, 0, sizeof(e));
+    int nc = chidef[aa].size(), na = rotAtomNames[ai].size();
+    e.numChi = nc; e.numAtoms = na; e.numBins = bins[ai].size(); e.defaultBin = defaultBin[aa];
+    e.nameOff = nameBlob.size();
+    nameBlob += aa; nameBlob.push_back('\0');
+    e.atomNamesOff = nameBlob.size();
+    for (int k = 0; k < na; k++) { nameBlob += rotAtomNames[ai][k]; nameBlob.push_back('\0'); }
+    e.chiDefsOff = nameBlob.size();
+    for (int k = 0; k < nc; k++) {
+      for (int j = 0; j < chidef[aa][k].size(); j++) { nameBlob += chidef[aa][k][j]; nameBlob.push_back('\0'); }
+    }
+    e.numPhi = binPhiCenters[aa].size(); e.numPsi = binPsiCenters[aa].size();
+    e.phiOff = reals.size(); reals.insert(reals.end(), binPhiCenters[aa].begin(), binPhiCenters[aa].end());
+    e.psiOff = reals.size(); reals.insert(reals.end(), binPsiCenters[aa].begin(), binPsiCenters[aa].end());
+    e.freqOff = reals.size(); reals.insert(reals.end(), binFreq[aa].begin(), binFreq[aa].end());
+    e.binStart = binTable.size();
+    for (int bi = 0; bi < bins[ai].size(); bi++) {
+      const rotamerBin& rb = bins[ai][bi];
+      compiledBin be;
+      be.numRots = rb.numRots; be.pad = 0;
+      be.probOff = reals.size(); reals.insert(reals.end(), rb.prob, rb.prob + rb.numRots);
+      be.chiOff = reals.size(); reals.insert(reals.end(), rb.chi, rb.chi + 2*nc*rb.numRots);
+      be.coorOff = reals.size(); reals.insert(reals.end(), rb.coor, rb.coor + 3*na*rb.numRots);
+      binTable.push_back(be);
+    }
+  }
+
+  // lay out the file
+  compiledHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  strncpy(hdr.magic, compiledMagic(), sizeof(hdr.magic));
+  hdr.version = compiledVersion;
+  hdr.numAA = N;
+  hdr.aaOff = align(sizeof(compiledHeader), 64);
+  hdr.binOff = align(hdr.aaOff + N * sizeof(compiledAA), 8);
+  hdr.realOff = align(hdr.binOff + binTable.size() * sizeof(compiledBin), 64);
+  hdr.nameOff = hdr.realOff + reals.size() * sizeof(mstreal);
+  hdr.fileSize = hdr.nameOff + nameBlob.size();
+
+  fstream ofs; MstUtils::openFile(ofs, file, fstream::out | fstream::binary, "RotamerLibrary::writeCompiledLibrary");
+  auto pad = [&ofs](int64_t to) { while (ofs.tellp() < to) ofs.put(0); };
+  ofs.write((const char*) &hdr, sizeof(hdr));
+  pad(hdr.aaOff); ofs.write((const char*) aaTable.data(), N * sizeof(compiledAA));
+  pad(hdr.binOff); ofs.write((const char*) binTable.data(), binTable.size() * sizeof(compiledBin));
+  pad(hdr.realOff); ofs.write((const char*) reals.data(), reals.size() * sizeof(mstreal));
+  ofs.write(nameBlob.data(), nameBlob.size());
+  ofs.close();
+}
+
+bool RotamerLibrary::isCompiledLibrary(const string& file) {
+  fstream ifs; MstUtils::openFile(ifs, file, fstream::in | fstream::binary, "RotamerLibrary::isCompiledLibrary");
+  char magic[8] = {0};
+  ifs.read(magic, sizeof(magic));
+  ifs.close();
+  return (strncmp(magic, compiledMagic(), sizeof(magic)) == 0);
+}
+
+int RotamerLibrary::aminoAcidIndex(const string& aa) {
+  map<string, int>::iterator it = aaIndices.find(aa);
+  if (it == aaIndices.end()) MstUtils::error("rotamer library does not contain amino acid '" + aa + "'", "RotamerLibrary::aminoAcidIndex");
+  return it->second;
+}
+
+int RotamerLibrary::getBackboneBin(int ai, mstreal phi, mstreal psi, bool assumeDefault) {
+  return getBackboneBin(aaByIndex[ai], phi, psi, assumeDefault);
+}
+
+Transform RotamerLibrary::backboneFrame(Residue& res) {
+  vector<Atom*> bb = RotamerLibrary::getBackbone(res);
+  if ((bb[RotamerLibrary::bbCA] == NULL) || (bb[RotamerLibrary::bbC] == NULL) || (bb[RotamerLibrary::bbN] == NULL)) {
+    MstUtils::error("cannot place rotamer in residue " + MstUtils::toString(res) + ", as it lacks proper backbone", "RotamerLibrary::backboneFrame");
+  }
+  CartesianPoint CA = CartesianPoint(bb[RotamerLibrary::bbCA]);
+  CartesianPoint C = CartesianPoint(bb[RotamerLibrary::bbC]);
+  CartesianPoint N = CartesianPoint(bb[RotamerLibrary::bbN]);
+  CartesianPoint X = CA - N;          // X-axis of the residue frame defined to be along N -> CA
+  CartesianPoint Z = X.cross(C - CA); // since CA-C is defined to be in the XY plane, (N -> CA) x (CA -> C) will be a vector along Z
+  CartesianPoint Y = Z.cross(X);      // finally, Z x X is Y
+  Frame R(CA, X, Y, Z);               // residue frame
+  Frame L;                            // Frame class defaults to the laboratory frame
+  return TransformFactory::switchFrames(R, L);
+}
+
+void RotamerLibrary::placeRotamers(Transform& T, int ai, int bi, mstreal* coor) {
+  const rotamerBin& rots = bins[ai][bi];
+  T.applyToCopy(rots.coor, rots.numRots * rotAtomNames[ai].size(), coor);
+}
+
 mstreal RotamerLibrary::angleToStandardRange(mstreal angle) {
   if ((angle >= -180) && (angle < 180)) return angle;
   return MstUtils::mod(angle + 180, 360.0) - 180;
@@ -141,26 +318,28 @@ mstreal RotamerLibrary::angleToStandardRange(mstreal angle) {
 
 int RotamerLibrary::numberOfRotamers(string aa, mstreal phi, mstreal psi, bool strict) {
   int bi = getBackboneBin(aa, phi, psi, !strict);
-  if (rotamers[aa][bi]->atomSize() == 0) return 1; // for GLY
-  return rotamers[aa][bi]->getAtom(0).numAlternatives() + 1;
+  int ai = aminoAcidIndex(aa);
+  if (rotAtomNames[ai].empty()) return 1; // for GLY
+  return bins[ai][bi].numRots;
 }
 
 mstreal RotamerLibrary::rotamerProbability(string aa, int ri, mstreal phi, mstreal psi, bool strict) {
   int bi = getBackboneBin(aa, phi, psi, !strict);
-  return prob[aa][bi][ri];
+  return bins[aminoAcidIndex(aa)][bi].prob[ri];
 }
 
 mstreal RotamerLibrary::rotamerProbability(rotamerID* rot) {
-  return prob[rot->aminoAcid()][rot->binIndex()][rot->rotIndex()];
+  return bins[aminoAcidIndex(rot->aminoAcid())][rot->binIndex()].prob[rot->rotIndex()];
 }
 
 rotamerID RotamerLibrary::getRotamer(Residue& res, string aa, int rotIndex, bool strict) {
   double phi = res.getPhi(false);
   double psi = res.getPsi(false);
   int binInd = getBackboneBin(aa, phi, psi, !strict);
-  if (rotamers.find(aa) == rotamers.end()) MstUtils::error("rotamer library does not contain amino acid '" + aa + "'", "RotamerLibrary::placeRotamer");
-  if (rotamers[aa].size() <= binInd) {
-    MstUtils::error("rotamer library has " + MstUtils::toString(rotamers[aa].size()) + " backbone bins for amino acid '" + aa + "', but bin number " + MstUtils::toString(binInd+1) + " was requested", "RotamerLibrary::placeRotamer");
+  if (aaIndices.find(aa) == aaIndices.end()) MstUtils::error("rotamer library does not contain amino acid '" + aa + "'", "RotamerLibrary::placeRotamer");
+  int ai = aaIndices[aa];
+  if (bins[ai].size() <= binInd) {
+    MstUtils::error("rotamer library has " + MstUtils::toString(bins[ai].size()) + " backbone bins for amino acid '" + aa + "', but bin number " + MstUtils::toString(binInd+1) + " was requested", "RotamerLibrary::placeRotamer");
   }
   return rotamerID(aa, binInd, rotIndex);
 }
@@ -169,32 +348,20 @@ rotamerID RotamerLibrary::placeRotamer(Residue& res, string aa, int rotIndex, Re
   double phi = res.getPhi(false);
   double psi = res.getPsi(false);
   int binInd = getBackboneBin(aa, phi, psi, !strict);
-  if (rotamers.find(aa) == rotamers.end()) MstUtils::error("rotamer library does not contain amino acid '" + aa + "'", "RotamerLibrary::placeRotamer");
-  if (rotamers[aa].size() <= binInd) {
-    MstUtils::error("rotamer library has " + MstUtils::toString(rotamers[aa].size()) + " backbone bins for amino acid '" + aa + "', but bin number " + MstUtils::toString(binInd+1) + " was requested", "RotamerLibrary::placeRotamer");
+  if (aaIndices.find(aa) == aaIndices.end()) MstUtils::error("rotamer library does not contain amino acid '" + aa + "'", "RotamerLibrary::placeRotamer");
+  int ai = aaIndices[aa];
+  if (bins[ai].size() <= binInd) {
+    MstUtils::error("rotamer library has " + MstUtils::toString(bins[ai].size()) + " backbone bins for amino acid '" + aa + "', but bin number " + MstUtils::toString(binInd+1) + " was requested", "RotamerLibrary::placeRotamer");
   }
-  Residue& rots = *(rotamers[aa][binInd]);
 
   // get the transformation to go from the standard position of the backbone, which is the
   // position for which the rotamer library stores side-chain coordinates, to the actual
   // backbone position in the given residue. That's the transformation we will need to apply
   // to go from rotamer-library coordinates to the final placed coordinates.
-  vector<Atom*> bb = RotamerLibrary::getBackbone(res);
-  if ((bb[RotamerLibrary::bbCA] == NULL) || (bb[RotamerLibrary::bbC] == NULL) || (bb[RotamerLibrary::bbN] == NULL)) {
-    MstUtils::error("cannot place rotamer in residue " + MstUtils::toString(res) + ", as it lacks proper backbone", "RotamerLibrary::placeRotamer");
-  }
-  CartesianPoint CA = CartesianPoint(bb[RotamerLibrary::bbCA]);
-  CartesianPoint C = CartesianPoint(bb[RotamerLibrary::bbC]);
-  CartesianPoint N = CartesianPoint(bb[RotamerLibrary::bbN]);
-  CartesianPoint X = CA - N;          // X-axis of the residue frame defined to be along N -> CA
-  CartesianPoint Z = X.cross(C - CA); // since CA-C is defined to be in the XY plane, (N -> CA) x (CA -> C) will be a vector along Z
-  CartesianPoint Y = Z.cross(X);      // finally, Z x X is Y
-  Frame R(CA, X, Y, Z);               // residue frame
-  Frame L;                            // Frame class defaults to the laboratory frame
-  Transform T = TransformFactory::switchFrames(R, L);
+  Transform T = backboneFrame(res);
 
   // fish out the right rotamer and transform it onto the residue
-  vector<Atom*> newAtoms; transformRotamerAtoms(T, rots, rotIndex, newAtoms);
+  vector<Atom*> newAtoms; transformRotamerAtoms(T, ai, binInd, rotIndex, newAtoms);
   if (dest_ptr == NULL) {
     vector<int> oldAtoms; // atoms to be deleted (mostly side-chain atoms of the previous residue)
     for (int i = 0; i < res.atomSize(); i++) {
@@ -232,18 +399,17 @@ rotamerID RotamerLibrary::placeRotamer(Residue& res, string aa, int rotIndex, Re
   return rotamerID(aa, binInd, rotIndex);
 }
 
-void RotamerLibrary::transformRotamerAtoms(Transform& T, Residue& rots, int rotIndex, vector<Atom*>& newAtoms) {
-  newAtoms.resize(rots.atomSize(), NULL);
-  for (int i = 0; i < rots.atomSize(); i++) {
-    Atom& a = rots[i];
-    if (a.numAlternatives() < rotIndex) {
-      MstUtils::error("rotamer library contains " + MstUtils::toString(a.numAlternatives() + 1) + " rotamers for amino-acid, but rotamer number " + MstUtils::toString(rotIndex+1) + "was requested", "RotamerLibrary::placeRotamer");
-    }
-    if (rotIndex > 0) a.swapWithAlternative(rotIndex-1);
-    Atom* newAtom = new Atom(a, false);
-    T.apply(newAtom);
-    newAtoms[i] = newAtom;
-    if (rotIndex > 0) a.swapWithAlternative(rotIndex-1);
+void RotamerLibrary::transformRotamerAtoms(Transform& T, int ai, int bi, int rotIndex, vector<Atom*>& newAtoms) {
+  const rotamerBin& rots = bins[ai][bi];
+  const vector<string>& names = rotAtomNames[ai];
+  if (!names.empty() && (rots.numRots <= rotIndex)) {
+    MstUtils::error("rotamer library contains " + MstUtils::toString(rots.numRots) + " rotamers for amino-acid, but rotamer number " + MstUtils::toString(rotIndex+1) + "was requested", "RotamerLibrary::placeRotamer");
+  }
+  newAtoms.resize(names.size(), NULL);
+  mstreal xyz[3];
+  for (int i = 0; i < names.size(); i++) {
+    T.applyToCopy(rots.coor + 3*(names.size()*rotIndex + i), 1, xyz);
+    newAtoms[i] = new Atom(1, names[i], xyz[0], xyz[1], xyz[2], 0, 0, false, ' ');
   }
 }
 
@@ -273,6 +439,16 @@ int RotamerLibrary::backboneAtomType(string atomName, bool noHyd) {
   return -1;
 }
 
+int RotamerLibrary::backboneAtomType(const Atom& atom, bool noHyd) {
+  static const int idN = MstNames::intern("N"), idCA = MstNames::intern("CA"), idC = MstNames::intern("C"), idO = MstNames::intern("O");
+  int id = atom.getNameID();
+  if (id == idN) return bbAtomType::bbN;
+  if (id == idCA) return bbAtomType::bbCA;
+  if (id == idC) return bbAtomType::bbC;
+  if (id == idO) return bbAtomType::bbO;
+  return backboneAtomType(string(atom.getNameC()), noHyd);
+}
+
 string RotamerLibrary::standardBackboneAtomName(string atomName, bool noHyd) {
   int type = RotamerLibrary::backboneAtomType(atomName, noHyd);
   switch (type) {
@@ -316,6 +492,15 @@ vector<Atom*> RotamerLibrary::getBackbone(const System& S, bool noHyd) {
   return bbAll;
 }
 
+vector<Atom*> RotamerLibrary::getBackbone(const StructureView& V, bool noHyd) {
+  vector<Atom*> bbAll;
+  for (Residue* res : V.getResidues()) {
+    vector<Atom*> bb = RotamerLibrary::getBackbone(*res, noHyd);
+    bbAll.insert(bbAll.end(), bb.begin(), bb.end());
+  }
+  return bbAll;
+}
+
 bool RotamerLibrary::hasFullBackbone(const Residue& res, bool noHyd) {
   vector<Atom*> bb = RotamerLibrary::getBackbone(res, noHyd);
   for (int i = 0; i < bb.size(); i++) {
@@ -171,7 +171,7 @@ vector<Sequence> SeqTools::readSequences(const string& seqsFile) {
   return seqs;
 }
 
-vector<vector<int> > SeqTools::rSearch(const vector<Sequence>& seqs, mstreal idCut, mstreal a, bool verb) {
+vector<vector<int> > SeqTools::rSearch(const vector<Sequence>& seqs, mstreal idCut, mstreal a, bool verb, int numThreads) {
   MstUtils::assertCond((idCut >= 0) && (idCut <= 1.0), "ID cutoff value must be [0; 1]", "SeqTools::rSearch()");
   int N = seqs.size();
   vector<vector<int> > result(N);
@@ -211,77 +211,82 @@ vector<vector<int> > SeqTools::rSearch(const vector<Sequence>& seqs, mstreal idC
   int n = Niters[minIdx]; // number of repeated lookups needed to reach coverage a
   if (verb) cout << "chose word length " << w << ", and will do " << n << " cycles" << endl;
 
-  // -- prepare C-style arrays to store sorted indices, words and words transposes (for different accept patterns)
-  int* indices = new int[N];
-  res_t** wordsT = new res_t*[L];
-  for (int k = 0; k < w; k++) wordsT[k] = new res_t[N];
-  res_t** words = new res_t*[N];
-  for (int k = 0; k < N; k++) words[k] = new res_t[w];
+  // -- residues of all sequences in one contiguous array, for fast comparisons
+  vector<res_t> packed(N*L);
+  for (int i = 0; i < N; i++) {
+    if (seqs[i].length() != L) MstUtils::error("sequences must all be of the same length", "SeqTools::rSearch()");
+    for (int k = 0; k < L; k++) packed[i*L + k] = seqs[i][k];
+  }
 
-  // --- do repeated word-based lookups
-  vector<set<int> > resultSets(N);
+  // -- word positions for each cycle (drawn here, so the result does not depend on threading)
+  vector<vector<int> > wordPos(n, vector<int>(w));
   for (int c = 0; c < n; c++) {
-    // pick random sub-set of positions
-    vector<int> pos(L), wordPos(w);
+    vector<int> pos(L);
     for (int i = 0; i < L; i++) pos[i] = i;
     MstUtils::shuffle(pos);
-    for (int i = 0; i < w; i++) wordPos[i] = pos[i];
+    for (int i = 0; i < w; i++) wordPos[c][i] = pos[i];
+  }
 
-    if (verb) tim.start();
-    // extract words and their transposes
+  // --- do repeated word-based lookups, each worker collecting the similar
+  // pairs (i < j) it finds, de-duplicated every so often
+  numThreads = MstUtils::max(1, MstUtils::min(numThreads, n));
+  vector<vector<pair<int, int> > > pairs(numThreads);
+  if (verb) tim.start();
+  MstUtils::parallelFor(n, numThreads, [&](int c, int t) {
+    // -- sorted indices, words and words transposes (for different accept patterns)
+    vector<int> indices(N);
+    vector<res_t> wordsT(w*N), words(N*w);
+    vector<res_t*> wordsTRows(w);
     for (int k = 0; k < w; k++) {
+      wordsTRows[k] = wordsT.data() + k*N;
       for (int i = 0; i < N; i++) {
-        wordsT[k][i] = seqs[i][wordPos[k]];
-        words[i][k] = wordsT[k][i];
+        wordsT[k*N + i] = packed[i*L + wordPos[c][k]];
+        words[i*w + k] = wordsT[k*N + i];
       }
     }
 
     // sort sequences by word
-    SeqTools::sortSequences(wordsT, indices, N, w);
-    if (verb) {
-      tim.stop();
-      cout << "sorting took " << tim.getDuration(MstTimer::msec) << " msec" << endl;
-      tim.start();
-    }
+    SeqTools::sortSequences(wordsTRows.data(), indices.data(), N, w);
 
     // for each sequence, look through other sequences with matching word
-    int beg = 0, end = beg;
-    for (int i = 1; i < N; i++) {
-      if (!areWordsIdentical(words[indices[i]], words[indices[beg]], w)) {
-        end = i - 1;
-        // mutually compare set between beg and end
-        for (int j = beg; j <= end - 1; j++) {
-          const Sequence& seqI = seqs[indices[j]];
-          for (int k = j + 1; k <= end ; k++) {
-            if (areSequencesWithinID(seqI, seqs[indices[k]], S)) {
-              resultSets[indices[j]].insert(indices[k]);
-              resultSets[indices[k]].insert(indices[j]);
-            }
+    vector<pair<int, int> >& found = pairs[t];
+    int beg = 0;
+    for (int i = 1; i <= N; i++) {
+      if ((i < N) && areWordsIdentical(&words[indices[i]*w], &words[indices[beg]*w], w)) continue;
+      // mutually compare set between beg and i - 1
+      for (int j = beg; j < i - 1; j++) {
+        const res_t* seqI = &packed[indices[j]*L];
+        for (int k = j + 1; k < i; k++) {
+          if (areWithinID(seqI, &packed[indices[k]*L], L, S)) {
+            found.push_back(pair<int, int>(MstUtils::min(indices[j], indices[k]), MstUtils::max(indices[j], indices[k])));
           }
         }
-        beg = i;
-        end = i;
       }
+      beg = i;
     }
-    if (verb) {
-      tim.stop();
-      cout << "comparing took " << tim.getDuration(MstTimer::msec) << " msec" << endl;
+    if (found.size() > 4*N + 1000000) {
+      sort(found.begin(), found.end());
+      found.erase(unique(found.begin(), found.end()), found.end());
     }
+  });
+  if (verb) {
+    tim.stop();
+    cout << "sorting and comparing took " << tim.getDuration(MstTimer::msec) << " msec" << endl;
   }
 
-  // -- clea up
-  delete[] indices;
-  for (int k = 0; k < w; k++) delete[] wordsT[k];
-  delete[] wordsT;
-  for (int k = 0; k < N; k++) delete[] words[k];
-  delete[] words;
-
   // --- extract/return results
-  for (int i = 0; i < N; i++) {
-    int k = 0;
-    result[i].resize(resultSets[i].size());
-    for (auto it = resultSets[i].begin(); it != resultSets[i].end(); ++it, ++k) result[i][k] = *it;
+  vector<pair<int, int> >& all = pairs[0];
+  for (int t = 1; t < numThreads; t++) {
+    all.insert(all.end(), pairs[t].begin(), pairs[t].end());
+    vector<pair<int, int> >().swap(pairs[t]);
+  }
+  sort(all.begin(), all.end());
+  all.erase(unique(all.begin(), all.end()), all.end());
+  for (int k = 0; k < all.size(); k++) {
+    result[all[k].first].push_back(all[k].second);
+    result[all[k].second].push_back(all[k].first);
   }
+  for (int i = 0; i < N; i++) sort(result[i].begin(), result[i].end());
   return result;
 }
 
@@ -363,23 +368,33 @@ bool SeqTools::sortSequencesTest(vector<Sequence> seqs) {
 }
 
 bool SeqTools::areSequencesWithinID(const Sequence& seqA, const Sequence& seqB, int numID) {
-  int nRem = numID, L = seqA.size();
-  for (int i = 0; (i < L - nRem + 1) && (nRem > 0); i++) {
-    if (seqA[i] == seqB[i]) nRem--;
-  }
-  return nRem <= 0; // < 0 should never happen, but just in case
+  return areWithinID(seqA.data(), seqB.data(), seqA.size(), numID);
 }
 
 bool SeqTools::areSequencesWithinID(const Sequence& seqA, const Sequence& seqB, mstreal idCut) {
   return areSequencesWithinID(seqA, seqB, (int) ceil(seqA.size() * idCut));
 }
 
-int SeqTools::sequenceIdentity(const Sequence& seqA, const Sequence& seqB) {
-  int numID = 0, L = seqA.size();
-  for (int i = 0; i < L; i++) {
-    if (seqA[i] == seqB[i]) numID++;
+int SeqTools::countMismatches(const res_t* A, const res_t* B, int L, int maxMismatches) {
+  static_assert(sizeof(res_t) == 2, "mismatch counting assumes 16-bit residue indices");
+  // a 16-bit lane of x = a ^ b is non-zero exactly where residues differ;
+  // adding 0x7FFF to the lower 15 bits of each lane sets its top bit if any of
+  // them are set, and this can not carry into the next lane
+  const uint64_t low = 0x7FFF7FFF7FFF7FFFULL;
+  int n = 0, i = 0;
+  for (; i + 4 <= L; i += 4) {
+    uint64_t a, b;
+    memcpy(&a, A + i, 8); memcpy(&b, B + i, 8);
+    uint64_t x = a ^ b;
+    n += __builtin_popcountll((((x & low) + low) | x) & ~low);
+    if (n > maxMismatches) return n;
   }
-  return numID;
+  for (; i < L; i++) n += (A[i] != B[i]);
+  return n;
+}
+
+int SeqTools::sequenceIdentity(const Sequence& seqA, const Sequence& seqB) {
+  return seqA.size() - countMismatches(seqA.data(), seqB.data(), seqA.size());
 }
 
 mstreal SeqTools::complexity(const vector<int>& seq, int mutSite, int mutAA) {
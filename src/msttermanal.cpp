@@ -19,18 +19,7 @@ pair<mstreal, mstreal> TERMANAL::structureScoreParts(const Structure& term, cons
   fasstSolutionSet matches = F->search();
   vector<fasstSolution*> topMatches;
   vector<mstreal> rmsds;
-  if (compatMode) {
-    vector<Atom*> termBB = RotamerLibrary::getBackbone(term);
-    topMatches = getTopMatches(F, matches, termBB, &rmsds);
-  } else {
-    int numMatches = matches.size();
-    topMatches.resize(numMatches);
-    rmsds.resize(numMatches);
-    for (int i = 0; i < numMatches; i++) {
-      topMatches[i] = &matches[i];
-      rmsds[i] = matches[i].getRMSD();
-    }
-  }
+  rankMatches(term, matches, topMatches, rmsds);
 
   // sequence likelihood = fraction of top hits that share the right amino acid
   mstreal seqLikeComb = calcSeqLikelihood(topMatches, central, verbose);
@@ -50,6 +39,7 @@ mstreal TERMANAL::combineScoreParts(const pair<mstreal, mstreal>& parts) {
 }
 
 vector<mstreal> TERMANAL::scoreStructure(const Structure& S, const vector<Residue*>& subregion, vector<pair<mstreal, mstreal>>* scoreParts, bool verbose) {
+  MstProfiler::scope prof("TERMANAL::scoreStructure");
   if (!RL.isLoaded()) MstUtils::error("Rotamer library not loaded", "TERMANAL::scoreStructure");
 
   // This map will store the score components for various visited TERMs that. The
@@ -67,6 +57,14 @@ vector<mstreal> TERMANAL::scoreStructure(const Structure& S, const vector<Residu
   vector<vector<int>> resOverlaps;
   vector<Structure> terms = collectTERMs(C, S.getResidues(), centrals, resOverlaps);
 
+  // search for all TERMs needed by the subregion as one batch
+  set<int> neededTERMs;
+  for (int i = 0; i < subregion.size(); i++) {
+    vector<int>& overlaps = resOverlaps[subregion[i]->getResidueIndex()];
+    neededTERMs.insert(overlaps.begin(), overlaps.end());
+  }
+  scoreTERMs(terms, centrals, vector<int>(neededTERMs.begin(), neededTERMs.end()), structScoreParts, verbose);
+
   // Smooth and combine each pair of score parts by incorporating the scores from each TERM that a residue belongs to
   vector<mstreal> structScores(subregion.size());
   if (scoreParts != NULL) scoreParts->resize(subregion.size());
@@ -93,18 +91,96 @@ vector<mstreal> TERMANAL::scoreStructure(const Structure& S, const vector<Residu
   return structScores;
 }
 
+void TERMANAL::scoreTERMs(const vector<Structure>& terms, const vector<Residue*>& centrals, const vector<int>& termIdx, map<int, pair<mstreal, mstreal>>& structScoreParts, bool verbose) {
+  MstProfiler::scope prof("TERMANAL::scoreTERMs");
+  if (F == NULL) MstUtils::error("FASST object not set", "TERMANAL::scoreTERMs");
+  int numTERMs = termIdx.size();
+  int nt = verbose ? 1 : MstUtils::max(1, numThreads);
+  int origThreads = F->getNumThreads(); // in case the same FASST object is being shared by others
+  vector<Structure> queries(numTERMs);
+  for (int k = 0; k < numTERMs; k++) queries[k] = terms[termIdx[k]];
+  vector<fasstSearchOptions> opts(numTERMs, searchOptions());
+  F->setNumThreads(nt);
+  vector<fasstSolutionSet> matches;
+  try {
+    matches = F->searchBatch(queries, opts);
+  } catch (...) {
+    F->setNumThreads(origThreads);
+    throw;
+  }
+
+  // sequence likelihoods, plus the top match of each TERM, for which a second
+  // round of search (to the closest native) is needed for structure frequency;
+  // TERMs are independent here, so each is processed on its own
+  vector<vector<fasstSolution*>> topMatches(numTERMs);
+  vector<vector<mstreal>> rmsds(numTERMs);
+  vector<mstreal> seqLikes(numTERMs);
+  vector<Structure> topMatchStructs(numTERMs);
+  MstUtils::parallelFor(numTERMs, nt, [&](int k, int) {
+    int ti = termIdx[k];
+    if (verbose) cout << "\tvisiting TERM (" << *(centrals[ti]) << "): " << MstUtils::vecPtrToString(terms[ti].getResidues()) << endl;
+    rankMatches(terms[ti], matches[k], topMatches[k], rmsds[k]);
+    seqLikes[k] = calcSeqLikelihood(topMatches[k], {centrals[ti]}, verbose);
+    if (!topMatches[k].empty()) topMatchStructs[k] = F->getMatchStructure(*(topMatches[k][0]));
+  });
+  vector<Structure> firstMatches;
+  vector<int> firstMatchOf;
+  for (int k = 0; k < numTERMs; k++) {
+    if (topMatches[k].empty()) continue;
+    firstMatches.push_back(topMatchStructs[k]);
+    firstMatchOf.push_back(k);
+  }
+  vector<fasstSolutionSet> nativeMatches;
+  try {
+    nativeMatches = F->searchBatch(firstMatches, vector<fasstSearchOptions>(firstMatches.size(), searchOptions()));
+  } catch (...) {
+    F->setNumThreads(origThreads);
+    throw;
+  }
+  F->setNumThreads(origThreads);
+
+  vector<mstreal> structFreqs(numTERMs, 0.0);
+  for (int k = 0; k < numTERMs; k++) {
+    if (topMatches[k].empty()) structFreqs[k] = calcStructFreq(topMatches[k], rmsds[k], verbose);
+  }
+  MstUtils::parallelFor(firstMatches.size(), nt, [&](int m, int) {
+    int k = firstMatchOf[m];
+    structFreqs[k] = structFreqFromNativeMatches(topMatches[k], rmsds[k], firstMatches[m], nativeMatches[m], verbose);
+  });
+  for (int k = 0; k < numTERMs; k++) structScoreParts[termIdx[k]] = make_pair(seqLikes[k], structFreqs[k]);
+}
+
+fasstSearchOptions TERMANAL::searchOptions() {
+  fasstSearchOptions opts;
+  opts.setRedundancyCut(0.7);
+  opts.setRMSDCutoff(rmsdCut);
+  opts.setMinNumMatches(0);
+  opts.setMaxNumMatches(compatMode ? compatSearchLimit : matchCount);
+  return opts;
+}
+
 fasstSearchOptions TERMANAL::setupSearch(const Structure& S) {
   fasstSearchOptions origOpts = F->options(); // in case the same FASST object is being shared by others
-  F->setOptions(fasstSearchOptions());
-  F->options().setRedundancyCut(0.7);
-  F->options().setRMSDCutoff(rmsdCut);
-  F->options().setMinNumMatches(0);
-  int maxNumMatches = compatMode ? compatSearchLimit : matchCount;
-  F->options().setMaxNumMatches(maxNumMatches);
+  F->setOptions(searchOptions());
   F->setQuery(S);
   return origOpts;
 }
 
+void TERMANAL::rankMatches(const Structure& term, fasstSolutionSet& matches, vector<fasstSolution*>& topMatches, vector<mstreal>& rmsds) {
+  if (compatMode) {
+    vector<Atom*> termBB = RotamerLibrary::getBackbone(term);
+    topMatches = getTopMatches(F, matches, termBB, &rmsds);
+  } else {
+    int numMatches = matches.size();
+    topMatches.resize(numMatches);
+    rmsds.resize(numMatches);
+    for (int i = 0; i < numMatches; i++) {
+      topMatches[i] = &matches[i];
+      rmsds[i] = matches[i].getRMSD();
+    }
+  }
+}
+
 vector<fasstSolution*> TERMANAL::getTopMatches(FASST* F, fasstSolutionSet& matches, vector<Atom*>& queryA, vector<mstreal>* topRmsds) {
   RMSDCalculator RC;
   int numMatches = matches.size();
@@ -147,22 +223,29 @@ mstreal TERMANAL::calcSeqFreq(Residue* res, vector<Sequence>& matchSeqs) {
 }
 
 mstreal TERMANAL::calcStructFreq(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, bool verbose) {
-  int n;
   if (matches.size() >= 1) {
     Structure firstMatch = F->getMatchStructure(*matches[0]);
     F->setQuery(firstMatch);
     fasstSolutionSet matchesToClosestNative = F->search();
-    mstreal r;
-    if (compatMode) {
-      vector<Atom*> firstMatchBB = RotamerLibrary::getBackbone(firstMatch);
-      vector<mstreal> nativeRmsds;
-      getTopMatches(F, matchesToClosestNative, firstMatchBB, &nativeRmsds);
-      r = nativeRmsds.back();
-    } else r = matchesToClosestNative.worstRMSD();
-    for (n = 0; n < matches.size(); n++) {
-      if (rmsds[n] > r) break;
-    }
-  } else n = 0;
+    return structFreqFromNativeMatches(matches, rmsds, firstMatch, matchesToClosestNative, verbose);
+  }
+  mstreal structFreq = 0.0;
+  if (verbose) cout << "\tstructure frequency = " << structFreq << endl;
+  return structFreq;
+}
+
+mstreal TERMANAL::structFreqFromNativeMatches(vector<fasstSolution*>& matches, vector<mstreal>& rmsds, const Structure& firstMatch, fasstSolutionSet& matchesToClosestNative, bool verbose) {
+  int n;
+  mstreal r;
+  if (compatMode) {
+    vector<Atom*> firstMatchBB = RotamerLibrary::getBackbone(firstMatch);
+    vector<mstreal> nativeRmsds;
+    getTopMatches(F, matchesToClosestNative, firstMatchBB, &nativeRmsds);
+    r = nativeRmsds.back();
+  } else r = matchesToClosestNative.worstRMSD();
+  for (n = 0; n < matches.size(); n++) {
+    if (rmsds[n] > r) break;
+  }
   mstreal structFreq = min(1.0, (1.0*n)/matchCount);
   if (verbose) cout << "\tstructure frequency = " << structFreq << endl;
   return structFreq;
@@ -0,0 +1,166 @@
+#include "msttraj.h"
+
+using namespace MST;
+
+namespace {
+  const char trajMagic[] = "MSTTRJ";
+  const int trajVersion = 1;
+  const char keyFrame = 'K', deltaFrame = 'D';
+
+  void putVarint(string& buf, long v) {
+    unsigned long u = (((unsigned long) v) << 1) ^ (unsigned long) (v >> (8*sizeof(long) - 1)); // zig-zag
+    while (u >= 0x80) { buf.push_back((char) ((u & 0x7F) | 0x80)); u >>= 7; }
+    buf.push_back((char) u);
+  }
+
+  bool getVarint(istream& ifs, long& v) {
+    unsigned long u = 0; int shift = 0; char c;
+    do {
+      if (!ifs.get(c) || (shift > 63)) return false;
+      u |= ((unsigned long) (c & 0x7F)) << shift;
+      shift += 7;
+    } while (c & 0x80);
+    v = (long) (u >> 1) ^ -((long) (u & 1));
+    return true;
+  }
+
+  // checks the magic string and version, and reads the rest of the header
+  bool readHeader(istream& ifs, Structure& topo, mstreal& prec) {
+    char magic[sizeof(trajMagic)];
+    if (!ifs.read(magic, sizeof(trajMagic)) || (string(magic, sizeof(trajMagic)) != string(trajMagic, sizeof(trajMagic)))) return false;
+    int version; MstUtils::readBin(ifs, version);
+    if (version != trajVersion) MstUtils::error("unsupported trajectory format version " + MstUtils::toString(version), "trajectoryReader::readHeader");
+    double p; MstUtils::readBin(ifs, p);
+    prec = p;
+    topo.readData(ifs);
+    return (bool) ifs;
+  }
+}
+
+/* --------- trajectoryWriter --------- */
+
+trajectoryWriter::trajectoryWriter(const string& file, mstreal precision, int keyInterval, bool append) {
+  if (precision <= 0) MstUtils::error("precision must be positive", "trajectoryWriter::trajectoryWriter");
+  fileName = file; prec = precision; keyInt = MstUtils::max(keyInterval, 1);
+  nAtoms = -1; nFrames = 0; headerWritten = false;
+  appending = append && trajectoryReader::isTrajectoryFile(file);
+  if (appending) {
+    // take the topology (and precision) from the existing file
+    trajectoryReader R(file);
+    nAtoms = R.numAtoms(); prec = R.getPrecision();
+    headerWritten = true;
+    MstUtils::openFile(out, file, ios::out | ios::app | ios::binary, "trajectoryWriter::trajectoryWriter");
+  }
+}
+
+trajectoryWriter::trajectoryWriter(const string& file, const Structure& topology, mstreal precision, int keyInterval, bool append) : trajectoryWriter(file, precision, keyInterval, append) {
+  if (appending) {
+    if (topology.atomSize() != nAtoms) MstUtils::error("cannot append to trajectory " + file + " with " + MstUtils::toString(nAtoms) + " atoms per frame, given a topology with " + MstUtils::toString(topology.atomSize()), "trajectoryWriter::trajectoryWriter");
+  } else {
+    writeHeader(topology);
+  }
+}
+
+void trajectoryWriter::writeHeader(const Structure& topology) {
+  MstUtils::openFile(out, fileName, ios::out | ios::binary, "trajectoryWriter::writeHeader");
+  out.write(trajMagic, sizeof(trajMagic));
+  MstUtils::writeBin(out, trajVersion);
+  MstUtils::writeBin(out, (double) prec);
+  topology.writeData(out);
+  nAtoms = topology.atomSize();
+  headerWritten = true;
+}
+
+void trajectoryWriter::addFrame(const Structure& S, mstreal score) {
+  AtomPointerVector atoms = S.getAtoms();
+  int n = atoms.size();
+  vector<mstreal> coords(3*n);
+  for (int i = 0; i < n; i++) {
+    coords[3*i] = atoms[i]->getX(); coords[3*i + 1] = atoms[i]->getY(); coords[3*i + 2] = atoms[i]->getZ();
+  }
+  {
+    lock_guard<mutex> guard(lock);
+    if (!headerWritten) writeHeader(S);
+  }
+  addFrame(coords.data(), n, score);
+}
+
+void trajectoryWriter::addFrame(const vector<mstreal>& coords, mstreal score) {
+  if (!headerWritten) MstUtils::error("the first frame must be given as a Structure, unless a topology was specified", "trajectoryWriter::addFrame");
+  addFrame(coords.data(), coords.size()/3, score);
+}
+
+void trajectoryWriter::addFrame(const mstreal* coords, int n, mstreal score) {
+  lock_guard<mutex> guard(lock);
+  if (n != nAtoms) MstUtils::error("expected " + MstUtils::toString(nAtoms) + " atoms per frame, got " + MstUtils::toString(n), "trajectoryWriter::addFrame");
+  if (!out.is_open()) MstUtils::error("trajectory " + fileName + " is closed", "trajectoryWriter::addFrame");
+  // the first frame appended to an existing file is also a key frame, so that
+  // it does not depend on frames written before
+  bool key = (nFrames % keyInt == 0);
+  prev.resize(3*nAtoms, 0);
+  buf.clear();
+  for (int i = 0; i < 3*nAtoms; i++) {
+    long q = lround(coords[i]/prec);
+    putVarint(buf, key ? q : q - prev[i]);
+    prev[i] = q;
+  }
+  out.put(key ? keyFrame : deltaFrame);
+  MstUtils::writeBin(out, (double) score);
+  out.write(buf.data(), buf.size());
+  if (key) out.flush();
+  nFrames++;
+}
+
+void trajectoryWriter::flush() {
+  lock_guard<mutex> guard(lock);
+  if (out.is_open()) out.flush();
+}
+
+void trajectoryWriter::close() {
+  lock_guard<mutex> guard(lock);
+  if (out.is_open()) out.close();
+}
+
+/* --------- trajectoryReader --------- */
+
+trajectoryReader::trajectoryReader(const string& file) {
+  MstUtils::openFile(in, file, ios::in | ios::binary, "trajectoryReader::trajectoryReader");
+  if (!readHeader(in, topo, prec)) MstUtils::error(file + " is not a trajectory file", "trajectoryReader::trajectoryReader");
+  nFrames = 0;
+  prev.assign(3*topo.atomSize(), 0);
+}
+
+bool trajectoryReader::readFrame(vector<mstreal>& coords, mstreal& score) {
+  char type;
+  if (!in.get(type)) return false;
+  if ((type != keyFrame) && (type != deltaFrame)) MstUtils::error("corrupt trajectory frame " + MstUtils::toString(nFrames + 1), "trajectoryReader::readFrame");
+  double s; MstUtils::readBin(in, s);
+  if (!in) return false;
+  vector<long> curr(prev.size());
+  for (int i = 0; i < curr.size(); i++) {
+    long v;
+    if (!getVarint(in, v)) return false; // incomplete last frame
+    curr[i] = (type == keyFrame) ? v : prev[i] + v;
+  }
+  prev.swap(curr);
+  coords.resize(prev.size());
+  for (int i = 0; i < prev.size(); i++) coords[i] = prev[i]*prec;
+  score = s;
+  nFrames++;
+  return true;
+}
+
+bool trajectoryReader::readFrame(Structure& S, mstreal& score) {
+  vector<mstreal> coords;
+  if (!readFrame(coords, score)) return false;
+  S = topo;
+  AtomPointerVector atoms = S.getAtoms();
+  for (int i = 0; i < atoms.size(); i++) atoms[i]->setCoor(coords[3*i], coords[3*i + 1], coords[3*i + 2]);
+  return true;
+}
+
+bool trajectoryReader::isTrajectoryFile(const string& file) {
+  ifstream ifs(file, ios::in | ios::binary);
+  char magic[sizeof(trajMagic)];
+  return ifs.read(magic, sizeof(trajMagic)) && (string(magic, sizeof(trajMagic)) == string(trajMagic, sizeof(trajMagic)));
+}
@@ -217,7 +217,11 @@ const CartesianPoint Transform::operator*(const CartesianPoint& rhs) const {
   if (rhs.size() != 3) {
     MstUtils::error("Transform currently supports only 3D transforms, whereas a point of dimensionality " + MstUtils::toString(rhs.size()) + " was passed", "Transform::operator*(const CartesianPoint&&)");
   }
-  CartesianPoint p(3, 0);
+  return (*this) * Point3(rhs);
+}
+
+const Point3 Transform::operator*(const Point3& rhs) const {
+  Point3 p;
   for (int i = 0; i < 3; i++) {
     for (int j = 0; j < 4; j++) {
       p[i] += (*this)(i, j) * (j == 3 ? 1 : rhs[j]); // add W (homogeneous coordinate) of 1 to the point
@@ -304,20 +308,13 @@ CartesianPoint Transform::applyToCopy(CartesianPoint& p) {
 }*/
 
 void Transform::apply(mstreal& x, mstreal& y, mstreal& z) {
-  mstreal p[3];
-  p[0] = 0;
-  p[1] = 0;
-  p[2] = 0;
-  p[3] = 0;
-  for (int i = 0; i < 3; i++) {
-    p[i] += (*this)(i, 0) * x;
-    p[i] += (*this)(i, 1) * y;
-    p[i] += (*this)(i, 2) * z;
-    p[i] += (*this)(i, 3); // add W (homogeneous coordinate) of 1 to the point
-  }
-  x = p[0];
-  y = p[1];
-  z = p[2];
+  // W (homogeneous coordinate) of the point is 1
+  mstreal px = M[0][0] * x + M[0][1] * y + M[0][2] * z + M[0][3];
+  mstreal py = M[1][0] * x + M[1][1] * y + M[1][2] * z + M[1][3];
+  mstreal pz = M[2][0] * x + M[2][1] * y + M[2][2] * z + M[2][3];
+  x = px;
+  y = py;
+  z = pz;
 }
 
 void Transform::apply(CartesianPoint& p) {
@@ -325,14 +322,16 @@ void Transform::apply(CartesianPoint& p) {
 }
 
 void Transform::apply(Atom* a) {
-  this->apply((*a)[0], (*a)[1], (*a)[2]);
+  mstreal x = a->getX(), y = a->getY(), z = a->getZ();
+  this->apply(x, y, z);
+  a->setCoor(x, y, z);
 }
 
 void Transform::apply(Frame& f) {
-  CartesianPoint O = f.getO();
-  CartesianPoint X = f.getX() + O;
-  CartesianPoint Y = f.getY() + O;
-  CartesianPoint Z = f.getZ() + O;
+  Point3 O(f.getO(0), f.getO(1), f.getO(2));
+  Point3 X = Point3(f.getX(0), f.getX(1), f.getX(2)) + O;
+  Point3 Y = Point3(f.getY(0), f.getY(1), f.getY(2)) + O;
+  Point3 Z = Point3(f.getZ(0), f.getZ(1), f.getZ(2)) + O;
   O = (*this) * O;
   X = (*this) * X;
   Y = (*this) * Y;
@@ -345,28 +344,19 @@ void Transform::apply(Frame& f) {
 
 void Transform::apply(Residue* res) {
   for (int i = 0; i < res->atomSize(); i++) {
-    apply((*res)[i]);
+    apply(&((*res)[i]));
   }
 }
 
 void Transform::apply(Chain* chain) {
   for (int j = 0; j < chain->residueSize(); j++) {
-    Residue& res = (*chain)[j];
-    for (int i = 0; i < res.atomSize(); i++) {
-      apply(res[i]);
-    }
+    apply(&((*chain)[j]));
   }
 }
 
 void Transform::apply(Structure* S) {
   for (int k = 0; k < S->chainSize(); k++) {
-    Chain& chain = (*S)[k];
-    for (int j = 0; j < chain.residueSize(); j++) {
-      Residue& res = chain[j];
-      for (int i = 0; i < res.atomSize(); i++) {
-        apply(res[i]);
-      }
-    }
+    apply(&((*S)[k]));
   }
 }
 
@@ -374,6 +364,30 @@ void Transform::apply(const AtomPointerVector& vec) {
   for (int i = 0; i < vec.size(); i++) apply(vec[i]);
 }
 
+void Transform::applyToCopy(const mstreal* coor, int n, mstreal* out) const {
+  const mstreal r00 = M[0][0], r01 = M[0][1], r02 = M[0][2], t0 = M[0][3];
+  const mstreal r10 = M[1][0], r11 = M[1][1], r12 = M[1][2], t1 = M[1][3];
+  const mstreal r20 = M[2][0], r21 = M[2][1], r22 = M[2][2], t2 = M[2][3];
+  for (int i = 0; i < 3*n; i += 3) {
+    mstreal x = coor[i], y = coor[i+1], z = coor[i+2];
+    out[i]   = r00 * x + r01 * y + r02 * z + t0;
+    out[i+1] = r10 * x + r11 * y + r12 * z + t1;
+    out[i+2] = r20 * x + r21 * y + r22 * z + t2;
+  }
+}
+
+void Transform::applyEach(const vector<Transform>& transforms, const mstreal* coor, int n, mstreal* out) {
+  for (int t = 0; t < transforms.size(); t++) {
+    transforms[t].applyToCopy(coor, n, out + 3*n*t);
+  }
+}
+
+Transform Transform::compose(const vector<Transform>& transforms) {
+  Transform T;
+  for (int t = 0; t < transforms.size(); t++) T = transforms[t] * T;
+  return T;
+}
+
 void Transform::write(ostream& _os) const {
   for (int i = 0; i < 4; i++) {
     for (int j = 0; j < 4; j++) MstUtils::writeBin(_os, M[i][j]);
@@ -1,30 +1,175 @@
 #include "msttypes.h"
-mt19937 MstUtils::mt;
+#include <sys/mman.h>
+#include <sys/stat.h>
+#ifdef MST_ZLIB
+#include <zlib.h>
+#endif
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+thread_local mt19937 MstUtils::mt;
 
 using namespace MST;
 
+/* --------- MstArena --------- */
+thread_local MstArena* MstArena::currentArena = NULL;
+atomic<char*> MstArena::regionBase(NULL);
+size_t MstArena::regionSize = 0;
+size_t MstArena::regionNext = 0;
+vector<char*> MstArena::freeChunks;
+mutex MstArena::regionLock;
+
+MstArena::~MstArena() {
+  for (int i = 0; i < chunks.size(); i++) returnChunk(chunks[i]);
+}
+
+void MstArena::release() {
+  if (--refs == 0) delete this;
+}
+
+char* MstArena::takeChunk() {
+  lock_guard<mutex> guard(regionLock);
+  if (!freeChunks.empty()) {
+    char* chunk = freeChunks.back();
+    freeChunks.pop_back();
+    return chunk;
+  }
+  if (regionBase == NULL) {
+    // reserve (but do not commit) address space, trying smaller sizes if need be
+    for (size_t sz = ((size_t) 1) << 36; (sz >= (((size_t) 1) << 30)) && (regionBase == NULL); sz /= 4) {
+      void* base = mmap(NULL, sz, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+      if (base == MAP_FAILED) continue;
+      // align the start to the chunk size, so chunks can be found from any address in them
+      char* aligned = (char*) ((((size_t) base) + chunkSize - 1) & ~(chunkSize - 1));
+      regionSize = sz - (aligned - (char*) base);
+      regionSize -= regionSize % chunkSize;
+      regionBase = aligned;
+    }
+    if (regionBase == NULL) regionSize = 1; // could not reserve, so will not try again
+  }
+  if ((regionBase == NULL) || (regionNext + chunkSize > regionSize)) return NULL;
+  char* chunk = regionBase + regionNext;
+  if (mprotect(chunk, chunkSize, PROT_READ | PROT_WRITE) != 0) return NULL;
+  regionNext += chunkSize;
+  return chunk;
+}
+
+void MstArena::returnChunk(char* chunk) {
+  madvise(chunk, chunkSize, MADV_DONTNEED);
+  lock_guard<mutex> guard(regionLock);
+  freeChunks.push_back(chunk);
+}
+
+void* MstArena::bump(size_t n) {
+  n = (n + 15) & ~((size_t) 15);
+  if (n > chunkSize/16) return NULL; // large objects are better off on the heap
+  lock_guard<mutex> guard(lock);
+  if (pos + n > end) {
+    char* chunk = takeChunk();
+    if (chunk == NULL) return NULL;
+    chunks.push_back(chunk);
+    // the owning arena goes at the start of every chunk
+    *((MstArena**) chunk) = this;
+    pos = chunk + 16;
+    end = chunk + chunkSize;
+  }
+  void* p = pos;
+  pos += n;
+  used += n;
+  refs++;
+  return p;
+}
+
+void* MstArena::allocate(size_t n) {
+  if (currentArena != NULL) {
+    void* p = currentArena->bump(n);
+    if (p != NULL) return p;
+  }
+  return ::operator new(n);
+}
+
+bool MstArena::fromArena(const void* p) {
+  char* base = regionBase.load(memory_order_relaxed);
+  return (base != NULL) && ((const char*) p >= base) && ((const char*) p < base + regionSize);
+}
+
+void MstArena::deallocate(void* p) {
+  if (p == NULL) return;
+  if (!fromArena(p)) { ::operator delete(p); return; }
+  char* base = regionBase.load(memory_order_relaxed);
+  char* chunk = base + ((((char*) p) - base) & ~(chunkSize - 1));
+  (*((MstArena**) chunk))->release();
+}
+
+/* --------- MstNames --------- */
+const char** MstNames::blocks[MstNames::maxBlocks];
+atomic<int> MstNames::numNames(0);
+unordered_map<string, int>* MstNames::ids = NULL;
+mutex MstNames::lock;
+thread_local unordered_map<string, int> MstNames::seen;
+
+int MstNames::intern(const char* name) {
+  string key(name);
+  auto it = seen.find(key);
+  if (it != seen.end()) return it->second;
+
+  lock_guard<mutex> guard(lock);
+  if (ids == NULL) ids = new unordered_map<string, int>(); // never deleted, as names may be used during exit
+  auto jt = ids->find(key);
+  int id;
+  if (jt != ids->end()) {
+    id = jt->second;
+  } else {
+    id = numNames;
+    int b = id >> blockBits;
+    if (b >= maxBlocks) MstUtils::error("ran out of room for names", "MstNames::intern");
+    if (blocks[b] == NULL) blocks[b] = new const char*[blockSize];
+    blocks[b][id & (blockSize - 1)] = MstUtils::copyStringC(name);
+    (*ids)[key] = id;
+    numNames++;
+  }
+  seen[key] = id;
+  return id;
+}
+
+int MstNames::find(const char* name) {
+  string key(name);
+  auto it = seen.find(key);
+  if (it != seen.end()) return it->second;
+  lock_guard<mutex> guard(lock);
+  if (ids == NULL) return -1;
+  auto jt = ids->find(key);
+  return (jt == ids->end()) ? -1 : jt->second;
+}
+
 /* --------- Structure --------- */
 Structure::Structure() {
   numResidues = numAtoms = 0;
+  arena = NULL;
 }
 
 Structure::Structure(string pdbFile, string options) {
   name = pdbFile;
   numResidues = numAtoms = 0;
+  arena = NULL;
   readPDB(pdbFile, options);
 }
 
 Structure::Structure(istream& is, string options) {
   name = "";
   numResidues = numAtoms = 0;
+  arena = NULL;
   readPDB(is, options);
 }
 
 Structure::Structure(const Structure& S) {
+  arena = NULL;
+  setArena(S.arena);
   copy(S);
 }
 
 void Structure::copy(const Structure& S) {
+  MstArena::Scope scope(arena ? arena : MstArena::current());
   name = S.name;
   numResidues = S.numResidues;
   numAtoms = S.numAtoms;
@@ -38,22 +183,26 @@ void Structure::copy(const Structure& S) {
 
 Structure::Structure(Chain& C) {
   numResidues = numAtoms = 0;
+  arena = NULL;
   appendChain(new Chain(C));
 }
 
 Structure::Structure(Residue& R) {
   numResidues = numAtoms = 0;
+  arena = NULL;
   Chain* newChain = appendChain("A", true);
   newChain->appendResidue(new Residue(R));
 }
 
 Structure::Structure(const vector<Atom*>& atoms) {
   numResidues = numAtoms = 0;
+  arena = NULL;
   addAtoms(atoms);
 }
 
 Structure::Structure(const vector<Residue*>& residues) {
   numResidues = numAtoms = 0;
+  arena = NULL;
   for (int i = 0; i < residues.size(); i++) addResidue(residues[i]);
 }
 
@@ -63,6 +212,13 @@ Structure::Structure(const vector<Residue*>& residues) {
  * should generate copies as needed via copy constructors. */
 Structure::~Structure() {
   deletePointers();
+  if (arena != NULL) arena->release();
+}
+
+void Structure::setArena(MstArena* _arena) {
+  if (_arena != NULL) _arena->acquire();
+  if (arena != NULL) arena->release();
+  arena = _arena;
 }
 
 Structure Structure::combine(const Structure& atomsStruct, const Structure& topoStruct, bool renameResidues) {
@@ -89,6 +245,7 @@ void Structure::reset() {
   chainsBySegID.clear();
   name = "";
   numResidues = numAtoms = 0;
+  clearBackboneCache();
 }
 
 Structure& Structure::operator=(const Structure& A) {
@@ -97,33 +254,111 @@ Structure& Structure::operator=(const Structure& A) {
   return *this;
 }
 
-void Structure::readPDB(const string& pdbFile, string options) {
-  name = pdbFile;
-  fstream ifh; MstUtils::openFile(ifh, pdbFile, fstream::in, "Structure::readPDB");
-  readPDB(ifh, options);
-  ifh.close();
-}
-
-void Structure::readPDB(istream& is, string options) {
-  int lastresnum = -999999;
-  string lastresname = "XXXXXX";
-  string lasticode = "";
-  string lastchainID = "";
-  string lastalt = " ";
-  Chain* chain = NULL;
-  Residue* residue = NULL;
+/* Fast field parsers for fixed-column (PDB) and whitespace-delimited (mmCIF)
+ * records. The common cases (plain integers and decimals) are handled here;
+ * anything else goes to the general MstUtils conversions, so the outcome is
+ * always the same as theirs. */
+static inline bool isBlank(char c) {
+  return (c == ' ') || (c == '\t') || (c == '\n') || (c == '\v') || (c == '\f') || (c == '\r');
+}
+
+static string recordField(const char* rec, int len) {
+  int i = 0, j = len;
+  while ((i < j) && isBlank(rec[i])) i++;
+  while ((j > i) && isBlank(rec[j-1])) j--;
+  return string(rec + i, j - i);
+}
+
+static int recordInt(const char* rec, int len, bool strict = true) {
+  int i = 0, val = 0, nd = 0; bool neg = false;
+  while ((i < len) && (rec[i] == ' ')) i++;
+  if ((i < len) && ((rec[i] == '-') || (rec[i] == '+'))) { neg = (rec[i] == '-'); i++; }
+  for (; (i < len) && (rec[i] >= '0') && (rec[i] <= '9') && (nd < 9); i++, nd++) val = 10*val + (rec[i] - '0');
+  while ((i < len) && (rec[i] == ' ')) i++;
+  if ((nd == 0) || (i < len)) return MstUtils::toInt(string(rec, len), strict);
+  return neg ? -val : val;
+}
+
+static mstreal recordReal(const char* rec, int len, bool strict = true) {
+  static const double pow10[] = {1E0, 1E1, 1E2, 1E3, 1E4, 1E5, 1E6, 1E7, 1E8, 1E9, 1E10, 1E11, 1E12, 1E13, 1E14, 1E15};
+  int i = 0, nd = 0, nf = 0; bool neg = false; long long mant = 0;
+  while ((i < len) && (rec[i] == ' ')) i++;
+  if ((i < len) && ((rec[i] == '-') || (rec[i] == '+'))) { neg = (rec[i] == '-'); i++; }
+  for (; (i < len) && (rec[i] >= '0') && (rec[i] <= '9'); i++, nd++) mant = 10*mant + (rec[i] - '0');
+  if ((i < len) && (rec[i] == '.')) {
+    for (i++; (i < len) && (rec[i] >= '0') && (rec[i] <= '9'); i++, nf++) mant = 10*mant + (rec[i] - '0');
+  }
+  while ((i < len) && (rec[i] == ' ')) i++;
+  // both the mantissa and the power of ten are exact, so the quotient is correctly rounded (as with sscanf)
+  if ((nd + nf == 0) || (nd + nf > 15) || (i < len)) return MstUtils::toReal(string(rec, len), strict);
+  double val = mant / pow10[nf];
+  return neg ? -val : val;
+}
+
+/* Builds up a Structure from a stream of atom records, coming either from PDB
+ * lines or from rows of an mmCIF atom_site table. Holds all the state that
+ * carries over between records, along with the parsing options. */
+class structureReader {
+  public:
+    structureReader(Structure& _S, string options);
+    bool pdbLine(const char* line, int len); // returns false upon reaching the end of the structure
+    bool cifLine(const char* line, int len);
+
+  private:
+    struct atomRecord {
+      int index, resnum;
+      string name, resname, chainID, segID;
+      char alt, icode;
+      mstreal x, y, z, B, occ;
+      bool het;
+    };
+    void addAtom(atomRecord& rec);
+    bool cifAtom(vector<pair<const char*, int> >& tokens);
+    int cifColumn(const vector<string>& names);
+
+    Structure& S;
+    MstArena::Scope scope;
+    int lastresnum;
+    string lastresname, lastchainID;
+    char lasticode, lastalt;
+    Chain* chain;
+    Residue* residue;
+    bool ter, usesegid, skipHetero, charmmFormat, charmm19Format, fixIleCD1, iCodesAsSepResidues, uniqChainIDs, ignoreTER, verbose;
+
+    // mmCIF state: the atom_site column names seen so far, whether we are in
+    // the rows of the table, which columns hold what, and which model is read
+    vector<string> cifColumns;
+    bool cifRows;
+    int cGroup, cIndex, cName, cAlt, cResname, cChain, cSeg, cResnum, cIcode, cX, cY, cZ, cOcc, cB, cModel;
+    string cifModel, lastSeg;
+};
+
+static MstArena* readerArena(Structure& S, const string& options) {
+  if ((MstUtils::uc(options).find("ARENA") != string::npos) && (S.getArena() == NULL)) S.useArena();
+  return S.getArena() ? S.getArena() : MstArena::current();
+}
+
+structureReader::structureReader(Structure& _S, string options) : S(_S), scope(readerArena(_S, options)) {
+  lastresnum = -999999;
+  lastresname = "XXXXXX";
+  lasticode = '\0';
+  lastchainID = "";
+  lastalt = ' ';
+  chain = NULL;
+  residue = NULL;
+  cifRows = false;
 
   // various parsing options (the wonders of dealing with the good-old PDB format)
-  bool ter = true;                   // flag to indicate that chain terminus was reached. Initialize to true so as to create a new chain upon reading the first atom.
-  bool usesegid = false;             // use segment IDs to name chains instead of chain IDs? (useful when the latter are absent OR when too many chains, so need multi-letter names)
-  bool skipHetero = false;           // skip hetero-atoms?
-  bool charmmFormat = false;         // the PDB file was written by CHARMM (slightly different format)
-  bool charmm19Format = false;       // upon reading, convert from all-hydrogen topology (param22 and higher) to the CHARMM19 united-atom topology (matters for HIS protonation states)
-  bool fixIleCD1 = true;             // rename CD1 in ILE to CD (as is standard in MM packages)
-  bool iCodesAsSepResidues = true;   // consequtive residues that differ only in their insertion code will be treated as separate residues
-  bool uniqChainIDs = true;          // make sure chain IDs are unique, even if they are not unique in the read file
-  bool ignoreTER = false;            // if true, will not pay attention to TER lines in deciding when chains end/begin
-  bool verbose = true;               // report various warnings when weird things are found and fixed?
+  ter = true;                   // flag to indicate that chain terminus was reached. Initialize to true so as to create a new chain upon reading the first atom.
+  usesegid = false;             // use segment IDs to name chains instead of chain IDs? (useful when the latter are absent OR when too many chains, so need multi-letter names)
+  skipHetero = false;           // skip hetero-atoms?
+  charmmFormat = false;         // the PDB file was written by CHARMM (slightly different format)
+  charmm19Format = false;       // upon reading, convert from all-hydrogen topology (param22 and higher) to the CHARMM19 united-atom topology (matters for HIS protonation states)
+  fixIleCD1 = true;             // rename CD1 in ILE to CD (as is standard in MM packages)
+  iCodesAsSepResidues = true;   // consequtive residues that differ only in their insertion code will be treated as separate residues
+  uniqChainIDs = true;          // make sure chain IDs are unique, even if they are not unique in the read file
+  ignoreTER = false;            // if true, will not pay attention to TER lines in deciding when chains end/begin
+  verbose = true;               // report various warnings when weird things are found and fixed?
 
   // user-specified custom parsing options
   options = MstUtils::uc(options);
@@ -136,100 +371,274 @@ void Structure::readPDB(istream& is, string options) {
   if (options.find("IGNORE-ICODES") != string::npos) iCodesAsSepResidues = true;
   if (options.find("IGNORE-TER") != string::npos) ignoreTER = true;
   if (options.find("QUIET") != string::npos) verbose = false;
+}
 
-  // read line by line
-  string line;
-  while (getline(is, line)) {
-    if (line.find("END") == 0) break;
-    if ((line.find("TER") == 0) && !ignoreTER) { ter = true; continue; }
-    if ((skipHetero && (line.find("ATOM") != 0)) || (!skipHetero && (line.find("ATOM") != 0) && (line.find("HETATM") != 0))) continue;
-
-    /* Now read atom record. Sometimes PDB lines are too short (if they do not contain some
-     * of the last optional columns). We don't want to read past the end of the string! */
-    line += string(100, ' ');
-    int atominx = MstUtils::toInt(line.substr(6, 5));
-    string atomname = MstUtils::trim(line.substr(12, 4));
-    string alt = line.substr(16, 1);
-    string resname = MstUtils::trim(line.substr(17, 4));
-    string chainID = MstUtils::trim(line.substr(21, 1));
-    int resnum = charmmFormat ? MstUtils::toInt(line.substr(23, 4)) : MstUtils::toInt(line.substr(22, 4));
-    string icode = charmmFormat ? " " : line.substr(26, 1);
-    mstreal x = MstUtils::toReal(line.substr(30, 8));
-    mstreal y = MstUtils::toReal(line.substr(38, 8));
-    mstreal z = MstUtils::toReal(line.substr(46, 8));
-    string segID = MstUtils::trim(line.substr(72, 4));
-    mstreal B = MstUtils::toReal(line.substr(60, 6), false);
-    mstreal occ = MstUtils::toReal(line.substr(54, 6), false);
-    bool het = (line.find("HETATM") == 0);
-
-    // use segment ID's instead of chain ID's?
-    if (usesegid) {
-      chainID = segID;
-    } else if ((chainID.compare("") == 0) && (segID.size() > 0) && (isalnum(segID[0]))) {
-      // use first character of segment name if no chain name is specified, a segment ID is specified, and the latter starts with an alphanumeric character
-      chainID = segID.substr(0, 1);
-    }
-
-    // create a new chain object, if necessary
-    if ((chainID.compare(lastchainID) != 0) || ter) {
-      chain = new Chain(chainID, segID);
-      this->appendChain(chain, uniqChainIDs);
-      // non-unique chains will be automatically renamed (unless the user specified not to rename chains), BUT we need to
-      // remember the name that was actually read, since this name is what will be used to determine when the next chain comes
-      if (verbose && chainID.compare(chain->getID())) {
-        MstUtils::warn("chain name '" + chainID + "' was repeated in '" + name + "', renaming the chain to '" + chain->getID() + "'", "Structure::readPDB");
-      }
+bool structureReader::pdbLine(const char* line, int len) {
+  if ((len >= 3) && (strncmp(line, "END", 3) == 0)) return false;
+  if ((len >= 3) && (strncmp(line, "TER", 3) == 0) && !ignoreTER) { ter = true; return true; }
+  bool isAtom = (len >= 4) && (strncmp(line, "ATOM", 4) == 0);
+  bool het = (len >= 6) && (strncmp(line, "HETATM", 6) == 0);
+  if ((skipHetero && !isAtom) || (!skipHetero && !isAtom && !het)) return true;
+
+  /* Now read atom record. Sometimes PDB lines are too short (if they do not contain some
+   * of the last optional columns). We don't want to read past the end of the line! */
+  char rec[81];
+  int n = min(len, 80);
+  memcpy(rec, line, n);
+  memset(rec + n, ' ', 80 - n);
+  atomRecord A;
+  A.index = recordInt(rec + 6, 5);
+  A.name = recordField(rec + 12, 4);
+  A.alt = rec[16];
+  A.resname = recordField(rec + 17, 4);
+  A.chainID = recordField(rec + 21, 1);
+  A.resnum = charmmFormat ? recordInt(rec + 23, 4) : recordInt(rec + 22, 4);
+  A.icode = charmmFormat ? ' ' : rec[26];
+  A.x = recordReal(rec + 30, 8);
+  A.y = recordReal(rec + 38, 8);
+  A.z = recordReal(rec + 46, 8);
+  A.segID = recordField(rec + 72, 4);
+  A.B = recordReal(rec + 60, 6, false);
+  A.occ = recordReal(rec + 54, 6, false);
+  A.het = het;
+
+  // use segment ID's instead of chain ID's?
+  if (usesegid) {
+    A.chainID = A.segID;
+  } else if (A.chainID.empty() && (A.segID.size() > 0) && (isalnum(A.segID[0]))) {
+    // use first character of segment name if no chain name is specified, a segment ID is specified, and the latter starts with an alphanumeric character
+    A.chainID = A.segID.substr(0, 1);
+  }
+  addAtom(A);
+  return true;
+}
 
-      // start to count residue numbers in this chain
-      lastresnum = -999999;
-      lastresname = "";
-      ter = false;
-    }
-
-    if (charmm19Format) {
-      if (resname.compare("HSE") == 0) resname = "HSD";   // neutral HIS, proton on ND1
-      if (resname.compare("HSD") == 0) resname = "HIS";   // neutral HIS, proton on NE2
-      if (resname.compare("HSC") == 0) resname = "HSP";   // doubley-protonated +1 HIS
-    }
-    // many PDB files in the Protein Data Bank call the delta carbon of isoleucine CD1, but
-    // the convention in basically all MM packages is to call it CD, since there is only one
-    if (fixIleCD1 && atomname.compare("CD1") == 0) atomname = "CD";
-
-    // if necessary, make a new residue
-    bool reallyNewAtom = true; // is this a truely new atom, as opposed to an alternative position?
-    if ((resnum != lastresnum) || resname.compare(lastresname) || (iCodesAsSepResidues && (icode.compare(lasticode))))  {
-      // this corresponds to a case, where the alternative location flag is being used to
-      // designate two (or more) different possible amino acids at a particular position
-      // (e.g., where the density is not clear to assign one). In this case, we shall keep
-      // only the first option, because we don't know any better.
-      if ((resnum == lastresnum) && resname.compare(lastresname) && (alt != lastalt)) {
-        continue;
-      }
-      residue = new Residue(resname, resnum, icode[0]);
-      chain->appendResidue(residue);
-    } else if (alt.compare(" ")) {
-      // if this is not a new residue AND the alternative location flag is specified,
-      // figure out if another location for this atom has already been given. If not,
-      // then treat this as the "primary" location, and whatever other locations
-      // are specified will be treated as alternatives.
-      Atom* a = residue->findAtom(atomname, false);
-      if (a) {
-        reallyNewAtom = false;
-        a->addAlternative(x, y, z, B, occ, alt[0]);
-      }
+void structureReader::addAtom(atomRecord& A) {
+  // create a new chain object, if necessary
+  if ((A.chainID.compare(lastchainID) != 0) || ter) {
+    chain = new Chain(A.chainID, A.segID);
+    S.appendChain(chain, uniqChainIDs);
+    // non-unique chains will be automatically renamed (unless the user specified not to rename chains), BUT we need to
+    // remember the name that was actually read, since this name is what will be used to determine when the next chain comes
+    if (verbose && A.chainID.compare(chain->getID())) {
+      MstUtils::warn("chain name '" + A.chainID + "' was repeated in '" + S.getName() + "', renaming the chain to '" + chain->getID() + "'", "Structure::readPDB");
+    }
+
+    // start to count residue numbers in this chain
+    lastresnum = -999999;
+    lastresname = "";
+    ter = false;
+  }
+
+  if (charmm19Format) {
+    if (A.resname.compare("HSE") == 0) A.resname = "HSD";   // neutral HIS, proton on ND1
+    if (A.resname.compare("HSD") == 0) A.resname = "HIS";   // neutral HIS, proton on NE2
+    if (A.resname.compare("HSC") == 0) A.resname = "HSP";   // doubley-protonated +1 HIS
+  }
+  // many PDB files in the Protein Data Bank call the delta carbon of isoleucine CD1, but
+  // the convention in basically all MM packages is to call it CD, since there is only one
+  if (fixIleCD1 && A.name.compare("CD1") == 0) A.name = "CD";
+
+  // if necessary, make a new residue
+  bool reallyNewAtom = true; // is this a truely new atom, as opposed to an alternative position?
+  if ((A.resnum != lastresnum) || A.resname.compare(lastresname) || (iCodesAsSepResidues && (A.icode != lasticode)))  {
+    // this corresponds to a case, where the alternative location flag is being used to
+    // designate two (or more) different possible amino acids at a particular position
+    // (e.g., where the density is not clear to assign one). In this case, we shall keep
+    // only the first option, because we don't know any better.
+    if ((A.resnum == lastresnum) && A.resname.compare(lastresname) && (A.alt != lastalt)) {
+      return;
+    }
+    residue = new Residue(A.resname, A.resnum, A.icode);
+    chain->appendResidue(residue);
+  } else if (A.alt != ' ') {
+    // if this is not a new residue AND the alternative location flag is specified,
+    // figure out if another location for this atom has already been given. If not,
+    // then treat this as the "primary" location, and whatever other locations
+    // are specified will be treated as alternatives.
+    Atom* a = residue->findAtom(A.name, false);
+    if (a) {
+      reallyNewAtom = false;
+      a->addAlternative(A.x, A.y, A.z, A.B, A.occ, A.alt);
+    }
+  }
+  // if necessary, make a new atom
+  if (reallyNewAtom) {
+    residue->appendAtom(new Atom(A.index, A.name, A.x, A.y, A.z, A.B, A.occ, A.het, A.alt));
+  }
+
+  // remember previous values for determining whether something interesting happens next
+  lastresnum = A.resnum;
+  lasticode = A.icode;
+  lastresname = A.resname;
+  lastchainID = A.chainID;
+  lastalt = A.alt;
+}
+
+int structureReader::cifColumn(const vector<string>& names) {
+  for (int i = 0; i < names.size(); i++) {
+    for (int j = 0; j < cifColumns.size(); j++) {
+      if (cifColumns[j] == names[i]) return j;
     }
-    // if necessary, make a new atom
-    if (reallyNewAtom) {
-      residue->appendAtom(new Atom(atominx, atomname, x, y, z, B, occ, het, alt[0]));
+  }
+  return -1;
+}
+
+bool structureReader::cifLine(const char* line, int len) {
+  while ((len > 0) && isBlank(line[len-1])) len--;
+  if ((len >= 11) && (strncmp(line, "_atom_site.", 11) == 0)) {
+    if (cifRows) { cifColumns.clear(); cifRows = false; }
+    cifColumns.push_back(string(line + 11, len - 11));
+    return true;
+  }
+  if (cifColumns.empty()) return true;
+  if ((len == 0) || (line[0] == '#') || (line[0] == '_') || ((len >= 5) && ((strncmp(line, "loop_", 5) == 0) || (strncmp(line, "data_", 5) == 0)))) {
+    // the atom_site table is over (there is only one per data block)
+    return !cifRows;
+  }
+  if (!cifRows) {
+    cifRows = true;
+    cGroup = cifColumn({"group_PDB"});
+    cIndex = cifColumn({"id"});
+    cName = cifColumn({"auth_atom_id", "label_atom_id"});
+    cAlt = cifColumn({"label_alt_id"});
+    cResname = cifColumn({"auth_comp_id", "label_comp_id"});
+    cChain = cifColumn({"auth_asym_id", "label_asym_id"});
+    cSeg = cifColumn({"label_asym_id"});
+    cResnum = cifColumn({"auth_seq_id", "label_seq_id"});
+    cIcode = cifColumn({"pdbx_PDB_ins_code"});
+    cX = cifColumn({"Cartn_x"}); cY = cifColumn({"Cartn_y"}); cZ = cifColumn({"Cartn_z"});
+    cOcc = cifColumn({"occupancy"});
+    cB = cifColumn({"B_iso_or_equiv"});
+    cModel = cifColumn({"pdbx_PDB_model_num"});
+    if ((cName < 0) || (cResname < 0) || (cChain < 0) || (cResnum < 0) || (cX < 0) || (cY < 0) || (cZ < 0)) {
+      MstUtils::error("atom_site table in '" + S.getName() + "' lacks some of the essential columns", "Structure::readCIF");
+    }
+  }
+
+  // split the row into tokens, which may be quoted
+  vector<pair<const char*, int> > tokens;
+  int i = 0;
+  while (i < len) {
+    while ((i < len) && isBlank(line[i])) i++;
+    if (i == len) break;
+    if ((line[i] == '\'') || (line[i] == '"')) {
+      char q = line[i]; int j = i + 1;
+      while ((j < len) && !((line[j] == q) && ((j + 1 == len) || isBlank(line[j+1])))) j++;
+      tokens.push_back(make_pair(line + i + 1, j - i - 1));
+      i = j + 1;
+    } else {
+      int j = i;
+      while ((j < len) && !isBlank(line[j])) j++;
+      tokens.push_back(make_pair(line + i, j - i));
+      i = j;
     }
+  }
+  if (tokens.size() != cifColumns.size()) MstUtils::error("unexpected number of fields in an atom_site row of '" + S.getName() + "': " + string(line, len), "Structure::readCIF");
+  return cifAtom(tokens);
+}
+
+bool structureReader::cifAtom(vector<pair<const char*, int> >& T) {
+  // only the first model is read (as with END in PDB files)
+  if (cModel >= 0) {
+    string model(T[cModel].first, T[cModel].second);
+    if (cifModel.empty()) cifModel = model;
+    else if (model != cifModel) return false;
+  }
+  bool het = (cGroup >= 0) && (T[cGroup].second == 6) && (strncmp(T[cGroup].first, "HETATM", 6) == 0);
+  if (skipHetero && het) return true;
+  // unknown (?) and inapplicable (.) values
+  auto given = [&T](int c) { return (c >= 0) && !((T[c].second == 1) && ((T[c].first[0] == '?') || (T[c].first[0] == '.'))); };
+
+  atomRecord A;
+  A.index = given(cIndex) ? recordInt(T[cIndex].first, T[cIndex].second) : 0;
+  A.name = string(T[cName].first, T[cName].second);
+  A.alt = given(cAlt) ? T[cAlt].first[0] : ' ';
+  A.resname = string(T[cResname].first, T[cResname].second);
+  // label_asym_id plays the role of the segment ID, but is only kept when chains are named by it
+  string seg = given(cSeg) ? string(T[cSeg].first, T[cSeg].second) : "";
+  A.segID = usesegid ? seg : "";
+  A.chainID = usesegid ? seg : string(T[cChain].first, T[cChain].second);
+  A.resnum = given(cResnum) ? recordInt(T[cResnum].first, T[cResnum].second) : 0;
+  A.icode = given(cIcode) ? T[cIcode].first[0] : ' ';
+  A.x = recordReal(T[cX].first, T[cX].second);
+  A.y = recordReal(T[cY].first, T[cY].second);
+  A.z = recordReal(T[cZ].first, T[cZ].second);
+  A.occ = given(cOcc) ? recordReal(T[cOcc].first, T[cOcc].second, false) : 1.0;
+  A.B = given(cB) ? recordReal(T[cB].first, T[cB].second, false) : 0.0;
+  A.het = het;
+
+  // a new entity instance (e.g., ligands or waters following a protein chain of the same
+  // author chain ID) is treated the way a TER record would be in a PDB file
+  if (!ignoreTER && (seg != lastSeg)) ter = true;
+  lastSeg = seg;
+  addAtom(A);
+  return true;
+}
+
+// calls f(line, length) on each line of the buffer, until it returns false
+template <class F>
+static void forEachLine(const string& buf, F f) {
+  const char* p = buf.data(); const char* e = p + buf.size();
+  while (p < e) {
+    const char* nl = (const char*) memchr(p, '\n', e - p);
+    if (nl == NULL) nl = e;
+    if (!f(p, (int) (nl - p))) break;
+    p = nl + 1;
+  }
+}
+
+static bool isCIFFile(string file) {
+  file = MstUtils::lc(file);
+  if ((file.size() > 3) && (file.compare(file.size() - 3, 3, ".gz") == 0)) file = file.substr(0, file.size() - 3);
+  return ((file.size() > 4) && (file.compare(file.size() - 4, 4, ".cif") == 0)) || ((file.size() > 6) && (file.compare(file.size() - 6, 6, ".mmcif") == 0));
+}
+
+void Structure::readPDB(const string& pdbFile, string options) {
+  if (isCIFFile(pdbFile)) { readCIF(pdbFile, options); return; }
+  name = pdbFile;
+  string buf; MstUtils::fileToString(pdbFile, buf, "Structure::readPDB");
+  structureReader reader(*this, options);
+  forEachLine(buf, [&reader](const char* line, int len) { return reader.pdbLine(line, len); });
+}
+
+void Structure::readPDB(istream& is, string options) {
+  structureReader reader(*this, options);
+  string line;
+  while (getline(is, line)) {
+    if (!reader.pdbLine(line.c_str(), line.size())) break;
+  }
+}
+
+void Structure::readCIF(const string& cifFile, string options) {
+  name = cifFile;
+  string buf; MstUtils::fileToString(cifFile, buf, "Structure::readCIF");
+  structureReader reader(*this, options);
+  forEachLine(buf, [&reader](const char* line, int len) { return reader.cifLine(line, len); });
+}
+
+void Structure::readCIF(istream& is, string options) {
+  structureReader reader(*this, options);
+  string line;
+  while (getline(is, line)) {
+    if (!reader.cifLine(line.c_str(), line.size())) break;
+  }
+}
 
-    // remember previous values for determining whether something interesting happens next
-    lastresnum = resnum;
-    lasticode = icode;
-    lastresname = resname;
-    lastchainID = chainID;
-    lastalt = alt;
+vector<Structure*> Structure::readMany(const vector<string>& files, int numThreads, string options, MstArena* _arena) {
+  vector<Structure*> structs(files.size(), NULL);
+  try {
+    MstUtils::parallelFor(files.size(), numThreads, [&](int i, int w) {
+      Structure* S = new Structure();
+      S->setArena(_arena);
+      S->readPDB(files[i], options);
+      structs[i] = S;
+    });
+  } catch (...) {
+    for (int i = 0; i < structs.size(); i++) delete structs[i];
+    throw;
   }
+  return structs;
 }
 
 void Structure::writePDB(const string& pdbFile, string options) const {
@@ -239,6 +648,13 @@ void Structure::writePDB(const string& pdbFile, string options) const {
 }
 
 void Structure::writePDB(ostream& ofs, string options) const {
+  vector<vector<Residue*> > residues(chainSize());
+  for (int ci = 0; ci < chainSize(); ci++) residues[ci] = (*this)[ci].getResidues();
+  writePDB(ofs, residues, options);
+}
+
+// writes the given residues, each inner list ending with TER as a chain would
+void Structure::writePDB(ostream& ofs, const vector<vector<Residue*> >& chains, string options) {
   options = MstUtils::uc(options);
 
 ///  my $chainstr = shift; // probably want to implement this eventually. Or maybe some more generic selection mechanism based on regular expressions applied onto full atom strings.
@@ -266,19 +682,19 @@ void Structure::writePDB(ostream& ofs, string options) const {
   if (charmm19Format && charmm22Format) MstUtils::error("CHARMM 19 and 22 formatting options cannot be specified together", "Structure::writePDB");
 
   int atomIndex = 0;
-  for (int ci = 0; ci < this->chainSize(); ci++) {
-    Chain& chain = (*this)[ci];
-    for (int ri = 0; ri < chain.residueSize(); ri++) {
-      Residue residue = chain[ri]; // NOTE: using a copy constructor here, in case residue details will be changed for formatting reasons upon writing
-      residue.setParent(&chain);   // by default, objects are copied as being disembodied (so as not to create inconsistent states)
+  for (int ci = 0; ci < chains.size(); ci++) {
+    const vector<Residue*>& chain = chains[ci];
+    for (int ri = 0; ri < chain.size(); ri++) {
+      Residue residue = *(chain[ri]);         // NOTE: using a copy constructor here, in case residue details will be changed for formatting reasons upon writing
+      residue.setParent(chain[ri]->getChain()); // by default, objects are copied as being disembodied (so as not to create inconsistent states)
       for (int ai = 0; ai < residue.atomSize(); ai++) {
         Atom& atom = residue[ai]; // NOTE: no need to copy atom, since residue copying does a deep copy
         atomIndex++;
         // dirty details of formating for MM purposes converting
         if (charmmFormat) {
           if (residue.isNamed("ILE") && atom.isNamed("CD1")) atom.setName("CD");
-          if (atom.isNamed("O") && (ri == chain.residueSize() - 1)) atom.setName("OT1");
-          if (atom.isNamed("OXT") && (ri == chain.residueSize() - 1)) atom.setName("OT2");
+          if (atom.isNamed("O") && (ri == chain.size() - 1)) atom.setName("OT1");
+          if (atom.isNamed("OXT") && (ri == chain.size() - 1)) atom.setName("OT2");
           if (residue.isNamed("HOH")) residue.setName("TIP3");
         }
         if (charmm19Format) {
@@ -315,23 +731,228 @@ void Structure::writePDB(ostream& ofs, string options) const {
         }
 
       }
-      if (!noter && (ri == chain.residueSize() - 1)) {
+      if (!noter && (ri == chain.size() - 1)) {
         ofs << "TER" << endl;
       }
     }
-    if (!noend && (ci == this->chainSize() - 1)) {
+    if (!noend && (ci == chains.size() - 1)) {
       ofs << "END" << endl;
     }
   }
 }
 
-void Structure::writeData(const string& dataFile) const {
+/* The compact (version 2) binary format. Names are interned into a dictionary
+ * that is written once, followed by flat per-chain, per-residue and per-atom
+ * tables and a single contiguous block of coordinates, so that reading takes
+ * one stream call per table rather than several per atom. Since the
+ * original format starts with a name and a chain count, a version-2 record
+ * is marked by an empty name followed by a negative count. */
+static const int compactDataVersion = 2;
+
+class nameDictionary {
+  public:
+    int index(const string& name) {
+      auto it = indices.find(name);
+      if (it != indices.end()) return it->second;
+      indices[name] = names.size();
+      names.push_back(name);
+      return names.size() - 1;
+    }
+    const string& operator[](int i) const { return names[i]; }
+    int size() const { return names.size(); }
+    void write(ostream& ofs) const;
+    void read(istream& ifs, const string& from);
+
+  private:
+    map<string, int> indices;
+    vector<string> names;
+};
+
+template <class T>
+static void writeBlock(ostream& ofs, const vector<T>& block) {
+  if (!block.empty()) ofs.write((const char*) block.data(), block.size() * sizeof(T));
+}
+
+template <class T>
+static void readBlock(istream& ifs, vector<T>& block, int n, const string& from) {
+  if (n < 0) MstUtils::error("malformed binary structure data", from);
+  block.resize(n);
+  if ((n > 0) && !ifs.read((char*) block.data(), n * sizeof(T))) MstUtils::error("truncated binary structure data", from);
+}
+
+void nameDictionary::write(ostream& ofs) const {
+  string block;
+  for (int i = 0; i < names.size(); i++) { block += names[i]; block += '\0'; }
+  MstUtils::writeBin(ofs, (int) names.size());
+  MstUtils::writeBin(ofs, (int) block.size());
+  ofs.write(block.data(), block.size());
+}
+
+void nameDictionary::read(istream& ifs, const string& from) {
+  int n, len;
+  MstUtils::readBin(ifs, n); MstUtils::readBin(ifs, len);
+  vector<char> block;
+  readBlock(ifs, block, len, from);
+  names.clear(); indices.clear();
+  for (int i = 0, start = 0; i < len; i++) {
+    if (block[i] == '\0') { names.push_back(string(block.data() + start, i - start)); start = i + 1; }
+  }
+  if (names.size() != n) MstUtils::error("malformed name dictionary in binary structure data", from);
+}
+
+// the per-atom tables of the compact format, for the given atoms
+class compactAtomTable {
+  public:
+    compactAtomTable() {}
+    compactAtomTable(const vector<Atom*>& atoms, nameDictionary& dict);
+    void write(ostream& ofs) const;
+    void read(istream& ifs, const string& from);
+    // makes the atoms, in order, given the dictionary their names are in
+    void build(vector<Atom*>& atoms, const nameDictionary& dict) const;
+
+  private:
+    vector<int> name, index, numAlt;
+    vector<char> alt, het, altID;
+    vector<mstreal> coor, altCoor; // x, y, z, occupancy and B-factor for each
+};
+
+compactAtomTable::compactAtomTable(const vector<Atom*>& atoms, nameDictionary& dict) {
+  int N = atoms.size();
+  name.resize(N); index.resize(N); numAlt.resize(N); alt.resize(N); het.resize(N); coor.resize(5*N);
+  for (int i = 0; i < N; i++) {
+    const Atom& a = *(atoms[i]);
+    name[i] = dict.index(a.getName());
+    index[i] = a.getIndex();
+    alt[i] = a.getAlt();
+    het[i] = a.isHetero();
+    numAlt[i] = a.numAlternatives();
+    mstreal* c = &coor[5*i];
+    c[0] = a.getX(); c[1] = a.getY(); c[2] = a.getZ(); c[3] = a.getOcc(); c[4] = a.getB();
+    for (int k = 0; k < numAlt[i]; k++) {
+      CartesianPoint ac = a.getAltCoor(k);
+      altCoor.push_back(ac.getX()); altCoor.push_back(ac.getY()); altCoor.push_back(ac.getZ());
+      altCoor.push_back(a.getAltOcc(k)); altCoor.push_back(a.getAltB(k));
+      altID.push_back(a.getAltLocID(k));
+    }
+  }
+}
+
+void compactAtomTable::write(ostream& ofs) const {
+  MstUtils::writeBin(ofs, (int) name.size());
+  MstUtils::writeBin(ofs, (int) altID.size());
+  writeBlock(ofs, name); writeBlock(ofs, index); writeBlock(ofs, numAlt);
+  writeBlock(ofs, alt); writeBlock(ofs, het);
+  writeBlock(ofs, coor);
+  writeBlock(ofs, altCoor); writeBlock(ofs, altID);
+}
+
+void compactAtomTable::read(istream& ifs, const string& from) {
+  int N, NA;
+  MstUtils::readBin(ifs, N); MstUtils::readBin(ifs, NA);
+  readBlock(ifs, name, N, from); readBlock(ifs, index, N, from); readBlock(ifs, numAlt, N, from);
+  readBlock(ifs, alt, N, from); readBlock(ifs, het, N, from);
+  readBlock(ifs, coor, 5*N, from);
+  readBlock(ifs, altCoor, 5*NA, from); readBlock(ifs, altID, NA, from);
+}
+
+void compactAtomTable::build(vector<Atom*>& atoms, const nameDictionary& dict) const {
+  atoms.resize(name.size());
+  for (int i = 0, ai = 0; i < name.size(); i++) {
+    if ((name[i] < 0) || (name[i] >= dict.size()) || (numAlt[i] < 0) || (ai + numAlt[i] > altID.size())) {
+      for (int j = 0; j < i; j++) delete atoms[j];
+      MstUtils::error("malformed atom table in binary structure data", "compactAtomTable::build");
+    }
+    const mstreal* c = &coor[5*i];
+    atoms[i] = new Atom(index[i], dict[name[i]], c[0], c[1], c[2], c[4], c[3], (bool) het[i], alt[i]);
+    for (int k = 0; k < numAlt[i]; k++, ai++) {
+      const mstreal* ac = &altCoor[5*ai];
+      atoms[i]->addAlternative(ac[0], ac[1], ac[2], ac[4], ac[3], altID[ai]);
+    }
+  }
+}
+
+static void writeCompactStructure(const Structure& S, ostream& ofs) {
+  nameDictionary dict;
+  vector<int> chainID, segID, chainLen, resName, resNum, resLen;
+  vector<char> icode;
+  vector<Atom*> atoms;
+  for (int i = 0; i < S.chainSize(); i++) {
+    Chain& chain = S.getChain(i);
+    chainID.push_back(dict.index(chain.getID()));
+    segID.push_back(dict.index(chain.getSegID()));
+    chainLen.push_back(chain.residueSize());
+    for (int j = 0; j < chain.residueSize(); j++) {
+      Residue& res = chain[j];
+      resName.push_back(dict.index(res.getName()));
+      resNum.push_back(res.getNum());
+      icode.push_back(res.getIcode());
+      resLen.push_back(res.atomSize());
+      for (int k = 0; k < res.atomSize(); k++) atoms.push_back(&(res[k]));
+    }
+  }
+  compactAtomTable atomTable(atoms, dict);
+
+  MstUtils::writeBin(ofs, '\0');
+  MstUtils::writeBin(ofs, -compactDataVersion);
+  MstUtils::writeBin(ofs, S.getName());
+  MstUtils::writeBin(ofs, (int) chainID.size());
+  MstUtils::writeBin(ofs, (int) resName.size());
+  dict.write(ofs);
+  writeBlock(ofs, chainID); writeBlock(ofs, segID); writeBlock(ofs, chainLen);
+  writeBlock(ofs, resName); writeBlock(ofs, resNum); writeBlock(ofs, icode); writeBlock(ofs, resLen);
+  atomTable.write(ofs);
+}
+
+static void readCompactStructure(Structure& S, istream& ifs) {
+  string from = "Structure::readData(istream&)";
+  string name; MstUtils::readBin(ifs, name);
+  S.setName(name);
+  int nC, nR;
+  MstUtils::readBin(ifs, nC); MstUtils::readBin(ifs, nR);
+  nameDictionary dict; dict.read(ifs, from);
+  vector<int> chainID, segID, chainLen, resName, resNum, resLen;
+  vector<char> icode;
+  readBlock(ifs, chainID, nC, from); readBlock(ifs, segID, nC, from); readBlock(ifs, chainLen, nC, from);
+  readBlock(ifs, resName, nR, from); readBlock(ifs, resNum, nR, from); readBlock(ifs, icode, nR, from); readBlock(ifs, resLen, nR, from);
+  compactAtomTable atomTable; atomTable.read(ifs, from);
+
+  // check that the tables are consistent before creating anything
+  long totR = 0, totA = 0;
+  for (int i = 0; i < nC; i++) {
+    if ((chainLen[i] < 0) || (chainID[i] < 0) || (chainID[i] >= dict.size()) || (segID[i] < 0) || (segID[i] >= dict.size())) MstUtils::error("malformed chain table in binary structure data", from);
+    totR += chainLen[i];
+  }
+  for (int j = 0; j < nR; j++) {
+    if ((resLen[j] < 0) || (resName[j] < 0) || (resName[j] >= dict.size())) MstUtils::error("malformed residue table in binary structure data", from);
+    totA += resLen[j];
+  }
+  vector<Atom*> atoms;
+  atomTable.build(atoms, dict);
+  if ((totR != nR) || (totA != atoms.size())) {
+    for (int k = 0; k < atoms.size(); k++) delete atoms[k];
+    MstUtils::error("inconsistent tables in binary structure data", from);
+  }
+
+  for (int i = 0, ri = 0, ai = 0; i < nC; i++) {
+    Chain* chain = new Chain(dict[chainID[i]], dict[segID[i]]);
+    S.appendChain(chain);
+    for (int j = 0; j < chainLen[i]; j++, ri++) {
+      Residue* residue = new Residue(dict[resName[ri]], resNum[ri], icode[ri]);
+      chain->appendResidue(residue);
+      for (int k = 0; k < resLen[ri]; k++, ai++) residue->appendAtom(atoms[ai]);
+    }
+  }
+}
+
+void Structure::writeData(const string& dataFile, int version) const {
   ofstream ofs; MstUtils::openFile(ofs, dataFile, fstream::out | fstream::binary, "Structure::writeData(const string&)");
-  writeData(ofs);
+  writeData(ofs, version);
   ofs.close();
 }
 
-void Structure::writeData(ostream& ofs) const {
+void Structure::writeData(ostream& ofs, int version) const {
+  if (version == compactDataVersion) { writeCompactStructure(*this, ofs); return; }
+  if (version != 1) MstUtils::error("unknown binary format version " + MstUtils::toString(version), "Structure::writeData(ostream&)");
   char ter = '\0';
   ofs << getName() << ter;
   MstUtils::writeBin(ofs, chainSize());
@@ -376,6 +997,7 @@ void Structure::readData(const string& dataFile) {
 }
 
 void Structure::readData(istream& ifs) {
+  MstArena::Scope scope(arena ? arena : MstArena::current());
   char ter = '\0';
   getline(ifs, name, '\0');
   string resname, atomname;
@@ -385,6 +1007,11 @@ void Structure::readData(istream& ifs) {
   char het;
 
   MstUtils::readBin(ifs, nC);
+  if (name.empty() && (nC < 0)) {
+    if (nC != -compactDataVersion) MstUtils::error("unknown binary format version " + MstUtils::toString(-nC), "Structure::readData(istream&)");
+    readCompactStructure(*this, ifs);
+    return;
+  }
   for (int i = 0; i < nC; i++) {
     string chainID, segID;
     getline(ifs, chainID, '\0'); getline(ifs, segID, '\0');
@@ -450,10 +1077,12 @@ bool Structure::appendChain(Chain* C, bool allowRename) {
   C->setParent(this);
   numAtoms += C->atomSize();
   numResidues += C->residueSize();
+  bbCache.valid = false;
   return cidUnique;
 }
 
 Chain* Structure::appendChain(string cid, bool allowRename) {
+  MstArena::Scope scope(arena ? arena : MstArena::current());
   Chain* newChain = new Chain(cid, cid);
   this->appendChain(newChain, allowRename);
   return newChain;
@@ -470,6 +1099,7 @@ void Structure::deleteChain(Chain* chain) {
   chains.erase(chains.begin() + i);
   numResidues -= chain->residueSize();
   numAtoms -= chain->atomSize();
+  bbCache.valid = false;
   if (chainsByID.find(chain->getID()) != chainsByID.end()) chainsByID.erase(chain->getID());
   if (chainsBySegID.find(chain->getSegID()) != chainsBySegID.end()) chainsBySegID.erase(chain->getSegID());
   delete chain;
@@ -571,6 +1201,7 @@ void Structure::reassignChainsByConnectivity(Structure& dest, mstreal maxPeptide
 void Structure::addAtom(Atom* A) {
   if ((A->getParent() == NULL) || (A->getParent()->getParent() == NULL)) MstUtils::error("cannot add a disembodied Atom", "Structure::addAtom");
   Residue* oldResidue = A->getParent();
+  MstArena::Scope scope(arena ? arena : MstArena::current());
   Chain* oldChain = oldResidue->getParent();
   Chain* newChain; Residue* newResidue; Atom* newAtom;
 
@@ -600,6 +1231,7 @@ void Structure::addAtoms(vector<Atom*>* atoms) {
 Residue* Structure::addResidue(Residue* res) {
   if (res->getParent() == NULL) MstUtils::error("cannot add a disembodied Residue", "Structure::addResidue");
   Chain* oldChain = res->getParent();
+  MstArena::Scope scope(arena ? arena : MstArena::current());
 
   // is there a chain matching the Residue's parent chain? If not, create one.
   Chain* newChain = getChainByID(oldChain->getID());
@@ -635,6 +1267,172 @@ int Structure::getResidueIndex(Residue* res) {
   return n;
 }
 
+void Structure::cacheBackbone() {
+  if (bbCache.valid) return;
+  int N = residueSize();
+  bbCache.atoms.assign(4*N, NULL);
+  bbCache.prev.assign(N, -1);
+  bbCache.next.assign(N, -1);
+  bbCache.index.clear();
+  bbCache.index.reserve(N);
+  static const int idN = MstNames::intern("N"), idCA = MstNames::intern("CA"), idC = MstNames::intern("C"), idO = MstNames::intern("O");
+  for (int ci = 0, ri = 0; ci < chainSize(); ci++) {
+    Chain& C = getChain(ci);
+    for (int k = 0; k < C.residueSize(); k++, ri++) {
+      Residue& R = C[k];
+      bbCache.index[&R] = ri;
+      bbCache.atoms[4*ri + backboneCache::N] = R.findAtom(idN, false);
+      bbCache.atoms[4*ri + backboneCache::CA] = R.findAtom(idCA, false);
+      bbCache.atoms[4*ri + backboneCache::C] = R.findAtom(idC, false);
+      bbCache.atoms[4*ri + backboneCache::O] = R.findAtom(idO, false);
+      if (k > 0) bbCache.prev[ri] = ri - 1;
+      if (k < C.residueSize() - 1) bbCache.next[ri] = ri + 1;
+    }
+  }
+  bbCache.valid = true;
+}
+
+void Structure::clearBackboneCache() {
+  bbCache = backboneCache();
+}
+
+void Structure::backboneDihedrals(vector<mstreal>& phi, vector<mstreal>& psi, vector<mstreal>& omega) {
+  cacheBackbone();
+  int N = residueSize();
+  phi.assign(N, Residue::badDihedral); psi.assign(N, Residue::badDihedral); omega.assign(N, Residue::badDihedral);
+  auto dihedral = [](Atom* A, Atom* B, Atom* C, Atom* D) {
+    if ((A == NULL) || (B == NULL) || (C == NULL) || (D == NULL)) return Residue::badDihedral;
+    return CartesianGeometry::dihedral(Point3(A), Point3(B), Point3(C), Point3(D));
+  };
+  const backboneCache& bb = bbCache;
+  for (int i = 0; i < N; i++) {
+    int p = bb.prev[i], n = bb.next[i];
+    if (p >= 0) {
+      phi[i] = dihedral(bb.atom(p, backboneCache::C), bb.atom(i, backboneCache::N), bb.atom(i, backboneCache::CA), bb.atom(i, backboneCache::C));
+      omega[i] = dihedral(bb.atom(p, backboneCache::CA), bb.atom(p, backboneCache::C), bb.atom(i, backboneCache::N), bb.atom(i, backboneCache::CA));
+    }
+    if (n >= 0) psi[i] = dihedral(bb.atom(i, backboneCache::N), bb.atom(i, backboneCache::CA), bb.atom(i, backboneCache::C), bb.atom(n, backboneCache::N));
+  }
+}
+
+/* --------- StructureView --------- */
+void StructureView::addResidue(int ri, bool newSegment) {
+  if (parent == NULL) MstUtils::error("view has no parent structure", "StructureView::addResidue");
+  if ((ri < 0) || (ri >= parent->residueSize())) MstUtils::error("residue index " + MstUtils::toString(ri) + " out of range for the parent structure", "StructureView::addResidue");
+  int last = segStart.empty() ? -1 : segStart.back() + chainResidueSize(chainSize() - 1) - 1;
+  if (newSegment || (last < 0) || (ri != last + 1) || (parent->getResidue(ri).getChain() != parent->getResidue(last).getChain())) {
+    segStart.push_back(ri);
+    segOff.push_back(segOff.back());
+  }
+  segOff.back()++;
+}
+
+void StructureView::addSegment(int first, int last) {
+  if (parent == NULL) MstUtils::error("view has no parent structure", "StructureView::addSegment");
+  if ((first < 0) || (last < first) || (last >= parent->residueSize())) MstUtils::error("residue range [" + MstUtils::toString(first) + ", " + MstUtils::toString(last) + "] invalid for the parent structure", "StructureView::addSegment");
+  segStart.push_back(first);
+  segOff.push_back(segOff.back() + last - first + 1);
+}
+
+int StructureView::atomSize() const {
+  int n = 0;
+  for (int s = 0; s < chainSize(); s++) {
+    for (Residue* res : getChainResidues(s)) n += res->atomSize();
+  }
+  return n;
+}
+
+Residue& StructureView::getResidue(int i) const {
+  if ((i < 0) || (i >= residueSize())) MstUtils::error("residue index " + MstUtils::toString(i) + " out of range for view", "StructureView::getResidue");
+  return parent->getResidue(parentIndex(i));
+}
+
+vector<Residue*> StructureView::getChainResidues(int s) const {
+  // walk the parent's chains from the first residue of the segment
+  vector<Residue*> residues(chainResidueSize(s));
+  Residue* res = &(parent->getResidue(segStart[s]));
+  Chain* C = res->getChain();
+  int ci = C->getIndex(), ri = res->getResidueIndexInChain();
+  for (int k = 0; k < residues.size(); k++, ri++) {
+    while (ri >= C->residueSize()) { C = &((*parent)[++ci]); ri = 0; }
+    residues[k] = &((*C)[ri]);
+  }
+  return residues;
+}
+
+vector<Residue*> StructureView::getResidues() const {
+  vector<Residue*> residues;
+  residues.reserve(residueSize());
+  for (int s = 0; s < chainSize(); s++) {
+    vector<Residue*> seg = getChainResidues(s);
+    residues.insert(residues.end(), seg.begin(), seg.end());
+  }
+  return residues;
+}
+
+vector<Atom*> StructureView::getAtoms() const {
+  vector<Atom*> atoms;
+  for (int s = 0; s < chainSize(); s++) {
+    for (Residue* res : getChainResidues(s)) {
+      for (int ai = 0; ai < res->atomSize(); ai++) atoms.push_back(&((*res)[ai]));
+    }
+  }
+  return atoms;
+}
+
+StructureView StructureView::reassignChainsByConnectivity(mstreal maxPeptideBond) const {
+  StructureView V(*parent);
+  vector<Residue*> residues = getResidues();
+  for (int i = 0; i < residues.size(); i++) {
+    bool broken = false;
+    if (i > 0) {
+      Atom* atomC = residues[i - 1]->findAtom("C", true);
+      Atom* atomN = residues[i]->findAtom("N", true);
+      if ((atomC == NULL) || (atomN == NULL)) MstUtils::error("cannot break into disjoint segments as some C or N backbone atoms are missing", "StructureView::reassignChainsByConnectivity");
+      broken = (atomC->distance(atomN) > maxPeptideBond);
+    }
+    // as in Structure::reassignChainsByConnectivity, chains of the parent do
+    // not matter; but a segment can only continue with the next parent residue
+    if ((i == 0) || broken || (parentIndex(i) != parentIndex(i - 1) + 1)) V.addSegment(parentIndex(i), parentIndex(i));
+    else V.segOff.back()++;
+  }
+  return V;
+}
+
+void StructureView::appendTo(Structure& S, const string& chainID) const {
+  for (int s = 0; s < chainSize(); s++) {
+    vector<Residue*> residues = getChainResidues(s);
+    Chain* C;
+    if (chainID.empty()) {
+      const Chain* P = residues[0]->getChain();
+      C = new Chain(P->getID(), P->getSegID());
+      S.appendChain(C, true);
+    } else {
+      C = S.appendChain(chainID, true);
+    }
+    for (Residue* res : residues) C->appendResidue(new Residue(*res));
+  }
+}
+
+Structure StructureView::toStructure(const string& chainID) const {
+  Structure S;
+  if (parent != NULL) S.setName(parent->getName());
+  appendTo(S, chainID);
+  return S;
+}
+
+void StructureView::writePDB(const string& pdbFile, string options) const {
+  fstream ofs; MstUtils::openFile(ofs, pdbFile, fstream::out, "StructureView::writePDB(string, string)");
+  writePDB(ofs, options);
+  ofs.close();
+}
+
+void StructureView::writePDB(ostream& ofs, string options) const {
+  vector<vector<Residue*> > residues(chainSize());
+  for (int s = 0; s < chainSize(); s++) residues[s] = getChainResidues(s);
+  Structure::writePDB(ofs, residues, options);
+}
+
 /* --------- Chain --------- */
 Chain::Chain() {
   numAtoms = 0;
@@ -773,7 +1571,7 @@ Residue* Chain::findResidue(string resname, int resnum, char icode) {
 const mstreal Residue::badDihedral = 999.0;
 
 Residue::Residue() {
-  resname = "UNK";
+  resnameID = MstNames::intern("UNK");
   resnum = 1;
   parent = NULL;
   icode = ' ';
@@ -786,12 +1584,12 @@ Residue::Residue(const Residue& R, bool copyAlt) {
     atoms.back()->setParent(this);
   }
   resnum = R.resnum;
-  resname = R.resname;
+  resnameID = R.resnameID;
   icode = R.icode;
 }
 
 Residue::Residue(string _resname, int _resnum, char _icode) {
-  resname = _resname;
+  resnameID = MstNames::intern(_resname);
   resnum = _resnum;
   parent = NULL;
   icode = _icode;
@@ -915,52 +1713,84 @@ Residue* Residue::previousResidue() {
   return iPlusDelta(-1);
 }
 
+const Structure::backboneCache* Residue::cachedBackbone() const {
+  Structure* S = getStructure();
+  return ((S != NULL) && S->bbCache.valid) ? &(S->bbCache) : NULL;
+}
+
 // C- N  CA  C
 mstreal Residue::getPhi(bool strict) {
-  Residue* res1 = previousResidue();
-  if (res1 == NULL) return badDihedral;
-  Atom* A = res1->findAtom("C", false);
-  Atom* B = findAtom("N", false);
-  Atom* C = findAtom("CA", false);
-  Atom* D = findAtom("C", false);
+  typedef Structure::backboneCache BB;
+  Atom *A, *B, *C, *D;
+  const BB* bb = cachedBackbone();
+  if (bb != NULL) {
+    int i = bb->index.at(this), j = bb->prev[i];
+    if (j < 0) return badDihedral;
+    A = bb->atom(j, BB::C); B = bb->atom(i, BB::N); C = bb->atom(i, BB::CA); D = bb->atom(i, BB::C);
+  } else {
+    Residue* res1 = previousResidue();
+    if (res1 == NULL) return badDihedral;
+    A = res1->findAtom("C", false);
+    B = findAtom("N", false);
+    C = findAtom("CA", false);
+    D = findAtom("C", false);
+  }
   if ((A == NULL) || (B == NULL) || (C == NULL) || (D == NULL)) {
     if (strict) MstUtils::error("not all backbone atoms present to compute PHI for residue " + MstUtils::toString(*this), "Residue::getPhi");
     return badDihedral;
   }
 
-  return CartesianGeometry::dihedral(*A, *B, *C, *D);
+  return CartesianGeometry::dihedral(Point3(A), Point3(B), Point3(C), Point3(D));
 }
 
 // N  CA  C  N+
 mstreal Residue::getPsi(bool strict) {
-  Residue* res1 = nextResidue();
-  if (res1 == NULL) return badDihedral;
-  Atom* A = findAtom("N", false);
-  Atom* B = findAtom("CA", false);
-  Atom* C = findAtom("C", false);
-  Atom* D = res1->findAtom("N", false);
+  typedef Structure::backboneCache BB;
+  Atom *A, *B, *C, *D;
+  const BB* bb = cachedBackbone();
+  if (bb != NULL) {
+    int i = bb->index.at(this), j = bb->next[i];
+    if (j < 0) return badDihedral;
+    A = bb->atom(i, BB::N); B = bb->atom(i, BB::CA); C = bb->atom(i, BB::C); D = bb->atom(j, BB::N);
+  } else {
+    Residue* res1 = nextResidue();
+    if (res1 == NULL) return badDihedral;
+    A = findAtom("N", false);
+    B = findAtom("CA", false);
+    C = findAtom("C", false);
+    D = res1->findAtom("N", false);
+  }
   if ((A == NULL) || (B == NULL) || (C == NULL) || (D == NULL)) {
     if (strict) MstUtils::error("not all backbone atoms present to compute PSI for residue " + MstUtils::toString(*this), "Residue::getPsi");
     return badDihedral;
   }
 
-  return CartesianGeometry::dihedral(*A, *B, *C, *D);
+  return CartesianGeometry::dihedral(Point3(A), Point3(B), Point3(C), Point3(D));
 }
 
 // CA-  C-  N  CA
 mstreal Residue::getOmega(bool strict) {
-  Residue* res1 = previousResidue();
-  if (res1 == NULL) return badDihedral;
-  Atom* A = res1->findAtom("CA", false);
-  Atom* B = res1->findAtom("C", false);
-  Atom* C = findAtom("N", false);
-  Atom* D = findAtom("CA", false);
+  typedef Structure::backboneCache BB;
+  Atom *A, *B, *C, *D;
+  const BB* bb = cachedBackbone();
+  if (bb != NULL) {
+    int i = bb->index.at(this), j = bb->prev[i];
+    if (j < 0) return badDihedral;
+    A = bb->atom(j, BB::CA); B = bb->atom(j, BB::C); C = bb->atom(i, BB::N); D = bb->atom(i, BB::CA);
+  } else {
+    Residue* res1 = previousResidue();
+    if (res1 == NULL) return badDihedral;
+    A = res1->findAtom("CA", false);
+    B = res1->findAtom("C", false);
+    C = findAtom("N", false);
+    D = findAtom("CA", false);
+  }
   if ((A == NULL) || (B == NULL) || (C == NULL) || (D == NULL)) {
     if (strict) MstUtils::error("not all backbone atoms present to compute OMEGA for residue " + MstUtils::toString(*this), "Residue::getOmega");
     return badDihedral;
   }
 
-  return CartesianGeometry::dihedral(*A, *B, *C, *D);
+  return CartesianGeometry::dihedral(Point3(A), Point3(B), Point3(C), Point3(D));
 }
 
 bool Residue::areBonded(const Residue& resN, const Residue& resC, mstreal maxPeptideBond) {
@@ -979,6 +1809,14 @@ Atom* Residue::findAtom(string _name, bool strict) const {
   return NULL;
 }
 
+Atom* Residue::findAtom(int _nameID, bool strict) const {
+  for (int i = 0; i < atoms.size(); i++) {
+    if (atoms[i]->isNamed(_nameID)) return atoms[i];
+  }
+  if (strict) MstUtils::error("could not find atom named '" + string(MstNames::name(_nameID)) + "' in residue " + MstUtils::toString(*this), "Residue::findAtom");
+  return NULL;
+}
+
 string Residue::getChainID(bool strict) {
   if (parent == NULL) {
     if (strict) MstUtils::error("residue has no parent", "Residue::getChainID");
@@ -1021,7 +1859,7 @@ int Residue::getResidueIndexInChain() const {
 Atom::atomInfo::atomInfo() {
   parent = NULL;
   het = false;
-  name = MstUtils::copyStringC("UNK");
+  setName("UNK");
   alternatives = NULL;
   alt = ' ';
   index = 0;
@@ -1030,8 +1868,7 @@ Atom::atomInfo::atomInfo() {
 
 Atom::atomInfo::atomInfo(const atomInfo& other, bool copyAlt) {
   index = other.index;
-  name = NULL;
-  setName(other.name);
+  nameID = other.nameID;
   B = other.B;
   occ = other.occ;
   het = other.het;
@@ -1049,7 +1886,6 @@ Atom::atomInfo::atomInfo(const atomInfo& other, bool copyAlt) {
 
 Atom::atomInfo::atomInfo(int _index, const string& _name, mstreal _B, mstreal _occ, bool _het, char _alt, Residue* _parent) {
   index = _index;
-  name = NULL;
   setName(_name);
   B = _B;
   occ = _occ;
@@ -1060,7 +1896,6 @@ Atom::atomInfo::atomInfo(int _index, const string& _name, mstreal _B, mstreal _o
 }
 
 Atom::atomInfo::~atomInfo() {
-  if (name != NULL) delete[] name;
   if (alternatives != NULL) delete alternatives;
 }
 
@@ -1120,12 +1955,6 @@ CartesianPoint Atom::getCoor() const {
   CartesianPoint coor(x, y, z); return coor;
 }
 
-void Atom::atomInfo::setName(const char* _name) {
-  if (name != NULL) delete[] name;
-  name = new char[strlen(_name)+1];
-  strcpy(name, _name);
-}
-
 CartesianPoint Atom::atomInfo::getAltCoor(int altInd) const {
   if ((alternatives == NULL) || (altInd >= alternatives->size()) || (altInd < 0)) MstUtils::error("alternative index " + MstUtils::toString(altInd) + " out of bounds (" + MstUtils::toString(alternatives->size()) + " alternatives available)", "Atom::getAltCoor");
   altInfo& targ = (*alternatives)[altInd];
@@ -1200,7 +2029,7 @@ void Atom::atomInfo::addAlternative(mstreal _x, mstreal _y, mstreal _z, mstreal
   if (alternatives == NULL) {
     alternatives = new vector<altInfo>(0);
   }
-  alternatives->push_back(altInfo(_x, _y, _z, _B, _occ, _alt));
+  alternatives->push_back(altInfo(_x, _y, _z, _occ, _B, _alt));
 }
 
 void Atom::atomInfo::removeLastAlternative() {
@@ -1258,32 +2087,37 @@ mstreal Atom::distance2(const Atom& another) const {
 }
 
 mstreal Atom::angle(const Atom& A, const Atom& B, bool radians) const {
-  return CartesianGeometry::angle(*this, A, B, radians);
+  return CartesianGeometry::angle(Point3(*this), Point3(A), Point3(B), radians);
 }
 
 mstreal Atom::angle(const Atom* A, const Atom* B, bool radians) const {
-  return CartesianGeometry::angle(this, A, B, radians);
+  return CartesianGeometry::angle(Point3(this), Point3(A), Point3(B), radians);
 }
 
 mstreal Atom::dihedral(const Atom& A, const Atom& B, const Atom& C, bool radians) const {
-  return CartesianGeometry::dihedral(*this, A, B, C, radians);
+  return CartesianGeometry::dihedral(Point3(*this), Point3(A), Point3(B), Point3(C), radians);
 }
 
 mstreal Atom::dihedral(const Atom* A, const Atom* B, const Atom* C, bool radians) const {
-  return CartesianGeometry::dihedral(this, A, B, C, radians);
+  return CartesianGeometry::dihedral(Point3(this), Point3(A), Point3(B), Point3(C), radians);
 }
 
 bool Atom::build(const Atom& diA, const Atom& anA, const Atom& thA, mstreal di, mstreal an, mstreal th, bool radians) {
-  if (!radians) {
-    an *= M_PI/180;
-    th *= M_PI/180;
-  }
+  return build(diA, anA, thA, di, an, th, NULL, NULL, radians);
+}
 
-  // unit vector from diA to anA (B - C)
-  CartesianPoint uCB = ((CartesianPoint) diA - (CartesianPoint) anA).getUnit();
+bool Atom::build(const Atom& diA, const Atom& anA, const Atom& thA, mstreal di, mstreal an, mstreal th, mstreal* icPartials, mstreal* xyzPartials, bool radians) {
+  mstreal s = radians ? 1.0 : M_PI/180;
+  an *= s;
+  th *= s;
+
+  // vector and unit vector from anA to diA (B - C)
+  Point3 dCB = Point3(diA) - Point3(anA);
+  mstreal lCB = dCB.norm();
+  Point3 uCB = dCB/lCB;
 
   // vector from anA to thA (C - D)
-  CartesianPoint dDC = (CartesianPoint) anA - (CartesianPoint) thA;
+  Point3 dDC = Point3(anA) - Point3(thA);
 
   mstreal an2 = M_PI - an;
   mstreal th2 = M_PI + th;
@@ -1292,18 +2126,62 @@ bool Atom::build(const Atom& diA, const Atom& anA, const Atom& thA, mstreal di,
   mstreal rsinsin = rsin * sin(th2);
   mstreal rsincos = rsin * cos(th2);
 
-  CartesianPoint c1 = uCB.cross(dDC);
+  Point3 c1 = uCB.cross(dDC);
+  mstreal lc1 = c1.norm();
 
   // when the first three atoms of the dihedral are co-linear, can't interpret
   // the dihedral angle, so just place the atom di distance away from diA, but
   // along some arbitrary direction
-  if (c1.norm() < 0.00000001) { setCoor(diA.getCoor() + CartesianPoint(di, 0, 0)); return false; }
-  c1 *= rsinsin / c1.norm();
-  CartesianPoint c2 = (-uCB * dDC.dot(uCB) + dDC).getUnit() * rsincos;
-  CartesianPoint dd = uCB * rcos + c1 + c2;
+  if (lc1 < 0.00000001) {
+    setCoor(diA.getX() + di, diA.getY(), diA.getZ());
+    if (icPartials != NULL) { std::fill(icPartials, icPartials + 9, 0.0); icPartials[0] = 1; }
+    if (xyzPartials != NULL) {
+      std::fill(xyzPartials, xyzPartials + 27, 0.0);
+      for (int d = 0; d < 3; d++) xyzPartials[3*d + d] = 1;
+    }
+    return false;
+  }
+
+  // the frame in which the atom is placed: uCB, m (in the plane with thA), and
+  // n (normal to that plane)
+  Point3 n = c1 / lc1;
+  Point3 m = (-uCB * dDC.dot(uCB) + dDC).getUnit();
+  Point3 dd = Point3(diA) + uCB * rcos + n * rsinsin + m * rsincos;
+  Point3 q = dd - Point3(diA); // placed atom relative to diA
 
   // set coordinate of placed atom
-  setCoor(diA.getCoor() + dd);
+  setCoor(dd[0], dd[1], dd[2]);
+
+  if (icPartials != NULL) {
+    // the placed atom, in the frame (uCB, m, n), is at di * (-cos(an), -sin(an)*cos(th), -sin(an)*sin(th))
+    Point3 dDi = q / di;
+    Point3 dAn = (uCB * sin(an) - m * (cos(an) * cos(th)) - n * (cos(an) * sin(th))) * (di * s);
+    Point3 dTh = (m * (sin(an) * sin(th)) - n * (sin(an) * cos(th))) * (di * s);
+    for (int d = 0; d < 3; d++) {
+      icPartials[3*d] = dDi[d];
+      icPartials[3*d + 1] = dAn[d];
+      icPartials[3*d + 2] = dTh[d];
+    }
+  }
+
+  if (xyzPartials != NULL) {
+    // moving any of the three reference atoms rotates the frame by some small
+    // angle w (and moving diA also translates it), so the placed atom moves by
+    // w x q. For a unit step along the j-th coordinate of each reference atom,
+    // w has the following components along uCB (a), m (b), and n (c).
+    mstreal ud = uCB.dot(dDC);
+    for (int j = 0; j < 3; j++) {
+      mstreal nb = n[j]/lCB, mb = m[j]/lCB;
+      mstreal a[3] = {-ud*nb/lc1, n[j]/lc1 + ud*nb/lc1, -n[j]/lc1};
+      mstreal b[3] = {-nb, nb, 0};
+      mstreal c[3] = {mb, -mb, 0};
+      for (int r = 0; r < 3; r++) {
+        Point3 dP = (uCB * a[r] + m * b[r] + n * c[r]).cross(q);
+        if (r == 0) dP[j] += 1;
+        for (int d = 0; d < 3; d++) xyzPartials[9*r + 3*d + j] = dP[d];
+      }
+    }
+  }
   return true;
 }
 
@@ -1382,9 +2260,9 @@ void AtomPointerVector::push_back(const vector<Atom*>& atoms) {
 }
 
 CartesianPoint AtomPointerVector::getGeometricCenter() {
-  CartesianPoint C(3, 0);
+  Point3 C;
   for (int i = 0; i < this->size(); i++) {
-    C += CartesianPoint(*((*this)[i]));
+    C += Point3((*this)[i]);
   }
   C /= this->size();
   return C;
@@ -1401,7 +2279,7 @@ void AtomPointerVector::getGeometricCenter(mstreal& xc, mstreal& yc, mstreal& zc
 }
 
 void AtomPointerVector::center() {
-  CartesianPoint C = getGeometricCenter();
+  Point3 C(getGeometricCenter());
   for (int i = 0; i < this->size(); i++) {
     Atom& a = *((*this)[i]);
     for (int k = 0; k < 3; k++) a[k] -= C[k];
@@ -1409,19 +2287,19 @@ void AtomPointerVector::center() {
 }
 
 mstreal AtomPointerVector::radiusOfGyration() {
-  CartesianPoint center = getGeometricCenter();
+  Point3 center(getGeometricCenter());
   mstreal s = 0;
   for (int i = 0; i < size(); i++) {
-    s += CartesianPoint((*this)[i]).distance2(center);
+    s += Point3((*this)[i]).distance2(center);
   }
   return sqrt(s / size());
 }
 
 mstreal AtomPointerVector::boundingSphereRadiusCent() {
-  CartesianPoint center = getGeometricCenter();
+  Point3 center(getGeometricCenter());
   mstreal r = 0;
   for (int i = 0; i < size(); i++) {
-    mstreal dist = CartesianPoint((*this)[i]).distance(center);
+    mstreal dist = Point3((*this)[i]).distance(center);
     if (dist > r) r = dist;
   }
   return r;
@@ -1488,12 +2366,24 @@ AtomPointerVector& AtomPointerVector::operator*=(const mstreal& s) {
 
 
 void AtomPointerVector::write(ostream &_os) const {
-  MstUtils::writeBin(_os, (int) size());
-  for (int i = 0; i < size(); i++) (*this)[i]->write(_os);
+  // compact format (see compactAtomTable), marked by a negative length
+  nameDictionary dict;
+  compactAtomTable atomTable(*this, dict);
+  MstUtils::writeBin(_os, -compactDataVersion);
+  dict.write(_os);
+  atomTable.write(_os);
 }
 
 void AtomPointerVector::read(istream &_is) {
-  int len; MstUtils::readBin(_is, len); resize(len, NULL);
+  int len; MstUtils::readBin(_is, len);
+  if (len < 0) {
+    if (len != -compactDataVersion) MstUtils::error("unknown binary format version " + MstUtils::toString(-len), "AtomPointerVector::read");
+    nameDictionary dict; dict.read(_is, "AtomPointerVector::read");
+    compactAtomTable atomTable; atomTable.read(_is, "AtomPointerVector::read");
+    atomTable.build(*this, dict);
+    return;
+  }
+  resize(len, NULL);
   for (int i = 0; i < size(); i++) {
     (*this)[i] = new Atom();
     (*this)[i]->read(_is);
@@ -1507,6 +2397,12 @@ ostream& MST::operator<<(ostream &_os, const AtomPointerVector& _atoms) {
   return _os;
 }
 
+/* --------- Point3 --------- */
+Point3::Point3(const CartesianPoint& p) {
+  if (p.size() != 3) MstUtils::error("expected a 3D point, got one of dimensionality " + MstUtils::toString(p.size()), "Point3::Point3(const CartesianPoint&)");
+  c[0] = p[0]; c[1] = p[1]; c[2] = p[2];
+}
+
 /* --------- CartesianPoint --------- */
 
 CartesianPoint::CartesianPoint(const Atom& A) {
@@ -1702,14 +2598,22 @@ mstreal CartesianPoint::distance2nc(const CartesianPoint& another) const {
 
 /* --------- CartesianGeometry --------- */
 mstreal CartesianGeometry::dihedral(const CartesianPoint & _p1, const CartesianPoint & _p2, const CartesianPoint & _p3, const CartesianPoint & _p4, bool radians) {
-  CartesianPoint AB = _p1 - _p2;
-  CartesianPoint CB = _p3 - _p2;
-  CartesianPoint DC = _p4 - _p3;
+  return dihedral(Point3(_p1), Point3(_p2), Point3(_p3), Point3(_p4), radians);
+}
+
+mstreal CartesianGeometry::dihedral(const CartesianPoint * _p1, const CartesianPoint * _p2, const CartesianPoint * _p3, const CartesianPoint * _p4, bool radians) {
+  return dihedral(*_p1, *_p2, *_p3, *_p4, radians);
+}
+
+mstreal CartesianGeometry::dihedral(const Point3& _p1, const Point3& _p2, const Point3& _p3, const Point3& _p4, bool radians) {
+  Point3 AB = _p1 - _p2;
+  Point3 CB = _p3 - _p2;
+  Point3 DC = _p4 - _p3;
 
   if (AB.norm() == 0.0 || CB.norm() == 0.0 || DC.norm() == 0.0) MstUtils::error("some points coincide in dihedral calculation", "CartesianGeometry::dihedralRadians");
 
-  CartesianPoint ABxCB = AB.cross(CB).getUnit();
-  CartesianPoint DCxCB = DC.cross(CB).getUnit();
+  Point3 ABxCB = AB.cross(CB).getUnit();
+  Point3 DCxCB = DC.cross(CB).getUnit();
 
   // the following is necessary for values very close to 1 but just above
   double dotp = ABxCB * DCxCB;
@@ -1727,21 +2631,21 @@ mstreal CartesianGeometry::dihedral(const CartesianPoint & _p1, const CartesianP
   return angle;
 }
 
-mstreal CartesianGeometry::dihedral(const CartesianPoint * _p1, const CartesianPoint * _p2, const CartesianPoint * _p3, const CartesianPoint * _p4, bool radians) {
-  return dihedral(*_p1, *_p2, *_p3, *_p4, radians);
-}
-
 mstreal CartesianGeometry::angle(const CartesianPoint & _p1, const CartesianPoint & _p2, const CartesianPoint & _p3, bool radians) {
-  CartesianPoint v21 = (_p1 - _p2).getUnit();
-  CartesianPoint v23 = (_p3 - _p2).getUnit();
-  mstreal c = v21.dot(v23);
-  return atan2(sqrt(1 - c*c), c) * (radians ? 1 : 180/M_PI);
+  return angle(Point3(_p1), Point3(_p2), Point3(_p3), radians);
 }
 
 mstreal CartesianGeometry::angle(const CartesianPoint * _p1, const CartesianPoint * _p2, const CartesianPoint * _p3, bool radians) {
   return angle(*_p1, *_p2, *_p3, radians);
 }
 
+mstreal CartesianGeometry::angle(const Point3& _p1, const Point3& _p2, const Point3& _p3, bool radians) {
+  Point3 v21 = (_p1 - _p2).getUnit();
+  Point3 v23 = (_p3 - _p2).getUnit();
+  mstreal c = v21.dot(v23);
+  return atan2(sqrt(1 - c*c), c) * (radians ? 1 : 180/M_PI);
+}
+
 mstreal CartesianGeometry::angleDiff(mstreal A, mstreal B, bool radians) {
   mstreal PI = radians ? M_PI : 180.0;
   mstreal TWOPI = 2*PI;
@@ -1786,6 +2690,11 @@ mstreal CartesianGeometry::angleMean(const vector<mstreal>& angles, bool radians
 // see derivation in http://grigoryanlab.org/docs/dynamics_derivatives.pdf
 template <class T>
 mstreal CartesianGeometry::distance(const CartesianPoint& atom1, const CartesianPoint& atom2, T& grad) {
+  return distance(Point3(atom1), Point3(atom2), grad);
+}
+
+template <class T>
+mstreal CartesianGeometry::distance(const Point3& atom1, const Point3& atom2, T& grad) {
   mstreal x12 = atom1.getX() - atom2.getX();
   mstreal y12 = atom1.getY() - atom2.getY();
   mstreal z12 = atom1.getZ() - atom2.getZ();
@@ -1807,6 +2716,11 @@ mstreal CartesianGeometry::distance(const CartesianPoint& atom1, const Cartesian
 // see derivation in http://grigoryanlab.org/docs/dynamics_derivatives.pdf
 template <class T>
 mstreal CartesianGeometry::angle(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, T& grad, bool radians) {
+  return angle(Point3(atom1), Point3(atom2), Point3(atom3), grad, radians);
+}
+
+template <class T>
+mstreal CartesianGeometry::angle(const Point3& atom1, const Point3& atom2, const Point3& atom3, T& grad, bool radians) {
   mstreal x12 = atom1.getX() - atom2.getX();
   mstreal y12 = atom1.getY() - atom2.getY();
   mstreal z12 = atom1.getZ() - atom2.getZ();
@@ -1861,6 +2775,11 @@ mstreal CartesianGeometry::angle(const CartesianPoint& atom1, const CartesianPoi
 // see derivation in http://grigoryanlab.org/docs/dynamics_derivatives.pdf
 template <class T>
 mstreal CartesianGeometry::dihedral(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, const CartesianPoint& atom4, T& grad, bool radians) {
+  return dihedral(Point3(atom1), Point3(atom2), Point3(atom3), Point3(atom4), grad, radians);
+}
+
+template <class T>
+mstreal CartesianGeometry::dihedral(const Point3& atom1, const Point3& atom2, const Point3& atom3, const Point3& atom4, T& grad, bool radians) {
   mstreal x21 = atom2.getX() - atom1.getX();
   mstreal y21 = atom2.getY() - atom1.getY();
   mstreal z21 = atom2.getZ() - atom1.getZ();
@@ -1877,10 +2796,10 @@ mstreal CartesianGeometry::dihedral(const CartesianPoint& atom1, const Cartesian
   mstreal y42 = atom4.getY() - atom2.getY();
   mstreal z42 = atom4.getZ() - atom2.getZ();
 
-  CartesianPoint N1(z21*y32 - y21*z32, x21*z32 - z21*x32, y21*x32 - x21*y32);
-  CartesianPoint N2(y43*z32 - z43*y32, z43*x32 - x43*z32, x43*y32 - y43*x32);
-  CartesianPoint angleGrad(9);
-  mstreal th = CartesianGeometry::angle(N1, CartesianPoint(0, 0, 0), N2, angleGrad, radians);
+  Point3 N1(z21*y32 - y21*z32, x21*z32 - z21*x32, y21*x32 - x21*y32);
+  Point3 N2(y43*z32 - z43*y32, z43*x32 - x43*z32, x43*y32 - y43*x32);
+  array<mstreal, 9> angleGrad;
+  mstreal th = CartesianGeometry::angle(N1, Point3(0, 0, 0), N2, angleGrad, radians);
 
   grad[0]  = -angleGrad[1]*z32 + angleGrad[2]*y32;
   grad[1]  =  angleGrad[0]*z32 - angleGrad[2]*x32;
@@ -1898,7 +2817,7 @@ mstreal CartesianGeometry::dihedral(const CartesianPoint& atom1, const Cartesian
   grad[10] =  angleGrad[6]*z32 - angleGrad[8]*x32;
   grad[11] = -angleGrad[6]*y32 + angleGrad[7]*x32;
 
-  if (N1 * CartesianPoint(x43, y43, z43) > 0) {
+  if (N1 * Point3(x43, y43, z43) > 0) {
     for (int i = 0; i < grad.size(); i++) grad[i] = -grad[i];
     th = -th;
   }
@@ -1991,126 +2910,144 @@ bool CartesianGeometry::testPrimitiveGradients(bool radians) {
 template mstreal CartesianGeometry::distance<vector<mstreal> >(const CartesianPoint& atom1, const CartesianPoint& atom2, vector<mstreal>& grad);
 template mstreal CartesianGeometry::angle<vector<mstreal> >(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, vector<mstreal>& grad, bool radians);
 template mstreal CartesianGeometry::dihedral<vector<mstreal> >(const CartesianPoint& atom1, const CartesianPoint& atom2, const CartesianPoint& atom3, const CartesianPoint& atom4, vector<mstreal>& grad, bool radians);
+template mstreal CartesianGeometry::distance<vector<mstreal> >(const Point3& atom1, const Point3& atom2, vector<mstreal>& grad);
+template mstreal CartesianGeometry::angle<vector<mstreal> >(const Point3& atom1, const Point3& atom2, const Point3& atom3, vector<mstreal>& grad, bool radians);
+template mstreal CartesianGeometry::dihedral<vector<mstreal> >(const Point3& atom1, const Point3& atom2, const Point3& atom3, const Point3& atom4, vector<mstreal>& grad, bool radians);
 
 /* --------- selector --------------- */
 
+compiledSelection::compiledSelection(const string& selStr) {
+  str = selStr;
+  tree.reset(selector::buildExpressionTree(selStr));
+}
+
 selector::selector(const Structure& S) {
   atoms = S.getAtoms();
   residues = S.getResidues();
   atomResidues.resize(atoms.size());
   atomChains.resize(atoms.size());
+  atomResIdx.resize(atoms.size());
+  atomChainIdx.resize(atoms.size());
   for (int i = 0; i < atoms.size(); i++) {
     atomResidues[i] = atoms[i]->getParent();
     if (atomResidues[i] != NULL) atomChains[i] = atomResidues[i]->getParent();
     if ((atomResidues[i] == NULL) || (atomChains[i] == NULL)) MstUtils::error("internally inconsistent Structure given", "selector::selector");
+    // atoms of a residue (and of a chain) are consecutive in a Structure
+    atomResIdx[i] = (i == 0) ? 0 : atomResIdx[i-1] + (atomResidues[i] != atomResidues[i-1]);
+    atomChainIdx[i] = (i == 0) ? 0 : atomChainIdx[i-1] + (atomChains[i] != atomChains[i-1]);
   }
 }
 
 AtomPointerVector selector::select(string selStr) {
-  expressionTree* tree = buildExpressionTree(selStr);
-  AtomPointerVector sel;
-  select(tree, sel);
-  delete tree;
-  set<Atom*> selAtoms(sel.begin(), sel.end());
-  AtomPointerVector sortedSel;
-  for (int i = 0; i < atoms.size(); i++) {
-    if (selAtoms.find(atoms[i]) != selAtoms.end()) sortedSel.push_back(atoms[i]);
-  }
-  return sortedSel;
+  return select(compiledSelection(selStr));
+}
+
+AtomPointerVector selector::select(const compiledSelection& sel) {
+  vector<bool> in;
+  evaluate(sel.getTree(), in);
+  return fromFlags(in);
 }
 
 vector<Residue*> selector::selectRes(string selStr) {
-  AtomPointerVector sel = select(selStr);
-  set<Residue*> selRes;
-  for (int i = 0; i < sel.size(); i++) {
-    selRes.insert(sel[i]->getParent());
-  }
-  vector<Residue*> selResSorted;
-  for (int i = 0; i < residues.size(); i++) {
-    if (selRes.find(residues[i]) != selRes.end()) selResSorted.push_back(residues[i]);
+  return selectRes(compiledSelection(selStr));
+}
+
+vector<Residue*> selector::selectRes(const compiledSelection& sel) {
+  vector<bool> in;
+  evaluate(sel.getTree(), in);
+  vector<Residue*> selRes;
+  for (int i = 0; i < atoms.size(); i++) {
+    if (in[i] && (selRes.empty() || (selRes.back() != atomResidues[i]))) selRes.push_back(atomResidues[i]);
   }
-  return selResSorted;
+  return selRes;
 }
 
 void selector::select(expressionTree* tree, AtomPointerVector& sel) {
+  vector<bool> in;
+  evaluate(tree, in);
+  sel = fromFlags(in);
+}
+
+void selector::evaluate(expressionTree* tree, vector<bool>& in) {
+  in.assign(atoms.size(), false);
   if (tree->numChildren() == 0) {
     // this is a terminal node, so just do the selection
-    for (int i = 0; i < atoms.size(); i++) {
-      switch(tree->getProperty()) {
-        case (expressionTree::selProperty::ALL):
-          sel.push_back(atoms[i]);
-          break;
-        case (expressionTree::selProperty::RESID):
-          if ((tree->hasNumSet() && tree->inNumSet(atomResidues[i]->getNum())) ||
-              (!tree->hasNumSet() && tree->hasNums() && (atomResidues[i]->getNum() >= tree->getNumByIdx(0)) && (atomResidues[i]->getNum() <= tree->getNumByIdx(1))) ||
-              (!tree->hasNumSet() && !tree->hasNums() && (atomResidues[i]->getNum() == tree->getNum()))) {
-            sel.push_back(atoms[i]);
-          }
-          break;
-        case (expressionTree::selProperty::RESNAME):
-          if (atomResidues[i]->getName() == tree->getString()) sel.push_back(atoms[i]);
-          break;
-        case (expressionTree::selProperty::ICODE):
-          if (string(1, atomResidues[i]->getIcode()) == tree->getString()) sel.push_back(atoms[i]);
-          break;
-        case (expressionTree::selProperty::CHAIN):
-          if (atomChains[i]->getID() == tree->getString()) sel.push_back(atoms[i]);
-          break;
-        case (expressionTree::selProperty::SEGID):
-          if (atomChains[i]->getSegID() == tree->getString()) sel.push_back(atoms[i]);
-          break;
-        case (expressionTree::selProperty::NAME):
-          if (atoms[i]->getName() == tree->getString()) sel.push_back(atoms[i]);
-          break;
-        default:
-          MstUtils::error("unknown selectable property " + MstUtils::toString(tree->getProperty()), "selector::select");
-      }
+    string str = tree->getString();
+    switch(tree->getProperty()) {
+      case (expressionTree::selProperty::ALL):
+        in.assign(atoms.size(), true);
+        break;
+      case (expressionTree::selProperty::RESID):
+        for (int i = 0; i < atoms.size(); i++) {
+          int num = atomResidues[i]->getNum();
+          in[i] = (tree->hasNumSet() && tree->inNumSet(num)) ||
+                  (!tree->hasNumSet() && tree->hasNums() && (num >= tree->getNumByIdx(0)) && (num <= tree->getNumByIdx(1))) ||
+                  (!tree->hasNumSet() && !tree->hasNums() && (num == tree->getNum()));
+        }
+        break;
+      case (expressionTree::selProperty::RESNAME):
+        for (int i = 0; i < atoms.size(); i++) in[i] = (atomResidues[i]->getName() == str);
+        break;
+      case (expressionTree::selProperty::ICODE):
+        for (int i = 0; i < atoms.size(); i++) in[i] = (string(1, atomResidues[i]->getIcode()) == str);
+        break;
+      case (expressionTree::selProperty::CHAIN):
+        for (int i = 0; i < atoms.size(); i++) in[i] = (atomChains[i]->getID() == str);
+        break;
+      case (expressionTree::selProperty::SEGID):
+        for (int i = 0; i < atoms.size(); i++) in[i] = (atomChains[i]->getSegID() == str);
+        break;
+      case (expressionTree::selProperty::NAME):
+        for (int i = 0; i < atoms.size(); i++) in[i] = (atoms[i]->getName() == str);
+        break;
+      default:
+        MstUtils::error("unknown selectable property " + MstUtils::toString(tree->getProperty()), "selector::select");
     }
   } else {
-    AtomPointerVector selA, selB;
+    vector<bool> inA, inB;
     switch(tree->getLogicalOperator()) {
       case (expressionTree::logicalOp::AND):
         if (tree->numChildren() != 2)
           MstUtils::error("poorly parsed expression: expected two operands for AND", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        select(tree->getChild(1), selB);
-        sel = intersect(selA, selB);
+        evaluate(tree->getChild(0), inA);
+        evaluate(tree->getChild(1), inB);
+        for (int i = 0; i < atoms.size(); i++) in[i] = inA[i] && inB[i];
         break;
       case (expressionTree::logicalOp::OR):
         if (tree->numChildren() != 2)
           MstUtils::error("poorly parsed expression: expected two operands for OR", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        select(tree->getChild(1), selB);
-        sel = combine(selA, selB);
+        evaluate(tree->getChild(0), inA);
+        evaluate(tree->getChild(1), inB);
+        for (int i = 0; i < atoms.size(); i++) in[i] = inA[i] || inB[i];
         break;
       case (expressionTree::logicalOp::NOT):
         if (tree->numChildren() != 1)
           MstUtils::error("poorly parsed expression: expected one operand for NOT", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        sel = invert(selA);
+        evaluate(tree->getChild(0), inA);
+        for (int i = 0; i < atoms.size(); i++) in[i] = !inA[i];
         break;
       case (expressionTree::logicalOp::BYRES):
         if (tree->numChildren() != 1)
           MstUtils::error("poorly parsed expression: expected one operand for BYRES", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        sel = byRes(selA);
+        evaluate(tree->getChild(0), inA);
+        expandFlags(inA, atomResIdx, in);
         break;
       case (expressionTree::logicalOp::BYCHAIN):
         if (tree->numChildren() != 1)
           MstUtils::error("poorly parsed expression: expected one operand for BYCHAIN", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        sel = byChain(selA);
+        evaluate(tree->getChild(0), inA);
+        expandFlags(inA, atomChainIdx, in);
         break;
       case (expressionTree::logicalOp::IS):
         if (tree->numChildren() != 1)
           MstUtils::error("poorly parsed expression: expected one operand for IS", "selector::select(expressionTree* )");
-        select(tree->getChild(0), sel);
+        evaluate(tree->getChild(0), in);
         break;
       case (expressionTree::logicalOp::AROUND):
         if (tree->numChildren() != 1)
           MstUtils::error("poorly parsed expression: expected one selection operand for AROUND", "selector::select(expressionTree* )");
-        select(tree->getChild(0), selA);
-        sel = around(selA, tree->getVal());
+        evaluate(tree->getChild(0), inA);
+        aroundFlags(inA, tree->getVal(), in);
         break;
       default:
         MstUtils::error("unknown selectable property " + MstUtils::toString(tree->getProperty()), "selector::select");
@@ -2118,10 +3055,50 @@ void selector::select(expressionTree* tree, AtomPointerVector& sel) {
   }
 }
 
-expressionTree* selector::buildExpressionTree(string selStr) {
-  expressionTree* tree = new expressionTree();
-  string token = getNextSelectionToken(selStr); // either something in () or the next space-separated word
-
+void selector::aroundFlags(const vector<bool>& in, mstreal dcut, vector<bool>& out) {
+  if (grid.get() == NULL) grid = make_shared<CellList>(atoms, max(dcut, (mstreal) 1.0));
+  out.assign(atoms.size(), false);
+  for (int i = 0; i < atoms.size(); i++) {
+    if (!in[i]) continue;
+    grid->forEachWithin(Point3(atoms[i]), 0, dcut, [&out](int j, mstreal d2) { out[j] = true; });
+  }
+}
+
+void selector::expandFlags(const vector<bool>& in, const vector<int>& groupIdx, vector<bool>& out) {
+  out.assign(atoms.size(), false);
+  if (atoms.empty()) return;
+  vector<bool> groupIn(groupIdx.back() + 1, false);
+  for (int i = 0; i < atoms.size(); i++) {
+    if (in[i]) groupIn[groupIdx[i]] = true;
+  }
+  for (int i = 0; i < atoms.size(); i++) out[i] = groupIn[groupIdx[i]];
+}
+
+vector<bool> selector::toFlags(const AtomPointerVector& sel) {
+  if (atomIndex.empty()) {
+    for (int i = 0; i < atoms.size(); i++) atomIndex[atoms[i]] = i;
+  }
+  vector<bool> in(atoms.size(), false);
+  for (int i = 0; i < sel.size(); i++) {
+    auto it = atomIndex.find(sel[i]);
+    if (it == atomIndex.end()) MstUtils::error("some atoms in selection are not in the selector's structure", "selector::toFlags");
+    in[it->second] = true;
+  }
+  return in;
+}
+
+AtomPointerVector selector::fromFlags(const vector<bool>& in) {
+  AtomPointerVector sel;
+  for (int i = 0; i < atoms.size(); i++) {
+    if (in[i]) sel.push_back(atoms[i]);
+  }
+  return sel;
+}
+
+expressionTree* selector::buildExpressionTree(string selStr) {
+  expressionTree* tree = new expressionTree();
+  string token = getNextSelectionToken(selStr); // either something in () or the next space-separated word
+
   if (MstUtils::stringsEqual(token, "not")) {
     tree->setLogicalOperator(expressionTree::logicalOp::NOT);
     tree->addChild(buildExpressionTree(selStr));
@@ -2247,83 +3224,39 @@ string selector::getNextSelectionToken(string& selStr) {
 }
 
 AtomPointerVector selector::invert(AtomPointerVector& selAtoms) {
-  map<Atom*, bool> in;
-  AtomPointerVector notIn;
-  for (int i = 0; i < selAtoms.size(); i++) in[selAtoms[i]] = true;
-  for (int i = 0; i < atoms.size(); i++) {
-    if (in.find(atoms[i]) == in.end()) notIn.push_back(atoms[i]);
-  }
-  return notIn;
+  vector<bool> in = toFlags(selAtoms);
+  in.flip();
+  return fromFlags(in);
 }
 
 AtomPointerVector selector::intersect(AtomPointerVector& selA, AtomPointerVector& selB) {
-  map<Atom*, bool> inA;
-  for (int i = 0; i < selA.size(); i++) inA[selA[i]] = true;
-
-  AtomPointerVector common;
-  for (int i = 0; i < selB.size(); i++) {
-    if (inA.find(selB[i]) != inA.end()) common.push_back(selB[i]);
-  }
-  return common;
+  vector<bool> inA = toFlags(selA), inB = toFlags(selB);
+  for (int i = 0; i < atoms.size(); i++) inA[i] = inA[i] && inB[i];
+  return fromFlags(inA);
 }
 
 AtomPointerVector selector::combine(AtomPointerVector& selA, AtomPointerVector& selB) {
-  map<Atom*, bool> inBothMap;
-  for (int i = 0; i < selA.size(); i++) inBothMap[selA[i]] = true;
-  for (int i = 0; i < selB.size(); i++) inBothMap[selB[i]] = true;
-  AtomPointerVector inBoth(inBothMap.size(), NULL);
-  int i = 0;
-  for (map<Atom*, bool>::iterator it = inBothMap.begin(); it != inBothMap.end(); ++it, i++)
-    inBoth[i] = it->first;
-  return inBoth;
+  vector<bool> inA = toFlags(selA), inB = toFlags(selB);
+  for (int i = 0; i < atoms.size(); i++) inA[i] = inA[i] || inB[i];
+  return fromFlags(inA);
 }
 
 AtomPointerVector selector::around(AtomPointerVector& selAtoms, mstreal dcut) {
-  AtomPointerVector within;
-  mstreal dcut2 = dcut*dcut;
-  for (int i = 0; i < atoms.size(); i++) {
-    Atom* a = atoms[i];
-    for (int j = 0; j < selAtoms.size(); j++) {
-      if (a->distance2(selAtoms[j]) <= dcut2) {
-        within.push_back(a);
-        break;
-      }
-    }
-  }
-  return within;
+  vector<bool> within;
+  aroundFlags(toFlags(selAtoms), dcut, within);
+  return fromFlags(within);
 }
 
 AtomPointerVector selector::byRes(AtomPointerVector& selAtoms) {
-  set<Residue*> added;
-  AtomPointerVector expanded;
-  for (int i = 0; i < selAtoms.size(); i++) {
-    Residue* res = selAtoms[i]->getParent();
-    if (res == NULL) MstUtils::error("some atoms in selection are parentless", "selector::byRes");
-    if (added.find(res) != added.end()) continue;
-    added.insert(res); // this will accumulate residues in the "natural" order (according to Residue::operator<)
-  }
-  for (auto it = added.begin(); it != added.end(); ++it) {
-    Residue* res = *it;
-    for (int j = 0; j < res->atomSize(); j++) expanded.push_back(&(res->getAtom(j)));
-  }
-
-  return expanded;
+  vector<bool> expanded;
+  expandFlags(toFlags(selAtoms), atomResIdx, expanded);
+  return fromFlags(expanded);
 }
 
 AtomPointerVector selector::byChain(AtomPointerVector& selAtoms) {
-  map<Chain*, bool> added;
-  AtomPointerVector expanded;
-  for (int i = 0; i < selAtoms.size(); i++) {
-    Chain* chain = selAtoms[i]->getChain();
-    if (chain == NULL) MstUtils::error("some atoms in selection are parentless", "selector::byChain");
-    if (added.find(chain) != added.end()) continue;
-    for (int j = 0; j < chain->residueSize(); j++) {
-      Residue& res = chain->getResidue(j);
-      for (int k = 0; k < res.atomSize(); k++) expanded.push_back(&(res[k]));
-    }
-    added[chain] = true;
-  }
-  return expanded;
+  vector<bool> expanded;
+  expandFlags(toFlags(selAtoms), atomChainIdx, expanded);
+  return fromFlags(expanded);
 }
 
 /* --------- RMSDCalculator --------- */
@@ -2369,6 +3302,22 @@ mstreal RMSDCalculator::bestResidual(const vector<Atom*> &_align, const vector<A
     return _res;
 }
 
+template <class T, class U>
+mstreal RMSDCalculator::bestRMSD(const T* _align, const U* _ref, int n, bool setTransRot, bool* _suc) {
+    _res = 0.0;
+    if (Kabsch(_align, _ref, n, setTransRot)) { if (_suc != NULL) *_suc = true; }
+    else { if (_suc != NULL) *_suc = false; }
+    return sqrt(_res/_n);
+}
+
+template <class T, class U>
+mstreal RMSDCalculator::bestResidual(const T* _align, const U* _ref, int n, bool setTransRot, bool* _suc) {
+    _res = 0.0;
+    if (Kabsch(_align, _ref, n, setTransRot)) { if (_suc != NULL) *_suc = true; }
+    else { if (_suc != NULL) *_suc = false; }
+    return _res;
+}
+
 bool RMSDCalculator::align(const vector<Atom*> &_align, const vector<Atom*> &_ref, vector<Atom*>& _moveable) {
     bool suc = Kabsch(_align, _ref, 1);
 
@@ -2418,27 +3367,22 @@ void RMSDCalculator::applyLastTransformation(vector<Atom*>& _moveable) {
   t    - t(i)   is translation vector for best superposition  (output)
 **************************************************************************/
 bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_ref, int mode) {
-    int i, j, m, m1, l, k;
-    mstreal e0, rms1, d, h, g;
-    mstreal cth, sth, sqrth, p, det, sigma;
-    mstreal xc[3], yc[3];
-    mstreal a[3][3], b[3][3], r[3][3], e[3], rr[6], ss[6];
-    mstreal sqrt3=1.73205080756888, tol=0.01;
-    int ip[]={0, 1, 3, 1, 2, 4, 3, 4, 5};
-    int ip2312[]={1, 2, 0, 1};
-
-    int a_failed=0, b_failed=0;
-    mstreal epsilon=0.00000001;
-
-    int n=_ref.size();
-    if(n != _align.size()) {
+    if(_ref.size() != _align.size()) {
         cout << "Two proteins have different length!" << endl;
         return false;
     }
+    return Kabsch(_align, _ref, _ref.size(), mode);
+}
+
+template <class T, class U>
+bool RMSDCalculator::Kabsch(const T& _align, const U& _ref, int n, int mode) {
+    int i, j, m;
+    mstreal e0;
+    mstreal xc[3], yc[3];
+    mstreal r[3][3];
 
     //initializtation
     _res=0;
-    rms1=0;
     e0=0;
     for (i=0; i<3; i++) {
         xc[i]=0.0;
@@ -2447,11 +3391,7 @@ bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_r
         for (j=0; j<3; j++) {
             u[i][j]=0.0;
             r[i][j]=0.0;
-            a[i][j]=0.0;
-            if (i==j) {
-                u[i][j]=1.0;
-                a[i][j]=1.0;
-            }
+            if (i==j) u[i][j]=1.0;
         }
     }
 
@@ -2462,13 +3402,13 @@ bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_r
 
     //compute centers for vector sets x, y
     for(i=0; i<n; i++){
-        xc[0] += _align[i]->getX();
-        xc[1] += _align[i]->getY();
-        xc[2] += _align[i]->getZ();
+        xc[0] += coorX(_align, i);
+        xc[1] += coorY(_align, i);
+        xc[2] += coorZ(_align, i);
 
-        yc[0] += _ref[i]->getX();
-        yc[1] += _ref[i]->getY();
-        yc[2] += _ref[i]->getZ();
+        yc[0] += coorX(_ref, i);
+        yc[1] += coorY(_ref, i);
+        yc[2] += coorZ(_ref, i);
     }
     for(i=0; i<3; i++){
         xc[i] = xc[i]/n;
@@ -2478,12 +3418,12 @@ bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_r
     //compute e0 and matrix r
     mstreal ax, ay, az, rx, ry, rz;
     for (m = 0; m < n; m++) {
-      ax = _align[m]->getX() - xc[0];
-      ay = _align[m]->getY() - xc[1];
-      az = _align[m]->getZ() - xc[2];
-      rx = _ref[m]->getX() - yc[0];
-      ry = _ref[m]->getY() - yc[1];
-      rz = _ref[m]->getZ() - yc[2];
+      ax = coorX(_align, m) - xc[0];
+      ay = coorY(_align, m) - xc[1];
+      az = coorZ(_align, m) - xc[2];
+      rx = coorX(_ref, m) - yc[0];
+      ry = coorY(_ref, m) - yc[1];
+      rz = coorZ(_ref, m) - yc[2];
       e0 += ax * ax + rx * rx;
       e0 += ay * ay + ry * ry;
       e0 += az * az + rz * rz;
@@ -2498,6 +3438,33 @@ bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_r
       r[2][2] += rz * az;
     }
 
+    return kabschSolve(xc, yc, r, e0, n, mode);
+}
+
+bool RMSDCalculator::kabschSolve(const mstreal xc[3], const mstreal yc[3], mstreal r[3][3], mstreal e0, int n, int mode) {
+    int i, j, m, m1, l, k;
+    mstreal rms1, d, h, g;
+    mstreal cth, sth, sqrth, p, det, sigma;
+    mstreal a[3][3], b[3][3], e[3], rr[6], ss[6];
+    mstreal sqrt3=1.73205080756888, tol=0.01;
+    int ip[]={0, 1, 3, 1, 2, 4, 3, 4, 5};
+    int ip2312[]={1, 2, 0, 1};
+
+    int a_failed=0, b_failed=0;
+    mstreal epsilon=0.00000001;
+
+    for (i=0; i<3; i++) {
+        t[i]=0.0;
+        for (j=0; j<3; j++) {
+            u[i][j]=0.0;
+            a[i][j]=0.0;
+            if (i==j) {
+                u[i][j]=1.0;
+                a[i][j]=1.0;
+            }
+        }
+    }
+
     //compute determinat of matrix r
     det = r[0][0] * ( r[1][1]*r[2][2] - r[1][2]*r[2][1] )       \
         - r[0][1] * ( r[1][0]*r[2][2] - r[1][2]*r[2][0] )       \
@@ -2725,6 +3692,212 @@ bool RMSDCalculator::Kabsch(const vector<Atom*> &_align, const vector<Atom*> &_r
     return true;
 }
 
+const int RMSDCalculator::qcpLanes;
+
+template <class T>
+void RMSDCalculator::windowResiduals(const mstreal* _ref, int n, const T* coords, int numWindows, int step, vector<mstreal>& res, vector<mstreal>* cents, const vector<bool>* ok) {
+  if (n < 1) MstUtils::error("window length is zero", "RMSDCalculator::windowResiduals");
+  // windows made of whole residues get a kernel specialized to the residue size
+  if ((step == 1) || (step == 4 && n % 4 == 0)) {
+    if (step == 1) windowResidualsKernel<1>(_ref, n, coords, numWindows, step, res, cents, ok);
+    else windowResidualsKernel<4>(_ref, n, coords, numWindows, step, res, cents, ok);
+  } else {
+    windowResidualsKernel<0>(_ref, n, coords, numWindows, step, res, cents, ok);
+  }
+}
+
+template <int STEP, class T>
+void RMSDCalculator::windowResidualsKernel(const mstreal* _ref, int n, const T* coords, int numWindows, int _step, vector<mstreal>& res, vector<mstreal>* cents, const vector<bool>* ok) {
+  const int step = (STEP > 0) ? STEP : _step;
+  if (res.size() < numWindows) res.resize(numWindows, 9999.0);
+  if (cents != NULL) cents->assign(3*numWindows, 0.0);
+
+  // center the reference once and pre-compute its squared norm
+  vector<mstreal> ref;
+  mstreal GB = qcpCenter(_ref, n, ref);
+
+  // running coordinate and squared-norm sums over the current window
+  mstreal sum[3] = {0, 0, 0}, sq = 0;
+  for (int k = 0; k < n; k++) {
+    for (int d = 0; d < 3; d++) {
+      mstreal v = coords[3*k + d];
+      sum[d] += v; sq += v*v;
+    }
+  }
+
+  // admissible windows are gathered into blocks and solved a block at a time
+  const T* blockWin[qcpLanes];
+  int blockIdx[qcpLanes];
+  mstreal E0[qcpLanes], L[qcpLanes], S[9][qcpLanes];
+  int m = 0;
+  for (int w = 0; w < numWindows; w++) {
+    const T* win = coords + 3*w*step;
+    if (w > 0) {
+      // slide the window by step points: drop the leading ones, add the trailing ones
+      const T* out = win - 3*step;
+      const T* in = win + 3*(n - step);
+      for (int k = 0; k < 3*step; k += 3) {
+        for (int d = 0; d < 3; d++) {
+          mstreal vo = out[k + d], vi = in[k + d];
+          sum[d] += vi - vo; sq += vi*vi - vo*vo;
+        }
+      }
+    }
+    if (cents != NULL) {
+      for (int d = 0; d < 3; d++) (*cents)[3*w + d] = sum[d]/n;
+    }
+    if ((ok == NULL) || (*ok)[w]) {
+      blockWin[m] = win;
+      blockIdx[m] = w;
+      E0[m] = GB + sq - (sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2])/n;
+      m++;
+    }
+    if ((m == qcpLanes) || ((w == numWindows - 1) && (m > 0))) {
+      for (int b = m; b < qcpLanes; b++) { blockWin[b] = blockWin[0]; E0[b] = E0[0]; }
+      qcpCovarianceBlock<(STEP > 1) ? STEP : 1>(ref.data(), n, blockWin, S);
+      qcpEigenBlock(S, E0, L);
+      for (int b = 0; b < m; b++) res[blockIdx[b]] = MstUtils::max(E0[b] - 2*L[b], 0.0);
+      m = 0;
+    }
+  }
+}
+
+template <class T>
+void RMSDCalculator::qcpRMSDBatch(const mstreal* _ref, int n, const T* const* cands, int numCands, mstreal* out, bool residuals) {
+  if (n < 1) MstUtils::error("reference length is zero", "RMSDCalculator::qcpRMSDBatch");
+  vector<mstreal> ref;
+  mstreal GB = qcpCenter(_ref, n, ref);
+  const T* block[qcpLanes];
+  mstreal E0[qcpLanes], L[qcpLanes], S[9][qcpLanes];
+  for (int c0 = 0; c0 < numCands; c0 += qcpLanes) {
+    int m = MstUtils::min(qcpLanes, numCands - c0);
+    for (int b = 0; b < qcpLanes; b++) {
+      block[b] = cands[c0 + ((b < m) ? b : 0)];
+      // inner product of the centered candidate, from its coordinate and squared-norm sums
+      mstreal sum[3] = {0, 0, 0}, sq = 0;
+      for (int k = 0; k < 3*n; k += 3) {
+        mstreal x = block[b][k], y = block[b][k + 1], z = block[b][k + 2];
+        sum[0] += x; sum[1] += y; sum[2] += z;
+        sq += x*x + y*y + z*z;
+      }
+      E0[b] = GB + sq - (sum[0]*sum[0] + sum[1]*sum[1] + sum[2]*sum[2])/n;
+    }
+    qcpCovarianceBlock<1>(ref.data(), n, block, S);
+    qcpEigenBlock(S, E0, L);
+    for (int b = 0; b < m; b++) {
+      mstreal r = MstUtils::max(E0[b] - 2*L[b], 0.0);
+      out[c0 + b] = residuals ? r : sqrt(r/n);
+    }
+  }
+}
+
+mstreal RMSDCalculator::qcpCenter(const mstreal* _ref, int n, vector<mstreal>& ref) {
+  mstreal c[3] = {0, 0, 0}, G = 0;
+  ref.assign(_ref, _ref + 3*n);
+  for (int k = 0; k < n; k++) {
+    for (int d = 0; d < 3; d++) c[d] += ref[3*k + d];
+  }
+  for (int d = 0; d < 3; d++) c[d] /= n;
+  for (int k = 0; k < n; k++) {
+    for (int d = 0; d < 3; d++) {
+      ref[3*k + d] -= c[d];
+      G += ref[3*k + d] * ref[3*k + d];
+    }
+  }
+  return G;
+}
+
+template <int G, class T>
+void RMSDCalculator::qcpCovarianceBlock(const mstreal* ref, int n, const T* const* c, mstreal S[9][qcpLanes]) {
+  // since the reference is centered, the candidates need no centering; points
+  // are taken G at a time, so the inner loop has a compile-time trip count
+#ifdef __AVX__
+  __m256d acc[9];
+  for (int i = 0; i < 9; i++) acc[i] = _mm256_setzero_pd();
+  for (int k0 = 0; k0 < 3*n; k0 += 3*G) {
+    for (int g = 0; g < G; g++) {
+      int k = k0 + 3*g;
+      __m256d ax = _mm256_set_pd(c[3][k], c[2][k], c[1][k], c[0][k]);
+      __m256d ay = _mm256_set_pd(c[3][k + 1], c[2][k + 1], c[1][k + 1], c[0][k + 1]);
+      __m256d az = _mm256_set_pd(c[3][k + 2], c[2][k + 2], c[1][k + 2], c[0][k + 2]);
+      for (int i = 0; i < 3; i++) {
+        __m256d r = _mm256_set1_pd(ref[k + i]);
+        acc[3*i] = _mm256_add_pd(acc[3*i], _mm256_mul_pd(r, ax));
+        acc[3*i + 1] = _mm256_add_pd(acc[3*i + 1], _mm256_mul_pd(r, ay));
+        acc[3*i + 2] = _mm256_add_pd(acc[3*i + 2], _mm256_mul_pd(r, az));
+      }
+    }
+  }
+  for (int i = 0; i < 9; i++) _mm256_storeu_pd(S[i], acc[i]);
+#else
+  for (int i = 0; i < 9; i++) {
+    for (int b = 0; b < qcpLanes; b++) S[i][b] = 0;
+  }
+  for (int k0 = 0; k0 < 3*n; k0 += 3*G) {
+    for (int g = 0; g < G; g++) {
+      int k = k0 + 3*g;
+      for (int i = 0; i < 3; i++) {
+        mstreal r = ref[k + i];
+        for (int b = 0; b < qcpLanes; b++) {
+          S[3*i][b] += r * c[b][k];
+          S[3*i + 1][b] += r * c[b][k + 1];
+          S[3*i + 2][b] += r * c[b][k + 2];
+        }
+      }
+    }
+  }
+#endif
+}
+
+void RMSDCalculator::qcpEigenBlock(const mstreal S[9][qcpLanes], const mstreal* E0, mstreal* L) {
+  // characteristic polynomial coefficients, as in qcpRMSD, for every lane
+  mstreal C0[qcpLanes], C1[qcpLanes], C2[qcpLanes];
+  for (int b = 0; b < qcpLanes; b++) {
+    mstreal Sxx = S[0][b], Sxy = S[1][b], Sxz = S[2][b];
+    mstreal Syx = S[3][b], Syy = S[4][b], Syz = S[5][b];
+    mstreal Szx = S[6][b], Szy = S[7][b], Szz = S[8][b];
+    mstreal Sxx2 = Sxx*Sxx, Sxy2 = Sxy*Sxy, Sxz2 = Sxz*Sxz;
+    mstreal Syx2 = Syx*Syx, Syy2 = Syy*Syy, Syz2 = Syz*Syz;
+    mstreal Szx2 = Szx*Szx, Szy2 = Szy*Szy, Szz2 = Szz*Szz;
+    C2[b] = -2*(Sxx2 + Sxy2 + Sxz2 + Syx2 + Syy2 + Syz2 + Szx2 + Szy2 + Szz2);
+    C1[b] = 8*(Sxx*Syz*Szy + Syy*Szx*Sxz + Szz*Sxy*Syx - Sxx*Syy*Szz - Syz*Szx*Sxy - Szy*Syx*Sxz);
+    mstreal D = (Sxy2 + Sxz2 - Syx2 - Szx2); D = D*D;
+    mstreal E1 = -Sxx2 + Syy2 + Szz2 + Syz2 + Szy2;
+    mstreal E2 = 2*(Syy*Szz - Syz*Szy);
+    mstreal E = (E1 - E2) * (E1 + E2);
+    mstreal F = (-(Sxz + Szx)*(Syz - Szy) + (Sxy - Syx)*(Sxx - Syy - Szz)) *
+                (-(Sxz - Szx)*(Syz + Szy) + (Sxy - Syx)*(Sxx - Syy + Szz));
+    mstreal G = (-(Sxz + Szx)*(Syz + Szy) - (Sxy + Syx)*(Sxx + Syy - Szz)) *
+                (-(Sxz - Szx)*(Syz - Szy) - (Sxy + Syx)*(Sxx + Syy + Szz));
+    mstreal H = ( (Sxy + Syx)*(Syz + Szy) + (Sxz + Szx)*(Sxx - Syy + Szz)) *
+                (-(Sxy - Syx)*(Syz - Szy) + (Sxz + Szx)*(Sxx + Syy + Szz));
+    mstreal I = ( (Sxy + Syx)*(Syz - Szy) + (Sxz - Szx)*(Sxx - Syy - Szz)) *
+                (-(Sxy - Syx)*(Syz + Szy) + (Sxz - Szx)*(Sxx + Syy - Szz));
+    C0[b] = D + E + F + G + H + I;
+    L[b] = E0[b]/2;
+  }
+
+  // Newton-Raphson on all lanes together, until every lane has converged; a
+  // lane stops being updated once it converges, so that its result does not
+  // depend on which other candidates share its block
+  mstreal tol = 10E-11;
+  bool conv[qcpLanes] = {false};
+  for (int it = 0; it < 100; it++) {
+    bool done = true;
+    for (int b = 0; b < qcpLanes; b++) {
+      if (conv[b]) continue;
+      mstreal l = L[b], l2 = l*l;
+      mstreal f = l2*l2 + C2[b]*l2 + C1[b]*l + C0[b];
+      mstreal df = 4*l2*l + 2*C2[b]*l + C1[b];
+      mstreal lnew = (df != 0) ? l - f/df : l;
+      if (fabs(lnew - l) > tol*lnew) done = false;
+      else conv[b] = true;
+      L[b] = lnew;
+    }
+    if (done) break;
+  }
+}
+
 mstreal RMSDCalculator::rmsd(const vector<Atom*>& A, const vector<Atom*>& B) {
   if (A.size() != B.size())
     MstUtils::error("atom vectors of different length (" + MstUtils::toString(A.size()) + " and " + MstUtils::toString(B.size()) + ")", "RMSDCalculator::rmsd(vector<Atom*>&, vector<Atom*>&)");
@@ -2784,6 +3957,12 @@ mstreal RMSDCalculator::rmsdCutoff(const Structure& S, mstreal rmsdMax, mstreal
   return RMSDCalculator::rmsdCutoff(L, rmsdMax, L0);
 }
 
+mstreal RMSDCalculator::rmsdCutoff(const StructureView& V, mstreal rmsdMax, mstreal L0) {
+  vector<int> L(V.chainSize());
+  for (int i = 0; i < V.chainSize(); i++) L[i] = V.chainResidueSize(i);
+  return RMSDCalculator::rmsdCutoff(L, rmsdMax, L0);
+}
+
 mstreal RMSDCalculator::rmsdCutoff(const vector<int>& J, const Structure& S, mstreal rmsdMax, mstreal L0) {
   vector<vector<int> > I;
   map<Chain*, vector<int> > residuesFromChain;
@@ -2998,7 +4177,7 @@ bool RMSDCalculator::testQCP(bool testGrad) {
   long int Tkabsch = 0, Tqcp = 0;
   bool failed = false; int N = 100000;
   for (int k = 0; k < N; k++) {
-    int N = MstUtils::randInt(100, 10); // number of atoms
+    int N = MstUtils::randInt(10, 100); // number of atoms
     mstreal L = (1 + MstUtils::randUnit())*50; // length scale
 
     // create random atoms
@@ -3064,10 +4243,49 @@ bool RMSDCalculator::testQCP(bool testGrad) {
   cout << "Kabsch: " << (10E9/(Tkabsch/N)) << " per second" << endl;
   cout << "Qcp:    " << (10E9/(Tqcp/N)) << " per second" << endl;
   cout << "Kabsch/Qcp = " << Tqcp*1.0/Tkabsch << endl;
+
+  // test the batch kernel against one-at-a-time calculations, with batch sizes
+  // that do and do not fill whole blocks
+  for (int k = 0; k < 1000; k++) {
+    int n = MstUtils::randInt(10, 100), nc = MstUtils::randInt(1, 4*qcpLanes);
+    mstreal L = (1 + MstUtils::randUnit())*50;
+    vector<mstreal> ref(3*n);
+    vector<vector<mstreal> > cands(nc, vector<mstreal>(3*n));
+    vector<const mstreal*> candPtrs(nc);
+    for (int i = 0; i < 3*n; i++) ref[i] = MstUtils::randUnit()*L;
+    for (int c = 0; c < nc; c++) {
+      for (int i = 0; i < 3*n; i++) cands[c][i] = MstUtils::randUnit()*L;
+      candPtrs[c] = cands[c].data();
+    }
+    vector<mstreal> batch(nc);
+    rc.qcpRMSDBatch(ref.data(), n, candPtrs.data(), nc, batch.data());
+    for (int c = 0; c < nc; c++) {
+      mstreal rmsd = rc.bestRMSD(cands[c].data(), ref.data(), n);
+      if (fabs(rmsd - batch[c]) > 10E-8) {
+        cout << "test FAILED for batch RMSD calculation, candidate " << c << " of " << nc << ", with " << n << " points" << endl;
+        cout << "Kabsch: " << rmsd << endl;
+        cout << "batch QCP: " << batch[c] << endl;
+        cout << "difference: " << (rmsd - batch[c]) << endl;
+        return false;
+      }
+    }
+  }
   return true;
 }
 
 // forward declarations of template functions
+template mstreal RMSDCalculator::bestRMSD<mstreal, mstreal>(const mstreal* _align, const mstreal* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestRMSD<float, mstreal>(const float* _align, const mstreal* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestRMSD<mstreal, float>(const mstreal* _align, const float* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestRMSD<float, float>(const float* _align, const float* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestResidual<mstreal, mstreal>(const mstreal* _align, const mstreal* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestResidual<float, mstreal>(const float* _align, const mstreal* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestResidual<mstreal, float>(const mstreal* _align, const float* _ref, int n, bool setTransRot, bool* _suc);
+template mstreal RMSDCalculator::bestResidual<float, float>(const float* _align, const float* _ref, int n, bool setTransRot, bool* _suc);
+template void RMSDCalculator::windowResiduals<mstreal>(const mstreal* _ref, int n, const mstreal* coords, int numWindows, int step, vector<mstreal>& res, vector<mstreal>* cents, const vector<bool>* ok);
+template void RMSDCalculator::windowResiduals<float>(const mstreal* _ref, int n, const float* coords, int numWindows, int step, vector<mstreal>& res, vector<mstreal>* cents, const vector<bool>* ok);
+template void RMSDCalculator::qcpRMSDBatch<mstreal>(const mstreal* _ref, int n, const mstreal* const* cands, int numCands, mstreal* out, bool residuals);
+template void RMSDCalculator::qcpRMSDBatch<float>(const mstreal* _ref, int n, const float* const* cands, int numCands, mstreal* out, bool residuals);
 template mstreal RMSDCalculator::qcpRMSD<vector<Atom*> >(const vector<Atom*>& A, const vector<Atom*>& B, bool setTransform, bool setResiduals);
 template mstreal RMSDCalculator::qcpRMSDGrad<vector<Atom*> >(const vector<Atom*>& A, const vector<Atom*>& B, vector<mstreal>& grad);
 template mstreal RMSDCalculator::qcpRMSD<AtomPointerVector>(const AtomPointerVector& A, const AtomPointerVector& B, bool setTransform, bool setResiduals);
@@ -3321,6 +4539,377 @@ bool ProximitySearch::overlaps(ProximitySearch& other, mstreal pad) {
   return true;
 }
 
+/* --------- CellList --------- */
+/* Runs query(q, list) for each center q over blocks of centers in parallel, and
+ * concatenates the per-block lists into CSR form. */
+static void batchQuery(int numCenters, int numThreads, vector<int>& offsets, vector<int>& list, const function<int(int, vector<int>&)>& query) {
+  int numBlocks = max(1, min(numCenters, max(numThreads, 1) * 4));
+  vector<pair<int, int> > blocks = MstUtils::splitTasks(numCenters, numBlocks);
+  vector<vector<int> > blockLists(blocks.size());
+  offsets.assign(numCenters + 1, 0);
+  MstUtils::parallelFor(blocks.size(), numThreads, [&](int b, int w) {
+    for (int q = blocks[b].first; q <= blocks[b].second; q++) offsets[q + 1] = query(q, blockLists[b]);
+  });
+  for (int q = 0; q < numCenters; q++) offsets[q + 1] += offsets[q];
+  list.resize(offsets.back());
+  for (int b = 0, k = 0; b < blocks.size(); b++) {
+    copy(blockLists[b].begin(), blockLists[b].end(), list.begin() + k);
+    k += blockLists[b].size();
+  }
+}
+
+CellList::CellList(const vector<Atom*>& atoms, mstreal _cellSize, const vector<int>* _tags) {
+  vector<mstreal> coords(3*atoms.size());
+  for (int i = 0; i < atoms.size(); i++) {
+    coords[3*i] = atoms[i]->getX(); coords[3*i + 1] = atoms[i]->getY(); coords[3*i + 2] = atoms[i]->getZ();
+  }
+  if ((_tags != NULL) && (_tags->size() != atoms.size())) MstUtils::error("different number of atoms and tags specified", "CellList::CellList");
+  build(coords.data(), atoms.size(), _cellSize, (_tags == NULL) ? NULL : _tags->data());
+}
+
+CellList::CellList(const vector<mstreal>& coords, mstreal _cellSize, const vector<int>* _tags) {
+  if (coords.size() % 3 != 0) MstUtils::error("the number of coordinates is not divisible by 3", "CellList::CellList");
+  if ((_tags != NULL) && (3*_tags->size() != coords.size())) MstUtils::error("different number of points and tags specified", "CellList::CellList");
+  build(coords.data(), coords.size()/3, _cellSize, (_tags == NULL) ? NULL : _tags->data());
+}
+
+void CellList::build(const mstreal* coords, int n, mstreal _cellSize, const int* _tags) {
+  if (_cellSize <= 0) MstUtils::error("cell size must be positive", "CellList::build");
+  numPoints = n;
+  cellSize = _cellSize;
+  tags.assign(_tags, (_tags == NULL) ? _tags : _tags + n);
+  mstreal hi[3];
+  for (int d = 0; d < 3; d++) { lo[d] = (n > 0) ? coords[d] : 0; hi[d] = lo[d]; }
+  for (int i = 0; i < n; i++) {
+    for (int d = 0; d < 3; d++) {
+      lo[d] = min(lo[d], coords[3*i + d]);
+      hi[d] = max(hi[d], coords[3*i + d]);
+    }
+  }
+  // keep the number of cells within a small multiple of the number of points
+  // (for sparse point sets spread over large volumes)
+  while (true) {
+    long numCells = 1;
+    for (int d = 0; d < 3; d++) {
+      dim[d] = int((hi[d] - lo[d]) / cellSize) + 1;
+      numCells *= dim[d];
+    }
+    if (numCells <= 8L*n + 64) break;
+    cellSize *= 1.5;
+  }
+  int numCells = dim[0]*dim[1]*dim[2];
+
+  // counting sort of points by cell
+  vector<int> cellOf(n);
+  cellStart.assign(numCells + 1, 0);
+  for (int i = 0; i < n; i++) {
+    int c[3];
+    for (int d = 0; d < 3; d++) c[d] = min(int((coords[3*i + d] - lo[d]) / cellSize), dim[d] - 1);
+    cellOf[i] = (c[0]*dim[1] + c[1])*dim[2] + c[2];
+    cellStart[cellOf[i] + 1]++;
+  }
+  for (int c = 0; c < numCells; c++) cellStart[c + 1] += cellStart[c];
+  vector<int> next(cellStart.begin(), cellStart.end() - 1);
+  coor.resize(3*n); pointAt.resize(n); position.resize(n);
+  for (int i = 0; i < n; i++) {
+    int k = next[cellOf[i]]++;
+    pointAt[k] = i;
+    position[i] = k;
+    for (int d = 0; d < 3; d++) coor[3*k + d] = coords[3*i + d];
+  }
+}
+
+int CellList::pointsWithin(const Point3& c, mstreal dmin, mstreal dmax, vector<int>& list, bool byTag) const {
+  int n0 = list.size();
+  bool useTags = byTag && !tags.empty();
+  forEachWithin(c, dmin, dmax, [&](int i, mstreal d2) { list.push_back(useTags ? tags[i] : i); });
+  return list.size() - n0;
+}
+
+bool CellList::anyWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+  return !forEachWithin(c, dmin, dmax, [](int i, mstreal d2) { return false; });
+}
+
+int CellList::numPointsWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+  int n = 0;
+  forEachWithin(c, dmin, dmax, [&n](int i, mstreal d2) { n++; });
+  return n;
+}
+
+void CellList::pointsWithin(const vector<Atom*>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  vector<Point3> points(centers.size());
+  for (int i = 0; i < centers.size(); i++) points[i] = Point3(centers[i]);
+  pointsWithin(points, dmin, dmax, offsets, list, byTag, numThreads);
+}
+
+void CellList::pointsWithin(const vector<Point3>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  batchQuery(centers.size(), numThreads, offsets, list, [&](int q, vector<int>& out) { return pointsWithin(centers[q], dmin, dmax, out, byTag); });
+}
+
+/* --------- KDTree --------- */
+KDTree::KDTree(const vector<Atom*>& atoms, const vector<int>* _tags) {
+  vector<Point3> P(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) P[i] = Point3(atoms[i]);
+  *this = KDTree(P, _tags);
+}
+
+KDTree::KDTree(const vector<Point3>& _points, const vector<int>* _tags) {
+  if ((_tags != NULL) && (_tags->size() != _points.size())) MstUtils::error("different number of points and tags specified", "KDTree::KDTree");
+  points = _points;
+  if (_tags == NULL) {
+    tags.resize(points.size());
+    for (int i = 0; i < tags.size(); i++) tags[i] = i;
+  } else {
+    tags = *_tags;
+  }
+  removed.assign(points.size(), false);
+  numRemoved = 0;
+  rebuild();
+}
+
+void KDTree::rebuild() {
+  slot.assign(points.size(), -1);
+  bufferPos.assign(points.size(), -1);
+  buffer.clear();
+  slotPoint.clear();
+  for (int i = 0; i < points.size(); i++) {
+    if (!removed[i]) slotPoint.push_back(i);
+  }
+  numStale = 0;
+  nodes.clear();
+  coor.resize(3*slotPoint.size());
+  if (!slotPoint.empty()) buildNode(0, slotPoint.size());
+  for (int k = 0; k < slotPoint.size(); k++) {
+    int i = slotPoint[k];
+    slot[i] = k;
+    for (int d = 0; d < 3; d++) coor[3*k + d] = points[i][d];
+  }
+}
+
+int KDTree::buildNode(int begin, int end) {
+  int ni = nodes.size();
+  nodes.push_back(node());
+  node n;
+  n.begin = begin; n.end = end; n.left = n.right = -1;
+  for (int d = 0; d < 3; d++) { n.lo[d] = numeric_limits<mstreal>::max(); n.hi[d] = -numeric_limits<mstreal>::max(); }
+  for (int k = begin; k < end; k++) {
+    const Point3& p = points[slotPoint[k]];
+    for (int d = 0; d < 3; d++) { n.lo[d] = min(n.lo[d], p[d]); n.hi[d] = max(n.hi[d], p[d]); }
+  }
+  if (end - begin > leafSize) {
+    // split at the median along the widest dimension of the bounding box
+    int sd = 0;
+    for (int d = 1; d < 3; d++) {
+      if (n.hi[d] - n.lo[d] > n.hi[sd] - n.lo[sd]) sd = d;
+    }
+    int mid = (begin + end)/2;
+    nth_element(slotPoint.begin() + begin, slotPoint.begin() + mid, slotPoint.begin() + end, [&](int a, int b) { return points[a][sd] < points[b][sd]; });
+    n.left = buildNode(begin, mid);
+    n.right = buildNode(mid, end);
+  }
+  nodes[ni] = n;
+  return ni;
+}
+
+int KDTree::addPoint(const Point3& p, int tag) {
+  int i = points.size();
+  points.push_back(p);
+  tags.push_back((tag < 0) ? i : tag);
+  removed.push_back(false);
+  slot.push_back(-1);
+  bufferPos.push_back(buffer.size());
+  buffer.push_back(i);
+  maybeRebuild();
+  return i;
+}
+
+void KDTree::toBuffer(int i) {
+  if (slot[i] >= 0) {
+    slotPoint[slot[i]] = -1;
+    slot[i] = -1;
+    numStale++;
+  }
+  if (bufferPos[i] < 0) {
+    bufferPos[i] = buffer.size();
+    buffer.push_back(i);
+  }
+}
+
+void KDTree::movePoint(int i, const Point3& p) {
+  if ((i < 0) || (i >= points.size()) || removed[i]) MstUtils::error("point " + MstUtils::toString(i) + " does not exist", "KDTree::movePoint");
+  toBuffer(i);
+  points[i] = p;
+  maybeRebuild();
+}
+
+void KDTree::removePoint(int i) {
+  if ((i < 0) || (i >= points.size()) || removed[i]) MstUtils::error("point " + MstUtils::toString(i) + " does not exist", "KDTree::removePoint");
+  toBuffer(i);
+  // swap the last buffer point into this one's place
+  int b = bufferPos[i], last = buffer.back();
+  buffer[b] = last; bufferPos[last] = b;
+  buffer.pop_back(); bufferPos[i] = -1;
+  removed[i] = true;
+  numRemoved++;
+  maybeRebuild();
+}
+
+void KDTree::maybeRebuild() {
+  // the linear scan of the buffer and the skipping of stale slots should stay
+  // cheap compared to the tree search itself
+  if (buffer.size() + numStale > max(32, (int) slotPoint.size()/4)) rebuild();
+}
+
+mstreal KDTree::boxDistance2(const node& n, const Point3& c) const {
+  mstreal d2 = 0;
+  for (int d = 0; d < 3; d++) {
+    mstreal e = (c[d] < n.lo[d]) ? n.lo[d] - c[d] : ((c[d] > n.hi[d]) ? c[d] - n.hi[d] : 0);
+    d2 += e*e;
+  }
+  return d2;
+}
+
+mstreal KDTree::boxFarDistance2(const node& n, const Point3& c) const {
+  mstreal d2 = 0;
+  for (int d = 0; d < 3; d++) {
+    mstreal e = max(fabs(c[d] - n.lo[d]), fabs(c[d] - n.hi[d]));
+    d2 += e*e;
+  }
+  return d2;
+}
+
+void KDTree::offerNearest(const Point3& c, int i, int k, vector<pair<mstreal, int> >& heap, mstreal& worst2) const {
+  pair<mstreal, int> cand(points[i].distance2(c), i);
+  if (cand.first > worst2) return;
+  if (heap.size() < k) {
+    heap.push_back(cand);
+    push_heap(heap.begin(), heap.end());
+  } else if (cand < heap.front()) {
+    pop_heap(heap.begin(), heap.end());
+    heap.back() = cand;
+    push_heap(heap.begin(), heap.end());
+  } else {
+    return;
+  }
+  if (heap.size() == k) worst2 = min(worst2, heap.front().first);
+}
+
+void KDTree::nearestInNode(int ni, const Point3& c, int k, vector<pair<mstreal, int> >& heap, mstreal& worst2) const {
+  const node& n = nodes[ni];
+  if (n.left < 0) {
+    for (int s = n.begin; s < n.end; s++) {
+      if (slotPoint[s] >= 0) offerNearest(c, slotPoint[s], k, heap, worst2);
+    }
+    return;
+  }
+  // visit the closer child first, so that the second one is more likely to be pruned
+  mstreal dl = boxDistance2(nodes[n.left], c), dr = boxDistance2(nodes[n.right], c);
+  int first = n.left, second = n.right;
+  if (dr < dl) { swap(first, second); swap(dl, dr); }
+  if (dl <= worst2) nearestInNode(first, c, k, heap, worst2);
+  if (dr <= worst2) nearestInNode(second, c, k, heap, worst2);
+}
+
+int KDTree::nearest(const Point3& c, int k, vector<int>& list, vector<mstreal>* dist2, bool byTag, mstreal dmax) const {
+  if (k <= 0) return 0;
+  vector<pair<mstreal, int> > heap;
+  heap.reserve(k);
+  mstreal worst2 = (dmax == numeric_limits<mstreal>::max()) ? dmax : dmax*dmax;
+  if (!nodes.empty()) nearestInNode(0, c, k, heap, worst2);
+  for (int b = 0; b < buffer.size(); b++) offerNearest(c, buffer[b], k, heap, worst2);
+  sort_heap(heap.begin(), heap.end());
+  for (int i = 0; i < heap.size(); i++) {
+    list.push_back(byTag ? tags[heap[i].second] : heap[i].second);
+    if (dist2 != NULL) dist2->push_back(heap[i].first);
+  }
+  return heap.size();
+}
+
+int KDTree::nearest(const Point3& c) const {
+  vector<int> list;
+  nearest(c, 1, list);
+  return list.empty() ? -1 : list[0];
+}
+
+int KDTree::pointsWithin(const Point3& c, mstreal dmin, mstreal dmax, vector<int>& list, bool byTag) const {
+  int n0 = list.size();
+  forEachWithin(c, dmin, dmax, [&](int i, mstreal d2) { list.push_back(byTag ? tags[i] : i); });
+  return list.size() - n0;
+}
+
+bool KDTree::anyWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+  return !forEachWithin(c, dmin, dmax, [](int i, mstreal d2) { return false; });
+}
+
+int KDTree::numPointsWithin(const Point3& c, mstreal dmin, mstreal dmax) const {
+  int n = 0;
+  forEachWithin(c, dmin, dmax, [&n](int i, mstreal d2) { n++; });
+  return n;
+}
+
+void KDTree::pointsWithin(const vector<Point3>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  batchQuery(centers.size(), numThreads, offsets, list, [&](int q, vector<int>& out) { return pointsWithin(centers[q], dmin, dmax, out, byTag); });
+}
+
+void KDTree::pointsWithin(const vector<Atom*>& centers, mstreal dmin, mstreal dmax, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  batchQuery(centers.size(), numThreads, offsets, list, [&](int q, vector<int>& out) { return pointsWithin(Point3(centers[q]), dmin, dmax, out, byTag); });
+}
+
+void KDTree::nearest(const vector<Point3>& centers, int k, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  batchQuery(centers.size(), numThreads, offsets, list, [&](int q, vector<int>& out) { return nearest(centers[q], k, out, NULL, byTag); });
+}
+
+void KDTree::nearest(const vector<Atom*>& centers, int k, vector<int>& offsets, vector<int>& list, bool byTag, int numThreads) const {
+  batchQuery(centers.size(), numThreads, offsets, list, [&](int q, vector<int>& out) { return nearest(Point3(centers[q]), k, out, NULL, byTag); });
+}
+
+/* --------- RangeSearch --------- */
+RangeSearch::RangeSearch(const vector<Atom*>& atoms, mstreal queryDist, const vector<int>* tags) {
+  vector<Point3> P(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) P[i] = Point3(atoms[i]);
+  init(P, queryDist, tags);
+}
+
+RangeSearch::RangeSearch(const vector<Point3>& points, mstreal queryDist, const vector<int>* tags) {
+  init(points, queryDist, tags);
+}
+
+void RangeSearch::init(const vector<Point3>& points, mstreal queryDist, const vector<int>* tags) {
+  if (queryDist <= 0) MstUtils::error("query distance must be positive", "RangeSearch::init");
+  // count the cells of query-distance size that are occupied, and use a grid if
+  // a good fraction of the cells in the bounding box would be
+  Point3 lo, hi;
+  if (!points.empty()) lo = hi = points[0];
+  for (int i = 0; i < points.size(); i++) {
+    for (int d = 0; d < 3; d++) { lo[d] = min(lo[d], points[i][d]); hi[d] = max(hi[d], points[i][d]); }
+  }
+  long dim[3], numCells = 1;
+  for (int d = 0; d < 3; d++) {
+    dim[d] = long(min((hi[d] - lo[d]) / queryDist, (mstreal) 1E6)) + 1;
+    numCells = min(numCells * dim[d], (long) 1E15);
+  }
+  useGrid = false;
+  if (numCells <= 8L*points.size() + 64) {
+    vector<long> occupied(points.size());
+    for (int i = 0; i < points.size(); i++) {
+      long c[3];
+      for (int d = 0; d < 3; d++) c[d] = min(long((points[i][d] - lo[d]) / queryDist), dim[d] - 1);
+      occupied[i] = (c[0]*dim[1] + c[1])*dim[2] + c[2];
+    }
+    sort(occupied.begin(), occupied.end());
+    useGrid = (unique(occupied.begin(), occupied.end()) - occupied.begin() >= numCells/4);
+  }
+  if (useGrid) {
+    vector<mstreal> coords(3*points.size());
+    for (int i = 0; i < points.size(); i++) {
+      for (int d = 0; d < 3; d++) coords[3*i + d] = points[i][d];
+    }
+    grid = CellList(coords, queryDist, tags);
+  } else {
+    tree = KDTree(points, tags);
+  }
+}
+
 /* --------- Clusterer --------- */
 vector<vector<int>> Clusterer::greedyCluster(const vector<vector<Atom*>>& units, mstreal rmsdCut, int Nmax, mstreal coverage, int maxClusters, bool verbose) {
   vector<vector<int>> clusters;
@@ -3405,11 +4994,33 @@ vector<vector<int>> Clusterer::greedyCluster(const vector<vector<Atom*>>& units,
 
 vector<vector<int> > Clusterer::greedyClusterBruteForce(const vector<vector<Atom*> >& units, set<int> remIndices, mstreal rmsdCut, int nClusts) {
   vector<vector<int> > clusters;
+
+  // with optimal alignment, pack the coordinates of the units to be clustered,
+  // so that RMSDs can be computed in batches
+  vector<mstreal> coords;
+  vector<const mstreal*> packed;
+  int n = remIndices.empty() ? 0 : units[*(remIndices.begin())].size();
+  bool batch = optimAlign && (n > 0);
+  for (auto it = remIndices.begin(); batch && (it != remIndices.end()); ++it) batch = (units[*it].size() == n);
+  if (batch) {
+    coords.resize(3*n*remIndices.size());
+    packed.resize(units.size(), NULL);
+    int k = 0;
+    for (auto it = remIndices.begin(); it != remIndices.end(); ++it) {
+      packed[*it] = coords.data() + 3*k;
+      for (int i = 0; i < n; i++, k++) {
+        for (int d = 0; d < 3; d++) coords[3*k + d] = (*(units[*it][i]))[d];
+      }
+    }
+  }
+
+  if (indexed) return greedyClusterIndexed(units, batch ? packed : vector<const mstreal*>(), n, remIndices, rmsdCut, nClusts);
+
   while (remIndices.size() != 0) {
     // pick the best current centroid
     vector<int> bestClust;
     for (auto it = remIndices.begin(); it != remIndices.end(); ++it) {
-      vector<int> clust = elementsWithin(units, remIndices, units[*it], rmsdCut);
+      vector<int> clust = batch ? elementsWithin(packed, n, remIndices, *it, rmsdCut) : elementsWithin(units, remIndices, units[*it], rmsdCut);
       if (clust.size() > bestClust.size()) {
         bestClust = clust;
       }
@@ -3425,12 +5036,48 @@ vector<vector<int> > Clusterer::greedyClusterBruteForce(const vector<vector<Atom
 }
 
 vector<int> Clusterer::elementsWithin(const vector<vector<Atom*> >& units, set<int>& remIndices, const vector<Atom*>& fromUnit, mstreal rmsdCut) {
+  vector<int> rem(remIndices.begin(), remIndices.end());
+  vector<mstreal> all(rem.size());
+  vector<RMSDCalculator> calcs(numThreads);
+  vector<pair<int, int> > blocks = MstUtils::splitTasks(rem.size(), MstUtils::max(1, MstUtils::min((int) rem.size(), 4*numThreads)));
+  MstUtils::parallelFor(blocks.size(), numThreads, [&](int b, int w) {
+    for (int i = blocks[b].first; i <= blocks[b].second; i++) {
+      all[i] = optimAlign ? calcs[w].bestRMSD(fromUnit, units[rem[i]]) : RMSDCalculator::rmsd(fromUnit, units[rem[i]]);
+    }
+  });
   vector<int> neigh; vector<mstreal> rmsds;
+  for (int i = 0; i < rem.size(); i++) {
+    if (all[i] <= rmsdCut) {
+      neigh.push_back(rem[i]);
+      rmsds.push_back(all[i]);
+    }
+  }
+
+  // sort by ascending RMSD
+  vector<int> si = MstUtils::sortIndices(rmsds);
+  vector<int> orderedNeigh = neigh;
+  for (int i = 0; i < si.size(); i++) {
+    orderedNeigh[i] = neigh[si[i]];
+  }
+
+  return orderedNeigh;
+}
+
+vector<int> Clusterer::elementsWithin(const vector<const mstreal*>& packed, int n, set<int>& remIndices, int fromIdx, mstreal rmsdCut) {
+  vector<const mstreal*> cands;
+  vector<int> candIdx;
   for (auto it = remIndices.begin(); it != remIndices.end(); ++it) {
-    mstreal r = optimAlign ? rCalc.bestRMSD(fromUnit, units[*it]) : rCalc.rmsd(fromUnit, units[*it]);
-    if (r <= rmsdCut) {
-      neigh.push_back(*it);
-      rmsds.push_back(r);
+    cands.push_back(packed[*it]);
+    candIdx.push_back(*it);
+  }
+  vector<mstreal> all(cands.size());
+  rCalc.qcpRMSDBatch(packed[fromIdx], n, cands.data(), cands.size(), all.data());
+
+  vector<int> neigh; vector<mstreal> rmsds;
+  for (int i = 0; i < all.size(); i++) {
+    if (all[i] <= rmsdCut) {
+      neigh.push_back(candIdx[i]);
+      rmsds.push_back(all[i]);
     }
   }
 
@@ -3444,6 +5091,195 @@ vector<int> Clusterer::elementsWithin(const vector<vector<Atom*> >& units, set<i
   return orderedNeigh;
 }
 
+/* RMSDs from one clustered unit to others, computed the same way as in
+ * Clusterer::elementsWithin: in batches over packed coordinates if these are
+ * given (optimal alignment), or one at a time otherwise. */
+class unitDistances {
+  public:
+    unitDistances(const vector<vector<Atom*> >& _units, const vector<const mstreal*>& _packed, int _n, bool _optimAlign) : units(_units), packed(_packed), n(_n), optimAlign(_optimAlign) {}
+
+    void operator()(RMSDCalculator& rc, int from, const vector<int>& to, vector<mstreal>& out) const {
+      out.resize(to.size());
+      if (!packed.empty()) {
+        vector<const mstreal*> cands(to.size());
+        for (int i = 0; i < to.size(); i++) cands[i] = packed[to[i]];
+        rc.qcpRMSDBatch(packed[from], n, cands.data(), cands.size(), out.data());
+      } else {
+        for (int i = 0; i < to.size(); i++) out[i] = optimAlign ? rc.bestRMSD(units[from], units[to[i]]) : RMSDCalculator::rmsd(units[from], units[to[i]]);
+      }
+    }
+    mstreal operator()(RMSDCalculator& rc, int from, int to) const {
+      vector<mstreal> out;
+      (*this)(rc, from, vector<int>(1, to), out);
+      return out[0];
+    }
+
+  private:
+    const vector<vector<Atom*> >& units;
+    const vector<const mstreal*>& packed;
+    int n;
+    bool optimAlign;
+};
+
+/* A vantage-point tree over units, with RMSD as the metric. Each inner node
+ * splits its units into those within the median RMSD mu of its vantage point
+ * and those beyond, so that a query can skip a side whenever the triangle
+ * inequality places all of its units outside the query radius. */
+class rmsdVPTree {
+  public:
+    rmsdVPTree(const unitDistances& _dist, const vector<int>& items, int numThreads) : dist(_dist), rng(1) {
+      calcs.resize(numThreads);
+      build(items);
+    }
+
+    /* Appends to cands the units that may be within radius of unit from (a
+     * superset of those that are); slack absorbs round-off in the RMSDs, which
+     * are not exactly symmetric. */
+    void candidates(RMSDCalculator& rc, int from, mstreal radius, vector<int>& cands) const {
+      const mstreal slack = 10E-4;
+      vector<int> stack(1, 0);
+      while (!stack.empty()) {
+        const node& nd = nodes[stack.back()];
+        stack.pop_back();
+        if (nd.vp < 0) {
+          cands.insert(cands.end(), nd.bucket.begin(), nd.bucket.end());
+          continue;
+        }
+        mstreal d = dist(rc, from, nd.vp);
+        if (d <= radius + slack) cands.push_back(nd.vp);
+        if (d - nd.mu <= radius + slack) stack.push_back(nd.inside);
+        if (nd.mu - d <= radius + slack) stack.push_back(nd.outside);
+      }
+    }
+
+  private:
+    struct node {
+      int vp;             // vantage point (-1 for leaves)
+      mstreal mu;         // median RMSD from the vantage point
+      int inside, outside;
+      vector<int> bucket; // units of a leaf
+    };
+
+    int build(const vector<int>& items) {
+      int ni = nodes.size();
+      nodes.push_back(node());
+      nodes[ni].vp = -1;
+      if (items.size() <= 16) {
+        nodes[ni].bucket = items;
+        return ni;
+      }
+      // RMSDs from a random vantage point to all other units, in parallel blocks
+      int v = uniform_int_distribution<int>(0, items.size() - 1)(rng);
+      vector<int> rest;
+      for (int i = 0; i < items.size(); i++) {
+        if (i != v) rest.push_back(items[i]);
+      }
+      vector<mstreal> d(rest.size());
+      int numBlocks = (rest.size() < 1024) ? 1 : MstUtils::min((int) rest.size()/256, 4*(int) calcs.size());
+      vector<pair<int, int> > blocks = MstUtils::splitTasks(rest.size(), numBlocks);
+      MstUtils::parallelFor(blocks.size(), calcs.size(), [&](int b, int w) {
+        vector<int> to(rest.begin() + blocks[b].first, rest.begin() + blocks[b].second + 1);
+        vector<mstreal> out;
+        dist(calcs[w], items[v], to, out);
+        copy(out.begin(), out.end(), d.begin() + blocks[b].first);
+      });
+      vector<mstreal> sorted = d;
+      nth_element(sorted.begin(), sorted.begin() + sorted.size()/2, sorted.end());
+      mstreal mu = sorted[sorted.size()/2];
+      vector<int> in, out;
+      for (int i = 0; i < rest.size(); i++) (d[i] <= mu ? in : out).push_back(rest[i]);
+      if (out.empty()) {
+        // all units are equally far from the vantage point, so can not split
+        nodes[ni].bucket = items;
+        return ni;
+      }
+      int inside = build(in), outside = build(out);
+      nodes[ni].vp = items[v]; nodes[ni].mu = mu;
+      nodes[ni].inside = inside; nodes[ni].outside = outside;
+      return ni;
+    }
+
+    const unitDistances& dist;
+    vector<node> nodes;
+    vector<RMSDCalculator> calcs;
+    mt19937 rng;
+};
+
+void Clusterer::findNeighbors(const vector<vector<Atom*> >& units, const vector<const mstreal*>& packed, int n, const vector<int>& indices, mstreal rmsdCut, vector<vector<pair<int, mstreal> > >& neighbors) {
+  unitDistances dist(units, packed, n, optimAlign);
+  rmsdVPTree tree(dist, indices, numThreads);
+  neighbors.clear();
+  neighbors.resize(indices.size());
+  vector<RMSDCalculator> calcs(numThreads);
+  MstUtils::parallelFor(indices.size(), numThreads, [&](int i, int w) {
+    vector<int> cands; vector<mstreal> rmsds;
+    tree.candidates(calcs[w], indices[i], rmsdCut, cands);
+    sort(cands.begin(), cands.end());
+    dist(calcs[w], indices[i], cands, rmsds);
+    for (int k = 0; k < cands.size(); k++) {
+      if (rmsds[k] <= rmsdCut) neighbors[i].push_back(pair<int, mstreal>(cands[k], rmsds[k]));
+    }
+  });
+}
+
+vector<vector<int> > Clusterer::greedyClusterIndexed(const vector<vector<Atom*> >& units, const vector<const mstreal*>& packed, int n, const set<int>& remIndices, mstreal rmsdCut, int nClusts) {
+  vector<int> indices(remIndices.begin(), remIndices.end());
+  vector<vector<pair<int, mstreal> > > neighbors;
+  findNeighbors(units, packed, n, indices, rmsdCut, neighbors);
+
+  // units are referred to by position in indices from here on; for each unit,
+  // which units have it as a neighbor, and the number of remaining neighbors
+  map<int, int> position;
+  for (int i = 0; i < indices.size(); i++) position[indices[i]] = i;
+  vector<vector<int> > neighborOf(indices.size());
+  for (int i = 0; i < indices.size(); i++) {
+    for (int k = 0; k < neighbors[i].size(); k++) {
+      neighbors[i][k].first = position[neighbors[i][k].first];
+      neighborOf[neighbors[i][k].first].push_back(i);
+    }
+  }
+  // ordered by decreasing count and then by increasing index, so that the first
+  // unit is the one the brute-force search would pick
+  vector<int> count(indices.size());
+  set<pair<int, int> > byCount;
+  for (int i = 0; i < indices.size(); i++) {
+    count[i] = neighbors[i].size();
+    byCount.insert(pair<int, int>(-count[i], i));
+  }
+
+  vector<vector<int> > clusters;
+  vector<bool> taken(indices.size(), false);
+  while (!byCount.empty()) {
+    int best = byCount.begin()->second;
+    vector<int> neigh; vector<mstreal> rmsds;
+    for (int k = 0; k < neighbors[best].size(); k++) {
+      int j = neighbors[best][k].first;
+      if (taken[j]) continue;
+      neigh.push_back(j);
+      rmsds.push_back(neighbors[best][k].second);
+    }
+    if (neigh.empty()) break; // only with a negative cutoff
+    // sorted by ascending RMSD, as in elementsWithin
+    vector<int> si = MstUtils::sortIndices(rmsds);
+    vector<int> clust(neigh.size());
+    for (int i = 0; i < si.size(); i++) clust[i] = indices[neigh[si[i]]];
+    clusters.push_back(clust);
+
+    for (int j : neigh) {
+      taken[j] = true;
+      byCount.erase(pair<int, int>(-count[j], j));
+      for (int i : neighborOf[j]) {
+        if (taken[i]) continue;
+        byCount.erase(pair<int, int>(-count[i], i));
+        count[i]--;
+        byCount.insert(pair<int, int>(-count[i], i));
+      }
+    }
+    if ((nClusts > 0) && (clusters.size() >= nClusts)) break;
+  }
+  return clusters;
+}
+
 set<int> Clusterer::randomSubsample(set<int>& indices, int N) {
   if (N > indices.size())
     MstUtils::error("asked for a subsample of " + MstUtils::toString(N) + " elements from an array of " + MstUtils::toString(indices.size()) + " elements", "Clusterer::randomSubsample");
@@ -3532,6 +5368,57 @@ void MstUtils::fileToArray(const string& _filename, vector<string>& lines) {
   }
 }
 
+void MstUtils::fileToString(const string& filename, string& contents, string from) {
+  contents.clear();
+  FILE* f = MstUtils::openFileC(filename.c_str(), "rb", from + "MstUtils::fileToString");
+  // one read for regular files, in large blocks for anything else
+  struct stat st;
+  if ((fstat(fileno(f), &st) == 0) && S_ISREG(st.st_mode)) {
+    contents.resize(st.st_size);
+    size_t n = fread(&contents[0], 1, contents.size(), f);
+    contents.resize(n);
+  } else {
+    char block[1 << 16];
+    size_t n;
+    while ((n = fread(block, 1, sizeof(block), f)) > 0) contents.append(block, n);
+  }
+  fclose(f);
+  if ((contents.size() < 2) || ((unsigned char) contents[0] != 0x1f) || ((unsigned char) contents[1] != 0x8b)) return;
+
+  // gzip-compressed
+#ifdef MST_ZLIB
+  string compressed; compressed.swap(contents);
+  z_stream zs; memset(&zs, 0, sizeof(zs));
+  if (inflateInit2(&zs, 15 + 32) != Z_OK) MstUtils::error("could not initialize zlib", from + "MstUtils::fileToString");
+  zs.next_in = (Bytef*) compressed.data();
+  zs.avail_in = compressed.size();
+  char block[1 << 16];
+  int ret;
+  do {
+    zs.next_out = (Bytef*) block;
+    zs.avail_out = sizeof(block);
+    ret = inflate(&zs, Z_NO_FLUSH);
+    if ((ret != Z_OK) && (ret != Z_STREAM_END) && (ret != Z_BUF_ERROR)) break;
+    contents.append(block, sizeof(block) - zs.avail_out);
+    // concatenated gzip members
+    if ((ret == Z_STREAM_END) && (zs.avail_in > 0)) { inflateReset(&zs); ret = Z_OK; }
+  } while ((ret != Z_STREAM_END) && !((ret == Z_BUF_ERROR) && (zs.avail_in == 0)));
+  inflateEnd(&zs);
+  if (ret != Z_STREAM_END) MstUtils::error("failed to decompress '" + filename + "'", from + "MstUtils::fileToString");
+#else
+  contents.clear();
+  string quoted;
+  for (int i = 0; i < filename.size(); i++) quoted += (filename[i] == '\'') ? string("'\\''") : string(1, filename[i]);
+  string cmd = "gzip -dc '" + quoted + "'";
+  FILE* p = popen(cmd.c_str(), "r");
+  if (p == NULL) MstUtils::error("could not run '" + cmd + "'", from + "MstUtils::fileToString");
+  char block[1 << 16];
+  size_t n;
+  while ((n = fread(block, 1, sizeof(block), p)) > 0) contents.append(block, n);
+  if (pclose(p) != 0) MstUtils::error("failed to decompress '" + filename + "'", from + "MstUtils::fileToString");
+#endif
+}
+
 string MstUtils::nextToken(string& str, string delimiters, bool skipTrailingDelims) {
   string ret; int i;
   if (!delimiters.empty()) {
@@ -3877,3 +5764,106 @@ vector<pair<int, int> > MstUtils::splitTasks(int numTasks, int numJobs) {
   if (k != numTasks) MstUtils::error("something went very wrong!", "MstUtils::splitTasks(int, int)");
   return division;
 }
+
+void MstUtils::parallelFor(int numTasks, int numThreads, const function<void(int, int)>& task) {
+  int numWorkers = MstUtils::min(numThreads, numTasks);
+  if (numWorkers <= 1) {
+    for (int i = 0; i < numTasks; i++) task(i, 0);
+    return;
+  }
+  atomic<int> next(0);
+  vector<exception_ptr> errors(numWorkers);
+  vector<thread> workers;
+  for (int w = 0; w < numWorkers; w++) {
+    workers.push_back(thread([&, w]() {
+      try {
+        for (int i = next++; i < numTasks; i = next++) task(i, w);
+      } catch (...) {
+        errors[w] = current_exception();
+        next = numTasks; // have the other workers stop early
+      }
+    }));
+  }
+  for (int w = 0; w < numWorkers; w++) workers[w].join();
+  for (int w = 0; w < numWorkers; w++) {
+    if (errors[w]) rethrow_exception(errors[w]);
+  }
+}
+
+/* --------- MstProfiler --------- */
+atomic<bool> MstProfiler::enabled(false);
+mutex MstProfiler::lock;
+map<string, MstProfiler::entry> MstProfiler::entries;
+string MstProfiler::outFile;
+
+// turns on profiling at start-up if MST_PROFILE is set
+static struct profilerFromEnvironment {
+  profilerFromEnvironment() {
+    const char* file = getenv("MST_PROFILE");
+    if ((file != NULL) && (strlen(file) > 0)) MstProfiler::enable(file);
+  }
+} profilerFromEnvironmentInstance;
+
+void MstProfiler::enable(const string& file) {
+  lock_guard<mutex> guard(lock);
+  static bool registered = false;
+  if (!file.empty()) {
+    outFile = file;
+    if (!registered) { atexit(MstProfiler::write); registered = true; }
+  }
+  enabled = true;
+}
+
+void MstProfiler::addTime(const string& name, double seconds) {
+  lock_guard<mutex> guard(lock);
+  entry& e = entries[name];
+  e.calls++;
+  e.total += seconds;
+  if (seconds > e.max) e.max = seconds;
+}
+
+void MstProfiler::addCount(const string& name, long n) {
+  if (!enabled) return;
+  lock_guard<mutex> guard(lock);
+  entries[name].count += n;
+}
+
+void MstProfiler::reset() {
+  lock_guard<mutex> guard(lock);
+  entries.clear();
+}
+
+void MstProfiler::writeJSON(ostream& os) {
+  lock_guard<mutex> guard(lock);
+  os << "{" << endl;
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    const entry& e = it->second;
+    os << "  \"" << it->first << "\": {\"calls\": " << e.calls << ", \"total_s\": " << e.total << ", \"max_s\": " << e.max << ", \"count\": " << e.count << "}";
+    os << ((next(it) == entries.end()) ? "" : ",") << endl;
+  }
+  os << "}" << endl;
+}
+
+void MstProfiler::writeCSV(ostream& os) {
+  lock_guard<mutex> guard(lock);
+  os << "name,calls,total_s,max_s,count" << endl;
+  for (auto it = entries.begin(); it != entries.end(); ++it) {
+    const entry& e = it->second;
+    os << it->first << "," << e.calls << "," << e.total << "," << e.max << "," << e.count << endl;
+  }
+}
+
+void MstProfiler::write() {
+  if (outFile.empty()) return;
+  bool csv = (outFile.size() >= 4) && (outFile.substr(outFile.size() - 4) == ".csv");
+  if (outFile == "-") {
+    writeJSON(cerr);
+    return;
+  }
+  fstream of;
+  of.open(outFile.c_str(), ios::out);
+  if (!of.is_open()) { cerr << "MstProfiler: could not open " << outFile << " for writing" << endl; return; }
+  if (csv) writeCSV(of);
+  else writeJSON(of);
+  of.close();
+}
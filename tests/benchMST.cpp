@@ -0,0 +1,210 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstsystem.h"
+#include "msttransforms.h"
+#include "mstfasst.h"
+#include "mstrotlib.h"
+#include "mstcondeg.h"
+#include "mstfuser.h"
+#include "dtermen.h"
+#include <sys/resource.h>
+
+/* Benchmark suite (see `make bench`). Each benchmark repeats an operation until
+ * it has run for at least the requested time, and reports the mean wall time
+ * and heap allocations per operation and the peak resident set size of the
+ * process so far. Inputs are fixed files from testfiles/ and a fixed random
+ * seed, so runs are comparable across releases and machines (as long as the
+ * build flags are the same). */
+
+// count heap allocations made through operator new
+static atomic<long> numAllocs(0);
+void* operator new(size_t n) {
+  numAllocs++;
+  void* p = malloc((n == 0) ? 1 : n);
+  if (p == NULL) throw bad_alloc();
+  return p;
+}
+void operator delete(void* p) noexcept { free(p); }
+
+struct benchResult {
+  string name, type;
+  long iterations;
+  double nsPerOp, allocsPerOp;
+  long peakRSS; // in KB
+};
+
+class benchSuite {
+  public:
+    benchSuite(mstreal _minTime, const string& _filter) { minTime = _minTime; filter = _filter; }
+
+    /* Runs op (which performs opsPerCall operations) once to warm up, and then
+     * repeatedly, for at least minTime seconds. */
+    void run(const string& name, const string& type, int opsPerCall, const function<void()>& op) {
+      if (!filter.empty() && (name.find(filter) == string::npos)) return;
+      op();
+      long iters = 0, allocs = numAllocs;
+      auto begin = chrono::steady_clock::now();
+      double elapsed = 0;
+      do {
+        op();
+        iters++;
+        elapsed = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+      } while (elapsed < minTime);
+      allocs = numAllocs - allocs;
+      struct rusage usage; getrusage(RUSAGE_SELF, &usage);
+      benchResult res;
+      res.name = name; res.type = type;
+      res.iterations = iters*opsPerCall;
+      res.nsPerOp = 1E9*elapsed/res.iterations;
+      res.allocsPerOp = ((double) allocs)/res.iterations;
+      res.peakRSS = usage.ru_maxrss;
+      results.push_back(res);
+      cerr << name << ": " << res.nsPerOp << " ns/op, " << res.allocsPerOp << " allocations/op (" << res.iterations << " ops)" << endl;
+    }
+
+    void writeJSON(ostream& os) {
+      os << "{" << endl;
+      os << "  \"host\": \"" << MstSys::getMachineName() << "\"," << endl;
+      os << "  \"min_time_s\": " << minTime << "," << endl;
+      os << "  \"benchmarks\": [" << endl;
+      for (int i = 0; i < results.size(); i++) {
+        const benchResult& r = results[i];
+        os << "    {\"name\": \"" << r.name << "\", \"type\": \"" << r.type << "\", \"iterations\": " << r.iterations
+           << ", \"ns_per_op\": " << r.nsPerOp << ", \"allocs_per_op\": " << r.allocsPerOp << ", \"peak_rss_kb\": " << r.peakRSS << "}"
+           << ((i < results.size() - 1) ? "," : "") << endl;
+      }
+      os << "  ]" << endl << "}" << endl;
+    }
+
+  private:
+    mstreal minTime;
+    string filter;
+    vector<benchResult> results;
+};
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Runs micro- and macro-benchmarks of MST, writing results as JSON. Options:");
+  op.addOption("t", "test files directory (default is testfiles/).");
+  op.addOption("out", "output JSON file (default is standard output).");
+  op.addOption("time", "minimal time to run each benchmark for, in seconds (default is 0.5).");
+  op.addOption("filter", "only run benchmarks whose names contain this string.");
+  op.addOption("dtermen", "a dTERMen configuration file; if given, also benchmarks building an energy table (which needs the FASST database named in the file).");
+  op.addOption("p", "the structure to build the dTERMen energy table for (default is small.pdb from the test files directory).");
+  op.setOptions(argc, argv);
+  string dir = op.getString("t", "testfiles/");
+  if (dir.back() != '/') dir += "/";
+  benchSuite suite(op.getReal("time", 0.5), op.getString("filter"));
+  MstUtils::seedRandEngine(1);
+
+  /* ---- micro-benchmarks ---- */
+  Structure S(dir + "1DC7.pdb");
+  AtomPointerVector bb = S.getAtoms();
+  vector<Atom*> CA;
+  for (int i = 0; i < bb.size(); i++) {
+    if (bb[i]->getName() == "CA") CA.push_back(bb[i]);
+  }
+
+  // QCP RMSD between a 20-residue window and a rotated, perturbed copy of it
+  vector<Atom*> winA(CA.begin(), CA.begin() + 20);
+  AtomPointerVector winB = AtomPointerVector(winA).clone();
+  Transform rot = TransformFactory::rotateAroundAxis(1, 2, 3, 40);
+  rot.apply(winB);
+  for (int i = 0; i < winB.size(); i++) {
+    winB[i]->setCoor(winB[i]->getX() + MstUtils::randNormal(0, 0.5), winB[i]->getY() + MstUtils::randNormal(0, 0.5), winB[i]->getZ() + MstUtils::randNormal(0, 0.5));
+  }
+  RMSDCalculator RC;
+  volatile mstreal sink = 0;
+  suite.run("qcp_rmsd_20ca", "micro", 1000, [&]() { for (int k = 0; k < 1000; k++) sink = RC.bestRMSD(winA, winB); });
+  winB.deletePointers();
+
+  // ProximitySearch queries around random points within the structure
+  ProximitySearch PS(bb, 4.0);
+  vector<CartesianPoint> probes;
+  for (int i = 0; i < 1000; i++) probes.push_back(bb[MstUtils::randInt(0, bb.size() - 1)]->getCoor());
+  vector<int> found;
+  suite.run("proximity_search_8A", "micro", probes.size(), [&]() {
+    for (int k = 0; k < probes.size(); k++) { found.clear(); PS.pointsWithin(probes[k], 0, 8.0, &found); }
+  });
+
+  // applying a rigid-body transform to all atoms
+  Structure moved = S;
+  AtomPointerVector movedAtoms = moved.getAtoms();
+  suite.run("transform_apply_atom", "micro", movedAtoms.size(), [&]() { rot.apply(movedAtoms); });
+
+  // PDB parsing
+  suite.run("pdb_parse_1DC7", "micro", 1, [&]() { Structure P(dir + "1DC7.pdb"); sink = P.residueSize(); });
+
+  // scoring single mutations with a compiled, synthetic energy table
+  EnergyTable E;
+  vector<string> alpha = {"ALA", "ARG", "ASN", "ASP", "CYS", "GLN", "GLU", "GLY", "HIS", "ILE", "LEU", "LYS", "MET", "PHE", "PRO", "SER", "THR", "TRP", "TYR", "VAL"};
+  int numSites = 50;
+  for (int s = 0; s < numSites; s++) {
+    E.addSite("A," + MstUtils::toString(s + 1));
+    E.setSiteAlphabet(s, alpha);
+    for (int a = 0; a < alpha.size(); a++) E.setSelfEnergy(s, a, MstUtils::randUnit());
+  }
+  for (int si = 0; si < numSites; si++) {
+    for (int sj = si + 1; sj < MstUtils::min(si + 5, numSites); sj++) {
+      for (int ai = 0; ai < alpha.size(); ai++) {
+        for (int aj = 0; aj < alpha.size(); aj++) E.setPairEnergy(si, sj, ai, aj, MstUtils::randUnit() - 0.5);
+      }
+    }
+  }
+  E.compile();
+  vector<int> sol = E.randomSolution(), mutSites(1000), mutAAs(1000);
+  for (int i = 0; i < mutSites.size(); i++) { mutSites[i] = MstUtils::randInt(0, numSites - 1); mutAAs[i] = E.randomResidue(mutSites[i]); }
+  suite.run("energy_table_score_mutation", "micro", mutSites.size(), [&]() {
+    for (int k = 0; k < mutSites.size(); k++) sink = E.scoreMutation(sol, mutSites[k], mutAAs[k]);
+  });
+
+  /* ---- macro-benchmarks ---- */
+  // FASST search for a two-segment query over a fixed slice of test structures
+  FASST F;
+  vector<string> dbFiles = {"1ZTA.pdb", "small.pdb", "1DC7.pdb", "1DC8.pdb"};
+  for (int i = 0; i < dbFiles.size(); i++) F.addTarget(dir + dbFiles[i]);
+  vector<Residue*> residues = S.getResidues(), queryRes;
+  for (int i = 10; i < 20; i++) queryRes.push_back(residues[i]);
+  for (int i = 40; i < 50; i++) queryRes.push_back(residues[i]);
+  Structure query = Structure(queryRes).reassignChainsByConnectivity();
+  F.setQuery(query);
+  F.setRMSDCutoff(2.0);
+  suite.run("fasst_search_2seg", "macro", 1, [&]() { F.search(); });
+
+  // ConFind caching of the whole structure (building rotamers and contacts)
+  RotamerLibrary RL(dir + "rotlib.bin");
+  Structure small(dir + "small.pdb");
+  suite.run("confind_cache_small", "macro", 1, [&]() { ConFind C(&RL, small); C.cache(small); });
+
+  // a fusion run, joining two chains through a bridge (as in testFuser)
+  Structure unitA(dir + "heptad.0388_0001.pdb"), unitB(dir + "heptad.0388_0007.pdb"), bridge(dir + "heptad.0388_0014.pdb");
+  Chain& chainA = unitA[1]; Chain& chainB = unitB[0]; Chain& chainBridge = bridge[0];
+  int overlapN = 2, overlapC = 2;
+  int L = chainA.residueSize() + chainB.residueSize() + chainBridge.residueSize() - overlapN - overlapC;
+  vector<vector<Residue*> > resTopo(L);
+  for (int i = 0; i < chainA.residueSize(); i++) resTopo[i].push_back(&(chainA[i]));
+  for (int i = 0; i < chainBridge.residueSize(); i++) resTopo[i + chainA.residueSize() - overlapN].push_back(&(chainBridge[i]));
+  for (int i = 0; i < chainB.residueSize(); i++) resTopo[i + chainA.residueSize() + chainBridge.residueSize() - overlapN - overlapC].push_back(&(chainB[i]));
+  vector<int> fixed;
+  for (int i = 0; i < chainA.residueSize() - overlapN; i++) fixed.push_back(i);
+  for (int i = L - 1; i >= L - (chainB.residueSize() - overlapC); i--) fixed.push_back(i);
+  fusionParams params; params.setNumIters(200); params.setVerbose(false); params.setMinimizerType(fusionParams::conjGrad);
+  suite.run("fuser_fuse_bridge", "macro", 1, [&]() { fusionOutput scores; Structure fused = Fuser::fuse(resTopo, scores, fixed, params); });
+
+  // building a dTERMen energy table (only if a configuration is given)
+  if (op.isGiven("dtermen")) {
+    dTERMen D(op.getString("dtermen"));
+    Structure P(op.getString("p", dir + "small.pdb"));
+    vector<Residue*> variable = P.getResidues();
+    suite.run("dtermen_energy_table", "macro", 1, [&]() { EnergyTable T = D.buildEnergyTable(variable); });
+  }
+
+  if (op.isGiven("out")) {
+    fstream of;
+    MstUtils::openFile(of, op.getString("out"), ios::out);
+    suite.writeJSON(of);
+    of.close();
+  } else {
+    suite.writeJSON(cout);
+  }
+}
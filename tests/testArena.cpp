@@ -0,0 +1,74 @@
+#include "msttypes.h"
+
+using namespace MST;
+
+string pdbString(const Structure& S) {
+  stringstream ss;
+  S.writePDB(ss);
+  return ss.str();
+}
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    MstUtils::error("Usage: ./testArena [PDB file] [number of copies, optional]", "main");
+  }
+  string pdbFile(argv[1]);
+  int N = (argc > 2) ? atoi(argv[2]) : 200;
+
+  // structures read into an arena should be the same as those read normally
+  Structure S(pdbFile);
+  Structure SA(pdbFile, "ARENA");
+  MstArena* arena = SA.getArena();
+  if (arena == NULL) MstUtils::error("ARENA option did not give the structure an arena");
+  if (pdbString(S) != pdbString(SA)) MstUtils::error("structure read into arena differs from original");
+  AtomPointerVector atoms = SA.getAtoms();
+  bool inArena = MstArena::fromArena(atoms[0]);
+  cout << "read " << atoms.size() << " atoms, " << arena->bytesUsed() << " bytes in " << arena->numChunks() << " chunk(s) of arena" << (inArena ? "" : " (address space not available, using heap)") << endl;
+  if (inArena && MstArena::fromArena(S.getAtoms()[0])) MstUtils::error("heap atom reported as coming from an arena");
+
+  // copies share the arena; edits and deletions of arena objects must work as usual
+  Structure C = SA;
+  if (C.getArena() != arena) MstUtils::error("copy does not share the arena of the original");
+  Residue* res = new Residue(S.getResidue(0));
+  C.appendChain("Z", true)->appendResidue(res);
+  C.deleteChain(&(C[0]));
+  AtomPointerVector catoms = C.getAtoms();
+  for (int i = 0; i < catoms.size(); i++) catoms[i]->setName(catoms[i]->getName());
+  Structure H; H = C;
+  if (H.getArena() != NULL) MstUtils::error("assignment should not carry over the arena");
+  if (pdbString(H) != pdbString(C)) MstUtils::error("heap copy of arena structure differs");
+
+  // arena outlives its structures, as long as any of their objects are alive
+  Residue* cres = new Residue(SA.getResidue(1));
+  Atom* catom = new Atom(atoms[0]);
+  {
+    Structure tmp(pdbFile, "ARENA");
+    MstArena::Scope scope(tmp.getArena());
+    delete cres;
+    cres = new Residue(tmp.getResidue(1));
+  }
+  if (cres->atomSize() != SA.getResidue(1).atomSize()) MstUtils::error("residue from released arena is corrupt");
+  delete cres;
+  delete catom;
+
+  // timing of building and tearing down many copies, with and without a shared
+  // arena (as FASST does in arena mode)
+  for (int a = 0; a < 2; a++) {
+    vector<Structure*> copies(N);
+    MstArena* shared = a ? MstArena::create() : NULL;
+    timespec t0, t1, t2;
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    for (int i = 0; i < N; i++) {
+      copies[i] = new Structure();
+      copies[i]->setArena(shared);
+      *(copies[i]) = S;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    for (int i = 0; i < N; i++) delete copies[i];
+    if (shared != NULL) shared->release();
+    clock_gettime(CLOCK_MONOTONIC, &t2);
+    cout << (a ? "arena" : "heap") << ": " << N << " copies built in " << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1.0E9 << " s and deleted in " << (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec)/1.0E9 << " s" << endl;
+  }
+
+  printf("TEST DONE\n");
+}
@@ -41,6 +41,7 @@ int main(int argc, char *argv[]) {
   op.addOption("i", "input PDB file.");
   op.addOption("db", "binary FASST database.");
   op.addOption("ob", "optional: output base name. If given, will write clusters as PDB files.");
+  op.addOption("j", "optional: number of threads to cluster with (default 1).");
   op.setOptions(argc, argv);
 
   int w = op.getInt("w");
@@ -65,9 +66,19 @@ int main(int argc, char *argv[]) {
   }
   cout << "extracted " << windows.size() << " windows. Clustering..." << endl;
 
-  // cluster
+  // cluster, checking that the indexed clustering gives the same clusters as
+  // the brute-force one
   Clusterer C;
+  C.setNumThreads(op.getInt("j", 1));
+  timespec t0, t1, t2;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
   vector<vector<int> > clusters = C.greedyCluster(windows, rmsdCut, 1000);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  C.setIndexed(false);
+  vector<vector<int> > bruteClusters = C.greedyCluster(windows, rmsdCut, 1000);
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  if (clusters != bruteClusters) MstUtils::error("indexed clustering differs from brute force");
+  cout << "found " << clusters.size() << " clusters in " << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1.0E9 << " s (brute force: " << (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec)/1.0E9 << " s)" << endl;
 
   // output clusters
   RMSDCalculator rc;
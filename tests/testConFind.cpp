@@ -83,6 +83,7 @@ int main(int argc, char *argv[]) {
   op.addOption("verb", "optional: generate lots of detailed output (i.e., print the details of which rotamer pairs are in contact).");
   op.addOption("pf", "if flag specified, will print the name of the PDB file being analyzed next to all positional scores. This is especially convenient when a list of PDB file is specified as input and the output goes to a single file.");
   op.addOption("ren", "if flag specified, will renumber the structure before output. Useful for keeping track of residues in the output list of contacts if the input PDB file is strangely numbered.");
+  op.addOption("j", "optional: number of threads with which to build rotamers (default is 1).");
 
   op.setOptions(argc, argv);
   
@@ -142,6 +143,7 @@ int main(int argc, char *argv[]) {
     // Structure S; proteinOnly(S, So, legalNames);
     if (iopts.renumPDB) S.renumber();
     ConFind C(&RL, S);
+    C.setNumThreads(op.getInt("j", 1));
     if (!iopts.rotOutFile.empty()) C.openLogFile(iopts.rotOutFile, si > 0);
     if (iopts.freeB) {
       AtomPointerVector atoms = S.getAtoms();
@@ -183,6 +185,27 @@ int main(int argc, char *argv[]) {
       out << endl;
     }
 
+    // lookups should follow contacts as they are sorted, and the pair table
+    // should hold the degree of every contact, both ways
+    contactList sortedL = L;
+    sortedL.sortByDegree();
+    vector<int> rowLen, partners; vector<mstreal> vals;
+    sortedL.pairTable(S.residueSize(), rowLen, partners, vals);
+    vector<int> rowBeg(rowLen.size() + 1, 0);
+    for (int ri = 0; ri < rowLen.size(); ri++) rowBeg[ri + 1] = rowBeg[ri] + max(rowLen[ri], 0);
+    auto tableValue = [&](int ri, int rj) {
+      for (int k = rowBeg[ri]; k < rowBeg[ri + 1]; k++) { if (partners[k] == rj) return vals[k]; }
+      return (mstreal) -1;
+    };
+    for (int i = 0; i < sortedL.size(); i++) {
+      Residue* resA = sortedL.residueA(i);
+      Residue* resB = sortedL.residueB(i);
+      if ((i > 0) && (sortedL.degree(i) > sortedL.degree(i - 1))) MstUtils::error("contacts not sorted by degree");
+      if (!sortedL.areInContact(resA, resB) || !sortedL.areInContact(resB, resA)) MstUtils::error("sorted contact " + MstUtils::toString(i) + " not found by its residues");
+      if (sortedL.getContacts(resA, resB).count(i) == 0) MstUtils::error("sorted contact " + MstUtils::toString(i) + " not listed among those of its residues");
+      if ((tableValue(resA->getResidueIndex(), resB->getResidueIndex()) != sortedL.degree(i)) || (tableValue(resB->getResidueIndex(), resA->getResidueIndex()) != sortedL.degree(i))) MstUtils::error("pair table differs from contact " + MstUtils::toString(i));
+    }
+
     // print crowdedness
     for (int k = 0; k < allRes.size(); k++) {
       Residue* res = allRes[k];
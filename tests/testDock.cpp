@@ -0,0 +1,49 @@
+#include "msttypes.h"
+#include "mstdock.h"
+
+using namespace MST;
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    MstUtils::error("Usage: ./testDock [PDB file with at least two chains]", "main");
+  }
+  Structure S(argv[1]);
+  AtomPointerVector rec = S[0].getAtoms(), lig = S[1].getAtoms();
+  int n = 50;
+
+  // poses should not depend on the number of threads
+  RigidBodyDocker serial(rec, lig), threaded(rec, lig);
+  threaded.setNumThreads(4);
+  long serialFailed, threadedFailed;
+  MstUtils::seedRandEngine(11);
+  vector<Transform> serialPoses = serial.sample(n, &serialFailed);
+  MstUtils::seedRandEngine(11);
+  vector<Transform> threadedPoses = threaded.sample(n, &threadedFailed);
+  if ((serialPoses.size() != n) || (threadedPoses.size() != n) || (serialFailed != threadedFailed)) MstUtils::error("threaded sampling ran differently from serial sampling");
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < 4; j++) {
+      for (int k = 0; k < 4; k++) {
+        if (fabs(serialPoses[i](j, k) - threadedPoses[i](j, k)) > 10E-10) MstUtils::error("threaded sampling gave different poses than serial sampling");
+      }
+    }
+  }
+  cout << "accepted " << n << " poses after " << serialFailed << " failed trials, same with 1 and 4 threads" << endl;
+
+  // accepted poses should satisfy the clash and contact criteria, counted by brute force
+  for (int i = 0; i < n; i++) {
+    Structure docked(lig);
+    serialPoses[i].apply(docked);
+    AtomPointerVector moved = docked.getAtoms();
+    int clashes = 0, contacts = 0;
+    for (int a = 0; a < moved.size(); a++) {
+      for (int b = 0; b < rec.size(); b++) {
+        mstreal d = moved[a]->distance(rec[b]);
+        if (d <= 3.0) clashes++;
+        if ((d <= 8.0) && (moved[a]->getName() == "CA") && (rec[b]->getName() == "CA")) contacts++;
+      }
+    }
+    if ((clashes != serial.numClashes(serialPoses[i])) || (contacts != serial.numContacts(serialPoses[i]))) MstUtils::error("clash or contact counts of pose " + MstUtils::toString(i) + " differ from brute force");
+    if ((clashes > 3) || (contacts < 1)) MstUtils::error("pose " + MstUtils::toString(i) + " should not have been accepted");
+  }
+  cout << "all accepted poses satisfy the docking criteria" << endl;
+}
@@ -0,0 +1,118 @@
+#include "msttypes.h"
+#include "dtermen.h"
+#include "mstoptions.h"
+#include <chrono>
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Compares scoring with a compiled and a non-compiled EnergyTable and times both. Options:");
+  op.addOption("etab", "energy table file.", true);
+  op.addOption("n", "number of random mutations to score (default is 1000000).");
+  op.addOption("m", "number of random sequences to score in bulk (default is 100000).");
+  op.addOption("j", "number of threads for bulk scoring (default is 2).");
+  op.setOptions(argc, argv);
+  int N = op.getInt("n", 1000000), M = op.getInt("m", 100000);
+
+  EnergyTable E(op.getString("etab"));
+  EnergyTable C = E;
+  C.compile();
+  if (!C.isCompiled() || E.isCompiled()) MstUtils::error("unexpected compiled state");
+
+  // the same random walk, scored with both tables
+  vector<int> sol = E.randomSolution();
+  vector<int> sites(N), aas(N);
+  for (int i = 0; i < N; i++) {
+    sites[i] = MstUtils::randInt(0, E.numSites() - 1);
+    aas[i] = E.randomResidue(sites[i]);
+  }
+  vector<mstreal> dE(N), dC(N);
+  vector<int> solE = sol, solC = sol;
+  auto begin = chrono::high_resolution_clock::now();
+  for (int i = 0; i < N; i++) { dE[i] = E.scoreMutation(solE, sites[i], aas[i]); solE[sites[i]] = aas[i]; }
+  auto end = chrono::high_resolution_clock::now();
+  cout << "scoring " << N << " mutations took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms without compiling" << endl;
+  begin = chrono::high_resolution_clock::now();
+  for (int i = 0; i < N; i++) { dC[i] = C.scoreMutation(solC, sites[i], aas[i]); solC[sites[i]] = aas[i]; }
+  end = chrono::high_resolution_clock::now();
+  cout << "scoring " << N << " mutations took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms with compiling" << endl;
+  for (int i = 0; i < N; i++) {
+    if (dE[i] != dC[i]) MstUtils::error("mutation " + MstUtils::toString(i) + " scores " + MstUtils::toString(dE[i]) + " without compiling and " + MstUtils::toString(dC[i]) + " with");
+  }
+  if (E.scoreSolution(solE) != C.scoreSolution(solC)) MstUtils::error("solution scores differ with and without compiling");
+
+  // bulk scoring of random sequences, one of them not from the alphabet
+  vector<Sequence> seqs(M);
+  for (int i = 0; i < M; i++) seqs[i] = E.solutionToSequence(E.randomSolution());
+  seqs.push_back(Sequence(E.numSites() + 1));
+  begin = chrono::high_resolution_clock::now();
+  vector<mstreal> one(M);
+  for (int i = 0; i < M; i++) one[i] = C.scoreSequence(seqs[i]);
+  end = chrono::high_resolution_clock::now();
+  cout << "scoring " << M << " sequences one at a time took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  for (int j = 1; j <= op.getInt("j", 2); j++) {
+    begin = chrono::high_resolution_clock::now();
+    vector<mstreal> bulk = E.scoreSequences(seqs, j);
+    end = chrono::high_resolution_clock::now();
+    cout << "scoring " << M << " sequences in bulk on " << j << " thread(s) took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+    if (bulk.size() != seqs.size()) MstUtils::error("wrong number of bulk scores");
+    for (int i = 0; i < M; i++) {
+      if (bulk[i] != one[i]) MstUtils::error("sequence " + MstUtils::toString(i) + " scores " + MstUtils::toString(bulk[i]) + " in bulk and " + MstUtils::toString(one[i]) + " alone");
+    }
+    if (!std::isnan(bulk[M])) MstUtils::error("sequence of the wrong length did not score NaN");
+  }
+
+  // exact optimization on the table itself (with a budget, as dense tables are beyond it)
+  bool optimal;
+  begin = chrono::high_resolution_clock::now();
+  vector<vector<int>> best = E.optimalSolutions(5, 10, -1, &optimal);
+  end = chrono::high_resolution_clock::now();
+  cout << "DEE/A* found " << best.size() << " best solutions (" << (optimal ? "optimal" : "not provably optimal") << ") in " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms:" << endl;
+  for (int i = 0; i < best.size(); i++) cout << "\t" << E.solutionToSequence(best[i]).toString() << " " << E.scoreSolution(best[i]) << endl;
+  for (int i = 1; i < best.size(); i++) {
+    if (E.scoreSolution(best[i]) < E.scoreSolution(best[i-1]) - 10E-8) MstUtils::error("best solutions are not in order of energy");
+  }
+  vector<int> mcBest = E.mc(5, 100000, 1.0, 0.01);
+  if (optimal && (E.scoreSolution(mcBest) < E.scoreSolution(best[0]) - 10E-8)) MstUtils::error("Monte Carlo found a better solution than DEE/A*");
+
+  // exact optimization of small random tables should agree with exhaustive enumeration
+  for (int t = 0; t < 20; t++) {
+    EnergyTable R;
+    int L = MstUtils::randInt(2, 7);
+    for (int i = 0; i < L; i++) {
+      R.addSite("A," + MstUtils::toString(i));
+      int na = MstUtils::randInt(1, 4);
+      for (int a = 0; a < na; a++) R.addToSiteAlphabet(i, SeqTools::idxToTriple(a));
+      for (int a = 0; a < na; a++) R.setSelfEnergy(i, a, MstUtils::randUnit(-2, 2));
+    }
+    for (int i = 0; i < L; i++) {
+      for (int j = i + 1; j < L; j++) {
+        if (MstUtils::randUnit() < 0.5) continue;
+        for (int a = 0; a < R.getSiteAlphabet(i).size(); a++) {
+          for (int b = 0; b < R.getSiteAlphabet(j).size(); b++) R.setPairEnergy(i, j, a, b, MstUtils::randUnit(-2, 2));
+        }
+      }
+    }
+    vector<mstreal> all;
+    vector<int> sol(L, 0);
+    while (true) {
+      all.push_back(R.scoreSolution(sol));
+      int i = 0;
+      while ((i < L) && (++sol[i] == R.getSiteAlphabet(i).size())) { sol[i] = 0; i++; }
+      if (i == L) break;
+    }
+    sort(all.begin(), all.end());
+    int K = MstUtils::randInt(1, 10);
+    vector<vector<int>> top = R.optimalSolutions(K, -1, -1, &optimal);
+    if (!optimal || (top.size() != MstUtils::min(K, (int) all.size()))) MstUtils::error("exact optimization of a random table did not return " + MstUtils::toString(K) + " solutions");
+    for (int k = 0; k < top.size(); k++) {
+      if (fabs(R.scoreSolution(top[k]) - all[k]) > 10E-8) MstUtils::error("solution " + MstUtils::toString(k) + " of a random table has energy " + MstUtils::toString(R.scoreSolution(top[k])) + " rather than " + MstUtils::toString(all[k]));
+    }
+  }
+  cout << "exact optimization of random tables agrees with enumeration" << endl;
+
+  // compiled form goes away with any change
+  C.setPairEnergy(0, E.numSites() - 1, 0, 0, 1.0);
+  if (C.isCompiled()) MstUtils::error("table still compiled after a change");
+  cout << "TEST PASSED" << endl;
+  return 0;
+}
@@ -4,12 +4,22 @@
 #include "mstsystem.h"
 #include <chrono>
 
+// the same constraints, but evaluated on every target rather than looked up in
+// the sequence index of the database
+class scannedSeqConst : public fasstSeqConstSimple {
+  public:
+    scannedSeqConst(const fasstSeqConstSimple& C) : fasstSeqConstSimple(C) {}
+    fasstSeqConst* clone() const { return new scannedSeqConst(*this); }
+    bool positionalConstraints(int segIdx, vector<int>& pos, vector<set<res_t> >& allowed) { return false; }
+};
+
 int main(int argc, char *argv[]) {
   MstOptions op;
   op.setTitle("Implements the FASST (FAst Structure Search Algorithm). Options:");
   op.addOption("q", "query PDB file.", true);
   op.addOption("d", "a database file with a list of PDB files.");
   op.addOption("b", "a binary database file. If both --d and --b are given, will overwrite this file with a corresponding binary database.");
+  op.addOption("mb", "a memory-mapped database file to write (from --d or --b) and then search instead.");
   op.addOption("r", "RMSD cutoff (takes the size-dependent cutoff by default).");
   op.addOption("red", "set redundancy cutoff level in percent (default is 100, so no redundancy filtering).");
   op.addOption("redProp", "set redundancy property name. If defined, will assume the FASST database encodes this relational property and will define redundancy via it.");
@@ -20,6 +30,10 @@ int main(int argc, char *argv[]) {
   op.addOption("strOut", "dump structures into this directory.");
   op.addOption("seqOut", "sequence output file.");
   op.addOption("sc", "dump sidechains (not only the backbone).");
+  op.addOption("j", "number of threads to search with (default is 1).");
+  op.addOption("cache", "keep targets re-read for producing matches in a cache of full structures of this many KB.");
+  op.addOption("maxNodes", "node budget for the search (checks that the search stops within it).");
+  op.addOption("order", "also search with targets ordered by their residual bounds from a segment index (checks that the same matches are found).");
   op.addOption("pp", "store phi/psi properties in the database, if creating a new one from PDB files.");
   op.setOptions(argc, argv);
   int memInit = MstSys::memUsage();
@@ -37,16 +51,16 @@ int main(int argc, char *argv[]) {
   }
   if (op.isGiven("strOut") && !MstSys::isDir(op.getString("strOut"))) MstSys::cmkdir(op.getString("strOut"));
 
-  FASST S;
+  FASST D;
   cout << "Reading the database..." << endl;
   auto begin = chrono::high_resolution_clock::now();
   Structure query(op.getString("q"));
-  S.setQuery(query);
+  D.setQuery(query);
   if (op.isGiven("d")) {
     vector<string> pdbFiles = MstUtils::fileToArray(op.getString("d"));
     for (int i = 0; i < pdbFiles.size(); i++) {
       Structure P(pdbFiles[i]);
-      S.addTarget(P);
+      D.addTarget(P);
       // compute and add some properties
       if (op.isGiven("pp")) {
         vector<Residue*> residues = P.getResidues();
@@ -55,23 +69,45 @@ int main(int argc, char *argv[]) {
           phi[ri] = residues[ri]->getPhi(false);
           psi[ri] = residues[ri]->getPsi(false);
         }
-        S.addResidueProperties(S.numTargets() - 1, "phi", phi);
-        S.addResidueProperties(S.numTargets() - 1, "psi", psi);
+        D.addResidueProperties(D.numTargets() - 1, "phi", phi);
+        D.addResidueProperties(D.numTargets() - 1, "psi", psi);
       }
     }
     if (op.isGiven("b")) {
-      S.writeDatabase(op.getString("b"));
+      D.writeDatabase(op.getString("b"));
+      // properties should read back the same, whether looked up by name or by handle
+      if (op.isGiven("pp")) {
+        FASST R;
+        R.readDatabase(op.getString("b"));
+        int phiID = R.getResiduePropertyID("phi");
+        for (int ti = 0; ti < D.numTargets(); ti++) {
+          for (int ri = 0; ri < D.getTargetResidueSize(ti); ri++) {
+            if ((R.getResidueProperty(ti, phiID, ri) != D.getResidueProperty(ti, "phi", ri)) || (R.getResidueProperty(ti, "psi", ri) != D.getResidueProperty(ti, "psi", ri))) MstUtils::error("residue properties differ after writing and reading back the database");
+          }
+        }
+        cout << "residue properties read back the same" << endl;
+      }
     }
   } else if (op.isGiven("b")) {
-    S.readDatabase(op.getString("b"), 2);
+    D.readDatabase(op.getString("b"), 2);
   } else {
     MstUtils::error("either --b or --d must be given!");
   }
+  FASST M;
+  if (op.isGiven("mb")) {
+    D.writeMappedDatabase(op.getString("mb"));
+    M.setQuery(query);
+    M.readDatabase(op.getString("mb"));
+  }
+  FASST& S = op.isGiven("mb") ? M : D;
+  if (op.isGiven("cache")) S.setTargetCacheBudget(op.getInt("cache")*1024);
   if (op.isGiven("r")) { S.setRMSDCutoff(op.getReal("r")); }
   else {
     cout << "setting RMSD cutoff to " << RMSDCalculator::rmsdCutoff(query) << endl;
     S.setRMSDCutoff(RMSDCalculator::rmsdCutoff(query));
   }
+  S.setNumThreads(op.getInt("j", 1));
+  if (op.isGiven("maxNodes")) S.options().setMaxSearchNodes(op.getInt("maxNodes"));
   S.setMaxNumMatches(op.getInt("max", -1));
   S.setMinNumMatches(op.getInt("min", -1));
   // S.setMaxGap(1, 0, 6); S.setMinGap(1, 0, 0);
@@ -98,6 +134,53 @@ int main(int argc, char *argv[]) {
   S.search();
   end = chrono::high_resolution_clock::now();
   cout << "Search took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  const fasstSearchStats& stats = S.getSearchStats();
+  cout << stats << endl;
+  if ((!S.isSearchPartial() && (stats.targetsSearched + stats.targetsSkipped != S.numTargets())) || (stats.solutionsFound < S.numMatches()) || (stats.nodesVisited < stats.solutionsFound + stats.boundPruned)) {
+    MstUtils::error("search statistics are inconsistent with the search");
+  }
+  if (op.isGiven("maxNodes") && (stats.nodesVisited > op.getInt("maxNodes") + 256*S.getNumThreads())) MstUtils::error("search overran its node budget");
+
+  // a solution callback stopping the search upon the first solution
+  if (S.numMatches() > 0) {
+    int numCalls = 0;
+    S.setSolutionCallback([&numCalls](const fasstSolution& sol) { numCalls++; return false; });
+    fasstSolutionSet first = S.search();
+    S.unsetSolutionCallback();
+    // (other workers of a parallel search may each have accepted one before stopping)
+    if ((numCalls < 1) || (numCalls > S.getNumThreads()) || !S.isSearchPartial() || (first.size() < 1)) MstUtils::error("solution callback did not stop the search upon the first solution");
+    S.search(); // restore the full solution set
+  }
+
+  // ordering targets by their bounds should find the same best matches
+  if (op.isGiven("order")) {
+    vector<int> lengths;
+    for (int i = 0; i < query.chainSize(); i++) lengths.push_back(query[i].residueSize());
+    S.buildSegmentIndex(lengths);
+    fasstSolutionSet unordered = S.search();
+    S.options().setTargetOrdering();
+    fasstSolutionSet ordered = S.search();
+    cout << "with targets ordered by bound: " << S.getSearchStats().targetsSkipped << " of " << S.numTargets() << " targets skipped" << endl;
+    if (ordered.size() != unordered.size()) MstUtils::error("ordered search found " + MstUtils::toString(ordered.size()) + " matches, vs. " + MstUtils::toString(unordered.size()) + " in database order");
+    for (int k = 0; k < ordered.size(); k++) {
+      if (fabs(ordered[k].getRMSD() - unordered[k].getRMSD()) > 10E-6) MstUtils::error("ordered search found different matches than in database order");
+    }
+    S.options().setTargetOrdering(false);
+  }
+
+  // constraints looked up in the sequence index should admit the same matches
+  if (op.isGiven("const")) {
+    fasstSolutionSet indexed = S.search();
+    int skipped = S.getSearchStats().targetsSkipped;
+    S.options().setSequenceConstraints(scannedSeqConst(seqConst));
+    fasstSolutionSet scanned = S.search();
+    cout << "with the sequence index: " << skipped << " of " << S.numTargets() << " targets skipped" << endl;
+    if (indexed.size() != scanned.size()) MstUtils::error("search with indexed sequence constraints found " + MstUtils::toString(indexed.size()) + " matches, vs. " + MstUtils::toString(scanned.size()) + " when scanning targets");
+    for (int k = 0; k < indexed.size(); k++) {
+      if ((indexed[k].getTargetIndex() != scanned[k].getTargetIndex()) || (indexed[k].getAlignment() != scanned[k].getAlignment())) MstUtils::error("search with indexed sequence constraints found different matches than when scanning targets");
+    }
+    S.options().setSequenceConstraints(seqConst);
+  }
   cout << "found " << S.numMatches() << " matches:" << endl;
   cout << "memory usage: " << MstSys::memUsage() << " KB" << endl;
   fasstSolutionSet matches = S.getMatches(); int i = 0;
@@ -109,11 +192,39 @@ int main(int argc, char *argv[]) {
       if (S.isResiduePropertyDefined("phi")) cout << "\tphi: " << MstUtils::vecToString(S.getResidueProperties(*it, "phi")) << endl;
       if (S.isResiduePropertyDefined("psi")) cout << "\tpsi: " << MstUtils::vecToString(S.getResidueProperties(*it, "psi")) << endl;
     }
-    if (op.isGiven("strOut")) {
-      // Structure match = S.getMatchStructure(*it, true, FASST::matchType::FULL);
-      Structure match = S.getMatchStructure(*it, op.isGiven("sc"), type);
-      match.writePDB(op.getString("strOut") + "/match" + MstUtils::toString(i) + ".pdb");
+  }
+  // transforms (computed for the final solutions only) should superimpose matches onto the query
+  auto backbone = [](const AtomPointerVector& atoms) {
+    AtomPointerVector bb;
+    for (int a = 0; a < atoms.size(); a++) {
+      string name = atoms[a]->getName();
+      if ((name == "N") || (name == "CA") || (name == "C") || (name == "O")) bb.push_back(atoms[a]);
     }
+    return bb;
+  };
+  AtomPointerVector queryBB = backbone(query.getAtoms());
+  for (int k = 0; k < matches.size(); k++) {
+    Structure full = S.getMatchStructure(matches[k], false, FASST::matchType::FULL, true);
+    AtomPointerVector aligned;
+    for (int i = 0; i < matches[k].numSegments(); i++) {
+      for (int r = 0; r < matches[k].segLength(i); r++) {
+        AtomPointerVector resBB = backbone(full.getResidue(matches[k][i] + r).getAtoms());
+        aligned.insert(aligned.end(), resBB.begin(), resBB.end());
+      }
+    }
+    if ((aligned.size() != queryBB.size()) || (fabs(RMSDCalculator::rmsd(aligned, queryBB) - matches[k].getRMSD()) > 10E-4)) MstUtils::error("match " + MstUtils::toString(k) + " is not superimposed onto the query by its transform");
+  }
+  if (op.isGiven("strOut")) {
+    // stream matches out, checking them against one-at-a-time extraction
+    S.visitMatchStructures(matches, [&](int k, const Structure& match) {
+      Structure single = S.getMatchStructure(matches[k], op.isGiven("sc"), type);
+      AtomPointerVector A = match.getAtoms(), B = single.getAtoms();
+      MstUtils::assertCond((A.size() == B.size()) && (match.getName() == single.getName()), "streamed match " + MstUtils::toString(k) + " differs from the extracted one");
+      for (int a = 0; a < A.size(); a++) MstUtils::assertCond(A[a]->distance(B[a]) < 10E-8, "streamed match " + MstUtils::toString(k) + " differs from the extracted one");
+      match.writePDB(op.getString("strOut") + "/match" + MstUtils::toString(k) + ".pdb");
+    }, op.isGiven("sc"), type);
+    if (S.getTargetCacheSize() > S.getTargetCacheBudget()) MstUtils::error("target cache exceeds its budget");
+    if (op.isGiven("cache")) cout << "target cache holds " << S.getTargetCacheSize() << " bytes" << endl;
   }
   fstream of;
   if (op.isGiven("seqOut")) MstUtils::openFile(of, op.getString("seqOut"), ios::out);
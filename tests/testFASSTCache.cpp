@@ -0,0 +1,107 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstfasst.h"
+#include "mstfasstcache.h"
+#include <chrono>
+
+// solutions keyed by target and alignment, mapped to their RMSDs
+map<pair<int, vector<int> >, mstreal> solutionMap(const fasstSolutionSet& sols) {
+  map<pair<int, vector<int> >, mstreal> m;
+  for (auto it = sols.begin(); it != sols.end(); ++it) m[make_pair(it->getTargetIndex(), it->getAlignment())] = it->getRMSD();
+  return m;
+}
+
+// number of solutions in A (away from the cutoff) that are missing from B or have a different RMSD
+int numDiscrepancies(const fasstSolutionSet& A, const fasstSolutionSet& B, mstreal cut) {
+  map<pair<int, vector<int> >, mstreal> a = solutionMap(A), b = solutionMap(B);
+  int n = 0;
+  for (auto it = a.begin(); it != a.end(); ++it) {
+    if (it->second > cut - 10E-6) continue;
+    if ((b.find(it->first) == b.end()) || (fabs(b[it->first] - it->second) > 10E-6)) n++;
+  }
+  return n;
+}
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Searches many perturbed copies of a query with and without a cFASST cache shared by several threads, and compares the results. Options:");
+  op.addOption("q", "query PDB file.", true);
+  op.addOption("b", "a binary database file.", true);
+  op.addOption("r", "RMSD cutoff (default is 1.0).");
+  op.addOption("n", "number of perturbed queries to search for (default is 100).");
+  op.addOption("noise", "maximal perturbation of any query coordinate, in Angstrom (default is 0.2).");
+  op.addOption("j", "number of threads sharing the cache (default is 2).");
+  op.addOption("log", "if given, the cache is also kept in a log at this path (overwritten), which is then read back and compacted.");
+  op.setOptions(argc, argv);
+  mstreal cut = op.getReal("r", 1.0), noise = op.getReal("noise", 0.2);
+  int N = op.getInt("n", 100), numThreads = op.getInt("j", 2);
+
+  // the workload: perturbed copies of the query
+  Structure query(op.getString("q"));
+  vector<Structure> queries(N, query);
+  for (int i = 1; i < N; i++) {
+    vector<Atom*> atoms = queries[i].getAtoms();
+    for (int k = 0; k < atoms.size(); k++) {
+      for (int d = 0; d < 3; d++) (*atoms[k])[d] += MstUtils::randUnit(-noise, noise);
+    }
+  }
+
+  // reference results without a cache
+  FASST F;
+  F.readDatabase(op.getString("b"), 2);
+  F.setRMSDCutoff(cut);
+  vector<fasstSolutionSet> ref(N);
+  auto begin = chrono::high_resolution_clock::now();
+  for (int i = 0; i < N; i++) {
+    F.setQuery(queries[i]);
+    ref[i] = F.search();
+  }
+  auto end = chrono::high_resolution_clock::now();
+  cout << "searches without cache took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+
+  // the same, with one cache shared by all threads
+  cFASST C(10*N);
+  C.readDatabase(op.getString("b"), 2);
+  if (op.isGiven("log")) {
+    remove(op.getString("log").c_str());
+    C.getCacheStore()->attachLog(op.getString("log"));
+  }
+  vector<cFASST*> workers(numThreads);
+  for (int w = 0; w < numThreads; w++) {
+    workers[w] = C.newCachedSearcher();
+    workers[w]->setRMSDCutoff(cut);
+  }
+  vector<fasstSolutionSet> cached(N);
+  begin = chrono::high_resolution_clock::now();
+  MstUtils::parallelFor(N, numThreads, [&](int i, int w) {
+    workers[w]->setQuery(queries[i]);
+    cached[i] = workers[w]->search();
+  });
+  end = chrono::high_resolution_clock::now();
+  cout << "searches with a cache shared by " << numThreads << " threads took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms; ";
+  cout << C.getCacheStore()->size() << " of " << N << " searches had to be done and were cached" << endl;
+  for (int w = 0; w < numThreads; w++) delete workers[w];
+
+  if (op.isGiven("log")) {
+    // every cached search should have made it to the log, and survive compaction
+    fasstCacheStore reader(10*N);
+    reader.attachLog(op.getString("log"), false);
+    if (reader.size() != C.getCacheStore()->size()) MstUtils::error("log has " + MstUtils::toString(reader.size()) + " entries instead of " + MstUtils::toString(C.getCacheStore()->size()));
+    C.getCacheStore()->compactLog();
+    if (reader.syncLog() != 0) MstUtils::error("compacted log has entries not in the original");
+    fasstCacheStore fresh(10*N);
+    fresh.attachLog(op.getString("log"), false);
+    if (fresh.size() != C.getCacheStore()->size()) MstUtils::error("compacted log has " + MstUtils::toString(fresh.size()) + " entries instead of " + MstUtils::toString(C.getCacheStore()->size()));
+    cout << "cache log has all " << fresh.size() << " entries, before and after compaction" << endl;
+  }
+
+  int bad = 0;
+  for (int i = 0; i < N; i++) {
+    int n = numDiscrepancies(ref[i], cached[i], cut) + numDiscrepancies(cached[i], ref[i], cut);
+    if (n > 0) cout << "query " << i << ": " << n << " solutions differ between searches with and without the cache" << endl;
+    bad += n;
+  }
+  if (bad > 0) MstUtils::error("cached results differ from uncached ones");
+  cout << "TEST PASSED" << endl;
+  return 0;
+}
@@ -0,0 +1,61 @@
+#include "msttypes.h"
+#include "mstoptions.h"
+#include "mstfasst.h"
+#include "mstfasstshard.h"
+#include <thread>
+
+// solutions keyed by target and alignment, mapped to their RMSDs
+map<pair<int, vector<int> >, mstreal> solutionMap(const fasstSolutionSet& sols) {
+  map<pair<int, vector<int> >, mstreal> m;
+  for (auto it = sols.begin(); it != sols.end(); ++it) m[make_pair(it->getTargetIndex(), it->getAlignment())] = it->getRMSD();
+  return m;
+}
+
+int main(int argc, char *argv[]) {
+  MstOptions op;
+  op.setTitle("Searches a database split into shards, each served over a local socket, and compares the results to searching the whole database. Options:");
+  op.addOption("q", "query PDB file.", true);
+  op.addOption("d", "a database file with a list of PDB files.", true);
+  op.addOption("s", "number of shards (default is 2).");
+  op.addOption("r", "RMSD cutoff (default is 2.0).");
+  op.setOptions(argc, argv);
+  vector<string> pdbFiles = MstUtils::fileToArray(op.getString("d"));
+  int numShards = op.getInt("s", 2);
+  Structure query(op.getString("q"));
+
+  // the whole database, and the same targets split into consecutive shards
+  FASST full;
+  for (int i = 0; i < pdbFiles.size(); i++) full.addTarget(pdbFiles[i]);
+  vector<FASST*> shardDBs(numShards);
+  vector<fasstShardServer*> servers(numShards);
+  fasstShardedSearch sharded;
+  int perShard = (pdbFiles.size() + numShards - 1)/numShards;
+  for (int s = 0; s < numShards; s++) {
+    shardDBs[s] = new FASST();
+    for (int i = s*perShard; i < MstUtils::min((s + 1)*perShard, (int) pdbFiles.size()); i++) shardDBs[s]->addTarget(pdbFiles[i]);
+    servers[s] = new fasstShardServer(*(shardDBs[s]), s*perShard);
+    servers[s]->listen();
+    sharded.addShard("localhost", servers[s]->getPort());
+  }
+
+  vector<fasstSearchOptions> tests(3);
+  for (int t = 0; t < tests.size(); t++) tests[t].setRMSDCutoff(op.getReal("r", 2.0));
+  tests[1].setMaxNumMatches(5);
+  tests[2].setMaxNumMatches(5); tests[2].setRedundancyCut(0.5);
+  vector<thread> serving;
+  for (int s = 0; s < numShards; s++) serving.push_back(thread([&servers, &tests, s]() { servers[s]->serve(tests.size()); }));
+
+  for (int t = 0; t < tests.size(); t++) {
+    full.setOptions(tests[t]);
+    full.setQuery(query);
+    fasstSolutionSet expected = full.search();
+    fasstSolutionSet found = sharded.search(query, tests[t]);
+    if (solutionMap(expected) != solutionMap(found)) MstUtils::error("sharded search " + MstUtils::toString(t) + " gave different solutions than searching the whole database");
+    cout << "sharded search " << t << " agrees with searching the whole database (" << found.size() << " matches)" << endl;
+  }
+  for (int s = 0; s < numShards; s++) {
+    serving[s].join();
+    delete servers[s];
+    delete shardDBs[s];
+  }
+}
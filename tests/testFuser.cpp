@@ -97,4 +97,60 @@ int main(int argc, char *argv[]) {
 	Structure fusedStruct = Fuser::fuse(residues, scores, vector<int>(1, 0), opts);
   cout << "best score is " << scores.getScore() << endl;
 	fusedStruct.writePDB(outBase + ".fused1.pdb");
+
+  // threaded scoring of restraints should agree with serial scoring
+  fusionParams serialOpts, threadedOpts; threadedOpts.setNumThreads(4);
+  fusionEvaluator serialE(residues, vector<int>(1, 0), serialOpts), threadedE(residues, vector<int>(1, 0), threadedOpts);
+  vector<mstreal> point = serialE.guessPoint(); threadedE.guessPoint();
+  Vector serialGrad, threadedGrad;
+  mstreal serialScore = serialE.eval(point, serialGrad), threadedScore = threadedE.eval(point, threadedGrad);
+  if ((fabs(serialScore - threadedScore) > 10E-8) || ((serialGrad - threadedGrad).norm() > 10E-8)) MstUtils::error("threaded scoring differs from serial scoring", "main");
+  cout << "threaded scoring agrees with serial scoring" << endl;
+
+  // independent starts should not depend on how many threads run them
+  fusionTopology topo(residues); topo.addFixedPositions(vector<int>(1, 0));
+  MstUtils::seedRandEngine(17);
+  vector<fusionOutput> serialStarts = Fuser::fuseMulti(topo, opts, 4, 1);
+  MstUtils::seedRandEngine(17);
+  vector<fusionOutput> threadedStarts = Fuser::fuseMulti(topo, opts, 4, 4);
+  for (int i = 0; i < serialStarts.size(); i++) {
+    cout << "start " << i << ": " << serialStarts[i].getScore() << endl;
+    if (fabs(serialStarts[i].getScore() - threadedStarts[i].getScore()) > 10E-8) MstUtils::error("threaded starts differ from serial starts", "main");
+  }
+  fusionOutput best;
+  Fuser::fuseMulti(topo, best, opts, 4, 4, MstUtils::min(serialStarts[0].getScore(), serialStarts[1].getScore()));
+  cout << "best of multi-start fusion with early stopping: " << best.getScore() << endl;
+
+  // an incremental fragment swap should give the same restraints as a full rebuild
+  Structure termD = termC;
+  vector<Residue*> swapRes; vector<int> swapPos;
+  for (int i = 0; i < 5; i++) { swapRes.push_back(&(termD[0][i])); swapPos.push_back(i+21); }
+  for (int i = 0; i < 5; i++) { swapRes.push_back(&(termD[1][i])); swapPos.push_back(i+10); }
+  termD[0][2][1][0] += 0.3; // move one CA, so that bonds and angles of that position change
+  int swapIdx = -1;
+  for (int fi = 0; fi < topo.numFrags(); fi++) {
+    if (MstUtils::contents(topo.getFragPositions(fi)).count(21)) swapIdx = fi;
+  }
+  fusionEvaluator incE(topo, serialOpts);
+  incE.guessPoint();
+  incE.replaceFragment(swapIdx, swapRes, swapPos);
+  fusionTopology editedTopo = topo;
+  editedTopo.replaceFragment(swapIdx, swapRes, swapPos);
+  fusionEvaluator fullE(editedTopo, serialOpts);
+  point = fullE.guessPoint();
+  Vector incGrad, fullGrad;
+  mstreal incScore = incE.eval(point, incGrad), fullScore = fullE.eval(point, fullGrad);
+  if ((fabs(incScore - fullScore) > 10E-8) || ((incGrad - fullGrad).norm() > 10E-8)) MstUtils::error("incremental topology update differs from a full rebuild", "main");
+  cout << "incremental topology update agrees with a full rebuild" << endl;
+
+  // ... and so should removing a fragment
+  fusionTopology extendedTopo = topo;
+  extendedTopo.addFragment(swapRes, swapPos);
+  fusionEvaluator remE(extendedTopo, serialOpts), origE(topo, serialOpts);
+  remE.guessPoint();
+  remE.removeFragment(extendedTopo.numFrags() - 1);
+  point = origE.guessPoint();
+  mstreal remScore = remE.eval(point, incGrad), origScore = origE.eval(point, fullGrad);
+  if ((fabs(remScore - origScore) > 10E-8) || ((incGrad - fullGrad).norm() > 10E-8)) MstUtils::error("fragment removal differs from a full rebuild", "main");
+  cout << "fragment removal agrees with a full rebuild" << endl;
 }
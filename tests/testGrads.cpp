@@ -2,8 +2,55 @@
 
 using namespace MST;
 
+// compares the analytical partials from Atom::build with finite differences
+bool testBuildPartials(bool radians) {
+  mstreal del = 0.0001, tol = 0.001;
+  mstreal icPartials[9], xyzPartials[27];
+  for (int k = 0; k < 100; k++) {
+    vector<Atom> R(3);
+    for (int i = 0; i < 3; i++) R[i].setCoor(10*MstUtils::randUnit(), 10*MstUtils::randUnit(), 10*MstUtils::randUnit());
+    mstreal s = radians ? 1.0 : 180/M_PI;
+    vector<mstreal> ic = {1 + MstUtils::randUnit(), s*M_PI*MstUtils::randUnit(), s*M_PI*(2*MstUtils::randUnit() - 1)};
+    Atom A, Ap, Am;
+    A.build(R[0], R[1], R[2], ic[0], ic[1], ic[2], icPartials, xyzPartials, radians);
+
+    for (int j = 0; j < 3; j++) {
+      vector<mstreal> icp = ic, icm = ic;
+      icp[j] += del; icm[j] -= del;
+      Ap.build(R[0], R[1], R[2], icp[0], icp[1], icp[2], radians);
+      Am.build(R[0], R[1], R[2], icm[0], icm[1], icm[2], radians);
+      for (int d = 0; d < 3; d++) {
+        mstreal fd = (Ap[d] - Am[d])/(2*del);
+        if (fabs(fd - icPartials[3*d + j]) > tol) {
+          cout << "test FAILED for build partial of coordinate " << d << " with respect to internal coordinate " << j << ": analytical " << icPartials[3*d + j] << ", numerical " << fd << endl;
+          return false;
+        }
+      }
+    }
+    for (int r = 0; r < 3; r++) {
+      for (int j = 0; j < 3; j++) {
+        vector<Atom> Rp = R, Rm = R;
+        Rp[r][j] += del; Rm[r][j] -= del;
+        Ap.build(Rp[0], Rp[1], Rp[2], ic[0], ic[1], ic[2], radians);
+        Am.build(Rm[0], Rm[1], Rm[2], ic[0], ic[1], ic[2], radians);
+        for (int d = 0; d < 3; d++) {
+          mstreal fd = (Ap[d] - Am[d])/(2*del);
+          if (fabs(fd - xyzPartials[9*r + 3*d + j]) > tol) {
+            cout << "test FAILED for build partial of coordinate " << d << " with respect to coordinate " << j << " of reference atom " << r << ": analytical " << xyzPartials[9*r + 3*d + j] << ", numerical " << fd << endl;
+            return false;
+          }
+        }
+      }
+    }
+  }
+  cout << "build partials test PASSED" << (radians ? " (radians)" : " (degrees)") << endl;
+  return true;
+}
+
 int main(int argc, char** argv) {
   CartesianGeometry::testPrimitiveGradients(true);
   CartesianGeometry::testPrimitiveGradients(false);
   RMSDCalculator::testQCP(true);
+  testBuildPartials(true);
+  testBuildPartials(false);
 }
@@ -0,0 +1,79 @@
+#include "msttypes.h"
+#include "mstlinalg.h"
+
+using namespace std;
+using namespace MST;
+
+Matrix randomMatrix(int n, int m) {
+  Matrix A(n, m);
+  for (int i = 0; i < n; i++) {
+    for (int j = 0; j < m; j++) A(i, j) = MstUtils::randUnit() - 0.5;
+  }
+  return A;
+}
+
+// reference product, by definition
+Matrix naiveProduct(const Matrix& A, const Matrix& B) {
+  Matrix C(A.numRows(), B.numCols(), 0);
+  for (int i = 0; i < A.numRows(); i++) {
+    for (int j = 0; j < B.numCols(); j++) {
+      for (int k = 0; k < A.numCols(); k++) C(i, j) += A(i, k) * B(k, j);
+    }
+  }
+  return C;
+}
+
+int main(int argc, char *argv[]) {
+  int N = (argc > 1) ? atoi(argv[1]) : 300;
+
+  // products of various shapes, including ones not divisible by the block size
+  vector<vector<int> > shapes = {{1, 1, 1}, {3, 3, 3}, {1, 70, 1}, {70, 1, 70}, {65, 130, 67}, {4, 200, 3}};
+  for (int s = 0; s < shapes.size(); s++) {
+    Matrix A = randomMatrix(shapes[s][0], shapes[s][1]), B = randomMatrix(shapes[s][1], shapes[s][2]);
+    Matrix D = A*B - naiveProduct(A, B);
+    if (D.abs().max() > 10E-10) MstUtils::error("matrix product differs from reference for shape " + MstUtils::vecToString(shapes[s]));
+  }
+  cout << "matrix products agree with reference" << endl;
+
+  // views write through into the matrix they came from
+  Matrix A = randomMatrix(5, 4), At = A.transpose();
+  for (int i = 0; i < 5; i++) {
+    for (int j = 0; j < 4; j++) {
+      if (A(i, j) != At(j, i)) MstUtils::error("transpose is wrong");
+    }
+  }
+  A.row(2) = Matrix(vector<mstreal>(4, 1.0));
+  A.column(1) = Matrix(vector<mstreal>(5, 2.0), true);
+  A.column(3) *= 0;
+  for (int i = 0; i < 5; i++) {
+    if ((A(i, 1) != 2.0) || (A(i, 3) != 0.0)) MstUtils::error("column view did not write through");
+  }
+  if ((A(2, 0) != 1.0) || (A(2, 2) != 1.0)) MstUtils::error("row view did not write through");
+  Vector c1(A.column(1)), r2(A.row(2));
+  if ((c1.dot(c1) != 20.0) || (Vector(A.column(1)).dot(Vector(A.column(0))) != 2*A.column(0).sum()(0, 0))) MstUtils::error("dot products of columns are wrong");
+  if (r2.dot(Vector(vector<mstreal>{1, 1, 1, 1})) != 4.0) MstUtils::error("dot product of row is wrong");
+  vector<mstreal> flat = A;
+  for (int i = 0; i < 5; i++) {
+    vector<mstreal> row = A.row(i);
+    for (int j = 0; j < 4; j++) {
+      if ((flat[i*4 + j] != A(i, j)) || (row[j] != A(i, j)) || (A[j*5 + i] != A(i, j))) MstUtils::error("element access is inconsistent");
+    }
+  }
+  cout << "sub-matrix views work" << endl;
+
+  // timing of a larger product
+  Matrix P = randomMatrix(N, N), Q = randomMatrix(N, N);
+  timespec t0, t1, t2;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  Matrix R = P*Q;
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  mstreal dot = 0;
+  for (int i = 0; i < N; i++) dot += Vector(P.row(i)).dot(Vector(Q.column(i)));
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  mstreal trace = 0;
+  for (int i = 0; i < N; i++) trace += R(i, i);
+  if (fabs(trace - dot) > 10E-8) MstUtils::error("trace of the product disagrees with the sum of row-column dot products");
+  cout << N << " x " << N << " product in " << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1.0E9 << " s; " << N << " row-column dot products in " << (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec)/1.0E9 << " s" << endl;
+
+  printf("TEST DONE\n");
+}
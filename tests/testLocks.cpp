@@ -0,0 +1,67 @@
+#include "msttypes.h"
+#include "mstlocks.h"
+#include <thread>
+#include <atomic>
+#include <sys/wait.h>
+
+int main(int argc, char *argv[]) {
+  string tag = "testLocks-" + MstUtils::toString((int) getpid());
+  fileLockBackend& locks = dynamic_cast<fileLockBackend&>(MstLocks::getBackend());
+
+  // exclusive holders within the process should never overlap
+  int numThreads = 4, numIters = 1000;
+  atomic<int> inside(0), maxInside(0);
+  long counter = 0;
+  auto start = chrono::steady_clock::now();
+  vector<thread> threads;
+  for (int t = 0; t < numThreads; t++) {
+    threads.push_back(thread([&]() {
+      for (int i = 0; i < numIters; i++) {
+        scopedLock lock(tag);
+        int n = ++inside;
+        if (n > maxInside) maxInside = n;
+        counter++;
+        inside--;
+      }
+    }));
+  }
+  for (int t = 0; t < numThreads; t++) threads[t].join();
+  double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  if ((maxInside != 1) || (counter != numThreads*numIters)) MstUtils::error("exclusive lock was held by more than one thread at a time");
+  cout << numThreads*numIters << " exclusive locks taken by " << numThreads << " threads, " << 1E6*elapsed/(numThreads*numIters) << " microseconds per lock on average" << endl;
+
+  // shared holders should overlap, and keep out exclusive ones
+  if (!MstLocks::getLock(tag, true) || !MstLocks::getLock(tag, true)) MstUtils::error("could not get shared locks");
+  bool gotExclusive = true;
+  thread other([&]() { gotExclusive = MstLocks::getLock(tag, false, 0.05); });
+  other.join();
+  if (gotExclusive) MstUtils::error("got an exclusive lock while shared locks were held");
+  MstLocks::releaseLock(tag); MstLocks::releaseLock(tag);
+  if (!MstLocks::getLock(tag, false, 0)) MstUtils::error("could not get an exclusive lock after shared locks were released");
+  MstLocks::releaseLock(tag);
+  cout << "shared locks work" << endl;
+
+  // another process holding the lock should keep this one out until it exits
+  int ready[2];
+  if (pipe(ready) != 0) MstUtils::error("could not create pipe");
+  pid_t child = fork();
+  if (child == 0) {
+    fileLockBackend childLocks;
+    if (!childLocks.acquire(tag, false, 0)) _exit(1);
+    char c = 1;
+    if (write(ready[1], &c, 1) != 1) _exit(1);
+    usleep(200000);
+    _exit(0); // without releasing the lock
+  }
+  char c;
+  if (read(ready[0], &c, 1) != 1) MstUtils::error("child process could not get the lock");
+  if (MstLocks::getLock(tag, true, 0.01)) MstUtils::error("got a shared lock held exclusively by another process");
+  start = chrono::steady_clock::now();
+  if (!MstLocks::getLock(tag, false, 5)) MstUtils::error("could not get the lock after the other process exited");
+  elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+  MstLocks::releaseLock(tag);
+  int status; waitpid(child, &status, 0);
+  if (!WIFEXITED(status) || (WEXITSTATUS(status) != 0)) MstUtils::error("child process failed");
+  cout << "lock held by another process was had " << elapsed << " seconds later, once that process exited" << endl;
+  MstSys::crm(locks.lockFile(tag));
+}
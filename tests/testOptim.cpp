@@ -0,0 +1,140 @@
+#include "msttypes.h"
+#include "mstoptim.h"
+
+using namespace std;
+using namespace MST;
+
+// the n-dimensional Rosenbrock function, with its minimum of 0 at (1, 1, ..., 1)
+class rosenbrockEvaluator : public optimizerEvaluator {
+  public:
+    rosenbrockEvaluator(int _n) { n = _n; numEvals = 0; }
+    vector<mstreal> guessPoint() {
+      vector<mstreal> x(n);
+      for (int i = 0; i < n; i++) x[i] = (i % 2) ? 1.0 : -1.2;
+      return x;
+    }
+    mstreal eval(const mstreal* x, mstreal* grad, int _n) {
+      numEvals++;
+      mstreal f = 0;
+      if (grad != NULL) for (int i = 0; i < n; i++) grad[i] = 0;
+      for (int i = 0; i + 1 < n; i++) {
+        mstreal a = x[i+1] - x[i]*x[i], b = 1 - x[i];
+        f += 100*a*a + b*b;
+        if (grad != NULL) {
+          grad[i] += -400*a*x[i] - 2*b;
+          grad[i+1] += 200*a;
+        }
+      }
+      return f;
+    }
+    // the vector-based interface, on top of the above
+    mstreal eval(const vector<mstreal>& point) { return eval(point.data(), NULL, point.size()); }
+    mstreal eval(const vector<mstreal>& point, Vector& grad) {
+      vector<mstreal> g(n);
+      mstreal f = eval(point.data(), g.data(), n);
+      grad = Vector(g);
+      return f;
+    }
+    int numEvals;
+
+  private:
+    int n;
+};
+
+// a weighted quadratic, implementing only the original vector-based interface
+class quadraticEvaluator : public optimizerEvaluator {
+  public:
+    quadraticEvaluator(const vector<mstreal>& _c) { c = _c; }
+    vector<mstreal> guessPoint() { return vector<mstreal>(c.size(), 0.0); }
+    mstreal eval(const vector<mstreal>& point) {
+      mstreal f = 0;
+      for (int i = 0; i < c.size(); i++) f += (i + 1)*(point[i] - c[i])*(point[i] - c[i]);
+      return f;
+    }
+    mstreal eval(const vector<mstreal>& point, Vector& grad) {
+      grad = Vector(c.size());
+      for (int i = 0; i < c.size(); i++) grad[i] = 2*(i + 1)*(point[i] - c[i]);
+      return eval(point);
+    }
+
+  private:
+    vector<mstreal> c;
+};
+
+// an isotropic harmonic well, whose mean potential energy at temperature kT is n*kT/2
+class harmonicEvaluator : public optimizerEvaluator {
+  public:
+    harmonicEvaluator(int _n) { n = _n; }
+    vector<mstreal> guessPoint() { return vector<mstreal>(n, 1.0); }
+    mstreal eval(const mstreal* x, mstreal* grad, int _n) {
+      mstreal f = 0;
+      for (int i = 0; i < n; i++) {
+        f += x[i]*x[i]/2;
+        if (grad != NULL) grad[i] = x[i];
+      }
+      return f;
+    }
+
+  private:
+    int n;
+};
+
+int main(int argc, char *argv[]) {
+  int n = (argc > 1) ? atoi(argv[1]) : 20;
+
+  // unconstrained minimization
+  rosenbrockEvaluator R(n);
+  vector<mstreal> sol;
+  mstreal f = Optim::lbfgs(R, sol, 5000, 10E-14);
+  for (int i = 0; i < n; i++) {
+    if (fabs(sol[i] - 1) > 10E-4) MstUtils::error("L-BFGS did not find the minimum of the Rosenbrock function, coordinate " + MstUtils::toString(i) + " is " + MstUtils::toString(sol[i]));
+  }
+  cout << "L-BFGS: Rosenbrock function in " << n << " dimensions minimized to " << f << " in " << R.numEvals << " evaluations" << endl;
+  R.numEvals = 0;
+  f = Optim::conjGradMin(R, sol, 5000, 10E-14);
+  cout << "for comparison, conjugate gradient got to " << f << " in " << R.numEvals << " evaluations" << endl;
+
+  // with bounds that contain the minimum, the result should be the same
+  R.numEvals = 0;
+  f = Optim::lbfgsb(R, sol, vector<mstreal>(n, -2), vector<mstreal>(n, 2), 5000, 10E-14);
+  for (int i = 0; i < n; i++) {
+    if (fabs(sol[i] - 1) > 10E-4) MstUtils::error("L-BFGS-B did not find the minimum of the Rosenbrock function within loose bounds");
+  }
+  cout << "L-BFGS-B: with loose bounds, minimized to " << f << " in " << R.numEvals << " evaluations" << endl;
+
+  // with active bounds, on a function only implementing the vector-based
+  // interface, the solution is the unconstrained minimum clamped to the box
+  vector<mstreal> c(n), lo(n, -0.5), hi(n, 0.5);
+  for (int i = 0; i < n; i++) c[i] = cos(i);
+  quadraticEvaluator Q(c);
+  f = Optim::lbfgsb(Q, sol, lo, hi, 1000, 10E-14);
+  for (int i = 0; i < n; i++) {
+    mstreal expected = min(max(c[i], lo[i]), hi[i]);
+    if (fabs(sol[i] - expected) > 10E-6) MstUtils::error("L-BFGS-B gives " + MstUtils::toString(sol[i]) + " instead of " + MstUtils::toString(expected) + " for coordinate " + MstUtils::toString(i) + " with active bounds");
+  }
+  cout << "L-BFGS-B: with active bounds, minimized to " << f << endl;
+
+  // replica-exchange dynamics should sample each temperature correctly, and
+  // not depend on the number of threads
+  int nh = 30, numSteps = 20000;
+  vector<harmonicEvaluator> H(3, harmonicEvaluator(nh));
+  vector<optimizerEvaluator*> reps = {&H[0], &H[1], &H[2]};
+  vector<mstreal> kTs = Optim::temperatureLadder(0.5, 2.0, 3), meanEner(3, 0);
+  vector<int> numSnaps(3, 0);
+  vector<vector<mstreal> > sols, sols1;
+  MstUtils::seedRandEngine(1);
+  Optim::langevinReplicas(reps, vector<mstreal>(nh, 1.0), 0.01, 1.0, kTs, numSteps, sols, [&](int k, const vector<mstreal>& x, mstreal ener) {
+    if (numSnaps[k]++ < 200) return; // equilibration
+    meanEner[k] += ener;
+  }, 10, 50, 2);
+  for (int k = 0; k < 3; k++) {
+    meanEner[k] /= numSnaps[k] - 200;
+    cout << "replica at kT = " << kTs[k] << ": mean potential energy " << meanEner[k] << " (expected " << nh*kTs[k]/2 << ")" << endl;
+    if (fabs(meanEner[k]/(nh*kTs[k]/2) - 1) > 0.1) MstUtils::error("replica at kT = " + MstUtils::toString(kTs[k]) + " is not sampling its temperature");
+  }
+  MstUtils::seedRandEngine(1);
+  Optim::langevinReplicas(reps, vector<mstreal>(nh, 1.0), 0.01, 1.0, kTs, numSteps, sols1, nullptr, -1, 50, 1);
+  if (sols != sols1) MstUtils::error("replica dynamics depend on the number of threads");
+
+  printf("TEST DONE\n");
+}
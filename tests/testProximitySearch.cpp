@@ -0,0 +1,181 @@
+#include "msttypes.h"
+
+using namespace MST;
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    MstUtils::error("Usage: ./testProximitySearch [PDB file] [number of threads, optional]", "main");
+  }
+  Structure S(argv[1]);
+  int numThreads = (argc > 2) ? atoi(argv[2]) : 4;
+  AtomPointerVector atoms = S.getAtoms();
+  vector<int> tags(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) tags[i] = 2*i + 1;
+  vector<mstreal> cuts = {0.5, 2.0, 4.0, 8.0, 15.0};
+
+  // cell lists and ProximitySearch should both find exactly what brute force finds
+  for (mstreal cellSize : {1.0, 3.0, 10.0}) {
+    CellList cl(atoms, cellSize, &tags);
+    ProximitySearch ps(atoms, cellSize);
+    if (cl.pointSize() != atoms.size()) MstUtils::error("wrong number of points in cell list");
+    for (int i = 0; i < atoms.size(); i++) {
+      if ((cl.getPoint(i).distance(Point3(atoms[i])) != 0) || (cl.getPointTag(i) != tags[i])) MstUtils::error("cell list point " + MstUtils::toString(i) + " is wrong");
+    }
+    vector<int> found, foundPS;
+    for (int i = 0; i < atoms.size(); i += 5) {
+      Point3 c(atoms[i]);
+      c += Point3(0.3, -0.2, 0.1);
+      for (mstreal dmax : cuts) {
+        mstreal dmin = dmax/4;
+        vector<int> expected;
+        for (int j = 0; j < atoms.size(); j++) {
+          mstreal d = c.distance(Point3(atoms[j]));
+          if ((d >= dmin) && (d <= dmax)) expected.push_back(j);
+        }
+        found.clear();
+        int n = cl.pointsWithin(c, dmin, dmax, found);
+        sort(found.begin(), found.end());
+        foundPS = ps.getPointsWithin(CartesianPoint(c), dmin, dmax);
+        sort(foundPS.begin(), foundPS.end());
+        if ((n != expected.size()) || (found != expected)) MstUtils::error("cell list range query differs from brute force");
+        if (foundPS != expected) MstUtils::error("ProximitySearch range query differs from brute force");
+        if ((cl.numPointsWithin(c, dmin, dmax) != n) || (cl.anyWithin(c, dmin, dmax) != (n > 0))) MstUtils::error("cell list counting queries are inconsistent");
+        found.clear();
+        cl.pointsWithin(c, dmin, dmax, found, true);
+        for (int k = 0; k < found.size(); k++) {
+          if ((found[k] % 2 != 1) || (c.distance(Point3(atoms[(found[k] - 1)/2])) > dmax)) MstUtils::error("cell list returned wrong tags");
+        }
+      }
+    }
+  }
+  cout << "range queries agree with brute force" << endl;
+
+  // batch queries are the same as one-at-a-time ones
+  CellList cl(atoms, 4.0);
+  vector<Point3> centers;
+  for (int i = 0; i < atoms.size(); i += 3) centers.push_back(Point3(atoms[i]));
+  vector<int> offsets, list, one;
+  cl.pointsWithin(centers, 0, 6.0, offsets, list, false, numThreads);
+  if (offsets.size() != centers.size() + 1) MstUtils::error("wrong number of offsets from batch query");
+  for (int q = 0; q < centers.size(); q++) {
+    one.clear();
+    cl.pointsWithin(centers[q], 0, 6.0, one);
+    if (!equal(one.begin(), one.end(), list.begin() + offsets[q]) || (offsets[q+1] - offsets[q] != one.size())) MstUtils::error("batch query differs for center " + MstUtils::toString(q));
+  }
+  cout << "batch query agrees with single queries" << endl;
+
+  // as should selections of atoms around others
+  selector sel(S);
+  AtomPointerVector core = sel.select("chain A and resid 1-10");
+  AtomPointerVector around = sel.select("(chain A and resid 1-10) around 5.0");
+  AtomPointerVector expectedAround;
+  for (int i = 0; i < atoms.size(); i++) {
+    for (int j = 0; j < core.size(); j++) {
+      if (atoms[i]->distance(core[j]) <= 5.0) { expectedAround.push_back(atoms[i]); break; }
+    }
+  }
+  if ((core.size() == 0) || (around != expectedAround)) MstUtils::error("around selection differs from brute force");
+  cout << "selected " << around.size() << " atoms around " << core.size() << endl;
+
+  // a compiled selection should give the same atoms every time it is evaluated,
+  // and byres should expand to whole residues of the structure
+  compiledSelection compiled("byres ((chain A and resid 1-10) around 5.0)");
+  AtomPointerVector byRes = sel.select(compiled), expectedByRes;
+  set<Residue*> aroundRes;
+  for (int i = 0; i < around.size(); i++) aroundRes.insert(around[i]->getParent());
+  for (int i = 0; i < atoms.size(); i++) {
+    if (aroundRes.find(atoms[i]->getParent()) != aroundRes.end()) expectedByRes.push_back(atoms[i]);
+  }
+  if ((byRes != expectedByRes) || (sel.select(compiled) != byRes) || (selector(S).select(compiled) != byRes)) MstUtils::error("compiled byres selection differs from brute force");
+  cout << "compiled selection gave " << byRes.size() << " atoms in " << sel.selectRes(compiled).size() << " residues" << endl;
+
+  // k-d tree range and nearest-neighbor queries, also with points added, moved,
+  // and removed after construction
+  vector<Point3> P(atoms.size());
+  for (int i = 0; i < atoms.size(); i++) P[i] = Point3(atoms[i]);
+  KDTree kd(atoms);
+  vector<bool> gone(P.size(), false);
+  mt19937 rng(7);
+  uniform_real_distribution<mstreal> shift(-3.0, 3.0);
+  for (int round = 0; round < 3; round++) {
+    for (int q = 0; q < P.size(); q += 11) {
+      Point3 c = P[q] + Point3(0.4, 0.1, -0.3);
+      vector<pair<mstreal, int> > byDist;
+      vector<int> expected;
+      for (int j = 0; j < P.size(); j++) {
+        if (gone[j]) continue;
+        mstreal d2 = c.distance2(P[j]);
+        byDist.push_back(pair<mstreal, int>(d2, j));
+        if ((d2 >= 1.0) && (d2 <= 36.0)) expected.push_back(j);
+      }
+      sort(byDist.begin(), byDist.end());
+      vector<int> found;
+      kd.pointsWithin(c, 1.0, 6.0, found);
+      sort(found.begin(), found.end());
+      if (found != expected) MstUtils::error("k-d tree range query differs from brute force in round " + MstUtils::toString(round));
+      for (int k : {1, 5, 40}) {
+        vector<int> nn; vector<mstreal> nd;
+        kd.nearest(c, k, nn, &nd);
+        if (nn.size() != min(k, (int) byDist.size())) MstUtils::error("wrong number of nearest neighbors");
+        for (int i = 0; i < nn.size(); i++) {
+          if ((nn[i] != byDist[i].second) || (nd[i] != byDist[i].first)) MstUtils::error("nearest neighbors differ from brute force in round " + MstUtils::toString(round));
+        }
+      }
+      if (kd.nearest(c) != byDist[0].second) MstUtils::error("nearest neighbor differs from brute force");
+    }
+    // jiggle some points, remove some, and add a few new ones
+    for (int i = round; i < P.size(); i += 4) {
+      if (gone[i]) continue;
+      if (i % 3 == 0) { kd.removePoint(i); gone[i] = true; continue; }
+      P[i] += Point3(shift(rng), shift(rng), shift(rng));
+      kd.movePoint(i, P[i]);
+    }
+    for (int i = 0; i < 50; i++) {
+      Point3 p = P[i*7 % P.size()] + Point3(shift(rng), shift(rng), shift(rng));
+      if (kd.addPoint(p) != P.size()) MstUtils::error("unexpected index for added point");
+      P.push_back(p); gone.push_back(false);
+    }
+  }
+  vector<int> kdOffsets, kdList;
+  kd.nearest(atoms, 3, kdOffsets, kdList, false, numThreads);
+  for (int q = 0; q < atoms.size(); q++) {
+    vector<int> one;
+    kd.nearest(Point3(atoms[q]), 3, one);
+    if (!equal(one.begin(), one.end(), kdList.begin() + kdOffsets[q])) MstUtils::error("batch nearest-neighbor query differs for center " + MstUtils::toString(q));
+  }
+  cout << "k-d tree queries agree with brute force" << endl;
+
+  // the grid should be picked for a protein, and the tree for a few far-apart pieces of it
+  RangeSearch dense(atoms, 4.0);
+  vector<Point3> spread;
+  for (int i = 0; i < atoms.size(); i++) spread.push_back(Point3(atoms[i]) + Point3(200.0*(i % 5), 0, 0));
+  RangeSearch sparse(spread, 4.0);
+  if (!dense.usesCellList() || sparse.usesCellList()) MstUtils::error("unexpected choice of range search structure");
+  for (int i = 0; i < spread.size(); i += 13) {
+    vector<int> found, expected;
+    sparse.pointsWithin(spread[i], 0, 5.0, found);
+    sort(found.begin(), found.end());
+    for (int j = 0; j < spread.size(); j++) {
+      if (spread[i].distance(spread[j]) <= 5.0) expected.push_back(j);
+    }
+    if (found != expected) MstUtils::error("sparse range search differs from brute force");
+  }
+  cout << "range search picks the expected structure" << endl;
+
+  // timing of neighbor counting with each structure
+  timespec t0, t1, t2, t3;
+  ProximitySearch ps(atoms, 4.0);
+  int n1 = 0, n2 = 0, n3 = 0;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (int i = 0; i < atoms.size(); i++) n1 += ps.getPointsWithin(CartesianPoint(atoms[i]), 0, 8.0).size();
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  for (int i = 0; i < atoms.size(); i++) n2 += cl.numPointsWithin(Point3(atoms[i]), 0, 8.0);
+  clock_gettime(CLOCK_MONOTONIC, &t2);
+  KDTree tree(atoms);
+  for (int i = 0; i < atoms.size(); i++) n3 += tree.numPointsWithin(Point3(atoms[i]), 0, 8.0);
+  clock_gettime(CLOCK_MONOTONIC, &t3);
+  if ((n1 != n2) || (n1 != n3)) MstUtils::error("neighbor counts differ");
+  cout << n1 << " neighbor pairs, ProximitySearch: " << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1.0E9 << " s, CellList: " << (t2.tv_sec - t1.tv_sec) + (t2.tv_nsec - t1.tv_nsec)/1.0E9 << " s, KDTree: " << (t3.tv_sec - t2.tv_sec) + (t3.tv_nsec - t2.tv_nsec)/1.0E9 << " s" << endl;
+
+  printf("TEST DONE\n");
+}
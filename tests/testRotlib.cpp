@@ -33,6 +33,37 @@ int main(int argc, char** argv) {
   }
   S.writePDB(outBase + ".pdb", "renumber");
 
+  // batch placement of whole backbone bins should agree with one-at-a-time placement
+  printf("comparing batch placement with placing rotamers one at a time...\n");
+  vector<mstreal> coor;
+  for (int i = 0; i < S.chainSize(); i++) {
+    Chain& chain = S[i];
+    for (int j = 0; j < chain.residueSize(); j++) {
+      Residue& res = chain[j];
+      Transform T = RotamerLibrary::backboneFrame(res);
+      for (int ai = 0; ai < R.numberOfAminoAcids(); ai++) {
+        string aa = R.aminoAcidName(ai);
+        if (R.aminoAcidIndex(aa) != ai) MstUtils::error("amino-acid index of " + aa + " is not " + MstUtils::toString(ai));
+        int bi = R.getBackboneBin(ai, res.getPhi(), res.getPsi());
+        int nr = R.numberOfRotamers(ai, bi), na = R.numberOfRotamerAtoms(ai);
+        if (nr != R.numberOfRotamers(aa, res.getPhi(), res.getPsi())) MstUtils::error("different number of rotamers of " + aa + " at " + MstUtils::toString(res));
+        coor.resize(3*nr*na);
+        R.placeRotamers(T, ai, bi, coor.data());
+        Residue rot;
+        for (int r = 0; r < nr; r++) {
+          rotamerID rID = R.placeRotamer(res, aa, r, &rot);
+          if ((rID.binIndex() != bi) || (R.rotamerProbability(ai, bi, r) != R.rotamerProbability(rID))) MstUtils::error("different rotamer " + MstUtils::toString(r) + " of " + aa + " at " + MstUtils::toString(res));
+          for (int k = 0; k < na; k++) {
+            if (!rot[k].isNamed(R.rotamerAtomNames(ai)[k])) MstUtils::error("unexpected atom " + rot[k].getName() + " in rotamer of " + aa);
+            for (int d = 0; d < 3; d++) {
+              if (rot[k][d] != coor[3*(na*r + k) + d]) MstUtils::error("batch-placed rotamer " + MstUtils::toString(r) + " of " + aa + " at " + MstUtils::toString(res) + " differs");
+            }
+          }
+        }
+      }
+    }
+  }
+
   // place every rotamer at every position (as a test)
   printf("now placing every rotamer at every position...\n");
   for (int i = 0; i < S.chainSize(); i++) {
@@ -50,5 +81,38 @@ int main(int argc, char** argv) {
   }
   printf("done!\n");
 
+  // a compiled library should load to the same contents
+  printf("compiling the library and mapping it back...\n");
+  R.writeCompiledLibrary(outBase + ".rotlib");
+  RotamerLibrary C(outBase + ".rotlib");
+  if (!RotamerLibrary::isCompiledLibrary(outBase + ".rotlib") || RotamerLibrary::isCompiledLibrary(rotLibFile)) MstUtils::error("compiled library not recognized");
+  if (C.availableAminoAcids() != aas) MstUtils::error("compiled library has different amino acids");
+  for (int ai = 0; ai < R.numberOfAminoAcids(); ai++) {
+    string aa = R.aminoAcidName(ai);
+    if ((C.rotamerAtomNames(ai) != R.rotamerAtomNames(ai)) || (C.numberOfBackboneBins(ai) != R.numberOfBackboneBins(ai))) MstUtils::error("compiled library differs for " + aa);
+    for (int bi = 0; bi < R.numberOfBackboneBins(ai); bi++) {
+      int nr = R.numberOfRotamers(ai, bi), na = R.numberOfRotamerAtoms(ai);
+      if ((C.numberOfRotamers(ai, bi) != nr) || (C.getBinPhiPsi(aa, bi) != R.getBinPhiPsi(aa, bi))) MstUtils::error("compiled library differs in bin " + MstUtils::toString(bi) + " of " + aa);
+      for (int r = 0; r < nr; r++) {
+        if (C.rotamerProbability(ai, bi, r) != R.rotamerProbability(ai, bi, r)) MstUtils::error("compiled library has different probabilities for " + aa);
+      }
+      if (!equal(R.rotamerCoordinates(ai, bi), R.rotamerCoordinates(ai, bi) + 3*nr*na, C.rotamerCoordinates(ai, bi))) MstUtils::error("compiled library has different coordinates for " + aa);
+    }
+  }
+  for (int i = 0; i < S.chainSize(); i++) {
+    for (int j = 0; j < S[i].residueSize(); j++) {
+      Residue& res = S[i][j];
+      for (string aa : aas) {
+        if (C.getBackboneBin(aa, res.getPhi(), res.getPsi()) != R.getBackboneBin(aa, res.getPhi(), res.getPsi())) MstUtils::error("compiled library assigns a different bin for " + aa + " at " + MstUtils::toString(res));
+        Residue a, b;
+        R.placeRotamer(res, aa, 0, &a); C.placeRotamer(res, aa, 0, &b);
+        for (int k = 0; k < a.atomSize(); k++) {
+          if (a[k].distance(b[k]) != 0) MstUtils::error("compiled library places rotamers differently");
+        }
+      }
+    }
+  }
+  printf("done!\n");
+
   printf("TEST DONE\n");
 }
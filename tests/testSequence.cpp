@@ -18,6 +18,7 @@ int main(int argc, char *argv[]) {
   op.addOption("L", "sequence length (required if --c is given).");
   op.addOption("id", "sequence identity cutoff (default is 0.5).");
   op.addOption("b", "how much to bias the sequence selection (>= 1; 1 is default and means unbiased).");
+  op.addOption("j", "number of threads for rSearch (default is 1).");
   op.setOptions(argc, argv);
   srand(time(NULL) + (int) getpid());
   chrono::high_resolution_clock::time_point begin, end;
@@ -43,7 +44,7 @@ int main(int argc, char *argv[]) {
     // apply rSearch
     cout << "doing rSearch..." << endl;
     begin = chrono::high_resolution_clock::now();
-    vector<vector<int> > result = SeqTools::rSearch(seqs, idCut, 0.99, true);
+    vector<vector<int> > result = SeqTools::rSearch(seqs, idCut, 0.99, true, op.getInt("j", 1));
     end = chrono::high_resolution_clock::now();
     for (int i = 0; i < N; i++) {
       if (result[i].empty()) continue;
@@ -69,6 +70,9 @@ int main(int argc, char *argv[]) {
           if (seqs[i][k] == seqs[j][k]) n++;
         }
         if (n >= nID) resultBrute.push_back(j);
+        if ((SeqTools::sequenceIdentity(seqs[i], seqs[j]) != n) || (SeqTools::areSequencesWithinID(seqs[i], seqs[j], nID) != (n >= nID)) || (SeqTools::countMismatches(seqs[i].data(), seqs[j].data(), L, L - nID) <= L - nID) != (n >= nID)) {
+          MstUtils::error("packed identity counting disagrees with brute force for sequences " + MstUtils::toString(i) + " and " + MstUtils::toString(j));
+        }
       }
 
       // compare
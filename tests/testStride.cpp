@@ -17,6 +17,13 @@ int main(int argc, char *argv[]) {
     cout << ssType << endl;
   }
   
+  // in-process classifications should largely agree with those of STRIDE
+  vector<string> nativeSSType = secondaryStructureAssigner::assign(P);
+  MstUtils::assertCond(nativeSSType.size() == P.residueSize(), "there should be one in-process classification per residue");
+  int agree = 0;
+  for (int i = 0; i < MstUtils::min(nativeSSType.size(), strideSSType.size()); i++) agree += (nativeSSType[i] == strideSSType[i]);
+  cout << "In-process classifications agreeing with STRIDE: " << agree << "/" << nativeSSType.size() << endl;
+
   // test
   vector<string> test;
   test.resize(10,"X");
@@ -0,0 +1,142 @@
+#include "msttypes.h"
+#include "mstsystem.h"
+
+using namespace MST;
+
+string pdbString(const Structure& S) {
+  stringstream ss;
+  S.writePDB(ss);
+  return ss.str();
+}
+
+int main(int argc, char** argv) {
+  if (argc < 4) {
+    MstUtils::error("Usage: ./testStructureIO [PDB file] [mmCIF file of the same structure] [output file base] [number of threads, optional]", "main");
+  }
+  string pdbFile(argv[1]), cifFile(argv[2]), outBase(argv[3]);
+  int numThreads = (argc > 4) ? atoi(argv[4]) : 4;
+  vector<string> options = {"", "SKIPHETERO", "CHARMM", "IGNORE-TER"};
+
+  for (int i = 0; i < options.size(); i++) {
+    // reading from a file and from a stream should give the same thing
+    Structure S(pdbFile, options[i]);
+    fstream ifs; MstUtils::openFile(ifs, pdbFile, fstream::in);
+    Structure Ss(ifs, options[i]);
+    ifs.close();
+    if (pdbString(S) != pdbString(Ss)) MstUtils::error("reading '" + pdbFile + "' from a stream differs, with options '" + options[i] + "'");
+
+    // as should reading the mmCIF version of the file
+    Structure C(cifFile, options[i]);
+    if (pdbString(S) != pdbString(C)) MstUtils::error("reading '" + cifFile + "' gives a different structure, with options '" + options[i] + "'");
+  }
+  cout << "PDB and mmCIF files read the same" << endl;
+
+  // gzipped files
+  string gzFile = outBase + ".pdb.gz";
+  if (system(("gzip -c " + pdbFile + " > " + gzFile).c_str()) != 0) MstUtils::error("could not gzip '" + pdbFile + "'");
+  if (pdbString(Structure(pdbFile)) != pdbString(Structure(gzFile))) MstUtils::error("reading gzipped '" + gzFile + "' differs");
+  cout << "gzipped file reads the same" << endl;
+
+  // binary formats: the compact one and the original one should round-trip the same way
+  Structure B(pdbFile);
+  AtomPointerVector batoms = B.getAtoms();
+  for (int i = 0; i < batoms.size(); i += 7) batoms[i]->addAlternative(batoms[i]->getX() + 0.5, batoms[i]->getY(), batoms[i]->getZ(), 10.0, 0.25, 'B');
+  for (int version = 1; version <= 2; version++) {
+    stringstream ss;
+    B.writeData(ss, version);
+    B.writeData(ss, version);
+    for (int k = 0; k < 2; k++) {
+      Structure R; R.readData(ss);
+      if ((R.getName() != B.getName()) || (pdbString(R) != pdbString(B))) MstUtils::error("binary round trip differs with format version " + MstUtils::toString(version));
+      AtomPointerVector ratoms = R.getAtoms();
+      for (int i = 0; i < batoms.size(); i++) {
+        if ((ratoms[i]->numAlternatives() != batoms[i]->numAlternatives()) || (ratoms[i]->isHetero() != batoms[i]->isHetero()) || (ratoms[i]->getIndex() != batoms[i]->getIndex())) MstUtils::error("atom details differ after binary round trip with format version " + MstUtils::toString(version));
+        for (int a = 0; a < ratoms[i]->numAlternatives(); a++) {
+          if ((ratoms[i]->getAltCoor(a).distance(batoms[i]->getAltCoor(a)) != 0) || (ratoms[i]->getAltB(a) != batoms[i]->getAltB(a)) || (ratoms[i]->getAltOcc(a) != batoms[i]->getAltOcc(a)) || (ratoms[i]->getAltLocID(a) != batoms[i]->getAltLocID(a))) MstUtils::error("alternative locations differ after binary round trip with format version " + MstUtils::toString(version));
+        }
+      }
+    }
+  }
+  stringstream ss;
+  batoms.write(ss);
+  AtomPointerVector ratoms; ratoms.read(ss);
+  if (ratoms.size() != batoms.size()) MstUtils::error("AtomPointerVector binary round trip changed the number of atoms");
+  for (int i = 0; i < batoms.size(); i++) {
+    if ((ratoms[i]->getName() != batoms[i]->getName()) || (ratoms[i]->distance(batoms[i]) != 0) || (ratoms[i]->getB() != batoms[i]->getB()) || (ratoms[i]->numAlternatives() != batoms[i]->numAlternatives())) MstUtils::error("AtomPointerVector binary round trip differs");
+  }
+  ratoms.deletePointers();
+  cout << "binary formats round-trip" << endl;
+
+  // cached backbone dihedrals should match those computed without the cache,
+  // and the cache should be dropped when residues change
+  Structure D(pdbFile);
+  vector<Residue*> dres = D.getResidues();
+  vector<mstreal> phi, psi, omega;
+  D.backboneDihedrals(phi, psi, omega);
+  if (!D.isBackboneCached()) MstUtils::error("backboneDihedrals did not cache the backbone");
+  for (int i = 0; i < dres.size(); i++) {
+    if ((phi[i] != dres[i]->getPhi(false)) || (psi[i] != dres[i]->getPsi(false)) || (omega[i] != dres[i]->getOmega(false))) MstUtils::error("bulk backbone dihedrals differ from per-residue ones");
+  }
+  D.clearBackboneCache();
+  for (int i = 0; i < dres.size(); i++) {
+    if ((phi[i] != dres[i]->getPhi(false)) || (psi[i] != dres[i]->getPsi(false)) || (omega[i] != dres[i]->getOmega(false))) MstUtils::error("cached backbone dihedrals differ from uncached ones");
+  }
+  D.cacheBackbone();
+  D.getChain(0).appendResidue(new Residue(*(dres[0])));
+  if (D.isBackboneCached()) MstUtils::error("adding a residue did not drop the backbone cache");
+  cout << "backbone cache agrees with direct look-ups" << endl;
+
+  // names are interned, so the same name always has the same ID
+  int caID = MstNames::intern("CA");
+  if ((MstNames::find("CA") != caID) || (string(MstNames::name(caID)) != "CA")) MstUtils::error("interned name look-ups disagree");
+  for (Residue* R : dres) {
+    Atom* A = R->findAtom(caID, false);
+    if ((A != R->findAtom("CA", false)) || ((A != NULL) && !A->isNamed(caID))) MstUtils::error("atom look-up by name ID differs from that by name");
+    if (!R->isNamed(MstNames::find(R->getName()))) MstUtils::error("residue name ID does not match its name");
+  }
+  cout << "interned names agree with names" << endl;
+
+  // a view of the whole structure writes and copies as the structure does,
+  // and a view of part of it refers to the atoms of the parent
+  Structure V(pdbFile);
+  StructureView whole(V);
+  for (int ci = 0; ci < V.chainSize(); ci++) {
+    int first = V[ci][0].getResidueIndex();
+    whole.addSegment(first, first + V[ci].residueSize() - 1);
+  }
+  stringstream vs; whole.writePDB(vs);
+  if ((vs.str() != pdbString(V)) || (pdbString(whole.toStructure()) != pdbString(V))) MstUtils::error("view of the whole structure differs from the structure");
+  StructureView part(V);
+  for (int ri = 1; ri < V.residueSize(); ri += 3) part.addResidue(ri);
+  Structure copy = part.toStructure();
+  vector<Atom*> patoms = part.getAtoms();
+  if ((part.residueSize() != copy.residueSize()) || (part.chainSize() != copy.chainSize()) || (patoms.size() != copy.atomSize())) MstUtils::error("copy of a view differs in size from the view");
+  for (int i = 0; i < part.residueSize(); i++) {
+    if (&(part.getResidue(i)) != &(V.getResidue(part.parentIndex(i)))) MstUtils::error("view residue is not that of the parent");
+    if (part.getResidue(i).getName() != copy.getResidue(i).getName()) MstUtils::error("copy of a view has different residues");
+    if (part.residueIndexInChain(i) != copy.getResidue(i).getResidueIndexInChain()) MstUtils::error("copy of a view is split into chains differently");
+  }
+  for (int i = 0; i < patoms.size(); i++) {
+    if (patoms[i]->getParent()->getStructure() != &V) MstUtils::error("view atoms are not those of the parent");
+  }
+  cout << "structure views agree with their copies" << endl;
+
+  // parallel reading of many files
+  vector<string> files;
+  for (int i = 0; i < 50; i++) files.push_back((i % 3 == 0) ? cifFile : ((i % 3 == 1) ? pdbFile : gzFile));
+  timespec t0, t1;
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  vector<Structure*> many = Structure::readMany(files, numThreads);
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+  if (many.size() != files.size()) MstUtils::error("readMany returned the wrong number of structures");
+  string expected = pdbString(Structure(pdbFile));
+  for (int i = 0; i < many.size(); i++) {
+    if (many[i]->getName() != files[i]) MstUtils::error("structure " + MstUtils::toString(i) + " from readMany is out of order");
+    if (pdbString(*(many[i])) != expected) MstUtils::error("structure " + MstUtils::toString(i) + " from readMany differs");
+    delete many[i];
+  }
+  cout << "read " << files.size() << " files with " << numThreads << " threads in " << (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec)/1.0E9 << " s" << endl;
+  MstSys::crm(gzFile);
+
+  printf("TEST DONE\n");
+}
@@ -12,6 +12,7 @@ int main(int argc, char *argv[]) {
   op.setTitle("Tests MST::TERMANAL. Options:");
   op.addOption("t", "path to MST test directory.", true);
   op.addOption("b", "path to a binary FASST database.", true);
+  op.addOption("j", "also score on this many threads, checking that scores agree.");
   op.setOptions(argc, argv);
 
   MstUtils::setSignalHandlers();
@@ -35,4 +36,15 @@ int main(int argc, char *argv[]) {
   for (int i = 0; i < subR.size(); i++) cout << "structure score for " << *(subR[i]) << " = " << structScores[i] << endl;
   auto end = chrono::high_resolution_clock::now();
   cout << "scoring took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+
+  if (op.isGiven("j")) {
+    T.setNumThreads(op.getInt("j"));
+    begin = chrono::high_resolution_clock::now();
+    vector<mstreal> threadedScores = T.scoreStructure(subS);
+    end = chrono::high_resolution_clock::now();
+    for (int i = 0; i < subR.size(); i++) {
+      if (fabs(threadedScores[i] - structScores[i]) > 10E-8) MstUtils::error("threaded score differs from serial score at " + MstUtils::toString(*(subR[i])));
+    }
+    cout << "threaded scoring agrees with serial scoring, took " << chrono::duration_cast<std::chrono::milliseconds>(end-begin).count() << " ms" << endl;
+  }
 }
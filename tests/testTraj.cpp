@@ -0,0 +1,76 @@
+#include "msttypes.h"
+#include "msttraj.h"
+
+using namespace MST;
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    MstUtils::error("Usage: ./testTraj [PDB file] [output file base]", "main");
+  }
+  string pdbFile(argv[1]);
+  string trajFile = string(argv[2]) + ".trj";
+  int N = 250;
+  mstreal prec = 0.001;
+
+  // a random walk of the structure, written as a trajectory
+  Structure S(pdbFile);
+  AtomPointerVector atoms = S.getAtoms();
+  vector<vector<mstreal> > frames;
+  vector<mstreal> scores;
+  {
+    trajectoryWriter W(trajFile, prec, 20);
+    for (int f = 0; f < N; f++) {
+      for (int i = 0; i < atoms.size(); i++) {
+        for (int k = 0; k < 3; k++) (*atoms[i])[k] += MstUtils::randNormal(0, (f % 50 == 0) ? 5.0 : 0.2);
+      }
+      vector<mstreal> coords(3*atoms.size());
+      for (int i = 0; i < atoms.size(); i++) {
+        for (int k = 0; k < 3; k++) coords[3*i + k] = (*atoms[i])[k];
+      }
+      frames.push_back(coords);
+      scores.push_back(MstUtils::randUnit());
+      if (f % 2 == 0) W.addFrame(S, scores.back());
+      else W.addFrame(coords, scores.back());
+    }
+  }
+  // appended frames go after the existing ones
+  {
+    trajectoryWriter W(trajFile, S, prec, 20, true);
+    for (int f = 0; f < 10; f++) {
+      frames.push_back(frames[f]);
+      scores.push_back(f);
+      W.addFrame(frames[f], f);
+    }
+  }
+
+  // read back, to within the precision
+  trajectoryReader R(trajFile);
+  if (R.numAtoms() != atoms.size()) MstUtils::error("wrong number of atoms in trajectory topology");
+  vector<mstreal> coords; mstreal score;
+  while (R.readFrame(coords, score)) {
+    int f = R.numFramesRead() - 1;
+    if (f >= frames.size()) MstUtils::error("more frames read than written");
+    if (score != scores[f]) MstUtils::error("score of frame " + MstUtils::toString(f) + " differs");
+    for (int i = 0; i < coords.size(); i++) {
+      if (fabs(coords[i] - frames[f][i]) > prec/2 + 10E-9) MstUtils::error("coordinate of frame " + MstUtils::toString(f) + " off by more than the precision");
+    }
+  }
+  if (R.numFramesRead() != frames.size()) MstUtils::error("read " + MstUtils::toString(R.numFramesRead()) + " frames, but wrote " + MstUtils::toString(frames.size()));
+  string content; MstUtils::fileToString(trajFile, content);
+  cout << "wrote and read back " << frames.size() << " frames of " << atoms.size() << " atoms in " << content.size() << " bytes" << endl;
+
+  // the structure version gives the topology with the atoms moved
+  trajectoryReader R2(trajFile);
+  Structure snap;
+  R2.readFrame(snap, score);
+  if ((snap.residueSize() != S.residueSize()) || (fabs(snap.getAtoms()[0]->getX() - frames[0][0]) > prec)) MstUtils::error("structure frame differs");
+
+  // a frame cut short ends the trajectory
+  fstream out; MstUtils::openFile(out, trajFile, ios::out | ios::binary);
+  out.write(content.data(), content.size() - 5);
+  out.close();
+  trajectoryReader R3(trajFile);
+  while (R3.readFrame(coords, score));
+  if (R3.numFramesRead() != frames.size() - 1) MstUtils::error("truncated trajectory should end before its last frame");
+  printf("TEST DONE\n");
+}
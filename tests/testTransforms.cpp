@@ -51,6 +51,54 @@ int main(int argc, char** argv) {
   cout << "computing the same via the fast method in TransformRMSD: " << fastRMSD << endl;
   Sr.writePDB(outBase + ".cust.pdb");
 
+  // fixed-size points should transform and measure just like CartesianPoints
+  for (int i = 0; i + 3 < all.size(); i++) {
+    CartesianPoint a(all[i]), b(all[i+1]), c(all[i+2]), d(all[i+3]);
+    Point3 pa(all[i]), pb(all[i+1]), pc(all[i+2]), pd(all[i+3]);
+    if ((total * a).distance(CartesianPoint(total * pa)) > 10E-10) MstUtils::error("Point3 and CartesianPoint transform differently");
+    if (fabs(a.distance(b) - pa.distance(pb)) > 10E-10) MstUtils::error("Point3 and CartesianPoint distances differ");
+    if (a.cross(b).distance(CartesianPoint(pa.cross(pb))) > 10E-10) MstUtils::error("Point3 and CartesianPoint cross products differ");
+    if (fabs(a.dot(b) - pa.dot(pb)) > 10E-10) MstUtils::error("Point3 and CartesianPoint dot products differ");
+    if (fabs(CartesianGeometry::dihedral(a, b, c, d) - CartesianGeometry::dihedral(pa, pb, pc, pd)) > 10E-10) MstUtils::error("Point3 and CartesianPoint dihedrals differ");
+  }
+
+  // batch application and composition should agree with transforming one atom at a time
+  vector<mstreal> coor(3*all.size()), batch(3*all.size());
+  for (int i = 0; i < all.size(); i++) {
+    for (int d = 0; d < 3; d++) coor[3*i + d] = (*all[i])[d];
+  }
+  vector<Transform> chain = {rot2, tr, TransformFactory::rotateAroundZ(30)};
+  Transform composed = Transform::compose(chain);
+  composed.applyToCopy(coor.data(), all.size(), batch.data());
+  vector<mstreal> each(3*all.size()*chain.size());
+  Transform::applyEach(chain, coor.data(), all.size(), each.data());
+  for (int i = 0; i < all.size(); i++) {
+    CartesianPoint p(all[i]);
+    for (int t = 0; t < chain.size(); t++) {
+      CartesianPoint q = chain[t] * CartesianPoint(all[i]);
+      if (q.distance(CartesianPoint(each[3*(all.size()*t + i)], each[3*(all.size()*t + i) + 1], each[3*(all.size()*t + i) + 2])) > 10E-10) MstUtils::error("batch application of each transform differs from point-wise application");
+      chain[t].apply(p);
+    }
+    if (p.distance(CartesianPoint(batch[3*i], batch[3*i+1], batch[3*i+2])) > 10E-10) MstUtils::error("composed batch transform differs from sequential application");
+  }
+  cout << "batch transform application agrees with point-wise application" << endl;
+
+  // sliding-window residuals, through the specialized and the generic kernels,
+  // should agree with superimposing each window on its own
+  RMSDCalculator rc;
+  for (int step : {1, 3, 4}) {
+    int n = 8*step, numWindows = (all.size() - n)/step + 1;
+    if (numWindows < 1) continue;
+    vector<mstreal> ref(coor.begin() + 3*step, coor.begin() + 3*(step + n)), res;
+    Transform::compose({rot2, tr}).apply(ref.data(), n);
+    rc.windowResiduals(ref.data(), n, coor.data(), numWindows, step, res);
+    for (int w = 0; w < numWindows; w++) {
+      mstreal r = rc.bestResidual(coor.data() + 3*w*step, ref.data(), n);
+      if (fabs(res[w] - r) > 10E-6*MstUtils::max(1.0, r)) MstUtils::error("windowed residual differs from single superposition for step " + MstUtils::toString(step));
+    }
+  }
+  cout << "windowed residuals agree with single superpositions" << endl;
+
   // dome some simple matrix algebra
   srand(time(NULL));
   Matrix M(4, 4);
@@ -11,6 +11,7 @@ int main(int argc, char *argv[]) {
   op.addOption("p", "template PDB file.", true);
   op.addOption("t", "test files directory.", true);
   op.addOption("o", "output base.", true);
+  op.addOption("j", "number of threads to build the energy table with (default is 1).");
   op.setOptions(argc, argv);
 
   Structure S(op.getString("p"));
@@ -20,7 +21,34 @@ int main(int argc, char *argv[]) {
 
   // build the energy table
   if (!MstSys::fileExists(etabFile)) {
-    dTERMen D(op.getString("t") + "/dtermen.conf");
+    dTERMen D;
+    D.setNumThreads(op.getInt("j", 1));
+    D.readConfigFile(op.getString("t") + "/dtermen.conf");
+
+    // background potentials should survive being written and read back, and
+    // rebuilding them (with any number of threads) should give the same ones
+    auto backgroundEnergies = [&D]() {
+      vector<mstreal> ener;
+      for (int ai = 0; ai < D.globalAlphabetSize(); ai++) {
+        string aa = D.indexToResName(ai);
+        ener.push_back(D.backEner(aa));
+        for (mstreal x = -175; x < 180; x += 10) {
+          ener.push_back(D.bbOmegaEner(x, aa));
+          for (mstreal y = -175; y < 180; y += 10) ener.push_back(D.bbPhiPsiEner(x, y, aa));
+        }
+        for (mstreal env = 0; env <= 1; env += 0.05) ener.push_back(D.envEner(env, aa));
+      }
+      return ener;
+    };
+    string potFile = op.getString("o") + ".bkpot";
+    vector<mstreal> built = backgroundEnergies();
+    D.writeBackgroundPotentials(potFile);
+    D.buildBackgroundPotentials();
+    if (backgroundEnergies() != built) MstUtils::error("rebuilding background potentials gave different potentials");
+    if (!D.readBackgroundPotentials(potFile) || (backgroundEnergies() != built)) MstUtils::error("background potentials read back differ from those written");
+    MstSys::crm(potFile);
+    cout << "background potentials were written and read back" << endl;
+
     E = D.buildEnergyTable(residues);
     E.writeToFile(etabFile);
   } else {